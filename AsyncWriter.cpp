@@ -0,0 +1,315 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "AsyncWriter.h"
+
+CAsyncWriter::CAsyncWriter() :
+    _Sink(NULL),
+    _BlockSize(0),
+    _FreeCount(0),
+    _FilledHead(0),
+    _FilledCount(0),
+    _Writing(false),
+    _Stopping(false),
+    _CurrentBlock(NULL),
+    _Failed(false),
+    _BytesSinceFlush(0),
+    _Histograms(NULL),
+    _BytesWritten(0),
+    _Writes(0),
+    _Flushes(0),
+    _RejectedBytes(0),
+    _QueueDepth(0),
+    _MaxQueueDepth(0),
+    _TotalWriteLatencyUs(0),
+    _MaxWriteLatencyUs(0),
+    _TotalFlushLatencyUs(0),
+    _MaxFlushLatencyUs(0)
+{
+    memset(&_Policy, 0, sizeof(_Policy));
+}
+
+CAsyncWriter::~CAsyncWriter()
+{
+    Close();
+}
+
+bool CAsyncWriter::Initialize(IOutputSink* Sink, size_t BlockSize, size_t BlockCount, const DurabilityPolicy& Policy,
+    AsyncWriterHistograms* Histograms)
+{
+    if (Sink == NULL || BlockSize == 0 || BlockCount < 2)
+    {
+        fprintf(stderr, "Invalid writer parameters.\n");
+        return false;
+    }
+
+    _Sink = Sink;
+    _Policy = Policy;
+    _Histograms = Histograms;
+    _BlockSize = BlockSize;
+    _Storage.assign(BlockSize * BlockCount, 0);
+    _Blocks.resize(BlockCount);
+    _FreeBlocks.resize(BlockCount);
+    _FilledBlocks.resize(BlockCount);
+    for (size_t i = 0; i < BlockCount; i++)
+    {
+        _Blocks[i].Data = &_Storage[i * BlockSize];
+        _Blocks[i].Size = 0;
+        _FreeBlocks[i] = &_Blocks[i];
+    }
+    _FreeCount = BlockCount;
+    _FilledHead = 0;
+    _FilledCount = 0;
+    _Stopping = false;
+
+    _WriterThread = std::thread(&CAsyncWriter::WriterThread, this);
+    return true;
+}
+
+size_t CAsyncWriter::WritableBytes()
+{
+    size_t writableBytes = 0;
+    if (_CurrentBlock != NULL)
+    {
+        writableBytes = _BlockSize - _CurrentBlock->Size;
+    }
+
+    std::lock_guard<std::mutex> lock(_Lock);
+    return writableBytes + _FreeCount * _BlockSize;
+}
+
+size_t CAsyncWriter::Write(const uint8_t* Data, size_t Size)
+{
+    size_t accepted = 0;
+    while (accepted < Size)
+    {
+        if (_CurrentBlock == NULL)
+        {
+            std::lock_guard<std::mutex> lock(_Lock);
+            if (_FreeCount == 0)
+            {
+                break;
+            }
+            _CurrentBlock = _FreeBlocks[--_FreeCount];
+            _CurrentBlock->Size = 0;
+        }
+
+        size_t bytesToCopy = _BlockSize - _CurrentBlock->Size;
+        if (bytesToCopy > Size - accepted)
+        {
+            bytesToCopy = Size - accepted;
+        }
+        memcpy(_CurrentBlock->Data + _CurrentBlock->Size, Data + accepted, bytesToCopy);
+        _CurrentBlock->Size += bytesToCopy;
+        accepted += bytesToCopy;
+
+        if (_CurrentBlock->Size == _BlockSize)
+        {
+            std::lock_guard<std::mutex> lock(_Lock);
+            QueueBlockLocked(_CurrentBlock);
+            _CurrentBlock = NULL;
+        }
+    }
+
+    if (accepted < Size)
+    {
+        _RejectedBytes.fetch_add(Size - accepted, std::memory_order_relaxed);
+    }
+    return accepted;
+}
+
+//
+//  End of a pacing tick.  Hand over the partial block only if the writer has nothing to do; otherwise keep filling it
+//  so the next write is larger.
+//
+void CAsyncWriter::Submit()
+{
+    if (_CurrentBlock == NULL || _CurrentBlock->Size == 0)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_Lock);
+    if (_FilledCount == 0 && !_Writing)
+    {
+        QueueBlockLocked(_CurrentBlock);
+        _CurrentBlock = NULL;
+    }
+}
+
+void CAsyncWriter::QueueBlockLocked(WriterBlock* Block)
+{
+    _FilledBlocks[(_FilledHead + _FilledCount) % _FilledBlocks.size()] = Block;
+    _FilledCount++;
+
+    uint32_t depth = static_cast<uint32_t>(_FilledCount);
+    _QueueDepth.store(depth, std::memory_order_relaxed);
+    if (depth > _MaxQueueDepth.load(std::memory_order_relaxed))
+    {
+        _MaxQueueDepth.store(depth, std::memory_order_relaxed);
+    }
+    if (_Histograms != NULL)
+    {
+        _Histograms->QueueDepth.Record(depth);
+    }
+    _WorkAvailable.notify_one();
+}
+
+bool CAsyncWriter::Close()
+{
+    if (!_WriterThread.joinable())
+    {
+        return !Failed();
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_Lock);
+        if (_CurrentBlock != NULL && _CurrentBlock->Size != 0)
+        {
+            QueueBlockLocked(_CurrentBlock);
+        }
+        _CurrentBlock = NULL;
+        _Stopping = true;
+        _WorkAvailable.notify_one();
+    }
+    _WriterThread.join();
+
+    //
+    //  Whatever the policy, the output is durable once we're closed.
+    //
+    if (!Failed() && !FlushSink())
+    {
+        _Failed.store(true, std::memory_order_release);
+    }
+    if (!_Sink->Close())
+    {
+        _Failed.store(true, std::memory_order_release);
+    }
+    return !Failed();
+}
+
+//
+//  Writer thread - writes queued blocks in order and applies the durability policy.
+//
+void CAsyncWriter::WriterThread()
+{
+    std::chrono::steady_clock::time_point lastFlush = std::chrono::steady_clock::now();
+    std::unique_lock<std::mutex> lock(_Lock);
+
+    for (;;)
+    {
+        if (_FilledCount == 0 && !_Stopping)
+        {
+            if (_Policy.FlushIntervalMs != 0 && _BytesSinceFlush != 0)
+            {
+                _WorkAvailable.wait_until(lock, lastFlush + std::chrono::milliseconds(_Policy.FlushIntervalMs));
+            }
+            else
+            {
+                _WorkAvailable.wait(lock);
+            }
+        }
+        if (_FilledCount == 0 && _Stopping)
+        {
+            break;
+        }
+
+        //
+        //  Take every queued block at once and write them without holding the lock.
+        //
+        size_t blockCount = _FilledCount;
+        size_t head = _FilledHead;
+        _Writing = blockCount != 0;
+        lock.unlock();
+
+        for (size_t i = 0; i < blockCount; i++)
+        {
+            WriterBlock* block = _FilledBlocks[(head + i) % _FilledBlocks.size()];
+            if (!Failed() && !WriteBlock(block))
+            {
+                _Failed.store(true, std::memory_order_release);
+            }
+        }
+
+        bool flushDue = _BytesSinceFlush != 0 &&
+            ((_Policy.FlushBytes != 0 && _BytesSinceFlush >= _Policy.FlushBytes) ||
+             (_Policy.FlushIntervalMs != 0 && std::chrono::steady_clock::now() - lastFlush >= std::chrono::milliseconds(_Policy.FlushIntervalMs)));
+        if (flushDue && !Failed())
+        {
+            if (!FlushSink())
+            {
+                _Failed.store(true, std::memory_order_release);
+            }
+            lastFlush = std::chrono::steady_clock::now();
+        }
+
+        lock.lock();
+        for (size_t i = 0; i < blockCount; i++)
+        {
+            _FreeBlocks[_FreeCount++] = _FilledBlocks[_FilledHead];
+            _FilledHead = (_FilledHead + 1) % _FilledBlocks.size();
+            _FilledCount--;
+        }
+        _QueueDepth.store(static_cast<uint32_t>(_FilledCount), std::memory_order_relaxed);
+        _Writing = false;
+    }
+}
+
+bool CAsyncWriter::WriteBlock(WriterBlock* Block)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool succeeded = _Sink->Write(Block->Data, Block->Size);
+    uint64_t latencyNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    uint64_t latencyUs = latencyNs / 1000;
+    if (_Histograms != NULL)
+    {
+        _Histograms->WriteLatencyNs.Record(latencyNs);
+    }
+
+    _BytesSinceFlush += Block->Size;
+    _BytesWritten.fetch_add(Block->Size, std::memory_order_relaxed);
+    _Writes.fetch_add(1, std::memory_order_relaxed);
+    _TotalWriteLatencyUs.fetch_add(latencyUs, std::memory_order_relaxed);
+    if (latencyUs > _MaxWriteLatencyUs.load(std::memory_order_relaxed))
+    {
+        _MaxWriteLatencyUs.store(latencyUs, std::memory_order_relaxed);
+    }
+    return succeeded;
+}
+
+bool CAsyncWriter::FlushSink()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    bool succeeded = _Sink->Flush();
+    uint64_t latencyNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    uint64_t latencyUs = latencyNs / 1000;
+    if (_Histograms != NULL)
+    {
+        _Histograms->FlushLatencyNs.Record(latencyNs);
+    }
+
+    _BytesSinceFlush = 0;
+    _Flushes.fetch_add(1, std::memory_order_relaxed);
+    _TotalFlushLatencyUs.fetch_add(latencyUs, std::memory_order_relaxed);
+    if (latencyUs > _MaxFlushLatencyUs.load(std::memory_order_relaxed))
+    {
+        _MaxFlushLatencyUs.store(latencyUs, std::memory_order_relaxed);
+    }
+    return succeeded;
+}
+
+void CAsyncWriter::GetStats(AsyncWriterStats* Stats) const
+{
+    Stats->BytesWritten = _BytesWritten.load(std::memory_order_relaxed);
+    Stats->Writes = _Writes.load(std::memory_order_relaxed);
+    Stats->Flushes = _Flushes.load(std::memory_order_relaxed);
+    Stats->RejectedBytes = _RejectedBytes.load(std::memory_order_relaxed);
+    Stats->QueueDepth = _QueueDepth.load(std::memory_order_relaxed);
+    Stats->MaxQueueDepth = _MaxQueueDepth.load(std::memory_order_relaxed);
+    Stats->TotalWriteLatencyUs = _TotalWriteLatencyUs.load(std::memory_order_relaxed);
+    Stats->MaxWriteLatencyUs = _MaxWriteLatencyUs.load(std::memory_order_relaxed);
+    Stats->TotalFlushLatencyUs = _TotalFlushLatencyUs.load(std::memory_order_relaxed);
+    Stats->MaxFlushLatencyUs = _MaxFlushLatencyUs.load(std::memory_order_relaxed);
+}
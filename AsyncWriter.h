@@ -0,0 +1,137 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "OutputSink.h"
+#include "LatencyHistogram.h"
+
+//
+//  When the writer thread makes written data durable.  Both triggers may be combined; with both at 0 the writer never
+//  flushes and leaves it to the OS.
+//
+struct DurabilityPolicy
+{
+    uint32_t FlushIntervalMs;   // Flush at most this long after data was written.
+    uint64_t FlushBytes;        // Flush once this many bytes were written since the last flush.
+};
+
+//
+//  Writer statistics.  Latencies are in microseconds.
+//
+struct AsyncWriterStats
+{
+    uint64_t BytesWritten;
+    uint64_t Writes;
+    uint64_t Flushes;
+    uint64_t RejectedBytes;     // Bytes Write() couldn't accept because every block was queued.
+    uint32_t QueueDepth;        // Blocks queued for the writer thread right now.
+    uint32_t MaxQueueDepth;
+    uint64_t TotalWriteLatencyUs;
+    uint64_t MaxWriteLatencyUs;
+    uint64_t TotalFlushLatencyUs;
+    uint64_t MaxFlushLatencyUs;
+};
+
+//
+//  Histograms the writer records into: the latency of every sink write and flush, in nanoseconds, and the queue depth
+//  each time a block is queued.
+//
+struct AsyncWriterHistograms
+{
+    CLatencyHistogram   WriteLatencyNs;
+    CLatencyHistogram   FlushLatencyNs;
+    CLatencyHistogram   QueueDepth;
+};
+
+//
+//  Asynchronous, multi-buffered writer.
+//
+//  The pacing loop copies captured bytes into the current block with Write() and never touches the disk.  Filled
+//  blocks go to a queue served by a dedicated writer thread.  A block is handed over when it is full, or at the end
+//  of a tick if the writer is idle - so when the disk keeps up, data reaches the file every tick, and when it
+//  doesn't, later ticks coalesce into full blocks and the writer issues fewer, larger writes.  All blocks are
+//  allocated in Initialize().
+//
+class CAsyncWriter
+{
+public:
+    CAsyncWriter();
+    ~CAsyncWriter();
+
+    bool Initialize(IOutputSink* Sink, size_t BlockSize, size_t BlockCount, const DurabilityPolicy& Policy,
+        AsyncWriterHistograms* Histograms = NULL);
+
+    //
+    //  Producer side.  Write() copies as much as fits in free blocks and returns the number of bytes taken; it never
+    //  waits for the writer thread.  WritableBytes() is how much the next Write() is guaranteed to take.  Submit() ends
+    //  a tick.
+    //
+    size_t WritableBytes();
+    size_t Write(const uint8_t* Data, size_t Size);
+    void Submit();
+
+    //
+    //  Drain every queued block, make it durable and close the sink.
+    //
+    bool Close();
+
+    bool Failed() const { return _Failed.load(std::memory_order_acquire); }
+    void GetStats(AsyncWriterStats* Stats) const;
+
+private:
+    struct WriterBlock
+    {
+        uint8_t*    Data;
+        size_t      Size;
+    };
+
+    void QueueBlockLocked(WriterBlock* Block);
+    void WriterThread();
+    bool WriteBlock(WriterBlock* Block);
+    bool FlushSink();
+
+    IOutputSink*                _Sink;
+    DurabilityPolicy            _Policy;
+    size_t                      _BlockSize;
+    std::vector<uint8_t>        _Storage;
+    std::vector<WriterBlock>    _Blocks;
+
+    //
+    //  Both queues hold at most every block, so they are fixed size rings of block pointers.
+    //
+    std::vector<WriterBlock*>   _FreeBlocks;
+    size_t                      _FreeCount;
+    std::vector<WriterBlock*>   _FilledBlocks;
+    size_t                      _FilledHead;
+    size_t                      _FilledCount;
+    bool                        _Writing;
+    bool                        _Stopping;
+    std::mutex                  _Lock;
+    std::condition_variable     _WorkAvailable;
+
+    //
+    //  Block being filled by the producer.  Only the producer touches it.
+    //
+    WriterBlock*                _CurrentBlock;
+
+    std::thread                 _WriterThread;
+    std::atomic<bool>           _Failed;
+    uint64_t                    _BytesSinceFlush;
+
+    AsyncWriterHistograms*      _Histograms;
+    std::atomic<uint64_t>       _BytesWritten;
+    std::atomic<uint64_t>       _Writes;
+    std::atomic<uint64_t>       _Flushes;
+    std::atomic<uint64_t>       _RejectedBytes;
+    std::atomic<uint32_t>       _QueueDepth;
+    std::atomic<uint32_t>       _MaxQueueDepth;
+    std::atomic<uint64_t>       _TotalWriteLatencyUs;
+    std::atomic<uint64_t>       _MaxWriteLatencyUs;
+    std::atomic<uint64_t>       _TotalFlushLatencyUs;
+    std::atomic<uint64_t>       _MaxFlushLatencyUs;
+};
@@ -0,0 +1,140 @@
+#pragma once
+
+//
+//  Portable audio format definitions.
+//
+//  The capture pipeline describes audio with WAVEFORMATEX / WAVEFORMATEXTENSIBLE everywhere, like the WASAPI mix
+//  format does.  On Windows those come from the SDK; elsewhere we declare layout compatible equivalents so the
+//  portable core and backends can share them.
+//
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef _WIN32
+
+// Keep windows.h from defining min and max macros, which break std::min and std::max
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <mmreg.h>
+
+#else
+
+typedef uint8_t     BYTE;
+typedef uint16_t    WORD;
+typedef uint32_t    DWORD;
+typedef uint32_t    UINT32;
+typedef uint64_t    UINT64;
+typedef int32_t     LONG;
+typedef uint32_t    ULONG;
+
+#define STDMETHODCALLTYPE
+
+typedef struct _GUID
+{
+    uint32_t Data1;
+    uint16_t Data2;
+    uint16_t Data3;
+    uint8_t  Data4[8];
+} GUID;
+
+#pragma pack(push, 1)
+
+typedef struct tWAVEFORMATEX
+{
+    WORD    wFormatTag;
+    WORD    nChannels;
+    DWORD   nSamplesPerSec;
+    DWORD   nAvgBytesPerSec;
+    WORD    nBlockAlign;
+    WORD    wBitsPerSample;
+    WORD    cbSize;
+} WAVEFORMATEX;
+
+typedef struct
+{
+    WAVEFORMATEX Format;
+    union
+    {
+        WORD wValidBitsPerSample;
+        WORD wSamplesPerBlock;
+        WORD wReserved;
+    } Samples;
+    DWORD   dwChannelMask;
+    GUID    SubFormat;
+} WAVEFORMATEXTENSIBLE;
+
+#pragma pack(pop)
+
+#define WAVE_FORMAT_PCM         0x0001
+#define WAVE_FORMAT_IEEE_FLOAT  0x0003
+#define WAVE_FORMAT_EXTENSIBLE  0xFFFE
+
+//
+//  WAVEFORMATEXTENSIBLE dwChannelMask speaker positions.
+//
+#define SPEAKER_FRONT_LEFT              0x1
+#define SPEAKER_FRONT_RIGHT             0x2
+#define SPEAKER_FRONT_CENTER            0x4
+#define SPEAKER_LOW_FREQUENCY           0x8
+#define SPEAKER_BACK_LEFT               0x10
+#define SPEAKER_BACK_RIGHT              0x20
+#define SPEAKER_FRONT_LEFT_OF_CENTER    0x40
+#define SPEAKER_FRONT_RIGHT_OF_CENTER   0x80
+#define SPEAKER_BACK_CENTER             0x100
+#define SPEAKER_SIDE_LEFT               0x200
+#define SPEAKER_SIDE_RIGHT              0x400
+#define SPEAKER_TOP_CENTER              0x800
+#define SPEAKER_TOP_FRONT_LEFT          0x1000
+#define SPEAKER_TOP_FRONT_CENTER        0x2000
+#define SPEAKER_TOP_FRONT_RIGHT         0x4000
+#define SPEAKER_TOP_BACK_LEFT           0x8000
+#define SPEAKER_TOP_BACK_CENTER         0x10000
+#define SPEAKER_TOP_BACK_RIGHT          0x20000
+
+#endif
+
+//
+//  Size of the WAVEFORMATEXTENSIBLE extension that follows WAVEFORMATEX.
+//
+#define WAVEFORMATEXTENSIBLE_EXTRA_SIZE (sizeof(WAVEFORMATEXTENSIBLE) - sizeof(WAVEFORMATEX))
+
+//
+//  The sample type of a format with the WAVE_FORMAT_EXTENSIBLE indirection resolved.  The KSDATAFORMAT_SUBTYPE_xxx
+//  GUIDs carry the legacy format tag in Data1.
+//
+inline WORD EffectiveFormatTag(const WAVEFORMATEX* WaveFormat)
+{
+    if (WaveFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE && WaveFormat->cbSize >= WAVEFORMATEXTENSIBLE_EXTRA_SIZE)
+    {
+        return static_cast<WORD>(reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(WaveFormat)->SubFormat.Data1);
+    }
+    return WaveFormat->wFormatTag;
+}
+
+inline bool IsFloatFormat(const WAVEFORMATEX* WaveFormat)
+{
+    return EffectiveFormatTag(WaveFormat) == WAVE_FORMAT_IEEE_FLOAT;
+}
+
+//
+//  Fill in a WAVEFORMATEXTENSIBLE for interleaved PCM or float samples.  ChannelMask 0 leaves the layout unspecified.
+//
+inline void InitializeWaveFormat(WAVEFORMATEXTENSIBLE* WaveFormat, bool IsFloat, WORD Channels, DWORD SamplesPerSec, WORD BitsPerSample, DWORD ChannelMask)
+{
+    static const GUID subFormatTemplate = { 0, 0x0000, 0x0010, { 0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71 } };
+
+    WaveFormat->Format.wFormatTag = WAVE_FORMAT_EXTENSIBLE;
+    WaveFormat->Format.nChannels = Channels;
+    WaveFormat->Format.nSamplesPerSec = SamplesPerSec;
+    WaveFormat->Format.wBitsPerSample = BitsPerSample;
+    WaveFormat->Format.nBlockAlign = static_cast<WORD>(Channels * BitsPerSample / 8);
+    WaveFormat->Format.nAvgBytesPerSec = SamplesPerSec * WaveFormat->Format.nBlockAlign;
+    WaveFormat->Format.cbSize = WAVEFORMATEXTENSIBLE_EXTRA_SIZE;
+    WaveFormat->Samples.wValidBitsPerSample = BitsPerSample;
+    WaveFormat->dwChannelMask = ChannelMask;
+    WaveFormat->SubFormat = subFormatTemplate;
+    WaveFormat->SubFormat.Data1 = IsFloat ? WAVE_FORMAT_IEEE_FLOAT : WAVE_FORMAT_PCM;
+}
@@ -0,0 +1,615 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "CaptureDrain.h"
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t SystemClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+CCaptureDrain::CCaptureDrain() :
+    _RingBuffer(NULL),
+    _SourceFrameSize(0),
+    _MaxChunkFrames(0),
+    _AdapterActive(false),
+    _Remixer(NULL),
+    _Resampler(NULL),
+    _Converter(NULL),
+    _Meter(NULL),
+    _PacketLog(NULL),
+    _RingFrames(0),
+    _GapPolicy(CaptureGapMark),
+    _LostFrames(0),
+    _PendingFillFrames(0),
+    _MaxFillFrames(0),
+    _NextDevicePosition(0),
+    _HaveDevicePosition(false),
+    _DeviceRate(0),
+    _RingRate(0),
+    _Overrun(false),
+    _DeviceClock(NULL),
+    _WakeupTimeNs(0),
+    _WakeupWallTimeNs(0),
+    _WakeupDeviceTime(0),
+    _WakeupPeriodInHns(0),
+    _LastWakeupTime(0),
+    _Histograms(NULL),
+    _OldestAgeNs(0),
+    _FramesReserved(0),
+    _FramesStored(0),
+    _Region(0),
+    _RegionOffset(0),
+    _Wakeups(0),
+    _PacketsDrained(0),
+    _FramesMoved(0),
+    _LastWakeupPackets(0),
+    _LastWakeupFrames(0),
+    _MaxWakeupPackets(0),
+    _StreamSwitches(0),
+    _SwitchSilenceFrames(0),
+    _LastSwitchInHns(0),
+    _MaxSwitchInHns(0),
+    _Glitches(0),
+    _GlitchFrames(0),
+    _DiscardedFrames(0),
+    _Overruns(0),
+    _SilentPackets(0),
+    _LateWakeups(0),
+    _FilledFrames(0)
+{
+    memset(&_SourceFormat, 0, sizeof(_SourceFormat));
+}
+
+bool CCaptureDrain::Attach(CCaptureRingBuffer* RingBuffer, const CaptureProcessing* Processing, const WAVEFORMATEX* SourceFormat,
+    ICaptureClock* DeviceClock, int64_t WakeupPeriodInHns)
+{
+    const size_t SourceFrameSize = SourceFormat->nBlockAlign;
+    CChannelRemixer* remixer = Processing != NULL ? Processing->Remixer : NULL;
+    CResampler* resampler = Processing != NULL ? Processing->Resampler : NULL;
+    CSampleConverter* converter = Processing != NULL ? Processing->Converter : NULL;
+    CLevelMeter* meter = Processing != NULL ? Processing->Meter : NULL;
+
+    size_t frameSize = SourceFrameSize;
+    size_t maxChunkFrames = SIZE_MAX;
+    if (remixer != NULL)
+    {
+        if (remixer->InputFrameSize() != frameSize)
+        {
+            fprintf(stderr, "Remixer frame size %zu doesn't match the source frame size %zu.\n", remixer->InputFrameSize(), frameSize);
+            return false;
+        }
+        frameSize = remixer->OutputFrameSize();
+        maxChunkFrames = remixer->MaxFrames();
+    }
+    if (resampler != NULL)
+    {
+        if (resampler->InputFrameSize() != frameSize)
+        {
+            fprintf(stderr, "Resampler frame size %zu doesn't match the incoming frame size %zu.\n", resampler->InputFrameSize(), frameSize);
+            return false;
+        }
+        frameSize = resampler->OutputFrameSize();
+        if (resampler->MaxInputFrames() < maxChunkFrames)
+        {
+            maxChunkFrames = resampler->MaxInputFrames();
+        }
+    }
+    if (meter != NULL && meter->FrameSize() != frameSize)
+    {
+        fprintf(stderr, "Level meter frame size %zu doesn't match the incoming frame size %zu.\n", meter->FrameSize(), frameSize);
+        return false;
+    }
+    if (converter != NULL)
+    {
+        if (converter->InputFrameSize() != frameSize)
+        {
+            fprintf(stderr, "Converter frame size %zu doesn't match the incoming frame size %zu.\n", converter->InputFrameSize(), frameSize);
+            return false;
+        }
+        frameSize = converter->OutputFrameSize();
+    }
+    if (RingBuffer->FrameSize() != frameSize)
+    {
+        fprintf(stderr, "Ring buffer frame size %zu doesn't match the source frame size %zu.\n", RingBuffer->FrameSize(), frameSize);
+        return false;
+    }
+
+    if (resampler != NULL)
+    {
+        resampler->Reset();
+    }
+    if (meter != NULL)
+    {
+        meter->Reset();
+    }
+    _RingBuffer = RingBuffer;
+    size_t formatSize = sizeof(WAVEFORMATEX) + SourceFormat->cbSize;
+    memset(&_SourceFormat, 0, sizeof(_SourceFormat));
+    memcpy(&_SourceFormat, SourceFormat, formatSize < sizeof(_SourceFormat) ? formatSize : sizeof(_SourceFormat));
+    _SourceFrameSize = SourceFrameSize;
+    _AdapterActive = false;
+    _MaxChunkFrames = maxChunkFrames;
+    _Remixer = remixer;
+    _Resampler = resampler;
+    _Converter = converter;
+    _Meter = meter;
+    _PacketLog = Processing != NULL ? Processing->PacketLog : NULL;
+    _RingFrames = 0;
+    _GapPolicy = Processing != NULL ? Processing->GapPolicy : CaptureGapMark;
+    _LostFrames = 0;
+    _PendingFillFrames = 0;
+    _HaveDevicePosition = false;
+    _DeviceRate = SourceFormat->nSamplesPerSec;
+    _RingRate = resampler != NULL ? resampler->OutputFormat()->nSamplesPerSec : SourceFormat->nSamplesPerSec;
+    _MaxFillFrames = static_cast<uint64_t>(_RingRate) * 10;
+    _Overrun = false;
+    _DeviceClock = DeviceClock;
+    _WakeupPeriodInHns = WakeupPeriodInHns;
+    _LastWakeupTime = 0;
+    _Histograms = Processing != NULL ? Processing->Histograms : NULL;
+    _Wakeups.store(0, std::memory_order_relaxed);
+    _PacketsDrained.store(0, std::memory_order_relaxed);
+    _FramesMoved.store(0, std::memory_order_relaxed);
+    _LastWakeupPackets.store(0, std::memory_order_relaxed);
+    _LastWakeupFrames.store(0, std::memory_order_relaxed);
+    _MaxWakeupPackets.store(0, std::memory_order_relaxed);
+    _StreamSwitches.store(0, std::memory_order_relaxed);
+    _SwitchSilenceFrames.store(0, std::memory_order_relaxed);
+    _LastSwitchInHns.store(0, std::memory_order_relaxed);
+    _MaxSwitchInHns.store(0, std::memory_order_relaxed);
+    _Glitches.store(0, std::memory_order_relaxed);
+    _GlitchFrames.store(0, std::memory_order_relaxed);
+    _DiscardedFrames.store(0, std::memory_order_relaxed);
+    _Overruns.store(0, std::memory_order_relaxed);
+    _SilentPackets.store(0, std::memory_order_relaxed);
+    _LateWakeups.store(0, std::memory_order_relaxed);
+    _FilledFrames.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+//
+//  Run a packet through the format adapter, if the source has switched formats, and then the configured stages.
+//
+void CCaptureDrain::Process(const uint8_t* Data, size_t Frames, bool Silent)
+{
+    if (!_AdapterActive)
+    {
+        ProcessSourceFormat(Silent ? NULL : Data, Frames);
+        return;
+    }
+
+    const size_t frameSize = _Adapter.InputFrameSize();
+    for (size_t offset = 0; offset < Frames; )
+    {
+        size_t chunk = Frames - offset;
+        if (chunk > _Adapter.MaxFrames())
+        {
+            chunk = _Adapter.MaxFrames();
+        }
+        size_t frames;
+        const uint8_t* data = _Adapter.Process(Silent ? NULL : Data + offset * frameSize, chunk, &frames);
+        ProcessSourceFormat(data, frames);
+        offset += chunk;
+    }
+}
+
+//
+//  Run frames of the format given to Attach() through the remixer and the resampler, in pieces they can take, meter
+//  and store the result.  Data NULL is silence: it skips the remixer, and the resampler and the meter are fed
+//  silence so their history stays continuous even when the ring is full.
+//
+void CCaptureDrain::ProcessSourceFormat(const uint8_t* Data, size_t Frames)
+{
+    if (_Remixer == NULL && _Resampler == NULL)
+    {
+        MeterAndStore(Data, Frames);
+        return;
+    }
+
+    for (size_t offset = 0; offset < Frames; )
+    {
+        size_t chunk = Frames - offset;
+        if (chunk > _MaxChunkFrames)
+        {
+            chunk = _MaxChunkFrames;
+        }
+
+        const uint8_t* data = Data != NULL ? Data + offset * _SourceFrameSize : NULL;
+        size_t frames = chunk;
+        if (_Remixer != NULL && data != NULL)
+        {
+            data = reinterpret_cast<const uint8_t*>(_Remixer->Process(reinterpret_cast<const float*>(data), frames));
+        }
+        if (_Resampler != NULL)
+        {
+            data = reinterpret_cast<const uint8_t*>(_Resampler->Process(reinterpret_cast<const float*>(data), frames, &frames));
+        }
+        MeterAndStore(data, frames);
+        offset += chunk;
+    }
+}
+
+//
+//  The meter copies float frames into the ring itself, in the pass that measures them, so metering costs the capture
+//  thread little more than the copy.  Frames that go through the converter or are silence it only measures.
+//
+void CCaptureDrain::MeterAndStore(const uint8_t* Data, size_t Frames)
+{
+    if (_Meter != NULL && (Data == NULL || _Converter != NULL))
+    {
+        _Meter->Process(reinterpret_cast<const float*>(Data), Frames);
+        Store(Data, Frames, Data == NULL);
+    }
+    else
+    {
+        Store(Data, Frames, Data == NULL, _Meter);
+    }
+}
+
+//
+//  Copy (or convert) as many frames as fit in the reservation, splitting only where the ring wraps.  Frames that
+//  don't fit are discarded - the writer hasn't made room for them - and handed to the gap policy.  Data is in the
+//  converter's input format.  Meter, if not NULL, does the copying of float frames without a converter, and still
+//  meters the frames discarded.
+//
+size_t CCaptureDrain::Store(const uint8_t* Data, size_t Frames, bool Silent, CLevelMeter* Meter)
+{
+    const size_t frameSize = _RingBuffer->FrameSize();
+    const size_t dataFrameSize = _Converter != NULL ? _Converter->InputFrameSize() : frameSize;
+    const size_t offered = Frames;
+
+    if (Frames > _FramesReserved - _FramesStored)
+    {
+        size_t discarded = Frames - (_FramesReserved - _FramesStored);
+        Frames -= discarded;
+        _DiscardedFrames.fetch_add(discarded, std::memory_order_relaxed);
+        _Overrun = true;
+        AddLostFrames(discarded);
+    }
+
+    size_t offset = 0;
+    while (offset < Frames)
+    {
+        size_t chunk = _Regions[_Region].Frames - _RegionOffset;
+        if (chunk > Frames - offset)
+        {
+            chunk = Frames - offset;
+        }
+
+        uint8_t* target = _Regions[_Region].Data + _RegionOffset * frameSize;
+        if (Silent)
+        {
+            //
+            //  We rely on the fact that a logical bit 0 is silence for both float and int formats.
+            //
+            memset(target, 0, chunk * frameSize);
+        }
+        else if (_Converter != NULL)
+        {
+            _Converter->Convert(Data + offset * dataFrameSize, target, chunk);
+        }
+        else if (Meter != NULL)
+        {
+            Meter->Process(reinterpret_cast<const float*>(Data + offset * frameSize), chunk, reinterpret_cast<float*>(target));
+        }
+        else
+        {
+            memcpy(target, Data + offset * frameSize, chunk * frameSize);
+        }
+
+        offset += chunk;
+        _RegionOffset += chunk;
+        if (_RegionOffset == _Regions[_Region].Frames && _Region == 0)
+        {
+            _Region = 1;
+            _RegionOffset = 0;
+        }
+    }
+    if (Meter != NULL && Frames < offered)
+    {
+        Meter->Process(reinterpret_cast<const float*>(Data + Frames * frameSize), offered - Frames);
+    }
+    _FramesStored += Frames;
+    return Frames;
+}
+
+//
+//  Reserve all the free space up front.  _RingBuffer only sees the frames once CommitBatch() publishes them.
+//
+void CCaptureDrain::BeginBatch()
+{
+    _FramesReserved = _RingBuffer->BeginWrite(_RingBuffer->FrameCapacity(), _Regions);
+    _FramesStored = 0;
+    _Region = 0;
+    _RegionOffset = 0;
+    _WakeupDeviceTime = _DeviceClock != NULL ? _DeviceClock->Now() : SteadyClockNs() / 100;
+    if (_PacketLog != NULL || _Histograms != NULL)
+    {
+        _WakeupTimeNs = SteadyClockNs();
+    }
+    if (_PacketLog != NULL)
+    {
+        _WakeupWallTimeNs = SystemClockNs();
+    }
+    _OldestAgeNs = 0;
+}
+
+//
+//  The packet records go out first, so whoever receives these frames can already look them up.
+//
+size_t CCaptureDrain::CommitBatch()
+{
+    if (_PacketLog != NULL)
+    {
+        _PacketLog->Publish();
+    }
+    _RingBuffer->CommitWrite(_FramesStored);
+    _RingFrames += _FramesStored;
+    return _FramesStored;
+}
+
+//
+//  Log the frames stored since FirstFrame as one packet.  LostFrames is how many were lost before the packet, read
+//  before it was stored, so frames it loses itself to a full ring go on the next packet.
+//
+void CCaptureDrain::LogPacket(size_t FirstFrame, uint32_t Flags, int64_t AgeNs, uint64_t DevicePosition, uint64_t LostFrames)
+{
+    if (_FramesStored == FirstFrame)
+    {
+        return;
+    }
+    _LostFrames -= LostFrames;
+    if (_PacketLog == NULL)
+    {
+        return;
+    }
+
+    CapturePacketRecord record;
+    record.Frame = _RingFrames + FirstFrame;
+    record.Frames = _FramesStored - FirstFrame;
+    record.Flags = LostFrames != 0 ? Flags | CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY : Flags;
+    record.GapFrames = LostFrames < UINT32_MAX ? static_cast<uint32_t>(LostFrames) : UINT32_MAX;
+    record.TimeNs = _WakeupTimeNs - AgeNs;
+    record.WallTimeNs = _WakeupWallTimeNs - AgeNs;
+    record.DevicePosition = DevicePosition;
+    _PacketLog->Append(record);
+}
+
+//
+//  Count a packet's faults.  A device position past where the last packet ended is a gap even if the packet isn't
+//  flagged; its length, in ring frames, goes to the gap policy.
+//
+void CCaptureDrain::CheckPacket(uint32_t Flags, uint64_t DevicePosition, uint32_t Frames)
+{
+    uint64_t lostFrames = 0;
+    if (_HaveDevicePosition && DevicePosition > _NextDevicePosition)
+    {
+        lostFrames = (DevicePosition - _NextDevicePosition) * _RingRate / _DeviceRate;
+    }
+    _NextDevicePosition = DevicePosition + Frames;
+    _HaveDevicePosition = true;
+
+    if ((Flags & CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY) != 0 || lostFrames != 0)
+    {
+        _Glitches.fetch_add(1, std::memory_order_relaxed);
+        _GlitchFrames.fetch_add(lostFrames, std::memory_order_relaxed);
+        AddLostFrames(lostFrames);
+    }
+    if ((Flags & CAPTURE_PACKET_FLAG_SILENT) != 0)
+    {
+        _SilentPackets.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+//
+//  Under CaptureGapFill, lost frames are owed to the ring as silence; past _MaxFillFrames the timeline is given up
+//  on and the rest are marked instead.
+//
+void CCaptureDrain::AddLostFrames(uint64_t Frames)
+{
+    if (_GapPolicy != CaptureGapFill)
+    {
+        _LostFrames += Frames;
+        return;
+    }
+    _PendingFillFrames += Frames;
+    if (_PendingFillFrames > _MaxFillFrames)
+    {
+        _LostFrames += _PendingFillFrames - _MaxFillFrames;
+        _PendingFillFrames = _MaxFillFrames;
+    }
+}
+
+//
+//  Pay as much of the silence owed as the reservation has room for.  It goes in ahead of whatever comes next, where
+//  the lost frames would have been.
+//
+void CCaptureDrain::FillGap()
+{
+    size_t frames = _FramesReserved - _FramesStored;
+    if (frames > _PendingFillFrames)
+    {
+        frames = static_cast<size_t>(_PendingFillFrames);
+    }
+    if (frames == 0)
+    {
+        return;
+    }
+    size_t firstFrame = _FramesStored;
+    uint64_t lostFrames = _LostFrames;
+    Store(NULL, frames, true);
+    LogPacket(firstFrame, CAPTURE_PACKET_FLAG_SILENT | CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY, 0, 0, lostFrames);
+    _PendingFillFrames -= frames;
+    _FilledFrames.fetch_add(frames, std::memory_order_relaxed);
+}
+
+//
+//  Pull packets until the engine queue is empty.  Returns false if the client reported an error; whatever was copied
+//  before the error is still published.
+//
+bool CCaptureDrain::Drain(ICapturePacketClient* Client)
+{
+    bool succeeded = true;
+    uint32_t packets = 0;
+
+    BeginBatch();
+    if (_WakeupPeriodInHns > 0 && _LastWakeupTime != 0)
+    {
+        int64_t lateness = _WakeupDeviceTime - _LastWakeupTime - _WakeupPeriodInHns;
+        if (lateness > _WakeupPeriodInHns)
+        {
+            _LateWakeups.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (_Histograms != NULL)
+        {
+            _Histograms->WakeupJitterNs.Record(static_cast<uint64_t>(lateness >= 0 ? lateness : -lateness) * 100);
+        }
+    }
+    _LastWakeupTime = _WakeupDeviceTime;
+    FillGap();
+
+    for (;;)
+    {
+        uint32_t packetFrames;
+        if (!Client->GetNextPacketSize(&packetFrames))
+        {
+            succeeded = false;
+            break;
+        }
+        if (packetFrames == 0)
+        {
+            break;
+        }
+
+        uint8_t* data;
+        uint32_t framesAvailable;
+        uint32_t flags;
+        uint64_t devicePosition = 0;
+        uint64_t qpcPosition = 0;
+        if (!Client->GetBuffer(&data, &framesAvailable, &flags, &devicePosition, &qpcPosition))
+        {
+            succeeded = false;
+            break;
+        }
+
+        //
+        //  QPC positions are in 100 ns units.  A packet that arrived after the wakeup read the clock counts as new.
+        //
+        int64_t ageNs = 0;
+        if (_DeviceClock != NULL && qpcPosition != 0 && (flags & CAPTURE_PACKET_FLAG_TIMESTAMP_ERROR) == 0 &&
+            _WakeupDeviceTime > static_cast<int64_t>(qpcPosition))
+        {
+            ageNs = (_WakeupDeviceTime - static_cast<int64_t>(qpcPosition)) * 100;
+        }
+
+        if (ageNs > _OldestAgeNs)
+        {
+            _OldestAgeNs = ageNs;
+        }
+        CheckPacket(flags, devicePosition, framesAvailable);
+        FillGap();
+
+        size_t firstFrame = _FramesStored;
+        uint64_t lostFrames = _LostFrames;
+        Process(data, framesAvailable, (flags & CAPTURE_PACKET_FLAG_SILENT) != 0);
+        LogPacket(firstFrame, flags, ageNs, devicePosition, lostFrames);
+        packets++;
+
+        if (!Client->ReleaseBuffer(framesAvailable))
+        {
+            succeeded = false;
+            break;
+        }
+    }
+
+    size_t framesMoved = CommitBatch();
+    if (_Overrun)
+    {
+        _Overruns.fetch_add(1, std::memory_order_relaxed);
+        _Overrun = false;
+    }
+    if (_Histograms != NULL && framesMoved != 0)
+    {
+        _Histograms->RingLatencyNs.Record(static_cast<uint64_t>(_OldestAgeNs + (SteadyClockNs() - _WakeupTimeNs)));
+    }
+
+    _Wakeups.fetch_add(1, std::memory_order_relaxed);
+    _PacketsDrained.fetch_add(packets, std::memory_order_relaxed);
+    _FramesMoved.fetch_add(framesMoved, std::memory_order_relaxed);
+    _LastWakeupPackets.store(packets, std::memory_order_relaxed);
+    _LastWakeupFrames.store(static_cast<uint32_t>(framesMoved), std::memory_order_relaxed);
+    if (packets > _MaxWakeupPackets.load(std::memory_order_relaxed))
+    {
+        _MaxWakeupPackets.store(packets, std::memory_order_relaxed);
+    }
+    return succeeded;
+}
+
+bool CCaptureDrain::SwitchFormat(const WAVEFORMATEX* NewFormat, int64_t GapInHns)
+{
+    //
+    //  The gap is silence in the original format, so it goes through the configured stages like any other packet.
+    //
+    uint64_t gapFrames = GapInHns > 0 ? static_cast<uint64_t>(GapInHns) * _SourceFormat.Format.nSamplesPerSec / 10000000 : 0;
+    BeginBatch();
+    uint64_t lostFrames = _LostFrames;
+    ProcessSourceFormat(NULL, static_cast<size_t>(gapFrames));
+    LogPacket(0, CAPTURE_PACKET_FLAG_SILENT | CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY, GapInHns * 100, 0, lostFrames);
+    size_t silenceFrames = CommitBatch();
+    if (_Overrun)
+    {
+        _Overruns.fetch_add(1, std::memory_order_relaxed);
+        _Overrun = false;
+    }
+
+    //
+    //  The new stream's positions start over, and the wait for it isn't a late wakeup.
+    //
+    _HaveDevicePosition = false;
+    _DeviceRate = NewFormat->nSamplesPerSec;
+    _LastWakeupTime = 0;
+
+    _StreamSwitches.fetch_add(1, std::memory_order_relaxed);
+    _SwitchSilenceFrames.fetch_add(silenceFrames, std::memory_order_relaxed);
+    _FramesMoved.fetch_add(silenceFrames, std::memory_order_relaxed);
+    _LastSwitchInHns.store(GapInHns, std::memory_order_relaxed);
+    if (GapInHns > _MaxSwitchInHns.load(std::memory_order_relaxed))
+    {
+        _MaxSwitchInHns.store(GapInHns, std::memory_order_relaxed);
+    }
+
+    _AdapterActive = false;
+    if (!_Adapter.Initialize(NewFormat, &_SourceFormat.Format, 1024))
+    {
+        return false;
+    }
+    _AdapterActive = !_Adapter.IsIdentity();
+    return true;
+}
+
+void CCaptureDrain::GetStats(CaptureDrainStats* Stats) const
+{
+    Stats->Wakeups = _Wakeups.load(std::memory_order_relaxed);
+    Stats->PacketsDrained = _PacketsDrained.load(std::memory_order_relaxed);
+    Stats->FramesMoved = _FramesMoved.load(std::memory_order_relaxed);
+    Stats->LastWakeupPackets = _LastWakeupPackets.load(std::memory_order_relaxed);
+    Stats->LastWakeupFrames = _LastWakeupFrames.load(std::memory_order_relaxed);
+    Stats->MaxWakeupPackets = _MaxWakeupPackets.load(std::memory_order_relaxed);
+    Stats->StreamSwitches = _StreamSwitches.load(std::memory_order_relaxed);
+    Stats->SwitchSilenceFrames = _SwitchSilenceFrames.load(std::memory_order_relaxed);
+    Stats->LastSwitchInHns = _LastSwitchInHns.load(std::memory_order_relaxed);
+    Stats->MaxSwitchInHns = _MaxSwitchInHns.load(std::memory_order_relaxed);
+    Stats->Glitches = _Glitches.load(std::memory_order_relaxed);
+    Stats->GlitchFrames = _GlitchFrames.load(std::memory_order_relaxed);
+    Stats->DiscardedFrames = _DiscardedFrames.load(std::memory_order_relaxed);
+    Stats->Overruns = _Overruns.load(std::memory_order_relaxed);
+    Stats->SilentPackets = _SilentPackets.load(std::memory_order_relaxed);
+    Stats->LateWakeups = _LateWakeups.load(std::memory_order_relaxed);
+    Stats->FilledFrames = _FilledFrames.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,239 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "CaptureRingBuffer.h"
+#include "CaptureScheduler.h"
+#include "SampleConvert.h"
+#include "Resampler.h"
+#include "ChannelRemix.h"
+#include "CaptureFormatAdapter.h"
+#include "CapturePacketLog.h"
+#include "LatencyHistogram.h"
+#include "LevelMeter.h"
+
+//
+//  Packet flags.  The values match AUDCLNT_BUFFERFLAGS_xxx so WASAPI flags pass through unchanged.
+//
+#define CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY  0x1
+#define CAPTURE_PACKET_FLAG_SILENT              0x2
+#define CAPTURE_PACKET_FLAG_TIMESTAMP_ERROR     0x4
+
+//
+//  The packet interface of an engine capture client.  It mirrors IAudioCaptureClient so the WASAPI adapter is a
+//  thin forwarder, and a mock client can deliver bursts of packets without any audio stack.
+//
+class ICapturePacketClient
+{
+public:
+    virtual ~ICapturePacketClient() {}
+    virtual bool GetNextPacketSize(uint32_t* Frames) = 0;
+    virtual bool GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition) = 0;
+    virtual bool ReleaseBuffer(uint32_t Frames) = 0;
+};
+
+//
+//  Counters exported by the drain.  Totals are cumulative since Attach(); the Last* fields describe the most recent
+//  wakeup.
+//
+struct CaptureDrainStats
+{
+    uint64_t Wakeups;
+    uint64_t PacketsDrained;
+    uint64_t FramesMoved;
+    uint32_t LastWakeupPackets;
+    uint32_t LastWakeupFrames;
+    uint32_t MaxWakeupPackets;
+
+    //
+    //  Format switches, the silence put in the ring for their gaps (in ring frames), and how long they took.
+    //
+    uint64_t StreamSwitches;
+    uint64_t SwitchSilenceFrames;
+    int64_t LastSwitchInHns;
+    int64_t MaxSwitchInHns;
+
+    //
+    //  Faults.  A glitch is a packet the device flagged as discontinuous or whose device position skipped ahead;
+    //  GlitchFrames is what the skips add up to, in ring frames.  Discarded frames didn't fit in the ring, and an
+    //  overrun is a wakeup that discarded any.  A late wakeup came more than two periods after the one before it.
+    //  FilledFrames is the silence put in the ring for lost frames under CaptureGapFill.
+    //
+    uint64_t Glitches;
+    uint64_t GlitchFrames;
+    uint64_t DiscardedFrames;
+    uint64_t Overruns;
+    uint64_t SilentPackets;
+    uint64_t LateWakeups;
+    uint64_t FilledFrames;
+};
+
+//
+//  What the drain does about frames that never reach the ring, whether the device lost them or the ring was full.
+//
+enum CaptureGapPolicy
+{
+    CaptureGapMark = 0,     // Leave them out; the next packet logged is a discontinuity with their exact count.
+    CaptureGapFill,         // Put as much silence in the ring in their place, as soon as there is room for it.
+};
+
+//
+//  Latency histograms the drain records a value into per wakeup, in nanoseconds: how long the oldest frame moved
+//  waited between its capture and the commit that made it visible in the ring (its age on the device clock plus the
+//  time spent copying), and how far the wakeup was from one period after the one before it, either way.
+//
+struct CaptureDrainHistograms
+{
+    CLatencyHistogram   RingLatencyNs;
+    CLatencyHistogram   WakeupJitterNs;
+};
+
+//
+//  Optional stages between the capture client and the ring, applied in this order, an optional log the drain
+//  records every packet's flags and capture time in, optional histograms, and an optional level meter, which sees
+//  the float frames the converter is about to take.  Any of them may be NULL.  Left out of an initializer, the gap
+//  policy is CaptureGapMark.
+//
+struct CaptureProcessing
+{
+    CChannelRemixer*            Remixer;
+    CResampler*                 Resampler;
+    CSampleConverter*           Converter;
+    CCapturePacketLog*          PacketLog;
+    CaptureGapPolicy            GapPolicy;
+    CaptureDrainHistograms*     Histograms;
+    CLevelMeter*                Meter;
+};
+
+//
+//  Moves every pending packet from a capture client into the ring on each wakeup.
+//
+//  All packets of a wakeup are copied into a single ring reservation, which is only split at the wrap point, and the
+//  whole batch is published to the consumer with one CommitWrite().  Packets pass through the remixer and the resampler
+//  in pieces they can take in one call, and the converter writes them into the ring in place of the plain copy.  With a
+//  packet log, every packet's flags and capture time are logged against the ring frames it became; frames lost to a
+//  full ring or by the device are handled by the gap policy.  A packet's capture time is the wakeup time less its age
+//  on the device clock given to Attach(), which is the clock the client's QPC positions are on; without one, or for
+//  packets without a QPC position, it is the wakeup time.  Runs on the capture thread only; the stats may be read
+//  from any thread.
+//
+class CCaptureDrain
+{
+public:
+    CCaptureDrain();
+
+    //
+    //  Fails if the frame sizes of the source, the processing stages and the ring don't line up.  WakeupPeriodInHns
+    //  is how often the source means to call Drain(), for counting late wakeups; 0 doesn't count them.
+    //
+    bool Attach(CCaptureRingBuffer* RingBuffer, const CaptureProcessing* Processing, const WAVEFORMATEX* SourceFormat,
+        ICaptureClock* DeviceClock = NULL, int64_t WakeupPeriodInHns = 0);
+    bool Drain(ICapturePacketClient* Client);
+    void GetStats(CaptureDrainStats* Stats) const;
+
+    //
+    //  The level meter's latest reading; false without a meter or before its first reading.  Any thread.
+    //
+    bool GetLevels(LevelMeterReading* Reading) const { return _Meter != NULL && _Meter->GetReading(Reading); }
+
+    //
+    //  The source's format changed to NewFormat after a gap of GapInHns.  Fills the gap with silence and adapts the
+    //  packets that follow back to the format given to Attach(), so the ring never sees the change.  Fails if
+    //  NewFormat can't be adapted.  Capture thread only, between Drain() calls.
+    //
+    bool SwitchFormat(const WAVEFORMATEX* NewFormat, int64_t GapInHns);
+
+private:
+    void BeginBatch();
+    size_t CommitBatch();
+    void Process(const uint8_t* Data, size_t Frames, bool Silent);
+    void ProcessSourceFormat(const uint8_t* Data, size_t Frames);
+    void MeterAndStore(const uint8_t* Data, size_t Frames);
+    size_t Store(const uint8_t* Data, size_t Frames, bool Silent, CLevelMeter* Meter = NULL);
+    void LogPacket(size_t FirstFrame, uint32_t Flags, int64_t AgeNs, uint64_t DevicePosition, uint64_t LostFrames);
+    void CheckPacket(uint32_t Flags, uint64_t DevicePosition, uint32_t Frames);
+    void AddLostFrames(uint64_t Frames);
+    void FillGap();
+
+    CCaptureRingBuffer*     _RingBuffer;
+    WAVEFORMATEXTENSIBLE    _SourceFormat;
+    size_t                  _SourceFrameSize;
+    size_t                  _MaxChunkFrames;
+
+    //
+    //  After a format switch, maps the source's new format to _SourceFormat ahead of the other stages.
+    //
+    CCaptureFormatAdapter   _Adapter;
+    bool                    _AdapterActive;
+
+    CChannelRemixer*        _Remixer;
+    CResampler*             _Resampler;
+    CSampleConverter*       _Converter;
+    CLevelMeter*            _Meter;
+
+    //
+    //  Frames committed to the ring since Attach().
+    //
+    CCapturePacketLog*      _PacketLog;
+    uint64_t                _RingFrames;
+
+    //
+    //  Ring frames lost since the last packet logged, and the silence still owed to the ring for lost frames under
+    //  CaptureGapFill, up to _MaxFillFrames.  Device positions are in frames at _DeviceRate, the rate of the source's
+    //  current format; _RingRate is the rate after the resampler.
+    //
+    CaptureGapPolicy        _GapPolicy;
+    uint64_t                _LostFrames;
+    uint64_t                _PendingFillFrames;
+    uint64_t                _MaxFillFrames;
+    uint64_t                _NextDevicePosition;
+    bool                    _HaveDevicePosition;
+    uint32_t                _DeviceRate;
+    uint32_t                _RingRate;
+    bool                    _Overrun;
+
+    //
+    //  The current wakeup's time on the steady clock, the wall clock and the device clock, read together.  Without a
+    //  device clock, the device time is the steady clock's, in 100 ns units like the device clock's.
+    //
+    ICaptureClock*          _DeviceClock;
+    int64_t                 _WakeupTimeNs;
+    int64_t                 _WakeupWallTimeNs;
+    int64_t                 _WakeupDeviceTime;
+    int64_t                 _WakeupPeriodInHns;
+    int64_t                 _LastWakeupTime;
+
+    //
+    //  The age of the oldest packet moved this wakeup, for the ring latency histogram.
+    //
+    CaptureDrainHistograms* _Histograms;
+    int64_t                 _OldestAgeNs;
+
+    //
+    //  The current wakeup's reservation and how much of it is filled.
+    //
+    CaptureRingRegion       _Regions[2];
+    size_t                  _FramesReserved;
+    size_t                  _FramesStored;
+    int                     _Region;
+    size_t                  _RegionOffset;
+
+    std::atomic<uint64_t>   _Wakeups;
+    std::atomic<uint64_t>   _PacketsDrained;
+    std::atomic<uint64_t>   _FramesMoved;
+    std::atomic<uint32_t>   _LastWakeupPackets;
+    std::atomic<uint32_t>   _LastWakeupFrames;
+    std::atomic<uint32_t>   _MaxWakeupPackets;
+    std::atomic<uint64_t>   _StreamSwitches;
+    std::atomic<uint64_t>   _SwitchSilenceFrames;
+    std::atomic<int64_t>    _LastSwitchInHns;
+    std::atomic<int64_t>    _MaxSwitchInHns;
+    std::atomic<uint64_t>   _Glitches;
+    std::atomic<uint64_t>   _GlitchFrames;
+    std::atomic<uint64_t>   _DiscardedFrames;
+    std::atomic<uint64_t>   _Overruns;
+    std::atomic<uint64_t>   _SilentPackets;
+    std::atomic<uint64_t>   _LateWakeups;
+    std::atomic<uint64_t>   _FilledFrames;
+};
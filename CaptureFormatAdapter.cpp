@@ -0,0 +1,96 @@
+#include <stdio.h>
+#include "CaptureFormatAdapter.h"
+
+CCaptureFormatAdapter::CCaptureFormatAdapter() :
+    _Identity(true),
+    _InputFrameSize(0),
+    _MaxFrames(0),
+    _UseRemixer(false),
+    _UseResampler(false),
+    _UseConverter(false)
+{
+}
+
+bool CCaptureFormatAdapter::Initialize(const WAVEFORMATEX* InputFormat, const WAVEFORMATEX* OutputFormat, size_t MaxFrames,
+    SampleConvertKernel MaxKernel)
+{
+    _InputFrameSize = InputFormat->nBlockAlign;
+    _MaxFrames = MaxFrames;
+    _UseRemixer = false;
+    _UseResampler = false;
+    _UseConverter = false;
+    _Identity = InputFormat->nChannels == OutputFormat->nChannels && InputFormat->nSamplesPerSec == OutputFormat->nSamplesPerSec &&
+        InputFormat->wBitsPerSample == OutputFormat->wBitsPerSample && IsFloatFormat(InputFormat) == IsFloatFormat(OutputFormat);
+    if (_Identity)
+    {
+        return true;
+    }
+
+    if (!IsFloatFormat(InputFormat) || InputFormat->wBitsPerSample != 32)
+    {
+        fprintf(stderr, "Can't adapt a %u bit integer stream; only float streams can change format mid-stream.\n", InputFormat->wBitsPerSample);
+        return false;
+    }
+
+    const WAVEFORMATEX* format = InputFormat;
+    if (InputFormat->nChannels != OutputFormat->nChannels)
+    {
+        std::vector<float> matrix;
+        if (!BuildLayoutMatrix(InputFormat, OutputFormat, &matrix) ||
+            !_Remixer.Initialize(format, &matrix[0], OutputFormat->nChannels, ChannelLayoutOf(OutputFormat), MaxFrames, MaxKernel))
+        {
+            return false;
+        }
+        _UseRemixer = true;
+        format = _Remixer.OutputFormat();
+    }
+    if (InputFormat->nSamplesPerSec != OutputFormat->nSamplesPerSec)
+    {
+        if (!_Resampler.Initialize(format, OutputFormat->nSamplesPerSec, ResamplerQualityMedium, MaxFrames, MaxKernel))
+        {
+            return false;
+        }
+        _UseResampler = true;
+        format = _Resampler.OutputFormat();
+    }
+    if (!IsFloatFormat(OutputFormat) || OutputFormat->wBitsPerSample != 32)
+    {
+        if (!_Converter.Initialize(format, IsFloatFormat(OutputFormat), OutputFormat->wBitsPerSample, false, MaxKernel))
+        {
+            return false;
+        }
+        _UseConverter = true;
+        size_t outputFrames = _UseResampler ? MaxFrames * OutputFormat->nSamplesPerSec / InputFormat->nSamplesPerSec + 1 : MaxFrames;
+        _Output.assign(outputFrames * _Converter.OutputFrameSize(), 0);
+    }
+    return true;
+}
+
+const uint8_t* CCaptureFormatAdapter::Process(const uint8_t* Input, size_t Frames, size_t* OutputFrames)
+{
+    if (Frames > _MaxFrames)
+    {
+        Frames = _MaxFrames;
+    }
+
+    const float* data = reinterpret_cast<const float*>(Input);
+    if (_UseRemixer && data != NULL)
+    {
+        data = _Remixer.Process(data, Frames);
+    }
+    if (_UseResampler)
+    {
+        data = _Resampler.Process(data, Frames, &Frames);
+    }
+    *OutputFrames = Frames;
+    if (data == NULL)
+    {
+        return NULL;
+    }
+    if (_UseConverter)
+    {
+        _Converter.Convert(reinterpret_cast<const uint8_t*>(data), &_Output[0], Frames);
+        return &_Output[0];
+    }
+    return reinterpret_cast<const uint8_t*>(data);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "AudioFormat.h"
+#include "ChannelRemix.h"
+#include "Resampler.h"
+#include "SampleConvert.h"
+
+//
+//  Maps the frames of a capture stream whose format changed mid-stream (e.g. after a stream switch to a headset with
+//  a different rate) back to the format the stream started with, so everything downstream keeps seeing one format.
+//
+//  The chain is channel layout, then rate, then sample format, each stage only if needed.  The new format has to be
+//  32 bit float, which is what shared mode engines deliver; the original can be anything CSampleConverter produces.
+//
+class CCaptureFormatAdapter
+{
+public:
+    CCaptureFormatAdapter();
+
+    bool Initialize(const WAVEFORMATEX* InputFormat, const WAVEFORMATEX* OutputFormat, size_t MaxFrames,
+        SampleConvertKernel MaxKernel = SampleKernelAvx2);
+
+    //
+    //  True if the two formats are the same and Process() would just copy.
+    //
+    bool IsIdentity() const { return _Identity; }
+    size_t InputFrameSize() const { return _InputFrameSize; }
+    size_t MaxFrames() const { return _MaxFrames; }
+
+    //
+    //  Adapt up to MaxFrames() frames; Input NULL is silence, and the result is NULL (silence) too.  The output
+    //  stays valid until the next call.
+    //
+    const uint8_t* Process(const uint8_t* Input, size_t Frames, size_t* OutputFrames);
+
+private:
+    bool                    _Identity;
+    size_t                  _InputFrameSize;
+    size_t                  _MaxFrames;
+    bool                    _UseRemixer;
+    bool                    _UseResampler;
+    bool                    _UseConverter;
+    CChannelRemixer         _Remixer;
+    CResampler              _Resampler;
+    CSampleConverter        _Converter;
+    std::vector<uint8_t>    _Output;
+};
@@ -0,0 +1,91 @@
+#include "CaptureMetrics.h"
+
+//
+//  Latency buckets from 1 us to 10 s in a 1-2-5 series, in nanoseconds.
+//
+static std::vector<uint64_t> LatencyBounds()
+{
+    std::vector<uint64_t> bounds;
+    for (uint64_t decade = 1000; decade <= 1000000000; decade *= 10)
+    {
+        bounds.push_back(decade);
+        bounds.push_back(decade * 2);
+        bounds.push_back(decade * 5);
+    }
+    bounds.push_back(10000000000ULL);
+    return bounds;
+}
+
+static std::vector<uint64_t> QueueDepthBounds()
+{
+    std::vector<uint64_t> bounds;
+    for (uint64_t depth = 1; depth <= 256; depth *= 2)
+    {
+        bounds.push_back(depth);
+    }
+    return bounds;
+}
+
+CCaptureMetrics::CCaptureMetrics() :
+    _Source(NULL),
+    _Writer(NULL)
+{
+    _Exporter.AddHistogram("audio_capture_ring_latency_seconds",
+        "Time from capture to commit into the ring of the oldest frame of each wakeup.",
+        &_DrainHistograms.RingLatencyNs, 1e-9, LatencyBounds());
+    _Exporter.AddHistogram("audio_capture_wakeup_jitter_seconds",
+        "How far each capture wakeup was from one period after the previous one.",
+        &_DrainHistograms.WakeupJitterNs, 1e-9, LatencyBounds());
+    _Exporter.AddHistogram("audio_capture_write_latency_seconds", "Latency of each write to the output.",
+        &_WriterHistograms.WriteLatencyNs, 1e-9, LatencyBounds());
+    _Exporter.AddHistogram("audio_capture_flush_latency_seconds", "Latency of each flush of the output to disk.",
+        &_WriterHistograms.FlushLatencyNs, 1e-9, LatencyBounds());
+    _Exporter.AddHistogram("audio_capture_writer_queued_blocks", "Blocks queued for the writer thread each time one is queued.",
+        &_WriterHistograms.QueueDepth, 1, QueueDepthBounds());
+}
+
+bool CCaptureMetrics::Start(const std::string& JsonFile, const std::string& PrometheusFile, uint32_t IntervalMs,
+    ICaptureSource* Source, CAsyncWriter* Writer)
+{
+    _Source = Source;
+    _Writer = Writer;
+    return _Exporter.Start(JsonFile, PrometheusFile, IntervalMs, this);
+}
+
+void CCaptureMetrics::Stop()
+{
+    _Exporter.Stop();
+}
+
+void CCaptureMetrics::CollectMetrics(std::vector<MetricValue>* Values)
+{
+    CaptureDrainStats drain;
+    _Source->GetDrainStats(&drain);
+    AsyncWriterStats writer;
+    _Writer->GetStats(&writer);
+
+    const MetricValue values[] =
+    {
+        { "audio_capture_wakeups_total", "Capture thread wakeups.", true, static_cast<double>(drain.Wakeups) },
+        { "audio_capture_packets_total", "Packets drained from the device.", true, static_cast<double>(drain.PacketsDrained) },
+        { "audio_capture_frames_total", "Frames committed to the ring.", true, static_cast<double>(drain.FramesMoved) },
+        { "audio_capture_stream_switches_total", "Stream switches.", true, static_cast<double>(drain.StreamSwitches) },
+        { "audio_capture_glitches_total", "Packets flagged discontinuous or skipping device positions.", true,
+            static_cast<double>(drain.Glitches) },
+        { "audio_capture_glitch_frames_total", "Frames the device skipped.", true, static_cast<double>(drain.GlitchFrames) },
+        { "audio_capture_discarded_frames_total", "Frames discarded because the ring was full.", true,
+            static_cast<double>(drain.DiscardedFrames) },
+        { "audio_capture_overruns_total", "Wakeups that discarded frames.", true, static_cast<double>(drain.Overruns) },
+        { "audio_capture_silent_packets_total", "Packets the device flagged as silent.", true, static_cast<double>(drain.SilentPackets) },
+        { "audio_capture_late_wakeups_total", "Wakeups more than two periods after the previous one.", true,
+            static_cast<double>(drain.LateWakeups) },
+        { "audio_capture_filled_frames_total", "Silence put in place of lost frames.", true, static_cast<double>(drain.FilledFrames) },
+        { "audio_capture_written_bytes_total", "Bytes written to the output.", true, static_cast<double>(writer.BytesWritten) },
+        { "audio_capture_writes_total", "Writes to the output.", true, static_cast<double>(writer.Writes) },
+        { "audio_capture_flushes_total", "Flushes of the output.", true, static_cast<double>(writer.Flushes) },
+        { "audio_capture_rejected_bytes_total", "Bytes the writer had no room for.", true, static_cast<double>(writer.RejectedBytes) },
+        { "audio_capture_writer_queued_blocks_now", "Blocks queued for the writer thread.", false, static_cast<double>(writer.QueueDepth) },
+        { "audio_capture_writer_failed", "1 once writing to the output failed.", false, _Writer->Failed() ? 1.0 : 0.0 },
+    };
+    Values->insert(Values->end(), values, values + sizeof(values) / sizeof(values[0]));
+}
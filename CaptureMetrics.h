@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "CaptureSource.h"
+#include "AsyncWriter.h"
+#include "MetricsExporter.h"
+
+//
+//  The capture pipeline's metrics: the drain's and the writer's histograms, and a collector for the counters in their
+//  stats, exported as audio_capture_* metrics.
+//
+//  Hand DrainHistograms() to the drain through CaptureProcessing and WriterHistograms() to the writer's Initialize()
+//  before starting them.  The histograms are recorded on the capture and writer threads without locks; everything
+//  else happens on the exporter's thread.
+//
+class CCaptureMetrics : public IMetricsCollector
+{
+public:
+    CCaptureMetrics();
+
+    CaptureDrainHistograms* DrainHistograms() { return &_DrainHistograms; }
+    AsyncWriterHistograms* WriterHistograms() { return &_WriterHistograms; }
+
+    bool Start(const std::string& JsonFile, const std::string& PrometheusFile, uint32_t IntervalMs, ICaptureSource* Source,
+        CAsyncWriter* Writer);
+    void Stop();
+
+    const CMetricsExporter& Exporter() const { return _Exporter; }
+
+    void CollectMetrics(std::vector<MetricValue>* Values);
+
+private:
+    CaptureDrainHistograms  _DrainHistograms;
+    AsyncWriterHistograms   _WriterHistograms;
+    CMetricsExporter        _Exporter;
+    ICaptureSource*         _Source;
+    CAsyncWriter*           _Writer;
+};
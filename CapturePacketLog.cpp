@@ -0,0 +1,95 @@
+#include <string.h>
+#include "CapturePacketLog.h"
+#include "CaptureDrain.h"
+
+CCapturePacketLog::CCapturePacketLog() :
+    _HasPending(false),
+    _Tail(0),
+    _Dropped(0),
+    _Head(0)
+{
+    memset(&_Pending, 0, sizeof(_Pending));
+}
+
+//
+//  Must be called before either thread touches the log.
+//
+bool CCapturePacketLog::Initialize(size_t Capacity)
+{
+    if (Capacity == 0)
+    {
+        return false;
+    }
+    _Records.assign(Capacity, CapturePacketRecord());
+    _HasPending = false;
+    _Tail.store(0, std::memory_order_relaxed);
+    _Dropped.store(0, std::memory_order_relaxed);
+    _Head.store(0, std::memory_order_relaxed);
+    return true;
+}
+
+void CCapturePacketLog::Append(const CapturePacketRecord& Packet)
+{
+    if (Packet.Frames == 0)
+    {
+        return;
+    }
+    //
+    //  A discontinuity only marks the first frame of a record, so a packet with one always starts a new record.
+    //
+    if (_HasPending && (Packet.Flags & CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY) == 0 &&
+        (_Pending.Flags & ~CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY) == Packet.Flags && _Pending.Frame + _Pending.Frames == Packet.Frame)
+    {
+        _Pending.Frames += Packet.Frames;
+        return;
+    }
+
+    Publish();
+    _Pending = Packet;
+    _HasPending = true;
+}
+
+void CCapturePacketLog::Publish()
+{
+    if (!_HasPending)
+    {
+        return;
+    }
+    _HasPending = false;
+
+    uint64_t tail = _Tail.load(std::memory_order_relaxed);
+    if (tail - _Head.load(std::memory_order_acquire) == _Records.size())
+    {
+        _Dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    _Records[tail % _Records.size()] = _Pending;
+    _Tail.store(tail + 1, std::memory_order_release);
+}
+
+bool CCapturePacketLog::Lookup(uint64_t Frame, CapturePacketRecord* Record)
+{
+    uint64_t tail = _Tail.load(std::memory_order_acquire);
+    uint64_t head = _Head.load(std::memory_order_relaxed);
+    bool found = false;
+    for (; head < tail; head++)
+    {
+        const CapturePacketRecord& record = _Records[head % _Records.size()];
+        if (Frame < record.Frame)
+        {
+            break;
+        }
+        if (Frame < record.Frame + record.Frames)
+        {
+            *Record = record;
+            found = true;
+            break;
+        }
+    }
+
+    //
+    //  The record found stays at the head, since the next lookup is likely to land in it again.
+    //
+    _Head.store(head, std::memory_order_release);
+    return found;
+}
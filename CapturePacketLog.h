@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include "CaptureRingBuffer.h"
+
+//
+//  What the capture thread knew about a packet, in ring terms: the ring frames it became, its packet flags
+//  (CAPTURE_PACKET_FLAG_xxx), how many frames were lost right before it, when it was captured, in steady clock and
+//  in wall clock (system clock since the Unix epoch) nanoseconds, and the device position the source reported for it.
+//
+struct CapturePacketRecord
+{
+    uint64_t    Frame;          // Ring position of the first frame, in frames since Start().
+    uint64_t    Frames;
+    uint32_t    Flags;
+    uint32_t    GapFrames;      // Ring frames missing before Frame; only with CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY.
+    int64_t     TimeNs;
+    int64_t     WallTimeNs;
+    uint64_t    DevicePosition; // In source frames; 0 if the source doesn't report one.
+};
+
+//
+//  Side channel that carries packet metadata from the capture thread to the writer thread next to the audio.
+//
+//  The ring buffer only moves bytes, so the drain appends a record for every packet it stores, and a sink that needs
+//  flags or timestamps looks them up by stream position as the bytes reach it.  Records are published before the
+//  frames they describe are committed to the ring, so a sink always finds the record for bytes it was given.  Like
+//  the ring, this is a wait-free single producer / single consumer queue; when the consumer falls so far behind
+//  that it is full, records are dropped and counted rather than blocking capture.
+//
+class CCapturePacketLog
+{
+public:
+    CCapturePacketLog();
+
+    bool Initialize(size_t Capacity);
+
+    //
+    //  Producer side - capture thread only.  Appended packets stay private until Publish(); consecutive ones with the
+    //  same flags and no gap between them are merged, so a steady stream costs a record per wakeup.
+    //
+    void Append(const CapturePacketRecord& Packet);
+    void Publish();
+
+    //
+    //  Consumer side - a single thread, usually the writer thread.  Finds the record covering Frame and forgets
+    //  every record before it.  Frame must not go backwards between calls.  Returns false if no record covers it.
+    //
+    bool Lookup(uint64_t Frame, CapturePacketRecord* Record);
+
+    uint64_t DroppedRecords() const { return _Dropped.load(std::memory_order_relaxed); }
+
+private:
+    CCapturePacketLog(const CCapturePacketLog&);
+    CCapturePacketLog& operator=(const CCapturePacketLog&);
+
+    std::vector<CapturePacketRecord>    _Records;
+    CapturePacketRecord                 _Pending;   // Producer only.
+    bool                                _HasPending;
+    char                                _Pad0[CAPTURE_CACHE_LINE_SIZE];
+    std::atomic<uint64_t>               _Tail;      // Next record the producer fills.
+    std::atomic<uint64_t>               _Dropped;
+    char                                _Pad1[CAPTURE_CACHE_LINE_SIZE - 2 * sizeof(std::atomic<uint64_t>)];
+    std::atomic<uint64_t>               _Head;      // Oldest record the consumer still holds.
+};
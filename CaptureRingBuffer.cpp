@@ -0,0 +1,177 @@
+#include <new>
+#include <string.h>
+#include "CaptureRingBuffer.h"
+
+CCaptureRingBuffer::CCaptureRingBuffer() :
+    _Buffer(NULL),
+    _FrameSize(0),
+    _FrameCapacity(0),
+    _WritePosition(0),
+    _CachedReadPosition(0),
+    _ReadPosition(0),
+    _CachedWritePosition(0)
+{
+}
+
+CCaptureRingBuffer::~CCaptureRingBuffer()
+{
+    Shutdown();
+}
+
+//
+//  Allocate storage for FrameCount frames of FrameSize bytes each.  Must be called before either thread touches the ring.
+//
+bool CCaptureRingBuffer::Initialize(size_t FrameCount, size_t FrameSize)
+{
+    Shutdown();
+
+    if (FrameCount == 0 || FrameSize == 0)
+    {
+        return false;
+    }
+
+    _Buffer = new (std::nothrow) uint8_t[FrameCount * FrameSize];
+    if (_Buffer == NULL)
+    {
+        return false;
+    }
+
+    _FrameSize = FrameSize;
+    _FrameCapacity = FrameCount;
+    _WritePosition.store(0, std::memory_order_relaxed);
+    _ReadPosition.store(0, std::memory_order_relaxed);
+    _CachedReadPosition = 0;
+    _CachedWritePosition = 0;
+    return true;
+}
+
+void CCaptureRingBuffer::Shutdown()
+{
+    delete[] _Buffer;
+    _Buffer = NULL;
+    _FrameSize = 0;
+    _FrameCapacity = 0;
+}
+
+//
+//  Split Frames frames starting at the absolute frame Position into at most two contiguous regions.
+//
+size_t CCaptureRingBuffer::GetRegions(uint64_t Position, size_t Frames, CaptureRingRegion Regions[2])
+{
+    size_t offset = static_cast<size_t>(Position % _FrameCapacity);
+    size_t firstFrames = _FrameCapacity - offset;
+    if (firstFrames > Frames)
+    {
+        firstFrames = Frames;
+    }
+
+    Regions[0].Data = _Buffer + offset * _FrameSize;
+    Regions[0].Frames = firstFrames;
+    Regions[1].Data = _Buffer;
+    Regions[1].Frames = Frames - firstFrames;
+    return Frames;
+}
+
+size_t CCaptureRingBuffer::WritableFrames()
+{
+    _CachedReadPosition = _ReadPosition.load(std::memory_order_acquire);
+    return _FrameCapacity - static_cast<size_t>(_WritePosition.load(std::memory_order_relaxed) - _CachedReadPosition);
+}
+
+//
+//  Reserve up to Frames frames of free space.  Nothing is visible to the consumer until CommitWrite().
+//
+size_t CCaptureRingBuffer::BeginWrite(size_t Frames, CaptureRingRegion Regions[2])
+{
+    uint64_t writePosition = _WritePosition.load(std::memory_order_relaxed);
+    size_t writable = _FrameCapacity - static_cast<size_t>(writePosition - _CachedReadPosition);
+    if (Frames > writable)
+    {
+        //
+        //  Our view of the consumer is stale - only now touch its cache line.
+        //
+        writable = WritableFrames();
+    }
+    if (Frames > writable)
+    {
+        Frames = writable;
+    }
+    return GetRegions(writePosition, Frames, Regions);
+}
+
+void CCaptureRingBuffer::CommitWrite(size_t Frames)
+{
+    _WritePosition.store(_WritePosition.load(std::memory_order_relaxed) + Frames, std::memory_order_release);
+}
+
+size_t CCaptureRingBuffer::Write(const uint8_t* Data, size_t Frames)
+{
+    CaptureRingRegion regions[2];
+    size_t framesToWrite = BeginWrite(Frames, regions);
+
+    memcpy(regions[0].Data, Data, regions[0].Frames * _FrameSize);
+    if (regions[1].Frames != 0)
+    {
+        memcpy(regions[1].Data, Data + regions[0].Frames * _FrameSize, regions[1].Frames * _FrameSize);
+    }
+
+    CommitWrite(framesToWrite);
+    return framesToWrite;
+}
+
+//
+//  Append frames of silence.  We rely on the fact that a logical bit 0 is silence for both float and int formats.
+//
+size_t CCaptureRingBuffer::WriteSilence(size_t Frames)
+{
+    CaptureRingRegion regions[2];
+    size_t framesToWrite = BeginWrite(Frames, regions);
+
+    memset(regions[0].Data, 0, regions[0].Frames * _FrameSize);
+    if (regions[1].Frames != 0)
+    {
+        memset(regions[1].Data, 0, regions[1].Frames * _FrameSize);
+    }
+
+    CommitWrite(framesToWrite);
+    return framesToWrite;
+}
+
+size_t CCaptureRingBuffer::ReadableFrames()
+{
+    _CachedWritePosition = _WritePosition.load(std::memory_order_acquire);
+    return static_cast<size_t>(_CachedWritePosition - _ReadPosition.load(std::memory_order_relaxed));
+}
+
+//
+//  Expose up to Frames frames of captured data.  The regions stay valid until CommitRead() hands them back to the producer.
+//
+size_t CCaptureRingBuffer::BeginRead(size_t Frames, CaptureRingRegion Regions[2])
+{
+    size_t readable = ReadableFrames();
+    if (Frames > readable)
+    {
+        Frames = readable;
+    }
+    return GetRegions(_ReadPosition.load(std::memory_order_relaxed), Frames, Regions);
+}
+
+void CCaptureRingBuffer::CommitRead(size_t Frames)
+{
+    _ReadPosition.store(_ReadPosition.load(std::memory_order_relaxed) + Frames, std::memory_order_release);
+}
+
+size_t CCaptureRingBuffer::Read(uint8_t* Data, size_t Frames)
+{
+    CaptureRingRegion regions[2];
+    size_t framesToRead = BeginRead(Frames, regions);
+
+    memcpy(Data, regions[0].Data, regions[0].Frames * _FrameSize);
+    if (regions[1].Frames != 0)
+    {
+        memcpy(Data + regions[0].Frames * _FrameSize, regions[1].Data, regions[1].Frames * _FrameSize);
+    }
+
+    CommitRead(framesToRead);
+    return framesToRead;
+}
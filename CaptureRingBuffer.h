@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+//
+//  Size of a cache line on the platforms we care about.  The producer and consumer indices live on separate lines so
+//  the capture thread and the writer loop never bounce the same line between cores.
+//
+#define CAPTURE_CACHE_LINE_SIZE 64
+
+//
+//  A contiguous piece of the ring returned by BeginWrite/BeginRead.  A reservation is split into at most two regions,
+//  and only at the wrap point.
+//
+struct CaptureRingRegion
+{
+    uint8_t* Data;
+    size_t   Frames;
+};
+
+//
+//  Wait-free single producer / single consumer ring buffer of audio frames.
+//
+//  The capture thread is the only producer and the writer loop is the only consumer.  Positions are monotonically
+//  increasing frame counters; the producer publishes with a release store on _WritePosition and the consumer
+//  acquires it, and vice versa for _ReadPosition.  The capacity is a whole number of frames so a frame is never
+//  split across the wrap point and a reader can never observe a torn frame.
+//
+class CCaptureRingBuffer
+{
+public:
+    CCaptureRingBuffer();
+    ~CCaptureRingBuffer();
+
+    bool Initialize(size_t FrameCount, size_t FrameSize);
+    void Shutdown();
+
+    size_t FrameSize() const { return _FrameSize; }
+    size_t FrameCapacity() const { return _FrameCapacity; }
+
+    //
+    //  Producer side - only ever called from the capture thread.
+    //
+    size_t WritableFrames();
+    size_t BeginWrite(size_t Frames, CaptureRingRegion Regions[2]);
+    void CommitWrite(size_t Frames);
+    size_t Write(const uint8_t* Data, size_t Frames);
+    size_t WriteSilence(size_t Frames);
+
+    //
+    //  Consumer side - only ever called from the writer loop.
+    //
+    size_t ReadableFrames();
+    size_t BeginRead(size_t Frames, CaptureRingRegion Regions[2]);
+    void CommitRead(size_t Frames);
+    size_t Read(uint8_t* Data, size_t Frames);
+
+private:
+    CCaptureRingBuffer(const CCaptureRingBuffer&);
+    CCaptureRingBuffer& operator=(const CCaptureRingBuffer&);
+
+    size_t GetRegions(uint64_t Position, size_t Frames, CaptureRingRegion Regions[2]);
+
+    //
+    //  Immutable after Initialize(), shared read-only by both sides.
+    //
+    uint8_t*                _Buffer;
+    size_t                  _FrameSize;
+    size_t                  _FrameCapacity;
+    char                    _Pad0[CAPTURE_CACHE_LINE_SIZE];
+
+    //
+    //  Producer owned line.  _CachedReadPosition is the producer's last view of the consumer index, so the consumer's
+    //  line is only touched when the cached view doesn't have enough room.
+    //
+    std::atomic<uint64_t>   _WritePosition;
+    uint64_t                _CachedReadPosition;
+    char                    _Pad1[CAPTURE_CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>) - sizeof(uint64_t)];
+
+    //
+    //  Consumer owned line.
+    //
+    std::atomic<uint64_t>   _ReadPosition;
+    uint64_t                _CachedWritePosition;
+    char                    _Pad2[CAPTURE_CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>) - sizeof(uint64_t)];
+};
@@ -0,0 +1,69 @@
+#include <chrono>
+#include <thread>
+#include "CaptureScheduler.h"
+
+int64_t CSteadyCaptureClock::Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count() / 100;
+}
+
+void CSteadyCaptureClock::SleepUntil(int64_t Deadline)
+{
+    int64_t now = Now();
+    if (Deadline > now)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds((Deadline - now) * 100));
+    }
+}
+
+CClockCaptureScheduler::CClockCaptureScheduler(ICaptureClock* Clock, int64_t PeriodInHns) :
+    _Clock(Clock),
+    _PeriodInHns(PeriodInHns > 0 ? PeriodInHns : 1),
+    _NextDeadline(0),
+    _ShutdownRequested(false),
+    _StreamSwitchRequested(false)
+{
+    Reset();
+}
+
+//
+//  Restart the period from the current time, e.g. after the source was stopped.
+//
+void CClockCaptureScheduler::Reset()
+{
+    _NextDeadline = _Clock->Now() + _PeriodInHns;
+    _ShutdownRequested.store(false, std::memory_order_release);
+    _StreamSwitchRequested.store(false, std::memory_order_release);
+}
+
+CaptureWakeReason CClockCaptureScheduler::WaitForWork()
+{
+    if (_ShutdownRequested.load(std::memory_order_acquire))
+    {
+        return CaptureWakeShutdown;
+    }
+    if (_StreamSwitchRequested.exchange(false, std::memory_order_acq_rel))
+    {
+        return CaptureWakeStreamSwitch;
+    }
+
+    _Clock->SleepUntil(_NextDeadline);
+
+    //
+    //  If we overslept by more than a period, resynchronize rather than firing a burst of catch-up wakeups.
+    //  The work done per wakeup drains everything that is pending anyway.
+    //
+    int64_t now = _Clock->Now();
+    _NextDeadline += _PeriodInHns;
+    if (_NextDeadline <= now)
+    {
+        _NextDeadline = now + _PeriodInHns;
+    }
+
+    if (_ShutdownRequested.load(std::memory_order_acquire))
+    {
+        return CaptureWakeShutdown;
+    }
+    return CaptureWakeSamplesReady;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+
+//
+//  Number of 100 nanosecond REFERENCE_TIME units per millisecond.
+//
+#define REFTIMES_PER_MILLISEC 10000
+
+//
+//  Why the capture thread woke up.
+//
+enum CaptureWakeReason
+{
+    CaptureWakeShutdown,
+    CaptureWakeStreamSwitch,
+    CaptureWakeSamplesReady,
+};
+
+//
+//  The capture thread's wait/dispatch policy.  WaitForWork() blocks until there is something for the capture thread
+//  to do and tells it what.  Backends plug in a scheduler driven by OS events or by a clock.
+//
+class ICaptureScheduler
+{
+public:
+    virtual ~ICaptureScheduler() {}
+    virtual CaptureWakeReason WaitForWork() = 0;
+};
+
+//
+//  Time source for clock driven scheduling, in REFERENCE_TIME (100ns) units.  A synthetic clock lets the same
+//  scheduler run faster than real time, or step deterministically.
+//
+class ICaptureClock
+{
+public:
+    virtual ~ICaptureClock() {}
+    virtual int64_t Now() = 0;
+    virtual void SleepUntil(int64_t Deadline) = 0;
+};
+
+//
+//  Wall clock backed by std::chrono::steady_clock.
+//
+class CSteadyCaptureClock : public ICaptureClock
+{
+public:
+    int64_t Now();
+    void SleepUntil(int64_t Deadline);
+};
+
+//
+//  Synthetic clock that never blocks: sleeping just moves time forward to the deadline.  Driving a source with it
+//  runs the source as fast as the consumer allows while keeping its timeline exact.
+//
+class CSyntheticCaptureClock : public ICaptureClock
+{
+public:
+    CSyntheticCaptureClock() : _Now(0) {}
+    int64_t Now() { return _Now; }
+    void SleepUntil(int64_t Deadline) { if (Deadline > _Now) _Now = Deadline; }
+    void Advance(int64_t Duration) { _Now += Duration; }
+
+private:
+    int64_t _Now;
+};
+
+//
+//  Timer driven scheduler: wakes up once per period on the given clock.  Deadlines are absolute so a late wakeup
+//  doesn't push every later one back.
+//
+class CClockCaptureScheduler : public ICaptureScheduler
+{
+public:
+    CClockCaptureScheduler(ICaptureClock* Clock, int64_t PeriodInHns);
+
+    CaptureWakeReason WaitForWork();
+    void RequestShutdown() { _ShutdownRequested.store(true, std::memory_order_release); }
+    bool ShutdownRequested() const { return _ShutdownRequested.load(std::memory_order_acquire); }
+
+    //
+    //  The next WaitForWork() returns CaptureWakeStreamSwitch right away.
+    //
+    void RequestStreamSwitch() { _StreamSwitchRequested.store(true, std::memory_order_release); }
+    void Reset();
+
+private:
+    ICaptureClock*      _Clock;
+    int64_t             _PeriodInHns;
+    int64_t             _NextDeadline;
+    std::atomic<bool>   _ShutdownRequested;
+    std::atomic<bool>   _StreamSwitchRequested;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "AudioFormat.h"
+#include "CaptureRingBuffer.h"
+#include "CaptureDrain.h"
+
+//
+//  A source of captured audio.
+//
+//  Sources push whole frames of their MixFormat() into the ring handed to Start(), from a capture thread they own.
+//  If Start() is given processing stages, the frames are resampled and converted from MixFormat() on the way in.
+//  A stream switch may reopen the source on a different MixFormat(); the drain then adapts the new format back to
+//  the one the source was started with, so the ring keeps a single format for the whole capture.
+//  Construction and Initialize() are backend specific; everything after that goes through this interface.  Sources
+//  are reference counted like the COM objects the WASAPI backend is built on, so CWASAPICapture's AddRef/Release
+//  implement both.
+//
+class ICaptureSource
+{
+public:
+    virtual bool Start(CCaptureRingBuffer* RingBuffer, const CaptureProcessing* Processing) = 0;
+    virtual void Stop() = 0;
+    virtual void Shutdown() = 0;
+
+    virtual WAVEFORMATEX* MixFormat() = 0;
+    virtual size_t FrameSize() = 0;
+    virtual void GetDrainStats(CaptureDrainStats* Stats) = 0;
+
+    //
+    //  The latest reading of the level meter given to Start(); false without one or before its first reading.
+    //
+    virtual bool GetLevels(LevelMeterReading* Reading) = 0;
+
+    //
+    //  True once a finite source (e.g. a file replay) has delivered its last frame.
+    //
+    virtual bool IsFinished() = 0;
+
+    virtual ULONG STDMETHODCALLTYPE AddRef() = 0;
+    virtual ULONG STDMETHODCALLTYPE Release() = 0;
+
+protected:
+    virtual ~ICaptureSource() {}
+};
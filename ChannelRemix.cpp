@@ -0,0 +1,517 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "ChannelRemix.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CHANNEL_REMIX_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+static void RemixScalar(const float* Matrix, size_t InputChannels, const float* Input, float* Output, size_t OutputChannels, size_t Frames)
+{
+    for (size_t frame = 0; frame < Frames; frame++)
+    {
+        float sum[CHANNEL_REMIX_MAX_OUTPUTS] = {};
+        for (size_t channel = 0; channel < InputChannels; channel++)
+        {
+            const float* column = Matrix + channel * CHANNEL_REMIX_MAX_OUTPUTS;
+            for (size_t output = 0; output < CHANNEL_REMIX_MAX_OUTPUTS; output++)
+            {
+                sum[output] += column[output] * Input[channel];
+            }
+        }
+        memcpy(Output, sum, sizeof(sum));
+        Input += InputChannels;
+        Output += OutputChannels;
+    }
+}
+
+#ifdef CHANNEL_REMIX_HAVE_SSE2
+
+//
+//  Outputs 0-3 and 4-7 of a frame in two registers; the upper one is skipped for four or fewer outputs.
+//
+static void RemixSse2(const float* Matrix, size_t InputChannels, const float* Input, float* Output, size_t OutputChannels, size_t Frames)
+{
+    const bool upper = OutputChannels > 4;
+    for (size_t frame = 0; frame < Frames; frame++)
+    {
+        __m128 low = _mm_setzero_ps();
+        __m128 high = _mm_setzero_ps();
+        for (size_t channel = 0; channel < InputChannels; channel++)
+        {
+            const float* column = Matrix + channel * CHANNEL_REMIX_MAX_OUTPUTS;
+            __m128 sample = _mm_set1_ps(Input[channel]);
+            low = _mm_add_ps(low, _mm_mul_ps(_mm_loadu_ps(column), sample));
+            if (upper)
+            {
+                high = _mm_add_ps(high, _mm_mul_ps(_mm_loadu_ps(column + 4), sample));
+            }
+        }
+        _mm_storeu_ps(Output, low);
+        _mm_storeu_ps(Output + 4, high);
+        Input += InputChannels;
+        Output += OutputChannels;
+    }
+}
+
+#endif
+
+CChannelRemixer::CChannelRemixer() :
+    _InputChannels(0),
+    _OutputChannels(0),
+    _MaxFrames(0),
+    _Kernel(SampleKernelScalar),
+    _Function(RemixScalar)
+{
+    memset(&_OutputFormat, 0, sizeof(_OutputFormat));
+}
+
+bool CChannelRemixer::Initialize(const WAVEFORMATEX* InputFormat, const float* Matrix, WORD OutputChannels, DWORD OutputChannelMask,
+    size_t MaxFrames, SampleConvertKernel MaxKernel)
+{
+    if (!IsFloatFormat(InputFormat) || InputFormat->wBitsPerSample != 32)
+    {
+        fprintf(stderr, "Channel remixing needs 32 bit float capture data.\n");
+        return false;
+    }
+    if (InputFormat->nChannels == 0 || OutputChannels == 0 || OutputChannels > CHANNEL_REMIX_MAX_OUTPUTS || MaxFrames == 0)
+    {
+        fprintf(stderr, "Can't remix %u channels to %u; at most %u output channels are supported.\n",
+            InputFormat->nChannels, OutputChannels, CHANNEL_REMIX_MAX_OUTPUTS);
+        return false;
+    }
+
+    _InputChannels = InputFormat->nChannels;
+    _OutputChannels = OutputChannels;
+    _MaxFrames = MaxFrames;
+    InitializeWaveFormat(&_OutputFormat, true, OutputChannels, InputFormat->nSamplesPerSec, 32, OutputChannelMask);
+
+    _Matrix.assign(static_cast<size_t>(_InputChannels) * CHANNEL_REMIX_MAX_OUTPUTS, 0.0f);
+    _Selection.assign(_OutputChannels, 0);
+    bool selection = true;
+    for (uint32_t output = 0; output < _OutputChannels; output++)
+    {
+        uint32_t ones = 0;
+        for (uint32_t channel = 0; channel < _InputChannels; channel++)
+        {
+            float gain = Matrix[output * _InputChannels + channel];
+            _Matrix[channel * CHANNEL_REMIX_MAX_OUTPUTS + output] = gain;
+            if (gain == 1.0f)
+            {
+                _Selection[output] = channel;
+                ones++;
+            }
+            else if (gain != 0.0f)
+            {
+                selection = false;
+            }
+        }
+        if (ones != 1)
+        {
+            selection = false;
+        }
+    }
+    if (!selection)
+    {
+        _Selection.clear();
+    }
+
+    _Output.assign(MaxFrames * _OutputChannels + CHANNEL_REMIX_MAX_OUTPUTS, 0.0f);
+
+    _Kernel = SampleKernelScalar;
+    _Function = RemixScalar;
+#ifdef CHANNEL_REMIX_HAVE_SSE2
+    if (MaxKernel >= SampleKernelSse2)
+    {
+        _Kernel = SampleKernelSse2;
+        _Function = RemixSse2;
+    }
+#endif
+    if (MaxKernel >= SampleKernelAvx2 && GetAvx2ChannelRemix() != NULL && CpuSupportsAvx2())
+    {
+        _Kernel = SampleKernelAvx2;
+        _Function = GetAvx2ChannelRemix();
+    }
+    return true;
+}
+
+const float* CChannelRemixer::Process(const float* Input, size_t Frames)
+{
+    if (Frames > _MaxFrames)
+    {
+        Frames = _MaxFrames;
+    }
+
+    float* output = &_Output[0];
+    if (!_Selection.empty())
+    {
+        for (size_t frame = 0; frame < Frames; frame++)
+        {
+            for (uint32_t channel = 0; channel < _OutputChannels; channel++)
+            {
+                output[channel] = Input[_Selection[channel]];
+            }
+            Input += _InputChannels;
+            output += _OutputChannels;
+        }
+    }
+    else
+    {
+        _Function(&_Matrix[0], _InputChannels, Input, output, _OutputChannels, Frames);
+    }
+    return &_Output[0];
+}
+
+//
+//  Population count of a channel mask.
+//
+static uint32_t SpeakerCount(DWORD Mask)
+{
+    uint32_t count = 0;
+    for (; Mask != 0; Mask &= Mask - 1)
+    {
+        count++;
+    }
+    return count;
+}
+
+DWORD ChannelLayoutOf(const WAVEFORMATEX* WaveFormat)
+{
+    if (WaveFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE && WaveFormat->cbSize >= WAVEFORMATEXTENSIBLE_EXTRA_SIZE)
+    {
+        DWORD mask = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(WaveFormat)->dwChannelMask;
+        if (mask != 0 && SpeakerCount(mask) == WaveFormat->nChannels)
+        {
+            return mask;
+        }
+    }
+
+    //
+    //  The KSAUDIO_SPEAKER_xxx layouts Windows assumes for a bare channel count.
+    //
+    switch (WaveFormat->nChannels)
+    {
+    case 1: return SPEAKER_FRONT_CENTER;
+    case 2: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT;
+    case 3: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER;
+    case 4: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
+    case 5: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
+    case 6: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY |
+        SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT;
+    case 8: return SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT | SPEAKER_FRONT_CENTER | SPEAKER_LOW_FREQUENCY |
+        SPEAKER_BACK_LEFT | SPEAKER_BACK_RIGHT | SPEAKER_SIDE_LEFT | SPEAKER_SIDE_RIGHT;
+    default: return 0;
+    }
+}
+
+bool BuildDownmixMatrix(const std::string& Preset, const WAVEFORMATEX* InputFormat, std::vector<float>* Matrix,
+    WORD* OutputChannels, DWORD* OutputChannelMask)
+{
+    const float minus3dB = 0.70710678f;
+    const DWORD leftSpeakers = SPEAKER_FRONT_LEFT_OF_CENTER | SPEAKER_BACK_LEFT | SPEAKER_SIDE_LEFT | SPEAKER_TOP_FRONT_LEFT | SPEAKER_TOP_BACK_LEFT;
+    const DWORD rightSpeakers = SPEAKER_FRONT_RIGHT_OF_CENTER | SPEAKER_BACK_RIGHT | SPEAKER_SIDE_RIGHT | SPEAKER_TOP_FRONT_RIGHT | SPEAKER_TOP_BACK_RIGHT;
+    const DWORD centerSpeakers = SPEAKER_FRONT_CENTER | SPEAKER_BACK_CENTER | SPEAKER_TOP_CENTER | SPEAKER_TOP_FRONT_CENTER | SPEAKER_TOP_BACK_CENTER;
+
+    if (Preset != "stereo" && Preset != "mono")
+    {
+        fprintf(stderr, "Unknown downmix preset: %s\n", Preset.c_str());
+        return false;
+    }
+    DWORD layout = ChannelLayoutOf(InputFormat);
+    if (layout == 0)
+    {
+        fprintf(stderr, "The %u channel layout is unknown; use --remix-matrix instead.\n", InputFormat->nChannels);
+        return false;
+    }
+
+    //
+    //  Stereo gains of each input channel, in channel mask order.  Mono output is the mean of the two.
+    //
+    const size_t channels = InputFormat->nChannels;
+    std::vector<float> left(channels, 0.0f);
+    std::vector<float> right(channels, 0.0f);
+    size_t channel = 0;
+    for (DWORD speaker = 1; speaker != 0 && channel < channels; speaker <<= 1)
+    {
+        if ((layout & speaker) == 0)
+        {
+            continue;
+        }
+        if (layout == SPEAKER_FRONT_CENTER || speaker == SPEAKER_FRONT_LEFT)
+        {
+            left[channel] = 1.0f;
+        }
+        if (layout == SPEAKER_FRONT_CENTER || speaker == SPEAKER_FRONT_RIGHT)
+        {
+            right[channel] = 1.0f;
+        }
+        if (layout != SPEAKER_FRONT_CENTER && (speaker & (leftSpeakers | centerSpeakers)))
+        {
+            left[channel] = minus3dB;
+        }
+        if (layout != SPEAKER_FRONT_CENTER && (speaker & (rightSpeakers | centerSpeakers)))
+        {
+            right[channel] = minus3dB;
+        }
+        channel++;
+    }
+
+    if (Preset == "mono")
+    {
+        *OutputChannels = 1;
+        *OutputChannelMask = SPEAKER_FRONT_CENTER;
+        Matrix->assign(channels, 0.0f);
+        for (size_t i = 0; i < channels; i++)
+        {
+            (*Matrix)[i] = 0.5f * (left[i] + right[i]);
+        }
+    }
+    else
+    {
+        *OutputChannels = 2;
+        *OutputChannelMask = SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT;
+        Matrix->assign(left.begin(), left.end());
+        Matrix->insert(Matrix->end(), right.begin(), right.end());
+    }
+
+    //
+    //  Keep the loudest row at unity gain or below.
+    //
+    float largest = 0.0f;
+    for (WORD output = 0; output < *OutputChannels; output++)
+    {
+        float sum = 0.0f;
+        for (size_t i = 0; i < channels; i++)
+        {
+            sum += fabsf((*Matrix)[output * channels + i]);
+        }
+        if (sum > largest)
+        {
+            largest = sum;
+        }
+    }
+    if (largest > 1.0f)
+    {
+        for (size_t i = 0; i < Matrix->size(); i++)
+        {
+            (*Matrix)[i] /= largest;
+        }
+    }
+    return true;
+}
+
+bool BuildChannelSelectionMatrix(const std::vector<uint32_t>& Channels, const WAVEFORMATEX* InputFormat, std::vector<float>* Matrix,
+    WORD* OutputChannels, DWORD* OutputChannelMask)
+{
+    if (Channels.empty() || Channels.size() > CHANNEL_REMIX_MAX_OUTPUTS)
+    {
+        fprintf(stderr, "Select between 1 and %u channels.\n", CHANNEL_REMIX_MAX_OUTPUTS);
+        return false;
+    }
+
+    //
+    //  Speaker position of each input channel, if the layout is known.
+    //
+    const size_t channels = InputFormat->nChannels;
+    DWORD layout = ChannelLayoutOf(InputFormat);
+    std::vector<DWORD> speakers(channels, 0);
+    size_t channel = 0;
+    for (DWORD speaker = 1; speaker != 0 && channel < channels && layout != 0; speaker <<= 1)
+    {
+        if (layout & speaker)
+        {
+            speakers[channel++] = speaker;
+        }
+    }
+
+    Matrix->assign(Channels.size() * channels, 0.0f);
+    DWORD mask = 0;
+    DWORD previous = 0;
+    bool ordered = true;
+    for (size_t output = 0; output < Channels.size(); output++)
+    {
+        if (Channels[output] >= channels)
+        {
+            fprintf(stderr, "Channel %u doesn't exist; the source has %zu channels.\n", Channels[output], channels);
+            return false;
+        }
+        (*Matrix)[output * channels + Channels[output]] = 1.0f;
+
+        //
+        //  Channel masks list speakers in ascending order, so a reordered selection has no mask.
+        //
+        DWORD speaker = speakers[Channels[output]];
+        if (speaker == 0 || speaker <= previous)
+        {
+            ordered = false;
+        }
+        previous = speaker;
+        mask |= speaker;
+    }
+    *OutputChannels = static_cast<WORD>(Channels.size());
+    *OutputChannelMask = ordered ? mask : 0;
+    return true;
+}
+
+bool BuildLayoutMatrix(const WAVEFORMATEX* InputFormat, const WAVEFORMATEX* OutputFormat, std::vector<float>* Matrix)
+{
+    const size_t inputChannels = InputFormat->nChannels;
+    const size_t outputChannels = OutputFormat->nChannels;
+    if (outputChannels == 0 || outputChannels > CHANNEL_REMIX_MAX_OUTPUTS)
+    {
+        fprintf(stderr, "Can't map %u channels to %zu.\n", InputFormat->nChannels, outputChannels);
+        return false;
+    }
+
+    DWORD inputLayout = ChannelLayoutOf(InputFormat);
+    DWORD outputLayout = ChannelLayoutOf(OutputFormat);
+    WORD channels;
+    DWORD mask;
+    if (inputLayout != 0 && outputLayout == (SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT) && outputChannels == 2)
+    {
+        return BuildDownmixMatrix("stereo", InputFormat, Matrix, &channels, &mask);
+    }
+    if (inputLayout != 0 && outputLayout == SPEAKER_FRONT_CENTER && outputChannels == 1)
+    {
+        return BuildDownmixMatrix("mono", InputFormat, Matrix, &channels, &mask);
+    }
+
+    Matrix->assign(outputChannels * inputChannels, 0.0f);
+    if (inputChannels == 1)
+    {
+        for (size_t output = 0; output < outputChannels; output++)
+        {
+            (*Matrix)[output] = 1.0f;
+        }
+        return true;
+    }
+    if (inputLayout == 0 || outputLayout == 0)
+    {
+        for (size_t output = 0; output < outputChannels && output < inputChannels; output++)
+        {
+            (*Matrix)[output * inputChannels + output] = 1.0f;
+        }
+        return true;
+    }
+
+    //
+    //  Match speakers; the n-th set bit of a mask is channel n.
+    //
+    size_t output = 0;
+    for (DWORD speaker = 1; speaker != 0 && output < outputChannels; speaker <<= 1)
+    {
+        if ((outputLayout & speaker) == 0)
+        {
+            continue;
+        }
+        size_t input = 0;
+        for (DWORD other = 1; other != speaker && input < inputChannels; other <<= 1)
+        {
+            if (inputLayout & other)
+            {
+                input++;
+            }
+        }
+        if ((inputLayout & speaker) && input < inputChannels)
+        {
+            (*Matrix)[output * inputChannels + input] = 1.0f;
+        }
+        output++;
+    }
+    return true;
+}
+
+//
+//  Vorbis speaker positions for each channel count, each with the speaker that stands in for it.
+//
+struct VorbisPosition
+{
+    DWORD   Speaker;
+    DWORD   Alternate;
+};
+
+static const VorbisPosition VorbisLayouts[8][8] =
+{
+    { { SPEAKER_FRONT_CENTER, 0 } },
+    { { SPEAKER_FRONT_LEFT, 0 }, { SPEAKER_FRONT_RIGHT, 0 } },
+    { { SPEAKER_FRONT_LEFT, 0 }, { SPEAKER_FRONT_CENTER, 0 }, { SPEAKER_FRONT_RIGHT, 0 } },
+    { { SPEAKER_FRONT_LEFT, 0 }, { SPEAKER_FRONT_RIGHT, 0 }, { SPEAKER_BACK_LEFT, SPEAKER_SIDE_LEFT },
+      { SPEAKER_BACK_RIGHT, SPEAKER_SIDE_RIGHT } },
+    { { SPEAKER_FRONT_LEFT, 0 }, { SPEAKER_FRONT_CENTER, 0 }, { SPEAKER_FRONT_RIGHT, 0 },
+      { SPEAKER_BACK_LEFT, SPEAKER_SIDE_LEFT }, { SPEAKER_BACK_RIGHT, SPEAKER_SIDE_RIGHT } },
+    { { SPEAKER_FRONT_LEFT, 0 }, { SPEAKER_FRONT_CENTER, 0 }, { SPEAKER_FRONT_RIGHT, 0 },
+      { SPEAKER_BACK_LEFT, SPEAKER_SIDE_LEFT }, { SPEAKER_BACK_RIGHT, SPEAKER_SIDE_RIGHT }, { SPEAKER_LOW_FREQUENCY, 0 } },
+    { { SPEAKER_FRONT_LEFT, 0 }, { SPEAKER_FRONT_CENTER, 0 }, { SPEAKER_FRONT_RIGHT, 0 },
+      { SPEAKER_SIDE_LEFT, SPEAKER_BACK_LEFT }, { SPEAKER_SIDE_RIGHT, SPEAKER_BACK_RIGHT }, { SPEAKER_BACK_CENTER, 0 },
+      { SPEAKER_LOW_FREQUENCY, 0 } },
+    { { SPEAKER_FRONT_LEFT, 0 }, { SPEAKER_FRONT_CENTER, 0 }, { SPEAKER_FRONT_RIGHT, 0 },
+      { SPEAKER_SIDE_LEFT, 0 }, { SPEAKER_SIDE_RIGHT, 0 }, { SPEAKER_BACK_LEFT, 0 }, { SPEAKER_BACK_RIGHT, 0 },
+      { SPEAKER_LOW_FREQUENCY, 0 } },
+};
+
+void BuildVorbisChannelOrder(const WAVEFORMATEX* Format, uint32_t* Order)
+{
+    const size_t channels = Format->nChannels;
+    for (size_t position = 0; position < channels; position++)
+    {
+        Order[position] = static_cast<uint32_t>(position);
+    }
+    DWORD layout = ChannelLayoutOf(Format);
+    if (channels == 0 || channels > 8 || layout == 0)
+    {
+        return;
+    }
+
+    //
+    //  The n-th set bit of the layout is channel n.
+    //
+    DWORD speakers[8] = {};
+    size_t channel = 0;
+    for (DWORD speaker = 1; speaker != 0 && channel < channels; speaker <<= 1)
+    {
+        if (layout & speaker)
+        {
+            speakers[channel++] = speaker;
+        }
+    }
+
+    bool taken[8] = {};
+    bool placed[8] = {};
+    const VorbisPosition* positions = VorbisLayouts[channels - 1];
+    for (int pass = 0; pass < 2; pass++)
+    {
+        for (size_t position = 0; position < channels; position++)
+        {
+            DWORD speaker = pass == 0 ? positions[position].Speaker : positions[position].Alternate;
+            for (channel = 0; channel < channels && !placed[position] && speaker != 0; channel++)
+            {
+                if (!taken[channel] && speakers[channel] == speaker)
+                {
+                    Order[position] = static_cast<uint32_t>(channel);
+                    taken[channel] = true;
+                    placed[position] = true;
+                }
+            }
+        }
+    }
+
+    //
+    //  Whatever is left fills the positions left over, in order.
+    //
+    channel = 0;
+    for (size_t position = 0; position < channels; position++)
+    {
+        if (placed[position])
+        {
+            continue;
+        }
+        while (taken[channel])
+        {
+            channel++;
+        }
+        Order[position] = static_cast<uint32_t>(channel);
+        taken[channel] = true;
+    }
+}
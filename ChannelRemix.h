@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "AudioFormat.h"
+#include "SampleConvert.h"
+#include "ChannelRemixKernels.h"
+
+//
+//  Maps interleaved 32 bit float frames of one channel layout to another through a gain matrix, e.g. a 5.1 or 7.1
+//  endpoint down to stereo, mono or a subset of its channels.
+//
+//  Every output channel is a weighted sum of the input channels.  A matrix that only picks channels (each row a
+//  single gain of 1) is a plain gather; anything else runs a multiply-accumulate kernel, the fastest the CPU
+//  supports up to MaxKernel.  Buffers are allocated in Initialize().
+//
+class CChannelRemixer
+{
+public:
+    CChannelRemixer();
+
+    //
+    //  Matrix holds OutputChannels rows of InputFormat->nChannels gains.  OutputChannelMask describes the output
+    //  layout, or is 0 if it has none.
+    //
+    bool Initialize(const WAVEFORMATEX* InputFormat, const float* Matrix, WORD OutputChannels, DWORD OutputChannelMask,
+        size_t MaxFrames, SampleConvertKernel MaxKernel = SampleKernelAvx2);
+
+    const WAVEFORMATEX* OutputFormat() const { return &_OutputFormat.Format; }
+    size_t InputFrameSize() const { return _InputChannels * sizeof(float); }
+    size_t OutputFrameSize() const { return _OutputChannels * sizeof(float); }
+    size_t MaxFrames() const { return _MaxFrames; }
+    bool IsSelection() const { return !_Selection.empty(); }
+    SampleConvertKernel Kernel() const { return _Kernel; }
+
+    //
+    //  Remix up to MaxFrames() frames.  The output stays valid until the next call.
+    //
+    const float* Process(const float* Input, size_t Frames);
+
+private:
+    WAVEFORMATEXTENSIBLE    _OutputFormat;
+    uint32_t                _InputChannels;
+    uint32_t                _OutputChannels;
+    size_t                  _MaxFrames;
+    SampleConvertKernel     _Kernel;
+    ChannelRemixFunction    _Function;
+
+    //
+    //  One column of CHANNEL_REMIX_MAX_OUTPUTS gains per input channel, zero padded.
+    //
+    std::vector<float>      _Matrix;
+
+    //
+    //  For a pure channel selection, the input channel of each output channel.
+    //
+    std::vector<uint32_t>   _Selection;
+
+    std::vector<float>      _Output;
+};
+
+//
+//  The speaker layout of a format: its channel mask, or the usual layout for its channel count if it has none.
+//  Returns 0 if neither is known.
+//
+DWORD ChannelLayoutOf(const WAVEFORMATEX* WaveFormat);
+
+//
+//  Build the matrix for a named downmix ("stereo" or "mono") from the input format's layout.  Front channels pass
+//  at unity, center and surround channels at -3 dB, LFE is dropped, and the whole matrix is scaled down if needed
+//  so a full scale signal on every channel can't clip.
+//
+bool BuildDownmixMatrix(const std::string& Preset, const WAVEFORMATEX* InputFormat, std::vector<float>* Matrix,
+    WORD* OutputChannels, DWORD* OutputChannelMask);
+
+//
+//  Build the matrix that maps one format's channels onto another's layout, for when a stream's layout changes under
+//  us.  Stereo and mono targets get the downmix above; otherwise each output speaker takes the same speaker from the
+//  input, a mono input feeds every output, and unknown layouts map channel by channel.
+//
+bool BuildLayoutMatrix(const WAVEFORMATEX* InputFormat, const WAVEFORMATEX* OutputFormat, std::vector<float>* Matrix);
+
+//
+//  Build the matrix that picks the given input channels (0 based), in order.  The output keeps the speaker
+//  positions of the picked channels when they still form a valid channel mask.
+//
+bool BuildChannelSelectionMatrix(const std::vector<uint32_t>& Channels, const WAVEFORMATEX* InputFormat, std::vector<float>* Matrix,
+    WORD* OutputChannels, DWORD* OutputChannelMask);
+
+//
+//  Vorbis channel order (RFC 7845 section 5.1.1.2, used by Opus mapping family 1) for 1 to 8 channels: Order[i] is
+//  the input channel that goes to Vorbis position i.  Speakers are matched by the format's layout, with side and back
+//  surrounds standing in for each other; channels the layout doesn't place keep their order.  Order has room for
+//  nChannels entries, and is left in input order when the layout is unknown.
+//
+void BuildVorbisChannelOrder(const WAVEFORMATEX* Format, uint32_t* Order);
@@ -0,0 +1,63 @@
+#include "ChannelRemixKernels.h"
+
+//
+//  Built with AVX2 code generation enabled where the compiler supports it; CChannelRemixer only calls in here after
+//  checking the CPU.
+//
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+//
+//  All eight outputs of a frame live in one register: each input sample is broadcast and accumulated against its
+//  matrix column.  With four or fewer outputs, each 128 bit half works on its own frame instead, two frames at a time.
+//
+static void RemixAvx2(const float* Matrix, size_t InputChannels, const float* Input, float* Output, size_t OutputChannels, size_t Frames)
+{
+    size_t frame = 0;
+    if (OutputChannels <= 4)
+    {
+        for (; frame + 2 <= Frames; frame += 2)
+        {
+            const float* next = Input + InputChannels;
+            __m256 sum = _mm256_setzero_ps();
+            for (size_t channel = 0; channel < InputChannels; channel++)
+            {
+                __m256 column = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(Matrix + channel * CHANNEL_REMIX_MAX_OUTPUTS));
+                __m256 samples = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_broadcast_ss(Input + channel)), _mm_broadcast_ss(next + channel), 1);
+                sum = _mm256_add_ps(sum, _mm256_mul_ps(column, samples));
+            }
+            _mm_storeu_ps(Output, _mm256_castps256_ps128(sum));
+            _mm_storeu_ps(Output + OutputChannels, _mm256_extractf128_ps(sum, 1));
+            Input += 2 * InputChannels;
+            Output += 2 * OutputChannels;
+        }
+    }
+
+    for (; frame < Frames; frame++)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        for (size_t channel = 0; channel < InputChannels; channel++)
+        {
+            __m256 column = _mm256_loadu_ps(Matrix + channel * CHANNEL_REMIX_MAX_OUTPUTS);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(column, _mm256_broadcast_ss(Input + channel)));
+        }
+        _mm256_storeu_ps(Output, sum);
+        Input += InputChannels;
+        Output += OutputChannels;
+    }
+}
+
+ChannelRemixFunction GetAvx2ChannelRemix()
+{
+    return RemixAvx2;
+}
+
+#else
+
+ChannelRemixFunction GetAvx2ChannelRemix()
+{
+    return NULL;
+}
+
+#endif
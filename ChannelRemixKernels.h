@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stddef.h>
+
+//
+//  Multiply-accumulate kernels of the channel remixer.  Like SampleConvertKernels.h, this header must stay free of
+//  inline code because ChannelRemixAvx2.cpp is built with AVX2 enabled.
+//
+
+//
+//  The remixer produces at most this many channels; the matrix keeps one column of this many gains per input channel.
+//
+#define CHANNEL_REMIX_MAX_OUTPUTS 8
+
+//
+//  Output[f * OutputChannels + o] = sum over i of Matrix[i * CHANNEL_REMIX_MAX_OUTPUTS + o] * Input[f * InputChannels + i]
+//  for Frames frames.  Each frame is stored with a full CHANNEL_REMIX_MAX_OUTPUTS wide write, so Output needs room
+//  for CHANNEL_REMIX_MAX_OUTPUTS - OutputChannels floats past the last frame.  Nothing needs to be aligned.
+//
+typedef void (*ChannelRemixFunction)(const float* Matrix, size_t InputChannels, const float* Input, float* Output,
+    size_t OutputChannels, size_t Frames);
+
+//
+//  The AVX2 kernel, or NULL if this build has none.  Only call it if CpuSupportsAvx2().
+//
+ChannelRemixFunction GetAvx2ChannelRemix();
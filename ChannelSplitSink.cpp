@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "ChannelSplitSink.h"
+
+//
+//  Frames gathered per output and Write() call.
+//
+#define CHANNEL_SPLIT_CHUNK_FRAMES 4096
+
+CChannelSplitSink::CChannelSplitSink() :
+    _FrameSize(0),
+    _PartialSize(0)
+{
+}
+
+CChannelSplitSink::~CChannelSplitSink()
+{
+    for (size_t i = 0; i < _Sinks.size(); i++)
+    {
+        delete _Sinks[i];
+    }
+}
+
+std::string CChannelSplitSink::SplitFileName(const std::string& FileName, uint32_t Index)
+{
+    size_t dot = FileName.find_last_of('.');
+    size_t slash = FileName.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        dot = FileName.size();
+    }
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%u", Index);
+    return FileName.substr(0, dot) + suffix + FileName.substr(dot);
+}
+
+bool CChannelSplitSink::Open(IOutputSink* const* Sinks, const WORD* Channels, size_t Count, WORD BytesPerSample)
+{
+    _Sinks.assign(Sinks, Sinks + Count);
+    _Offsets.resize(Count);
+    _Sizes.resize(Count);
+    _FrameSize = 0;
+    for (size_t i = 0; i < Count; i++)
+    {
+        if (Sinks[i] == NULL || Channels[i] == 0)
+        {
+            fprintf(stderr, "Invalid channel split output %zu.\n", i);
+            return false;
+        }
+        _Offsets[i] = _FrameSize;
+        _Sizes[i] = static_cast<size_t>(Channels[i]) * BytesPerSample;
+        _FrameSize += _Sizes[i];
+    }
+    if (_FrameSize == 0)
+    {
+        fprintf(stderr, "Channel split needs at least one output.\n");
+        return false;
+    }
+    _Partial.assign(_FrameSize, 0);
+    _PartialSize = 0;
+    _Scratch.resize(static_cast<size_t>(CHANNEL_SPLIT_CHUNK_FRAMES) * *std::max_element(_Sizes.begin(), _Sizes.end()));
+    return true;
+}
+
+bool CChannelSplitSink::Write(const uint8_t* Data, size_t Size)
+{
+    if (_PartialSize != 0)
+    {
+        size_t take = std::min(Size, _FrameSize - _PartialSize);
+        memcpy(&_Partial[_PartialSize], Data, take);
+        _PartialSize += take;
+        Data += take;
+        Size -= take;
+        if (_PartialSize < _FrameSize)
+        {
+            return true;
+        }
+        _PartialSize = 0;
+        if (!WriteFrames(&_Partial[0], 1))
+        {
+            return false;
+        }
+    }
+
+    size_t frames = Size / _FrameSize;
+    if (!WriteFrames(Data, frames))
+    {
+        return false;
+    }
+    _PartialSize = Size - frames * _FrameSize;
+    memcpy(&_Partial[0], Data + frames * _FrameSize, _PartialSize);
+    return true;
+}
+
+bool CChannelSplitSink::WriteFrames(const uint8_t* Data, size_t Frames)
+{
+    while (Frames != 0)
+    {
+        size_t chunk = std::min<size_t>(Frames, CHANNEL_SPLIT_CHUNK_FRAMES);
+        for (size_t i = 0; i < _Sinks.size(); i++)
+        {
+            const uint8_t* source = Data + _Offsets[i];
+            uint8_t* target = &_Scratch[0];
+            for (size_t frame = 0; frame < chunk; frame++)
+            {
+                memcpy(target, source, _Sizes[i]);
+                source += _FrameSize;
+                target += _Sizes[i];
+            }
+            if (!_Sinks[i]->Write(&_Scratch[0], chunk * _Sizes[i]))
+            {
+                return false;
+            }
+        }
+        Data += chunk * _FrameSize;
+        Frames -= chunk;
+    }
+    return true;
+}
+
+bool CChannelSplitSink::Flush()
+{
+    bool succeeded = true;
+    for (size_t i = 0; i < _Sinks.size(); i++)
+    {
+        succeeded = _Sinks[i]->Flush() && succeeded;
+    }
+    return succeeded;
+}
+
+//
+//  A partial frame left at the end never got its other channels, so it's dropped.
+//
+bool CChannelSplitSink::Close()
+{
+    bool succeeded = true;
+    for (size_t i = 0; i < _Sinks.size(); i++)
+    {
+        succeeded = _Sinks[i]->Close() && succeeded;
+    }
+    _PartialSize = 0;
+    return succeeded;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "OutputSink.h"
+
+//
+//  Splits an interleaved stream into several outputs by channel: the first output gets the first Channels[0]
+//  channels of every frame, the next one the Channels[1] after those, and so on.  Fed by a multi source, this writes
+//  one file per input, frame for frame in step with each other.  The writer's blocks may end in the middle of a
+//  frame, so a partial frame waits for the rest of it.  The sink owns its outputs from Open() on.
+//
+class CChannelSplitSink : public IOutputSink
+{
+public:
+    CChannelSplitSink();
+    ~CChannelSplitSink();
+
+    bool Open(IOutputSink* const* Sinks, const WORD* Channels, size_t Count, WORD BytesPerSample);
+    bool Write(const uint8_t* Data, size_t Size);
+    bool Flush();
+    bool Close();
+
+    //
+    //  <name>_<index>.<ext>, the file of output Index.
+    //
+    static std::string SplitFileName(const std::string& FileName, uint32_t Index);
+
+private:
+    bool WriteFrames(const uint8_t* Data, size_t Frames);
+
+    std::vector<IOutputSink*>   _Sinks;
+    std::vector<size_t>         _Offsets;       // Of each output's channels in the frame, in bytes.
+    std::vector<size_t>         _Sizes;         // Bytes of each output's frames.
+    size_t                      _FrameSize;
+    std::vector<uint8_t>        _Partial;
+    size_t                      _PartialSize;
+    std::vector<uint8_t>        _Scratch;
+};
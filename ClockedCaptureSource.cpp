@@ -0,0 +1,170 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "ClockedCaptureSource.h"
+
+CClockedCaptureSource::CClockedCaptureSource() :
+    _RefCount(1),
+    _Clock(&_SteadyClock),
+    _Scheduler(NULL),
+    _PeriodInHns(0),
+    _RealTime(true),
+    _RingBuffer(NULL),
+    _Finished(false)
+{
+    memset(&_MixFormat, 0, sizeof(_MixFormat));
+}
+
+CClockedCaptureSource::~CClockedCaptureSource()
+{
+    Shutdown();
+}
+
+//
+//  Pick the clock and the wakeup period.  Subclasses call this from their Initialize().
+//
+bool CClockedCaptureSource::InitializeClock(int64_t PeriodInHns, bool RealTime)
+{
+    if (PeriodInHns <= 0)
+    {
+        fprintf(stderr, "Invalid capture period: %lld\n", static_cast<long long>(PeriodInHns));
+        return false;
+    }
+
+    _PeriodInHns = PeriodInHns;
+    _RealTime = RealTime;
+    _Clock = RealTime ? static_cast<ICaptureClock*>(&_SteadyClock) : static_cast<ICaptureClock*>(&_SyntheticClock);
+
+    delete _Scheduler;
+    _Scheduler = new CClockCaptureScheduler(_Clock, _PeriodInHns);
+    return true;
+}
+
+bool CClockedCaptureSource::Start(CCaptureRingBuffer* RingBuffer, const CaptureProcessing* Processing)
+{
+    if (_Scheduler == NULL)
+    {
+        fprintf(stderr, "Capture source started before it was initialized.\n");
+        return false;
+    }
+    if (!_Drain.Attach(RingBuffer, Processing, MixFormat(), _Clock, _PeriodInHns))
+    {
+        return false;
+    }
+
+    _RingBuffer = RingBuffer;
+    _Finished.store(false, std::memory_order_release);
+    _Scheduler->Reset();
+
+    _CaptureThread = std::thread(&CClockedCaptureSource::CaptureThread, this);
+    return true;
+}
+
+void CClockedCaptureSource::Stop()
+{
+    if (_CaptureThread.joinable())
+    {
+        _Scheduler->RequestShutdown();
+        _CaptureThread.join();
+    }
+}
+
+void CClockedCaptureSource::Shutdown()
+{
+    Stop();
+    delete _Scheduler;
+    _Scheduler = NULL;
+}
+
+//
+//  Without a real clock nothing paces the source, so hold off while the consumer hasn't made room for Frames.
+//  Returns false if we're shut down while waiting.
+//
+bool CClockedCaptureSource::WaitForRoom(size_t Frames)
+{
+    if (Frames > _RingBuffer->FrameCapacity())
+    {
+        Frames = _RingBuffer->FrameCapacity();
+    }
+    while (!_RealTime && _RingBuffer->WritableFrames() < Frames && !IsFinished())
+    {
+        if (_Scheduler->ShutdownRequested())
+        {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+//
+//  Capture thread - behaves like the WASAPI capture thread but pulls its packets from the subclass.
+//
+void CClockedCaptureSource::CaptureThread()
+{
+    OnStart();
+
+    //
+    //  Without a real clock, wait for room for roughly two periods worth of frames before each drain.  Otherwise we'd
+    //  just discard everything the writer can't keep up with.  A switch waits for half the ring, for the gap.
+    //
+    size_t backpressureFrames = static_cast<size_t>(2 * _PeriodInHns * _MixFormat.Format.nSamplesPerSec / 10000000);
+
+    bool stillPlaying = true;
+    while (stillPlaying)
+    {
+        switch (_Scheduler->WaitForWork())
+        {
+        case CaptureWakeShutdown:
+            stillPlaying = false;
+            break;
+        case CaptureWakeStreamSwitch:
+            {
+                if (!WaitForRoom(_RingBuffer->FrameCapacity() / 2))
+                {
+                    return;
+                }
+                int64_t switchStart = _Clock->Now();
+                if (!OnStreamSwitch() || !_Drain.SwitchFormat(MixFormat(), _Clock->Now() - switchStart))
+                {
+                    fprintf(stderr, "Could not handle the stream switch.\n");
+                    SetFinished();
+                    stillPlaying = false;
+                }
+            }
+            break;
+        case CaptureWakeSamplesReady:
+            if (!WaitForRoom(backpressureFrames))
+            {
+                return;
+            }
+            if (!_Drain.Drain(this))
+            {
+                //
+                //  The source can't deliver any more data - let the consumer know it's done.
+                //
+                SetFinished();
+            }
+            if (IsFinished())
+            {
+                stillPlaying = false;
+            }
+            break;
+        }
+    }
+}
+
+ULONG CClockedCaptureSource::AddRef()
+{
+    return ++_RefCount;
+}
+
+ULONG CClockedCaptureSource::Release()
+{
+    ULONG returnValue = --_RefCount;
+    if (returnValue == 0)
+    {
+        delete this;
+    }
+    return returnValue;
+}
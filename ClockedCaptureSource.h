@@ -0,0 +1,74 @@
+#pragma once
+
+#include <atomic>
+#include <thread>
+#include "CaptureSource.h"
+#include "CaptureScheduler.h"
+
+//
+//  Base class for portable sources that behave like a capture engine driven by a clock.
+//
+//  The base owns the capture thread, the clock scheduler and the drain.  On every wakeup it drains the subclass'
+//  ICapturePacketClient into the ring exactly as the WASAPI backend drains IAudioCaptureClient, so the portable
+//  backends exercise the same hot path.  Packets become available according to Clock(), which is the wall clock in
+//  real time mode and a CSyntheticCaptureClock otherwise.
+//
+class CClockedCaptureSource : public ICaptureSource, protected ICapturePacketClient
+{
+public:
+    bool Start(CCaptureRingBuffer* RingBuffer, const CaptureProcessing* Processing);
+    void Stop();
+    void Shutdown();
+
+    WAVEFORMATEX* MixFormat() { return &_MixFormat.Format; }
+    size_t FrameSize() { return _MixFormat.Format.nBlockAlign; }
+    void GetDrainStats(CaptureDrainStats* Stats) { _Drain.GetStats(Stats); }
+    bool GetLevels(LevelMeterReading* Reading) { return _Drain.GetLevels(Reading); }
+    bool IsFinished() { return _Finished.load(std::memory_order_acquire); }
+
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+protected:
+    CClockedCaptureSource();
+    virtual ~CClockedCaptureSource();
+
+    bool InitializeClock(int64_t PeriodInHns, bool RealTime);
+    ICaptureClock* Clock() { return _Clock; }
+    void SetFinished() { _Finished.store(true, std::memory_order_release); }
+
+    //
+    //  Have the capture thread call OnStreamSwitch() at its next wakeup.
+    //
+    void RequestStreamSwitch() { _Scheduler->RequestStreamSwitch(); }
+
+    //
+    //  Called on the capture thread before the first wakeup, with Clock() at the start of the stream.
+    //
+    virtual void OnStart() = 0;
+
+    //
+    //  Called on the capture thread after RequestStreamSwitch() to reopen the stream, possibly on a new _MixFormat.
+    //  Everything from the call until it returns counts as the switch gap and is filled with silence.
+    //
+    virtual bool OnStreamSwitch() { return false; }
+
+    WAVEFORMATEXTENSIBLE    _MixFormat;
+
+private:
+    void CaptureThread();
+    bool WaitForRoom(size_t Frames);
+
+    std::atomic<ULONG>      _RefCount;
+    CSteadyCaptureClock     _SteadyClock;
+    CSyntheticCaptureClock  _SyntheticClock;
+    ICaptureClock*          _Clock;
+    CClockCaptureScheduler* _Scheduler;
+    int64_t                 _PeriodInHns;
+    bool                    _RealTime;
+
+    std::thread             _CaptureThread;
+    CCaptureRingBuffer*     _RingBuffer;
+    CCaptureDrain           _Drain;
+    std::atomic<bool>       _Finished;
+};
@@ -0,0 +1,567 @@
+#include <string.h>
+#include "FlacEncoder.h"
+
+#define FLAC_SUBFRAME_CONSTANT  0x00
+#define FLAC_SUBFRAME_VERBATIM  0x01
+#define FLAC_SUBFRAME_FIXED     0x08
+
+#define FLAC_CHANNELS_LEFT_SIDE     8
+#define FLAC_CHANNELS_SIDE_RIGHT    9
+#define FLAC_CHANNELS_MID_SIDE      10
+
+#define FLAC_RICE_MAX_PARAMETER     30
+
+//
+//  The CRC tables, built the first time any thread asks for them; the initialization of a function local static is
+//  thread safe, so encoders starting on several workers at once can't see them half built.
+//
+struct FlacCrcTables
+{
+    uint8_t     Crc8[256];
+    uint16_t    Crc16[256];
+
+    FlacCrcTables()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc8 = i;
+            uint32_t crc16 = i << 8;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc8 = (crc8 & 0x80) ? (crc8 << 1) ^ 0x07 : crc8 << 1;
+                crc16 = (crc16 & 0x8000) ? (crc16 << 1) ^ 0x8005 : crc16 << 1;
+            }
+            Crc8[i] = static_cast<uint8_t>(crc8);
+            Crc16[i] = static_cast<uint16_t>(crc16);
+        }
+    }
+};
+
+static const FlacCrcTables& CrcTables()
+{
+    static const FlacCrcTables tables;
+    return tables;
+}
+
+static uint8_t Crc8(const uint8_t* Data, size_t Size)
+{
+    const uint8_t* table = CrcTables().Crc8;
+    uint8_t crc = 0;
+    for (size_t i = 0; i < Size; i++)
+    {
+        crc = table[crc ^ Data[i]];
+    }
+    return crc;
+}
+
+static uint16_t Crc16(const uint8_t* Data, size_t Size)
+{
+    const uint16_t* table = CrcTables().Crc16;
+    uint16_t crc = 0;
+    for (size_t i = 0; i < Size; i++)
+    {
+        crc = static_cast<uint16_t>((crc << 8) ^ table[(crc >> 8) ^ Data[i]]);
+    }
+    return crc;
+}
+
+//
+//  MSB first bit writer appending to a byte vector.
+//
+class CFlacBitWriter
+{
+public:
+    CFlacBitWriter(std::vector<uint8_t>* Output) :
+        _Output(Output),
+        _Accumulator(0),
+        _Bits(0)
+    {
+    }
+
+    void Put(uint32_t Value, uint32_t Bits)
+    {
+        if (Bits == 0)
+        {
+            return;
+        }
+        _Accumulator = (_Accumulator << Bits) | (Bits == 32 ? Value : Value & ((1u << Bits) - 1));
+        _Bits += Bits;
+        while (_Bits >= 8)
+        {
+            _Bits -= 8;
+            _Output->push_back(static_cast<uint8_t>(_Accumulator >> _Bits));
+        }
+    }
+
+    void PutSigned(int32_t Value, uint32_t Bits)
+    {
+        Put(static_cast<uint32_t>(Value), Bits);
+    }
+
+    void PutRice(uint32_t Value, uint32_t Parameter)
+    {
+        uint32_t quotient = Value >> Parameter;
+        while (quotient >= 32)
+        {
+            Put(0, 32);
+            quotient -= 32;
+        }
+        Put(0, quotient);
+        Put(1, 1);
+        Put(Value, Parameter);
+    }
+
+    void AlignToByte()
+    {
+        if (_Bits != 0)
+        {
+            Put(0, 8 - _Bits);
+        }
+    }
+
+private:
+    std::vector<uint8_t>*   _Output;
+    uint64_t                _Accumulator;
+    uint32_t                _Bits;
+};
+
+static uint32_t ZigZag(int32_t Value)
+{
+    return (static_cast<uint32_t>(Value) << 1) ^ static_cast<uint32_t>(Value >> 31);
+}
+
+CFlacFrameEncoder::CFlacFrameEncoder() :
+    _Channels(0),
+    _BitsPerSample(0),
+    _MaxBlockSize(0)
+{
+}
+
+bool CFlacFrameEncoder::Initialize(uint32_t Channels, uint32_t BitsPerSample, uint32_t MaxBlockSize)
+{
+    if (Channels == 0 || Channels > FLAC_MAX_CHANNELS || BitsPerSample < 4 || BitsPerSample > FLAC_MAX_BITS ||
+        MaxBlockSize < 16 || MaxBlockSize > 65535)
+    {
+        return false;
+    }
+    _Channels = Channels;
+    _BitsPerSample = BitsPerSample;
+    _MaxBlockSize = MaxBlockSize;
+    _Signals.assign((Channels + 2) * MaxBlockSize, 0);
+    _Residuals.assign((Channels + 2) * MaxBlockSize, 0);
+    _Scratch.assign(1 << FLAC_MAX_PARTITION_ORDER, 0);
+    return true;
+}
+
+void CFlacFrameEncoder::ComputeResidual(const int32_t* Signal, uint32_t Frames, uint32_t Order, int32_t* Residual)
+{
+    const int32_t* x = Signal;
+    for (uint32_t i = Order; i < Frames; i++)
+    {
+        int64_t residual;
+        switch (Order)
+        {
+        case 0: residual = x[i]; break;
+        case 1: residual = static_cast<int64_t>(x[i]) - x[i - 1]; break;
+        case 2: residual = static_cast<int64_t>(x[i]) - 2 * static_cast<int64_t>(x[i - 1]) + x[i - 2]; break;
+        case 3: residual = static_cast<int64_t>(x[i]) - 3 * static_cast<int64_t>(x[i - 1]) + 3 * static_cast<int64_t>(x[i - 2]) - x[i - 3]; break;
+        default: residual = static_cast<int64_t>(x[i]) - 4 * static_cast<int64_t>(x[i - 1]) + 6 * static_cast<int64_t>(x[i - 2]) - 4 * static_cast<int64_t>(x[i - 3]) + x[i - 4]; break;
+        }
+        Residual[i - Order] = static_cast<int32_t>(residual);
+    }
+}
+
+//
+//  Estimate each subframe type and keep the smallest.
+//
+void CFlacFrameEncoder::ChooseSubframe(const int32_t* Signal, uint32_t Frames, uint32_t BitsPerSample, SubframeChoice* Choice, int32_t* Residual)
+{
+    bool isConstant = true;
+    for (uint32_t i = 1; i < Frames && isConstant; i++)
+    {
+        isConstant = Signal[i] == Signal[0];
+    }
+    if (isConstant)
+    {
+        Choice->Type = FLAC_SUBFRAME_CONSTANT;
+        Choice->Bits = 8 + BitsPerSample;
+        return;
+    }
+
+    Choice->Type = FLAC_SUBFRAME_VERBATIM;
+    Choice->Bits = 8 + static_cast<uint64_t>(Frames) * BitsPerSample;
+    if (Frames <= FLAC_MAX_FIXED_ORDER)
+    {
+        return;
+    }
+
+    //
+    //  Pick the predictor order with the smallest total absolute residual.
+    //
+    uint64_t errorSums[FLAC_MAX_FIXED_ORDER + 1] = {};
+    int64_t lastError0 = Signal[3];
+    int64_t lastError1 = static_cast<int64_t>(Signal[3]) - Signal[2];
+    int64_t lastError2 = lastError1 - (static_cast<int64_t>(Signal[2]) - Signal[1]);
+    int64_t lastError3 = lastError2 - (static_cast<int64_t>(Signal[2]) - 2 * static_cast<int64_t>(Signal[1]) + Signal[0]);
+    for (uint32_t i = 4; i < Frames; i++)
+    {
+        int64_t error0 = Signal[i];
+        int64_t error1 = error0 - lastError0;
+        int64_t error2 = error1 - lastError1;
+        int64_t error3 = error2 - lastError2;
+        int64_t error4 = error3 - lastError3;
+        errorSums[0] += static_cast<uint64_t>(error0 < 0 ? -error0 : error0);
+        errorSums[1] += static_cast<uint64_t>(error1 < 0 ? -error1 : error1);
+        errorSums[2] += static_cast<uint64_t>(error2 < 0 ? -error2 : error2);
+        errorSums[3] += static_cast<uint64_t>(error3 < 0 ? -error3 : error3);
+        errorSums[4] += static_cast<uint64_t>(error4 < 0 ? -error4 : error4);
+        lastError0 = error0;
+        lastError1 = error1;
+        lastError2 = error2;
+        lastError3 = error3;
+    }
+    uint32_t order = 0;
+    for (uint32_t candidate = 1; candidate <= FLAC_MAX_FIXED_ORDER; candidate++)
+    {
+        if (errorSums[candidate] < errorSums[order])
+        {
+            order = candidate;
+        }
+    }
+    ComputeResidual(Signal, Frames, order, Residual);
+
+    //
+    //  Partition sums at the finest usable partition order, merged pairwise for the coarser ones.  Partition 0 is
+    //  short by the warm-up samples.
+    //
+    uint32_t maxPartitionOrder = 0;
+    while (maxPartitionOrder < FLAC_MAX_PARTITION_ORDER &&
+        (Frames & ((2u << maxPartitionOrder) - 1)) == 0 && (Frames >> (maxPartitionOrder + 1)) > order)
+    {
+        maxPartitionOrder++;
+    }
+
+    uint64_t sums[1 << FLAC_MAX_PARTITION_ORDER];
+    uint32_t partitionCount = 1u << maxPartitionOrder;
+    uint32_t partitionFrames = Frames >> maxPartitionOrder;
+    const int32_t* residual = Residual;
+    for (uint32_t partition = 0; partition < partitionCount; partition++)
+    {
+        uint32_t count = partition == 0 ? partitionFrames - order : partitionFrames;
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            sum += ZigZag(residual[i]);
+        }
+        sums[partition] = sum;
+        residual += count;
+    }
+
+    uint64_t bestBits = UINT64_MAX;
+    for (int partitionOrder = static_cast<int>(maxPartitionOrder); partitionOrder >= 0; partitionOrder--)
+    {
+        partitionCount = 1u << partitionOrder;
+        partitionFrames = Frames >> partitionOrder;
+
+        uint64_t bits = 0;
+        uint32_t maxParameter = 0;
+        for (uint32_t partition = 0; partition < partitionCount; partition++)
+        {
+            uint64_t count = partition == 0 ? partitionFrames - order : partitionFrames;
+            uint32_t bestParameter = 0;
+            uint64_t bestPartitionBits = UINT64_MAX;
+            for (uint32_t parameter = 0; parameter <= FLAC_RICE_MAX_PARAMETER; parameter++)
+            {
+                uint64_t partitionBits = count * (parameter + 1) + (sums[partition] >> parameter);
+                if (partitionBits < bestPartitionBits)
+                {
+                    bestPartitionBits = partitionBits;
+                    bestParameter = parameter;
+                }
+            }
+            _Scratch[partition] = bestParameter;
+            maxParameter = bestParameter > maxParameter ? bestParameter : maxParameter;
+            bits += bestPartitionBits;
+        }
+        bits += static_cast<uint64_t>(partitionCount) * (maxParameter > 14 ? 5 : 4);
+
+        if (bits < bestBits)
+        {
+            bestBits = bits;
+            Choice->PartitionOrder = static_cast<uint32_t>(partitionOrder);
+            memcpy(Choice->Parameters, &_Scratch[0], partitionCount * sizeof(uint32_t));
+        }
+
+        //
+        //  Merge neighbouring partitions for the next, coarser order.
+        //
+        for (uint32_t partition = 0; partition < partitionCount / 2; partition++)
+        {
+            sums[partition] = sums[2 * partition] + sums[2 * partition + 1];
+        }
+    }
+
+    uint64_t fixedBits = 8 + static_cast<uint64_t>(order) * BitsPerSample + 2 + 4 + bestBits;
+    if (fixedBits < Choice->Bits)
+    {
+        Choice->Type = FLAC_SUBFRAME_FIXED;
+        Choice->Order = order;
+        Choice->Bits = fixedBits;
+    }
+}
+
+static void WriteSubframe(CFlacBitWriter* Writer, const int32_t* Signal, const int32_t* Residual, uint32_t Frames, uint32_t BitsPerSample,
+    uint32_t Type, uint32_t Order, uint32_t PartitionOrder, const uint32_t* Parameters)
+{
+    Writer->Put(0, 1);
+    Writer->Put(Type == FLAC_SUBFRAME_FIXED ? Type | Order : Type, 6);
+    Writer->Put(0, 1);
+
+    if (Type == FLAC_SUBFRAME_CONSTANT)
+    {
+        Writer->PutSigned(Signal[0], BitsPerSample);
+        return;
+    }
+    if (Type == FLAC_SUBFRAME_VERBATIM)
+    {
+        for (uint32_t i = 0; i < Frames; i++)
+        {
+            Writer->PutSigned(Signal[i], BitsPerSample);
+        }
+        return;
+    }
+
+    for (uint32_t i = 0; i < Order; i++)
+    {
+        Writer->PutSigned(Signal[i], BitsPerSample);
+    }
+
+    //
+    //  Rice parameters above 14 need the 5 bit parameter coding method.
+    //
+    uint32_t partitionCount = 1u << PartitionOrder;
+    uint32_t parameterBits = 4;
+    for (uint32_t partition = 0; partition < partitionCount; partition++)
+    {
+        if (Parameters[partition] > 14)
+        {
+            parameterBits = 5;
+        }
+    }
+    Writer->Put(parameterBits == 4 ? 0 : 1, 2);
+    Writer->Put(PartitionOrder, 4);
+
+    uint32_t partitionFrames = Frames >> PartitionOrder;
+    for (uint32_t partition = 0; partition < partitionCount; partition++)
+    {
+        uint32_t count = partition == 0 ? partitionFrames - Order : partitionFrames;
+        Writer->Put(Parameters[partition], parameterBits);
+        for (uint32_t i = 0; i < count; i++)
+        {
+            Writer->PutRice(ZigZag(Residual[i]), Parameters[partition]);
+        }
+        Residual += count;
+    }
+}
+
+void CFlacFrameEncoder::EncodeFrame(const int32_t* Samples, uint32_t Frames, uint64_t FrameNumber, std::vector<uint8_t>* Output)
+{
+    //
+    //  De-interleave, and derive mid and side for stereo.
+    //
+    for (uint32_t channel = 0; channel < _Channels; channel++)
+    {
+        int32_t* signal = &_Signals[channel * _MaxBlockSize];
+        for (uint32_t i = 0; i < Frames; i++)
+        {
+            signal[i] = Samples[i * _Channels + channel];
+        }
+    }
+    uint32_t signalCount = _Channels;
+    if (_Channels == 2)
+    {
+        int32_t* left = &_Signals[0];
+        int32_t* right = &_Signals[_MaxBlockSize];
+        int32_t* mid = &_Signals[2 * _MaxBlockSize];
+        int32_t* side = &_Signals[3 * _MaxBlockSize];
+        for (uint32_t i = 0; i < Frames; i++)
+        {
+            mid[i] = (left[i] + right[i]) >> 1;
+            side[i] = left[i] - right[i];
+        }
+        signalCount = 4;
+    }
+
+    //
+    //  The side signal needs one more bit than the channels it is the difference of.
+    //
+    const uint32_t sideSignal = _Channels == 2 ? 3 : FLAC_MAX_CHANNELS;
+    SubframeChoice choices[FLAC_MAX_CHANNELS + 2];
+    for (uint32_t signal = 0; signal < signalCount; signal++)
+    {
+        uint32_t bitsPerSample = signal == sideSignal ? _BitsPerSample + 1 : _BitsPerSample;
+        ChooseSubframe(&_Signals[signal * _MaxBlockSize], Frames, bitsPerSample, &choices[signal], &_Residuals[signal * _MaxBlockSize]);
+    }
+
+    //
+    //  Channel assignment: independent, or the cheapest stereo decorrelation.
+    //
+    uint32_t channelAssignment = _Channels - 1;
+    uint32_t subframeSignals[FLAC_MAX_CHANNELS];
+    for (uint32_t channel = 0; channel < _Channels; channel++)
+    {
+        subframeSignals[channel] = channel;
+    }
+    if (_Channels == 2)
+    {
+        uint64_t independentBits = choices[0].Bits + choices[1].Bits;
+        uint64_t leftSideBits = choices[0].Bits + choices[3].Bits;
+        uint64_t sideRightBits = choices[3].Bits + choices[1].Bits;
+        uint64_t midSideBits = choices[2].Bits + choices[3].Bits;
+        uint64_t bestBits = independentBits;
+        if (leftSideBits < bestBits)
+        {
+            bestBits = leftSideBits;
+            channelAssignment = FLAC_CHANNELS_LEFT_SIDE;
+            subframeSignals[0] = 0;
+            subframeSignals[1] = 3;
+        }
+        if (sideRightBits < bestBits)
+        {
+            bestBits = sideRightBits;
+            channelAssignment = FLAC_CHANNELS_SIDE_RIGHT;
+            subframeSignals[0] = 3;
+            subframeSignals[1] = 1;
+        }
+        if (midSideBits < bestBits)
+        {
+            channelAssignment = FLAC_CHANNELS_MID_SIDE;
+            subframeSignals[0] = 2;
+            subframeSignals[1] = 3;
+        }
+    }
+
+    //
+    //  Frame header.  Sample rate and sample size come from STREAMINFO.
+    //
+    size_t frameStart = Output->size();
+    CFlacBitWriter writer(Output);
+    writer.Put(0x3FFE, 14);
+    writer.Put(0, 1);
+    writer.Put(0, 1);
+
+    uint32_t blockSizeCode = 7;
+    for (uint32_t code = 8; code <= 15; code++)
+    {
+        if (Frames == (256u << (code - 8)))
+        {
+            blockSizeCode = code;
+        }
+    }
+    writer.Put(blockSizeCode, 4);
+    writer.Put(0, 4);
+    writer.Put(channelAssignment, 4);
+    writer.Put(0, 3);
+    writer.Put(0, 1);
+
+    //
+    //  Frame number in the extended UTF-8 coding.
+    //
+    if (FrameNumber < 0x80)
+    {
+        writer.Put(static_cast<uint32_t>(FrameNumber), 8);
+    }
+    else
+    {
+        uint32_t byteCount = 2;
+        while (byteCount < 7 && FrameNumber >= (1ull << (5 * byteCount + 1)))
+        {
+            byteCount++;
+        }
+        uint32_t leadingBits = (0xFF00u >> byteCount) & 0xFF;
+        writer.Put(leadingBits | static_cast<uint32_t>(FrameNumber >> (6 * (byteCount - 1))), 8);
+        for (uint32_t i = byteCount - 1; i > 0; i--)
+        {
+            writer.Put(0x80 | static_cast<uint32_t>((FrameNumber >> (6 * (i - 1))) & 0x3F), 8);
+        }
+    }
+    if (blockSizeCode == 7)
+    {
+        writer.Put(Frames - 1, 16);
+    }
+    writer.Put(Crc8(&(*Output)[frameStart], Output->size() - frameStart), 8);
+
+    for (uint32_t channel = 0; channel < _Channels; channel++)
+    {
+        uint32_t signal = subframeSignals[channel];
+        const SubframeChoice& choice = choices[signal];
+        WriteSubframe(&writer, &_Signals[signal * _MaxBlockSize], &_Residuals[signal * _MaxBlockSize], Frames,
+            signal == sideSignal ? _BitsPerSample + 1 : _BitsPerSample, choice.Type, choice.Order, choice.PartitionOrder, choice.Parameters);
+    }
+
+    writer.AlignToByte();
+    writer.Put(Crc16(&(*Output)[frameStart], Output->size() - frameStart), 16);
+}
+
+size_t FlacHeaderSize(uint32_t SeekPointCapacity)
+{
+    return 4 + 4 + 34 + 4 + static_cast<size_t>(SeekPointCapacity) * FLAC_SEEKPOINT_SIZE;
+}
+
+void BuildFlacHeader(const FlacStreamInfo& Info, const FlacSeekPoint* SeekPoints, uint32_t SeekPointCount, uint32_t SeekPointCapacity, std::vector<uint8_t>* Header)
+{
+    Header->clear();
+    Header->reserve(FlacHeaderSize(SeekPointCapacity));
+    CFlacBitWriter writer(Header);
+
+    writer.Put('f', 8);
+    writer.Put('L', 8);
+    writer.Put('a', 8);
+    writer.Put('C', 8);
+
+    //
+    //  STREAMINFO.  The MD5 signature is left 0 (unknown): the frames are encoded out of order.
+    //
+    writer.Put(0, 1);
+    writer.Put(0, 7);
+    writer.Put(34, 24);
+    writer.Put(Info.BlockSize, 16);
+    writer.Put(Info.BlockSize, 16);
+    writer.Put(Info.MinFrameSize, 24);
+    writer.Put(Info.MaxFrameSize, 24);
+    writer.Put(Info.SampleRate, 20);
+    writer.Put(Info.Channels - 1, 3);
+    writer.Put(Info.BitsPerSample - 1, 5);
+    writer.Put(static_cast<uint32_t>(Info.TotalSamples >> 32), 4);
+    writer.Put(static_cast<uint32_t>(Info.TotalSamples), 32);
+    for (int i = 0; i < 4; i++)
+    {
+        writer.Put(0, 32);
+    }
+
+    //
+    //  SEEKTABLE, the last metadata block.
+    //
+    writer.Put(1, 1);
+    writer.Put(3, 7);
+    writer.Put(SeekPointCapacity * FLAC_SEEKPOINT_SIZE, 24);
+    for (uint32_t i = 0; i < SeekPointCapacity; i++)
+    {
+        if (i < SeekPointCount)
+        {
+            writer.Put(static_cast<uint32_t>(SeekPoints[i].SampleNumber >> 32), 32);
+            writer.Put(static_cast<uint32_t>(SeekPoints[i].SampleNumber), 32);
+            writer.Put(static_cast<uint32_t>(SeekPoints[i].Offset >> 32), 32);
+            writer.Put(static_cast<uint32_t>(SeekPoints[i].Offset), 32);
+            writer.Put(SeekPoints[i].Frames, 16);
+        }
+        else
+        {
+            writer.Put(0xFFFFFFFF, 32);
+            writer.Put(0xFFFFFFFF, 32);
+            writer.Put(0, 32);
+            writer.Put(0, 32);
+            writer.Put(0, 16);
+        }
+    }
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+//
+//  FLAC limits we encode within: up to 8 channels of 4 to 24 bit samples.
+//
+#define FLAC_MAX_CHANNELS       8
+#define FLAC_MAX_BITS           24
+#define FLAC_MAX_FIXED_ORDER    4
+#define FLAC_MAX_PARTITION_ORDER 6
+
+//
+//  Encodes independent FLAC frames.
+//
+//  Each frame uses the fixed polynomial predictors (orders 0-4) with partitioned Rice coding of the residual, picks
+//  constant or verbatim subframes where they are smaller, and tries left/side, side/right and mid/side decorrelation
+//  for stereo.  Frames don't depend on each other, so any number of encoders can work on different frames of the
+//  same stream at once.  All scratch space is allocated in Initialize().
+//
+class CFlacFrameEncoder
+{
+public:
+    CFlacFrameEncoder();
+
+    bool Initialize(uint32_t Channels, uint32_t BitsPerSample, uint32_t MaxBlockSize);
+
+    //
+    //  Samples are interleaved and already in range for BitsPerSample.  The frame is appended to Output.
+    //
+    void EncodeFrame(const int32_t* Samples, uint32_t Frames, uint64_t FrameNumber, std::vector<uint8_t>* Output);
+
+private:
+    struct SubframeChoice
+    {
+        uint32_t    Type;           // FLAC subframe type code
+        uint32_t    Order;
+        uint32_t    PartitionOrder;
+        uint32_t    Parameters[1 << FLAC_MAX_PARTITION_ORDER];
+        uint64_t    Bits;
+    };
+
+    void ChooseSubframe(const int32_t* Signal, uint32_t Frames, uint32_t BitsPerSample, SubframeChoice* Choice, int32_t* Residual);
+    void ComputeResidual(const int32_t* Signal, uint32_t Frames, uint32_t Order, int32_t* Residual);
+
+    uint32_t                _Channels;
+    uint32_t                _BitsPerSample;
+    uint32_t                _MaxBlockSize;
+
+    //
+    //  One signal per channel, plus mid and side for stereo, and the residual of each.
+    //
+    std::vector<int32_t>    _Signals;
+    std::vector<int32_t>    _Residuals;
+    std::vector<uint32_t>   _Scratch;
+};
+
+//
+//  STREAMINFO metadata block (34 bytes).  A TotalSamples or frame size of 0 means unknown.
+//
+struct FlacStreamInfo
+{
+    uint32_t    BlockSize;
+    uint32_t    MinFrameSize;
+    uint32_t    MaxFrameSize;
+    uint32_t    SampleRate;
+    uint32_t    Channels;
+    uint32_t    BitsPerSample;
+    uint64_t    TotalSamples;
+};
+
+struct FlacSeekPoint
+{
+    uint64_t    SampleNumber;
+    uint64_t    Offset;         // From the first byte of the first frame.
+    uint32_t    Frames;
+};
+
+#define FLAC_SEEKPOINT_SIZE 18
+
+//
+//  "fLaC", STREAMINFO and a SEEKTABLE with room for SeekPointCapacity points; unused points are placeholders.  The
+//  size depends only on the capacity, so the header can be rewritten in place as the stream grows.
+//
+size_t FlacHeaderSize(uint32_t SeekPointCapacity);
+void BuildFlacHeader(const FlacStreamInfo& Info, const FlacSeekPoint* SeekPoints, uint32_t SeekPointCount, uint32_t SeekPointCapacity, std::vector<uint8_t>* Header);
@@ -0,0 +1,423 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "FlacFileSink.h"
+
+//
+//  Seek points start out every FLAC_SEEK_INTERVAL_SECONDS.  When the table is full, every other point is dropped and
+//  the interval doubles, so the table keeps covering the whole stream however long it gets.
+//
+#define FLAC_SEEK_INTERVAL_SECONDS  10
+#define FLAC_SEEK_POINT_CAPACITY    1024
+
+CFlacFileSink::CFlacFileSink() :
+    _SampleFormat(FlacSampleFloat32),
+    _BytesPerFrame(0),
+    _FramesOffset(0),
+    _WriteOffset(0),
+    _SeekPointCapacity(FLAC_SEEK_POINT_CAPACITY),
+    _SeekInterval(0),
+    _NextSeekSample(0),
+    _PendingBytes(0),
+    _NextSubmit(0),
+    _NextEncode(0),
+    _NextWrite(0),
+    _Stopping(false),
+    _FramesEncoded(0),
+    _SamplesEncoded(0),
+    _InputBytes(0),
+    _OutputBytes(0),
+    _EncodeTimeUs(0)
+{
+    memset(&_StreamInfo, 0, sizeof(_StreamInfo));
+}
+
+CFlacFileSink::~CFlacFileSink()
+{
+    Close();
+}
+
+bool CFlacFileSink::Open(const std::string& FileName, const WAVEFORMATEX* Format, uint32_t BlockSize, uint32_t ThreadCount)
+{
+    //
+    //  Float is stored as 24 bit; 32 bit integer keeps its top 24 bits, the most FLAC frames we write can carry.
+    //
+    uint32_t bitsPerSample;
+    if (IsFloatFormat(Format) && Format->wBitsPerSample == 32)
+    {
+        _SampleFormat = FlacSampleFloat32;
+        bitsPerSample = 24;
+    }
+    else if (EffectiveFormatTag(Format) == WAVE_FORMAT_PCM && Format->wBitsPerSample == 16)
+    {
+        _SampleFormat = FlacSampleInt16;
+        bitsPerSample = 16;
+    }
+    else if (EffectiveFormatTag(Format) == WAVE_FORMAT_PCM && Format->wBitsPerSample == 24)
+    {
+        _SampleFormat = FlacSampleInt24;
+        bitsPerSample = 24;
+    }
+    else if (EffectiveFormatTag(Format) == WAVE_FORMAT_PCM && Format->wBitsPerSample == 32)
+    {
+        _SampleFormat = FlacSampleInt32;
+        bitsPerSample = 24;
+        fprintf(stderr, "FLAC output keeps the top 24 bits of 32 bit samples.\n");
+    }
+    else
+    {
+        fprintf(stderr, "Unsupported FLAC input format: tag %u, %u bits.\n", EffectiveFormatTag(Format), Format->wBitsPerSample);
+        return false;
+    }
+    if (Format->nChannels == 0 || Format->nChannels > FLAC_MAX_CHANNELS || Format->nSamplesPerSec == 0 ||
+        Format->nSamplesPerSec >= (1u << 20) || Format->nBlockAlign != Format->nChannels * Format->wBitsPerSample / 8)
+    {
+        fprintf(stderr, "FLAC output supports 1 to %d channels below 1 MHz.\n", FLAC_MAX_CHANNELS);
+        return false;
+    }
+    if (BlockSize < 16 || BlockSize > 65535 || ThreadCount == 0)
+    {
+        fprintf(stderr, "Invalid FLAC encoder parameters.\n");
+        return false;
+    }
+
+    _BytesPerFrame = Format->nBlockAlign;
+    _StreamInfo.BlockSize = BlockSize;
+    _StreamInfo.MinFrameSize = 0;
+    _StreamInfo.MaxFrameSize = 0;
+    _StreamInfo.SampleRate = Format->nSamplesPerSec;
+    _StreamInfo.Channels = Format->nChannels;
+    _StreamInfo.BitsPerSample = bitsPerSample;
+    _StreamInfo.TotalSamples = 0;
+
+    _SeekPoints.clear();
+    _SeekPoints.reserve(_SeekPointCapacity);
+    _SeekInterval = static_cast<uint64_t>(Format->nSamplesPerSec) * FLAC_SEEK_INTERVAL_SECONDS;
+    _NextSeekSample = 0;
+
+    //
+    //  Two jobs per worker: one being encoded while the next waits, so workers never idle on the writer thread.
+    //
+    _Encoders.resize(ThreadCount);
+    for (size_t i = 0; i < _Encoders.size(); i++)
+    {
+        if (!_Encoders[i].Initialize(_StreamInfo.Channels, bitsPerSample, BlockSize))
+        {
+            fprintf(stderr, "Unable to initialize FLAC encoder.\n");
+            return false;
+        }
+    }
+    _Jobs.resize(2 * static_cast<size_t>(ThreadCount));
+    for (size_t i = 0; i < _Jobs.size(); i++)
+    {
+        _Jobs[i].Input.assign(static_cast<size_t>(BlockSize) * _BytesPerFrame, 0);
+        _Jobs[i].Samples.assign(static_cast<size_t>(BlockSize) * _StreamInfo.Channels, 0);
+        _Jobs[i].Output.reserve(static_cast<size_t>(BlockSize) * _BytesPerFrame);
+        _Jobs[i].Frames = 0;
+        _Jobs[i].FrameNumber = 0;
+        _Jobs[i].Done = false;
+    }
+    _PendingInput.assign(static_cast<size_t>(BlockSize) * _BytesPerFrame, 0);
+    _PendingBytes = 0;
+    _NextSubmit = 0;
+    _NextEncode = 0;
+    _NextWrite = 0;
+
+    if (!_File.Create(FileName))
+    {
+        fprintf(stderr, "Unable to create output FLAC file: %d\n", COutputFile::LastError());
+        return false;
+    }
+    _FramesOffset = FlacHeaderSize(_SeekPointCapacity);
+    _WriteOffset = _FramesOffset;
+    if (!UpdateHeader())
+    {
+        return false;
+    }
+
+    _Stopping = false;
+    for (size_t i = 0; i < ThreadCount; i++)
+    {
+        _Workers.push_back(std::thread(&CFlacFileSink::WorkerThread, this, i));
+    }
+    return true;
+}
+
+bool CFlacFileSink::Write(const uint8_t* Data, size_t Size)
+{
+    while (Size > 0)
+    {
+        size_t bytesToCopy = _PendingInput.size() - _PendingBytes;
+        if (bytesToCopy > Size)
+        {
+            bytesToCopy = Size;
+        }
+        memcpy(&_PendingInput[_PendingBytes], Data, bytesToCopy);
+        _PendingBytes += bytesToCopy;
+        Data += bytesToCopy;
+        Size -= bytesToCopy;
+
+        if (_PendingBytes == _PendingInput.size() && !SubmitBlock())
+        {
+            return false;
+        }
+    }
+
+    //
+    //  Write out whatever the workers have finished without waiting for the rest.
+    //
+    return WriteCompletedFrames(_Jobs.size());
+}
+
+bool CFlacFileSink::Flush()
+{
+    if (!WriteCompletedFrames(0) || !UpdateHeader())
+    {
+        return false;
+    }
+    return _File.Flush();
+}
+
+bool CFlacFileSink::Close()
+{
+    if (!_File.IsOpen())
+    {
+        StopWorkers();
+        return true;
+    }
+
+    //
+    //  Only whole frames make it into the stream; a trailing partial frame of the input is dropped.
+    //
+    _PendingBytes -= _PendingBytes % _BytesPerFrame;
+    bool succeeded = (_PendingBytes == 0 || SubmitBlock()) && WriteCompletedFrames(0);
+    StopWorkers();
+    succeeded = succeeded && UpdateHeader();
+    if (!succeeded)
+    {
+        fprintf(stderr, "Unable to finish FLAC file: %d\n", COutputFile::LastError());
+    }
+    _File.Close();
+    return succeeded;
+}
+
+void CFlacFileSink::GetStats(FlacEncoderStats* Stats) const
+{
+    Stats->FramesEncoded = _FramesEncoded.load(std::memory_order_relaxed);
+    Stats->SamplesEncoded = _SamplesEncoded.load(std::memory_order_relaxed);
+    Stats->InputBytes = _InputBytes.load(std::memory_order_relaxed);
+    Stats->OutputBytes = _OutputBytes.load(std::memory_order_relaxed);
+    Stats->EncodeTimeUs = _EncodeTimeUs.load(std::memory_order_relaxed);
+}
+
+void CFlacFileSink::WorkerThread(size_t WorkerIndex)
+{
+    CFlacFrameEncoder& encoder = _Encoders[WorkerIndex];
+    std::unique_lock<std::mutex> lock(_Lock);
+    for (;;)
+    {
+        _JobAvailable.wait(lock, [this]() { return _Stopping || _NextEncode < _NextSubmit; });
+        if (_NextEncode == _NextSubmit)
+        {
+            return;
+        }
+        FlacJob& job = _Jobs[_NextEncode % _Jobs.size()];
+        _NextEncode++;
+        lock.unlock();
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        ConvertSamples(&job.Input[0], job.Frames, &job.Samples[0]);
+        job.Output.clear();
+        encoder.EncodeFrame(&job.Samples[0], job.Frames, job.FrameNumber, &job.Output);
+        uint64_t elapsedUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+
+        _FramesEncoded.fetch_add(1, std::memory_order_relaxed);
+        _SamplesEncoded.fetch_add(job.Frames, std::memory_order_relaxed);
+        _InputBytes.fetch_add(static_cast<uint64_t>(job.Frames) * _BytesPerFrame, std::memory_order_relaxed);
+        _OutputBytes.fetch_add(job.Output.size(), std::memory_order_relaxed);
+        _EncodeTimeUs.fetch_add(elapsedUs, std::memory_order_relaxed);
+
+        lock.lock();
+        job.Done = true;
+        _JobDone.notify_all();
+    }
+}
+
+void CFlacFileSink::ConvertSamples(const uint8_t* Input, uint32_t Frames, int32_t* Samples) const
+{
+    size_t sampleCount = static_cast<size_t>(Frames) * _StreamInfo.Channels;
+    switch (_SampleFormat)
+    {
+    case FlacSampleFloat32:
+        for (size_t i = 0; i < sampleCount; i++)
+        {
+            float value;
+            memcpy(&value, Input + i * 4, sizeof(value));
+            float scaled = value * 8388608.0f;
+            if (!(scaled > -8388608.0f))        // Also catches NaN.
+            {
+                Samples[i] = scaled < 0 ? -8388608 : 0;
+            }
+            else if (scaled >= 8388607.0f)
+            {
+                Samples[i] = 8388607;
+            }
+            else
+            {
+                Samples[i] = static_cast<int32_t>(lrintf(scaled));
+            }
+        }
+        break;
+
+    case FlacSampleInt16:
+        for (size_t i = 0; i < sampleCount; i++)
+        {
+            Samples[i] = static_cast<int16_t>(Input[i * 2] | (Input[i * 2 + 1] << 8));
+        }
+        break;
+
+    case FlacSampleInt24:
+        for (size_t i = 0; i < sampleCount; i++)
+        {
+            const uint8_t* sample = Input + i * 3;
+            Samples[i] = static_cast<int32_t>(static_cast<uint32_t>(sample[0] << 8 | sample[1] << 16 | sample[2] << 24)) >> 8;
+        }
+        break;
+
+    case FlacSampleInt32:
+        for (size_t i = 0; i < sampleCount; i++)
+        {
+            int32_t value;
+            memcpy(&value, Input + i * 4, sizeof(value));
+            Samples[i] = value >> 8;
+        }
+        break;
+    }
+}
+
+//
+//  Hand the pending block to the pool.  The slot it goes into must have been written out first.
+//
+bool CFlacFileSink::SubmitBlock()
+{
+    if (!WriteCompletedFrames(_Jobs.size() - 1))
+    {
+        return false;
+    }
+
+    FlacJob& job = _Jobs[_NextSubmit % _Jobs.size()];
+    job.Input.swap(_PendingInput);
+    job.Frames = static_cast<uint32_t>(_PendingBytes / _BytesPerFrame);
+    job.FrameNumber = _NextSubmit;
+    job.Done = false;
+    _PendingBytes = 0;
+
+    std::lock_guard<std::mutex> lock(_Lock);
+    _NextSubmit++;
+    _JobAvailable.notify_one();
+    return true;
+}
+
+//
+//  Write finished frames in order, waiting for the workers until no more than MaxInFlight frames are left.
+//
+bool CFlacFileSink::WriteCompletedFrames(uint64_t MaxInFlight)
+{
+    std::unique_lock<std::mutex> lock(_Lock);
+    while (_NextWrite < _NextSubmit)
+    {
+        FlacJob& job = _Jobs[_NextWrite % _Jobs.size()];
+        if (!job.Done)
+        {
+            if (_NextSubmit - _NextWrite <= MaxInFlight)
+            {
+                break;
+            }
+            _JobDone.wait(lock, [&job]() { return job.Done; });
+        }
+
+        //
+        //  Workers don't touch a finished job, and only this thread reuses its slot.
+        //
+        lock.unlock();
+        if (!_File.WriteAt(&job.Output[0], job.Output.size(), _WriteOffset))
+        {
+            fprintf(stderr, "Unable to write FLAC data: %d\n", COutputFile::LastError());
+            return false;
+        }
+
+        uint32_t frameSize = static_cast<uint32_t>(job.Output.size());
+        if (_StreamInfo.MinFrameSize == 0 || frameSize < _StreamInfo.MinFrameSize)
+        {
+            _StreamInfo.MinFrameSize = frameSize;
+        }
+        if (frameSize > _StreamInfo.MaxFrameSize)
+        {
+            _StreamInfo.MaxFrameSize = frameSize;
+        }
+        if (_StreamInfo.TotalSamples >= _NextSeekSample)
+        {
+            AddSeekPoint(_StreamInfo.TotalSamples, _WriteOffset - _FramesOffset, job.Frames);
+        }
+        _StreamInfo.TotalSamples += job.Frames;
+        _WriteOffset += job.Output.size();
+
+        lock.lock();
+        _NextWrite++;
+    }
+    return true;
+}
+
+void CFlacFileSink::AddSeekPoint(uint64_t SampleNumber, uint64_t Offset, uint32_t Frames)
+{
+    if (_SeekPoints.size() == _SeekPointCapacity)
+    {
+        for (size_t i = 0; 2 * i < _SeekPoints.size(); i++)
+        {
+            _SeekPoints[i] = _SeekPoints[2 * i];
+        }
+        _SeekPoints.resize((_SeekPoints.size() + 1) / 2);
+        _SeekInterval *= 2;
+        if (SampleNumber < _SeekPoints.size() * _SeekInterval)
+        {
+            _NextSeekSample = _SeekPoints.size() * _SeekInterval;
+            return;
+        }
+    }
+
+    FlacSeekPoint seekPoint;
+    seekPoint.SampleNumber = SampleNumber;
+    seekPoint.Offset = Offset;
+    seekPoint.Frames = Frames;
+    _SeekPoints.push_back(seekPoint);
+    _NextSeekSample = _SeekPoints.size() * _SeekInterval;
+}
+
+bool CFlacFileSink::UpdateHeader()
+{
+    std::vector<uint8_t> header;
+    BuildFlacHeader(_StreamInfo, _SeekPoints.empty() ? NULL : &_SeekPoints[0], static_cast<uint32_t>(_SeekPoints.size()),
+        _SeekPointCapacity, &header);
+    if (!_File.WriteAt(&header[0], header.size(), 0))
+    {
+        fprintf(stderr, "Unable to write FLAC header: %d\n", COutputFile::LastError());
+        return false;
+    }
+    return true;
+}
+
+void CFlacFileSink::StopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(_Lock);
+        _Stopping = true;
+    }
+    _JobAvailable.notify_all();
+    for (size_t i = 0; i < _Workers.size(); i++)
+    {
+        _Workers[i].join();
+    }
+    _Workers.clear();
+}
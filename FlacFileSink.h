@@ -0,0 +1,114 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "OutputSink.h"
+#include "FlacEncoder.h"
+
+//
+//  Encoder statistics.  EncodeTimeUs is summed over all workers, so SamplesEncoded / EncodeTimeUs is the per core
+//  throughput.
+//
+struct FlacEncoderStats
+{
+    uint64_t FramesEncoded;
+    uint64_t SamplesEncoded;    // Per channel.
+    uint64_t InputBytes;
+    uint64_t OutputBytes;
+    uint64_t EncodeTimeUs;
+};
+
+//
+//  FLAC file encoded on a pool of worker threads.
+//
+//  Write() cuts the byte stream into fixed size blocks and hands each to the pool; workers convert a block to
+//  integer samples (float to 24 bit) and encode it as an independent frame.  Finished frames are written strictly in
+//  frame order by the calling (writer) thread.  At most two blocks per worker are in flight, which bounds both memory
+//  and latency: Flush() waits for them and brings STREAMINFO and the seek table up to date, so only the block still
+//  being filled - BlockSize frames at most - is not yet on disk.
+//
+class CFlacFileSink : public IOutputSink
+{
+public:
+    CFlacFileSink();
+    ~CFlacFileSink();
+
+    bool Open(const std::string& FileName, const WAVEFORMATEX* Format, uint32_t BlockSize, uint32_t ThreadCount);
+    bool Write(const uint8_t* Data, size_t Size);
+    bool Flush();
+    bool Close();
+
+    void GetStats(FlacEncoderStats* Stats) const;
+
+private:
+    enum FlacSampleFormat
+    {
+        FlacSampleFloat32,
+        FlacSampleInt16,
+        FlacSampleInt24,
+        FlacSampleInt32,
+    };
+
+    struct FlacJob
+    {
+        std::vector<uint8_t>    Input;
+        std::vector<int32_t>    Samples;
+        std::vector<uint8_t>    Output;
+        uint32_t                Frames;
+        uint64_t                FrameNumber;
+        bool                    Done;
+    };
+
+    void WorkerThread(size_t WorkerIndex);
+    void ConvertSamples(const uint8_t* Input, uint32_t Frames, int32_t* Samples) const;
+    bool SubmitBlock();
+    bool WriteCompletedFrames(uint64_t MaxInFlight);
+    void AddSeekPoint(uint64_t SampleNumber, uint64_t Offset, uint32_t Frames);
+    bool UpdateHeader();
+    void StopWorkers();
+
+    COutputFile                     _File;
+    FlacSampleFormat                _SampleFormat;
+    uint32_t                        _BytesPerFrame;
+    FlacStreamInfo                  _StreamInfo;
+    uint64_t                        _FramesOffset;      // File offset of the first frame.
+    uint64_t                        _WriteOffset;
+
+    std::vector<FlacSeekPoint>      _SeekPoints;
+    uint32_t                        _SeekPointCapacity;
+    uint64_t                        _SeekInterval;
+    uint64_t                        _NextSeekSample;
+
+    //
+    //  Block being filled by Write().
+    //
+    std::vector<uint8_t>            _PendingInput;
+    size_t                          _PendingBytes;
+
+    //
+    //  Job slots, indexed by frame number modulo their count.  Frames [_NextWrite, _NextSubmit) are in flight and
+    //  [_NextEncode, _NextSubmit) are waiting for a worker.
+    //
+    std::vector<FlacJob>            _Jobs;
+    std::vector<CFlacFrameEncoder>  _Encoders;
+    std::vector<std::thread>        _Workers;
+    uint64_t                        _NextSubmit;
+    uint64_t                        _NextEncode;
+    uint64_t                        _NextWrite;
+    bool                            _Stopping;
+    std::mutex                      _Lock;
+    std::condition_variable         _JobAvailable;
+    std::condition_variable         _JobDone;
+
+    std::atomic<uint64_t>           _FramesEncoded;
+    std::atomic<uint64_t>           _SamplesEncoded;
+    std::atomic<uint64_t>           _InputBytes;
+    std::atomic<uint64_t>           _OutputBytes;
+    std::atomic<uint64_t>           _EncodeTimeUs;
+};
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "AudioFormat.h"
+
+//
+//  Framed stream protocol written by CStreamSink to stdout or a named pipe.
+//
+//  The stream starts with one FramedStreamHeader, followed by blocks: a FramedStreamBlockHeader and PayloadSize bytes
+//  of audio in the header's format, always whole frames.  All fields are little endian.  Every block the sink forms
+//  takes the next Sequence number, including blocks dropped because the reader was too slow, so a reader sees drops
+//  both as a jump in Sequence and as a jump in Frame; the first block after a drop also carries the discontinuity
+//  flag.  The last block has the end of stream flag and no payload.  Audio lost before it reached the sink doesn't
+//  take up stream frames under the default gap policy: the block after it has the discontinuity flag and, when the
+//  capture knows how much was lost, its length in GapFrames.  Under the fill policy it is silence in the stream.
+//
+#define FRAMED_STREAM_MAGIC         0x54534341      // "ACST"
+#define FRAMED_STREAM_BLOCK_MAGIC   0x4B424341      // "ACBK"
+#define FRAMED_STREAM_VERSION       1
+
+//
+//  Block flags.  The low bits are the capture packet flags of the block's audio (CAPTURE_PACKET_FLAG_xxx, which in
+//  turn match AUDCLNT_BUFFERFLAGS_xxx).
+//
+#define FRAMED_STREAM_FLAG_DISCONTINUITY    0x1     // Audio is missing right before this block.
+#define FRAMED_STREAM_FLAG_SILENT           0x2     // The device reported silence; the payload is zeros.
+#define FRAMED_STREAM_FLAG_TIMESTAMP_ERROR  0x4     // TimeNs is extrapolated, not measured.
+#define FRAMED_STREAM_FLAG_END_OF_STREAM    0x100
+
+#pragma pack(push, 1)
+
+struct FramedStreamHeader
+{
+    uint32_t                Magic;
+    uint16_t                Version;
+    uint16_t                HeaderSize;         // sizeof(FramedStreamHeader).
+    uint16_t                BlockHeaderSize;    // sizeof(FramedStreamBlockHeader).
+    uint16_t                Reserved;
+    WAVEFORMATEXTENSIBLE    Format;             // Format.Format.cbSize says how much of the extension is valid.
+};
+
+struct FramedStreamBlockHeader
+{
+    uint32_t    Magic;
+    uint32_t    PayloadSize;
+    uint64_t    Sequence;
+    uint64_t    Frame;          // Position of the first frame, in frames since the start of the stream.
+    int64_t     TimeNs;         // Capture time of the first frame, in steady clock (CLOCK_MONOTONIC / QPC) nanoseconds.
+    uint32_t    Flags;
+    uint32_t    GapFrames;      // Frames the capture lost right before this block, when known; see below.
+};
+
+#pragma pack(pop)
@@ -0,0 +1,150 @@
+#include <string.h>
+#include "LatencyHistogram.h"
+
+CLatencyHistogram::CLatencyHistogram() :
+    _Sum(0),
+    _Max(0)
+{
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        _Buckets[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+void CLatencyHistogram::Snapshot(CHistogramSnapshot* Snapshot) const
+{
+    Snapshot->_Buckets.resize(HISTOGRAM_BUCKETS);
+    Snapshot->_Count = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        Snapshot->_Buckets[i] = _Buckets[i].load(std::memory_order_relaxed);
+        Snapshot->_Count += Snapshot->_Buckets[i];
+    }
+    Snapshot->_Sum = _Sum.load(std::memory_order_relaxed);
+    Snapshot->_Max = _Max.load(std::memory_order_relaxed);
+}
+
+uint64_t CLatencyHistogram::BucketLowest(size_t Index)
+{
+    if (Index < 2 * HISTOGRAM_SUB_BUCKETS)
+    {
+        return Index;
+    }
+    size_t shift = Index / HISTOGRAM_SUB_BUCKETS - 1;
+    return static_cast<uint64_t>(Index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS) << shift;
+}
+
+uint64_t CLatencyHistogram::BucketWidth(size_t Index)
+{
+    if (Index < 2 * HISTOGRAM_SUB_BUCKETS)
+    {
+        return 1;
+    }
+    return 1ULL << (Index / HISTOGRAM_SUB_BUCKETS - 1);
+}
+
+CHistogramSnapshot::CHistogramSnapshot() :
+    _Buckets(HISTOGRAM_BUCKETS, 0),
+    _Count(0),
+    _Sum(0),
+    _Max(0)
+{
+}
+
+void CHistogramSnapshot::Subtract(const CHistogramSnapshot& Earlier)
+{
+    size_t highest = 0;
+    _Count = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        _Buckets[i] = _Buckets[i] >= Earlier._Buckets[i] ? _Buckets[i] - Earlier._Buckets[i] : 0;
+        _Count += _Buckets[i];
+        if (_Buckets[i] != 0)
+        {
+            highest = i;
+        }
+    }
+    _Sum = _Sum >= Earlier._Sum ? _Sum - Earlier._Sum : 0;
+
+    uint64_t highestValue = CLatencyHistogram::BucketLowest(highest) + CLatencyHistogram::BucketWidth(highest) - 1;
+    _Max = _Count == 0 ? 0 : highestValue < _Max ? highestValue : _Max;
+}
+
+uint64_t CHistogramSnapshot::ValueAtQuantile(double Quantile) const
+{
+    if (_Count == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(Quantile * _Count + 0.5);
+    if (rank == 0)
+    {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < HISTOGRAM_BUCKETS; i++)
+    {
+        seen += _Buckets[i];
+        if (seen >= rank)
+        {
+            uint64_t value = CLatencyHistogram::BucketLowest(i) + CLatencyHistogram::BucketWidth(i) - 1;
+            return value < _Max ? value : _Max;
+        }
+    }
+    return _Max;
+}
+
+uint64_t CHistogramSnapshot::CountAtOrBelow(uint64_t Value) const
+{
+    //
+    //  Buckets are contiguous, so the ones ending at or below Value are the ones before the bucket Value + 1 is in.
+    //
+    size_t end = Value >= HISTOGRAM_MAX_VALUE ? HISTOGRAM_BUCKETS : CLatencyHistogram::BucketIndex(Value + 1);
+    uint64_t count = 0;
+    for (size_t i = 0; i < end; i++)
+    {
+        count += _Buckets[i];
+    }
+    return count;
+}
+
+void CHistogramSnapshot::ValuesAtQuantiles(const double* Quantiles, size_t Count, uint64_t* Values) const
+{
+    uint64_t seen = 0;
+    size_t bucket = 0;
+    for (size_t i = 0; i < Count; i++)
+    {
+        if (_Count == 0)
+        {
+            Values[i] = 0;
+            continue;
+        }
+        uint64_t rank = static_cast<uint64_t>(Quantiles[i] * _Count + 0.5);
+        if (rank == 0)
+        {
+            rank = 1;
+        }
+        while (bucket < HISTOGRAM_BUCKETS && seen + _Buckets[bucket] < rank)
+        {
+            seen += _Buckets[bucket++];
+        }
+        uint64_t value = bucket < HISTOGRAM_BUCKETS ? CLatencyHistogram::BucketLowest(bucket) + CLatencyHistogram::BucketWidth(bucket) - 1 : _Max;
+        Values[i] = value < _Max ? value : _Max;
+    }
+}
+
+void CHistogramSnapshot::CountsAtOrBelow(const uint64_t* Values, size_t Count, uint64_t* Counts) const
+{
+    uint64_t count = 0;
+    size_t bucket = 0;
+    for (size_t i = 0; i < Count; i++)
+    {
+        size_t end = Values[i] >= HISTOGRAM_MAX_VALUE ? HISTOGRAM_BUCKETS : CLatencyHistogram::BucketIndex(Values[i] + 1);
+        for (; bucket < end; bucket++)
+        {
+            count += _Buckets[bucket];
+        }
+        Counts[i] = count;
+    }
+}
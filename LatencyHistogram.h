@@ -0,0 +1,133 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//
+//  Log-linear (HDR style) histogram of non-negative integer values, usually nanoseconds.
+//
+//  Values below 2 * HISTOGRAM_SUB_BUCKETS are counted exactly; above that every power of two range is split into
+//  HISTOGRAM_SUB_BUCKETS equal buckets, so any value is known to within 1/HISTOGRAM_SUB_BUCKETS (1.6%) over the whole
+//  range, in a fixed, preallocated table.  Values past HISTOGRAM_MAX_VALUE (about 4.9 hours in nanoseconds) are
+//  counted as that.
+//
+//  Record() is wait-free and takes no locks: a histogram has a single writer, which only does relaxed loads and
+//  stores, and any thread may take a Snapshot() while it records.  A snapshot taken mid Record() may be a value
+//  behind in one of its fields, never torn.
+//
+#define HISTOGRAM_SUB_BUCKET_BITS   6
+#define HISTOGRAM_SUB_BUCKETS       (1 << HISTOGRAM_SUB_BUCKET_BITS)
+#define HISTOGRAM_MAX_VALUE         ((1ULL << 44) - 1)
+#define HISTOGRAM_BUCKETS           ((43 - HISTOGRAM_SUB_BUCKET_BITS) * HISTOGRAM_SUB_BUCKETS + 2 * HISTOGRAM_SUB_BUCKETS)
+
+class CHistogramSnapshot;
+
+class CLatencyHistogram
+{
+public:
+    CLatencyHistogram();
+
+    void Record(uint64_t Value)
+    {
+        if (Value > HISTOGRAM_MAX_VALUE)
+        {
+            Value = HISTOGRAM_MAX_VALUE;
+        }
+        std::atomic<uint64_t>& bucket = _Buckets[BucketIndex(Value)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        _Sum.store(_Sum.load(std::memory_order_relaxed) + Value, std::memory_order_relaxed);
+        if (Value > _Max.load(std::memory_order_relaxed))
+        {
+            _Max.store(Value, std::memory_order_relaxed);
+        }
+    }
+
+    void Snapshot(CHistogramSnapshot* Snapshot) const;
+
+    static size_t BucketIndex(uint64_t Value)
+    {
+        if (Value < 2 * HISTOGRAM_SUB_BUCKETS)
+        {
+            return static_cast<size_t>(Value);
+        }
+        int shift = HighestBit(Value) - HISTOGRAM_SUB_BUCKET_BITS;
+        return static_cast<size_t>(shift) * HISTOGRAM_SUB_BUCKETS + static_cast<size_t>(Value >> shift);
+    }
+
+    //
+    //  The smallest value counted in a bucket, and how many values it covers.
+    //
+    static uint64_t BucketLowest(size_t Index);
+    static uint64_t BucketWidth(size_t Index);
+
+private:
+    static int HighestBit(uint64_t Value)
+    {
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+        unsigned long index;
+        _BitScanReverse64(&index, Value);
+        return static_cast<int>(index);
+#elif defined(_MSC_VER)
+        unsigned long index;
+        if (_BitScanReverse(&index, static_cast<unsigned long>(Value >> 32)))
+        {
+            return static_cast<int>(index) + 32;
+        }
+        _BitScanReverse(&index, static_cast<unsigned long>(Value));
+        return static_cast<int>(index);
+#else
+        return 63 - __builtin_clzll(Value);
+#endif
+    }
+
+    std::atomic<uint64_t>   _Buckets[HISTOGRAM_BUCKETS];
+    std::atomic<uint64_t>   _Sum;
+    std::atomic<uint64_t>   _Max;
+};
+
+//
+//  A copy of a histogram's counts, for reading without racing the writer.  Subtract() turns a snapshot into the
+//  values recorded since an earlier one; the maximum of such an interval is only known to within a bucket.
+//
+class CHistogramSnapshot
+{
+public:
+    CHistogramSnapshot();
+
+    void Subtract(const CHistogramSnapshot& Earlier);
+
+    uint64_t Count() const { return _Count; }
+    uint64_t Sum() const { return _Sum; }
+    uint64_t Max() const { return _Max; }
+    double Mean() const { return _Count != 0 ? static_cast<double>(_Sum) / _Count : 0.0; }
+
+    //
+    //  The value Quantile (0 to 1) of the values are at or below, to within a bucket.  0 if nothing was recorded.
+    //
+    uint64_t ValueAtQuantile(double Quantile) const;
+
+    //
+    //  How many values are at or below Value, not counting the bucket Value falls inside of unless it ends there.
+    //  Exact below 2 * HISTOGRAM_SUB_BUCKETS and for powers of two less one.
+    //
+    uint64_t CountAtOrBelow(uint64_t Value) const;
+
+    //
+    //  The same for each of Count increasing quantiles or values, in a single pass over the buckets.
+    //
+    void ValuesAtQuantiles(const double* Quantiles, size_t Count, uint64_t* Values) const;
+    void CountsAtOrBelow(const uint64_t* Values, size_t Count, uint64_t* Counts) const;
+
+private:
+    friend class CLatencyHistogram;
+
+    std::vector<uint64_t>   _Buckets;
+    uint64_t                _Count;
+    uint64_t                _Sum;
+    uint64_t                _Max;
+};
@@ -0,0 +1,515 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include "LevelMeter.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LEVEL_METER_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//
+//  Frames measured at a time, which keeps the true peak history small, and about how many the lanes take before
+//  they are folded into the channels, which keeps their sums short enough for float.
+//
+#define LEVEL_METER_BLOCK_FRAMES    1024
+
+//
+//  Stopband attenuation of the true peak filter, in dB.
+//
+#define LEVEL_METER_TRUE_PEAK_ATTENUATION   60.0
+
+static const double Pi = 3.14159265358979323846;
+
+//
+//  Scalar reference.  Also takes any Count, for the samples left over after the vector kernels.
+//
+static void MeasureScalar(const float* Samples, size_t Count, size_t Width, float* MaxSquares, float* Squares, float* Copy)
+{
+    if (Copy != NULL && Count != 0)
+    {
+        memcpy(Copy, Samples, Count * sizeof(float));
+    }
+    size_t lane = 0;
+    for (size_t i = 0; i < Count; i++)
+    {
+        float square = Samples[i] * Samples[i];
+        if (square > MaxSquares[lane])
+        {
+            MaxSquares[lane] = square;
+        }
+        Squares[lane] += square;
+        if (++lane == Width)
+        {
+            lane = 0;
+        }
+    }
+}
+
+void TruePeakScalar(const float* Samples, size_t Frames, const float* Phases, float* MaxSquare)
+{
+    float maxSquare = *MaxSquare;
+    for (size_t n = 0; n < Frames; n++)
+    {
+        for (int phase = 0; phase < 3; phase++)
+        {
+            const float* taps = Phases + phase * LEVEL_METER_TRUE_PEAK_TAPS;
+            float value = 0.0f;
+            for (size_t tap = 0; tap < LEVEL_METER_TRUE_PEAK_TAPS; tap++)
+            {
+                value += taps[tap] * Samples[n + tap];
+            }
+            float square = value * value;
+            if (square > maxSquare)
+            {
+                maxSquare = square;
+            }
+        }
+    }
+    *MaxSquare = maxSquare;
+}
+
+//
+//  Zeroth order modified Bessel function of the first kind, for the Kaiser window.
+//
+static double BesselI0(double X)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 64; k++)
+    {
+        term *= (X / (2 * k)) * (X / (2 * k));
+        sum += term;
+        if (term < sum * 1e-17)
+        {
+            break;
+        }
+    }
+    return sum;
+}
+
+//
+//  Phases 1 to 3 of a Kaiser windowed sinc at 4 times the sample rate, cut off at the sample rate's Nyquist
+//  frequency; phase 0 would only give back the samples.  Phase p's value at position n lies p / 4 of the way from
+//  sample n + LEVEL_METER_TRUE_PEAK_TAPS / 2 - 1 to the next.  Each phase is scaled to a gain of 1 at DC.
+//
+static void BuildTruePeakPhases(float* Phases)
+{
+    const double attenuation = LEVEL_METER_TRUE_PEAK_ATTENUATION;
+    const double beta = 0.1102 * (attenuation - 8.7);
+    const double halfLength = LEVEL_METER_TRUE_PEAK_TAPS / 2;
+    const double windowScale = BesselI0(beta);
+    for (int phase = 0; phase < 3; phase++)
+    {
+        double taps[LEVEL_METER_TRUE_PEAK_TAPS];
+        double sum = 0.0;
+        for (int tap = 0; tap < LEVEL_METER_TRUE_PEAK_TAPS; tap++)
+        {
+            double t = halfLength - 1.0 + (phase + 1) / 4.0 - tap;
+            double position = t / halfLength;
+            taps[tap] = sin(Pi * t) / (Pi * t) * BesselI0(beta * sqrt(1.0 - position * position)) / windowScale;
+            sum += taps[tap];
+        }
+        for (int tap = 0; tap < LEVEL_METER_TRUE_PEAK_TAPS; tap++)
+        {
+            Phases[phase * LEVEL_METER_TRUE_PEAK_TAPS + tap] = static_cast<float>(taps[tap] / sum);
+        }
+    }
+}
+
+#ifdef LEVEL_METER_HAVE_SSE2
+
+//
+//  Like the AVX2 kernel, a register of lanes at a time with four sets of accumulators.
+//
+template <bool Copying>
+static void MeasureSse2Lanes(const float* Samples, size_t Count, size_t Width, float* MaxSquares, float* Squares, float* Copy)
+{
+    for (size_t lane = 0; lane < Width; lane += 4)
+    {
+        __m128 maxSquares[4] = { _mm_loadu_ps(MaxSquares + lane), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+        __m128 squares[4] = { _mm_loadu_ps(Squares + lane), _mm_setzero_ps(), _mm_setzero_ps(), _mm_setzero_ps() };
+        size_t i = lane;
+        for (; i + 3 * Width < Count; i += 4 * Width)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                __m128 samples = _mm_loadu_ps(Samples + i + j * Width);
+                if (Copying)
+                {
+                    _mm_storeu_ps(Copy + i + j * Width, samples);
+                }
+                __m128 square = _mm_mul_ps(samples, samples);
+                maxSquares[j] = _mm_max_ps(square, maxSquares[j]);
+                squares[j] = _mm_add_ps(squares[j], square);
+            }
+        }
+        for (; i < Count; i += Width)
+        {
+            __m128 samples = _mm_loadu_ps(Samples + i);
+            if (Copying)
+            {
+                _mm_storeu_ps(Copy + i, samples);
+            }
+            __m128 square = _mm_mul_ps(samples, samples);
+            maxSquares[0] = _mm_max_ps(square, maxSquares[0]);
+            squares[0] = _mm_add_ps(squares[0], square);
+        }
+        _mm_storeu_ps(MaxSquares + lane, _mm_max_ps(_mm_max_ps(maxSquares[0], maxSquares[1]), _mm_max_ps(maxSquares[2], maxSquares[3])));
+        _mm_storeu_ps(Squares + lane, _mm_add_ps(_mm_add_ps(squares[0], squares[1]), _mm_add_ps(squares[2], squares[3])));
+    }
+}
+
+static void MeasureSse2(const float* Samples, size_t Count, size_t Width, float* MaxSquares, float* Squares, float* Copy)
+{
+    if (Copy != NULL)
+    {
+        MeasureSse2Lanes<true>(Samples, Count, Width, MaxSquares, Squares, Copy);
+    }
+    else
+    {
+        MeasureSse2Lanes<false>(Samples, Count, Width, MaxSquares, Squares, NULL);
+    }
+}
+
+//
+//  Like the AVX2 kernel, eight positions at a time in two registers.
+//
+static void TruePeakSse2(const float* Samples, size_t Frames, const float* Phases, float* MaxSquare)
+{
+    __m128 maxSquare = _mm_set1_ps(*MaxSquare);
+    size_t n = 0;
+    for (; n + 8 <= Frames; n += 8)
+    {
+        __m128 values[3][2] = {};
+        for (size_t tap = 0; tap < LEVEL_METER_TRUE_PEAK_TAPS; tap++)
+        {
+            __m128 samples[2] = { _mm_loadu_ps(Samples + n + tap), _mm_loadu_ps(Samples + n + tap + 4) };
+            for (int phase = 0; phase < 3; phase++)
+            {
+                __m128 coefficient = _mm_set1_ps(Phases[phase * LEVEL_METER_TRUE_PEAK_TAPS + tap]);
+                values[phase][0] = _mm_add_ps(values[phase][0], _mm_mul_ps(coefficient, samples[0]));
+                values[phase][1] = _mm_add_ps(values[phase][1], _mm_mul_ps(coefficient, samples[1]));
+            }
+        }
+        for (int phase = 0; phase < 3; phase++)
+        {
+            maxSquare = _mm_max_ps(_mm_mul_ps(values[phase][0], values[phase][0]), maxSquare);
+            maxSquare = _mm_max_ps(_mm_mul_ps(values[phase][1], values[phase][1]), maxSquare);
+        }
+    }
+    maxSquare = _mm_max_ps(maxSquare, _mm_movehl_ps(maxSquare, maxSquare));
+    maxSquare = _mm_max_ss(maxSquare, _mm_shuffle_ps(maxSquare, maxSquare, 1));
+    *MaxSquare = _mm_cvtss_f32(maxSquare);
+    TruePeakScalar(Samples + n, Frames - n, Phases, MaxSquare);
+}
+
+#endif
+
+CLevelMeter::CLevelMeter() :
+    _Channels(0),
+    _Width(0),
+    _WidthFrames(0),
+    _IntervalFrames(0),
+    _TruePeak(false),
+    _Kernel(SampleKernelScalar),
+    _Function(MeasureScalar),
+    _TruePeakFunction(TruePeakScalar),
+    _TruePeakStride(0),
+    _TotalFrames(0),
+    _Frames(0),
+    _LaneFrames(0),
+    _Sequence(0)
+{
+}
+
+bool CLevelMeter::Initialize(const WAVEFORMATEX* Format, uint32_t IntervalFrames, bool TruePeak, SampleConvertKernel MaxKernel)
+{
+    if (!IsFloatFormat(Format) || Format->wBitsPerSample != 32 || Format->nChannels == 0 ||
+        Format->nBlockAlign != Format->nChannels * sizeof(float) || IntervalFrames == 0)
+    {
+        fprintf(stderr, "Level metering needs 32 bit float samples and a nonzero interval.\n");
+        return false;
+    }
+    _Channels = Format->nChannels;
+    _IntervalFrames = IntervalFrames;
+    _TruePeak = TruePeak;
+
+    //
+    //  Lanes line up with channels when their count is a multiple of both the channel count and the vector width.
+    //  They hold a power of two frames, since LEVEL_METER_LANES is one.
+    //
+    size_t a = _Channels;
+    size_t b = LEVEL_METER_LANES;
+    while (b != 0)
+    {
+        size_t remainder = a % b;
+        a = b;
+        b = remainder;
+    }
+    _Width = _Channels / a * LEVEL_METER_LANES;
+    _WidthFrames = LEVEL_METER_LANES / a;
+
+    _Function = MeasureScalar;
+    _TruePeakFunction = TruePeakScalar;
+    _Kernel = SampleKernelScalar;
+#ifdef LEVEL_METER_HAVE_SSE2
+    if (MaxKernel >= SampleKernelSse2)
+    {
+        _Function = MeasureSse2;
+        _TruePeakFunction = TruePeakSse2;
+        _Kernel = SampleKernelSse2;
+    }
+#endif
+    if (MaxKernel >= SampleKernelAvx2 && GetAvx2LevelMeterFunction() != NULL && CpuSupportsAvx2())
+    {
+        _Function = GetAvx2LevelMeterFunction();
+        _TruePeakFunction = GetAvx2TruePeakFunction();
+        _Kernel = SampleKernelAvx2;
+    }
+
+    if (TruePeak)
+    {
+        _TruePeakPhases.resize(3 * LEVEL_METER_TRUE_PEAK_TAPS);
+        BuildTruePeakPhases(&_TruePeakPhases[0]);
+    }
+    _TruePeakStride = TruePeak ? LEVEL_METER_TRUE_PEAK_TAPS - 1 + LEVEL_METER_BLOCK_FRAMES : 0;
+    _TruePeakHistory.assign(_TruePeakStride * _Channels, 0.0f);
+
+    _MaxSquares.assign(_Channels, 0.0f);
+    _Squares.assign(_Channels, 0.0);
+    _TrueMaxSquares.assign(_Channels, 0.0f);
+    ClearLanes();
+    _Versions.reset(new std::atomic<uint64_t>[LEVEL_METER_HISTORY]);
+    _PublishedFirstFrames.reset(new std::atomic<uint64_t>[LEVEL_METER_HISTORY]);
+    _PublishedFrames.reset(new std::atomic<uint32_t>[LEVEL_METER_HISTORY]);
+    for (size_t i = 0; i < LEVEL_METER_HISTORY; i++)
+    {
+        _Versions[i].store(0, std::memory_order_relaxed);
+        _PublishedFirstFrames[i].store(0, std::memory_order_relaxed);
+        _PublishedFrames[i].store(0, std::memory_order_relaxed);
+    }
+    _Published.reset(new std::atomic<float>[LEVEL_METER_HISTORY * _Channels * 3]);
+    for (size_t i = 0; i < LEVEL_METER_HISTORY * _Channels * 3; i++)
+    {
+        _Published[i].store(0.0f, std::memory_order_relaxed);
+    }
+    _Sequence.store(0, std::memory_order_relaxed);
+    _TotalFrames = 0;
+    _Frames = 0;
+    return true;
+}
+
+void CLevelMeter::Reset()
+{
+    _MaxSquares.assign(_Channels, 0.0f);
+    _Squares.assign(_Channels, 0.0);
+    _TrueMaxSquares.assign(_Channels, 0.0f);
+    ClearLanes();
+    _TotalFrames += _Frames;
+    _Frames = 0;
+    std::fill(_TruePeakHistory.begin(), _TruePeakHistory.end(), 0.0f);
+}
+
+//
+//  Cut the frames at interval boundaries, so every reading covers exactly IntervalFrames frames.
+//
+void CLevelMeter::Process(const float* Data, size_t Frames, float* Copy)
+{
+    while (Frames != 0)
+    {
+        size_t frames = Frames;
+        if (frames > _IntervalFrames - _Frames)
+        {
+            frames = _IntervalFrames - _Frames;
+        }
+        if (frames > LEVEL_METER_BLOCK_FRAMES)
+        {
+            frames = LEVEL_METER_BLOCK_FRAMES;
+        }
+        Measure(Data, frames, Copy);
+        _Frames += static_cast<uint32_t>(frames);
+        if (_Frames == _IntervalFrames)
+        {
+            Publish();
+        }
+        Data = Data != NULL ? Data + frames * _Channels : NULL;
+        Copy = Copy != NULL ? Copy + frames * _Channels : NULL;
+        Frames -= frames;
+    }
+}
+
+//
+//  Up to LEVEL_METER_BLOCK_FRAMES frames into the lanes, and into Copy.  Silence only moves the oversampler along.
+//
+void CLevelMeter::Measure(const float* Data, size_t Frames, float* Copy)
+{
+    if (Data != NULL)
+    {
+        size_t count = Frames * _Channels;
+        size_t whole = (Frames & ~(_WidthFrames - 1)) * _Channels;
+        if (whole != 0)
+        {
+            _Function(Data, whole, _Width, &_LaneMaxSquares[0], &_LaneSquares[0], Copy);
+        }
+        if (whole != count)
+        {
+            MeasureScalar(Data + whole, count - whole, _Width, &_LaneMaxSquares[0], &_LaneSquares[0], Copy != NULL ? Copy + whole : NULL);
+        }
+    }
+    else if (Copy != NULL)
+    {
+        memset(Copy, 0, Frames * _Channels * sizeof(float));
+    }
+
+    if (_TruePeak)
+    {
+        //
+        //  Append the frames to each channel's history, run the phases over it, and keep the newest taps - 1 samples
+        //  for the next block.
+        //
+        const size_t historyLength = LEVEL_METER_TRUE_PEAK_TAPS - 1;
+        for (size_t channel = 0; channel < _Channels; channel++)
+        {
+            float* history = &_TruePeakHistory[channel * _TruePeakStride];
+            if (Data == NULL)
+            {
+                memset(history + historyLength, 0, Frames * sizeof(float));
+            }
+            else
+            {
+                for (size_t i = 0; i < Frames; i++)
+                {
+                    history[historyLength + i] = Data[i * _Channels + channel];
+                }
+            }
+            _TruePeakFunction(history, Frames, &_TruePeakPhases[0], &_TrueMaxSquares[channel]);
+            memmove(history, history + Frames, historyLength * sizeof(float));
+        }
+    }
+
+    _LaneFrames += static_cast<uint32_t>(Frames);
+    if (_LaneFrames >= LEVEL_METER_BLOCK_FRAMES)
+    {
+        Fold();
+    }
+}
+
+//
+//  Move the lanes into the channels, before their float sums grow long enough to lose precision.
+//
+void CLevelMeter::Fold()
+{
+    for (size_t lane = 0, channel = 0; lane < _Width; lane++)
+    {
+        _MaxSquares[channel] = std::max(_MaxSquares[channel], _LaneMaxSquares[lane]);
+        _Squares[channel] += _LaneSquares[lane];
+        if (++channel == _Channels)
+        {
+            channel = 0;
+        }
+    }
+    ClearLanes();
+}
+
+void CLevelMeter::ClearLanes()
+{
+    _LaneFrames = 0;
+    _LaneMaxSquares.assign(_Width, 0.0f);
+    _LaneSquares.assign(_Width, 0.0f);
+}
+
+void CLevelMeter::Publish()
+{
+    Fold();
+    uint64_t sequence = _Sequence.load(std::memory_order_relaxed) + 1;
+    size_t slot = static_cast<size_t>(sequence % LEVEL_METER_HISTORY);
+    std::atomic<float>* published = &_Published[slot * _Channels * 3];
+    _Versions[slot].store(2 * sequence - 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t channel = 0; channel < _Channels; channel++)
+    {
+        //
+        //  The oversampled signal passes through the samples only approximately, so the true peak is never taken
+        //  below the sample peak.
+        //
+        float peak = sqrtf(_MaxSquares[channel]);
+        published[channel].store(peak, std::memory_order_relaxed);
+        published[_Channels + channel].store(static_cast<float>(sqrt(_Squares[channel] / _Frames)), std::memory_order_relaxed);
+        published[2 * _Channels + channel].store(std::max(sqrtf(_TrueMaxSquares[channel]), peak), std::memory_order_relaxed);
+    }
+    _PublishedFirstFrames[slot].store(_TotalFrames, std::memory_order_relaxed);
+    _PublishedFrames[slot].store(_Frames, std::memory_order_relaxed);
+    _Versions[slot].store(2 * sequence, std::memory_order_release);
+    _Sequence.store(sequence, std::memory_order_release);
+
+    _TotalFrames += _Frames;
+    _Frames = 0;
+    _MaxSquares.assign(_Channels, 0.0f);
+    _Squares.assign(_Channels, 0.0);
+    _TrueMaxSquares.assign(_Channels, 0.0f);
+}
+
+bool CLevelMeter::GetReading(LevelMeterReading* Reading) const
+{
+    //
+    //  Only a reader held up for LEVEL_METER_HISTORY readings loses the latest, and then there is a newer one.
+    //
+    for (;;)
+    {
+        uint64_t sequence = _Sequence.load(std::memory_order_acquire);
+        if (sequence == 0)
+        {
+            return false;
+        }
+        if (GetReading(sequence, Reading))
+        {
+            return true;
+        }
+    }
+}
+
+bool CLevelMeter::GetReading(uint64_t Sequence, LevelMeterReading* Reading) const
+{
+    if (Sequence == 0 || !_Versions)
+    {
+        return false;
+    }
+    Reading->Peak.resize(_Channels);
+    Reading->Rms.resize(_Channels);
+    Reading->TruePeak.resize(_TruePeak ? _Channels : 0);
+    size_t slot = static_cast<size_t>(Sequence % LEVEL_METER_HISTORY);
+    const std::atomic<float>* published = &_Published[slot * _Channels * 3];
+    for (;;)
+    {
+        uint64_t version = _Versions[slot].load(std::memory_order_acquire);
+        if (version == 2 * Sequence - 1)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        if (version != 2 * Sequence)
+        {
+            return false;
+        }
+        for (size_t channel = 0; channel < _Channels; channel++)
+        {
+            Reading->Peak[channel] = published[channel].load(std::memory_order_relaxed);
+            Reading->Rms[channel] = published[_Channels + channel].load(std::memory_order_relaxed);
+            if (_TruePeak)
+            {
+                Reading->TruePeak[channel] = published[2 * _Channels + channel].load(std::memory_order_relaxed);
+            }
+        }
+        Reading->FirstFrame = _PublishedFirstFrames[slot].load(std::memory_order_relaxed);
+        Reading->Frames = _PublishedFrames[slot].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (_Versions[slot].load(std::memory_order_relaxed) == version)
+        {
+            Reading->Sequence = Sequence;
+            return true;
+        }
+    }
+}
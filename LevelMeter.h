@@ -0,0 +1,129 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include "AudioFormat.h"
+#include "SampleConvert.h"
+#include "LevelMeterKernels.h"
+
+//
+//  Readings the meter keeps, so a reader on its own timer can pick up every one published since it last looked.
+//
+#define LEVEL_METER_HISTORY 64
+
+//
+//  One interval of the level meter: per channel, the largest absolute sample, the RMS and, if the meter oversamples,
+//  the true peak, all linear with full scale at 1.  Sequence counts the readings from 1, so a reader that sees it
+//  skip missed some.  FirstFrame counts the meter's frames since it was initialized.
+//
+struct LevelMeterReading
+{
+    uint64_t            Sequence;
+    uint64_t            FirstFrame;
+    uint32_t            Frames;
+    std::vector<float>  Peak;
+    std::vector<float>  Rms;
+    std::vector<float>  TruePeak;           // Empty without true peak metering.
+};
+
+//
+//  Peak, RMS and optional true peak meter for interleaved 32 bit float audio, run on the capture thread.
+//
+//  Every IntervalFrames frames the meter publishes a reading, which any thread can pick up with GetReading() without
+//  ever holding up the capture thread: each of the last LEVEL_METER_HISTORY readings sits behind a version that is
+//  odd while it is being written, and a reader that catches it mid-write just reads again.  Peak and power are measured by the fastest
+//  kernel the CPU supports (up to MaxKernel), over lanes that each see one channel.  The true peak also takes the
+//  signal a quarter, a half and three quarters of the way between samples, interpolated by a 4 phase polyphase
+//  filter of LEVEL_METER_TRUE_PEAK_TAPS taps per phase, which finds the inter-sample peaks a D/A converter would
+//  make, as ITU-R BS.1770 describes.  Its kernels run the phases over many positions at once, but it still costs
+//  several times the rest, so it is optional.
+//
+class CLevelMeter
+{
+public:
+    CLevelMeter();
+
+    bool Initialize(const WAVEFORMATEX* Format, uint32_t IntervalFrames, bool TruePeak, SampleConvertKernel MaxKernel = SampleKernelAvx2);
+
+    size_t FrameSize() const { return _Channels * sizeof(float); }
+    WORD Channels() const { return static_cast<WORD>(_Channels); }
+    bool HasTruePeak() const { return _TruePeak; }
+    uint32_t IntervalFrames() const { return _IntervalFrames; }
+    SampleConvertKernel Kernel() const { return _Kernel; }
+
+    //
+    //  Meter Frames frames; Data NULL is silence.  If Copy isn't NULL the frames are copied there as well, in the same
+    //  pass, which is how the drain stores them in the ring.  Capture thread only.
+    //
+    void Process(const float* Data, size_t Frames, float* Copy = NULL);
+
+    //
+    //  Start over on an interval, and forget the oversampler's history.  Readings already published stay.
+    //  Capture thread only.
+    //
+    void Reset();
+
+    //
+    //  The latest reading; false before the first.  Any thread.
+    //
+    bool GetReading(LevelMeterReading* Reading) const;
+
+    //
+    //  The reading numbered Sequence; false if it isn't published yet, or is more than LEVEL_METER_HISTORY readings
+    //  old and gone.  Any thread.
+    //
+    bool GetReading(uint64_t Sequence, LevelMeterReading* Reading) const;
+
+    //
+    //  The number of the latest reading, 0 before the first.  Any thread.
+    //
+    uint64_t LatestSequence() const { return _Sequence.load(std::memory_order_acquire); }
+
+private:
+    void Measure(const float* Data, size_t Frames, float* Copy);
+    void Fold();
+    void ClearLanes();
+    void Publish();
+
+    size_t                  _Channels;
+    size_t                  _Width;             // Lanes: the least common multiple of the channel count and LEVEL_METER_LANES.
+    size_t                  _WidthFrames;       // Frames in the lanes.
+    uint32_t                _IntervalFrames;
+    bool                    _TruePeak;
+    SampleConvertKernel     _Kernel;
+    LevelMeterFunction      _Function;
+    LevelMeterTruePeakFunction  _TruePeakFunction;
+
+    //
+    //  The true peak filter's phases 1 to 3, and its planar history: per channel, the last taps - 1 samples followed by
+    //  the current block.
+    //
+    std::vector<float>      _TruePeakPhases;
+    std::vector<float>      _TruePeakHistory;
+    size_t                  _TruePeakStride;
+
+    //
+    //  Capture thread: the current interval, per channel and per lane, with peaks squared.
+    //
+    uint64_t                _TotalFrames;
+    uint32_t                _Frames;
+    std::vector<float>      _MaxSquares;
+    std::vector<double>     _Squares;
+    std::vector<float>      _TrueMaxSquares;
+    uint32_t                _LaneFrames;
+    std::vector<float>      _LaneMaxSquares;
+    std::vector<float>      _LaneSquares;
+
+    //
+    //  The published readings, reading n in slot n % LEVEL_METER_HISTORY: peak, RMS and true peak per channel, one
+    //  after the other.  A slot's version is 2n - 1 while reading n is written into it and 2n once it is.
+    //
+    std::atomic<uint64_t>                       _Sequence;
+    std::unique_ptr<std::atomic<uint64_t>[]>    _Versions;
+    std::unique_ptr<std::atomic<uint64_t>[]>    _PublishedFirstFrames;
+    std::unique_ptr<std::atomic<uint32_t>[]>    _PublishedFrames;
+    std::unique_ptr<std::atomic<float>[]>       _Published;
+};
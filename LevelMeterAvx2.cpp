@@ -0,0 +1,122 @@
+#include "LevelMeterKernels.h"
+
+//
+//  Built with AVX2 code generation enabled where the compiler supports it; CLevelMeter only calls in here after
+//  checking the CPU.
+//
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+//
+//  Each register of lanes is finished before the next, striding through the samples, so its accumulators stay in
+//  registers; four sets of them keep the additions from waiting on each other.  Copying stores each register as it
+//  is loaded.
+//
+template <bool Copying>
+static void MeasureAvx2Lanes(const float* Samples, size_t Count, size_t Width, float* MaxSquares, float* Squares, float* Copy)
+{
+    for (size_t lane = 0; lane < Width; lane += LEVEL_METER_LANES)
+    {
+        __m256 maxSquares[4] = { _mm256_loadu_ps(MaxSquares + lane), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+        __m256 squares[4] = { _mm256_loadu_ps(Squares + lane), _mm256_setzero_ps(), _mm256_setzero_ps(), _mm256_setzero_ps() };
+        size_t i = lane;
+        for (; i + 3 * Width < Count; i += 4 * Width)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                __m256 samples = _mm256_loadu_ps(Samples + i + j * Width);
+                if (Copying)
+                {
+                    _mm256_storeu_ps(Copy + i + j * Width, samples);
+                }
+                __m256 square = _mm256_mul_ps(samples, samples);
+                maxSquares[j] = _mm256_max_ps(square, maxSquares[j]);
+                squares[j] = _mm256_add_ps(squares[j], square);
+            }
+        }
+        for (; i < Count; i += Width)
+        {
+            __m256 samples = _mm256_loadu_ps(Samples + i);
+            if (Copying)
+            {
+                _mm256_storeu_ps(Copy + i, samples);
+            }
+            __m256 square = _mm256_mul_ps(samples, samples);
+            maxSquares[0] = _mm256_max_ps(square, maxSquares[0]);
+            squares[0] = _mm256_add_ps(squares[0], square);
+        }
+        _mm256_storeu_ps(MaxSquares + lane, _mm256_max_ps(_mm256_max_ps(maxSquares[0], maxSquares[1]), _mm256_max_ps(maxSquares[2], maxSquares[3])));
+        _mm256_storeu_ps(Squares + lane, _mm256_add_ps(_mm256_add_ps(squares[0], squares[1]), _mm256_add_ps(squares[2], squares[3])));
+    }
+}
+
+static void MeasureAvx2(const float* Samples, size_t Count, size_t Width, float* MaxSquares, float* Squares, float* Copy)
+{
+    if (Copy != NULL)
+    {
+        MeasureAvx2Lanes<true>(Samples, Count, Width, MaxSquares, Squares, Copy);
+    }
+    else
+    {
+        MeasureAvx2Lanes<false>(Samples, Count, Width, MaxSquares, Squares, NULL);
+    }
+}
+
+//
+//  Sixteen positions at a time, in two registers: each coefficient is multiplied into both, and the six sums don't
+//  wait on each other.
+//
+static void TruePeakAvx2(const float* Samples, size_t Frames, const float* Phases, float* MaxSquare)
+{
+    __m256 maxSquare = _mm256_set1_ps(*MaxSquare);
+    size_t n = 0;
+    for (; n + 16 <= Frames; n += 16)
+    {
+        __m256 values[3][2] = {};
+        for (size_t tap = 0; tap < LEVEL_METER_TRUE_PEAK_TAPS; tap++)
+        {
+            __m256 samples[2] = { _mm256_loadu_ps(Samples + n + tap), _mm256_loadu_ps(Samples + n + tap + 8) };
+            for (int phase = 0; phase < 3; phase++)
+            {
+                __m256 coefficient = _mm256_broadcast_ss(Phases + phase * LEVEL_METER_TRUE_PEAK_TAPS + tap);
+                values[phase][0] = _mm256_add_ps(values[phase][0], _mm256_mul_ps(coefficient, samples[0]));
+                values[phase][1] = _mm256_add_ps(values[phase][1], _mm256_mul_ps(coefficient, samples[1]));
+            }
+        }
+        for (int phase = 0; phase < 3; phase++)
+        {
+            maxSquare = _mm256_max_ps(_mm256_mul_ps(values[phase][0], values[phase][0]), maxSquare);
+            maxSquare = _mm256_max_ps(_mm256_mul_ps(values[phase][1], values[phase][1]), maxSquare);
+        }
+    }
+    __m128 folded = _mm_max_ps(_mm256_castps256_ps128(maxSquare), _mm256_extractf128_ps(maxSquare, 1));
+    folded = _mm_max_ps(folded, _mm_movehl_ps(folded, folded));
+    folded = _mm_max_ss(folded, _mm_shuffle_ps(folded, folded, 1));
+    *MaxSquare = _mm_cvtss_f32(folded);
+    TruePeakScalar(Samples + n, Frames - n, Phases, MaxSquare);
+}
+
+LevelMeterFunction GetAvx2LevelMeterFunction()
+{
+    return MeasureAvx2;
+}
+
+LevelMeterTruePeakFunction GetAvx2TruePeakFunction()
+{
+    return TruePeakAvx2;
+}
+
+#else
+
+LevelMeterFunction GetAvx2LevelMeterFunction()
+{
+    return NULL;
+}
+
+LevelMeterTruePeakFunction GetAvx2TruePeakFunction()
+{
+    return NULL;
+}
+
+#endif
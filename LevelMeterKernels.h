@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+//  Peak and power kernels of the level meter.  Like SampleConvertKernels.h, this header must stay free of inline
+//  code because LevelMeterAvx2.cpp is built with AVX2 enabled.
+//
+
+//
+//  Lane accumulators come in multiples of this many, one AVX2 register's worth of floats.
+//
+#define LEVEL_METER_LANES   8
+
+//
+//  Folds Count float samples into Width lane accumulators: lane j takes samples j, j + Width, j + 2 * Width and so
+//  on, raising MaxSquares[j] to the largest of their squares and adding their squares to Squares[j].  Tracking the
+//  peak squared saves taking the absolute value, and its square root gives back the peak exactly.  With Width a
+//  multiple of the channel count, every lane sees a single channel.  The vector kernels need Count to be a multiple
+//  of Width and Width a multiple of LEVEL_METER_LANES; the scalar one takes any Count and Width.  A NaN sample
+//  doesn't raise the peak.  If Copy isn't NULL the samples are stored there too, from the same registers, so metering
+//  a copy costs little more than the copy.  Nothing needs to be aligned.
+//
+typedef void (*LevelMeterFunction)(const float* Samples, size_t Count, size_t Width, float* MaxSquares, float* Squares, float* Copy);
+
+//
+//  The AVX2 kernel, or NULL if this build has none.  Only call it if CpuSupportsAvx2().
+//
+LevelMeterFunction GetAvx2LevelMeterFunction();
+
+//
+//  True peak kernels, run on one channel at a time.  Samples holds Frames + LEVEL_METER_TRUE_PEAK_TAPS - 1 samples
+//  of the channel in time order, and Phases the taps of the three phases of a 4 times oversampling filter, one phase
+//  after the other, in time order too.  Each phase is applied at every one of the Frames positions, giving the
+//  signal a quarter, a half and three quarters of the way between two samples, and MaxSquare is raised to the
+//  largest of their squares; the samples themselves are left to the peak.  A NaN doesn't raise it.  The vector
+//  kernels take any Frames, finishing the last few with the scalar one, and nothing needs to be aligned.
+//
+#define LEVEL_METER_TRUE_PEAK_TAPS  12
+
+typedef void (*LevelMeterTruePeakFunction)(const float* Samples, size_t Frames, const float* Phases, float* MaxSquare);
+
+//
+//  The scalar kernel, which the vector ones call for the frames left over.
+//
+void TruePeakScalar(const float* Samples, size_t Frames, const float* Phases, float* MaxSquare);
+
+//
+//  The AVX2 kernel, or NULL if this build has none.  Only call it if CpuSupportsAvx2().
+//
+LevelMeterTruePeakFunction GetAvx2TruePeakFunction();
@@ -0,0 +1,367 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "MetricsExporter.h"
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void AppendFormat(std::string* Text, const char* Format, ...)
+{
+    char buffer[512];
+    va_list arguments;
+    va_start(arguments, Format);
+    int length = vsnprintf(buffer, sizeof(buffer), Format, arguments);
+    va_end(arguments);
+    if (length > 0)
+    {
+        Text->append(buffer, static_cast<size_t>(length) < sizeof(buffer) ? static_cast<size_t>(length) : sizeof(buffer) - 1);
+    }
+}
+
+static void AppendUnsigned(std::string* Text, uint64_t Value)
+{
+    char digits[20];
+    size_t length = 0;
+    do
+    {
+        digits[length++] = static_cast<char>('0' + Value % 10);
+        Value /= 10;
+    } while (Value != 0);
+    while (length != 0)
+    {
+        Text->push_back(digits[--length]);
+    }
+}
+
+//
+//  %.17g, without going through printf for the whole numbers most counters and gauges are.
+//
+static void AppendValue(std::string* Text, double Value)
+{
+    if (Value >= 0 && Value < 9007199254740992.0 && Value == static_cast<double>(static_cast<uint64_t>(Value)))
+    {
+        AppendUnsigned(Text, static_cast<uint64_t>(Value));
+    }
+    else
+    {
+        AppendFormat(Text, "%.17g", Value);
+    }
+}
+
+CMetricsExporter::CMetricsExporter() :
+    _Collector(NULL),
+    _JsonFile(NULL),
+    _OwnJsonFile(false),
+    _IntervalMs(0),
+    _LastExportNs(0),
+    _PrometheusWritten(false),
+    _Stopping(false),
+    _Exports(0),
+    _ExportTimeNs(0)
+{
+}
+
+CMetricsExporter::~CMetricsExporter()
+{
+    Stop();
+}
+
+void CMetricsExporter::AddHistogram(const char* Name, const char* Help, const CLatencyHistogram* Histogram, double Scale,
+    const std::vector<uint64_t>& Bounds)
+{
+    ExportedHistogram histogram;
+    histogram.Name = Name;
+    histogram.Help = Help;
+    histogram.Histogram = Histogram;
+    histogram.Scale = Scale;
+    histogram.Bounds = Bounds;
+    AppendFormat(&histogram.JsonKey, "\"%s\":{\"count\":", Name);
+    AppendFormat(&histogram.PrometheusHeader, "# HELP %s %s\n# TYPE %s histogram\n", Name, Help, Name);
+    histogram.BucketPrefixes.resize(Bounds.size());
+    for (size_t bound = 0; bound < Bounds.size(); bound++)
+    {
+        AppendFormat(&histogram.BucketPrefixes[bound], "%s_bucket{le=\"%.6g\"} ", Name, Bounds[bound] * Scale);
+    }
+    histogram.BucketCounts.resize(Bounds.size());
+    _Histograms.push_back(histogram);
+}
+
+bool CMetricsExporter::Start(const std::string& JsonFile, const std::string& PrometheusFile, uint32_t IntervalMs,
+    IMetricsCollector* Collector)
+{
+    if (IntervalMs == 0 || (JsonFile.empty() && PrometheusFile.empty()))
+    {
+        fprintf(stderr, "Invalid metrics parameters.\n");
+        return false;
+    }
+    if (JsonFile == "-")
+    {
+        _JsonFile = stderr;
+        _OwnJsonFile = false;
+    }
+    else if (!JsonFile.empty())
+    {
+        _JsonFile = fopen(JsonFile.c_str(), "a");
+        if (_JsonFile == NULL)
+        {
+            fprintf(stderr, "Unable to open metrics file %s\n", JsonFile.c_str());
+            return false;
+        }
+        _OwnJsonFile = true;
+    }
+
+    _PrometheusFile = PrometheusFile;
+    _IntervalMs = IntervalMs;
+    _Collector = Collector;
+    _LastValues.clear();
+    _LastExportNs = SteadyClockNs();
+    _PrometheusWritten = false;
+    for (size_t i = 0; i < _Histograms.size(); i++)
+    {
+        _Histograms[i].Histogram->Snapshot(&_Histograms[i].Last);
+    }
+    _Stopping = false;
+    _Thread = std::thread(&CMetricsExporter::ExporterThread, this);
+    return true;
+}
+
+void CMetricsExporter::Stop()
+{
+    if (!_Thread.joinable())
+    {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_Lock);
+        _Stopping = true;
+    }
+    _StopRequested.notify_one();
+    _Thread.join();
+
+    if (_OwnJsonFile)
+    {
+        fclose(_JsonFile);
+    }
+    _JsonFile = NULL;
+    _OwnJsonFile = false;
+}
+
+//
+//  Exporter thread - exports every interval, and once more on the way out so the files end with the final counts.
+//
+void CMetricsExporter::ExporterThread()
+{
+    std::unique_lock<std::mutex> lock(_Lock);
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    for (;;)
+    {
+        next += std::chrono::milliseconds(_IntervalMs);
+        bool stopping = _StopRequested.wait_until(lock, next, [this] { return _Stopping; });
+        lock.unlock();
+        Export();
+        lock.lock();
+        if (stopping)
+        {
+            break;
+        }
+    }
+}
+
+bool CMetricsExporter::Export()
+{
+    int64_t start = SteadyClockNs();
+    _Values.clear();
+    if (_Collector != NULL)
+    {
+        _Collector->CollectMetrics(&_Values);
+    }
+    FormatValues();
+
+    //
+    //  Histograms only ever gain values, so one whose count hasn't moved is the same as at the last export.
+    //
+    bool changed = !_PrometheusWritten || _Values.size() != _LastValues.size();
+    for (size_t i = 0; i < _Values.size() && !changed; i++)
+    {
+        changed = _Values[i].Value != _LastValues[i].Value || _Values[i].Name != _LastValues[i].Name;
+    }
+    for (size_t i = 0; i < _Histograms.size(); i++)
+    {
+        _Histograms[i].Histogram->Snapshot(&_Histograms[i].Current);
+        changed = changed || _Histograms[i].Current.Count() != _Histograms[i].Last.Count();
+    }
+
+    double intervalSeconds = (start - _LastExportNs) / 1e9;
+    if (_JsonFile != NULL)
+    {
+        WriteJson(intervalSeconds);
+    }
+    bool succeeded = _PrometheusFile.empty() || !changed || WritePrometheus();
+    _PrometheusWritten = _PrometheusWritten || (succeeded && changed);
+
+    for (size_t i = 0; i < _Histograms.size(); i++)
+    {
+        std::swap(_Histograms[i].Last, _Histograms[i].Current);
+    }
+    std::swap(_LastValues, _Values);
+    _LastExportNs = start;
+    _Exports.fetch_add(1, std::memory_order_relaxed);
+    _ExportTimeNs.fetch_add(static_cast<uint64_t>(SteadyClockNs() - start), std::memory_order_relaxed);
+    return succeeded;
+}
+
+//
+//  The collector hands back the same names every time, so their text is only formatted again if one changes.
+//
+void CMetricsExporter::FormatValues()
+{
+    _FormattedValues.resize(_Values.size());
+    for (size_t i = 0; i < _Values.size(); i++)
+    {
+        FormattedValue& formatted = _FormattedValues[i];
+        if (formatted.Name == _Values[i].Name && !formatted.JsonKey.empty())
+        {
+            continue;
+        }
+        formatted.Name = _Values[i].Name;
+        formatted.JsonKey.clear();
+        formatted.PrometheusPrefix.clear();
+        AppendFormat(&formatted.JsonKey, "\"%s\":", _Values[i].Name);
+        AppendFormat(&formatted.PrometheusPrefix, "# HELP %s %s\n# TYPE %s %s\n%s ", _Values[i].Name, _Values[i].Help,
+            _Values[i].Name, _Values[i].Counter ? "counter" : "gauge", _Values[i].Name);
+    }
+}
+
+void CMetricsExporter::WriteJson(double IntervalSeconds)
+{
+    double now = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+    std::string& line = _JsonLine;
+    line.clear();
+    AppendFormat(&line, "{\"time\":%.3f,\"intervalSeconds\":%.3f", now, IntervalSeconds);
+
+    const char* sections[] = { ",\"counters\":{", ",\"gauges\":{" };
+    for (int section = 0; section < 2; section++)
+    {
+        bool counters = section == 0;
+        line += sections[section];
+        bool first = true;
+        for (size_t i = 0; i < _Values.size(); i++)
+        {
+            if (_Values[i].Counter == counters)
+            {
+                if (!first)
+                {
+                    line += ',';
+                }
+                line += _FormattedValues[i].JsonKey;
+                AppendValue(&line, _Values[i].Value);
+                first = false;
+            }
+        }
+        line += "}";
+    }
+
+    //
+    //  Rates need the previous export's value; the first line has none.
+    //
+    line += ",\"rates\":{";
+    bool first = true;
+    for (size_t i = 0; i < _Values.size() && i < _LastValues.size() && IntervalSeconds > 0; i++)
+    {
+        if (_Values[i].Counter && strcmp(_Values[i].Name, _LastValues[i].Name) == 0)
+        {
+            if (!first)
+            {
+                line += ',';
+            }
+            line += _FormattedValues[i].JsonKey;
+            AppendFormat(&line, "%.6g", (_Values[i].Value - _LastValues[i].Value) / IntervalSeconds);
+            first = false;
+        }
+    }
+    line += "}";
+
+    line += ",\"histograms\":{";
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+    for (size_t i = 0; i < _Histograms.size(); i++)
+    {
+        ExportedHistogram& histogram = _Histograms[i];
+        CHistogramSnapshot& interval = histogram.Interval;
+        interval = histogram.Current;
+        interval.Subtract(histogram.Last);
+        uint64_t values[4];
+        interval.ValuesAtQuantiles(quantiles, 4, values);
+        double scale = histogram.Scale;
+        if (i != 0)
+        {
+            line += ',';
+        }
+        line += histogram.JsonKey;
+        AppendUnsigned(&line, interval.Count());
+        AppendFormat(&line, ",\"mean\":%.6g,\"p50\":%.6g,\"p90\":%.6g,\"p99\":%.6g,\"p999\":%.6g,\"max\":%.6g}", interval.Mean() * scale,
+            values[0] * scale, values[1] * scale, values[2] * scale, values[3] * scale, interval.Max() * scale);
+    }
+    line += "}}\n";
+
+    fwrite(line.data(), 1, line.size(), _JsonFile);
+    fflush(_JsonFile);
+}
+
+bool CMetricsExporter::WritePrometheus()
+{
+    std::string& text = _PrometheusText;
+    text.clear();
+    for (size_t i = 0; i < _Values.size(); i++)
+    {
+        text += _FormattedValues[i].PrometheusPrefix;
+        AppendValue(&text, _Values[i].Value);
+        text += '\n';
+    }
+    for (size_t i = 0; i < _Histograms.size(); i++)
+    {
+        ExportedHistogram& histogram = _Histograms[i];
+        const CHistogramSnapshot& snapshot = histogram.Current;
+        text += histogram.PrometheusHeader;
+        if (!histogram.Bounds.empty())
+        {
+            snapshot.CountsAtOrBelow(&histogram.Bounds[0], histogram.Bounds.size(), &histogram.BucketCounts[0]);
+        }
+        for (size_t bound = 0; bound < histogram.Bounds.size(); bound++)
+        {
+            text += histogram.BucketPrefixes[bound];
+            AppendUnsigned(&text, histogram.BucketCounts[bound]);
+            text += '\n';
+        }
+        AppendFormat(&text, "%s_bucket{le=\"+Inf\"} %llu\n%s_sum %.9g\n%s_count %llu\n", histogram.Name,
+            static_cast<unsigned long long>(snapshot.Count()), histogram.Name, snapshot.Sum() * histogram.Scale,
+            histogram.Name, static_cast<unsigned long long>(snapshot.Count()));
+    }
+
+    //
+    //  node_exporter only reads *.prom files, so the temporary name doesn't get scraped.  Windows can't rename over an
+    //  existing file.
+    //
+    std::string temporaryFile = _PrometheusFile + ".tmp";
+    FILE* file = fopen(temporaryFile.c_str(), "wb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Unable to write metrics file %s\n", temporaryFile.c_str());
+        return false;
+    }
+    bool succeeded = fwrite(text.data(), 1, text.size(), file) == text.size();
+    succeeded = fclose(file) == 0 && succeeded;
+#ifdef _WIN32
+    remove(_PrometheusFile.c_str());
+#endif
+    if (!succeeded || rename(temporaryFile.c_str(), _PrometheusFile.c_str()) != 0)
+    {
+        fprintf(stderr, "Unable to write metrics file %s\n", _PrometheusFile.c_str());
+        remove(temporaryFile.c_str());
+        return false;
+    }
+    return true;
+}
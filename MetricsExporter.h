@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "LatencyHistogram.h"
+
+//
+//  A counter or gauge value, as collected for one export.
+//
+struct MetricValue
+{
+    const char*     Name;
+    const char*     Help;
+    bool            Counter;        // Only ever goes up; false for a gauge.
+    double          Value;
+};
+
+//
+//  Fills in the counters and gauges for an export, from the exporter's thread.  Implementations read the pipeline's
+//  atomic stats, so collecting never blocks the threads being measured.
+//
+class IMetricsCollector
+{
+public:
+    virtual ~IMetricsCollector() {}
+    virtual void CollectMetrics(std::vector<MetricValue>* Values) = 0;
+};
+
+//
+//  Periodic metrics export, on a thread of its own.
+//
+//  Every interval the exporter collects the counters and gauges and snapshots the histograms, then appends a JSON
+//  line to the side channel and rewrites the Prometheus text file, either of which may be left out.  The JSON line
+//  has the counters and gauges as of the export, the counters' rates and the histograms' count, mean, percentiles
+//  and max over the interval since the line before.  The text file, in the node_exporter textfile collector format,
+//  has them since the start, with cumulative histogram buckets; it is written next to its final name and renamed
+//  over it, so a scrape never sees half a file, and left alone when nothing changed since it was last written.
+//  Histogram values are exported multiplied by their scale, so nanoseconds become seconds as Prometheus expects.
+//
+//  Everything in the output but the numbers is formatted once, the first time it's needed, and the buffers are kept
+//  from one export to the next, so an export costs little more than the numbers it writes.
+//
+class CMetricsExporter
+{
+public:
+    CMetricsExporter();
+    ~CMetricsExporter();
+
+    //
+    //  Bounds are the upper bounds of the Prometheus buckets in the histogram's own units, in increasing order.
+    //  Before Start() only.
+    //
+    void AddHistogram(const char* Name, const char* Help, const CLatencyHistogram* Histogram, double Scale,
+        const std::vector<uint64_t>& Bounds);
+
+    //
+    //  JsonFile "-" is stderr.  Either file name may be empty.
+    //
+    bool Start(const std::string& JsonFile, const std::string& PrometheusFile, uint32_t IntervalMs, IMetricsCollector* Collector);
+
+    //
+    //  Export one last time and stop.
+    //
+    void Stop();
+
+    //
+    //  Exports so far and the time they took, collecting and writing, for checking the exporter's own cost.
+    //
+    uint64_t Exports() const { return _Exports.load(std::memory_order_relaxed); }
+    uint64_t ExportTimeNs() const { return _ExportTimeNs.load(std::memory_order_relaxed); }
+
+private:
+    struct ExportedHistogram
+    {
+        const char*                 Name;
+        const char*                 Help;
+        const CLatencyHistogram*    Histogram;
+        double                      Scale;
+        std::vector<uint64_t>       Bounds;
+        CHistogramSnapshot          Last;
+        CHistogramSnapshot          Current;
+        CHistogramSnapshot          Interval;
+
+        //
+        //  The text around the numbers: the JSON key, the Prometheus HELP and TYPE lines, and each bucket's name
+        //  and label.
+        //
+        std::string                 JsonKey;
+        std::string                 PrometheusHeader;
+        std::vector<std::string>    BucketPrefixes;
+        std::vector<uint64_t>       BucketCounts;
+    };
+
+    //
+    //  The text around a counter's or gauge's number, for the name it was formatted for.
+    //
+    struct FormattedValue
+    {
+        const char*                 Name;
+        std::string                 JsonKey;
+        std::string                 PrometheusPrefix;
+    };
+
+    void ExporterThread();
+    bool Export();
+    void FormatValues();
+    void WriteJson(double IntervalSeconds);
+    bool WritePrometheus();
+
+    std::vector<ExportedHistogram>  _Histograms;
+    IMetricsCollector*              _Collector;
+    FILE*                           _JsonFile;
+    bool                            _OwnJsonFile;
+    std::string                     _PrometheusFile;
+    uint32_t                        _IntervalMs;
+
+    //
+    //  This export's counters and the previous one's, for the rates, and the previous export's time.
+    //
+    std::vector<MetricValue>        _Values;
+    std::vector<MetricValue>        _LastValues;
+    int64_t                         _LastExportNs;
+
+    std::vector<FormattedValue>     _FormattedValues;
+    std::string                     _JsonLine;
+    std::string                     _PrometheusText;
+    bool                            _PrometheusWritten;
+
+    std::thread                     _Thread;
+    std::mutex                      _Lock;
+    std::condition_variable         _StopRequested;
+    bool                            _Stopping;
+
+    std::atomic<uint64_t>           _Exports;
+    std::atomic<uint64_t>           _ExportTimeNs;
+};
@@ -0,0 +1,440 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "MultiCaptureSource.h"
+
+//
+//  How much of the reference input may pile up while another input hasn't delivered, before that input gets silence.
+//  It has to cover the difference in latency between the devices.
+//
+#define MULTI_CAPTURE_MAX_WAIT_MS   250
+
+//
+//  Timing errors beyond this aren't drift; the input jumps or waits instead.
+//
+#define MULTI_CAPTURE_RESYNC_MS     20
+
+//
+//  Gains of the clock model per packet record, an alpha-beta filter with the beta that damps it critically, and how
+//  far off its line a capture time may be before the line starts over.
+//
+#define MULTI_CAPTURE_CLOCK_ALPHA   0.05
+#define MULTI_CAPTURE_CLOCK_BETA    (MULTI_CAPTURE_CLOCK_ALPHA * MULTI_CAPTURE_CLOCK_ALPHA / (2 - MULTI_CAPTURE_CLOCK_ALPHA))
+#define MULTI_CAPTURE_CLOCK_RESET_MS 50
+
+//
+//  Control loop gains per packet.  With the integral gain a quarter of the square of the proportional gain the loop
+//  is critically damped, with a time constant of 2 / MULTI_CAPTURE_GAIN_P packets.
+//
+#define MULTI_CAPTURE_GAIN_P        0.1
+#define MULTI_CAPTURE_GAIN_I        (MULTI_CAPTURE_GAIN_P * MULTI_CAPTURE_GAIN_P / 4)
+
+//
+//  The largest relative clock rate error followed; real crystals are off by a few hundred ppm at most.
+//
+#define MULTI_CAPTURE_MAX_DRIFT     0.005
+
+CMultiCaptureSource::CMultiCaptureSource() :
+    _PacketFrames(0),
+    _MaxWaitFrames(0),
+    _PacketTimeNs(0),
+    _OutputFrames(0)
+{
+}
+
+CMultiCaptureSource::~CMultiCaptureSource()
+{
+    Shutdown();
+}
+
+//
+//  Inputs have to deliver 32 bit float, as shared mode engines do.
+//
+bool CMultiCaptureSource::Initialize(ICaptureSource* const* Sources, size_t Count, UINT32 PacketFrames, SampleConvertKernel MaxKernel)
+{
+    if (Count == 0 || PacketFrames == 0 || !_Streams.empty())
+    {
+        fprintf(stderr, "Invalid multi source parameters.\n");
+        return false;
+    }
+
+    const DWORD referenceRate = Sources[0]->MixFormat()->nSamplesPerSec;
+    uint32_t channels = 0;
+    for (size_t i = 0; i < Count; i++)
+    {
+        const WAVEFORMATEX* format = Sources[i]->MixFormat();
+        Stream* stream = new Stream();
+        stream->Source = Sources[i];
+        stream->Source->AddRef();
+        _Streams.push_back(stream);
+
+        stream->Channels = format->nChannels;
+        stream->SamplesPerSec = format->nSamplesPerSec;
+        stream->FirstChannel = static_cast<WORD>(channels);
+        stream->NominalStep = static_cast<double>(format->nSamplesPerSec) / referenceRate;
+        channels += format->nChannels;
+        if (channels > 0xFFFF / sizeof(float))
+        {
+            fprintf(stderr, "Too many channels for one multi source.\n");
+            return false;
+        }
+
+        //
+        //  A second of every input can wait in its ring for the others.
+        //
+        if (!IsFloatFormat(format) || format->wBitsPerSample != 32)
+        {
+            fprintf(stderr, "Multi source input %zu doesn't deliver 32 bit float.\n", i);
+            return false;
+        }
+        memset(&stream->Processing, 0, sizeof(stream->Processing));
+        stream->Processing.PacketLog = &stream->PacketLog;
+        stream->Processing.GapPolicy = CaptureGapFill;
+        if (!stream->RingBuffer.Initialize(format->nSamplesPerSec, format->nChannels * sizeof(float)) ||
+            !stream->PacketLog.Initialize(4096) ||
+            !stream->Resampler.Initialize(format->nChannels, stream->NominalStep, format->nSamplesPerSec, MaxKernel))
+        {
+            fprintf(stderr, "Failed to allocate the buffers of multi source input %zu.\n", i);
+            return false;
+        }
+
+        stream->HaveRecord = false;
+        stream->HaveClock = false;
+        stream->ClockFrame = 0;
+        stream->ClockTimeNs = 0.0;
+        stream->FrameNs = 1000000000.0 / format->nSamplesPerSec;
+        stream->Locked = false;
+        stream->Drift = 0.0;
+        stream->Error = 0.0;
+        stream->Step = stream->NominalStep;
+        stream->SilenceFrames = 0;
+        stream->MaxError = 0.0;
+        stream->DriftPpb.store(0);
+        stream->OffsetNs.store(0);
+        stream->MaxOffsetNs.store(0);
+        stream->Resyncs.store(0);
+        stream->SilenceTotal.store(0);
+    }
+
+    InitializeWaveFormat(&_MixFormat, true, static_cast<WORD>(channels), referenceRate, 32, 0);
+    _PacketFrames = PacketFrames;
+    _MaxWaitFrames = referenceRate * MULTI_CAPTURE_MAX_WAIT_MS / 1000;
+    _Packet.assign(static_cast<size_t>(PacketFrames) * channels, 0.0f);
+
+    //
+    //  Wake up twice per packet, like the synthetic source.
+    //
+    int64_t packetDuration = static_cast<int64_t>(PacketFrames) * 10000000 / referenceRate;
+    return InitializeClock(packetDuration > 1 ? packetDuration / 2 : 1, true);
+}
+
+//
+//  The inputs start first, so their rings already fill while our capture thread spins up.
+//
+bool CMultiCaptureSource::Start(CCaptureRingBuffer* RingBuffer, const CaptureProcessing* Processing)
+{
+    if (_Streams.empty())
+    {
+        fprintf(stderr, "Multi source started before it was initialized.\n");
+        return false;
+    }
+    for (size_t i = 0; i < _Streams.size(); i++)
+    {
+        if (!_Streams[i]->Source->Start(&_Streams[i]->RingBuffer, &_Streams[i]->Processing))
+        {
+            fprintf(stderr, "Failed to start multi source input %zu.\n", i);
+            StopSources();
+            return false;
+        }
+    }
+    if (!CClockedCaptureSource::Start(RingBuffer, Processing))
+    {
+        StopSources();
+        return false;
+    }
+    return true;
+}
+
+void CMultiCaptureSource::Stop()
+{
+    CClockedCaptureSource::Stop();
+    StopSources();
+}
+
+void CMultiCaptureSource::StopSources()
+{
+    for (size_t i = 0; i < _Streams.size(); i++)
+    {
+        _Streams[i]->Source->Stop();
+    }
+}
+
+void CMultiCaptureSource::Shutdown()
+{
+    CClockedCaptureSource::Shutdown();
+    for (size_t i = 0; i < _Streams.size(); i++)
+    {
+        _Streams[i]->Source->Shutdown();
+        _Streams[i]->Source->Release();
+        delete _Streams[i];
+    }
+    _Streams.clear();
+}
+
+void CMultiCaptureSource::GetStreamStats(size_t Index, MultiCaptureStreamStats* Stats) const
+{
+    const Stream* stream = _Streams[Index];
+    Stats->DriftPpm = stream->DriftPpb.load(std::memory_order_relaxed) / 1000.0;
+    Stats->OffsetUs = stream->OffsetNs.load(std::memory_order_relaxed) / 1000.0;
+    Stats->MaxOffsetUs = stream->MaxOffsetNs.load(std::memory_order_relaxed) / 1000.0;
+    Stats->Resyncs = stream->Resyncs.load(std::memory_order_relaxed);
+    Stats->SilenceFrames = stream->SilenceTotal.load(std::memory_order_relaxed);
+}
+
+void CMultiCaptureSource::OnStart()
+{
+    _OutputFrames = 0;
+}
+
+//
+//  Move everything the inputs' capture threads have published into their resamplers.
+//
+void CMultiCaptureSource::ReadInputs()
+{
+    for (size_t i = 0; i < _Streams.size(); i++)
+    {
+        Stream* stream = _Streams[i];
+        CaptureRingRegion regions[2];
+        stream->RingBuffer.BeginRead(stream->RingBuffer.FrameCapacity(), regions);
+        size_t taken = 0;
+        for (int region = 0; region < 2 && regions[region].Frames != 0; region++)
+        {
+            size_t pushed = stream->Resampler.Push(reinterpret_cast<const float*>(regions[region].Data), regions[region].Frames);
+            taken += pushed;
+            if (pushed < regions[region].Frames)
+            {
+                break;
+            }
+        }
+        stream->RingBuffer.CommitRead(taken);
+    }
+}
+
+//
+//  Fold a packet's capture time into the input's clock model: a line through the packets' capture times, followed by
+//  an alpha-beta filter so capture times that jitter - or are only arrival times, from sources that report none -
+//  still come out smooth, and with the slope of the device's actual rate rather than its nominal one.  After a gap,
+//  or a capture time too far off the line, the line starts over from the packet.
+//
+void CMultiCaptureSource::UpdateClock(Stream* Input, const CapturePacketRecord& Record)
+{
+    if (Input->HaveClock && Record.Frame > Input->ClockFrame && (Record.Flags & CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY) == 0)
+    {
+        double frames = static_cast<double>(Record.Frame - Input->ClockFrame);
+        double predicted = Input->ClockTimeNs + frames * Input->FrameNs;
+        double residual = static_cast<double>(Record.TimeNs) - predicted;
+        if (fabs(residual) < MULTI_CAPTURE_CLOCK_RESET_MS * 1000000.0)
+        {
+            double nominalFrameNs = 1000000000.0 / Input->SamplesPerSec;
+            Input->ClockFrame = Record.Frame;
+            Input->ClockTimeNs = predicted + MULTI_CAPTURE_CLOCK_ALPHA * residual;
+            Input->FrameNs += MULTI_CAPTURE_CLOCK_BETA * residual / frames;
+            Input->FrameNs = std::min(std::max(Input->FrameNs, nominalFrameNs * (1.0 - MULTI_CAPTURE_MAX_DRIFT)),
+                nominalFrameNs * (1.0 + MULTI_CAPTURE_MAX_DRIFT));
+            return;
+        }
+    }
+    Input->ClockFrame = Record.Frame;
+    Input->ClockTimeNs = static_cast<double>(Record.TimeNs);
+    Input->HaveClock = true;
+}
+
+//
+//  Capture time of the input at Position by its clock model, which takes in the packet record covering the position
+//  when it comes out.  Positions must not go backwards.
+//
+bool CMultiCaptureSource::InputTime(Stream* Input, double Position, int64_t* TimeNs)
+{
+    uint64_t frame = static_cast<uint64_t>(Position);
+    if (!Input->HaveRecord || frame >= Input->PacketRecord.Frame + Input->PacketRecord.Frames)
+    {
+        CapturePacketRecord record;
+        if (Input->PacketLog.Lookup(frame, &record))
+        {
+            Input->PacketRecord = record;
+            Input->HaveRecord = true;
+            UpdateClock(Input, record);
+        }
+    }
+    if (!Input->HaveClock)
+    {
+        return false;
+    }
+    *TimeNs = static_cast<int64_t>(Input->ClockTimeNs + (Position - static_cast<double>(Input->ClockFrame)) * Input->FrameNs);
+    return true;
+}
+
+//
+//  Decide how a non-reference input fills the next packet, whose first frame was captured at TimeNs: how many frames
+//  of silence come first and at which step the rest is resampled.  Returns false to wait for more of its input;
+//  once the reference is Late, an input that has nothing gets silence instead.
+//
+bool CMultiCaptureSource::PlanStream(Stream* Input, int64_t TimeNs, bool Late)
+{
+    Input->SilenceFrames = 0;
+    Input->Error = 0.0;
+    Input->Step = Input->NominalStep * (1.0 + Input->Drift);
+
+    int64_t inputTimeNs;
+    if (!InputTime(Input, Input->Resampler.Position(), &inputTimeNs))
+    {
+        if (!Late)
+        {
+            return false;
+        }
+        Input->SilenceFrames = _PacketFrames;
+        return true;
+    }
+
+    //
+    //  Positive when the input frame we're at was captured after the packet, i.e. we're ahead in the input.
+    //
+    double error = static_cast<double>(inputTimeNs - TimeNs) * Input->SamplesPerSec / 1000000000.0;
+    if (!Input->Locked || fabs(error) > Input->SamplesPerSec * MULTI_CAPTURE_RESYNC_MS / 1000.0)
+    {
+        if (Input->Locked)
+        {
+            Input->Resyncs.fetch_add(1, std::memory_order_relaxed);
+            Input->Locked = false;
+        }
+        if (error > 0.0)
+        {
+            //
+            //  The input starts after this packet does: silence up to the first output frame at or after it, and
+            //  the rest of the way to that frame's capture time is skipped.
+            //
+            double silence = error / Input->NominalStep;
+            if (silence >= _PacketFrames)
+            {
+                Input->SilenceFrames = _PacketFrames;
+                return true;
+            }
+            Input->SilenceFrames = static_cast<uint32_t>(ceil(silence));
+            Input->Resampler.Skip((Input->SilenceFrames - silence) * Input->NominalStep);
+        }
+        else
+        {
+            Input->Resampler.Skip(-error);
+        }
+        Input->Locked = true;
+        Input->MaxError = 0.0;
+        error = 0.0;
+    }
+
+    Input->Error = error;
+    Input->Step = Input->NominalStep * (1.0 + Input->Drift) - MULTI_CAPTURE_GAIN_P * error / _PacketFrames;
+    Input->Step = std::min(std::max(Input->Step, Input->NominalStep * (1.0 - MULTI_CAPTURE_MAX_DRIFT)),
+        Input->NominalStep * (1.0 + MULTI_CAPTURE_MAX_DRIFT));
+    if (Input->Resampler.Available(Input->Step) < _PacketFrames - Input->SilenceFrames)
+    {
+        if (!Late)
+        {
+            return false;
+        }
+
+        //
+        //  Stalled: it falls behind by a packet and gets resynced once its input comes in.
+        //
+        Input->SilenceFrames = _PacketFrames;
+        Input->Error = 0.0;
+    }
+    return true;
+}
+
+//
+//  A packet is ready once the reference has one and every other input can fill it, or has been waited on long enough.
+//
+bool CMultiCaptureSource::GetNextPacketSize(uint32_t* Frames)
+{
+    *Frames = 0;
+    ReadInputs();
+
+    Stream* reference = _Streams[0];
+    size_t available = reference->Resampler.Available(1.0);
+    if (available < _PacketFrames || !InputTime(reference, reference->Resampler.Position(), &_PacketTimeNs))
+    {
+        return true;
+    }
+    bool late = available >= _PacketFrames + _MaxWaitFrames;
+    for (size_t i = 1; i < _Streams.size(); i++)
+    {
+        if (!PlanStream(_Streams[i], _PacketTimeNs, late))
+        {
+            return true;
+        }
+    }
+    *Frames = _PacketFrames;
+    return true;
+}
+
+bool CMultiCaptureSource::GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition)
+{
+    const size_t stride = _MixFormat.Format.nChannels;
+    float* packet = &_Packet[0];
+    for (size_t i = 0; i < _Streams.size(); i++)
+    {
+        Stream* stream = _Streams[i];
+        float* output = packet + stream->FirstChannel;
+        size_t silence = i == 0 ? 0 : std::min<size_t>(stream->SilenceFrames, _PacketFrames);
+        size_t produced = silence + stream->Resampler.Pull(output + silence * stride, stride, _PacketFrames - silence, i == 0 ? 1.0 : stream->Step);
+
+        //
+        //  Silence before the resampled frames, and after them if the input came up short.
+        //
+        for (size_t frame = 0; frame < silence; frame++)
+        {
+            memset(output + frame * stride, 0, stream->Channels * sizeof(float));
+        }
+        for (size_t frame = produced; frame < _PacketFrames; frame++)
+        {
+            memset(output + frame * stride, 0, stream->Channels * sizeof(float));
+        }
+    }
+
+    *Data = reinterpret_cast<uint8_t*>(packet);
+    *Frames = _PacketFrames;
+    *Flags = 0;
+    if (DevicePosition != NULL)
+    {
+        *DevicePosition = _OutputFrames;
+    }
+    if (QPCPosition != NULL)
+    {
+        *QPCPosition = static_cast<uint64_t>(_PacketTimeNs / 100);
+    }
+    return true;
+}
+
+//
+//  The packet is out: feed its timing errors to the integrators and publish the inputs' statistics.
+//
+bool CMultiCaptureSource::ReleaseBuffer(uint32_t Frames)
+{
+    _OutputFrames += Frames;
+    for (size_t i = 1; i < _Streams.size(); i++)
+    {
+        Stream* stream = _Streams[i];
+        if (stream->Locked && stream->SilenceFrames == 0)
+        {
+            stream->Drift -= MULTI_CAPTURE_GAIN_I * stream->Error / (_PacketFrames * stream->NominalStep);
+            stream->Drift = std::min(std::max(stream->Drift, -MULTI_CAPTURE_MAX_DRIFT), MULTI_CAPTURE_MAX_DRIFT);
+            stream->MaxError = std::max(stream->MaxError, fabs(stream->Error));
+        }
+        stream->DriftPpb.store(static_cast<int64_t>(stream->Drift * 1e9), std::memory_order_relaxed);
+        stream->OffsetNs.store(static_cast<int64_t>(stream->Error * 1e9 / stream->SamplesPerSec), std::memory_order_relaxed);
+        stream->MaxOffsetNs.store(static_cast<int64_t>(stream->MaxError * 1e9 / stream->SamplesPerSec), std::memory_order_relaxed);
+        stream->SilenceTotal.fetch_add(stream->SilenceFrames, std::memory_order_relaxed);
+    }
+    return true;
+}
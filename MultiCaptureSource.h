@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <vector>
+#include "ClockedCaptureSource.h"
+#include "CapturePacketLog.h"
+#include "Resampler.h"
+
+//
+//  How one input of a multi source is doing.  The drift is its clock rate against the first input's, as compensated
+//  right now.  The offset is the capture time of the input at the start of the last packet minus the reference's,
+//  before the control loop corrected it.  A resync is a jump over input, or a wait on silence, when it was off by
+//  more than the loop corrects; silence frames are output frames it had nothing for.
+//
+struct MultiCaptureStreamStats
+{
+    double      DriftPpm;
+    double      OffsetUs;
+    double      MaxOffsetUs;    // Since the stream locked, or since its last resync.
+    uint64_t    Resyncs;
+    uint64_t    SilenceFrames;
+};
+
+//
+//  Records several capture sources at once as one multi channel stream, sample aligned.
+//
+//  Every input runs as it would on its own - its own capture thread, into its own ring and packet log - and delivers
+//  32 bit float, like the shared mode engines.  This source's capture thread reads them all and lays their channels
+//  side by side, the first input's first.  The first input is the reference clock: its frames go out unchanged, and
+//  each output frame takes its capture time.  Every other input goes through a CDriftResampler whose position is
+//  steered so the capture time of the input it interpolates matches that capture time, which lines up inputs that
+//  started at different times and, with a second order control loop on the timing error, follows their clocks' drift
+//  against the reference.  Capture times come from a clock model fitted to each input's packet times, so jittery
+//  timestamps don't reach the output.  An input that falls behind or stalls gets silence, then is resynced once it
+//  catches up.
+//
+//  The output packets carry the reference input's capture times, so everything downstream of the ring - time index,
+//  segments, framed streams - sees one ordinary source.  Capture times only mean something in real time, so every
+//  input must be paced by its device or the wall clock.
+//
+class CMultiCaptureSource : public CClockedCaptureSource
+{
+public:
+    CMultiCaptureSource();
+
+    //
+    //  Takes a reference to each of the Count initialized sources.  PacketFrames is the output packet size in frames
+    //  of the first source, which is also how often the control loop runs.
+    //
+    bool Initialize(ICaptureSource* const* Sources, size_t Count, UINT32 PacketFrames, SampleConvertKernel MaxKernel = SampleKernelAvx2);
+
+    bool Start(CCaptureRingBuffer* RingBuffer, const CaptureProcessing* Processing);
+    void Stop();
+    void Shutdown();
+
+    size_t SourceCount() const { return _Streams.size(); }
+    ICaptureSource* Source(size_t Index) { return _Streams[Index]->Source; }
+    WORD SourceChannels(size_t Index) const { return _Streams[Index]->Channels; }
+    void GetStreamStats(size_t Index, MultiCaptureStreamStats* Stats) const;
+
+    //
+    //  How far behind real time the output can fall waiting for a late input, in output frames.  It catches up in a
+    //  burst, which the ring has to have room for.
+    //
+    uint32_t MaxWaitFrames() const { return _MaxWaitFrames; }
+
+protected:
+    ~CMultiCaptureSource();
+
+    void OnStart();
+    bool GetNextPacketSize(uint32_t* Frames);
+    bool GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition);
+    bool ReleaseBuffer(uint32_t Frames);
+
+private:
+    struct Stream
+    {
+        ICaptureSource*         Source;
+        WORD                    Channels;
+        DWORD                   SamplesPerSec;
+        WORD                    FirstChannel;       // In the output frame.
+        CCaptureRingBuffer      RingBuffer;
+        CCapturePacketLog       PacketLog;
+        CaptureProcessing       Processing;
+        CDriftResampler         Resampler;
+
+        //
+        //  Capture thread of the multi source only.  PacketRecord covers the last input frame whose time was looked up;
+        //  the clock model puts input frame ClockFrame at ClockTimeNs, and FrameNs apart.
+        //
+        CapturePacketRecord     PacketRecord;
+        bool                    HaveRecord;
+        bool                    HaveClock;
+        uint64_t                ClockFrame;
+        double                  ClockTimeNs;
+        double                  FrameNs;
+        bool                    Locked;
+        double                  NominalStep;        // Input frames per output frame if both clocks were exact.
+        double                  Drift;              // Integral term: the relative clock rate error.
+        double                  Error;              // This packet's timing error, in input frames.
+        double                  Step;               // This packet's step.
+        uint32_t                SilenceFrames;      // This packet's frames of silence before the resampled ones.
+        double                  MaxError;
+
+        std::atomic<int64_t>    DriftPpb;
+        std::atomic<int64_t>    OffsetNs;
+        std::atomic<int64_t>    MaxOffsetNs;
+        std::atomic<uint64_t>   Resyncs;
+        std::atomic<uint64_t>   SilenceTotal;
+    };
+
+    void StopSources();
+    void ReadInputs();
+    void UpdateClock(Stream* Input, const CapturePacketRecord& Record);
+    bool InputTime(Stream* Input, double Position, int64_t* TimeNs);
+    bool PlanStream(Stream* Input, int64_t TimeNs, bool Late);
+
+    std::vector<Stream*>    _Streams;
+    UINT32                  _PacketFrames;
+    uint32_t                _MaxWaitFrames;     // Reference backlog after which a late input gets silence.
+    std::vector<float>      _Packet;
+    int64_t                 _PacketTimeNs;      // Capture time of the packet's first frame.
+    uint64_t                _OutputFrames;
+};
@@ -0,0 +1,664 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <chrono>
+#include <opus_multistream.h>
+#include "ChannelRemix.h"
+#include "OpusFileSink.h"
+
+//
+//  Ogg header type flags.
+//
+#define OGG_PAGE_FIRST  0x02
+#define OGG_PAGE_LAST   0x04
+
+//
+//  A page is finished once it covers this much audio (48 kHz samples), or its segment table is full.
+//
+#define OGG_PAGE_DURATION   48000
+#define OGG_MAX_SEGMENTS    255
+
+//
+//  Largest packet a multistream encoder can produce for 8 channels of 60 ms.
+//
+#define OPUS_MAX_PACKET_SIZE    (8 * 3 * 1275 + 7 * 2)
+
+//
+//  Input handed to the encoder thread: blocks of this many ms, and at most this many of them in flight.
+//
+#define OPUS_HANDOFF_BLOCK_MS   20
+#define OPUS_HANDOFF_BLOCKS     8
+
+//
+//  Built once, by whichever encoder thread gets there first.
+//
+struct OggCrcTable
+{
+    uint32_t    Table[256];
+
+    OggCrcTable()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t crc = i << 24;
+            for (int bit = 0; bit < 8; bit++)
+            {
+                crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : crc << 1;
+            }
+            Table[i] = crc;
+        }
+    }
+};
+
+static uint32_t OggCrc(uint32_t Crc, const uint8_t* Data, size_t Size)
+{
+    static const OggCrcTable crcTable;
+    for (size_t i = 0; i < Size; i++)
+    {
+        Crc = (Crc << 8) ^ crcTable.Table[(Crc >> 24) ^ Data[i]];
+    }
+    return Crc;
+}
+
+static void PutLE(std::vector<uint8_t>* Output, uint64_t Value, int Bytes)
+{
+    for (int i = 0; i < Bytes; i++)
+    {
+        Output->push_back(static_cast<uint8_t>(Value >> (8 * i)));
+    }
+}
+
+COpusFileSink::COpusFileSink() :
+    _Encoder(NULL),
+    _SampleFormat(OpusSampleFloat32),
+    _Channels(0),
+    _BytesPerFrame(0),
+    _BytesPerSample(0),
+    _InputRate(0),
+    _EncoderRate(0),
+    _FrameSize(0),
+    _PreSkip(0),
+    _Resample(false),
+    _ResampleBlockFrames(0),
+    _ResampleFill(0),
+    _ResamplerDelay(0),
+    _PartialBytes(0),
+    _FrameFill(0),
+    _InputFrames(0),
+    _InputSamples(0),
+    _PacketEnd(0),
+    _Finishing(false),
+    _StreamSerial(0),
+    _PageSequence(0),
+    _PageStart(0),
+    _PagePackets(0),
+    _PendingBytes(0),
+    _NextSubmit(0),
+    _NextEncode(0),
+    _Stopping(false),
+    _Failed(false),
+    _PacketsEncoded(0),
+    _InputBytes(0),
+    _OutputBytes(0),
+    _EncodeTimeUs(0),
+    _WriterWaitUs(0)
+{
+}
+
+COpusFileSink::~COpusFileSink()
+{
+    Close();
+    if (_Encoder != NULL)
+    {
+        opus_multistream_encoder_destroy(_Encoder);
+    }
+}
+
+bool COpusFileSink::Open(const std::string& FileName, const WAVEFORMATEX* Format, uint32_t BitRate, uint32_t FrameMs)
+{
+    if (IsFloatFormat(Format) && Format->wBitsPerSample == 32)
+    {
+        _SampleFormat = OpusSampleFloat32;
+    }
+    else if (EffectiveFormatTag(Format) == WAVE_FORMAT_PCM && Format->wBitsPerSample == 16)
+    {
+        _SampleFormat = OpusSampleInt16;
+    }
+    else if (EffectiveFormatTag(Format) == WAVE_FORMAT_PCM && Format->wBitsPerSample == 24)
+    {
+        _SampleFormat = OpusSampleInt24;
+    }
+    else if (EffectiveFormatTag(Format) == WAVE_FORMAT_PCM && Format->wBitsPerSample == 32)
+    {
+        _SampleFormat = OpusSampleInt32;
+    }
+    else
+    {
+        fprintf(stderr, "Unsupported Opus input format: tag %u, %u bits.\n", EffectiveFormatTag(Format), Format->wBitsPerSample);
+        return false;
+    }
+    if (Format->nChannels == 0 || Format->nChannels > 8 || Format->nSamplesPerSec == 0 ||
+        Format->nBlockAlign != Format->nChannels * Format->wBitsPerSample / 8)
+    {
+        fprintf(stderr, "Opus output supports 1 to 8 channels.\n");
+        return false;
+    }
+    if (FrameMs != 5 && FrameMs != 10 && FrameMs != 20 && FrameMs != 40 && FrameMs != 60)
+    {
+        fprintf(stderr, "Opus frames are 5, 10, 20, 40 or 60 ms.\n");
+        return false;
+    }
+
+    _Channels = Format->nChannels;
+    _BytesPerFrame = Format->nBlockAlign;
+    _BytesPerSample = Format->wBitsPerSample / 8;
+    _InputRate = Format->nSamplesPerSec;
+
+    _ChannelOrder.resize(_Channels);
+    BuildVorbisChannelOrder(Format, &_ChannelOrder[0]);
+    _CurrentFrame.assign(_Channels, 0.0f);
+
+    //
+    //  Opus takes 8, 12, 16, 24 and 48 kHz.  Anything else is resampled to 48 kHz.
+    //
+    _Resample = _InputRate != 8000 && _InputRate != 12000 && _InputRate != 16000 && _InputRate != 24000 && _InputRate != 48000;
+    _EncoderRate = _Resample ? 48000 : _InputRate;
+    _FrameSize = _EncoderRate / 1000 * FrameMs;
+    _ResampleBlockFrames = _InputRate / 100 != 0 ? _InputRate / 100 : 1;
+    _ResampleFill = 0;
+    _ResamplerDelay = 0;
+    if (_Resample)
+    {
+        WAVEFORMATEXTENSIBLE resamplerFormat;
+        InitializeWaveFormat(&resamplerFormat, true, static_cast<WORD>(_Channels), _InputRate, 32, 0);
+        if (!_Resampler.Initialize(&resamplerFormat.Format, _EncoderRate, ResamplerQualityMedium, _ResampleBlockFrames))
+        {
+            return false;
+        }
+        _ResampleBlock.assign(_ResampleBlockFrames * _Channels, 0.0f);
+        _ResamplerDelay = static_cast<uint32_t>(_Resampler.Delay() + 0.5);
+        fprintf(stderr, "Resampling %u Hz to %u Hz for Opus.\n", _InputRate, _EncoderRate);
+    }
+
+    int streams;
+    int coupledStreams;
+    uint8_t mapping[8];
+    int error;
+    _Encoder = opus_multistream_surround_encoder_create(_EncoderRate, _Channels, _Channels > 2 ? 1 : 0, &streams,
+        &coupledStreams, mapping, OPUS_APPLICATION_AUDIO, &error);
+    if (_Encoder == NULL)
+    {
+        fprintf(stderr, "Unable to create Opus encoder: %s\n", opus_strerror(error));
+        return false;
+    }
+    if (BitRate != 0 && opus_multistream_encoder_ctl(_Encoder, OPUS_SET_BITRATE(static_cast<opus_int32>(BitRate))) != OPUS_OK)
+    {
+        fprintf(stderr, "Unsupported Opus bit rate: %u\n", BitRate);
+        return false;
+    }
+    opus_int32 lookahead = 0;
+    opus_multistream_encoder_ctl(_Encoder, OPUS_GET_LOOKAHEAD(&lookahead));
+    _PreSkip = (static_cast<uint32_t>(lookahead) + _ResamplerDelay) * (48000 / _EncoderRate);
+
+    _PartialFrame.assign(_BytesPerFrame, 0);
+    _PartialBytes = 0;
+    _FrameBuffer.assign(static_cast<size_t>(_FrameSize) * _Channels, 0.0f);
+    _FrameFill = 0;
+    _Packet.resize(OPUS_MAX_PACKET_SIZE);
+    _InputFrames = 0;
+    _InputSamples = 0;
+    _PacketEnd = 0;
+    _Finishing = false;
+
+    size_t blockFrames = _InputRate / (1000 / OPUS_HANDOFF_BLOCK_MS) != 0 ? _InputRate / (1000 / OPUS_HANDOFF_BLOCK_MS) : 1;
+    _PendingInput.assign(blockFrames * _BytesPerFrame, 0);
+    _PendingBytes = 0;
+    _Blocks.resize(OPUS_HANDOFF_BLOCKS);
+    for (size_t i = 0; i < _Blocks.size(); i++)
+    {
+        _Blocks[i].Data.assign(_PendingInput.size(), 0);
+        _Blocks[i].Size = 0;
+    }
+    _NextSubmit = 0;
+    _NextEncode = 0;
+
+    _StreamSerial = static_cast<uint32_t>(time(NULL)) ^ static_cast<uint32_t>(reinterpret_cast<uintptr_t>(this));
+    _PageSequence = 0;
+    _PageSegments.clear();
+    _PageData.clear();
+    _PageStart = 0;
+    _PagePackets = 0;
+
+    if (!_File.Create(FileName))
+    {
+        fprintf(stderr, "Unable to create output Opus file: %d\n", COutputFile::LastError());
+        return false;
+    }
+
+    //
+    //  Identification and comment headers, each on a page of its own.
+    //
+    std::vector<uint8_t> header;
+    header.insert(header.end(), "OpusHead", "OpusHead" + 8);
+    header.push_back(1);
+    header.push_back(static_cast<uint8_t>(_Channels));
+    PutLE(&header, _PreSkip, 2);
+    PutLE(&header, _InputRate, 4);
+    PutLE(&header, 0, 2);
+    header.push_back(_Channels > 2 ? 1 : 0);
+    if (_Channels > 2)
+    {
+        header.push_back(static_cast<uint8_t>(streams));
+        header.push_back(static_cast<uint8_t>(coupledStreams));
+        header.insert(header.end(), mapping, mapping + _Channels);
+    }
+    if (!AddPacket(&header[0], header.size(), 0) || !WritePage(OGG_PAGE_FIRST))
+    {
+        return false;
+    }
+
+    const char* vendor = opus_get_version_string();
+    size_t vendorLength = strlen(vendor);
+    header.clear();
+    header.insert(header.end(), "OpusTags", "OpusTags" + 8);
+    PutLE(&header, vendorLength, 4);
+    header.insert(header.end(), vendor, vendor + vendorLength);
+    PutLE(&header, 0, 4);
+    if (!AddPacket(&header[0], header.size(), 0) || !WritePage(0))
+    {
+        return false;
+    }
+
+    _Stopping = false;
+    _Failed = false;
+    _EncoderThread = std::thread(&COpusFileSink::EncoderThread, this);
+    return true;
+}
+
+bool COpusFileSink::Write(const uint8_t* Data, size_t Size)
+{
+    _InputBytes += Size;
+    while (Size > 0)
+    {
+        size_t bytesToCopy = _PendingInput.size() - _PendingBytes;
+        if (bytesToCopy > Size)
+        {
+            bytesToCopy = Size;
+        }
+        memcpy(&_PendingInput[_PendingBytes], Data, bytesToCopy);
+        _PendingBytes += bytesToCopy;
+        Data += bytesToCopy;
+        Size -= bytesToCopy;
+
+        if (_PendingBytes == _PendingInput.size() && !SubmitBlock())
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool COpusFileSink::Flush()
+{
+    if (!WaitForEncoder())
+    {
+        return false;
+    }
+
+    //
+    //  The encoder thread is idle until the next block is handed to it.
+    //
+    if (_PagePackets != 0 && !WritePage(0))
+    {
+        return false;
+    }
+    return _File.Flush();
+}
+
+bool COpusFileSink::Close()
+{
+    if (!_File.IsOpen())
+    {
+        StopEncoder();
+        return true;
+    }
+    bool encoded = WaitForEncoder();
+    StopEncoder();
+    if (!encoded)
+    {
+        _File.Close();
+        return false;
+    }
+
+    //
+    //  Push the last partial block and then silence through the resampler until its delay has come out, pad the last
+    //  frame with silence, and keep encoding silence until the encoder's lookahead has been pushed out.  The last page
+    //  ends exactly at the end of the real audio; decoders drop the rest.  Nothing else may end a page on the way, as
+    //  a page's granule position past the end of the stream is only allowed on the last one.
+    //
+    uint64_t audioEnd = (_InputFrames * 48000 + _InputRate / 2) / _InputRate;
+    uint64_t streamEnd = _PreSkip + audioEnd;
+    _Finishing = true;
+    bool succeeded = true;
+    if (_Resample)
+    {
+        succeeded = ResampleBlock(&_ResampleBlock[0], _ResampleFill);
+        _ResampleFill = 0;
+        while (succeeded && _InputSamples < audioEnd + _ResamplerDelay)
+        {
+            succeeded = ResampleBlock(NULL, _ResampleBlockFrames);
+        }
+    }
+    while (succeeded && (_FrameFill != 0 || _PacketEnd < streamEnd || _PagePackets == 0))
+    {
+        memset(&_FrameBuffer[static_cast<size_t>(_FrameFill) * _Channels], 0,
+            static_cast<size_t>(_FrameSize - _FrameFill) * _Channels * sizeof(float));
+        _FrameFill = _FrameSize;
+        succeeded = EncodeFrame();
+    }
+    if (succeeded)
+    {
+        _PacketEnd = streamEnd;
+        succeeded = WritePage(OGG_PAGE_LAST);
+    }
+    if (!succeeded)
+    {
+        fprintf(stderr, "Unable to finish Opus file: %d\n", COutputFile::LastError());
+    }
+    _File.Close();
+    return succeeded;
+}
+
+void COpusFileSink::GetStats(OpusEncoderStats* Stats) const
+{
+    Stats->PacketsEncoded = _PacketsEncoded;
+    Stats->SamplesEncoded = _PacketsEncoded * _FrameSize;
+    Stats->EncoderRate = _EncoderRate;
+    Stats->InputBytes = _InputBytes;
+    Stats->OutputBytes = _OutputBytes;
+    Stats->EncodeTimeUs = _EncodeTimeUs;
+    Stats->WriterWaitUs = _WriterWaitUs;
+}
+
+void COpusFileSink::EncoderThread()
+{
+    std::unique_lock<std::mutex> lock(_Lock);
+    for (;;)
+    {
+        _BlockAvailable.wait(lock, [this]() { return _Stopping || _NextEncode < _NextSubmit; });
+        if (_NextEncode == _NextSubmit)
+        {
+            return;
+        }
+        OpusBlock& block = _Blocks[_NextEncode % _Blocks.size()];
+        bool failed = _Failed;
+        lock.unlock();
+
+        //
+        //  The writer thread doesn't touch a submitted block until it is done, nor the encoder's state while blocks
+        //  are in flight.
+        //
+        bool succeeded = failed || EncodeBytes(&block.Data[0], block.Size);
+
+        lock.lock();
+        _Failed = _Failed || !succeeded;
+        _NextEncode++;
+        _BlockDone.notify_all();
+    }
+}
+
+//
+//  Hand the pending block to the encoder thread, waiting for a free slot if they are all in flight.
+//
+bool COpusFileSink::SubmitBlock()
+{
+    std::unique_lock<std::mutex> lock(_Lock);
+    if (_NextSubmit - _NextEncode == _Blocks.size())
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        _BlockDone.wait(lock, [this]() { return _NextSubmit - _NextEncode < _Blocks.size(); });
+        _WriterWaitUs += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    if (_Failed)
+    {
+        return false;
+    }
+
+    OpusBlock& block = _Blocks[_NextSubmit % _Blocks.size()];
+    block.Data.swap(_PendingInput);
+    block.Size = _PendingBytes;
+    _PendingBytes = 0;
+    _NextSubmit++;
+    _BlockAvailable.notify_one();
+    return true;
+}
+
+//
+//  Hand over what Write() has gathered so far and wait until the encoder thread has been through all of it.
+//
+bool COpusFileSink::WaitForEncoder()
+{
+    if (_PendingBytes != 0 && !SubmitBlock())
+    {
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(_Lock);
+    if (_NextEncode != _NextSubmit)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        _BlockDone.wait(lock, [this]() { return _NextEncode == _NextSubmit; });
+        _WriterWaitUs += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count());
+    }
+    return !_Failed;
+}
+
+void COpusFileSink::StopEncoder()
+{
+    {
+        std::lock_guard<std::mutex> lock(_Lock);
+        _Stopping = true;
+    }
+    _BlockAvailable.notify_all();
+    if (_EncoderThread.joinable())
+    {
+        _EncoderThread.join();
+    }
+}
+
+//
+//  Runs on the encoder thread.
+//
+bool COpusFileSink::EncodeBytes(const uint8_t* Data, size_t Size)
+{
+    if (_PartialBytes != 0)
+    {
+        size_t bytesToCopy = _BytesPerFrame - _PartialBytes;
+        if (bytesToCopy > Size)
+        {
+            bytesToCopy = Size;
+        }
+        memcpy(&_PartialFrame[_PartialBytes], Data, bytesToCopy);
+        _PartialBytes += bytesToCopy;
+        Data += bytesToCopy;
+        Size -= bytesToCopy;
+        if (_PartialBytes < _BytesPerFrame)
+        {
+            return true;
+        }
+        _PartialBytes = 0;
+        if (!ProcessFrame(&_PartialFrame[0]))
+        {
+            return false;
+        }
+    }
+
+    for (; Size >= _BytesPerFrame; Data += _BytesPerFrame, Size -= _BytesPerFrame)
+    {
+        if (!ProcessFrame(Data))
+        {
+            return false;
+        }
+    }
+
+    memcpy(&_PartialFrame[0], Data, Size);
+    _PartialBytes = Size;
+    return true;
+}
+
+float COpusFileSink::ReadSample(const uint8_t* Sample) const
+{
+    switch (_SampleFormat)
+    {
+    case OpusSampleFloat32:
+        {
+            float value;
+            memcpy(&value, Sample, sizeof(value));
+            return value;
+        }
+    case OpusSampleInt16:
+        return static_cast<int16_t>(Sample[0] | (Sample[1] << 8)) * (1.0f / 32768.0f);
+    case OpusSampleInt24:
+        return (static_cast<int32_t>(static_cast<uint32_t>(Sample[0] << 8 | Sample[1] << 16 | Sample[2] << 24)) >> 8) * (1.0f / 8388608.0f);
+    case OpusSampleInt32:
+        {
+            int32_t value;
+            memcpy(&value, Sample, sizeof(value));
+            return value * (1.0f / 2147483648.0f);
+        }
+    }
+    return 0.0f;
+}
+
+bool COpusFileSink::ProcessFrame(const uint8_t* Frame)
+{
+    _InputFrames++;
+    float* sample = _Resample ? &_ResampleBlock[_ResampleFill * _Channels] : &_CurrentFrame[0];
+    for (uint32_t channel = 0; channel < _Channels; channel++)
+    {
+        sample[channel] = ReadSample(Frame + _ChannelOrder[channel] * _BytesPerSample);
+    }
+    if (!_Resample)
+    {
+        return PushFrame(&_CurrentFrame[0]);
+    }
+    if (++_ResampleFill < _ResampleBlockFrames)
+    {
+        return true;
+    }
+    _ResampleFill = 0;
+    return ResampleBlock(&_ResampleBlock[0], _ResampleBlockFrames);
+}
+
+//
+//  Resample a block of input frames (NULL for silence) and hand the result to the encoder.
+//
+bool COpusFileSink::ResampleBlock(const float* Input, size_t Frames)
+{
+    if (Frames == 0)
+    {
+        return true;
+    }
+    size_t outputFrames;
+    const float* output = _Resampler.Process(Input, Frames, &outputFrames);
+    for (size_t frame = 0; frame < outputFrames; frame++)
+    {
+        if (!PushFrame(output + frame * _Channels))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool COpusFileSink::PushFrame(const float* Frame)
+{
+    memcpy(&_FrameBuffer[static_cast<size_t>(_FrameFill) * _Channels], Frame, _Channels * sizeof(float));
+    _InputSamples++;
+    if (++_FrameFill < _FrameSize)
+    {
+        return true;
+    }
+    return EncodeFrame();
+}
+
+bool COpusFileSink::EncodeFrame()
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    opus_int32 packetSize = opus_multistream_encode_float(_Encoder, &_FrameBuffer[0], static_cast<int>(_FrameSize),
+        &_Packet[0], static_cast<opus_int32>(_Packet.size()));
+    _EncodeTimeUs += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count());
+    _FrameFill = 0;
+    if (packetSize < 0)
+    {
+        fprintf(stderr, "Opus encoding failed: %s\n", opus_strerror(packetSize));
+        return false;
+    }
+
+    _PacketsEncoded++;
+    return AddPacket(&_Packet[0], static_cast<size_t>(packetSize), static_cast<uint64_t>(_FrameSize) * (48000 / _EncoderRate));
+}
+
+//
+//  Append a packet of Duration samples at 48 kHz to the page being assembled, starting a new page first if the
+//  segment table can't take it.  That page ends where the packets already on it do.
+//
+bool COpusFileSink::AddPacket(const uint8_t* Packet, size_t Size, uint64_t Duration)
+{
+    size_t segmentCount = Size / 255 + 1;
+    if (_PageSegments.size() + segmentCount > OGG_MAX_SEGMENTS && !WritePage(0))
+    {
+        return false;
+    }
+
+    for (size_t i = 0; i < segmentCount - 1; i++)
+    {
+        _PageSegments.push_back(255);
+    }
+    _PageSegments.push_back(static_cast<uint8_t>(Size % 255));
+    _PageData.insert(_PageData.end(), Packet, Packet + Size);
+    _PagePackets++;
+    _PacketEnd += Duration;
+
+    if (!_Finishing && _PacketEnd - _PageStart >= OGG_PAGE_DURATION)
+    {
+        return WritePage(0);
+    }
+    return true;
+}
+
+bool COpusFileSink::WritePage(uint8_t Flags)
+{
+    std::vector<uint8_t> header;
+    header.insert(header.end(), "OggS", "OggS" + 4);
+    header.push_back(0);
+    header.push_back(Flags);
+    PutLE(&header, _PacketEnd, 8);
+    PutLE(&header, _StreamSerial, 4);
+    PutLE(&header, _PageSequence, 4);
+    PutLE(&header, 0, 4);
+    header.push_back(static_cast<uint8_t>(_PageSegments.size()));
+    header.insert(header.end(), _PageSegments.begin(), _PageSegments.end());
+
+    uint32_t crc = OggCrc(0, &header[0], header.size());
+    crc = OggCrc(crc, _PageData.empty() ? NULL : &_PageData[0], _PageData.size());
+    for (int i = 0; i < 4; i++)
+    {
+        header[22 + i] = static_cast<uint8_t>(crc >> (8 * i));
+    }
+
+    if (!_File.Write(&header[0], header.size()) || (!_PageData.empty() && !_File.Write(&_PageData[0], _PageData.size())))
+    {
+        fprintf(stderr, "Unable to write Opus data: %d\n", COutputFile::LastError());
+        return false;
+    }
+    _OutputBytes += header.size() + _PageData.size();
+    _PageSequence++;
+    _PageSegments.clear();
+    _PageData.clear();
+    _PageStart = _PacketEnd;
+    _PagePackets = 0;
+    return true;
+}
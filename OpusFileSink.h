@@ -0,0 +1,160 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "OutputSink.h"
+#include "Resampler.h"
+
+struct OpusMSEncoder;
+
+//
+//  Encoder statistics.  Samples are per channel at the encoder rate; EncodeTimeUs / (SamplesEncoded / EncoderRate)
+//  is the real-time factor.  WriterWaitUs is how long Write() and Flush() held up the writer thread waiting for the
+//  encoder thread.
+//
+struct OpusEncoderStats
+{
+    uint64_t PacketsEncoded;
+    uint64_t SamplesEncoded;
+    uint32_t EncoderRate;
+    uint64_t InputBytes;
+    uint64_t OutputBytes;
+    uint64_t EncodeTimeUs;
+    uint64_t WriterWaitUs;
+};
+
+//
+//  Opus in Ogg (RFC 7845).
+//
+//  Write() only gathers the byte stream into 20 ms blocks and hands them to an encoder thread of the sink's own,
+//  so the writer thread is not held up by encoding and the sinks after this one get their data on time.  At most
+//  OPUS_HANDOFF_BLOCKS blocks are in flight; Write() waits for the encoder thread only once they are all taken.
+//  The encoder thread converts the blocks to float, resamples them with CResampler when the mix rate is not one Opus
+//  takes, and encodes them a frame at a time.  Up to 8 channels are encoded with the Vorbis channel layouts (mapping
+//  family 1), so more than two are reordered from WAVE order to Vorbis order on the way in.  Packets are collected
+//  into Ogg pages; a page goes out once it covers about a second of audio.  Flush() waits for the blocks in flight,
+//  like CFlacFileSink's, and ends the page in progress so the file on disk is always a playable stream.
+//
+class COpusFileSink : public IOutputSink
+{
+public:
+    COpusFileSink();
+    ~COpusFileSink();
+
+    bool Open(const std::string& FileName, const WAVEFORMATEX* Format, uint32_t BitRate, uint32_t FrameMs);
+    bool Write(const uint8_t* Data, size_t Size);
+    bool Flush();
+    bool Close();
+
+    //
+    //  Only meaningful once Close() has returned.
+    //
+    void GetStats(OpusEncoderStats* Stats) const;
+
+private:
+    enum OpusSampleFormat
+    {
+        OpusSampleFloat32,
+        OpusSampleInt16,
+        OpusSampleInt24,
+        OpusSampleInt32,
+    };
+
+    struct OpusBlock
+    {
+        std::vector<uint8_t>    Data;
+        size_t                  Size;
+    };
+
+    void EncoderThread();
+    bool SubmitBlock();
+    bool WaitForEncoder();
+    void StopEncoder();
+    bool EncodeBytes(const uint8_t* Data, size_t Size);
+    float ReadSample(const uint8_t* Sample) const;
+    bool ProcessFrame(const uint8_t* Frame);
+    bool ResampleBlock(const float* Input, size_t Frames);
+    bool PushFrame(const float* Frame);
+    bool EncodeFrame();
+    bool AddPacket(const uint8_t* Packet, size_t Size, uint64_t Duration);
+    bool WritePage(uint8_t Flags);
+
+    COutputFile             _File;
+    OpusMSEncoder*          _Encoder;
+    OpusSampleFormat        _SampleFormat;
+    uint32_t                _Channels;
+    uint32_t                _BytesPerFrame;
+    uint32_t                _BytesPerSample;
+    uint32_t                _InputRate;
+    uint32_t                _EncoderRate;
+    uint32_t                _FrameSize;         // Per channel, at the encoder rate.
+    uint32_t                _PreSkip;           // At 48 kHz, like granule positions.
+
+    //
+    //  Input channel of each Vorbis channel position.
+    //
+    std::vector<uint32_t>   _ChannelOrder;
+    std::vector<float>      _CurrentFrame;
+
+    //
+    //  Input frames are gathered into blocks of 10 ms for the resampler.  The encoder's input lags by
+    //  _ResamplerDelay samples, which the pre-skip covers.
+    //
+    bool                    _Resample;
+    CResampler              _Resampler;
+    std::vector<float>      _ResampleBlock;
+    size_t                  _ResampleBlockFrames;
+    size_t                  _ResampleFill;
+    uint32_t                _ResamplerDelay;
+
+    //
+    //  Bytes of an incomplete input frame, and the frame being gathered for the encoder.
+    //
+    std::vector<uint8_t>    _PartialFrame;
+    size_t                  _PartialBytes;
+    std::vector<float>      _FrameBuffer;
+    uint32_t                _FrameFill;
+    std::vector<uint8_t>    _Packet;
+    uint64_t                _InputFrames;       // Real audio, per channel at the input rate.
+    uint64_t                _InputSamples;      // Handed to the encoder, per channel at the encoder rate.
+    uint64_t                _PacketEnd;         // Granule position at the end of the last packet.
+    bool                    _Finishing;         // Close() is padding the stream out; only it ends the last page.
+
+    //
+    //  Ogg page being assembled.  Packets never span pages.
+    //
+    uint32_t                _StreamSerial;
+    uint32_t                _PageSequence;
+    std::vector<uint8_t>    _PageSegments;
+    std::vector<uint8_t>    _PageData;
+    uint64_t                _PageStart;         // Granule position at the start of the page.
+    uint32_t                _PagePackets;
+
+    //
+    //  Block being filled by Write(), and the blocks handed to the encoder thread, indexed by their number modulo
+    //  their count.  Blocks [_NextEncode, _NextSubmit) are waiting or being encoded.  _Failed is set by the encoder
+    //  thread once encoding or writing failed; it then drops whatever it is handed.
+    //
+    std::vector<uint8_t>    _PendingInput;
+    size_t                  _PendingBytes;
+    std::vector<OpusBlock>  _Blocks;
+    uint64_t                _NextSubmit;
+    uint64_t                _NextEncode;
+    bool                    _Stopping;
+    bool                    _Failed;
+    std::mutex              _Lock;
+    std::condition_variable _BlockAvailable;
+    std::condition_variable _BlockDone;
+    std::thread             _EncoderThread;
+
+    uint64_t                _PacketsEncoded;
+    uint64_t                _InputBytes;
+    uint64_t                _OutputBytes;
+    uint64_t                _EncodeTimeUs;
+    uint64_t                _WriterWaitUs;
+};
@@ -0,0 +1,246 @@
+#include <errno.h>
+#include "OutputFile.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+COutputFile::COutputFile() :
+    _Handle(INVALID_HANDLE_VALUE),
+    _Unbuffered(false)
+{
+}
+
+bool COutputFile::Create(const std::string& FileName, int Flags)
+{
+    Close();
+    _Unbuffered = (Flags & OutputFileUnbuffered) != 0;
+    _Handle = CreateFileA(
+        FileName.c_str(),
+        GENERIC_WRITE,
+        0,
+        NULL,
+        CREATE_ALWAYS,
+        _Unbuffered ? FILE_ATTRIBUTE_NORMAL | FILE_FLAG_NO_BUFFERING : FILE_ATTRIBUTE_NORMAL,
+        NULL
+    );
+    return _Handle != INVALID_HANDLE_VALUE;
+}
+
+bool COutputFile::Write(const void* Buffer, size_t BufferSize)
+{
+    const BYTE* data = static_cast<const BYTE*>(Buffer);
+    while (BufferSize > 0)
+    {
+        //
+        //  WriteFile takes a DWORD length, so very large buffers go out in pieces.
+        //
+        DWORD bytesToWrite = BufferSize > 0x40000000 ? 0x40000000 : static_cast<DWORD>(BufferSize);
+        DWORD bytesWritten;
+        if (!WriteFile(_Handle, data, bytesToWrite, &bytesWritten, NULL) || bytesWritten == 0)
+        {
+            return false;
+        }
+        data += bytesWritten;
+        BufferSize -= bytesWritten;
+    }
+    return true;
+}
+
+bool COutputFile::WriteAt(const void* Buffer, size_t BufferSize, uint64_t Offset)
+{
+    const BYTE* data = static_cast<const BYTE*>(Buffer);
+    while (BufferSize > 0)
+    {
+        DWORD bytesToWrite = BufferSize > 0x40000000 ? 0x40000000 : static_cast<DWORD>(BufferSize);
+        DWORD bytesWritten;
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>(Offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(Offset >> 32);
+        if (!WriteFile(_Handle, data, bytesToWrite, &bytesWritten, &overlapped) || bytesWritten == 0)
+        {
+            return false;
+        }
+        data += bytesWritten;
+        Offset += bytesWritten;
+        BufferSize -= bytesWritten;
+    }
+    return true;
+}
+
+bool COutputFile::Flush()
+{
+    return FlushFileBuffers(_Handle) != FALSE;
+}
+
+//
+//  Setting the allocation size reserves the clusters without moving end of file.  We don't use SetFileValidData: it
+//  needs SE_MANAGE_VOLUME_NAME and exposes stale disk contents, and appending at the valid data length never triggers
+//  zero filling anyway.
+//
+bool COutputFile::Preallocate(uint64_t Size)
+{
+    FILE_ALLOCATION_INFO allocationInfo;
+    allocationInfo.AllocationSize.QuadPart = static_cast<LONGLONG>(Size);
+    return SetFileInformationByHandle(_Handle, FileAllocationInfo, &allocationInfo, sizeof(allocationInfo)) != FALSE;
+}
+
+bool COutputFile::SetLength(uint64_t Size)
+{
+    FILE_END_OF_FILE_INFO endOfFileInfo;
+    endOfFileInfo.EndOfFile.QuadPart = static_cast<LONGLONG>(Size);
+    return SetFileInformationByHandle(_Handle, FileEndOfFileInfo, &endOfFileInfo, sizeof(endOfFileInfo)) != FALSE;
+}
+
+void COutputFile::Close()
+{
+    if (_Handle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(_Handle);
+        _Handle = INVALID_HANDLE_VALUE;
+    }
+}
+
+bool COutputFile::IsOpen() const
+{
+    return _Handle != INVALID_HANDLE_VALUE;
+}
+
+int COutputFile::LastError()
+{
+    return static_cast<int>(GetLastError());
+}
+
+#else
+
+COutputFile::COutputFile() :
+    _Fd(-1),
+    _Unbuffered(false)
+{
+}
+
+bool COutputFile::Create(const std::string& FileName, int Flags)
+{
+    Close();
+    _Unbuffered = false;
+#ifdef O_DIRECT
+    if ((Flags & OutputFileUnbuffered) != 0)
+    {
+        _Fd = open(FileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC | O_DIRECT, 0644);
+        if (_Fd >= 0)
+        {
+            _Unbuffered = true;
+            return true;
+        }
+        if (errno != EINVAL)
+        {
+            return false;
+        }
+
+        //
+        //  tmpfs and some network file systems don't do O_DIRECT.
+        //
+    }
+#else
+    (void)Flags;
+#endif
+    _Fd = open(FileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    return _Fd >= 0;
+}
+
+bool COutputFile::Write(const void* Buffer, size_t BufferSize)
+{
+    const uint8_t* data = static_cast<const uint8_t*>(Buffer);
+    while (BufferSize > 0)
+    {
+        ssize_t bytesWritten = write(_Fd, data, BufferSize);
+        if (bytesWritten < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += bytesWritten;
+        BufferSize -= static_cast<size_t>(bytesWritten);
+    }
+    return true;
+}
+
+bool COutputFile::WriteAt(const void* Buffer, size_t BufferSize, uint64_t Offset)
+{
+    const uint8_t* data = static_cast<const uint8_t*>(Buffer);
+    while (BufferSize > 0)
+    {
+        ssize_t bytesWritten = pwrite(_Fd, data, BufferSize, static_cast<off_t>(Offset));
+        if (bytesWritten < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return false;
+        }
+        data += bytesWritten;
+        Offset += static_cast<uint64_t>(bytesWritten);
+        BufferSize -= static_cast<size_t>(bytesWritten);
+    }
+    return true;
+}
+
+bool COutputFile::Flush()
+{
+    return fsync(_Fd) == 0;
+}
+
+bool COutputFile::Preallocate(uint64_t Size)
+{
+#ifdef __linux__
+    int result;
+    do
+    {
+        result = fallocate(_Fd, FALLOC_FL_KEEP_SIZE, 0, static_cast<off_t>(Size));
+    } while (result != 0 && errno == EINTR);
+    return result == 0;
+#else
+    (void)Size;
+    errno = ENOTSUP;
+    return false;
+#endif
+}
+
+bool COutputFile::SetLength(uint64_t Size)
+{
+    return ftruncate(_Fd, static_cast<off_t>(Size)) == 0;
+}
+
+void COutputFile::Close()
+{
+    if (_Fd >= 0)
+    {
+        close(_Fd);
+        _Fd = -1;
+    }
+}
+
+bool COutputFile::IsOpen() const
+{
+    return _Fd >= 0;
+}
+
+int COutputFile::LastError()
+{
+    return errno;
+}
+
+#endif
+
+COutputFile::~COutputFile()
+{
+    Close();
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "AudioFormat.h"
+
+//
+//  Unbuffered files bypass the OS cache (FILE_FLAG_NO_BUFFERING / O_DIRECT).  Their buffers, offsets and lengths must
+//  be multiples of OUTPUT_FILE_ALIGNMENT, which covers both 512 byte and 4K sector devices.
+//
+enum OutputFileFlags
+{
+    OutputFileBuffered = 0,
+    OutputFileUnbuffered = 1,
+};
+
+#define OUTPUT_FILE_ALIGNMENT 4096
+
+//
+//  Output file used by the writer paths.  A thin wrapper over a Win32 file HANDLE or a POSIX file descriptor.
+//
+class COutputFile
+{
+public:
+    COutputFile();
+    ~COutputFile();
+
+    //
+    //  If the file system refuses unbuffered I/O the file is opened buffered instead; IsUnbuffered() tells which.
+    //
+    bool Create(const std::string& FileName, int Flags = OutputFileBuffered);
+    bool Write(const void* Buffer, size_t BufferSize);
+    bool WriteAt(const void* Buffer, size_t BufferSize, uint64_t Offset);
+    bool Flush();
+    void Close();
+    bool IsOpen() const;
+    bool IsUnbuffered() const { return _Unbuffered; }
+
+    //
+    //  Reserve disk space for the first Size bytes without changing the file length, and set the exact file length.
+    //
+    bool Preallocate(uint64_t Size);
+    bool SetLength(uint64_t Size);
+
+    //
+    //  The last OS error code (GetLastError() or errno).
+    //
+    static int LastError();
+
+private:
+    COutputFile(const COutputFile&);
+    COutputFile& operator=(const COutputFile&);
+
+#ifdef _WIN32
+    HANDLE  _Handle;
+#else
+    int     _Fd;
+#endif
+    bool    _Unbuffered;
+};
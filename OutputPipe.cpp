@@ -0,0 +1,266 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include "OutputPipe.h"
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//
+//  The original stdout after ReserveStdout(), or -1.
+//
+static int s_ReservedStdout = -1;
+
+#ifdef _WIN32
+
+COutputPipe::COutputPipe() :
+    _Handle(INVALID_HANDLE_VALUE),
+    _OwnsHandle(false),
+    _NonBlocking(false)
+{
+}
+
+bool COutputPipe::ReserveStdout()
+{
+    fflush(stdout);
+    s_ReservedStdout = _dup(_fileno(stdout));
+    if (s_ReservedStdout < 0 || _dup2(_fileno(stderr), _fileno(stdout)) != 0)
+    {
+        return false;
+    }
+    _setmode(s_ReservedStdout, _O_BINARY);
+    SetStdHandle(STD_OUTPUT_HANDLE, GetStdHandle(STD_ERROR_HANDLE));
+    return true;
+}
+
+bool COutputPipe::OpenStdout()
+{
+    Close();
+    _Handle = reinterpret_cast<HANDLE>(_get_osfhandle(s_ReservedStdout >= 0 ? s_ReservedStdout : _fileno(stdout)));
+    if (_Handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    _OwnsHandle = false;
+
+    //
+    //  Anonymous pipes take PIPE_NOWAIT too.  Files and consoles don't; writes to them simply block.
+    //
+    DWORD mode = PIPE_READMODE_BYTE | PIPE_NOWAIT;
+    _NonBlocking = GetFileType(_Handle) == FILE_TYPE_PIPE && SetNamedPipeHandleState(_Handle, &mode, NULL, NULL);
+    return true;
+}
+
+bool COutputPipe::CreateFifo(const std::string& Name)
+{
+    Close();
+    std::string pipeName = Name.compare(0, 9, "\\\\.\\pipe\\") == 0 ? Name : "\\\\.\\pipe\\" + Name;
+    _Handle = CreateNamedPipeA(pipeName.c_str(), PIPE_ACCESS_OUTBOUND | FILE_FLAG_FIRST_PIPE_INSTANCE,
+        PIPE_TYPE_BYTE | PIPE_NOWAIT | PIPE_REJECT_REMOTE_CLIENTS, 1, 1024 * 1024, 0, 0, NULL);
+    if (_Handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    _OwnsHandle = true;
+    _NonBlocking = true;
+
+    //
+    //  In PIPE_NOWAIT mode ConnectNamedPipe() only reports whether a client is there yet.
+    //
+    for (;;)
+    {
+        if (ConnectNamedPipe(_Handle, NULL) || GetLastError() == ERROR_PIPE_CONNECTED)
+        {
+            return true;
+        }
+        if (GetLastError() != ERROR_PIPE_LISTENING && GetLastError() != ERROR_NO_DATA)
+        {
+            Close();
+            return false;
+        }
+        Sleep(10);
+    }
+}
+
+ptrdiff_t COutputPipe::TryWrite(const void* Buffer, size_t Size)
+{
+    DWORD bytesToWrite = Size > 0x40000000 ? 0x40000000 : static_cast<DWORD>(Size);
+    DWORD bytesWritten = 0;
+    if (!WriteFile(_Handle, Buffer, bytesToWrite, &bytesWritten, NULL))
+    {
+        return -1;
+    }
+    return static_cast<ptrdiff_t>(bytesWritten);
+}
+
+//
+//  Pipes can't be waited on for room, so just give the reader a moment.
+//
+void COutputPipe::WaitWritable(int TimeoutMs)
+{
+    Sleep(TimeoutMs < 1 ? 0 : 1);
+}
+
+void COutputPipe::Close()
+{
+    if (_Handle != INVALID_HANDLE_VALUE && _OwnsHandle)
+    {
+        FlushFileBuffers(_Handle);
+        DisconnectNamedPipe(_Handle);
+        CloseHandle(_Handle);
+    }
+    _Handle = INVALID_HANDLE_VALUE;
+    _OwnsHandle = false;
+}
+
+bool COutputPipe::IsOpen() const
+{
+    return _Handle != INVALID_HANDLE_VALUE;
+}
+
+int COutputPipe::LastError()
+{
+    return static_cast<int>(GetLastError());
+}
+
+#else
+
+COutputPipe::COutputPipe() :
+    _Fd(-1),
+    _OriginalFlags(0),
+    _OwnsFd(false)
+{
+}
+
+bool COutputPipe::ReserveStdout()
+{
+    fflush(stdout);
+    s_ReservedStdout = dup(STDOUT_FILENO);
+    return s_ReservedStdout >= 0 && dup2(STDERR_FILENO, STDOUT_FILENO) >= 0;
+}
+
+bool COutputPipe::OpenStdout()
+{
+    Close();
+    _Fd = s_ReservedStdout >= 0 ? s_ReservedStdout : STDOUT_FILENO;
+    _OwnsFd = false;
+    _OriginalFlags = fcntl(_Fd, F_GETFL);
+    if (_OriginalFlags < 0 || fcntl(_Fd, F_SETFL, _OriginalFlags | O_NONBLOCK) != 0)
+    {
+        _Fd = -1;
+        return false;
+    }
+
+    //
+    //  A reader that goes away should fail the write with EPIPE, not kill the process.
+    //
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+}
+
+bool COutputPipe::CreateFifo(const std::string& Name)
+{
+    Close();
+    struct stat status;
+    if (stat(Name.c_str(), &status) == 0)
+    {
+        if (!S_ISFIFO(status.st_mode))
+        {
+            errno = EEXIST;
+            return false;
+        }
+    }
+    else if (mkfifo(Name.c_str(), 0644) != 0)
+    {
+        return false;
+    }
+
+    //
+    //  Opening the write end blocks until a reader opens the other one.
+    //
+    _Fd = open(Name.c_str(), O_WRONLY);
+    if (_Fd < 0)
+    {
+        return false;
+    }
+    _OwnsFd = true;
+    _OriginalFlags = fcntl(_Fd, F_GETFL);
+    if (_OriginalFlags < 0 || fcntl(_Fd, F_SETFL, _OriginalFlags | O_NONBLOCK) != 0)
+    {
+        Close();
+        return false;
+    }
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+}
+
+ptrdiff_t COutputPipe::TryWrite(const void* Buffer, size_t Size)
+{
+    for (;;)
+    {
+        ssize_t written = write(_Fd, Buffer, Size);
+        if (written >= 0)
+        {
+            return written;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+        {
+            return 0;
+        }
+        if (errno != EINTR)
+        {
+            return -1;
+        }
+    }
+}
+
+void COutputPipe::WaitWritable(int TimeoutMs)
+{
+    struct pollfd descriptor;
+    descriptor.fd = _Fd;
+    descriptor.events = POLLOUT;
+    descriptor.revents = 0;
+    poll(&descriptor, 1, TimeoutMs);
+}
+
+void COutputPipe::Close()
+{
+    if (_Fd < 0)
+    {
+        return;
+    }
+    if (_OwnsFd)
+    {
+        close(_Fd);
+    }
+    else
+    {
+        fcntl(_Fd, F_SETFL, _OriginalFlags);
+    }
+    _Fd = -1;
+    _OwnsFd = false;
+}
+
+bool COutputPipe::IsOpen() const
+{
+    return _Fd >= 0;
+}
+
+int COutputPipe::LastError()
+{
+    return errno;
+}
+
+#endif
+
+COutputPipe::~COutputPipe()
+{
+    Close();
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "AudioFormat.h"
+
+//
+//  Write end of a pipe the CLI streams into: its own stdout, or a named pipe (a FIFO on POSIX, \\.\pipe\<name> on
+//  Windows) that a reader opens.  Writes never block; the caller decides whether to wait for room or give up.
+//
+class COutputPipe
+{
+public:
+    COutputPipe();
+    ~COutputPipe();
+
+    //
+    //  Move the process' stdout out of the way before anything is printed: the original stdout is kept for
+    //  OpenStdout(), and file descriptor 1 goes to stderr, so no stray output can end up in the stream.
+    //
+    static bool ReserveStdout();
+
+    bool OpenStdout();
+
+    //
+    //  Create the named pipe (or reuse an existing FIFO) and wait until a reader opens it.
+    //
+    bool CreateFifo(const std::string& Name);
+
+    //
+    //  Write what fits without blocking.  Returns the bytes written, which may be 0 when the pipe is full, or -1 if
+    //  the write failed - most likely because the reader went away.
+    //
+    ptrdiff_t TryWrite(const void* Buffer, size_t Size);
+
+    //
+    //  Wait until the pipe has room, or TimeoutMs passes.
+    //
+    void WaitWritable(int TimeoutMs);
+
+    void Close();
+    bool IsOpen() const;
+
+    //
+    //  The last OS error code (GetLastError() or errno).
+    //
+    static int LastError();
+
+private:
+    COutputPipe(const COutputPipe&);
+    COutputPipe& operator=(const COutputPipe&);
+
+#ifdef _WIN32
+    HANDLE  _Handle;
+    bool    _OwnsHandle;
+    bool    _NonBlocking;
+#else
+    int     _Fd;
+    int     _OriginalFlags;     // To restore a shared stdout to how we found it.
+    bool    _OwnsFd;
+#endif
+};
@@ -0,0 +1,309 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "OutputSink.h"
+
+CPcmFileSink::CPcmFileSink() :
+    _Size(0),
+    _Preallocated(false)
+{
+}
+
+bool CPcmFileSink::Open(const std::string& FileName, uint64_t PreallocateSize)
+{
+    if (!_File.Create(FileName))
+    {
+        fprintf(stderr, "Unable to create output PCM file: %d\n", COutputFile::LastError());
+        return false;
+    }
+    _Size = 0;
+
+    //
+    //  Only an optimization, so failing is fine.
+    //
+    _Preallocated = PreallocateSize != 0 && _File.Preallocate(PreallocateSize);
+    return true;
+}
+
+bool CPcmFileSink::Write(const uint8_t* Data, size_t Size)
+{
+    if (!_File.Write(Data, Size))
+    {
+        fprintf(stderr, "Unable to write PCM data: %d\n", COutputFile::LastError());
+        return false;
+    }
+    _Size += Size;
+    return true;
+}
+
+bool CPcmFileSink::Flush()
+{
+    return _File.Flush();
+}
+
+bool CPcmFileSink::Close()
+{
+    if (!_File.IsOpen())
+    {
+        return true;
+    }
+    bool succeeded = !_Preallocated || _File.SetLength(_Size);
+    if (!succeeded)
+    {
+        fprintf(stderr, "Unable to finish PCM file: %d\n", COutputFile::LastError());
+    }
+    _File.Close();
+    return succeeded;
+}
+
+CWavFileSink::CWavFileSink() :
+    _HeaderSize(0),
+    _DataSize(0),
+    _Preallocated(false)
+{
+    memset(&_Format, 0, sizeof(_Format));
+}
+
+bool CWavFileSink::Open(const std::string& FileName, const WAVEFORMATEX* Format, uint64_t PreallocateSize)
+{
+    size_t formatSize = sizeof(WAVEFORMATEX) + Format->cbSize;
+    memcpy(&_Format, Format, formatSize < sizeof(_Format) ? formatSize : sizeof(_Format));
+    _DataSize = 0;
+
+    if (!_File.Create(FileName))
+    {
+        fprintf(stderr, "Unable to create output WAV file: %d\n", COutputFile::LastError());
+        return false;
+    }
+    _Preallocated = PreallocateSize != 0 && _File.Preallocate(PreallocateSize);
+    return UpdateHeader();
+}
+
+bool CWavFileSink::Write(const uint8_t* Data, size_t Size)
+{
+    if (!_File.WriteAt(Data, Size, _HeaderSize + _DataSize))
+    {
+        fprintf(stderr, "Unable to write WAV data: %d\n", COutputFile::LastError());
+        return false;
+    }
+    _DataSize += Size;
+    return true;
+}
+
+bool CWavFileSink::Flush()
+{
+    if (!UpdateHeader())
+    {
+        return false;
+    }
+    return _File.Flush();
+}
+
+bool CWavFileSink::Close()
+{
+    if (!_File.IsOpen())
+    {
+        return true;
+    }
+
+    //
+    //  RIFF chunks are word aligned, so an odd sized data chunk gets a pad byte.
+    //
+    bool succeeded = true;
+    if ((_DataSize & 1) != 0)
+    {
+        uint8_t padding = 0;
+        succeeded = _File.WriteAt(&padding, 1, _HeaderSize + _DataSize);
+    }
+    succeeded = succeeded && UpdateHeader();
+    succeeded = succeeded && (!_Preallocated || _File.SetLength(_HeaderSize + _DataSize + (_DataSize & 1)));
+    if (!succeeded)
+    {
+        fprintf(stderr, "Unable to finish WAV file: %d\n", COutputFile::LastError());
+    }
+    _File.Close();
+    return succeeded;
+}
+
+bool CWavFileSink::UpdateHeader()
+{
+    uint8_t header[WAV_HEADER_MAX_SIZE];
+    _HeaderSize = BuildWavHeader(&_Format.Format, _DataSize, header);
+    if (!_File.WriteAt(header, _HeaderSize, 0))
+    {
+        fprintf(stderr, "Unable to write WAV header: %d\n", COutputFile::LastError());
+        return false;
+    }
+    return true;
+}
+
+static uint8_t* AllocateAligned(size_t Size)
+{
+#ifdef _WIN32
+    return static_cast<uint8_t*>(_aligned_malloc(Size, OUTPUT_FILE_ALIGNMENT));
+#else
+    void* buffer;
+    if (posix_memalign(&buffer, OUTPUT_FILE_ALIGNMENT, Size) != 0)
+    {
+        return NULL;
+    }
+    return static_cast<uint8_t*>(buffer);
+#endif
+}
+
+static void FreeAligned(uint8_t* Buffer)
+{
+#ifdef _WIN32
+    _aligned_free(Buffer);
+#else
+    free(Buffer);
+#endif
+}
+
+static uint64_t AlignUp(uint64_t Value, uint64_t Alignment)
+{
+    return (Value + Alignment - 1) / Alignment * Alignment;
+}
+
+CDirectPcmFileSink::CDirectPcmFileSink() :
+    _Staging(NULL),
+    _StagingSize(0),
+    _StagedBytes(0),
+    _FileOffset(0),
+    _ExtentSize(0),
+    _AllocatedSize(0)
+{
+}
+
+CDirectPcmFileSink::~CDirectPcmFileSink()
+{
+    Close();
+    FreeAligned(_Staging);
+}
+
+bool CDirectPcmFileSink::Open(const std::string& FileName, size_t StagingSize, uint64_t ExtentSize)
+{
+    _StagingSize = static_cast<size_t>(AlignUp(StagingSize != 0 ? StagingSize : 1, OUTPUT_FILE_ALIGNMENT));
+    _ExtentSize = AlignUp(ExtentSize != 0 ? ExtentSize : 1, OUTPUT_FILE_ALIGNMENT);
+    _Staging = AllocateAligned(_StagingSize);
+    if (_Staging == NULL)
+    {
+        fprintf(stderr, "Unable to allocate output staging buffer.\n");
+        return false;
+    }
+
+    if (!_File.Create(FileName, OutputFileUnbuffered))
+    {
+        fprintf(stderr, "Unable to create output PCM file: %d\n", COutputFile::LastError());
+        return false;
+    }
+    if (!_File.IsUnbuffered())
+    {
+        fprintf(stderr, "File system doesn't support unbuffered I/O, writing through the cache.\n");
+    }
+    return true;
+}
+
+bool CDirectPcmFileSink::Write(const uint8_t* Data, size_t Size)
+{
+    while (Size > 0)
+    {
+        size_t bytesToCopy = _StagingSize - _StagedBytes;
+        if (bytesToCopy > Size)
+        {
+            bytesToCopy = Size;
+        }
+        memcpy(_Staging + _StagedBytes, Data, bytesToCopy);
+        _StagedBytes += bytesToCopy;
+        Data += bytesToCopy;
+        Size -= bytesToCopy;
+
+        if (_StagedBytes == _StagingSize)
+        {
+            if (!WriteStaged(_StagingSize))
+            {
+                return false;
+            }
+            _FileOffset += _StagingSize;
+            _StagedBytes = 0;
+        }
+    }
+    return true;
+}
+
+bool CDirectPcmFileSink::Flush()
+{
+    if (!WriteTail(true))
+    {
+        return false;
+    }
+    return _File.Flush();
+}
+
+bool CDirectPcmFileSink::Close()
+{
+    if (!_File.IsOpen())
+    {
+        return true;
+    }
+
+    //
+    //  Besides the tail, this gives back whatever preallocation we didn't use.
+    //
+    bool succeeded = WriteTail(false) && _File.SetLength(_FileOffset + _StagedBytes);
+    if (!succeeded)
+    {
+        fprintf(stderr, "Unable to finish PCM file: %d\n", COutputFile::LastError());
+    }
+    _File.Close();
+    return succeeded;
+}
+
+bool CDirectPcmFileSink::WriteStaged(size_t Size)
+{
+    //
+    //  Grow the preallocation a whole extent at a time.  It's only an optimization, so failing is fine.
+    //
+    if (_FileOffset + Size > _AllocatedSize)
+    {
+        uint64_t allocationSize = AlignUp(_FileOffset + Size, _ExtentSize);
+        _File.Preallocate(allocationSize);
+        _AllocatedSize = allocationSize;
+    }
+
+    if (!_File.WriteAt(_Staging, Size, _FileOffset))
+    {
+        fprintf(stderr, "Unable to write PCM data: %d\n", COutputFile::LastError());
+        return false;
+    }
+    return true;
+}
+
+//
+//  Trimming the file to length gives back the preallocation past its end too, so unless the file is being closed,
+//  take the extent back; otherwise every flush would leave the rest of the recording to grow in small pieces.
+//
+bool CDirectPcmFileSink::WriteTail(bool KeepExtent)
+{
+    if (_StagedBytes == 0)
+    {
+        return true;
+    }
+
+    size_t paddedSize = static_cast<size_t>(AlignUp(_StagedBytes, OUTPUT_FILE_ALIGNMENT));
+    memset(_Staging + _StagedBytes, 0, paddedSize - _StagedBytes);
+    if (!WriteStaged(paddedSize))
+    {
+        return false;
+    }
+    if (!_File.SetLength(_FileOffset + _StagedBytes))
+    {
+        fprintf(stderr, "Unable to set PCM file length: %d\n", COutputFile::LastError());
+        return false;
+    }
+    if (KeepExtent && !_File.Preallocate(_AllocatedSize))
+    {
+        _AllocatedSize = _FileOffset + paddedSize;
+    }
+    return true;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "OutputFile.h"
+#include "WavFile.h"
+
+//
+//  Destination of the writer thread.  Write() receives the captured byte stream in order, Flush() is the durability
+//  point (fsync / FlushFileBuffers), and Close() finalizes the output.  Sinks are only ever called from the writer
+//  thread, so they can block without holding up capture.
+//
+class IOutputSink
+{
+public:
+    virtual ~IOutputSink() {}
+    virtual bool Write(const uint8_t* Data, size_t Size) = 0;
+    virtual bool Flush() = 0;
+    virtual bool Close() = 0;
+};
+
+//
+//  Headerless PCM file, the CLI's original output format.  PreallocateSize reserves that much disk space up front;
+//  Close() gives back whatever wasn't used.
+//
+class CPcmFileSink : public IOutputSink
+{
+public:
+    CPcmFileSink();
+
+    bool Open(const std::string& FileName, uint64_t PreallocateSize = 0);
+    bool Write(const uint8_t* Data, size_t Size);
+    bool Flush();
+    bool Close();
+
+private:
+    COutputFile _File;
+    uint64_t    _Size;
+    bool        _Preallocated;
+};
+
+//
+//  Streaming WAV file.  The header goes out first; audio is written with positional writes behind it and the sizes
+//  are brought up to date at every Flush() by rewriting the header alone, switching to RF64 past 4 GiB.  Since this
+//  all runs on the writer thread, header updates never hold up capture.  If the process dies, RepairWavFile() fixes
+//  the sizes from the file length.  PreallocateSize works as for CPcmFileSink.
+//
+class CWavFileSink : public IOutputSink
+{
+public:
+    CWavFileSink();
+
+    bool Open(const std::string& FileName, const WAVEFORMATEX* Format, uint64_t PreallocateSize = 0);
+    bool Write(const uint8_t* Data, size_t Size);
+    bool Flush();
+    bool Close();
+
+private:
+    bool UpdateHeader();
+
+    COutputFile             _File;
+    WAVEFORMATEXTENSIBLE    _Format;
+    size_t                  _HeaderSize;
+    uint64_t                _DataSize;
+    bool                    _Preallocated;
+};
+
+//
+//  Headerless PCM file written around the OS cache.  Data is staged in an aligned buffer and goes out in whole
+//  OUTPUT_FILE_ALIGNMENT multiples with unbuffered I/O, and the file is preallocated in large extents so long
+//  recordings stay contiguous.  Flush() writes the unaligned tail zero padded, trims the file back to the exact
+//  length and preallocates the extent again; the next full block simply rewrites that tail.  Close() gives back
+//  the preallocation that wasn't used.
+//
+class CDirectPcmFileSink : public IOutputSink
+{
+public:
+    CDirectPcmFileSink();
+    ~CDirectPcmFileSink();
+
+    bool Open(const std::string& FileName, size_t StagingSize, uint64_t ExtentSize);
+    bool Write(const uint8_t* Data, size_t Size);
+    bool Flush();
+    bool Close();
+
+private:
+    bool WriteStaged(size_t Size);
+    bool WriteTail(bool KeepExtent);
+
+    COutputFile _File;
+    uint8_t*    _Staging;
+    size_t      _StagingSize;
+    size_t      _StagedBytes;
+    uint64_t    _FileOffset;        // Where the staging buffer goes in the file - always aligned.
+    uint64_t    _ExtentSize;
+    uint64_t    _AllocatedSize;
+};
@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <string.h>
+#include "PulseAudioCapture.h"
+
+//
+//  Monitor source of the default sink - the PulseAudio equivalent of WASAPI loopback on the default render endpoint.
+//  PipeWire's pulse server resolves the same name.
+//
+#define PULSE_DEFAULT_MONITOR "@DEFAULT_MONITOR@"
+
+CPulseAudioCapture::CPulseAudioCapture() :
+    _RefCount(1),
+    _Mainloop(NULL),
+    _Context(NULL),
+    _Stream(NULL),
+    _EngineLatencyInMS(0),
+    _PeekData(NULL),
+    _PeekBytes(0),
+    _Peeked(false),
+    _DevicePosition(0),
+    _OperationSucceeded(false),
+    _RingBuffer(NULL),
+    _Failed(false)
+{
+    memset(&_SampleSpec, 0, sizeof(_SampleSpec));
+    memset(&_MixFormat, 0, sizeof(_MixFormat));
+    pa_channel_map_init(&_ChannelMap);
+}
+
+//
+//  Empty destructor - everything should be released in the Shutdown() call.
+//
+CPulseAudioCapture::~CPulseAudioCapture()
+{
+}
+
+//
+//  The WAVEFORMATEXTENSIBLE speaker of a PulseAudio channel position, or 0 if it has none.
+//
+static DWORD SpeakerFromChannelPosition(pa_channel_position_t Position)
+{
+    switch (Position)
+    {
+    case PA_CHANNEL_POSITION_MONO:                  return SPEAKER_FRONT_CENTER;
+    case PA_CHANNEL_POSITION_FRONT_LEFT:            return SPEAKER_FRONT_LEFT;
+    case PA_CHANNEL_POSITION_FRONT_RIGHT:           return SPEAKER_FRONT_RIGHT;
+    case PA_CHANNEL_POSITION_FRONT_CENTER:          return SPEAKER_FRONT_CENTER;
+    case PA_CHANNEL_POSITION_LFE:                   return SPEAKER_LOW_FREQUENCY;
+    case PA_CHANNEL_POSITION_REAR_LEFT:             return SPEAKER_BACK_LEFT;
+    case PA_CHANNEL_POSITION_REAR_RIGHT:            return SPEAKER_BACK_RIGHT;
+    case PA_CHANNEL_POSITION_FRONT_LEFT_OF_CENTER:  return SPEAKER_FRONT_LEFT_OF_CENTER;
+    case PA_CHANNEL_POSITION_FRONT_RIGHT_OF_CENTER: return SPEAKER_FRONT_RIGHT_OF_CENTER;
+    case PA_CHANNEL_POSITION_REAR_CENTER:           return SPEAKER_BACK_CENTER;
+    case PA_CHANNEL_POSITION_SIDE_LEFT:             return SPEAKER_SIDE_LEFT;
+    case PA_CHANNEL_POSITION_SIDE_RIGHT:            return SPEAKER_SIDE_RIGHT;
+    case PA_CHANNEL_POSITION_TOP_CENTER:            return SPEAKER_TOP_CENTER;
+    case PA_CHANNEL_POSITION_TOP_FRONT_LEFT:        return SPEAKER_TOP_FRONT_LEFT;
+    case PA_CHANNEL_POSITION_TOP_FRONT_CENTER:      return SPEAKER_TOP_FRONT_CENTER;
+    case PA_CHANNEL_POSITION_TOP_FRONT_RIGHT:       return SPEAKER_TOP_FRONT_RIGHT;
+    case PA_CHANNEL_POSITION_TOP_REAR_LEFT:         return SPEAKER_TOP_BACK_LEFT;
+    case PA_CHANNEL_POSITION_TOP_REAR_CENTER:       return SPEAKER_TOP_BACK_CENTER;
+    case PA_CHANNEL_POSITION_TOP_REAR_RIGHT:        return SPEAKER_TOP_BACK_RIGHT;
+    default:                                        return 0;
+    }
+}
+
+//
+//  Put a PulseAudio channel map in WAVEFORMATEXTENSIBLE order and return its channel mask.  PulseAudio's own order
+//  differs (the default 5.1 map is FL FR RL RR FC LFE), and asking for the stream in mask order only makes the server
+//  permute the channels.  Returns 0 and leaves the map alone if a position has no speaker equivalent or appears twice.
+//
+static DWORD SortChannelMap(pa_channel_map* ChannelMap)
+{
+    DWORD mask = 0;
+    DWORD speakers[PA_CHANNELS_MAX];
+    for (unsigned channel = 0; channel < ChannelMap->channels; channel++)
+    {
+        speakers[channel] = SpeakerFromChannelPosition(ChannelMap->map[channel]);
+        if (speakers[channel] == 0 || (mask & speakers[channel]) != 0)
+        {
+            return 0;
+        }
+        mask |= speakers[channel];
+    }
+
+    for (unsigned channel = 1; channel < ChannelMap->channels; channel++)
+    {
+        DWORD speaker = speakers[channel];
+        pa_channel_position_t position = ChannelMap->map[channel];
+        unsigned target = channel;
+        for (; target > 0 && speakers[target - 1] > speaker; target--)
+        {
+            speakers[target] = speakers[target - 1];
+            ChannelMap->map[target] = ChannelMap->map[target - 1];
+        }
+        speakers[target] = speaker;
+        ChannelMap->map[target] = position;
+    }
+    return mask;
+}
+
+//
+//  Initialize the capturer: connect to the server and look up the monitor's native format.  The stream is created
+//  corked so Start() only has to uncork it.
+//
+bool CPulseAudioCapture::Initialize(const std::string& SourceName, UINT32 EngineLatency)
+{
+    _SourceName = SourceName.empty() ? PULSE_DEFAULT_MONITOR : SourceName;
+    _EngineLatencyInMS = EngineLatency;
+
+    _Mainloop = pa_threaded_mainloop_new();
+    if (_Mainloop == NULL)
+    {
+        fprintf(stderr, "Unable to create PulseAudio mainloop.\n");
+        return false;
+    }
+
+    _Context = pa_context_new(pa_threaded_mainloop_get_api(_Mainloop), "audio_capture_cli");
+    if (_Context == NULL)
+    {
+        fprintf(stderr, "Unable to create PulseAudio context.\n");
+        return false;
+    }
+    pa_context_set_state_callback(_Context, ContextStateCallback, this);
+
+    if (pa_context_connect(_Context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0)
+    {
+        fprintf(stderr, "Unable to connect to PulseAudio server: %s\n", pa_strerror(pa_context_errno(_Context)));
+        return false;
+    }
+
+    if (pa_threaded_mainloop_start(_Mainloop) < 0)
+    {
+        fprintf(stderr, "Unable to start PulseAudio mainloop.\n");
+        return false;
+    }
+
+    pa_threaded_mainloop_lock(_Mainloop);
+    bool succeeded = WaitForContextReady() && LoadFormat();
+    if (succeeded)
+    {
+        _Stream = pa_stream_new(_Context, "loopback capture", &_SampleSpec, &_ChannelMap);
+        if (_Stream == NULL)
+        {
+            fprintf(stderr, "Unable to create PulseAudio stream: %s\n", pa_strerror(pa_context_errno(_Context)));
+            succeeded = false;
+        }
+    }
+    if (succeeded)
+    {
+        pa_stream_set_state_callback(_Stream, StreamStateCallback, this);
+        pa_stream_set_read_callback(_Stream, StreamReadCallback, this);
+
+        //
+        //  Ask for fragments of the engine latency, so the read callback fires about as often as the WASAPI samples
+        //  ready event would.
+        //
+        pa_buffer_attr bufferAttributes;
+        bufferAttributes.maxlength = static_cast<uint32_t>(-1);
+        bufferAttributes.tlength = static_cast<uint32_t>(-1);
+        bufferAttributes.prebuf = static_cast<uint32_t>(-1);
+        bufferAttributes.minreq = static_cast<uint32_t>(-1);
+        bufferAttributes.fragsize = _EngineLatencyInMS != 0 ?
+            static_cast<uint32_t>(pa_usec_to_bytes(static_cast<pa_usec_t>(_EngineLatencyInMS) * 1000, &_SampleSpec)) :
+            static_cast<uint32_t>(-1);
+
+        if (pa_stream_connect_record(_Stream, _SourceName.c_str(), &bufferAttributes,
+            static_cast<pa_stream_flags_t>(PA_STREAM_ADJUST_LATENCY | PA_STREAM_START_CORKED)) < 0)
+        {
+            fprintf(stderr, "Unable to connect PulseAudio stream to %s: %s\n", _SourceName.c_str(), pa_strerror(pa_context_errno(_Context)));
+            succeeded = false;
+        }
+        else
+        {
+            succeeded = WaitForStreamReady();
+        }
+    }
+    pa_threaded_mainloop_unlock(_Mainloop);
+
+    if (succeeded)
+    {
+        fprintf(stderr, "Capturing from PulseAudio source %s\n", _SourceName.c_str());
+    }
+    return succeeded;
+}
+
+//
+//  Retrieve the format we'll use to capture samples.
+//
+//  We use the monitor's native rate and channels, in WAVEFORMATEXTENSIBLE order, so the server doesn't have to remix,
+//  and 32 bit float like the shared mode mix format on Windows.  Called with the mainloop locked.
+//
+bool CPulseAudioCapture::LoadFormat()
+{
+    pa_operation* operation = pa_context_get_source_info_by_name(_Context, _SourceName.c_str(), SourceInfoCallback, this);
+    if (!WaitForOperation(operation) || _SampleSpec.channels == 0)
+    {
+        fprintf(stderr, "Unable to get the format of PulseAudio source %s\n", _SourceName.c_str());
+        return false;
+    }
+
+    _SampleSpec.format = PA_SAMPLE_FLOAT32LE;
+    InitializeWaveFormat(&_MixFormat, true, _SampleSpec.channels, _SampleSpec.rate, 32, SortChannelMap(&_ChannelMap));
+    return true;
+}
+
+bool CPulseAudioCapture::WaitForContextReady()
+{
+    for (;;)
+    {
+        pa_context_state_t state = pa_context_get_state(_Context);
+        if (state == PA_CONTEXT_READY)
+        {
+            return true;
+        }
+        if (!PA_CONTEXT_IS_GOOD(state))
+        {
+            fprintf(stderr, "PulseAudio connection failed: %s\n", pa_strerror(pa_context_errno(_Context)));
+            return false;
+        }
+        pa_threaded_mainloop_wait(_Mainloop);
+    }
+}
+
+bool CPulseAudioCapture::WaitForStreamReady()
+{
+    for (;;)
+    {
+        pa_stream_state_t state = pa_stream_get_state(_Stream);
+        if (state == PA_STREAM_READY)
+        {
+            return true;
+        }
+        if (!PA_STREAM_IS_GOOD(state))
+        {
+            fprintf(stderr, "PulseAudio stream failed: %s\n", pa_strerror(pa_context_errno(_Context)));
+            return false;
+        }
+        pa_threaded_mainloop_wait(_Mainloop);
+    }
+}
+
+//
+//  Waits for Operation to complete.  For operations that report success, SuccessCallback() stores it in
+//  _OperationSucceeded.
+//
+bool CPulseAudioCapture::WaitForOperation(pa_operation* Operation)
+{
+    if (Operation == NULL)
+    {
+        return false;
+    }
+    _OperationSucceeded = false;
+    while (pa_operation_get_state(Operation) == PA_OPERATION_RUNNING)
+    {
+        pa_threaded_mainloop_wait(_Mainloop);
+    }
+    bool succeeded = pa_operation_get_state(Operation) == PA_OPERATION_DONE;
+    pa_operation_unref(Operation);
+    return succeeded;
+}
+
+//
+//  Start capturing...
+//
+bool CPulseAudioCapture::Start(CCaptureRingBuffer* RingBuffer, const CaptureProcessing* Processing)
+{
+    pa_threaded_mainloop_lock(_Mainloop);
+    if (!_Drain.Attach(RingBuffer, Processing, MixFormat(), NULL, static_cast<int64_t>(_EngineLatencyInMS) * REFTIMES_PER_MILLISEC))
+    {
+        pa_threaded_mainloop_unlock(_Mainloop);
+        return false;
+    }
+    _RingBuffer = RingBuffer;
+    _DevicePosition = 0;
+    bool succeeded = WaitForOperation(pa_stream_cork(_Stream, 0, SuccessCallback, this)) && _OperationSucceeded;
+    pa_threaded_mainloop_unlock(_Mainloop);
+
+    if (!succeeded)
+    {
+        fprintf(stderr, "Unable to start PulseAudio stream: %s\n", pa_strerror(pa_context_errno(_Context)));
+    }
+    return succeeded;
+}
+
+//
+//  Stop the capturer.  Once the cork completes the read callback no longer runs, so the ring is ours again.
+//
+void CPulseAudioCapture::Stop()
+{
+    if (_Mainloop == NULL || _Stream == NULL)
+    {
+        return;
+    }
+
+    pa_threaded_mainloop_lock(_Mainloop);
+    if (PA_STREAM_IS_GOOD(pa_stream_get_state(_Stream)))
+    {
+        WaitForOperation(pa_stream_cork(_Stream, 1, SuccessCallback, this));
+    }
+    _RingBuffer = NULL;
+    pa_threaded_mainloop_unlock(_Mainloop);
+}
+
+//
+//  Shut down the capture code and free all the resources.
+//
+void CPulseAudioCapture::Shutdown()
+{
+    if (_Mainloop == NULL)
+    {
+        return;
+    }
+
+    pa_threaded_mainloop_lock(_Mainloop);
+    if (_Stream)
+    {
+        pa_stream_set_read_callback(_Stream, NULL, NULL);
+        pa_stream_set_state_callback(_Stream, NULL, NULL);
+        pa_stream_disconnect(_Stream);
+        pa_stream_unref(_Stream);
+        _Stream = NULL;
+    }
+    if (_Context)
+    {
+        pa_context_set_state_callback(_Context, NULL, NULL);
+        pa_context_disconnect(_Context);
+        pa_context_unref(_Context);
+        _Context = NULL;
+    }
+    pa_threaded_mainloop_unlock(_Mainloop);
+
+    pa_threaded_mainloop_stop(_Mainloop);
+    pa_threaded_mainloop_free(_Mainloop);
+    _Mainloop = NULL;
+}
+
+//
+//  Packet client.  Each peeked fragment is one packet; a hole in the stream (data == NULL) is reported as a silent
+//  packet so the drain fills it with zeros and keeps the timeline intact.  Holes stand in for the frames they replace,
+//  so the device position is just the frames peeked since Start().
+//
+bool CPulseAudioCapture::GetNextPacketSize(uint32_t* Frames)
+{
+    if (!_Peeked)
+    {
+        if (pa_stream_peek(_Stream, &_PeekData, &_PeekBytes) < 0)
+        {
+            fprintf(stderr, "Unable to read from PulseAudio stream: %s\n", pa_strerror(pa_context_errno(_Context)));
+            return false;
+        }
+        _Peeked = _PeekBytes != 0;
+    }
+
+    *Frames = _Peeked ? static_cast<uint32_t>(_PeekBytes / FrameSize()) : 0;
+    if (_Peeked && *Frames == 0)
+    {
+        //
+        //  Never happens with whole frame fragments, but don't wedge the stream on a partial one.
+        //
+        pa_stream_drop(_Stream);
+        _Peeked = false;
+    }
+    return true;
+}
+
+bool CPulseAudioCapture::GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition)
+{
+    *Data = static_cast<uint8_t*>(const_cast<void*>(_PeekData));
+    *Frames = static_cast<uint32_t>(_PeekBytes / FrameSize());
+    *Flags = _PeekData == NULL ? CAPTURE_PACKET_FLAG_SILENT : 0;
+    if (DevicePosition != NULL)
+    {
+        *DevicePosition = _DevicePosition;
+    }
+    if (QPCPosition != NULL)
+    {
+        *QPCPosition = 0;
+    }
+    return true;
+}
+
+bool CPulseAudioCapture::ReleaseBuffer(uint32_t Frames)
+{
+    _DevicePosition += Frames;
+    _Peeked = false;
+    return pa_stream_drop(_Stream) == 0;
+}
+
+//
+//  Mainloop callbacks.
+//
+void CPulseAudioCapture::ContextStateCallback(pa_context* /*Context*/, void* UserData)
+{
+    CPulseAudioCapture* capturer = static_cast<CPulseAudioCapture*>(UserData);
+    pa_threaded_mainloop_signal(capturer->_Mainloop, 0);
+}
+
+void CPulseAudioCapture::StreamStateCallback(pa_stream* Stream, void* UserData)
+{
+    CPulseAudioCapture* capturer = static_cast<CPulseAudioCapture*>(UserData);
+    pa_stream_state_t state = pa_stream_get_state(Stream);
+    if (state == PA_STREAM_FAILED || state == PA_STREAM_TERMINATED)
+    {
+        //
+        //  The monitor went away (e.g. the sink was unloaded) - there is no stream switch on this backend, so let
+        //  the writer loop finish up.
+        //
+        capturer->_Failed.store(true, std::memory_order_release);
+    }
+    pa_threaded_mainloop_signal(capturer->_Mainloop, 0);
+}
+
+//
+//  Capture path - runs on the mainloop thread whenever the server has delivered at least a fragment.
+//
+void CPulseAudioCapture::StreamReadCallback(pa_stream* /*Stream*/, size_t /*Bytes*/, void* UserData)
+{
+    CPulseAudioCapture* capturer = static_cast<CPulseAudioCapture*>(UserData);
+    if (capturer->_RingBuffer != NULL && !capturer->_Drain.Drain(capturer))
+    {
+        capturer->_Failed.store(true, std::memory_order_release);
+    }
+}
+
+void CPulseAudioCapture::SourceInfoCallback(pa_context* /*Context*/, const pa_source_info* Info, int EndOfList, void* UserData)
+{
+    CPulseAudioCapture* capturer = static_cast<CPulseAudioCapture*>(UserData);
+    if (EndOfList == 0 && Info != NULL)
+    {
+        capturer->_SampleSpec = Info->sample_spec;
+        capturer->_ChannelMap = Info->channel_map;
+    }
+    pa_threaded_mainloop_signal(capturer->_Mainloop, 0);
+}
+
+void CPulseAudioCapture::SuccessCallback(pa_stream* /*Stream*/, int Success, void* UserData)
+{
+    CPulseAudioCapture* capturer = static_cast<CPulseAudioCapture*>(UserData);
+    capturer->_OperationSucceeded = Success != 0;
+    pa_threaded_mainloop_signal(capturer->_Mainloop, 0);
+}
+
+//
+//  Reference counting.
+//
+ULONG CPulseAudioCapture::AddRef()
+{
+    return ++_RefCount;
+}
+
+ULONG CPulseAudioCapture::Release()
+{
+    ULONG returnValue = --_RefCount;
+    if (returnValue == 0)
+    {
+        delete this;
+    }
+    return returnValue;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <pulse/pulseaudio.h>
+#include "CaptureSource.h"
+
+//
+//  PulseAudio / PipeWire capture class.
+//
+//  The Linux counterpart of CWASAPICapture's loopback capture: records a sink monitor source (by default the monitor
+//  of the default sink, "@DEFAULT_MONITOR@") in 32 bit float at the sink's rate and channel map.  It uses the
+//  asynchronous API on a threaded mainloop; the read callback runs on the mainloop thread, which acts as the capture
+//  thread, and drains pa_stream_peek() fragments into the ring through the same CCaptureDrain the other backends use.
+//  Nothing is allocated on that path after Start().
+//
+class CPulseAudioCapture : public ICaptureSource, private ICapturePacketClient
+{
+public:
+    CPulseAudioCapture();
+
+    bool Initialize(const std::string& SourceName, UINT32 EngineLatency);
+    bool Start(CCaptureRingBuffer* RingBuffer, const CaptureProcessing* Processing);
+    void Stop();
+    void Shutdown();
+
+    WAVEFORMATEX* MixFormat() { return &_MixFormat.Format; }
+    size_t FrameSize() { return _MixFormat.Format.nBlockAlign; }
+    void GetDrainStats(CaptureDrainStats* Stats) { _Drain.GetStats(Stats); }
+    bool GetLevels(LevelMeterReading* Reading) { return _Drain.GetLevels(Reading); }
+    bool IsFinished() { return _Failed.load(std::memory_order_acquire); }
+
+    ULONG STDMETHODCALLTYPE AddRef();
+    ULONG STDMETHODCALLTYPE Release();
+
+private:
+    ~CPulseAudioCapture();
+
+    //
+    //  ICapturePacketClient over pa_stream_peek/pa_stream_drop.
+    //
+    bool GetNextPacketSize(uint32_t* Frames);
+    bool GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition);
+    bool ReleaseBuffer(uint32_t Frames);
+
+    bool WaitForContextReady();
+    bool WaitForStreamReady();
+    bool WaitForOperation(pa_operation* Operation);
+    bool LoadFormat();
+
+    static void ContextStateCallback(pa_context* Context, void* UserData);
+    static void StreamStateCallback(pa_stream* Stream, void* UserData);
+    static void StreamReadCallback(pa_stream* Stream, size_t Bytes, void* UserData);
+    static void SourceInfoCallback(pa_context* Context, const pa_source_info* Info, int EndOfList, void* UserData);
+    static void SuccessCallback(pa_stream* Stream, int Success, void* UserData);
+
+    std::atomic<ULONG>      _RefCount;
+
+    pa_threaded_mainloop*   _Mainloop;
+    pa_context*             _Context;
+    pa_stream*              _Stream;
+    pa_sample_spec          _SampleSpec;
+    pa_channel_map          _ChannelMap;
+    std::string             _SourceName;
+    UINT32                  _EngineLatencyInMS;
+    WAVEFORMATEXTENSIBLE    _MixFormat;
+
+    //
+    //  The fragment currently peeked from the stream, and the frames released before it.
+    //
+    const void*             _PeekData;
+    size_t                  _PeekBytes;
+    bool                    _Peeked;
+    uint64_t                _DevicePosition;
+
+    bool                    _OperationSucceeded;
+
+    CCaptureRingBuffer*     _RingBuffer;
+    CCaptureDrain           _Drain;
+    std::atomic<bool>       _Failed;
+};
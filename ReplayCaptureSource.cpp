@@ -0,0 +1,150 @@
+#include <string.h>
+#include "ReplayCaptureSource.h"
+#include "WavFile.h"
+
+CReplayCaptureSource::CReplayCaptureSource() :
+    _File(NULL),
+    _DataOffset(0),
+    _TotalFrames(0),
+    _PacketFrames(0),
+    _StartTime(0),
+    _FramePosition(0)
+{
+}
+
+CReplayCaptureSource::~CReplayCaptureSource()
+{
+    //
+    //  Make sure the capture thread is gone before the file goes away.
+    //
+    Shutdown();
+    if (_File)
+    {
+        fclose(_File);
+        _File = NULL;
+    }
+}
+
+bool CReplayCaptureSource::Initialize(const std::string& FileName, const WAVEFORMATEX* RawFormat, UINT32 PacketFrames, bool RealTime)
+{
+    _File = fopen(FileName.c_str(), "rb");
+    if (_File == NULL)
+    {
+        fprintf(stderr, "Unable to open replay file %s\n", FileName.c_str());
+        return false;
+    }
+
+    uint64_t fileSize = FileSize64(_File);
+    uint64_t dataSize;
+    WavFileInfo wavInfo;
+    if (ReadWavHeader(_File, &wavInfo))
+    {
+        _MixFormat = wavInfo.Format;
+        _DataOffset = wavInfo.DataOffset;
+        dataSize = fileSize - _DataOffset;
+        if (wavInfo.DataSize < dataSize)
+        {
+            dataSize = wavInfo.DataSize;
+        }
+    }
+    else
+    {
+        //
+        //  No RIFF header - treat the whole file as raw samples in the caller's format.
+        //
+        memcpy(&_MixFormat, RawFormat, sizeof(WAVEFORMATEX) + RawFormat->cbSize);
+        _DataOffset = 0;
+        dataSize = fileSize;
+    }
+
+    if (_MixFormat.Format.nBlockAlign == 0 || _MixFormat.Format.nSamplesPerSec == 0 || PacketFrames == 0)
+    {
+        fprintf(stderr, "Invalid replay format for %s\n", FileName.c_str());
+        return false;
+    }
+
+    _TotalFrames = dataSize / _MixFormat.Format.nBlockAlign;
+    _PacketFrames = PacketFrames;
+    _Packet.assign(static_cast<size_t>(PacketFrames) * FrameSize(), 0);
+
+    fprintf(stderr, "Replaying %s: %llu frames from offset %llu\n", FileName.c_str(),
+        static_cast<unsigned long long>(_TotalFrames), static_cast<unsigned long long>(_DataOffset));
+
+    int64_t packetDuration = static_cast<int64_t>(PacketFrames) * 10000000 / _MixFormat.Format.nSamplesPerSec;
+    return InitializeClock(packetDuration > 1 ? packetDuration / 2 : 1, RealTime);
+}
+
+void CReplayCaptureSource::OnStart()
+{
+    _StartTime = Clock()->Now();
+    _FramePosition = 0;
+    if (!SeekFile64(_File, _DataOffset))
+    {
+        fprintf(stderr, "Unable to seek to the start of the replay data\n");
+        SetFinished();
+    }
+}
+
+//
+//  A packet is available once the clock has passed the end of the frames it covers.
+//
+bool CReplayCaptureSource::GetNextPacketSize(uint32_t* Frames)
+{
+    *Frames = 0;
+    if (IsFinished() || _FramePosition >= _TotalFrames)
+    {
+        return true;
+    }
+
+    uint64_t packetFrames = _TotalFrames - _FramePosition;
+    if (packetFrames > _PacketFrames)
+    {
+        packetFrames = _PacketFrames;
+    }
+
+    int64_t due = _StartTime + static_cast<int64_t>((_FramePosition + packetFrames) * 10000000 / _MixFormat.Format.nSamplesPerSec);
+    if (Clock()->Now() >= due)
+    {
+        *Frames = static_cast<uint32_t>(packetFrames);
+    }
+    return true;
+}
+
+bool CReplayCaptureSource::GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition)
+{
+    uint64_t packetFrames = _TotalFrames - _FramePosition;
+    if (packetFrames > _PacketFrames)
+    {
+        packetFrames = _PacketFrames;
+    }
+
+    size_t framesRead = fread(&_Packet[0], FrameSize(), static_cast<size_t>(packetFrames), _File);
+    if (framesRead == 0)
+    {
+        fprintf(stderr, "Unable to read replay data at frame %llu\n", static_cast<unsigned long long>(_FramePosition));
+        return false;
+    }
+
+    *Data = &_Packet[0];
+    *Frames = static_cast<uint32_t>(framesRead);
+    *Flags = 0;
+    if (DevicePosition != NULL)
+    {
+        *DevicePosition = _FramePosition;
+    }
+    if (QPCPosition != NULL)
+    {
+        *QPCPosition = static_cast<uint64_t>(_StartTime + static_cast<int64_t>(_FramePosition * 10000000 / _MixFormat.Format.nSamplesPerSec));
+    }
+    return true;
+}
+
+bool CReplayCaptureSource::ReleaseBuffer(uint32_t Frames)
+{
+    _FramePosition += Frames;
+    if (_FramePosition >= _TotalFrames)
+    {
+        SetFinished();
+    }
+    return true;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "ClockedCaptureSource.h"
+
+//
+//  File replay capture source.
+//
+//  Streams an existing recording back through the capture path, either paced in real time or as fast as the consumer
+//  takes it.  WAV and RF64 files describe their own format; headerless .pcm files (what the CLI writes) are replayed
+//  with the format passed to Initialize().
+//
+class CReplayCaptureSource : public CClockedCaptureSource
+{
+public:
+    CReplayCaptureSource();
+
+    bool Initialize(const std::string& FileName, const WAVEFORMATEX* RawFormat, UINT32 PacketFrames, bool RealTime);
+
+protected:
+    ~CReplayCaptureSource();
+
+    void OnStart();
+    bool GetNextPacketSize(uint32_t* Frames);
+    bool GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition);
+    bool ReleaseBuffer(uint32_t Frames);
+
+private:
+    FILE*                   _File;
+    uint64_t                _DataOffset;
+    uint64_t                _TotalFrames;
+    UINT32                  _PacketFrames;
+    std::vector<uint8_t>    _Packet;
+
+    int64_t                 _StartTime;
+    uint64_t                _FramePosition;
+};
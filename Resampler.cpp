@@ -0,0 +1,469 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "Resampler.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RESAMPLER_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//
+//  The phase table has L * taps entries; this keeps it to a few MB for any pair of common rates.
+//
+#define RESAMPLER_MAX_PHASES 4096
+
+static const double Pi = 3.14159265358979323846;
+
+static const uint32_t QualityTaps[] = { 24, 64, 128 };
+static const double QualityAttenuation[] = { 60.0, 90.0, 120.0 };
+
+static float DotScalar(const float* Coefficients, const float* Samples, size_t Count)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < Count; i++)
+    {
+        sum += Coefficients[i] * Samples[i];
+    }
+    return sum;
+}
+
+#ifdef RESAMPLER_HAVE_SSE2
+
+static float DotSse2(const float* Coefficients, const float* Samples, size_t Count)
+{
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    __m128 sum2 = _mm_setzero_ps();
+    __m128 sum3 = _mm_setzero_ps();
+    for (size_t i = 0; i < Count; i += 16)
+    {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(Coefficients + i), _mm_loadu_ps(Samples + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(Coefficients + i + 4), _mm_loadu_ps(Samples + i + 4)));
+        sum2 = _mm_add_ps(sum2, _mm_mul_ps(_mm_loadu_ps(Coefficients + i + 8), _mm_loadu_ps(Samples + i + 8)));
+        sum3 = _mm_add_ps(sum3, _mm_mul_ps(_mm_loadu_ps(Coefficients + i + 12), _mm_loadu_ps(Samples + i + 12)));
+    }
+    __m128 sum = _mm_add_ps(_mm_add_ps(sum0, sum1), _mm_add_ps(sum2, sum3));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+#endif
+
+static uint32_t GreatestCommonDivisor(uint32_t A, uint32_t B)
+{
+    while (B != 0)
+    {
+        uint32_t remainder = A % B;
+        A = B;
+        B = remainder;
+    }
+    return A;
+}
+
+//
+//  Zeroth order modified Bessel function of the first kind, for the Kaiser window.
+//
+static double BesselI0(double X)
+{
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 64; k++)
+    {
+        term *= (X / (2 * k)) * (X / (2 * k));
+        sum += term;
+        if (term < sum * 1e-17)
+        {
+            break;
+        }
+    }
+    return sum;
+}
+
+CResampler::CResampler() :
+    _Channels(0),
+    _L(1),
+    _M(1),
+    _Taps(0),
+    _MaxInputFrames(0),
+    _Kernel(SampleKernelScalar),
+    _Dot(DotScalar),
+    _HistoryStride(0),
+    _Position(0),
+    _Phase(0)
+{
+    memset(&_OutputFormat, 0, sizeof(_OutputFormat));
+}
+
+bool CResampler::Initialize(const WAVEFORMATEX* InputFormat, uint32_t OutputRate, ResamplerQuality Quality, size_t MaxInputFrames,
+    SampleConvertKernel MaxKernel)
+{
+    if (!IsFloatFormat(InputFormat) || InputFormat->wBitsPerSample != 32)
+    {
+        fprintf(stderr, "Resampling needs 32 bit float capture data.\n");
+        return false;
+    }
+    if (InputFormat->nSamplesPerSec == 0 || OutputRate == 0 || MaxInputFrames == 0 || Quality > ResamplerQualityHigh)
+    {
+        fprintf(stderr, "Invalid resampler parameters.\n");
+        return false;
+    }
+
+    uint32_t divisor = GreatestCommonDivisor(OutputRate, InputFormat->nSamplesPerSec);
+    _L = OutputRate / divisor;
+    _M = InputFormat->nSamplesPerSec / divisor;
+    if (_L > RESAMPLER_MAX_PHASES)
+    {
+        fprintf(stderr, "Can't resample %u Hz to %u Hz: the ratio %u/%u needs too many filter phases.\n",
+            InputFormat->nSamplesPerSec, OutputRate, _L, _M);
+        return false;
+    }
+
+    DWORD channelMask = 0;
+    if (InputFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE && InputFormat->cbSize >= WAVEFORMATEXTENSIBLE_EXTRA_SIZE)
+    {
+        channelMask = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(InputFormat)->dwChannelMask;
+    }
+    InitializeWaveFormat(&_OutputFormat, true, InputFormat->nChannels, OutputRate, 32, channelMask);
+    _Channels = InputFormat->nChannels;
+    _MaxInputFrames = MaxInputFrames;
+
+    //
+    //  When decimating, the filter has to be M / L times longer in input samples for the same transition band.
+    //
+    double lowerRateRatio = _L < _M ? static_cast<double>(_L) / _M : 1.0;
+    uint32_t taps = static_cast<uint32_t>(ceil(QualityTaps[Quality] / lowerRateRatio));
+    _Taps = (taps + RESAMPLER_TAP_MULTIPLE - 1) / RESAMPLER_TAP_MULTIPLE * RESAMPLER_TAP_MULTIPLE;
+
+    //
+    //  Prototype filter at L times the input rate, cut off at the lower Nyquist frequency.  Its gain is L, since only
+    //  one in L of its taps meets an input sample.
+    //
+    double attenuation = QualityAttenuation[Quality];
+    double beta = attenuation > 50.0 ? 0.1102 * (attenuation - 8.7) : 0.5842 * pow(attenuation - 21.0, 0.4) + 0.07886 * (attenuation - 21.0);
+    double cutoff = 0.5 * lowerRateRatio / _L;
+    size_t length = static_cast<size_t>(_Taps) * _L;
+    double center = (length - 1) / 2.0;
+    double windowScale = BesselI0(beta);
+    std::vector<double> prototype(length);
+    double sum = 0.0;
+    for (size_t i = 0; i < length; i++)
+    {
+        double t = i - center;
+        double x = 2.0 * cutoff * t;
+        double sinc = fabs(x) < 1e-12 ? 1.0 : sin(Pi * x) / (Pi * x);
+        double position = 2.0 * i / (length - 1) - 1.0;
+        double window = BesselI0(beta * sqrt(1.0 - position * position)) / windowScale;
+        prototype[i] = sinc * window;
+        sum += prototype[i];
+    }
+
+    _Coefficients.resize(length);
+    for (uint32_t phase = 0; phase < _L; phase++)
+    {
+        for (uint32_t tap = 0; tap < _Taps; tap++)
+        {
+            _Coefficients[static_cast<size_t>(phase) * _Taps + tap] =
+                static_cast<float>(prototype[static_cast<size_t>(_Taps - 1 - tap) * _L + phase] * _L / sum);
+        }
+    }
+
+    _HistoryStride = _Taps - 1 + MaxInputFrames;
+    _History.assign(_HistoryStride * _Channels, 0.0f);
+    _Output.assign((MaxInputFrames * _L / _M + 1) * _Channels, 0.0f);
+    Reset();
+
+    _Kernel = SampleKernelScalar;
+    _Dot = DotScalar;
+#ifdef RESAMPLER_HAVE_SSE2
+    if (MaxKernel >= SampleKernelSse2)
+    {
+        _Kernel = SampleKernelSse2;
+        _Dot = DotSse2;
+    }
+#endif
+    if (MaxKernel >= SampleKernelAvx2 && GetAvx2ResamplerDot() != NULL && CpuSupportsAvx2())
+    {
+        _Kernel = SampleKernelAvx2;
+        _Dot = GetAvx2ResamplerDot();
+    }
+    return true;
+}
+
+void CResampler::Reset()
+{
+    std::fill(_History.begin(), _History.end(), 0.0f);
+    _Position = 0;
+    _Phase = 0;
+}
+
+const float* CResampler::Process(const float* Input, size_t Frames, size_t* OutputFrames)
+{
+    if (Frames > _MaxInputFrames)
+    {
+        Frames = _MaxInputFrames;
+    }
+
+    //
+    //  Append the input to each channel's history.
+    //
+    const size_t historyLength = _Taps - 1;
+    for (uint32_t channel = 0; channel < _Channels; channel++)
+    {
+        float* history = &_History[channel * _HistoryStride + historyLength];
+        if (Input == NULL)
+        {
+            memset(history, 0, Frames * sizeof(float));
+            continue;
+        }
+        for (size_t i = 0; i < Frames; i++)
+        {
+            history[i] = Input[i * _Channels + channel];
+        }
+    }
+
+    size_t produced = 0;
+    while (_Position < Frames)
+    {
+        const float* coefficients = &_Coefficients[static_cast<size_t>(_Phase) * _Taps];
+        float* output = &_Output[produced * _Channels];
+        for (uint32_t channel = 0; channel < _Channels; channel++)
+        {
+            output[channel] = _Dot(coefficients, &_History[channel * _HistoryStride + _Position], _Taps);
+        }
+        produced++;
+
+        _Phase += _M;
+        _Position += _Phase / _L;
+        _Phase %= _L;
+    }
+    _Position -= Frames;
+
+    //
+    //  Keep the newest _Taps - 1 samples for the next call.
+    //
+    for (uint32_t channel = 0; channel < _Channels; channel++)
+    {
+        float* history = &_History[channel * _HistoryStride];
+        memmove(history, history + Frames, historyLength * sizeof(float));
+    }
+
+    *OutputFrames = produced;
+    return &_Output[0];
+}
+
+//
+//  Fraction of the lower Nyquist frequency the drift resampler's filter passes, and its stopband attenuation.
+//
+#define DRIFT_RESAMPLER_BANDWIDTH   0.9
+#define DRIFT_RESAMPLER_ATTENUATION 90.0
+
+CDriftResampler::CDriftResampler() :
+    _Channels(0),
+    _Capacity(0),
+    _Kernel(SampleKernelScalar),
+    _Dot(DotScalar),
+    _Base(0),
+    _Count(0),
+    _Latency(DRIFT_RESAMPLER_TAPS / 2 - 1),
+    _Position(0),
+    _Fraction(0.0)
+{
+}
+
+bool CDriftResampler::Initialize(WORD Channels, double NominalStep, size_t MaxInputFrames, SampleConvertKernel MaxKernel)
+{
+    if (Channels == 0 || !(NominalStep > 0.0) || MaxInputFrames == 0)
+    {
+        fprintf(stderr, "Invalid drift resampler parameters.\n");
+        return false;
+    }
+    _Channels = Channels;
+    _Capacity = MaxInputFrames + DRIFT_RESAMPLER_TAPS;
+
+    //
+    //  Tap k of a phase meets the input sample Fraction + _Latency - k input frames before the output.  Every phase
+    //  is normalized to unity gain so the interpolation between phases doesn't ripple.
+    //
+    const double beta = 0.1102 * (DRIFT_RESAMPLER_ATTENUATION - 8.7);
+    const double cutoff = 0.5 * DRIFT_RESAMPLER_BANDWIDTH * (NominalStep > 1.0 ? 1.0 / NominalStep : 1.0);
+    const double halfLength = DRIFT_RESAMPLER_TAPS / 2;
+    const double windowScale = BesselI0(beta);
+    _Coefficients.resize(static_cast<size_t>(DRIFT_RESAMPLER_PHASES + 1) * DRIFT_RESAMPLER_TAPS);
+    std::vector<double> taps(DRIFT_RESAMPLER_TAPS);
+    for (uint32_t phase = 0; phase <= DRIFT_RESAMPLER_PHASES; phase++)
+    {
+        double sum = 0.0;
+        for (uint32_t tap = 0; tap < DRIFT_RESAMPLER_TAPS; tap++)
+        {
+            double t = static_cast<double>(phase) / DRIFT_RESAMPLER_PHASES + static_cast<double>(_Latency) - tap;
+            double x = 2.0 * cutoff * t;
+            double sinc = fabs(x) < 1e-12 ? 1.0 : sin(Pi * x) / (Pi * x);
+            double position = std::min(fabs(t) / halfLength, 1.0);
+            taps[tap] = sinc * BesselI0(beta * sqrt(1.0 - position * position)) / windowScale;
+            sum += taps[tap];
+        }
+        for (uint32_t tap = 0; tap < DRIFT_RESAMPLER_TAPS; tap++)
+        {
+            _Coefficients[static_cast<size_t>(phase) * DRIFT_RESAMPLER_TAPS + tap] = static_cast<float>(taps[tap] / sum);
+        }
+    }
+    _Taps.assign(DRIFT_RESAMPLER_TAPS, 0.0f);
+    _History.assign(_Capacity * _Channels, 0.0f);
+    Reset();
+
+    _Kernel = SampleKernelScalar;
+    _Dot = DotScalar;
+#ifdef RESAMPLER_HAVE_SSE2
+    if (MaxKernel >= SampleKernelSse2)
+    {
+        _Kernel = SampleKernelSse2;
+        _Dot = DotSse2;
+    }
+#endif
+    if (MaxKernel >= SampleKernelAvx2 && GetAvx2ResamplerDot() != NULL && CpuSupportsAvx2())
+    {
+        _Kernel = SampleKernelAvx2;
+        _Dot = GetAvx2ResamplerDot();
+    }
+    return true;
+}
+
+void CDriftResampler::Reset()
+{
+    std::fill(_History.begin(), _History.end(), 0.0f);
+    _Base = 0;
+    _Count = static_cast<size_t>(_Latency);
+    _Position = _Latency;
+    _Fraction = 0.0;
+}
+
+size_t CDriftResampler::Push(const float* Input, size_t Frames)
+{
+    //
+    //  Drop the frames no output needs any more, and after a skip past the end, the input up to the position.
+    //
+    size_t taken = 0;
+    const uint64_t keepFrom = _Position - _Latency;
+    if (keepFrom > _Base)
+    {
+        size_t drop = static_cast<size_t>(std::min<uint64_t>(keepFrom - _Base, _Count));
+        if (drop != 0)
+        {
+            for (uint32_t channel = 0; channel < _Channels; channel++)
+            {
+                float* history = &_History[channel * _Capacity];
+                memmove(history, history + drop, (_Count - drop) * sizeof(float));
+            }
+            _Count -= drop;
+            _Base += drop;
+        }
+        if (_Count == 0 && keepFrom > _Base)
+        {
+            taken = static_cast<size_t>(std::min<uint64_t>(keepFrom - _Base, Frames));
+            _Base += taken;
+            Frames -= taken;
+            if (Input != NULL)
+            {
+                Input += taken * _Channels;
+            }
+        }
+    }
+
+    size_t frames = std::min(Frames, _Capacity - _Count);
+    for (uint32_t channel = 0; channel < _Channels; channel++)
+    {
+        float* history = &_History[channel * _Capacity + _Count];
+        if (Input == NULL)
+        {
+            memset(history, 0, frames * sizeof(float));
+            continue;
+        }
+        for (size_t i = 0; i < frames; i++)
+        {
+            history[i] = Input[i * _Channels + channel];
+        }
+    }
+    _Count += frames;
+    return taken + frames;
+}
+
+//
+//  Output k lies at _Position + _Fraction + k * Step and needs the input up to DRIFT_RESAMPLER_TAPS - _Latency - 1
+//  frames after it.  The count errs on the short side so Pull() never comes up short of it.
+//
+size_t CDriftResampler::Available(double Step) const
+{
+    const uint64_t end = _Base + _Count;
+    if (Step == 1.0 && _Fraction == 0.0)
+    {
+        return _Position < end ? static_cast<size_t>(end - _Position) : 0;
+    }
+    if (_Position + DRIFT_RESAMPLER_TAPS - _Latency > end)
+    {
+        return 0;
+    }
+    double room = static_cast<double>(end - (_Position + DRIFT_RESAMPLER_TAPS - _Latency)) + 1.0 - _Fraction - 1e-6;
+    return room > 0.0 ? static_cast<size_t>(ceil(room / Step)) : 0;
+}
+
+size_t CDriftResampler::Pull(float* Output, size_t OutputStride, size_t Frames, double Step)
+{
+    const uint64_t end = _Base + _Count;
+    if (Step == 1.0 && _Fraction == 0.0)
+    {
+        size_t frames = static_cast<size_t>(std::min<uint64_t>(Frames, _Position < end ? end - _Position : 0));
+        for (uint32_t channel = 0; channel < _Channels; channel++)
+        {
+            const float* history = &_History[channel * _Capacity + static_cast<size_t>(_Position - _Base)];
+            for (size_t i = 0; i < frames; i++)
+            {
+                Output[i * OutputStride + channel] = history[i];
+            }
+        }
+        _Position += frames;
+        return frames;
+    }
+
+    size_t produced = 0;
+    while (produced < Frames && _Position + DRIFT_RESAMPLER_TAPS - _Latency <= end)
+    {
+        double phase = _Fraction * DRIFT_RESAMPLER_PHASES;
+        uint32_t index = static_cast<uint32_t>(phase);
+        float weight = static_cast<float>(phase - index);
+        const float* lower = &_Coefficients[static_cast<size_t>(index) * DRIFT_RESAMPLER_TAPS];
+        const float* upper = lower + DRIFT_RESAMPLER_TAPS;
+        for (uint32_t tap = 0; tap < DRIFT_RESAMPLER_TAPS; tap++)
+        {
+            _Taps[tap] = lower[tap] + weight * (upper[tap] - lower[tap]);
+        }
+
+        size_t offset = static_cast<size_t>(_Position - _Latency - _Base);
+        float* output = Output + produced * OutputStride;
+        for (uint32_t channel = 0; channel < _Channels; channel++)
+        {
+            output[channel] = _Dot(&_Taps[0], &_History[channel * _Capacity + offset], DRIFT_RESAMPLER_TAPS);
+        }
+        produced++;
+        Advance(Step);
+    }
+    return produced;
+}
+
+void CDriftResampler::Skip(double Frames)
+{
+    if (Frames > 0.0)
+    {
+        Advance(Frames);
+    }
+}
+
+void CDriftResampler::Advance(double Frames)
+{
+    _Fraction += Frames;
+    double whole = floor(_Fraction);
+    _Position += static_cast<uint64_t>(whole);
+    _Fraction -= whole;
+}
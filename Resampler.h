@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+#include "AudioFormat.h"
+#include "SampleConvert.h"
+#include "ResamplerKernels.h"
+
+//
+//  Quality presets: filter length per input sample at the lower of the two rates, and stopband attenuation.
+//
+//  Low         24 taps,  60 dB
+//  Medium      64 taps,  90 dB
+//  High        128 taps, 120 dB
+//
+enum ResamplerQuality
+{
+    ResamplerQualityLow,
+    ResamplerQualityMedium,
+    ResamplerQualityHigh,
+};
+
+//
+//  Streaming polyphase resampler for interleaved 32 bit float audio.
+//
+//  The rate ratio is reduced to OutputRate / InputRate = L / M, and a Kaiser windowed sinc low pass, designed at L
+//  times the input rate with its cutoff at the lower Nyquist frequency, is split into L phases.  Each output sample
+//  is one dot product of a phase with the newest input samples, so any rational ratio costs the same per output
+//  sample.  The filter history and the position between input samples carry over from one Process() call to the
+//  next, and everything is allocated in Initialize().  The dot products use the fastest kernel the CPU supports.
+//
+class CResampler
+{
+public:
+    CResampler();
+
+    bool Initialize(const WAVEFORMATEX* InputFormat, uint32_t OutputRate, ResamplerQuality Quality, size_t MaxInputFrames,
+        SampleConvertKernel MaxKernel = SampleKernelAvx2);
+
+    const WAVEFORMATEX* OutputFormat() const { return &_OutputFormat.Format; }
+    size_t InputFrameSize() const { return _Channels * sizeof(float); }
+    size_t OutputFrameSize() const { return _Channels * sizeof(float); }
+    size_t MaxInputFrames() const { return _MaxInputFrames; }
+    uint32_t Phases() const { return _L; }
+    uint32_t TapsPerPhase() const { return _Taps; }
+    SampleConvertKernel Kernel() const { return _Kernel; }
+
+    //
+    //  How far the output lags the input, in output frames: the filter's group delay.
+    //
+    double Delay() const { return (static_cast<double>(_Taps) * _L - 1) / (2.0 * _M); }
+
+    //
+    //  Resample up to MaxInputFrames() frames; Input NULL is silence.  The output stays valid until the next call.
+    //
+    const float* Process(const float* Input, size_t Frames, size_t* OutputFrames);
+
+    //
+    //  Forget the history, as if the stream started over.
+    //
+    void Reset();
+
+private:
+    WAVEFORMATEXTENSIBLE    _OutputFormat;
+    uint32_t                _Channels;
+    uint32_t                _L;                 // Interpolation factor (output rate / gcd).
+    uint32_t                _M;                 // Decimation factor (input rate / gcd).
+    uint32_t                _Taps;              // Per phase.
+    size_t                  _MaxInputFrames;
+    SampleConvertKernel     _Kernel;
+    ResamplerDotFunction    _Dot;
+
+    //
+    //  Phase p's taps, reversed so they line up with the history in time order.
+    //
+    std::vector<float>      _Coefficients;
+
+    //
+    //  Planar history: per channel, _Taps - 1 samples from earlier calls followed by the current input.
+    //
+    std::vector<float>      _History;
+    size_t                  _HistoryStride;
+
+    //
+    //  The next output sample lies _Phase / _L input samples after input sample _Position of the current call.
+    //
+    size_t                  _Position;
+    uint32_t                _Phase;
+
+    std::vector<float>      _Output;
+};
+
+//
+//  Variable ratio resampler for interleaved 32 bit float audio, for following a clock that drifts.
+//
+//  Input is queued with Push(), and Pull() interpolates output frames at fractional input positions, stepping through
+//  the input by a ratio that may change from one call to the next.  Each output sample is the dot product of
+//  DRIFT_RESAMPLER_TAPS input samples around the position with a Kaiser windowed sinc, interpolated linearly between
+//  the nearest two of DRIFT_RESAMPLER_PHASES precomputed phases.  The cutoff follows the nominal step given to
+//  Initialize(), so the step should stay close to it.  Position() counts input frames from the first one pushed, so
+//  it can be matched to the input's timestamps.  A step of exactly 1 at a whole position copies the input through.
+//
+#define DRIFT_RESAMPLER_TAPS    64
+#define DRIFT_RESAMPLER_PHASES  256
+
+class CDriftResampler
+{
+public:
+    CDriftResampler();
+
+    bool Initialize(WORD Channels, double NominalStep, size_t MaxInputFrames, SampleConvertKernel MaxKernel = SampleKernelAvx2);
+
+    WORD Channels() const { return static_cast<WORD>(_Channels); }
+    SampleConvertKernel Kernel() const { return _Kernel; }
+    double Position() const { return static_cast<double>(_Position - _Latency) + _Fraction; }
+    uint64_t FramesPushed() const { return _Base + _Count - _Latency; }
+
+    //
+    //  Queue up to Frames input frames; Input NULL is silence.  Frames behind a Skip() are dropped as they arrive.
+    //  Returns how many were taken, which is fewer only when the history is full.
+    //
+    size_t Push(const float* Input, size_t Frames);
+
+    //
+    //  How many output frames Pull() can produce at Step with the input queued so far.
+    //
+    size_t Available(double Step) const;
+
+    //
+    //  Produce up to Frames frames into Output, whose frames are OutputStride floats apart, and return how many.
+    //
+    size_t Pull(float* Output, size_t OutputStride, size_t Frames, double Step);
+
+    //
+    //  Move the position Frames input frames ahead without producing anything.
+    //
+    void Skip(double Frames);
+
+    //
+    //  Forget all input, as if the stream started over.
+    //
+    void Reset();
+
+private:
+    void Advance(double Frames);
+
+    uint32_t                _Channels;
+    size_t                  _Capacity;          // Frames of history per channel.
+    SampleConvertKernel     _Kernel;
+    ResamplerDotFunction    _Dot;
+
+    //
+    //  Phase p's taps for an output at p / DRIFT_RESAMPLER_PHASES past an input sample, in time order, with one more
+    //  phase at the end to interpolate towards.
+    //
+    std::vector<float>      _Coefficients;
+    std::vector<float>      _Taps;
+
+    //
+    //  Planar history: per channel, input frames _Base to _Base + _Count, counted from _Latency zero frames queued
+    //  ahead of the input so the first output has its full window.
+    //
+    std::vector<float>      _History;
+    uint64_t                _Base;
+    size_t                  _Count;
+    uint64_t                _Latency;
+
+    //
+    //  The next output frame lies _Fraction input frames after input frame _Position.
+    //
+    uint64_t                _Position;
+    double                  _Fraction;
+};
@@ -0,0 +1,39 @@
+#include "ResamplerKernels.h"
+
+//
+//  Built with AVX2 code generation enabled where the compiler supports it; CResampler only calls in here after
+//  checking the CPU.
+//
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+static float DotAvx2(const float* Coefficients, const float* Samples, size_t Count)
+{
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    for (size_t i = 0; i < Count; i += 16)
+    {
+        sum0 = _mm256_add_ps(sum0, _mm256_mul_ps(_mm256_loadu_ps(Coefficients + i), _mm256_loadu_ps(Samples + i)));
+        sum1 = _mm256_add_ps(sum1, _mm256_mul_ps(_mm256_loadu_ps(Coefficients + i + 8), _mm256_loadu_ps(Samples + i + 8)));
+    }
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half);
+}
+
+ResamplerDotFunction GetAvx2ResamplerDot()
+{
+    return DotAvx2;
+}
+
+#else
+
+ResamplerDotFunction GetAvx2ResamplerDot()
+{
+    return NULL;
+}
+
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stddef.h>
+
+//
+//  Dot product kernels of the polyphase resampler.  Like SampleConvertKernels.h, this header must stay free of inline
+//  code because ResamplerAvx2.cpp is built with AVX2 enabled.
+//
+
+//
+//  Sum of Coefficients[i] * Samples[i] for Count values.  Count is a multiple of RESAMPLER_TAP_MULTIPLE; neither
+//  array needs to be aligned.
+//
+#define RESAMPLER_TAP_MULTIPLE 16
+
+typedef float (*ResamplerDotFunction)(const float* Coefficients, const float* Samples, size_t Count);
+
+//
+//  The AVX2 kernel, or NULL if this build has none.  Only call it if CpuSupportsAvx2().
+//
+ResamplerDotFunction GetAvx2ResamplerDot();
@@ -0,0 +1,333 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "SampleConvert.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SAMPLE_CONVERT_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#endif
+
+//
+//  Scalar reference.  Every other kernel must produce exactly this, down to the order of the float operations.
+//
+template <int Bytes>
+static void ConvertScalar(const uint8_t* Input, uint8_t* Output, size_t Count, uint32_t* DitherState, uint32_t Lane)
+{
+    const float scale = Bytes == 2 ? SAMPLE_SCALE_16 : Bytes == 3 ? SAMPLE_SCALE_24 : SAMPLE_SCALE_32;
+    const float minimum = -scale;
+    const float maximum = Bytes == 2 ? SAMPLE_MAX_16 : Bytes == 3 ? SAMPLE_MAX_24 : SAMPLE_MAX_32;
+
+    for (size_t i = 0; i < Count; i++)
+    {
+        float value;
+        memcpy(&value, Input + i * 4, sizeof(value));
+        float sample = value * scale;
+        if (DitherState != NULL)
+        {
+            uint32_t state = DitherState[Lane];
+            state ^= state << 13;
+            state ^= state >> 17;
+            state ^= state << 5;
+            DitherState[Lane] = state;
+            Lane = (Lane + 1) % SAMPLE_DITHER_LANES;
+            int32_t dither = static_cast<int32_t>(state & 0xFFFF) + static_cast<int32_t>(state >> 16) - 65535;
+            sample = sample + static_cast<float>(dither) * (1.0f / 65536.0f);
+        }
+
+        //
+        //  Written to match MAXPS / MINPS, which also map NaN to the lower bound.
+        //
+        sample = sample > minimum ? sample : minimum;
+        sample = sample < maximum ? sample : maximum;
+        int32_t result = static_cast<int32_t>(lrintf(sample));
+
+        uint8_t* target = Output + i * Bytes;
+        target[0] = static_cast<uint8_t>(result);
+        target[1] = static_cast<uint8_t>(result >> 8);
+        if (Bytes >= 3)
+        {
+            target[2] = static_cast<uint8_t>(result >> 16);
+        }
+        if (Bytes == 4)
+        {
+            target[3] = static_cast<uint8_t>(result >> 24);
+        }
+    }
+}
+
+static void ScalarToInt16(const uint8_t* Input, uint8_t* Output, size_t Count, uint32_t* DitherState)
+{
+    ConvertScalar<2>(Input, Output, Count, DitherState, 0);
+}
+
+static void ScalarToInt24(const uint8_t* Input, uint8_t* Output, size_t Count, uint32_t* DitherState)
+{
+    ConvertScalar<3>(Input, Output, Count, DitherState, 0);
+}
+
+static void ScalarToInt32(const uint8_t* Input, uint8_t* Output, size_t Count, uint32_t* DitherState)
+{
+    ConvertScalar<4>(Input, Output, Count, DitherState, 0);
+}
+
+static const SampleConvertKernels ScalarKernels = { ScalarToInt16, ScalarToInt24, ScalarToInt32 };
+
+#ifdef SAMPLE_CONVERT_HAVE_SSE2
+
+//
+//  Steps four dither lanes and returns their TPDF values in LSB.
+//
+static inline __m128 NextDitherSse2(__m128i* State)
+{
+    __m128i state = *State;
+    state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+    state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+    state = _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+    *State = state;
+    __m128i dither = _mm_add_epi32(_mm_and_si128(state, _mm_set1_epi32(0xFFFF)), _mm_srli_epi32(state, 16));
+    dither = _mm_sub_epi32(dither, _mm_set1_epi32(65535));
+    return _mm_mul_ps(_mm_cvtepi32_ps(dither), _mm_set1_ps(1.0f / 65536.0f));
+}
+
+//
+//  Eight samples per iteration, as two registers.  Each iteration loads all of its input before it stores, and its
+//  output never reaches past its input, so in place conversion is safe.
+//
+template <int Bytes>
+static void ConvertSse2(const uint8_t* Input, uint8_t* Output, size_t Count, uint32_t* DitherState)
+{
+    const float scale = Bytes == 2 ? SAMPLE_SCALE_16 : Bytes == 3 ? SAMPLE_SCALE_24 : SAMPLE_SCALE_32;
+    const __m128 scaleVector = _mm_set1_ps(scale);
+    const __m128 minimum = _mm_set1_ps(-scale);
+    const __m128 maximum = _mm_set1_ps(Bytes == 2 ? SAMPLE_MAX_16 : Bytes == 3 ? SAMPLE_MAX_24 : SAMPLE_MAX_32);
+
+    __m128i state0 = _mm_setzero_si128();
+    __m128i state1 = _mm_setzero_si128();
+    if (DitherState != NULL)
+    {
+        state0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(DitherState));
+        state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(DitherState + 4));
+    }
+
+    for (size_t i = 0; i < Count; i += 8)
+    {
+        __m128 sample0 = _mm_mul_ps(_mm_loadu_ps(reinterpret_cast<const float*>(Input + i * 4)), scaleVector);
+        __m128 sample1 = _mm_mul_ps(_mm_loadu_ps(reinterpret_cast<const float*>(Input + i * 4 + 16)), scaleVector);
+        if (DitherState != NULL)
+        {
+            sample0 = _mm_add_ps(sample0, NextDitherSse2(&state0));
+            sample1 = _mm_add_ps(sample1, NextDitherSse2(&state1));
+        }
+        __m128i result0 = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(sample0, minimum), maximum));
+        __m128i result1 = _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(sample1, minimum), maximum));
+
+        uint8_t* target = Output + i * Bytes;
+        if (Bytes == 2)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target), _mm_packs_epi32(result0, result1));
+        }
+        else if (Bytes == 4)
+        {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target), result0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target + 16), result1);
+        }
+        else
+        {
+            //
+            //  SSE2 has no byte shuffle, so the 24 bit packing is done from memory.
+            //
+            int32_t results[8];
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(results), result0);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(results + 4), result1);
+            for (int j = 0; j < 8; j++)
+            {
+                target[j * 3] = static_cast<uint8_t>(results[j]);
+                target[j * 3 + 1] = static_cast<uint8_t>(results[j] >> 8);
+                target[j * 3 + 2] = static_cast<uint8_t>(results[j] >> 16);
+            }
+        }
+    }
+
+    if (DitherState != NULL)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(DitherState), state0);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(DitherState + 4), state1);
+    }
+}
+
+static const SampleConvertKernels Sse2Kernels = { ConvertSse2<2>, ConvertSse2<3>, ConvertSse2<4> };
+
+#endif
+
+bool CpuSupportsAvx2()
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+    {
+        return false;
+    }
+
+    //
+    //  The OS has to save the YMM registers too.
+    //
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0 || (_xgetbv(0) & 6) != 6)
+    {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") != 0;
+#else
+    return false;
+#endif
+}
+
+const char* SampleConvertKernelName(SampleConvertKernel Kernel)
+{
+    switch (Kernel)
+    {
+    case SampleKernelScalar: return "scalar";
+    case SampleKernelSse2: return "SSE2";
+    case SampleKernelAvx2: return "AVX2";
+    }
+    return "unknown";
+}
+
+CSampleConverter::CSampleConverter() :
+    _InputFrameSize(0),
+    _OutputFrameSize(0),
+    _Channels(0),
+    _OutputBytes(0),
+    _Kernel(SampleKernelScalar),
+    _Function(NULL),
+    _Dither(false),
+    _Lane(0)
+{
+    memset(&_OutputFormat, 0, sizeof(_OutputFormat));
+    memset(_DitherState, 0, sizeof(_DitherState));
+}
+
+bool CSampleConverter::Initialize(const WAVEFORMATEX* InputFormat, bool OutputFloat, WORD OutputBits, bool Dither, SampleConvertKernel MaxKernel)
+{
+    bool inputFloat = IsFloatFormat(InputFormat);
+    if (OutputFloat ? OutputBits != 32 : (OutputBits != 16 && OutputBits != 24 && OutputBits != 32))
+    {
+        fprintf(stderr, "Unsupported output sample format: %u bits %s.\n", OutputBits, OutputFloat ? "float" : "integer");
+        return false;
+    }
+
+    //
+    //  Asking for the capture format itself needs no conversion.  Otherwise we only convert from float, the shared
+    //  mode mix format.
+    //
+    bool isCopy = inputFloat == OutputFloat && InputFormat->wBitsPerSample == OutputBits;
+    if (!isCopy && (!inputFloat || InputFormat->wBitsPerSample != 32))
+    {
+        fprintf(stderr, "Sample format conversion needs 32 bit float capture data.\n");
+        return false;
+    }
+
+    DWORD channelMask = 0;
+    if (InputFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE && InputFormat->cbSize >= WAVEFORMATEXTENSIBLE_EXTRA_SIZE)
+    {
+        channelMask = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(InputFormat)->dwChannelMask;
+    }
+    InitializeWaveFormat(&_OutputFormat, OutputFloat, InputFormat->nChannels, InputFormat->nSamplesPerSec, OutputBits, channelMask);
+    _InputFrameSize = InputFormat->nBlockAlign;
+    _OutputFrameSize = _OutputFormat.Format.nBlockAlign;
+    _Channels = InputFormat->nChannels;
+    _OutputBytes = isCopy ? 0 : OutputBits / 8;
+
+    //
+    //  Pick the best kernel the CPU and this build have, up to MaxKernel.
+    //
+    const SampleConvertKernels* kernels = &ScalarKernels;
+    _Kernel = SampleKernelScalar;
+#ifdef SAMPLE_CONVERT_HAVE_SSE2
+    if (MaxKernel >= SampleKernelSse2)
+    {
+        kernels = &Sse2Kernels;
+        _Kernel = SampleKernelSse2;
+    }
+#endif
+    if (MaxKernel >= SampleKernelAvx2 && GetAvx2SampleConvertKernels() != NULL && CpuSupportsAvx2())
+    {
+        kernels = GetAvx2SampleConvertKernels();
+        _Kernel = SampleKernelAvx2;
+    }
+    _Function = _OutputBytes == 2 ? kernels->ToInt16 : _OutputBytes == 3 ? kernels->ToInt24 : kernels->ToInt32;
+
+    //
+    //  Fixed seeds keep the output reproducible.
+    //
+    _Dither = Dither && !isCopy;
+    for (uint32_t lane = 0; lane < SAMPLE_DITHER_LANES; lane++)
+    {
+        _DitherState[lane] = 0x9E3779B9u * (lane + 1);
+    }
+    _Lane = 0;
+    return true;
+}
+
+void CSampleConverter::Convert(const uint8_t* Input, uint8_t* Output, size_t Frames)
+{
+    if (_OutputBytes == 0)
+    {
+        if (Input != Output)
+        {
+            memmove(Output, Input, Frames * _InputFrameSize);
+        }
+        return;
+    }
+
+    //
+    //  Scalar up to the next lane 0, the kernel for whole lane groups, and scalar for the rest.
+    //
+    uint32_t* ditherState = _Dither ? _DitherState : NULL;
+    size_t count = Frames * _Channels;
+    size_t head = (SAMPLE_DITHER_LANES - _Lane) % SAMPLE_DITHER_LANES;
+    if (head > count)
+    {
+        head = count;
+    }
+    size_t body = (count - head) / SAMPLE_DITHER_LANES * SAMPLE_DITHER_LANES;
+    size_t tail = count - head - body;
+
+    for (int part = 0; part < 3; part++)
+    {
+        size_t partCount = part == 0 ? head : part == 1 ? body : tail;
+        if (partCount == 0)
+        {
+            continue;
+        }
+        if (part == 1)
+        {
+            _Function(Input, Output, partCount, ditherState);
+        }
+        else if (_OutputBytes == 2)
+        {
+            ConvertScalar<2>(Input, Output, partCount, ditherState, _Lane);
+        }
+        else if (_OutputBytes == 3)
+        {
+            ConvertScalar<3>(Input, Output, partCount, ditherState, _Lane);
+        }
+        else
+        {
+            ConvertScalar<4>(Input, Output, partCount, ditherState, _Lane);
+        }
+        _Lane = static_cast<uint32_t>((_Lane + partCount) % SAMPLE_DITHER_LANES);
+        Input += partCount * 4;
+        Output += partCount * _OutputBytes;
+    }
+}
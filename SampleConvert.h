@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "AudioFormat.h"
+#include "SampleConvertKernels.h"
+
+//
+//  Instruction sets the converter can use, in order of preference.
+//
+enum SampleConvertKernel
+{
+    SampleKernelScalar,
+    SampleKernelSse2,
+    SampleKernelAvx2,
+};
+
+const char* SampleConvertKernelName(SampleConvertKernel Kernel);
+
+//
+//  Converts captured float samples to 16, 24 or 32 bit integer PCM.
+//
+//  Convert() streams: the dither sequence carries on from one call to the next, so converting a stream in pieces gives
+//  the same result as converting it at once.  It runs the fastest kernel the CPU supports (up to MaxKernel) on whole
+//  lane groups and the scalar reference on the ends.  An output format equal to the input format is a plain copy.
+//
+class CSampleConverter
+{
+public:
+    CSampleConverter();
+
+    bool Initialize(const WAVEFORMATEX* InputFormat, bool OutputFloat, WORD OutputBits, bool Dither,
+        SampleConvertKernel MaxKernel = SampleKernelAvx2);
+
+    const WAVEFORMATEX* OutputFormat() const { return &_OutputFormat.Format; }
+    size_t InputFrameSize() const { return _InputFrameSize; }
+    size_t OutputFrameSize() const { return _OutputFrameSize; }
+    SampleConvertKernel Kernel() const { return _Kernel; }
+
+    //
+    //  Output may be Input (in place conversion).
+    //
+    void Convert(const uint8_t* Input, uint8_t* Output, size_t Frames);
+
+private:
+    WAVEFORMATEXTENSIBLE    _OutputFormat;
+    size_t                  _InputFrameSize;
+    size_t                  _OutputFrameSize;
+    uint32_t                _Channels;
+    uint32_t                _OutputBytes;       // Per sample; 0 for a plain copy.
+    SampleConvertKernel     _Kernel;
+    SampleConvertFunction   _Function;
+    bool                    _Dither;
+    uint32_t                _DitherState[SAMPLE_DITHER_LANES];
+    uint32_t                _Lane;              // Lane of the next sample.
+};
@@ -0,0 +1,102 @@
+#include <string.h>
+#include "SampleConvertKernels.h"
+
+//
+//  Built with AVX2 code generation enabled where the compiler supports it; the dispatcher in SampleConvert.cpp only
+//  calls in here after checking the CPU.
+//
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+//
+//  Steps all eight dither lanes and returns their TPDF values in LSB.
+//
+static inline __m256 NextDitherAvx2(__m256i* State)
+{
+    __m256i state = *State;
+    state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 13));
+    state = _mm256_xor_si256(state, _mm256_srli_epi32(state, 17));
+    state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 5));
+    *State = state;
+    __m256i dither = _mm256_add_epi32(_mm256_and_si256(state, _mm256_set1_epi32(0xFFFF)), _mm256_srli_epi32(state, 16));
+    dither = _mm256_sub_epi32(dither, _mm256_set1_epi32(65535));
+    return _mm256_mul_ps(_mm256_cvtepi32_ps(dither), _mm256_set1_ps(1.0f / 65536.0f));
+}
+
+//
+//  Eight samples per iteration.  As with SSE2, all input of an iteration is loaded before anything is stored.
+//
+template <int Bytes>
+static void ConvertAvx2(const uint8_t* Input, uint8_t* Output, size_t Count, uint32_t* DitherState)
+{
+    const float scale = Bytes == 2 ? SAMPLE_SCALE_16 : Bytes == 3 ? SAMPLE_SCALE_24 : SAMPLE_SCALE_32;
+    const __m256 scaleVector = _mm256_set1_ps(scale);
+    const __m256 minimum = _mm256_set1_ps(-scale);
+    const __m256 maximum = _mm256_set1_ps(Bytes == 2 ? SAMPLE_MAX_16 : Bytes == 3 ? SAMPLE_MAX_24 : SAMPLE_MAX_32);
+
+    //
+    //  Gathers the low three bytes of each 32 bit sample at the bottom of each 128 bit half.
+    //
+    const __m256i pack24 = _mm256_setr_epi8(
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1,
+        0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+
+    __m256i state = _mm256_setzero_si256();
+    if (DitherState != NULL)
+    {
+        state = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(DitherState));
+    }
+
+    for (size_t i = 0; i < Count; i += 8)
+    {
+        __m256 sample = _mm256_mul_ps(_mm256_loadu_ps(reinterpret_cast<const float*>(Input + i * 4)), scaleVector);
+        if (DitherState != NULL)
+        {
+            sample = _mm256_add_ps(sample, NextDitherAvx2(&state));
+        }
+        __m256i result = _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(sample, minimum), maximum));
+
+        uint8_t* target = Output + i * Bytes;
+        if (Bytes == 2)
+        {
+            __m128i packed = _mm_packs_epi32(_mm256_castsi256_si128(result), _mm256_extracti128_si256(result, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(target), packed);
+        }
+        else if (Bytes == 4)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(target), result);
+        }
+        else
+        {
+            //
+            //  Twelve bytes from each half; copying them out avoids writing past the end of the output.
+            //
+            uint8_t packed[32];
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(packed), _mm256_shuffle_epi8(result, pack24));
+            memcpy(target, packed, 12);
+            memcpy(target + 12, packed + 16, 12);
+        }
+    }
+
+    if (DitherState != NULL)
+    {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(DitherState), state);
+    }
+}
+
+static const SampleConvertKernels Avx2Kernels = { ConvertAvx2<2>, ConvertAvx2<3>, ConvertAvx2<4> };
+
+const SampleConvertKernels* GetAvx2SampleConvertKernels()
+{
+    return &Avx2Kernels;
+}
+
+#else
+
+const SampleConvertKernels* GetAvx2SampleConvertKernels()
+{
+    return NULL;
+}
+
+#endif
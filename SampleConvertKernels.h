@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+//  Float to integer sample conversion kernels, shared by the scalar, SSE2 and AVX2 implementations.
+//
+//  This header must stay free of inline code: SampleConvertAvx2.cpp is built with AVX2 enabled, and an inline
+//  function instantiated there could be the copy the linker keeps for everyone else.
+//
+
+//
+//  Samples are scaled by 2^(bits - 1), TPDF dithered if requested, clipped to the output range and rounded to
+//  nearest even.  32 bit output is clipped to the largest float below 2^31.
+//
+#define SAMPLE_SCALE_16     32768.0f
+#define SAMPLE_SCALE_24     8388608.0f
+#define SAMPLE_SCALE_32     2147483648.0f
+#define SAMPLE_MAX_16       32767.0f
+#define SAMPLE_MAX_24       8388607.0f
+#define SAMPLE_MAX_32       2147483520.0f
+
+//
+//  TPDF dither comes from SAMPLE_DITHER_LANES independent xorshift32 generators; sample i of a stream uses lane
+//  i % SAMPLE_DITHER_LANES.  Each step, the two 16 bit halves of the lane's next value are summed into a triangular
+//  value of (hi + lo - 65535) / 65536 LSB.  Since the lanes line up with SIMD registers, every kernel produces
+//  exactly the scalar result.
+//
+#define SAMPLE_DITHER_LANES 8
+
+//
+//  Convert Count float samples from Input to the kernel's output format.  Count is a multiple of
+//  SAMPLE_DITHER_LANES, the first sample is in lane 0, and DitherState is the lanes' state, or NULL for no dither.
+//  Output may be Input; neither needs to be aligned.
+//
+typedef void (*SampleConvertFunction)(const uint8_t* Input, uint8_t* Output, size_t Count, uint32_t* DitherState);
+
+struct SampleConvertKernels
+{
+    SampleConvertFunction ToInt16;
+    SampleConvertFunction ToInt24;
+    SampleConvertFunction ToInt32;
+};
+
+//
+//  The AVX2 kernels, or NULL if this build has none.  Only call them if CpuSupportsAvx2().
+//
+const SampleConvertKernels* GetAvx2SampleConvertKernels();
+
+//
+//  True if the CPU and the OS support AVX2.
+//
+bool CpuSupportsAvx2();
@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "SegmentedSink.h"
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+//  The file name without its directory, with the characters JSON strings can't hold as they are escaped.
+//
+static std::string ManifestName(const std::string& FileName)
+{
+    size_t slash = FileName.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? FileName : FileName.substr(slash + 1);
+    std::string escaped;
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        if (name[i] == '"' || name[i] == '\\')
+        {
+            escaped += '\\';
+        }
+        escaped += name[i];
+    }
+    return escaped;
+}
+
+CSegmentedSink::CSegmentedSink() :
+    _PacketLog(NULL),
+    _FrameSize(0),
+    _MaxSegmentBytes(UINT64_MAX),
+    _Position(0),
+    _SegmentStart(0),
+    _RotateAt(UINT64_MAX),
+    _WallTimePending(false),
+    _HaveRecord(false),
+    _RotationRequested(false),
+    _Next(NULL),
+    _NextIndex(0),
+    _PrepareNext(false),
+    _Stopping(false),
+    _Failed(false),
+    _Segments(0),
+    _Stalls(0),
+    _TotalRotationNs(0),
+    _MaxRotationNs(0)
+{
+    memset(&_Format, 0, sizeof(_Format));
+    memset(&_Options, 0, sizeof(_Options));
+    memset(&_Current, 0, sizeof(_Current));
+    memset(&_LastRecord, 0, sizeof(_LastRecord));
+}
+
+CSegmentedSink::~CSegmentedSink()
+{
+    Close();
+}
+
+std::string CSegmentedSink::SegmentFileName(const std::string& FileName, uint32_t Index)
+{
+    size_t dot = FileName.find_last_of('.');
+    size_t slash = FileName.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        dot = FileName.size();
+    }
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%06u", Index);
+    return FileName.substr(0, dot) + suffix + FileName.substr(dot);
+}
+
+std::string CSegmentedSink::ManifestFileName(const std::string& FileName)
+{
+    size_t dot = FileName.find_last_of('.');
+    size_t slash = FileName.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        dot = FileName.size();
+    }
+    return FileName.substr(0, dot) + ".segments.jsonl";
+}
+
+bool CSegmentedSink::Open(const std::string& FileName, const WAVEFORMATEX* Format, const SegmentOptions& Options, CCapturePacketLog* PacketLog)
+{
+    _FileName = FileName;
+    size_t formatSize = sizeof(WAVEFORMATEX) + Format->cbSize;
+    memcpy(&_Format, Format, formatSize < sizeof(_Format) ? formatSize : sizeof(_Format));
+    _Options = Options;
+    _PacketLog = PacketLog;
+    _FrameSize = Format->nBlockAlign;
+
+    //
+    //  Both limits come down to a whole number of frames per segment.
+    //
+    _MaxSegmentBytes = Options.MaxFrames != 0 ? Options.MaxFrames * _FrameSize : UINT64_MAX;
+    if (Options.MaxBytes != 0)
+    {
+        _MaxSegmentBytes = std::min(_MaxSegmentBytes, Options.MaxBytes / _FrameSize * _FrameSize);
+    }
+    if (_MaxSegmentBytes == 0)
+    {
+        fprintf(stderr, "Segments must hold at least one frame.\n");
+        return false;
+    }
+
+    std::string manifestFileName = ManifestFileName(FileName);
+    if (!_Manifest.Create(manifestFileName))
+    {
+        fprintf(stderr, "Unable to create segment manifest %s: %d\n", manifestFileName.c_str(), COutputFile::LastError());
+        return false;
+    }
+    char line[256];
+    int length = snprintf(line, sizeof(line), "{\"sampleRate\":%u,\"channels\":%u,\"bitsPerSample\":%u,\"float\":%s,\"frameSize\":%u,\"fileFormat\":\"%s\"}\n",
+        static_cast<unsigned int>(Format->nSamplesPerSec),
+        static_cast<unsigned int>(Format->nChannels),
+        static_cast<unsigned int>(Format->wBitsPerSample),
+        IsFloatFormat(Format) ? "true" : "false",
+        static_cast<unsigned int>(_FrameSize),
+        Options.FileFormat == SegmentFileWav ? "wav" : "pcm");
+    if (!_Manifest.Write(line, static_cast<size_t>(length)))
+    {
+        fprintf(stderr, "Unable to write segment manifest: %d\n", COutputFile::LastError());
+        _Manifest.Close();
+        return false;
+    }
+
+    //
+    //  The first segment is opened here; from then on the worker keeps the next one ready.
+    //
+    _Current.Sink = CreateSegmentSink(0);
+    if (_Current.Sink == NULL)
+    {
+        _Manifest.Close();
+        return false;
+    }
+    _Current.Index = 0;
+    _Current.Frame = 0;
+    _Current.WallTimeNs = 0;
+    _WallTimePending = true;
+    _Position = 0;
+    _SegmentStart = 0;
+    _RotateAt = UINT64_MAX;
+    _Segments.store(1, std::memory_order_relaxed);
+
+    _Next = NULL;
+    _NextIndex = 1;
+    _PrepareNext = true;
+    _Stopping = false;
+    _Worker = std::thread(&CSegmentedSink::WorkerThread, this);
+    return true;
+}
+
+bool CSegmentedSink::Write(const uint8_t* Data, size_t Size)
+{
+    if (_Failed.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+    if (_RotationRequested.exchange(false, std::memory_order_acq_rel))
+    {
+        _RotateAt = (_Position + _FrameSize - 1) / _FrameSize * _FrameSize;
+    }
+
+    while (Size != 0)
+    {
+        //
+        //  Rotations happen lazily, when there's data for the next segment, so the last one is never empty.
+        //
+        if (_Position == _RotateAt)
+        {
+            _RotateAt = UINT64_MAX;
+            if (_Position != _SegmentStart && !Rotate("signal"))
+            {
+                return false;
+            }
+        }
+        if (_Position - _SegmentStart == _MaxSegmentBytes &&
+            !Rotate(_Options.MaxFrames != 0 && _MaxSegmentBytes == _Options.MaxFrames * _FrameSize ? "duration" : "size"))
+        {
+            return false;
+        }
+        if (_WallTimePending)
+        {
+            _Current.WallTimeNs = LookupWallTime(_Current.Frame);
+            _WallTimePending = false;
+        }
+
+        uint64_t end = std::min(_RotateAt, _MaxSegmentBytes != UINT64_MAX ? _SegmentStart + _MaxSegmentBytes : UINT64_MAX);
+        size_t bytes = static_cast<size_t>(std::min<uint64_t>(Size, end - _Position));
+        if (!_Current.Sink->Write(Data, bytes))
+        {
+            return false;
+        }
+        Data += bytes;
+        Size -= bytes;
+        _Position += bytes;
+    }
+
+    //
+    //  Keep up with the packet log, or it fills up between segments.
+    //
+    if (_Position != 0)
+    {
+        LookupWallTime((_Position - 1) / _FrameSize);
+    }
+    return true;
+}
+
+bool CSegmentedSink::Flush()
+{
+    if (_Failed.load(std::memory_order_acquire))
+    {
+        return false;
+    }
+    return _Current.Sink->Flush();
+}
+
+bool CSegmentedSink::Close()
+{
+    if (!_Worker.joinable())
+    {
+        return true;
+    }
+
+    //
+    //  The worker finishes the last segment after the others, then the file it opened ahead is thrown away.
+    //
+    {
+        std::lock_guard<std::mutex> lock(_Lock);
+        Segment last = _Current;
+        last.Frames = (_Position - _SegmentStart) / _FrameSize;
+        last.Reason = "end";
+        _Finishing.push_back(last);
+        _Stopping = true;
+    }
+    _WorkAvailable.notify_one();
+    _Worker.join();
+    _Current.Sink = NULL;
+    if (_Next != NULL)
+    {
+        _Next->Close();
+        delete _Next;
+        _Next = NULL;
+        remove(SegmentFileName(_FileName, _NextIndex).c_str());
+    }
+    _Manifest.Close();
+    return !_Failed.load(std::memory_order_acquire);
+}
+
+void CSegmentedSink::GetStats(SegmentedSinkStats* Stats) const
+{
+    Stats->Segments = _Segments.load(std::memory_order_relaxed);
+    Stats->Stalls = _Stalls.load(std::memory_order_relaxed);
+    Stats->TotalRotationUs = _TotalRotationNs.load(std::memory_order_relaxed) / 1000;
+    Stats->MaxRotationUs = _MaxRotationNs.load(std::memory_order_relaxed) / 1000;
+}
+
+IOutputSink* CSegmentedSink::CreateSegmentSink(uint32_t Index)
+{
+    std::string fileName = SegmentFileName(_FileName, Index);
+    if (_Options.FileFormat == SegmentFileWav)
+    {
+        CWavFileSink* sink = new CWavFileSink();
+        if (!sink->Open(fileName, &_Format.Format, _Options.PreallocateBytes))
+        {
+            delete sink;
+            return NULL;
+        }
+        return sink;
+    }
+    CPcmFileSink* sink = new CPcmFileSink();
+    if (!sink->Open(fileName, _Options.PreallocateBytes))
+    {
+        delete sink;
+        return NULL;
+    }
+    return sink;
+}
+
+//
+//  Swap in the file the worker opened ahead, waiting for it only if the worker is behind, and hand the finished
+//  segment to the worker.
+//
+bool CSegmentedSink::Rotate(const char* Reason)
+{
+    int64_t start = SteadyClockNs();
+    Segment finished = _Current;
+    finished.Frames = (_Position - _SegmentStart) / _FrameSize;
+    finished.Reason = Reason;
+    {
+        std::unique_lock<std::mutex> lock(_Lock);
+        if (_Next == NULL && !_Failed.load(std::memory_order_acquire))
+        {
+            _Stalls.fetch_add(1, std::memory_order_relaxed);
+            _NextReady.wait(lock, [this]() { return _Next != NULL || _Failed.load(std::memory_order_acquire); });
+        }
+        if (_Next == NULL)
+        {
+            return false;
+        }
+        _Current.Sink = _Next;
+        _Current.Index = _NextIndex;
+        _Next = NULL;
+        _NextIndex++;
+        _PrepareNext = true;
+        _Finishing.push_back(finished);
+    }
+    _WorkAvailable.notify_one();
+
+    _Current.Frame = _Position / _FrameSize;
+    _Current.WallTimeNs = 0;
+    _WallTimePending = true;
+    _SegmentStart = _Position;
+    _Segments.fetch_add(1, std::memory_order_relaxed);
+
+    uint64_t elapsed = static_cast<uint64_t>(SteadyClockNs() - start);
+    _TotalRotationNs.fetch_add(elapsed, std::memory_order_relaxed);
+    if (elapsed > _MaxRotationNs.load(std::memory_order_relaxed))
+    {
+        _MaxRotationNs.store(elapsed, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+//
+//  Capture time of a frame from the packet log.  Frames the log has no record for are extrapolated from the last
+//  record, or 0 without one.
+//
+int64_t CSegmentedSink::LookupWallTime(uint64_t Frame)
+{
+    CapturePacketRecord record;
+    if (_PacketLog != NULL && _PacketLog->Lookup(Frame, &record))
+    {
+        _LastRecord = record;
+        _HaveRecord = true;
+    }
+    if (!_HaveRecord || _LastRecord.WallTimeNs == 0)
+    {
+        return 0;
+    }
+    int64_t offsetFrames = static_cast<int64_t>(Frame) - static_cast<int64_t>(_LastRecord.Frame);
+    return _LastRecord.WallTimeNs + offsetFrames * 1000000000 / static_cast<int64_t>(_Format.Format.nSamplesPerSec);
+}
+
+//
+//  Make a segment durable, close it and only then list it in the manifest.
+//
+bool CSegmentedSink::FinishSegment(const Segment& Finished)
+{
+    bool succeeded = Finished.Sink->Flush();
+    succeeded = Finished.Sink->Close() && succeeded;
+    delete Finished.Sink;
+    if (!succeeded)
+    {
+        fprintf(stderr, "Unable to finish segment %u.\n", Finished.Index);
+        return false;
+    }
+
+    std::string line = "{\"segment\":" + std::to_string(Finished.Index) +
+        ",\"file\":\"" + ManifestName(SegmentFileName(_FileName, Finished.Index)) +
+        "\",\"startFrame\":" + std::to_string(Finished.Frame) +
+        ",\"frames\":" + std::to_string(Finished.Frames) +
+        ",\"dataBytes\":" + std::to_string(Finished.Frames * _FrameSize) +
+        ",\"startWallTimeNs\":" + std::to_string(Finished.WallTimeNs) +
+        ",\"reason\":\"" + Finished.Reason + "\"}\n";
+    if (!_Manifest.Write(line.data(), line.size()) || !_Manifest.Flush())
+    {
+        fprintf(stderr, "Unable to write segment manifest: %d\n", COutputFile::LastError());
+        return false;
+    }
+    return true;
+}
+
+//
+//  Opening the next file comes first, since a rotation may be waiting for it; finishing the old ones can wait.
+//
+void CSegmentedSink::WorkerThread()
+{
+    std::unique_lock<std::mutex> lock(_Lock);
+    for (;;)
+    {
+        _WorkAvailable.wait(lock, [this]() { return _Stopping || _PrepareNext || !_Finishing.empty(); });
+        if (_PrepareNext && !_Stopping)
+        {
+            _PrepareNext = false;
+            uint32_t index = _NextIndex;
+            lock.unlock();
+            IOutputSink* sink = CreateSegmentSink(index);
+            lock.lock();
+            _Next = sink;
+            if (sink == NULL)
+            {
+                _Failed.store(true, std::memory_order_release);
+            }
+            _NextReady.notify_all();
+        }
+        else if (!_Finishing.empty())
+        {
+            Segment finished = _Finishing.front();
+            _Finishing.pop_front();
+            lock.unlock();
+            bool succeeded = FinishSegment(finished);
+            lock.lock();
+            if (!succeeded)
+            {
+                _Failed.store(true, std::memory_order_release);
+                _NextReady.notify_all();
+            }
+        }
+        else if (_Stopping)
+        {
+            break;
+        }
+    }
+}
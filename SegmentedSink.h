@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "AudioFormat.h"
+#include "OutputSink.h"
+#include "CapturePacketLog.h"
+
+enum SegmentFileFormat
+{
+    SegmentFilePcm,
+    SegmentFileWav,
+};
+
+//
+//  When a segment ends: once it holds MaxFrames frames or MaxBytes bytes of audio (0 for no limit), or at the first
+//  frame boundary after RequestRotation().  Each new file reserves PreallocateBytes of disk space, 0 for none.
+//
+struct SegmentOptions
+{
+    SegmentFileFormat   FileFormat;
+    uint64_t            MaxFrames;
+    uint64_t            MaxBytes;
+    uint64_t            PreallocateBytes;
+};
+
+//
+//  Sink statistics.  A stall is a rotation that had to wait for the next file to be opened; RotationUs is the time
+//  rotations held up the writer thread.
+//
+struct SegmentedSinkStats
+{
+    uint64_t Segments;
+    uint64_t Stalls;
+    uint64_t TotalRotationUs;
+    uint64_t MaxRotationUs;
+};
+
+//
+//  Writes the recording as a series of PCM or WAV files, <name>_000000.<ext>, <name>_000001.<ext>, ..., without
+//  stopping capture.
+//
+//  Segments are cut on frame boundaries of the byte stream, so together they hold every frame exactly once.  A
+//  background thread opens and preallocates the next file ahead of time and finishes the previous one (flush,
+//  trim, header), so a rotation on the writer thread only swaps files.  Once a segment is finished and durable, it
+//  gets a line in the manifest <name>.segments.jsonl: its file, first frame, frame count, size, the capture time of
+//  its first frame (system clock nanoseconds since the Unix epoch, from the packet log; 0 if unknown) and why it
+//  ended.  The manifest's first line describes the audio format.  Segments listed there can be shipped or deleted
+//  while the recording goes on; the packet log, if any, must be the sink's alone.
+//
+class CSegmentedSink : public IOutputSink
+{
+public:
+    CSegmentedSink();
+    ~CSegmentedSink();
+
+    bool Open(const std::string& FileName, const WAVEFORMATEX* Format, const SegmentOptions& Options, CCapturePacketLog* PacketLog);
+    bool Write(const uint8_t* Data, size_t Size);
+    bool Flush();
+    bool Close();
+
+    //
+    //  End the current segment at the next frame boundary.  Any thread.
+    //
+    void RequestRotation() { _RotationRequested.store(true, std::memory_order_release); }
+
+    void GetStats(SegmentedSinkStats* Stats) const;
+
+    static std::string SegmentFileName(const std::string& FileName, uint32_t Index);
+    static std::string ManifestFileName(const std::string& FileName);
+
+private:
+    struct Segment
+    {
+        IOutputSink*    Sink;
+        uint32_t        Index;
+        uint64_t        Frame;
+        uint64_t        Frames;
+        int64_t         WallTimeNs;
+        const char*     Reason;
+    };
+
+    IOutputSink* CreateSegmentSink(uint32_t Index);
+    bool Rotate(const char* Reason);
+    int64_t LookupWallTime(uint64_t Frame);
+    bool FinishSegment(const Segment& Finished);
+    void WorkerThread();
+
+    std::string             _FileName;
+    WAVEFORMATEXTENSIBLE    _Format;
+    SegmentOptions          _Options;
+    CCapturePacketLog*      _PacketLog;
+    size_t                  _FrameSize;
+    uint64_t                _MaxSegmentBytes;   // Both limits, in whole frames; UINT64_MAX for none.
+    COutputFile             _Manifest;          // Worker thread only, once open.
+
+    //
+    //  Writer thread only.
+    //
+    Segment                 _Current;
+    uint64_t                _Position;          // Bytes of the stream so far.
+    uint64_t                _SegmentStart;      // Byte of the stream where _Current starts.
+    uint64_t                _RotateAt;          // Byte where a requested rotation happens; UINT64_MAX for none.
+    bool                    _WallTimePending;   // _Current.WallTimeNs isn't looked up yet.
+    CapturePacketRecord     _LastRecord;
+    bool                    _HaveRecord;
+    std::atomic<bool>       _RotationRequested;
+
+    //
+    //  Shared with the worker thread.  _Next is the file opened ahead, NULL while the worker is still at it.
+    //
+    std::mutex              _Lock;
+    std::condition_variable _WorkAvailable;
+    std::condition_variable _NextReady;
+    IOutputSink*            _Next;
+    uint32_t                _NextIndex;
+    bool                    _PrepareNext;
+    std::deque<Segment>     _Finishing;
+    bool                    _Stopping;
+    std::thread             _Worker;
+    std::atomic<bool>       _Failed;
+
+    std::atomic<uint64_t>   _Segments;
+    std::atomic<uint64_t>   _Stalls;
+    std::atomic<uint64_t>   _TotalRotationNs;
+    std::atomic<uint64_t>   _MaxRotationNs;
+};
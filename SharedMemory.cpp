@@ -0,0 +1,208 @@
+#include <errno.h>
+#include <string.h>
+#include "SharedMemory.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CSharedMemory::CSharedMemory() :
+#ifdef _WIN32
+    _Mapping(NULL),
+#endif
+    _Data(NULL),
+    _Size(0)
+{
+}
+
+CSharedMemory::~CSharedMemory()
+{
+    Close();
+}
+
+#ifdef _WIN32
+
+//
+//  Plain names go to the session namespace, so no privilege is needed to create them.
+//
+std::string CSharedMemory::ObjectName(const std::string& Name) const
+{
+    return Name.find('\\') == std::string::npos ? "Local\\" + Name : Name;
+}
+
+bool CSharedMemory::Create(const std::string& Name, size_t Size)
+{
+    Close();
+    uint64_t size = Size;
+    _Mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, static_cast<DWORD>(size >> 32),
+        static_cast<DWORD>(size), ObjectName(Name).c_str());
+    if (_Mapping == NULL)
+    {
+        return false;
+    }
+
+    //
+    //  A mapping with this name that is still open elsewhere can't be replaced, and may have the wrong size.
+    //
+    if (GetLastError() == ERROR_ALREADY_EXISTS)
+    {
+        CloseHandle(_Mapping);
+        _Mapping = NULL;
+        SetLastError(ERROR_ALREADY_EXISTS);
+        return false;
+    }
+
+    _Data = static_cast<uint8_t*>(MapViewOfFile(_Mapping, FILE_MAP_WRITE, 0, 0, Size));
+    if (_Data == NULL)
+    {
+        Close();
+        return false;
+    }
+    _Size = Size;
+    _CreatedName = Name;
+    return true;
+}
+
+bool CSharedMemory::Open(const std::string& Name)
+{
+    Close();
+    _Mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, ObjectName(Name).c_str());
+    if (_Mapping == NULL)
+    {
+        return false;
+    }
+    _Data = static_cast<uint8_t*>(MapViewOfFile(_Mapping, FILE_MAP_READ, 0, 0, 0));
+    MEMORY_BASIC_INFORMATION info;
+    if (_Data == NULL || VirtualQuery(_Data, &info, sizeof(info)) == 0)
+    {
+        Close();
+        return false;
+    }
+    _Size = info.RegionSize;
+    return true;
+}
+
+void CSharedMemory::Close()
+{
+    if (_Data != NULL)
+    {
+        UnmapViewOfFile(_Data);
+        _Data = NULL;
+    }
+    if (_Mapping != NULL)
+    {
+        CloseHandle(_Mapping);
+        _Mapping = NULL;
+    }
+    _Size = 0;
+    _CreatedName.clear();
+}
+
+int CSharedMemory::LastError()
+{
+    return static_cast<int>(GetLastError());
+}
+
+#else
+
+//
+//  POSIX shm names are a single path component with a leading slash.
+//
+std::string CSharedMemory::ObjectName(const std::string& Name) const
+{
+    return Name.empty() || Name[0] != '/' ? "/" + Name : Name;
+}
+
+bool CSharedMemory::Create(const std::string& Name, size_t Size)
+{
+    Close();
+    std::string objectName = ObjectName(Name);
+
+    //
+    //  Unlinking first means readers still attached to an old segment keep it, and the new one starts out zeroed.
+    //
+    shm_unlink(objectName.c_str());
+    int fd = shm_open(objectName.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if (fd < 0)
+    {
+        return false;
+    }
+    if (ftruncate(fd, static_cast<off_t>(Size)) != 0)
+    {
+        int error = errno;
+        close(fd);
+        shm_unlink(objectName.c_str());
+        errno = error;
+        return false;
+    }
+
+    void* data = mmap(NULL, Size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        shm_unlink(objectName.c_str());
+        errno = error;
+        return false;
+    }
+    _Data = static_cast<uint8_t*>(data);
+    _Size = Size;
+    _CreatedName = objectName;
+    return true;
+}
+
+bool CSharedMemory::Open(const std::string& Name)
+{
+    Close();
+    int fd = shm_open(ObjectName(Name).c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat status;
+    if (fstat(fd, &status) != 0 || status.st_size <= 0)
+    {
+        int error = errno;
+        close(fd);
+        errno = error != 0 ? error : EINVAL;
+        return false;
+    }
+
+    size_t size = static_cast<size_t>(status.st_size);
+    void* data = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    int error = errno;
+    close(fd);
+    if (data == MAP_FAILED)
+    {
+        errno = error;
+        return false;
+    }
+    _Data = static_cast<uint8_t*>(data);
+    _Size = size;
+    return true;
+}
+
+void CSharedMemory::Close()
+{
+    if (_Data != NULL)
+    {
+        munmap(_Data, _Size);
+        _Data = NULL;
+    }
+    if (!_CreatedName.empty())
+    {
+        shm_unlink(_CreatedName.c_str());
+        _CreatedName.clear();
+    }
+    _Size = 0;
+}
+
+int CSharedMemory::LastError()
+{
+    return errno;
+}
+
+#endif
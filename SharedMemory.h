@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "AudioFormat.h"
+
+//
+//  Named shared memory segment: a POSIX shm object (shm_open + mmap) or a Win32 file mapping.
+//
+//  The creator maps it read/write and removes the name again in Close(); readers map it read only.  Mappings that
+//  are still open keep the memory alive after the name is gone, so a reader never faults when the writer exits.
+//
+class CSharedMemory
+{
+public:
+    CSharedMemory();
+    ~CSharedMemory();
+
+    //
+    //  Create a zero filled segment.  A stale segment left under the same name by a process that died is replaced.
+    //
+    bool Create(const std::string& Name, size_t Size);
+    bool Open(const std::string& Name);
+    void Close();
+
+    bool IsOpen() const { return _Data != NULL; }
+    uint8_t* Data() const { return _Data; }
+    size_t Size() const { return _Size; }
+
+    //
+    //  The last OS error code (GetLastError() or errno).
+    //
+    static int LastError();
+
+private:
+    CSharedMemory(const CSharedMemory&);
+    CSharedMemory& operator=(const CSharedMemory&);
+
+    std::string ObjectName(const std::string& Name) const;
+
+#ifdef _WIN32
+    HANDLE      _Mapping;
+#endif
+    uint8_t*    _Data;
+    size_t      _Size;
+    std::string _CreatedName;       // Set when we own the name.
+};
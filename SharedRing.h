@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "AudioFormat.h"
+
+//
+//  Layout of the shared memory ring published by CSharedRingSink and read by CSharedRingReader.
+//
+//  The segment holds a SharedRingHeader, a table of BlockCount SharedRingBlock entries at BlockTableOffset, and
+//  DataSize bytes of audio at DataOffset.  Byte n of the stream lives at DataOffset + n % DataSize.  Positions are
+//  64 bit byte counts since the writer started and never wrap.
+//
+//  The writer never waits for readers.  Before it overwrites anything it raises WriteReserve to the end of the range
+//  it is about to write, and once the bytes are in place it raises WriteCursor to the same value.  A reader owns
+//  [Position, WriteCursor), and data at Position is intact as long as WriteReserve - DataSize <= Position after the
+//  reader is done with it, so a reader that fell a full ring behind sees that it was lapped instead of reading torn
+//  audio.
+//
+//  The data area is cut into blocks of BlockSize bytes.  When the writer starts stream block k (bytes k * BlockSize
+//  and up), it stamps table entry k % BlockCount with the steady clock time (CLOCK_MONOTONIC / QPC, in nanoseconds,
+//  comparable across processes) and sets its Sequence to k + 1.
+//
+#define SHARED_RING_MAGIC       0x474E5241      // "ARNG"
+#define SHARED_RING_VERSION     1
+
+enum SharedRingState
+{
+    SharedRingWriting = 1,
+    SharedRingClosed = 2,       // The writer stopped; WriteCursor won't move again.
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "The shared ring needs lock free 64 bit atomics");
+
+struct SharedRingHeader
+{
+    uint32_t                Magic;
+    uint32_t                Version;
+    uint32_t                HeaderSize;
+    uint32_t                BlockSize;
+    uint32_t                BlockCount;
+    uint32_t                FrameSize;
+    uint64_t                BlockTableOffset;
+    uint64_t                DataOffset;
+    uint64_t                DataSize;           // BlockSize * BlockCount.
+    WAVEFORMATEXTENSIBLE    Format;
+
+    //
+    //  Written by the writer only.  On their own cache line so readers polling them don't share it with anything else.
+    //
+    alignas(64) std::atomic<uint64_t>   WriteCursor;
+    std::atomic<uint64_t>               WriteReserve;
+    std::atomic<uint32_t>               State;
+};
+
+struct SharedRingBlock
+{
+    std::atomic<uint64_t>   Sequence;           // Stream block number + 1; 0 while the entry is being rewritten.
+    std::atomic<int64_t>    TimestampNs;
+};
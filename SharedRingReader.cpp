@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "SharedRingReader.h"
+
+//
+//  Readers build this library into their own programs, which may include windows.h without NOMINMAX, so std::min and
+//  std::max are written in parentheses to keep its macros out.
+//
+
+CSharedRingReader::CSharedRingReader() :
+    _Header(NULL),
+    _Blocks(NULL),
+    _Data(NULL),
+    _DataSize(0),
+    _BlockSize(0),
+    _BlockCount(0),
+    _FrameSize(0),
+    _Position(0),
+    _LostBytes(0)
+{
+}
+
+bool CSharedRingReader::Open(const std::string& Name)
+{
+    Close();
+    if (!_Memory.Open(Name))
+    {
+        return false;
+    }
+
+    //
+    //  The writer publishes State last, so a ring that is still being set up looks like a missing one.
+    //
+    const SharedRingHeader* header = reinterpret_cast<const SharedRingHeader*>(_Memory.Data());
+    if (_Memory.Size() < sizeof(SharedRingHeader) || header->State.load(std::memory_order_acquire) == 0)
+    {
+        _Memory.Close();
+        return false;
+    }
+    if (header->Magic != SHARED_RING_MAGIC || header->Version != SHARED_RING_VERSION ||
+        header->HeaderSize != sizeof(SharedRingHeader) || header->FrameSize == 0 || header->BlockSize == 0 ||
+        header->BlockSize % header->FrameSize != 0 ||
+        header->DataSize != static_cast<uint64_t>(header->BlockSize) * header->BlockCount ||
+        header->BlockTableOffset + static_cast<uint64_t>(header->BlockCount) * sizeof(SharedRingBlock) > header->DataOffset ||
+        header->DataOffset + header->DataSize > _Memory.Size())
+    {
+        fprintf(stderr, "%s is not a shared memory ring this reader understands.\n", Name.c_str());
+        _Memory.Close();
+        return false;
+    }
+
+    _Header = header;
+    _Blocks = reinterpret_cast<const SharedRingBlock*>(_Memory.Data() + header->BlockTableOffset);
+    _Data = _Memory.Data() + header->DataOffset;
+    _DataSize = header->DataSize;
+    _BlockSize = header->BlockSize;
+    _BlockCount = header->BlockCount;
+    _FrameSize = header->FrameSize;
+    _LostBytes = 0;
+
+    uint64_t cursor = _Header->WriteCursor.load(std::memory_order_acquire);
+    _Position = cursor - cursor % _FrameSize;
+    return true;
+}
+
+void CSharedRingReader::Close()
+{
+    _Header = NULL;
+    _Blocks = NULL;
+    _Data = NULL;
+    _Memory.Close();
+}
+
+bool CSharedRingReader::IsWriterClosed() const
+{
+    return _Header->State.load(std::memory_order_acquire) == SharedRingClosed;
+}
+
+uint64_t CSharedRingReader::AvailableBytes() const
+{
+    uint64_t available = _Header->WriteCursor.load(std::memory_order_acquire) - _Position;
+    return available - available % _FrameSize;
+}
+
+//
+//  First byte the writer hasn't started overwriting, as a frame boundary.
+//
+uint64_t CSharedRingReader::OldestIntact() const
+{
+    uint64_t reserve = _Header->WriteReserve.load(std::memory_order_relaxed);
+    if (reserve <= _DataSize)
+    {
+        return 0;
+    }
+    uint64_t oldest = reserve - _DataSize;
+    return (oldest + _FrameSize - 1) / _FrameSize * _FrameSize;
+}
+
+void CSharedRingReader::SkipTo(uint64_t Position)
+{
+    if (Position > _Position)
+    {
+        _LostBytes += Position - _Position;
+        _Position = Position;
+    }
+}
+
+size_t CSharedRingReader::Peek(SharedRingSpan* Span, size_t MaxBytes)
+{
+    uint64_t cursor = _Header->WriteCursor.load(std::memory_order_acquire);
+    SkipTo(OldestIntact());
+
+    uint64_t available = cursor > _Position ? cursor - _Position : 0;
+    size_t bytes = static_cast<size_t>((std::min<uint64_t>)(available, MaxBytes));
+    bytes -= bytes % _FrameSize;
+
+    size_t offset = static_cast<size_t>(_Position % _DataSize);
+    size_t first = (std::min)(bytes, static_cast<size_t>(_DataSize - offset));
+    Span->Position = _Position;
+    Span->Data[0] = _Data + offset;
+    Span->Size[0] = first;
+    Span->Data[1] = _Data;
+    Span->Size[1] = bytes - first;
+    Span->Bytes = bytes;
+    return bytes;
+}
+
+bool CSharedRingReader::Consume(const SharedRingSpan& Span)
+{
+    //
+    //  Order the caller's reads of the span before the check, like the read side of a sequence lock.
+    //
+    std::atomic_thread_fence(std::memory_order_acquire);
+    uint64_t oldest = OldestIntact();
+    if (oldest > Span.Position)
+    {
+        SkipTo((std::max)(oldest, _Position));
+        return false;
+    }
+    _Position = (std::max)(_Position, Span.Position + Span.Bytes);
+    return true;
+}
+
+size_t CSharedRingReader::Read(uint8_t* Buffer, size_t MaxBytes)
+{
+    for (;;)
+    {
+        SharedRingSpan span;
+        if (Peek(&span, MaxBytes) == 0)
+        {
+            return 0;
+        }
+        memcpy(Buffer, span.Data[0], span.Size[0]);
+        memcpy(Buffer + span.Size[0], span.Data[1], span.Size[1]);
+        if (Consume(span))
+        {
+            return span.Bytes;
+        }
+    }
+}
+
+bool CSharedRingReader::BlockTimestamp(uint64_t Position, int64_t* TimestampNs) const
+{
+    uint64_t block = Position / _BlockSize;
+    const SharedRingBlock* entry = &_Blocks[block % _BlockCount];
+    if (entry->Sequence.load(std::memory_order_acquire) != block + 1)
+    {
+        return false;
+    }
+    *TimestampNs = entry->TimestampNs.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return entry->Sequence.load(std::memory_order_relaxed) == block + 1;
+}
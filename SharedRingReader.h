@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "SharedMemory.h"
+#include "SharedRing.h"
+
+//
+//  Up to two pieces of the ring, in stream order.  Bytes is always whole frames.
+//
+struct SharedRingSpan
+{
+    uint64_t        Position;
+    const uint8_t*  Data[2];
+    size_t          Size[2];
+    size_t          Bytes;
+};
+
+//
+//  Reader side of a shared memory ring written by CSharedRingSink.
+//
+//  Readers only map the segment read only and never write to it, so any number of them can attach and the writer
+//  doesn't know they exist.  Peek() hands out whole frames straight from the mapping; once the caller is done with
+//  them, Consume() confirms the writer didn't overwrite them in the meantime.  When it did, or when Peek() finds the
+//  reader more than a ring behind, the reader skips ahead to the oldest data still intact and counts the bytes it
+//  lost.  There is no wake up from the writer: readers poll, typically once per tick or after a short sleep.
+//
+class CSharedRingReader
+{
+public:
+    CSharedRingReader();
+
+    //
+    //  Attach to the named ring and start at its newest data.
+    //
+    bool Open(const std::string& Name);
+    void Close();
+
+    const WAVEFORMATEX* Format() const { return &_Header->Format.Format; }
+    size_t FrameSize() const { return _FrameSize; }
+    uint64_t Capacity() const { return _DataSize; }
+    uint64_t Position() const { return _Position; }
+    uint64_t LostBytes() const { return _LostBytes; }
+    uint64_t AvailableBytes() const;
+
+    //
+    //  The writer closed the ring.  Whatever is still between Position() and the cursor can be read.
+    //
+    bool IsWriterClosed() const;
+
+    //
+    //  Get up to MaxBytes of unread audio without copying it, rounded down to whole frames.  Returns Span->Bytes.
+    //
+    size_t Peek(SharedRingSpan* Span, size_t MaxBytes);
+
+    //
+    //  Move past a span from Peek().  Returns false if the writer overwrote part of it while the caller was reading;
+    //  whatever was computed from it has to be thrown away.
+    //
+    bool Consume(const SharedRingSpan& Span);
+
+    //
+    //  Peek(), copy, Consume(), retrying if the copy was overwritten.  Returns the bytes copied.
+    //
+    size_t Read(uint8_t* Buffer, size_t MaxBytes);
+
+    //
+    //  Writer timestamp of the block holding stream byte Position, in steady clock nanoseconds.  Fails if the block
+    //  was overwritten or not written yet.
+    //
+    bool BlockTimestamp(uint64_t Position, int64_t* TimestampNs) const;
+
+private:
+    CSharedRingReader(const CSharedRingReader&);
+    CSharedRingReader& operator=(const CSharedRingReader&);
+
+    uint64_t OldestIntact() const;
+    void SkipTo(uint64_t Position);
+
+    CSharedMemory               _Memory;
+    const SharedRingHeader*     _Header;
+    const SharedRingBlock*      _Blocks;
+    const uint8_t*              _Data;
+    uint64_t                    _DataSize;
+    uint64_t                    _BlockSize;
+    uint32_t                    _BlockCount;
+    size_t                      _FrameSize;
+    uint64_t                    _Position;
+    uint64_t                    _LostBytes;
+};
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include "SharedRingSink.h"
+
+CSharedRingSink::CSharedRingSink() :
+    _Header(NULL),
+    _Blocks(NULL),
+    _Data(NULL),
+    _DataSize(0),
+    _BlockSize(0),
+    _Cursor(0)
+{
+}
+
+CSharedRingSink::~CSharedRingSink()
+{
+    Close();
+}
+
+bool CSharedRingSink::Open(const std::string& Name, const WAVEFORMATEX* Format, size_t Capacity, size_t BlockSize)
+{
+    size_t frameSize = Format->nBlockAlign;
+    if (frameSize == 0 || Capacity == 0 || BlockSize == 0)
+    {
+        fprintf(stderr, "Invalid shared memory ring parameters.\n");
+        return false;
+    }
+    BlockSize = (BlockSize + frameSize - 1) / frameSize * frameSize;
+    size_t blockCount = std::max<size_t>((Capacity + BlockSize - 1) / BlockSize, 2);
+    if (BlockSize > UINT32_MAX || blockCount > UINT32_MAX)
+    {
+        fprintf(stderr, "Shared memory ring is too large.\n");
+        return false;
+    }
+
+    //
+    //  The audio starts on its own page, so readers get page aligned data.
+    //
+    size_t headerSize = (sizeof(SharedRingHeader) + 63) / 64 * 64;
+    size_t dataOffset = (headerSize + blockCount * sizeof(SharedRingBlock) + 4095) / 4096 * 4096;
+    _DataSize = static_cast<uint64_t>(BlockSize) * blockCount;
+    if (!_Memory.Create(Name, dataOffset + _DataSize))
+    {
+        fprintf(stderr, "Failed to create shared memory ring %s: %d\n", Name.c_str(), CSharedMemory::LastError());
+        return false;
+    }
+
+    uint8_t* base = _Memory.Data();
+    _Header = new (base) SharedRingHeader;
+    _Header->Magic = SHARED_RING_MAGIC;
+    _Header->Version = SHARED_RING_VERSION;
+    _Header->HeaderSize = static_cast<uint32_t>(sizeof(SharedRingHeader));
+    _Header->BlockSize = static_cast<uint32_t>(BlockSize);
+    _Header->BlockCount = static_cast<uint32_t>(blockCount);
+    _Header->FrameSize = static_cast<uint32_t>(frameSize);
+    _Header->BlockTableOffset = headerSize;
+    _Header->DataOffset = dataOffset;
+    _Header->DataSize = _DataSize;
+    memset(&_Header->Format, 0, sizeof(_Header->Format));
+    memcpy(&_Header->Format, Format, std::min(sizeof(_Header->Format), sizeof(WAVEFORMATEX) + Format->cbSize));
+    _Header->WriteCursor.store(0, std::memory_order_relaxed);
+    _Header->WriteReserve.store(0, std::memory_order_relaxed);
+
+    _Blocks = reinterpret_cast<SharedRingBlock*>(base + headerSize);
+    for (size_t i = 0; i < blockCount; i++)
+    {
+        new (&_Blocks[i]) SharedRingBlock;
+        _Blocks[i].Sequence.store(0, std::memory_order_relaxed);
+        _Blocks[i].TimestampNs.store(0, std::memory_order_relaxed);
+    }
+    _Data = base + dataOffset;
+    _BlockSize = BlockSize;
+    _Cursor = 0;
+
+    //
+    //  Readers check the magic only once State says the header is complete.
+    //
+    _Header->State.store(SharedRingWriting, std::memory_order_release);
+    return true;
+}
+
+//
+//  Stamp every block that starts in [Start, End).
+//
+void CSharedRingSink::StampBlocks(uint64_t Start, uint64_t End)
+{
+    int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    for (uint64_t block = (Start + _BlockSize - 1) / _BlockSize; block * _BlockSize < End; block++)
+    {
+        SharedRingBlock* entry = &_Blocks[block % _Header->BlockCount];
+        entry->Sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        entry->TimestampNs.store(now, std::memory_order_relaxed);
+        entry->Sequence.store(block + 1, std::memory_order_release);
+    }
+}
+
+bool CSharedRingSink::Write(const uint8_t* Data, size_t Size)
+{
+    if (_Header == NULL)
+    {
+        return false;
+    }
+
+    //
+    //  Publish in pieces of at most half the ring, so a reader keeping up is never lapped by a single large write.
+    //
+    while (Size > 0)
+    {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(Size, _DataSize / 2));
+        uint64_t end = _Cursor + chunk;
+
+        //
+        //  Tell readers what is about to be overwritten before touching it.
+        //
+        _Header->WriteReserve.store(end, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        size_t offset = static_cast<size_t>(_Cursor % _DataSize);
+        size_t first = std::min(chunk, static_cast<size_t>(_DataSize - offset));
+        memcpy(_Data + offset, Data, first);
+        memcpy(_Data, Data + first, chunk - first);
+        StampBlocks(_Cursor, end);
+
+        _Header->WriteCursor.store(end, std::memory_order_release);
+        _Cursor = end;
+        Data += chunk;
+        Size -= chunk;
+    }
+    return true;
+}
+
+bool CSharedRingSink::Flush()
+{
+    return _Header != NULL;
+}
+
+bool CSharedRingSink::Close()
+{
+    if (_Header == NULL)
+    {
+        return true;
+    }
+    _Header->State.store(SharedRingClosed, std::memory_order_release);
+    _Header = NULL;
+    _Blocks = NULL;
+    _Data = NULL;
+    _Memory.Close();
+    return true;
+}
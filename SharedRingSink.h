@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include "OutputSink.h"
+#include "SharedMemory.h"
+#include "SharedRing.h"
+
+//
+//  Publishes the captured stream into a named shared memory ring (see SharedRing.h) instead of a file.
+//
+//  Write() copies straight into the ring and moves the write cursor, so same-host consumers see every tick as soon
+//  as the writer thread gets it, without a file system round trip.  Any number of readers can attach; the sink never
+//  waits for them, and a reader that falls more than the ring's length behind is lapped.  Nothing is durable, so
+//  Flush() does nothing.  Close() marks the ring closed and removes its name.
+//
+class CSharedRingSink : public IOutputSink
+{
+public:
+    CSharedRingSink();
+    ~CSharedRingSink();
+
+    //
+    //  The ring holds about Capacity bytes, rounded up to whole blocks of BlockSize bytes (rounded to whole frames).
+    //
+    bool Open(const std::string& Name, const WAVEFORMATEX* Format, size_t Capacity, size_t BlockSize);
+    bool Write(const uint8_t* Data, size_t Size);
+    bool Flush();
+    bool Close();
+
+private:
+    void StampBlocks(uint64_t Start, uint64_t End);
+
+    CSharedMemory       _Memory;
+    SharedRingHeader*   _Header;
+    SharedRingBlock*    _Blocks;
+    uint8_t*            _Data;
+    uint64_t            _DataSize;
+    uint64_t            _BlockSize;
+    uint64_t            _Cursor;
+};
@@ -0,0 +1,231 @@
+#include <stdio.h>
+#include <string.h>
+#include "SilenceDetect.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SILENCE_DETECT_HAVE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+//
+//  Scalar reference.  Also takes any Count, for the samples left over after the vector kernels.
+//
+static bool QuietFloat32Scalar(const uint8_t* Samples, size_t Count, int32_t Threshold)
+{
+    for (size_t i = 0; i < Count; i++)
+    {
+        int32_t bits;
+        memcpy(&bits, Samples + i * 4, sizeof(bits));
+        if ((bits & 0x7FFFFFFF) > Threshold)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool QuietInt16Scalar(const uint8_t* Samples, size_t Count, int32_t Threshold)
+{
+    for (size_t i = 0; i < Count; i++)
+    {
+        int16_t sample;
+        memcpy(&sample, Samples + i * 2, sizeof(sample));
+        if (sample > Threshold || sample < -Threshold)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool QuietInt24Scalar(const uint8_t* Samples, size_t Count, int32_t Threshold)
+{
+    for (size_t i = 0; i < Count; i++)
+    {
+        const uint8_t* sample = Samples + i * 3;
+        int32_t value = static_cast<int32_t>(static_cast<uint32_t>(sample[0]) << 8 | static_cast<uint32_t>(sample[1]) << 16 |
+            static_cast<uint32_t>(sample[2]) << 24) >> 8;
+        if (value > Threshold || value < -Threshold)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool QuietInt32Scalar(const uint8_t* Samples, size_t Count, int32_t Threshold)
+{
+    for (size_t i = 0; i < Count; i++)
+    {
+        int32_t sample;
+        memcpy(&sample, Samples + i * 4, sizeof(sample));
+        if (sample > Threshold || sample < -Threshold)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const SilenceDetectKernels ScalarKernels = { QuietFloat32Scalar, QuietInt16Scalar, QuietInt32Scalar };
+
+#ifdef SILENCE_DETECT_HAVE_SSE2
+
+//
+//  A group is eight registers of float or 32 bit samples, or four of 16 bit ones, whose comparisons are OR'ed
+//  together before a single test.
+//
+static bool QuietFloat32Sse2(const uint8_t* Samples, size_t Count, int32_t Threshold)
+{
+    const __m128i mask = _mm_set1_epi32(0x7FFFFFFF);
+    const __m128i threshold = _mm_set1_epi32(Threshold);
+    for (size_t i = 0; i < Count; i += SILENCE_DETECT_GROUP)
+    {
+        __m128i loud = _mm_setzero_si128();
+        for (int j = 0; j < SILENCE_DETECT_GROUP / 4; j++)
+        {
+            __m128i bits = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(Samples + (i + j * 4) * 4)), mask);
+            loud = _mm_or_si128(loud, _mm_cmpgt_epi32(bits, threshold));
+        }
+        if (_mm_movemask_epi8(loud) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool QuietInt16Sse2(const uint8_t* Samples, size_t Count, int32_t Threshold)
+{
+    const __m128i maximum = _mm_set1_epi16(static_cast<int16_t>(Threshold));
+    const __m128i minimum = _mm_set1_epi16(static_cast<int16_t>(-Threshold));
+    for (size_t i = 0; i < Count; i += SILENCE_DETECT_GROUP)
+    {
+        __m128i loud = _mm_setzero_si128();
+        for (int j = 0; j < SILENCE_DETECT_GROUP / 8; j++)
+        {
+            __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Samples + (i + j * 8) * 2));
+            loud = _mm_or_si128(loud, _mm_or_si128(_mm_cmpgt_epi16(samples, maximum), _mm_cmpgt_epi16(minimum, samples)));
+        }
+        if (_mm_movemask_epi8(loud) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool QuietInt32Sse2(const uint8_t* Samples, size_t Count, int32_t Threshold)
+{
+    const __m128i maximum = _mm_set1_epi32(Threshold);
+    const __m128i minimum = _mm_set1_epi32(-Threshold);
+    for (size_t i = 0; i < Count; i += SILENCE_DETECT_GROUP)
+    {
+        __m128i loud = _mm_setzero_si128();
+        for (int j = 0; j < SILENCE_DETECT_GROUP / 4; j++)
+        {
+            __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Samples + (i + j * 4) * 4));
+            loud = _mm_or_si128(loud, _mm_or_si128(_mm_cmpgt_epi32(samples, maximum), _mm_cmpgt_epi32(minimum, samples)));
+        }
+        if (_mm_movemask_epi8(loud) != 0)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const SilenceDetectKernels Sse2Kernels = { QuietFloat32Sse2, QuietInt16Sse2, QuietInt32Sse2 };
+
+#endif
+
+CSilenceDetector::CSilenceDetector() :
+    _Channels(0),
+    _BytesPerSample(0),
+    _Threshold(0),
+    _Kernel(SampleKernelScalar),
+    _Function(NULL),
+    _ScalarFunction(NULL)
+{
+}
+
+bool CSilenceDetector::Initialize(const WAVEFORMATEX* Format, double Threshold, SampleConvertKernel MaxKernel)
+{
+    bool isFloat = IsFloatFormat(Format);
+    WORD bits = Format->wBitsPerSample;
+    if ((isFloat ? bits != 32 : (bits != 16 && bits != 24 && bits != 32)) || Format->nBlockAlign != Format->nChannels * bits / 8 ||
+        !(Threshold >= 0 && Threshold <= 1))
+    {
+        fprintf(stderr, "Silence detection needs 32 bit float or 16, 24 or 32 bit integer samples and a threshold up to full scale.\n");
+        return false;
+    }
+    _Channels = Format->nChannels;
+    _BytesPerSample = bits / 8;
+
+    //
+    //  Integer thresholds round down, so a sample at the threshold's level in float is quiet in every format.
+    //
+    if (isFloat)
+    {
+        float threshold = static_cast<float>(Threshold);
+        memcpy(&_Threshold, &threshold, sizeof(_Threshold));
+    }
+    else
+    {
+        double scale = bits == 16 ? SAMPLE_SCALE_16 : bits == 24 ? SAMPLE_SCALE_24 : SAMPLE_SCALE_32;
+        double maximum = bits == 16 ? SAMPLE_MAX_16 : bits == 24 ? SAMPLE_MAX_24 : 2147483647.0;
+        double threshold = Threshold * scale;
+        _Threshold = static_cast<int32_t>(threshold < maximum ? threshold : maximum);
+    }
+
+    //
+    //  Pick the best kernel the CPU and this build have, up to MaxKernel.
+    //
+    const SilenceDetectKernels* kernels = &ScalarKernels;
+    _Kernel = SampleKernelScalar;
+#ifdef SILENCE_DETECT_HAVE_SSE2
+    if (MaxKernel >= SampleKernelSse2)
+    {
+        kernels = &Sse2Kernels;
+        _Kernel = SampleKernelSse2;
+    }
+#endif
+    if (MaxKernel >= SampleKernelAvx2 && GetAvx2SilenceDetectKernels() != NULL && CpuSupportsAvx2())
+    {
+        kernels = GetAvx2SilenceDetectKernels();
+        _Kernel = SampleKernelAvx2;
+    }
+    if (isFloat)
+    {
+        _Function = kernels->QuietFloat32;
+        _ScalarFunction = QuietFloat32Scalar;
+    }
+    else if (bits == 16)
+    {
+        _Function = kernels->QuietInt16;
+        _ScalarFunction = QuietInt16Scalar;
+    }
+    else if (bits == 32)
+    {
+        _Function = kernels->QuietInt32;
+        _ScalarFunction = QuietInt32Scalar;
+    }
+    else
+    {
+        _Function = NULL;
+        _ScalarFunction = QuietInt24Scalar;
+        _Kernel = SampleKernelScalar;
+    }
+    return true;
+}
+
+bool CSilenceDetector::Quiet(const uint8_t* Data, size_t Frames) const
+{
+    size_t count = Frames * _Channels;
+    size_t grouped = _Function != NULL ? count - count % SILENCE_DETECT_GROUP : 0;
+    if (grouped != 0 && !_Function(Data, grouped, _Threshold))
+    {
+        return false;
+    }
+    return _ScalarFunction(Data + grouped * _BytesPerSample, count - grouped, _Threshold);
+}
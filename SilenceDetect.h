@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "AudioFormat.h"
+#include "SampleConvert.h"
+#include "SilenceDetectKernels.h"
+
+//
+//  Peak threshold detector for silence and near-silence, on 32 bit float or 16, 24 or 32 bit integer PCM.
+//
+//  Frames are quiet when no sample of any channel is louder than the threshold, a linear fraction of full scale.  A
+//  threshold of 0 only takes digital silence, exact zeros, which is what the drain stores for packets the device
+//  flags as silent.  It runs the fastest kernel the CPU supports (up to MaxKernel) on whole groups of samples and
+//  the scalar reference on the rest; 24 bit samples are always scalar.
+//
+class CSilenceDetector
+{
+public:
+    CSilenceDetector();
+
+    bool Initialize(const WAVEFORMATEX* Format, double Threshold, SampleConvertKernel MaxKernel = SampleKernelAvx2);
+
+    bool Quiet(const uint8_t* Data, size_t Frames) const;
+
+    SampleConvertKernel Kernel() const { return _Kernel; }
+
+private:
+    size_t                  _Channels;
+    size_t                  _BytesPerSample;
+    int32_t                 _Threshold;         // In the format's units; the bits of the float threshold for float.
+    SampleConvertKernel     _Kernel;
+    SilenceDetectFunction   _Function;          // NULL for 24 bit samples.
+    SilenceDetectFunction   _ScalarFunction;
+};
@@ -0,0 +1,88 @@
+#include "SilenceDetectKernels.h"
+
+//
+//  Built with AVX2 code generation enabled where the compiler supports it; CSilenceDetector only calls in here after
+//  checking the CPU.
+//
+#ifdef __AVX2__
+
+#include <immintrin.h>
+
+//
+//  A group is four registers of float or 32 bit samples, or two of 16 bit ones, tested together.
+//
+static bool QuietFloat32Avx2(const uint8_t* Samples, size_t Count, int32_t Threshold)
+{
+    const __m256i mask = _mm256_set1_epi32(0x7FFFFFFF);
+    const __m256i threshold = _mm256_set1_epi32(Threshold);
+    for (size_t i = 0; i < Count; i += SILENCE_DETECT_GROUP)
+    {
+        __m256i loud = _mm256_setzero_si256();
+        for (int j = 0; j < SILENCE_DETECT_GROUP / 8; j++)
+        {
+            __m256i bits = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(Samples + (i + j * 8) * 4)), mask);
+            loud = _mm256_or_si256(loud, _mm256_cmpgt_epi32(bits, threshold));
+        }
+        if (!_mm256_testz_si256(loud, loud))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool QuietInt16Avx2(const uint8_t* Samples, size_t Count, int32_t Threshold)
+{
+    const __m256i maximum = _mm256_set1_epi16(static_cast<int16_t>(Threshold));
+    const __m256i minimum = _mm256_set1_epi16(static_cast<int16_t>(-Threshold));
+    for (size_t i = 0; i < Count; i += SILENCE_DETECT_GROUP)
+    {
+        __m256i loud = _mm256_setzero_si256();
+        for (int j = 0; j < SILENCE_DETECT_GROUP / 16; j++)
+        {
+            __m256i samples = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Samples + (i + j * 16) * 2));
+            loud = _mm256_or_si256(loud, _mm256_or_si256(_mm256_cmpgt_epi16(samples, maximum), _mm256_cmpgt_epi16(minimum, samples)));
+        }
+        if (!_mm256_testz_si256(loud, loud))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool QuietInt32Avx2(const uint8_t* Samples, size_t Count, int32_t Threshold)
+{
+    const __m256i maximum = _mm256_set1_epi32(Threshold);
+    const __m256i minimum = _mm256_set1_epi32(-Threshold);
+    for (size_t i = 0; i < Count; i += SILENCE_DETECT_GROUP)
+    {
+        __m256i loud = _mm256_setzero_si256();
+        for (int j = 0; j < SILENCE_DETECT_GROUP / 8; j++)
+        {
+            __m256i samples = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(Samples + (i + j * 8) * 4));
+            loud = _mm256_or_si256(loud, _mm256_or_si256(_mm256_cmpgt_epi32(samples, maximum), _mm256_cmpgt_epi32(minimum, samples)));
+        }
+        if (!_mm256_testz_si256(loud, loud))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+static const SilenceDetectKernels Avx2Kernels = { QuietFloat32Avx2, QuietInt16Avx2, QuietInt32Avx2 };
+
+const SilenceDetectKernels* GetAvx2SilenceDetectKernels()
+{
+    return &Avx2Kernels;
+}
+
+#else
+
+const SilenceDetectKernels* GetAvx2SilenceDetectKernels()
+{
+    return NULL;
+}
+
+#endif
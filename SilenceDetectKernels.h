@@ -0,0 +1,35 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+//
+//  Peak threshold kernels of the silence detector.  Like SampleConvertKernels.h, this header must stay free of inline
+//  code because SilenceDetectAvx2.cpp is built with AVX2 enabled.
+//
+
+//
+//  The vector kernels look at this many samples at a time, and stop at the first group with a loud sample, so loud
+//  audio costs next to nothing.
+//
+#define SILENCE_DETECT_GROUP    32
+
+//
+//  True if none of the Count samples at Samples is louder than Threshold, that is no integer sample is above
+//  Threshold or below -Threshold.  Float samples are compared by the bits of their absolute value, which order like
+//  the values themselves, so their Threshold is the bit pattern of the float threshold; a NaN counts as loud.  Count
+//  is a multiple of SILENCE_DETECT_GROUP.  Nothing needs to be aligned.
+//
+typedef bool (*SilenceDetectFunction)(const uint8_t* Samples, size_t Count, int32_t Threshold);
+
+struct SilenceDetectKernels
+{
+    SilenceDetectFunction QuietFloat32;
+    SilenceDetectFunction QuietInt16;
+    SilenceDetectFunction QuietInt32;
+};
+
+//
+//  The AVX2 kernels, or NULL if this build has none.  Only call them if CpuSupportsAvx2().
+//
+const SilenceDetectKernels* GetAvx2SilenceDetectKernels();
@@ -0,0 +1,496 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "SilenceFile.h"
+#include "CaptureDrain.h"
+#include "WavFile.h"
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CSilenceFileSink::CSilenceFileSink() :
+    _Open(false),
+    _PacketLog(NULL),
+    _FrameSize(0),
+    _SampleRate(0),
+    _ChunkFrames(0),
+    _MinSilenceFrames(0),
+    _MaxRecordFrames(0),
+    _ChunkBytes(0),
+    _Frame(0),
+    _AudioFrames(0),
+    _AudioFrame(0),
+    _AudioWallTimeNs(0),
+    _AudioFlags(0),
+    _QuietFrames(0),
+    _QuietWallTimeNs(0),
+    _QuietFlags(0),
+    _InSilence(false),
+    _SilenceFrame(0),
+    _SilenceFrames(0),
+    _SilenceWallTimeNs(0),
+    _SilenceFlags(0),
+    _HaveRecord(false),
+    _AudioRecords(0),
+    _SilenceRecords(0),
+    _AudioFramesWritten(0),
+    _SilentFrames(0),
+    _BytesWritten(0),
+    _DetectNs(0)
+{
+    memset(&_LastRecord, 0, sizeof(_LastRecord));
+}
+
+bool CSilenceFileSink::Open(const std::string& FileName, const WAVEFORMATEX* Format, double Threshold, uint32_t MinSilenceMs,
+    CCapturePacketLog* PacketLog, SampleConvertKernel MaxKernel)
+{
+    if (!_Detector.Initialize(Format, Threshold, MaxKernel))
+    {
+        return false;
+    }
+    if (!_File.Create(FileName))
+    {
+        fprintf(stderr, "Unable to create output file: %d\n", COutputFile::LastError());
+        return false;
+    }
+
+    _PacketLog = PacketLog;
+    _FrameSize = Format->nBlockAlign;
+    _SampleRate = Format->nSamplesPerSec;
+    _ChunkFrames = std::max<size_t>(_SampleRate / 100, 1);
+    _MinSilenceFrames = std::max<uint64_t>(static_cast<uint64_t>(_SampleRate) * MinSilenceMs / 1000, _ChunkFrames);
+    _MaxRecordFrames = std::max<size_t>(_SampleRate, _ChunkFrames);
+
+    //
+    //  An audio record is cut once it passes _MaxRecordFrames, not counting a quiet tail that may still turn into
+    //  silence, so the buffer never holds more than that, the tail and a chunk.
+    //
+    _Chunk.resize(_ChunkFrames * _FrameSize);
+    _Audio.resize((_MaxRecordFrames + static_cast<size_t>(_MinSilenceFrames) + 2 * _ChunkFrames) * _FrameSize);
+    _ChunkBytes = 0;
+    _Frame = 0;
+    _AudioFrames = 0;
+    _QuietFrames = 0;
+    _InSilence = false;
+    _HaveRecord = false;
+
+    SilenceFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.Magic = SILENCE_FILE_MAGIC;
+    header.Version = SILENCE_FILE_VERSION;
+    header.HeaderSize = sizeof(SilenceFileHeader);
+    header.RecordHeaderSize = sizeof(SilenceRecordHeader);
+    header.Threshold = static_cast<float>(Threshold);
+    memcpy(&header.Format, Format, sizeof(WAVEFORMATEX) + std::min<size_t>(Format->cbSize, WAVEFORMATEXTENSIBLE_EXTRA_SIZE));
+    header.Format.Format.cbSize = std::min<WORD>(Format->cbSize, WAVEFORMATEXTENSIBLE_EXTRA_SIZE);
+    if (!_File.Write(&header, sizeof(header)))
+    {
+        fprintf(stderr, "Unable to write output file: %d\n", COutputFile::LastError());
+        _File.Close();
+        return false;
+    }
+    _BytesWritten.store(sizeof(header), std::memory_order_relaxed);
+    _Open = true;
+    return true;
+}
+
+bool CSilenceFileSink::Write(const uint8_t* Data, size_t Size)
+{
+    const size_t chunkSize = _ChunkFrames * _FrameSize;
+    while (Size != 0)
+    {
+        if (_ChunkBytes == 0 && Size >= chunkSize)
+        {
+            if (!ProcessChunk(Data, _ChunkFrames))
+            {
+                return false;
+            }
+            Data += chunkSize;
+            Size -= chunkSize;
+            continue;
+        }
+
+        size_t bytes = std::min(Size, chunkSize - _ChunkBytes);
+        memcpy(&_Chunk[_ChunkBytes], Data, bytes);
+        _ChunkBytes += bytes;
+        Data += bytes;
+        Size -= bytes;
+        if (_ChunkBytes == chunkSize)
+        {
+            _ChunkBytes = 0;
+            if (!ProcessChunk(&_Chunk[0], _ChunkFrames))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+//
+//  End the records under way and make them durable.  The whole frames of a partial chunk go out as a short chunk.
+//
+bool CSilenceFileSink::Flush()
+{
+    size_t frames = _ChunkBytes / _FrameSize;
+    if (frames != 0)
+    {
+        size_t rest = _ChunkBytes - frames * _FrameSize;
+        if (!ProcessChunk(&_Chunk[0], frames))
+        {
+            return false;
+        }
+        memmove(&_Chunk[0], &_Chunk[frames * _FrameSize], rest);
+        _ChunkBytes = rest;
+    }
+
+    if (_InSilence)
+    {
+        //
+        //  The run carries on in a new record after this one.
+        //
+        uint64_t frame = _SilenceFrame + _SilenceFrames;
+        int64_t wallTimeNs = _SilenceWallTimeNs != 0 ? _SilenceWallTimeNs + static_cast<int64_t>(_SilenceFrames * 1000000000 / _SampleRate) : 0;
+        if (!WriteSilence())
+        {
+            return false;
+        }
+        _InSilence = true;
+        _SilenceFrame = frame;
+        _SilenceFrames = 0;
+        _SilenceWallTimeNs = wallTimeNs;
+        _SilenceFlags = 0;
+    }
+    else if (_AudioFrames != 0)
+    {
+        _AudioFlags |= _QuietFlags;
+        _QuietFrames = 0;
+        if (!WriteAudio(_AudioFrames))
+        {
+            return false;
+        }
+    }
+
+    if (!_File.Flush())
+    {
+        fprintf(stderr, "Unable to flush output file: %d\n", COutputFile::LastError());
+        return false;
+    }
+    return true;
+}
+
+bool CSilenceFileSink::Close()
+{
+    if (!_Open)
+    {
+        return true;
+    }
+    bool succeeded = Flush();
+    _File.Close();
+    _Open = false;
+    return succeeded;
+}
+
+void CSilenceFileSink::GetStats(SilenceFileStats* Stats) const
+{
+    Stats->AudioRecords = _AudioRecords.load(std::memory_order_relaxed);
+    Stats->SilenceRecords = _SilenceRecords.load(std::memory_order_relaxed);
+    Stats->AudioFrames = _AudioFramesWritten.load(std::memory_order_relaxed);
+    Stats->SilentFrames = _SilentFrames.load(std::memory_order_relaxed);
+    Stats->BytesWritten = _BytesWritten.load(std::memory_order_relaxed);
+    Stats->DetectUs = _DetectNs.load(std::memory_order_relaxed) / 1000;
+}
+
+bool CSilenceFileSink::ProcessChunk(const uint8_t* Data, size_t Frames)
+{
+    uint32_t flags;
+    bool flaggedSilent;
+    int64_t wallTimeNs;
+    LookupChunk(Frames, &flags, &flaggedSilent, &wallTimeNs);
+
+    int64_t start = SteadyClockNs();
+    bool quiet = flaggedSilent || _Detector.Quiet(Data, Frames);
+    _DetectNs.store(_DetectNs.load(std::memory_order_relaxed) + static_cast<uint64_t>(SteadyClockNs() - start), std::memory_order_relaxed);
+
+    uint64_t frame = _Frame;
+    _Frame += Frames;
+    if (_InSilence)
+    {
+        if (quiet)
+        {
+            _SilenceFrames += Frames;
+            _SilenceFlags |= flags;
+            return true;
+        }
+        if (!WriteSilence())
+        {
+            return false;
+        }
+    }
+
+    if (_AudioFrames == 0)
+    {
+        _AudioFrame = frame;
+        _AudioWallTimeNs = wallTimeNs;
+        _AudioFlags = 0;
+    }
+    memcpy(&_Audio[_AudioFrames * _FrameSize], Data, Frames * _FrameSize);
+    _AudioFrames += Frames;
+    if (!quiet)
+    {
+        _AudioFlags |= _QuietFlags | flags;
+        _QuietFrames = 0;
+        _QuietFlags = 0;
+    }
+    else
+    {
+        if (_QuietFrames == 0)
+        {
+            _QuietWallTimeNs = wallTimeNs;
+        }
+        _QuietFrames += Frames;
+        _QuietFlags |= flags;
+    }
+
+    if (_QuietFrames >= _MinSilenceFrames)
+    {
+        //
+        //  The quiet tail is long enough: the audio before it is done, and the tail starts a silence record.
+        //
+        size_t quietFrames = _QuietFrames;
+        if (!WriteAudio(_AudioFrames - quietFrames))
+        {
+            return false;
+        }
+        _InSilence = true;
+        _SilenceFrame = _AudioFrame;
+        _SilenceFrames = quietFrames;
+        _SilenceWallTimeNs = _QuietWallTimeNs;
+        _SilenceFlags = _QuietFlags;
+        _AudioFrames = 0;
+        _QuietFrames = 0;
+        _QuietFlags = 0;
+    }
+    else if (_AudioFrames - _QuietFrames >= _MaxRecordFrames)
+    {
+        return WriteAudio(_AudioFrames - _QuietFrames);
+    }
+    return true;
+}
+
+//
+//  Flags, capture time and whether the device flagged all of the next chunk as silent, from the packet log.  Times
+//  of frames the log has no record for are extrapolated from the last record, or 0 without one.
+//
+void CSilenceFileSink::LookupChunk(size_t Frames, uint32_t* Flags, bool* FlaggedSilent, int64_t* WallTimeNs)
+{
+    *Flags = 0;
+    *FlaggedSilent = _PacketLog != NULL;
+    uint64_t frame = _Frame;
+    uint64_t end = _Frame + Frames;
+    while (frame < end)
+    {
+        CapturePacketRecord record;
+        if (_PacketLog == NULL || !_PacketLog->Lookup(frame, &record) || record.Frame + record.Frames <= frame)
+        {
+            *FlaggedSilent = false;
+            break;
+        }
+        if (frame == _Frame)
+        {
+            _LastRecord = record;
+            _HaveRecord = true;
+        }
+        *Flags |= frame == record.Frame ? record.Flags : record.Flags & ~CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY;
+        if ((record.Flags & CAPTURE_PACKET_FLAG_SILENT) == 0)
+        {
+            *FlaggedSilent = false;
+        }
+        frame = record.Frame + record.Frames;
+    }
+
+    *WallTimeNs = _HaveRecord && _LastRecord.WallTimeNs != 0 ?
+        _LastRecord.WallTimeNs + static_cast<int64_t>((_Frame - _LastRecord.Frame) * 1000000000 / _SampleRate) : 0;
+}
+
+//
+//  Write the first Frames frames of the pending audio as a record, and keep the rest, a quiet tail, pending.
+//
+bool CSilenceFileSink::WriteAudio(size_t Frames)
+{
+    if (Frames != 0 && !WriteRecord(SILENCE_RECORD_AUDIO, _AudioFrame, Frames, _AudioWallTimeNs, _AudioFlags, &_Audio[0]))
+    {
+        return false;
+    }
+    _AudioFramesWritten.fetch_add(Frames, std::memory_order_relaxed);
+    memmove(&_Audio[0], &_Audio[Frames * _FrameSize], (_AudioFrames - Frames) * _FrameSize);
+    _AudioFrames -= Frames;
+    _AudioFrame += Frames;
+    _AudioWallTimeNs = _QuietWallTimeNs;
+    _AudioFlags = 0;
+    return true;
+}
+
+bool CSilenceFileSink::WriteSilence()
+{
+    _InSilence = false;
+    if (_SilenceFrames == 0)
+    {
+        return true;
+    }
+    _SilentFrames.fetch_add(_SilenceFrames, std::memory_order_relaxed);
+    return WriteRecord(SILENCE_RECORD_SILENCE, _SilenceFrame, _SilenceFrames, _SilenceWallTimeNs, _SilenceFlags, NULL);
+}
+
+bool CSilenceFileSink::WriteRecord(uint32_t Type, uint64_t Frame, uint64_t Frames, int64_t WallTimeNs, uint32_t Flags, const uint8_t* Payload)
+{
+    SilenceRecordHeader record;
+    record.Magic = SILENCE_FILE_RECORD_MAGIC;
+    record.Type = Type;
+    record.Frame = Frame;
+    record.Frames = Frames;
+    record.WallTimeNs = WallTimeNs;
+    record.Flags = Flags;
+    record.PayloadSize = Payload != NULL ? static_cast<uint32_t>(Frames * _FrameSize) : 0;
+    if (!_File.Write(&record, sizeof(record)) || (Payload != NULL && !_File.Write(Payload, record.PayloadSize)))
+    {
+        fprintf(stderr, "Unable to write output file: %d\n", COutputFile::LastError());
+        return false;
+    }
+    _BytesWritten.fetch_add(sizeof(record) + record.PayloadSize, std::memory_order_relaxed);
+    (Type == SILENCE_RECORD_AUDIO ? _AudioRecords : _SilenceRecords).fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+CSilenceFileReader::CSilenceFileReader() :
+    _File(NULL),
+    _Frames(0),
+    _SilentFrames(0)
+{
+    memset(&_Header, 0, sizeof(_Header));
+}
+
+CSilenceFileReader::~CSilenceFileReader()
+{
+    Close();
+}
+
+bool CSilenceFileReader::Open(const std::string& FileName)
+{
+    Close();
+    _File = fopen(FileName.c_str(), "rb");
+    if (_File == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", FileName.c_str());
+        return false;
+    }
+    if (fread(&_Header, sizeof(_Header), 1, _File) != 1 || _Header.Magic != SILENCE_FILE_MAGIC ||
+        _Header.HeaderSize < sizeof(SilenceFileHeader) || _Header.RecordHeaderSize < sizeof(SilenceRecordHeader) ||
+        _Header.Format.Format.nBlockAlign == 0)
+    {
+        fprintf(stderr, "%s is not a silence collapsed audio file.\n", FileName.c_str());
+        Close();
+        return false;
+    }
+
+    //
+    //  A record that doesn't follow on from the one before, or is cut short, is where a crashed writer stopped.
+    //
+    uint64_t size = FileSize64(_File);
+    uint64_t offset = _Header.HeaderSize;
+    while (offset + _Header.RecordHeaderSize <= size)
+    {
+        SilenceRecordHeader record;
+        if (!SeekFile64(_File, offset) || fread(&record, sizeof(record), 1, _File) != 1)
+        {
+            break;
+        }
+        bool audio = record.Type == SILENCE_RECORD_AUDIO;
+        if (record.Magic != SILENCE_FILE_RECORD_MAGIC || record.Frame != _Frames || record.Frames == 0 ||
+            (audio ? record.PayloadSize != record.Frames * _Header.Format.Format.nBlockAlign :
+                record.Type != SILENCE_RECORD_SILENCE || record.PayloadSize != 0) ||
+            offset + _Header.RecordHeaderSize + record.PayloadSize > size)
+        {
+            break;
+        }
+
+        RecordEntry entry;
+        entry.Frame = record.Frame;
+        entry.Frames = record.Frames;
+        entry.Offset = audio ? offset + _Header.RecordHeaderSize : 0;
+        entry.WallTimeNs = record.WallTimeNs;
+        _Records.push_back(entry);
+        _Frames += record.Frames;
+        _SilentFrames += audio ? 0 : record.Frames;
+        offset += _Header.RecordHeaderSize + record.PayloadSize;
+    }
+    return true;
+}
+
+void CSilenceFileReader::Close()
+{
+    if (_File != NULL)
+    {
+        fclose(_File);
+        _File = NULL;
+    }
+    _Records.clear();
+    _Frames = 0;
+    _SilentFrames = 0;
+}
+
+size_t CSilenceFileReader::Read(uint64_t Frame, uint8_t* Data, size_t Frames)
+{
+    if (_File == NULL || Frame >= _Frames)
+    {
+        return 0;
+    }
+
+    //
+    //  The last record starting at or before Frame.
+    //
+    size_t index = std::upper_bound(_Records.begin(), _Records.end(), Frame,
+        [](uint64_t Position, const RecordEntry& Entry) { return Position < Entry.Frame; }) - _Records.begin() - 1;
+    size_t frameSize = _Header.Format.Format.nBlockAlign;
+    size_t done = 0;
+    for (; done < Frames && index < _Records.size(); index++)
+    {
+        const RecordEntry& entry = _Records[index];
+        uint64_t skip = Frame + done - entry.Frame;
+        size_t frames = static_cast<size_t>(std::min<uint64_t>(Frames - done, entry.Frames - skip));
+        uint8_t* target = Data + done * frameSize;
+        if (entry.Offset == 0)
+        {
+            memset(target, 0, frames * frameSize);
+        }
+        else if (!SeekFile64(_File, entry.Offset + skip * frameSize) || fread(target, frameSize, frames, _File) != frames)
+        {
+            return 0;
+        }
+        done += frames;
+    }
+    return done;
+}
+
+void CSilenceFileReader::GetSoundRegions(std::vector<SilenceFileRegion>* Regions) const
+{
+    Regions->clear();
+    bool lastAudio = false;
+    for (size_t i = 0; i < _Records.size(); i++)
+    {
+        bool audio = _Records[i].Offset != 0;
+        if (audio && lastAudio)
+        {
+            Regions->back().Frames += _Records[i].Frames;
+        }
+        else if (audio)
+        {
+            SilenceFileRegion region = { _Records[i].Frame, _Records[i].Frames, _Records[i].WallTimeNs };
+            Regions->push_back(region);
+        }
+        lastAudio = audio;
+    }
+}
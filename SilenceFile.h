@@ -0,0 +1,201 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "AudioFormat.h"
+#include "OutputSink.h"
+#include "CapturePacketLog.h"
+#include "SilenceDetect.h"
+
+//
+//  Silence collapsed audio file.
+//
+//  A header followed by records, each a SilenceRecordHeader: audio records carry PayloadSize bytes of audio in the
+//  header's format, always whole frames; silence records carry no payload and stand for Frames frames of zeros.
+//  Records follow each other without gaps in Frame, so the file is the whole recording, and a reader can expand any
+//  part of it or skip the silence.  Records are appended as the recording goes, so a file cut short by a crash just
+//  ends at its last complete record.  All fields are little endian.
+//
+//  Threshold is the silence detector's level, as a fraction of full scale.  At 0 only digital silence is collapsed
+//  and expanding the file gives back exactly what was captured; above 0, near-silence is stored as zeros.
+//
+#define SILENCE_FILE_MAGIC          0x46534341      // "ACSF"
+#define SILENCE_FILE_RECORD_MAGIC   0x52534341      // "ACSR"
+#define SILENCE_FILE_VERSION        1
+
+#define SILENCE_RECORD_AUDIO        0
+#define SILENCE_RECORD_SILENCE      1
+
+#pragma pack(push, 1)
+
+struct SilenceFileHeader
+{
+    uint32_t                Magic;
+    uint16_t                Version;
+    uint16_t                HeaderSize;         // sizeof(SilenceFileHeader).
+    uint16_t                RecordHeaderSize;   // sizeof(SilenceRecordHeader).
+    uint16_t                Reserved;
+    float                   Threshold;
+    WAVEFORMATEXTENSIBLE    Format;             // Format.Format.cbSize says how much of the extension is valid.
+};
+
+struct SilenceRecordHeader
+{
+    uint32_t    Magic;
+    uint32_t    Type;           // SILENCE_RECORD_xxx.
+    uint64_t    Frame;          // Position of the first frame, in frames since the start of the recording.
+    uint64_t    Frames;
+    int64_t     WallTimeNs;     // Capture time of the first frame, in system clock nanoseconds since the Unix epoch; 0 if unknown.
+    uint32_t    Flags;          // CAPTURE_PACKET_FLAG_xxx of the packets the record's frames came from, OR'ed together.
+    uint32_t    PayloadSize;    // Frames * the frame size for audio, 0 for silence.
+};
+
+#pragma pack(pop)
+
+//
+//  Sink statistics.  DetectUs is the time spent deciding which chunks are silent.
+//
+struct SilenceFileStats
+{
+    uint64_t AudioRecords;
+    uint64_t SilenceRecords;
+    uint64_t AudioFrames;
+    uint64_t SilentFrames;
+    uint64_t BytesWritten;
+    uint64_t DetectUs;
+};
+
+//
+//  Writes the silence collapsed file (see above) on the writer thread.
+//
+//  The stream is looked at in chunks of 10 ms.  A chunk is silent if the packet log says every frame of it came
+//  from a packet the device flagged as silent, or if the detector finds no sample in it louder than the threshold.
+//  Silent stretches of at least MinSilenceMs become silence records; shorter ones stay in the audio, so speech
+//  pauses don't chop it up.  Audio records hold at most about a second.  Every Flush() ends the current records,
+//  so what was flushed is readable; the packet log, if any, must be the sink's alone.
+//
+class CSilenceFileSink : public IOutputSink
+{
+public:
+    CSilenceFileSink();
+
+    bool Open(const std::string& FileName, const WAVEFORMATEX* Format, double Threshold, uint32_t MinSilenceMs,
+        CCapturePacketLog* PacketLog, SampleConvertKernel MaxKernel = SampleKernelAvx2);
+    bool Write(const uint8_t* Data, size_t Size);
+    bool Flush();
+    bool Close();
+
+    void GetStats(SilenceFileStats* Stats) const;
+    SampleConvertKernel DetectorKernel() const { return _Detector.Kernel(); }
+
+private:
+    bool ProcessChunk(const uint8_t* Data, size_t Frames);
+    void LookupChunk(size_t Frames, uint32_t* Flags, bool* FlaggedSilent, int64_t* WallTimeNs);
+    bool WriteAudio(size_t Frames);
+    bool WriteSilence();
+    bool WriteRecord(uint32_t Type, uint64_t Frame, uint64_t Frames, int64_t WallTimeNs, uint32_t Flags, const uint8_t* Payload);
+
+    COutputFile             _File;
+    bool                    _Open;
+    CSilenceDetector        _Detector;
+    CCapturePacketLog*      _PacketLog;
+    size_t                  _FrameSize;
+    uint32_t                _SampleRate;
+    size_t                  _ChunkFrames;
+    uint64_t                _MinSilenceFrames;
+    size_t                  _MaxRecordFrames;
+
+    //
+    //  Bytes of a chunk split between Write() calls.
+    //
+    std::vector<uint8_t>    _Chunk;
+    size_t                  _ChunkBytes;
+    uint64_t                _Frame;             // Stream position of the next chunk.
+
+    //
+    //  Audio not written yet, starting at _AudioFrame.  Its last _QuietFrames frames are silent chunks that become
+    //  a silence record if enough follow; _QuietWallTimeNs and _QuietFlags are for that record.
+    //
+    std::vector<uint8_t>    _Audio;
+    size_t                  _AudioFrames;
+    uint64_t                _AudioFrame;
+    int64_t                 _AudioWallTimeNs;
+    uint32_t                _AudioFlags;
+    size_t                  _QuietFrames;
+    int64_t                 _QuietWallTimeNs;
+    uint32_t                _QuietFlags;
+
+    //
+    //  The silence record under way, if any.
+    //
+    bool                    _InSilence;
+    uint64_t                _SilenceFrame;
+    uint64_t                _SilenceFrames;
+    int64_t                 _SilenceWallTimeNs;
+    uint32_t                _SilenceFlags;
+
+    CapturePacketRecord     _LastRecord;        // For extrapolating times the packet log doesn't have.
+    bool                    _HaveRecord;
+
+    std::atomic<uint64_t>   _AudioRecords;
+    std::atomic<uint64_t>   _SilenceRecords;
+    std::atomic<uint64_t>   _AudioFramesWritten;
+    std::atomic<uint64_t>   _SilentFrames;
+    std::atomic<uint64_t>   _BytesWritten;
+    std::atomic<uint64_t>   _DetectNs;
+};
+
+//
+//  A stretch of a silence collapsed file with sound in it: consecutive audio records.
+//
+struct SilenceFileRegion
+{
+    uint64_t    Frame;
+    uint64_t    Frames;
+    int64_t     WallTimeNs;
+};
+
+class CSilenceFileReader
+{
+public:
+    CSilenceFileReader();
+    ~CSilenceFileReader();
+
+    //
+    //  Reads every record header, which takes a seek per record, not the audio.
+    //
+    bool Open(const std::string& FileName);
+    void Close();
+
+    const SilenceFileHeader& Header() const { return _Header; }
+    const WAVEFORMATEX* Format() const { return &_Header.Format.Format; }
+    uint64_t Frames() const { return _Frames; }
+    uint64_t SilentFrames() const { return _SilentFrames; }
+    size_t Records() const { return _Records.size(); }
+
+    //
+    //  Up to Frames frames from Frame on, with silence expanded to zeros.  Returns the number of frames read, short
+    //  only at the end of the file; 0 on a read error.
+    //
+    size_t Read(uint64_t Frame, uint8_t* Data, size_t Frames);
+
+    void GetSoundRegions(std::vector<SilenceFileRegion>* Regions) const;
+
+private:
+    struct RecordEntry
+    {
+        uint64_t    Frame;
+        uint64_t    Frames;
+        uint64_t    Offset;             // Of the payload; 0 for silence.
+        int64_t     WallTimeNs;
+    };
+
+    FILE*                       _File;
+    SilenceFileHeader           _Header;
+    std::vector<RecordEntry>    _Records;
+    uint64_t                    _Frames;
+    uint64_t                    _SilentFrames;
+};
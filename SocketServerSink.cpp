@@ -0,0 +1,971 @@
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <afunix.h>
+#else
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include "SocketServerSink.h"
+
+#define SOCKET_SERVER_BACKLOG 128
+#define SOCKET_SERVER_MAX_IOVECS 16
+#define SOCKET_SERVER_MAX_EVENTS 64
+#define SOCKET_SERVER_CLOSE_TIMEOUT_MS 2000
+
+static const intptr_t NoSocket = -1;
+
+struct CSocketServerSink::StreamChunk
+{
+    std::vector<uint8_t>    Data;
+    size_t                  Size;
+    uint64_t                Position;       // Stream position of Data[0].
+    uint32_t                References;     // Subscribers sending from this chunk.
+    StreamChunk*            Next;
+};
+
+struct CSocketServerSink::ServerClient
+{
+    intptr_t                Socket;
+    StreamChunk*            Chunk;          // Referenced; Offset bytes of it are sent.
+    size_t                  Offset;
+    size_t                  HeaderSent;
+    bool                    WantWrite;      // The socket is full; wait for it to drain.
+    bool                    SkipPending;
+    bool                    Dead;           // Removed; freed at the end of the loop iteration.
+};
+
+static int SocketLastError()
+{
+#ifdef _WIN32
+    return WSAGetLastError();
+#else
+    return errno;
+#endif
+}
+
+static bool SocketWouldBlock()
+{
+#ifdef _WIN32
+    return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+    return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+static void CloseSocket(intptr_t Socket)
+{
+    if (Socket == NoSocket)
+    {
+        return;
+    }
+#ifdef _WIN32
+    closesocket(static_cast<SOCKET>(Socket));
+#else
+    close(static_cast<int>(Socket));
+#endif
+}
+
+static bool SetNonBlocking(intptr_t Socket)
+{
+#ifdef _WIN32
+    u_long nonBlocking = 1;
+    return ioctlsocket(static_cast<SOCKET>(Socket), FIONBIO, &nonBlocking) == 0;
+#else
+    int flags = fcntl(static_cast<int>(Socket), F_GETFL);
+    return flags >= 0 && fcntl(static_cast<int>(Socket), F_SETFL, flags | O_NONBLOCK) == 0;
+#endif
+}
+
+//
+//  Gathered send of up to SOCKET_SERVER_MAX_IOVECS pieces.  Returns the bytes sent, 0 if the socket is full, or -1.
+//
+struct SendPiece
+{
+    const uint8_t*  Data;
+    size_t          Size;
+};
+
+static ptrdiff_t SendPieces(intptr_t Socket, const SendPiece* Pieces, int Count)
+{
+#ifdef _WIN32
+    WSABUF buffers[SOCKET_SERVER_MAX_IOVECS];
+    for (int i = 0; i < Count; i++)
+    {
+        buffers[i].buf = reinterpret_cast<CHAR*>(const_cast<uint8_t*>(Pieces[i].Data));
+        buffers[i].len = static_cast<ULONG>(Pieces[i].Size);
+    }
+    DWORD sent = 0;
+    if (WSASend(static_cast<SOCKET>(Socket), buffers, Count, &sent, 0, NULL, NULL) != 0)
+    {
+        return SocketWouldBlock() ? 0 : -1;
+    }
+    return static_cast<ptrdiff_t>(sent);
+#else
+    struct iovec vectors[SOCKET_SERVER_MAX_IOVECS];
+    for (int i = 0; i < Count; i++)
+    {
+        vectors[i].iov_base = const_cast<uint8_t*>(Pieces[i].Data);
+        vectors[i].iov_len = Pieces[i].Size;
+    }
+    struct msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = vectors;
+    message.msg_iovlen = Count;
+#ifdef MSG_NOSIGNAL
+    const int flags = MSG_NOSIGNAL;
+#else
+    const int flags = 0;
+#endif
+    ssize_t sent = sendmsg(static_cast<int>(Socket), &message, flags);
+    if (sent < 0)
+    {
+        return SocketWouldBlock() ? 0 : -1;
+    }
+    return sent;
+#endif
+}
+
+//
+//  A connected pair the writer thread uses to wake the event loop.  Windows has no socketpair(), so there it is a
+//  loopback TCP connection.
+//
+static bool CreateWakePair(intptr_t* ReadSocket, intptr_t* WriteSocket)
+{
+#ifdef _WIN32
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (listener == INVALID_SOCKET)
+    {
+        return false;
+    }
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int addressLength = sizeof(address);
+    SOCKET writer = INVALID_SOCKET;
+    SOCKET reader = INVALID_SOCKET;
+    if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0 &&
+        getsockname(listener, reinterpret_cast<sockaddr*>(&address), &addressLength) == 0 &&
+        listen(listener, 1) == 0)
+    {
+        writer = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (writer != INVALID_SOCKET && connect(writer, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0)
+        {
+            reader = accept(listener, NULL, NULL);
+        }
+    }
+    closesocket(listener);
+    if (reader == INVALID_SOCKET)
+    {
+        CloseSocket(static_cast<intptr_t>(writer));
+        return false;
+    }
+    *ReadSocket = static_cast<intptr_t>(reader);
+    *WriteSocket = static_cast<intptr_t>(writer);
+#else
+    int sockets[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0)
+    {
+        return false;
+    }
+    *ReadSocket = sockets[0];
+    *WriteSocket = sockets[1];
+#endif
+    return SetNonBlocking(*ReadSocket) && SetNonBlocking(*WriteSocket);
+}
+
+//
+//  Level-triggered readiness for the event loop: epoll on Linux, poll() / WSAPoll() elsewhere.  Every socket is
+//  watched for reading; writing only while a subscriber's socket is full.
+//
+struct PollerEvent
+{
+    void*   Context;
+    bool    Readable;
+    bool    Writable;
+};
+
+#ifdef __linux__
+
+class CSocketServerSink::CSocketPoller
+{
+public:
+    CSocketPoller() : _Epoll(-1) {}
+    ~CSocketPoller()
+    {
+        if (_Epoll >= 0)
+        {
+            close(_Epoll);
+        }
+    }
+
+    bool Initialize()
+    {
+        _Epoll = epoll_create1(EPOLL_CLOEXEC);
+        return _Epoll >= 0;
+    }
+
+    bool Add(intptr_t Socket, void* Context)
+    {
+        return Control(EPOLL_CTL_ADD, Socket, Context, false);
+    }
+
+    bool SetWantWrite(intptr_t Socket, void* Context, bool WantWrite)
+    {
+        return Control(EPOLL_CTL_MOD, Socket, Context, WantWrite);
+    }
+
+    void Remove(intptr_t Socket)
+    {
+        epoll_ctl(_Epoll, EPOLL_CTL_DEL, static_cast<int>(Socket), NULL);
+    }
+
+    int Wait(PollerEvent* Events, int MaxEvents, int TimeoutMs)
+    {
+        struct epoll_event events[SOCKET_SERVER_MAX_EVENTS];
+        int count = epoll_wait(_Epoll, events, std::min(MaxEvents, SOCKET_SERVER_MAX_EVENTS), TimeoutMs);
+        for (int i = 0; i < count; i++)
+        {
+            Events[i].Context = events[i].data.ptr;
+            Events[i].Readable = (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) != 0;
+            Events[i].Writable = (events[i].events & (EPOLLOUT | EPOLLHUP | EPOLLERR)) != 0;
+        }
+        return count < 0 ? 0 : count;
+    }
+
+private:
+    bool Control(int Operation, intptr_t Socket, void* Context, bool WantWrite)
+    {
+        struct epoll_event event;
+        memset(&event, 0, sizeof(event));
+        event.events = EPOLLIN | (WantWrite ? static_cast<uint32_t>(EPOLLOUT) : 0u);
+        event.data.ptr = Context;
+        return epoll_ctl(_Epoll, Operation, static_cast<int>(Socket), &event) == 0;
+    }
+
+    int _Epoll;
+};
+
+#else
+
+#ifdef _WIN32
+typedef WSAPOLLFD PollDescriptor;
+#define PollSockets(Descriptors, Count, TimeoutMs) WSAPoll(Descriptors, static_cast<ULONG>(Count), TimeoutMs)
+#else
+typedef struct pollfd PollDescriptor;
+#define PollSockets(Descriptors, Count, TimeoutMs) poll(Descriptors, static_cast<nfds_t>(Count), TimeoutMs)
+#endif
+
+class CSocketServerSink::CSocketPoller
+{
+public:
+    bool Initialize()
+    {
+        return true;
+    }
+
+    bool Add(intptr_t Socket, void* Context)
+    {
+        PollDescriptor descriptor;
+        memset(&descriptor, 0, sizeof(descriptor));
+        descriptor.fd = Socket;
+        descriptor.events = POLLIN;
+        _Descriptors.push_back(descriptor);
+        _Contexts.push_back(Context);
+        return true;
+    }
+
+    bool SetWantWrite(intptr_t Socket, void* /*Context*/, bool WantWrite)
+    {
+        for (size_t i = 0; i < _Descriptors.size(); i++)
+        {
+            if (static_cast<intptr_t>(_Descriptors[i].fd) == Socket)
+            {
+                _Descriptors[i].events = static_cast<short>(POLLIN | (WantWrite ? POLLOUT : 0));
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Remove(intptr_t Socket)
+    {
+        for (size_t i = 0; i < _Descriptors.size(); i++)
+        {
+            if (static_cast<intptr_t>(_Descriptors[i].fd) == Socket)
+            {
+                _Descriptors.erase(_Descriptors.begin() + i);
+                _Contexts.erase(_Contexts.begin() + i);
+                return;
+            }
+        }
+    }
+
+    int Wait(PollerEvent* Events, int MaxEvents, int TimeoutMs)
+    {
+        if (PollSockets(&_Descriptors[0], _Descriptors.size(), TimeoutMs) <= 0)
+        {
+            return 0;
+        }
+        int count = 0;
+        for (size_t i = 0; i < _Descriptors.size() && count < MaxEvents; i++)
+        {
+            short events = _Descriptors[i].revents;
+            if (events == 0)
+            {
+                continue;
+            }
+            Events[count].Context = _Contexts[i];
+            Events[count].Readable = (events & (POLLIN | POLLHUP | POLLERR)) != 0;
+            Events[count].Writable = (events & (POLLOUT | POLLHUP | POLLERR)) != 0;
+            count++;
+        }
+        return count;
+    }
+
+private:
+    std::vector<PollDescriptor> _Descriptors;
+    std::vector<void*>          _Contexts;
+};
+
+#endif
+
+//
+//  Event contexts for the two sockets that aren't subscribers.
+//
+static char ListenerContext;
+static char WakeContext;
+
+CSocketServerSink::CSocketServerSink() :
+    _Poller(NULL),
+    _Listener(NoSocket),
+    _WakeRead(NoSocket),
+    _WakeWrite(NoSocket),
+    _MaxLagBytes(0),
+    _Stopping(false),
+    _Head(NULL),
+    _Tail(NULL),
+    _TailEnd(0),
+    _ClientsAccepted(0),
+    _ClientsRejected(0),
+    _ClientsDropped(0),
+    _ClientsConnected(0),
+    _MaxClientsConnected(0),
+    _Skips(0),
+    _SkippedBytes(0),
+    _BytesSent(0),
+    _SendCalls(0),
+    _ChunksInUse(0)
+{
+    memset(&_Options, 0, sizeof(_Options));
+    memset(&_Header, 0, sizeof(_Header));
+}
+
+CSocketServerSink::~CSocketServerSink()
+{
+    Close();
+}
+
+bool CSocketServerSink::Open(const std::string& Address, const WAVEFORMATEX* Format, uint32_t MaxBlockFrames,
+    CCapturePacketLog* PacketLog, const SocketServerOptions& Options)
+{
+    if (Format->nAvgBytesPerSec == 0 || Options.MaxLagMs == 0 || Options.MaxClients == 0)
+    {
+        fprintf(stderr, "Invalid socket server parameters.\n");
+        return false;
+    }
+#ifdef _WIN32
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0)
+    {
+        fprintf(stderr, "Failed to initialize Winsock.\n");
+        return false;
+    }
+#endif
+    _Options = Options;
+    _MaxLagBytes = static_cast<uint64_t>(Format->nAvgBytesPerSec) * Options.MaxLagMs / 1000;
+    _Stopping = false;
+
+    //
+    //  An empty chunk to start the list, so there is always a tail for new subscribers to start after.
+    //
+    _Head = _Tail = new StreamChunk();
+    _Head->Size = 0;
+    _Head->Position = 0;
+    _Head->References = 0;
+    _Head->Next = NULL;
+    _TailEnd = 0;
+    _ChunksInUse = 1;
+
+    _Poller = new CSocketPoller();
+    if (!_Poller->Initialize() || !CreateWakePair(&_WakeRead, &_WakeWrite))
+    {
+        fprintf(stderr, "Failed to set up the socket server event loop: %d\n", SocketLastError());
+        CloseSockets();
+        return false;
+    }
+    if (!Listen(Address))
+    {
+        CloseSockets();
+        return false;
+    }
+    _Poller->Add(_Listener, &ListenerContext);
+    _Poller->Add(_WakeRead, &WakeContext);
+
+    //
+    //  The header is sent from here; it only has to be kept for the subscribers.
+    //
+    if (!Initialize(Format, true, StreamSlowReaderBlock, MaxBlockFrames, PacketLog))
+    {
+        CloseSockets();
+        return false;
+    }
+    _Thread = std::thread(&CSocketServerSink::EventLoop, this);
+    return true;
+}
+
+bool CSocketServerSink::Listen(const std::string& Address)
+{
+    if (Address.compare(0, 5, "unix:") == 0)
+    {
+        std::string path = Address.substr(5);
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(address.sun_path))
+        {
+            fprintf(stderr, "Invalid Unix socket path: %s\n", path.c_str());
+            return false;
+        }
+        memcpy(address.sun_path, path.c_str(), path.size());
+
+        //
+        //  A socket file left behind by an earlier run would make bind() fail.
+        //
+#ifdef _WIN32
+        DeleteFileA(path.c_str());
+#else
+        unlink(path.c_str());
+#endif
+        _Listener = static_cast<intptr_t>(socket(AF_UNIX, SOCK_STREAM, 0));
+        if (_Listener == NoSocket || bind(_Listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+        {
+            fprintf(stderr, "Failed to bind %s: %d\n", path.c_str(), SocketLastError());
+            return false;
+        }
+        _SocketPath = path;
+    }
+    else if (Address.compare(0, 4, "tcp:") == 0)
+    {
+        std::string host = "127.0.0.1";
+        std::string port = Address.substr(4);
+        size_t colon = port.rfind(':');
+        if (colon != std::string::npos)
+        {
+            host = port.substr(0, colon);
+            port = port.substr(colon + 1);
+        }
+
+        addrinfo hints;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        hints.ai_flags = AI_PASSIVE;
+        addrinfo* addresses = NULL;
+        if (port.empty() || getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0 || addresses == NULL)
+        {
+            fprintf(stderr, "Invalid server address: %s\n", Address.c_str());
+            return false;
+        }
+        _Listener = static_cast<intptr_t>(socket(addresses->ai_family, SOCK_STREAM, IPPROTO_TCP));
+        int reuse = 1;
+        bool bound = _Listener != NoSocket &&
+            setsockopt(_Listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse)) == 0 &&
+            bind(_Listener, addresses->ai_addr, static_cast<int>(addresses->ai_addrlen)) == 0;
+        freeaddrinfo(addresses);
+        if (!bound)
+        {
+            fprintf(stderr, "Failed to bind %s: %d\n", Address.c_str(), SocketLastError());
+            return false;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "Server address must be unix:<path>, tcp:<port> or tcp:<host>:<port>: %s\n", Address.c_str());
+        return false;
+    }
+
+    if (listen(_Listener, SOCKET_SERVER_BACKLOG) != 0 || !SetNonBlocking(_Listener))
+    {
+        fprintf(stderr, "Failed to listen on %s: %d\n", Address.c_str(), SocketLastError());
+        return false;
+    }
+    fprintf(stderr, "Serving the stream on %s\n", Address.c_str());
+    return true;
+}
+
+CStreamSink::SendResult CSocketServerSink::SendHeader(const FramedStreamHeader& Header)
+{
+    _Header = Header;
+    return SendResultSent;
+}
+
+//
+//  Hand a block to the event loop.  The copy into a pooled chunk is the only work done on the writer thread.
+//
+CStreamSink::SendResult CSocketServerSink::Send(const uint8_t* Data, size_t Size)
+{
+    StreamChunk* chunk = NULL;
+    {
+        std::lock_guard<std::mutex> lock(_Lock);
+        if (!_FreeChunks.empty())
+        {
+            chunk = _FreeChunks.back();
+            _FreeChunks.pop_back();
+        }
+    }
+    if (chunk == NULL)
+    {
+        chunk = new StreamChunk();
+        _ChunksInUse.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (chunk->Data.size() < Size)
+    {
+        chunk->Data.resize(Size);
+    }
+    memcpy(&chunk->Data[0], Data, Size);
+    chunk->Size = Size;
+    chunk->References = 0;
+    chunk->Next = NULL;
+
+    bool wake;
+    {
+        std::lock_guard<std::mutex> lock(_Lock);
+        wake = _Inbox.empty();
+        _Inbox.push_back(chunk);
+    }
+    if (wake)
+    {
+        Wake();
+    }
+    return SendResultSent;
+}
+
+void CSocketServerSink::Wake()
+{
+    const char signal = 1;
+    send(_WakeWrite, &signal, 1, 0);
+}
+
+void CSocketServerSink::EventLoop()
+{
+    PollerEvent events[SOCKET_SERVER_MAX_EVENTS];
+    std::chrono::steady_clock::time_point closeDeadline;
+    bool stopping = false;
+    for (;;)
+    {
+        int count = _Poller->Wait(events, SOCKET_SERVER_MAX_EVENTS, stopping ? 10 : 1000);
+        for (int i = 0; i < count; i++)
+        {
+            if (events[i].Context == &ListenerContext)
+            {
+                AcceptClients();
+            }
+            else if (events[i].Context == &WakeContext)
+            {
+                char drain[256];
+                while (recv(_WakeRead, drain, sizeof(drain), 0) > 0)
+                {
+                }
+            }
+            else
+            {
+                ServerClient* client = static_cast<ServerClient*>(events[i].Context);
+                if (client->Dead)
+                {
+                    continue;
+                }
+                if (events[i].Readable)
+                {
+                    //
+                    //  Subscribers don't send anything; reading only tells us when one goes away.
+                    //
+                    char discard[256];
+                    int received = static_cast<int>(recv(client->Socket, discard, sizeof(discard), 0));
+                    if (received == 0 || (received < 0 && !SocketWouldBlock()))
+                    {
+                        RemoveClient(client);
+                        continue;
+                    }
+                }
+                if (events[i].Writable && client->WantWrite)
+                {
+                    client->WantWrite = false;
+                    _Poller->SetWantWrite(client->Socket, client, false);
+                }
+            }
+        }
+
+        AdoptChunks();
+        bool drained = true;
+        for (size_t i = 0; i < _Clients.size(); i++)
+        {
+            ServerClient* client = _Clients[i];
+            if (!client->Dead && !client->WantWrite && !PumpClient(client))
+            {
+                RemoveClient(client);
+            }
+            if (!client->Dead && (client->Chunk != _Tail || client->Offset < _Tail->Size))
+            {
+                drained = false;
+            }
+        }
+        _Clients.erase(std::remove_if(_Clients.begin(), _Clients.end(), [](ServerClient* Client)
+        {
+            if (Client->Dead)
+            {
+                delete Client;
+                return true;
+            }
+            return false;
+        }), _Clients.end());
+        TrimChunks();
+
+        if (!stopping)
+        {
+            std::lock_guard<std::mutex> lock(_Lock);
+            if (_Stopping && _Inbox.empty())
+            {
+                stopping = true;
+                closeDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(SOCKET_SERVER_CLOSE_TIMEOUT_MS);
+            }
+            continue;
+        }
+        if (drained || std::chrono::steady_clock::now() >= closeDeadline)
+        {
+            break;
+        }
+    }
+}
+
+void CSocketServerSink::AcceptClients()
+{
+    for (;;)
+    {
+        intptr_t socket = static_cast<intptr_t>(accept(_Listener, NULL, NULL));
+        if (socket == NoSocket)
+        {
+            return;
+        }
+        _ClientsAccepted.fetch_add(1, std::memory_order_relaxed);
+        if (_Clients.size() >= _Options.MaxClients || !SetNonBlocking(socket))
+        {
+            _ClientsRejected.fetch_add(1, std::memory_order_relaxed);
+            CloseSocket(socket);
+            continue;
+        }
+        int noDelay = 1;
+        setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&noDelay), sizeof(noDelay));
+#ifdef SO_NOSIGPIPE
+        int noSigPipe = 1;
+        setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &noSigPipe, sizeof(noSigPipe));
+#endif
+
+        //
+        //  Start after everything already queued: the subscriber gets the header, then the next block.
+        //
+        ServerClient* client = new ServerClient();
+        client->Socket = socket;
+        client->Chunk = _Tail;
+        client->Offset = _Tail->Size;
+        client->HeaderSent = 0;
+        client->WantWrite = false;
+        client->SkipPending = false;
+        client->Dead = false;
+        _Tail->References++;
+        if (!_Poller->Add(socket, client))
+        {
+            _Tail->References--;
+            CloseSocket(socket);
+            delete client;
+            _ClientsRejected.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        _Clients.push_back(client);
+        uint32_t connected = _ClientsConnected.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (connected > _MaxClientsConnected.load(std::memory_order_relaxed))
+        {
+            _MaxClientsConnected.store(connected, std::memory_order_relaxed);
+        }
+    }
+}
+
+//
+//  Move the blocks the writer handed over onto the chunk list, then apply the lag policy.
+//
+void CSocketServerSink::AdoptChunks()
+{
+    _Adopted.clear();
+    {
+        std::lock_guard<std::mutex> lock(_Lock);
+        _Adopted.swap(_Inbox);
+    }
+    if (_Adopted.empty())
+    {
+        return;
+    }
+    for (size_t i = 0; i < _Adopted.size(); i++)
+    {
+        StreamChunk* chunk = _Adopted[i];
+        chunk->Position = _TailEnd;
+        _TailEnd += chunk->Size;
+        _Tail->Next = chunk;
+        _Tail = chunk;
+    }
+    for (size_t i = 0; i < _Clients.size(); i++)
+    {
+        if (!_Clients[i]->Dead)
+        {
+            CheckLag(_Clients[i]);
+        }
+    }
+}
+
+void CSocketServerSink::CheckLag(ServerClient* Client)
+{
+    uint64_t lag = _TailEnd - (Client->Chunk->Position + Client->Offset);
+    if (lag <= _MaxLagBytes)
+    {
+        return;
+    }
+    if (_Options.Policy == SlowClientSkip && lag <= 2 * _MaxLagBytes)
+    {
+        Client->SkipPending = true;
+        return;
+    }
+    _ClientsDropped.fetch_add(1, std::memory_order_relaxed);
+    RemoveClient(Client);
+}
+
+//
+//  Step past chunks the subscriber has sent completely.  Returns whether there is anything left to send.
+//
+bool CSocketServerSink::AdvanceClient(ServerClient* Client)
+{
+    while (Client->Offset == Client->Chunk->Size && Client->Chunk->Next != NULL)
+    {
+        StreamChunk* next = Client->Chunk->Next;
+        if (Client->SkipPending)
+        {
+            //
+            //  Blocks are whole chunks, so jumping to the newest one lands on a block boundary.
+            //
+            _Skips.fetch_add(1, std::memory_order_relaxed);
+            _SkippedBytes.fetch_add(_Tail->Position - next->Position, std::memory_order_relaxed);
+            next = _Tail;
+            Client->SkipPending = false;
+        }
+        Client->Chunk->References--;
+        next->References++;
+        Client->Chunk = next;
+        Client->Offset = 0;
+    }
+    return Client->HeaderSent < sizeof(_Header) || Client->Offset < Client->Chunk->Size;
+}
+
+//
+//  Send as much as the socket takes.  Returns false if the subscriber is gone.
+//
+bool CSocketServerSink::PumpClient(ServerClient* Client)
+{
+    while (AdvanceClient(Client))
+    {
+        SendPiece pieces[SOCKET_SERVER_MAX_IOVECS];
+        int count = 0;
+        if (Client->HeaderSent < sizeof(_Header))
+        {
+            pieces[count].Data = reinterpret_cast<const uint8_t*>(&_Header) + Client->HeaderSent;
+            pieces[count].Size = sizeof(_Header) - Client->HeaderSent;
+            count++;
+        }
+        StreamChunk* chunk = Client->Chunk;
+        size_t offset = Client->Offset;
+        while (chunk != NULL && count < SOCKET_SERVER_MAX_IOVECS)
+        {
+            if (offset < chunk->Size)
+            {
+                pieces[count].Data = &chunk->Data[offset];
+                pieces[count].Size = chunk->Size - offset;
+                count++;
+            }
+            if (Client->SkipPending)
+            {
+                break;
+            }
+            chunk = chunk->Next;
+            offset = 0;
+        }
+
+        ptrdiff_t sent = SendPieces(Client->Socket, pieces, count);
+        _SendCalls.fetch_add(1, std::memory_order_relaxed);
+        if (sent < 0)
+        {
+            return false;
+        }
+        if (sent == 0)
+        {
+            Client->WantWrite = true;
+            _Poller->SetWantWrite(Client->Socket, Client, true);
+            return true;
+        }
+        _BytesSent.fetch_add(static_cast<uint64_t>(sent), std::memory_order_relaxed);
+
+        size_t remaining = static_cast<size_t>(sent);
+        if (Client->HeaderSent < sizeof(_Header))
+        {
+            size_t header = std::min(remaining, sizeof(_Header) - Client->HeaderSent);
+            Client->HeaderSent += header;
+            remaining -= header;
+        }
+        while (remaining > 0)
+        {
+            AdvanceClient(Client);
+            size_t bytes = std::min(remaining, Client->Chunk->Size - Client->Offset);
+            Client->Offset += bytes;
+            remaining -= bytes;
+        }
+    }
+    return true;
+}
+
+void CSocketServerSink::RemoveClient(ServerClient* Client)
+{
+    if (Client->Dead)
+    {
+        return;
+    }
+    Client->Dead = true;
+    Client->Chunk->References--;
+    _Poller->Remove(Client->Socket);
+    CloseSocket(Client->Socket);
+    Client->Socket = NoSocket;
+    _ClientsConnected.fetch_sub(1, std::memory_order_relaxed);
+}
+
+//
+//  Recycle chunks from the head that no subscriber needs any more.
+//
+void CSocketServerSink::TrimChunks()
+{
+    if (_Head == _Tail || _Head->References != 0)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(_Lock);
+    while (_Head != _Tail && _Head->References == 0)
+    {
+        StreamChunk* chunk = _Head;
+        _Head = chunk->Next;
+        _FreeChunks.push_back(chunk);
+    }
+}
+
+bool CSocketServerSink::Close()
+{
+    if (_Poller == NULL)
+    {
+        return true;
+    }
+    bool succeeded = FinishStream();
+    if (_Thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(_Lock);
+            _Stopping = true;
+        }
+        Wake();
+        _Thread.join();
+    }
+    CloseSockets();
+    return succeeded;
+}
+
+void CSocketServerSink::CloseSockets()
+{
+    for (size_t i = 0; i < _Clients.size(); i++)
+    {
+        RemoveClient(_Clients[i]);
+        delete _Clients[i];
+    }
+    _Clients.clear();
+    CloseSocket(_Listener);
+    CloseSocket(_WakeRead);
+    CloseSocket(_WakeWrite);
+    _Listener = _WakeRead = _WakeWrite = NoSocket;
+    if (!_SocketPath.empty())
+    {
+#ifdef _WIN32
+        DeleteFileA(_SocketPath.c_str());
+#else
+        unlink(_SocketPath.c_str());
+#endif
+        _SocketPath.clear();
+    }
+    delete _Poller;
+    _Poller = NULL;
+
+    while (_Head != NULL)
+    {
+        StreamChunk* chunk = _Head;
+        _Head = chunk->Next;
+        delete chunk;
+    }
+    _Tail = NULL;
+    for (size_t i = 0; i < _Inbox.size(); i++)
+    {
+        delete _Inbox[i];
+    }
+    for (size_t i = 0; i < _FreeChunks.size(); i++)
+    {
+        delete _FreeChunks[i];
+    }
+    _Inbox.clear();
+    _FreeChunks.clear();
+    _ChunksInUse = 0;
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+void CSocketServerSink::GetServerStats(SocketServerStats* Stats) const
+{
+    Stats->ClientsAccepted = _ClientsAccepted.load(std::memory_order_relaxed);
+    Stats->ClientsRejected = _ClientsRejected.load(std::memory_order_relaxed);
+    Stats->ClientsDropped = _ClientsDropped.load(std::memory_order_relaxed);
+    Stats->ClientsConnected = _ClientsConnected.load(std::memory_order_relaxed);
+    Stats->MaxClientsConnected = _MaxClientsConnected.load(std::memory_order_relaxed);
+    Stats->Skips = _Skips.load(std::memory_order_relaxed);
+    Stats->SkippedBytes = _SkippedBytes.load(std::memory_order_relaxed);
+    Stats->BytesSent = _BytesSent.load(std::memory_order_relaxed);
+    Stats->SendCalls = _SendCalls.load(std::memory_order_relaxed);
+    Stats->ChunksInUse = _ChunksInUse.load(std::memory_order_relaxed);
+}
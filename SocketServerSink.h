@@ -0,0 +1,135 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "StreamSink.h"
+
+//
+//  What the server does with a subscriber that falls more than the lag limit behind.
+//
+enum SlowClientPolicy
+{
+    SlowClientDisconnect,
+    SlowClientSkip,             // Jump to the newest block once the current one is out; Sequence shows the jump.
+};
+
+struct SocketServerOptions
+{
+    uint32_t            MaxLagMs;
+    SlowClientPolicy    Policy;
+    uint32_t            MaxClients;
+};
+
+//
+//  Server statistics.  They may be read from any thread.
+//
+struct SocketServerStats
+{
+    uint64_t ClientsAccepted;
+    uint64_t ClientsRejected;       // Over MaxClients.
+    uint64_t ClientsDropped;        // Disconnected for lagging.
+    uint32_t ClientsConnected;
+    uint32_t MaxClientsConnected;
+    uint64_t Skips;
+    uint64_t SkippedBytes;
+    uint64_t BytesSent;
+    uint64_t SendCalls;
+    uint32_t ChunksInUse;           // Blocks held for subscribers, including free ones kept for reuse.
+};
+
+//
+//  Serves the framed stream (see FramedStream.h) to any number of subscribers on a Unix domain socket or a TCP port.
+//
+//  Every block is copied once, by the writer thread, into a chunk that goes on a shared list; each subscriber keeps
+//  a reference to the chunk it is sending from and an offset into it, and sends straight from the chunks with
+//  scatter/gather writes.  A chunk goes back to a free list once no subscriber references it and it isn't the newest
+//  one, so in steady state nothing is allocated.  A subscriber gets the stream header and then the stream from the
+//  next block on.  A single thread serves all of them from an event loop (epoll on Linux, poll / WSAPoll elsewhere),
+//  and never blocks on one: a subscriber whose socket is full just waits for it to drain, and one that lags more
+//  than MaxLagMs behind the newest block is disconnected or skipped ahead at a block boundary, per Policy.  Under
+//  the skip policy, one that is stuck in the middle of a block for twice that long is disconnected anyway, since it
+//  holds every chunk after it.
+//
+//  Addresses are unix:<path>, tcp:<port> (loopback only) or tcp:<host>:<port>.
+//
+class CSocketServerSink : public CStreamSink
+{
+public:
+    CSocketServerSink();
+    ~CSocketServerSink();
+
+    bool Open(const std::string& Address, const WAVEFORMATEX* Format, uint32_t MaxBlockFrames, CCapturePacketLog* PacketLog,
+        const SocketServerOptions& Options);
+
+    //
+    //  Sends the end of stream block, gives subscribers up to a couple of seconds to receive everything and closes.
+    //
+    bool Close();
+
+    void GetServerStats(SocketServerStats* Stats) const;
+
+protected:
+    SendResult SendHeader(const FramedStreamHeader& Header);
+    SendResult Send(const uint8_t* Data, size_t Size);
+
+private:
+    struct StreamChunk;
+    struct ServerClient;
+    class CSocketPoller;
+
+    bool Listen(const std::string& Address);
+    void EventLoop();
+    void AcceptClients();
+    void AdoptChunks();
+    bool PumpClient(ServerClient* Client);
+    bool AdvanceClient(ServerClient* Client);
+    void CheckLag(ServerClient* Client);
+    void RemoveClient(ServerClient* Client);
+    void TrimChunks();
+    void Wake();
+    void CloseSockets();
+
+    CSocketPoller*              _Poller;
+    intptr_t                    _Listener;
+    intptr_t                    _WakeRead;
+    intptr_t                    _WakeWrite;
+    std::string                 _SocketPath;        // Unix socket to remove on close.
+    SocketServerOptions         _Options;
+    uint64_t                    _MaxLagBytes;
+    FramedStreamHeader          _Header;
+    std::thread                 _Thread;
+
+    //
+    //  Handoff from the writer thread.
+    //
+    std::mutex                  _Lock;
+    std::vector<StreamChunk*>   _Inbox;
+    std::vector<StreamChunk*>   _FreeChunks;
+    bool                        _Stopping;
+
+    //
+    //  Event loop thread only.  _Head .. _Tail is the chunk list in stream order; _Tail is never recycled, so a new
+    //  subscriber always has a chunk to start after.
+    //
+    StreamChunk*                _Head;
+    StreamChunk*                _Tail;
+    uint64_t                    _TailEnd;           // Stream position right after _Tail.
+    std::vector<ServerClient*>  _Clients;
+    std::vector<StreamChunk*>   _Adopted;
+
+    std::atomic<uint64_t>       _ClientsAccepted;
+    std::atomic<uint64_t>       _ClientsRejected;
+    std::atomic<uint64_t>       _ClientsDropped;
+    std::atomic<uint32_t>       _ClientsConnected;
+    std::atomic<uint32_t>       _MaxClientsConnected;
+    std::atomic<uint64_t>       _Skips;
+    std::atomic<uint64_t>       _SkippedBytes;
+    std::atomic<uint64_t>       _BytesSent;
+    std::atomic<uint64_t>       _SendCalls;
+    std::atomic<uint32_t>       _ChunksInUse;
+};
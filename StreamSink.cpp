@@ -0,0 +1,334 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "StreamSink.h"
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+CStreamSink::CStreamSink() :
+    _Open(false),
+    _Framed(true),
+    _Policy(StreamSlowReaderBlock),
+    _PacketLog(NULL),
+    _FrameSize(0),
+    _SampleRate(0),
+    _MaxBlockFrames(0),
+    _Buffered(0),
+    _Frame(0),
+    _Sequence(0),
+    _Discontinuity(false),
+    _HaveRecord(false),
+    _BlocksSent(0),
+    _BytesSent(0),
+    _BlocksDropped(0),
+    _FramesDropped(0),
+    _BlockedUs(0),
+    _MaxBlockedUs(0)
+{
+    memset(&_LastRecord, 0, sizeof(_LastRecord));
+}
+
+bool CStreamSink::Open(const std::string& Target, const WAVEFORMATEX* Format, bool Framed, StreamSlowReaderPolicy Policy,
+    uint32_t MaxBlockFrames, CCapturePacketLog* PacketLog)
+{
+    if (Target == "-")
+    {
+        if (!_Pipe.OpenStdout())
+        {
+            fprintf(stderr, "Failed to set up stdout for streaming: %d\n", COutputPipe::LastError());
+            return false;
+        }
+    }
+    else
+    {
+        fprintf(stderr, "Waiting for a reader on %s\n", Target.c_str());
+        if (!_Pipe.CreateFifo(Target))
+        {
+            fprintf(stderr, "Failed to open named pipe %s: %d\n", Target.c_str(), COutputPipe::LastError());
+            return false;
+        }
+    }
+
+    if (!Initialize(Format, Framed, Policy, MaxBlockFrames, PacketLog))
+    {
+        _Pipe.Close();
+        return false;
+    }
+    return true;
+}
+
+bool CStreamSink::Initialize(const WAVEFORMATEX* Format, bool Framed, StreamSlowReaderPolicy Policy, uint32_t MaxBlockFrames,
+    CCapturePacketLog* PacketLog)
+{
+    if (Format->nBlockAlign == 0 || Format->nSamplesPerSec == 0 || MaxBlockFrames == 0)
+    {
+        fprintf(stderr, "Invalid stream parameters.\n");
+        return false;
+    }
+    _Framed = Framed;
+    _Policy = Policy;
+    _PacketLog = PacketLog;
+    _FrameSize = Format->nBlockAlign;
+    _SampleRate = Format->nSamplesPerSec;
+    _MaxBlockFrames = MaxBlockFrames;
+    _Buffer.assign(sizeof(FramedStreamBlockHeader) + (static_cast<size_t>(MaxBlockFrames) + 1) * _FrameSize, 0);
+    _Buffered = 0;
+    _Frame = 0;
+    _Sequence = 0;
+    _Discontinuity = false;
+    _HaveRecord = false;
+    _Open = true;
+
+    if (!_Framed)
+    {
+        return true;
+    }
+
+    FramedStreamHeader header;
+    memset(&header, 0, sizeof(header));
+    header.Magic = FRAMED_STREAM_MAGIC;
+    header.Version = FRAMED_STREAM_VERSION;
+    header.HeaderSize = sizeof(FramedStreamHeader);
+    header.BlockHeaderSize = sizeof(FramedStreamBlockHeader);
+    memcpy(&header.Format, Format, std::min(sizeof(header.Format), sizeof(WAVEFORMATEX) + Format->cbSize));
+    if (SendHeader(header) != SendResultSent)
+    {
+        fprintf(stderr, "Failed to write the stream header: %d\n", COutputPipe::LastError());
+        _Open = false;
+        return false;
+    }
+    return true;
+}
+
+//
+//  The stream header can't be dropped - without it the stream is unreadable.
+//
+CStreamSink::SendResult CStreamSink::SendHeader(const FramedStreamHeader& Header)
+{
+    StreamSlowReaderPolicy policy = _Policy;
+    _Policy = StreamSlowReaderBlock;
+    SendResult result = Send(reinterpret_cast<const uint8_t*>(&Header), sizeof(Header));
+    _Policy = policy;
+    return result;
+}
+
+//
+//  Write Size bytes, waiting for room as the policy allows.  A block is only dropped if none of it went out.
+//
+CStreamSink::SendResult CStreamSink::Send(const uint8_t* Data, size_t Size)
+{
+    size_t sent = 0;
+    std::chrono::steady_clock::time_point blockedSince;
+    bool blocked = false;
+    while (sent < Size)
+    {
+        ptrdiff_t written = _Pipe.TryWrite(Data + sent, Size - sent);
+        if (written < 0)
+        {
+            return SendResultFailed;
+        }
+        sent += static_cast<size_t>(written);
+        if (sent == Size)
+        {
+            break;
+        }
+        if (sent == 0 && _Policy == StreamSlowReaderDrop)
+        {
+            return SendResultDropped;
+        }
+        if (!blocked)
+        {
+            blocked = true;
+            blockedSince = std::chrono::steady_clock::now();
+        }
+        _Pipe.WaitWritable(100);
+    }
+
+    if (blocked)
+    {
+        uint64_t blockedUs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - blockedSince).count());
+        _BlockedUs.fetch_add(blockedUs, std::memory_order_relaxed);
+        if (blockedUs > _MaxBlockedUs.load(std::memory_order_relaxed))
+        {
+            _MaxBlockedUs.store(blockedUs, std::memory_order_relaxed);
+        }
+    }
+    return SendResultSent;
+}
+
+//
+//  Send the buffered frames as blocks.  Unless All is set, a short block is only sent where a packet ends, and
+//  the rest waits for more data.
+//
+bool CStreamSink::SendBlocks(bool All)
+{
+    uint8_t* payload = &_Buffer[sizeof(FramedStreamBlockHeader)];
+    for (;;)
+    {
+        uint64_t frames = std::min<uint64_t>(_Buffered / _FrameSize, _MaxBlockFrames);
+        if (frames == 0 || (!All && frames < _MaxBlockFrames))
+        {
+            return true;
+        }
+
+        //
+        //  Take flags and time from the packet the first frame came from, and end the block where that packet ends.
+        //
+        uint32_t flags = 0;
+        uint32_t gapFrames = 0;
+        int64_t timeNs;
+        CapturePacketRecord record;
+        if (_PacketLog != NULL && _PacketLog->Lookup(_Frame, &record))
+        {
+            _LastRecord = record;
+            _HaveRecord = true;
+            flags = record.Flags & ~FRAMED_STREAM_FLAG_END_OF_STREAM;
+            if (_Frame != record.Frame)
+            {
+                flags &= ~FRAMED_STREAM_FLAG_DISCONTINUITY;
+            }
+            else
+            {
+                gapFrames = record.GapFrames;
+            }
+            frames = std::min(frames, record.Frame + record.Frames - _Frame);
+        }
+        else
+        {
+            flags = FRAMED_STREAM_FLAG_TIMESTAMP_ERROR;
+            if (!_HaveRecord)
+            {
+                _LastRecord.Frame = _Frame;
+                _LastRecord.TimeNs = SteadyClockNs();
+                _HaveRecord = true;
+            }
+        }
+        timeNs = _LastRecord.TimeNs + static_cast<int64_t>((_Frame - _LastRecord.Frame) * 1000000000 / _SampleRate);
+        if (_Discontinuity)
+        {
+            flags |= FRAMED_STREAM_FLAG_DISCONTINUITY;
+        }
+
+        size_t bytes = static_cast<size_t>(frames) * _FrameSize;
+        SendResult result;
+        if (_Framed)
+        {
+            FramedStreamBlockHeader* header = reinterpret_cast<FramedStreamBlockHeader*>(&_Buffer[0]);
+            header->Magic = FRAMED_STREAM_BLOCK_MAGIC;
+            header->PayloadSize = static_cast<uint32_t>(bytes);
+            header->Sequence = _Sequence;
+            header->Frame = _Frame;
+            header->TimeNs = timeNs;
+            header->Flags = flags;
+            header->GapFrames = gapFrames;
+            result = Send(&_Buffer[0], sizeof(FramedStreamBlockHeader) + bytes);
+        }
+        else
+        {
+            result = Send(payload, bytes);
+        }
+
+        if (result == SendResultFailed)
+        {
+            fprintf(stderr, "Failed to write to the stream: %d\n", COutputPipe::LastError());
+            return false;
+        }
+        if (result == SendResultDropped)
+        {
+            _BlocksDropped.fetch_add(1, std::memory_order_relaxed);
+            _FramesDropped.fetch_add(frames, std::memory_order_relaxed);
+            _Discontinuity = true;
+        }
+        else
+        {
+            _BlocksSent.fetch_add(1, std::memory_order_relaxed);
+            _BytesSent.fetch_add(bytes, std::memory_order_relaxed);
+            _Discontinuity = false;
+        }
+        _Sequence++;
+        _Frame += frames;
+        _Buffered -= bytes;
+        memmove(payload, payload + bytes, _Buffered);
+    }
+}
+
+bool CStreamSink::Write(const uint8_t* Data, size_t Size)
+{
+    if (!_Open)
+    {
+        return false;
+    }
+
+    const size_t capacity = _Buffer.size() - sizeof(FramedStreamBlockHeader);
+    uint8_t* payload = &_Buffer[sizeof(FramedStreamBlockHeader)];
+    while (Size > 0)
+    {
+        size_t chunk = std::min(Size, capacity - _Buffered);
+        memcpy(payload + _Buffered, Data, chunk);
+        _Buffered += chunk;
+        Data += chunk;
+        Size -= chunk;
+        if (!SendBlocks(Size == 0))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CStreamSink::Flush()
+{
+    return _Open;
+}
+
+//
+//  Send the end of stream block, waiting for the reader whatever the policy.
+//
+bool CStreamSink::FinishStream()
+{
+    if (!_Open)
+    {
+        return true;
+    }
+    _Open = false;
+    if (!_Framed)
+    {
+        return true;
+    }
+
+    FramedStreamBlockHeader header;
+    memset(&header, 0, sizeof(header));
+    header.Magic = FRAMED_STREAM_BLOCK_MAGIC;
+    header.Sequence = _Sequence;
+    header.Frame = _Frame;
+    header.TimeNs = _HaveRecord ? _LastRecord.TimeNs + static_cast<int64_t>((_Frame - _LastRecord.Frame) * 1000000000 / _SampleRate) : 0;
+    header.Flags = FRAMED_STREAM_FLAG_END_OF_STREAM;
+    _Policy = StreamSlowReaderBlock;
+    return Send(reinterpret_cast<const uint8_t*>(&header), sizeof(header)) == SendResultSent;
+}
+
+bool CStreamSink::Close()
+{
+    if (!_Pipe.IsOpen())
+    {
+        return true;
+    }
+    bool succeeded = FinishStream();
+    _Pipe.Close();
+    return succeeded;
+}
+
+void CStreamSink::GetStats(StreamSinkStats* Stats) const
+{
+    Stats->BlocksSent = _BlocksSent.load(std::memory_order_relaxed);
+    Stats->BytesSent = _BytesSent.load(std::memory_order_relaxed);
+    Stats->BlocksDropped = _BlocksDropped.load(std::memory_order_relaxed);
+    Stats->FramesDropped = _FramesDropped.load(std::memory_order_relaxed);
+    Stats->BlockedUs = _BlockedUs.load(std::memory_order_relaxed);
+    Stats->MaxBlockedUs = _MaxBlockedUs.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "OutputSink.h"
+#include "OutputPipe.h"
+#include "FramedStream.h"
+#include "CapturePacketLog.h"
+
+//
+//  What the sink does when the pipe is full because the reader is slow.
+//
+enum StreamSlowReaderPolicy
+{
+    StreamSlowReaderBlock,      // Wait for the reader; the writer queue absorbs the delay.
+    StreamSlowReaderDrop,       // Drop the block and count it; the stream carries on at the current audio.
+};
+
+//
+//  Sink statistics.  BlockedUs is the time spent waiting for the reader.
+//
+struct StreamSinkStats
+{
+    uint64_t BlocksSent;
+    uint64_t BytesSent;
+    uint64_t BlocksDropped;
+    uint64_t FramesDropped;
+    uint64_t BlockedUs;
+    uint64_t MaxBlockedUs;
+};
+
+//
+//  Streams the capture into a pipe, framed (see FramedStream.h) or as raw PCM.
+//
+//  Every Write() goes out as soon as the writer thread has it, cut into blocks of at most MaxBlockFrames frames.
+//  With a packet log, blocks are also cut where the capture packet flags change and carry the capture time of their
+//  first frame; without one, blocks have no flags and extrapolated times.  The pipe is non-blocking, so a slow
+//  reader is handled by the policy instead of stalling on a write; a block is only ever dropped whole, so the
+//  framing and raw frame alignment stay intact.  Flush() does nothing - there is nothing to make durable.
+//
+class CStreamSink : public IOutputSink
+{
+public:
+    CStreamSink();
+    virtual ~CStreamSink() {}
+
+    //
+    //  Target "-" is stdout; anything else is a named pipe that is created, and Open() waits for a reader.
+    //
+    bool Open(const std::string& Target, const WAVEFORMATEX* Format, bool Framed, StreamSlowReaderPolicy Policy,
+        uint32_t MaxBlockFrames, CCapturePacketLog* PacketLog);
+    bool Write(const uint8_t* Data, size_t Size);
+    bool Flush();
+    bool Close();
+
+    void GetStats(StreamSinkStats* Stats) const;
+
+protected:
+    enum SendResult
+    {
+        SendResultSent,
+        SendResultDropped,
+        SendResultFailed,
+    };
+
+    //
+    //  Derived sinks deliver the stream somewhere else by overriding the transport: Initialize() sets up the
+    //  framing and sends the stream header, SendHeader() and Send() get the header and every block (header and
+    //  payload in one piece), and FinishStream() sends the end of stream block.
+    //
+    bool Initialize(const WAVEFORMATEX* Format, bool Framed, StreamSlowReaderPolicy Policy, uint32_t MaxBlockFrames,
+        CCapturePacketLog* PacketLog);
+    bool FinishStream();
+    virtual SendResult SendHeader(const FramedStreamHeader& Header);
+    virtual SendResult Send(const uint8_t* Data, size_t Size);
+
+private:
+    bool SendBlocks(bool All);
+
+    COutputPipe                 _Pipe;
+    bool                        _Open;
+    bool                        _Framed;
+    StreamSlowReaderPolicy      _Policy;
+    CCapturePacketLog*          _PacketLog;
+    size_t                      _FrameSize;
+    uint32_t                    _SampleRate;
+    uint32_t                    _MaxBlockFrames;
+
+    //
+    //  Bytes of the current Write() not sent yet, behind room for a block header; only a partial frame stays
+    //  between calls.
+    //
+    std::vector<uint8_t>        _Buffer;
+    size_t                      _Buffered;
+
+    uint64_t                    _Frame;             // Stream position of the next block.
+    uint64_t                    _Sequence;
+    bool                        _Discontinuity;     // A block was dropped since the last one sent.
+    CapturePacketRecord         _LastRecord;        // For extrapolating times the packet log doesn't have.
+    bool                        _HaveRecord;
+
+    std::atomic<uint64_t>       _BlocksSent;
+    std::atomic<uint64_t>       _BytesSent;
+    std::atomic<uint64_t>       _BlocksDropped;
+    std::atomic<uint64_t>       _FramesDropped;
+    std::atomic<uint64_t>       _BlockedUs;
+    std::atomic<uint64_t>       _MaxBlockedUs;
+};
@@ -0,0 +1,274 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "SyntheticCaptureSource.h"
+
+#define SYNTHETIC_TONE_HZ           440.0
+#define SYNTHETIC_TONE_AMPLITUDE    0.25
+#define SYNTHETIC_TWO_PI            6.283185307179586
+
+//
+//  With a shared signal every channel also carries this tone, which has no common period with the 440 Hz ones short
+//  of 10 seconds, so two recordings of it only line up at the right offset.
+//
+#define SYNTHETIC_SHARED_HZ         97.3
+#define SYNTHETIC_SHARED_AMPLITUDE  0.2
+
+CSyntheticCaptureSource::CSyntheticCaptureSource() :
+    _PacketFrames(0),
+    _JitterInHns(0),
+    _StartTime(0),
+    _PacketIndex(0),
+    _NextPacketDue(0),
+    _RandomState(0x12345678),
+    _SkewPpm(0),
+    _StartDelayInHns(0),
+    _SharedSignal(false),
+    _HnsPerFrame(0.0),
+    _SwitchAfterFrames(0),
+    _SwitchSamplesPerSec(0),
+    _SwitchChannels(0),
+    _SwitchGapInHns(0),
+    _Switching(false)
+{
+}
+
+CSyntheticCaptureSource::~CSyntheticCaptureSource()
+{
+}
+
+//
+//  Initialize the generator.  BitsPerSample is 32 for float, or 16/24/32 for integer PCM.
+//
+bool CSyntheticCaptureSource::Initialize(DWORD SamplesPerSec, WORD Channels, WORD BitsPerSample, bool IsFloat,
+    UINT32 PacketFrames, UINT32 JitterInMS, bool RealTime)
+{
+    if (SamplesPerSec == 0 || Channels == 0 || PacketFrames == 0)
+    {
+        fprintf(stderr, "Invalid synthetic source parameters.\n");
+        return false;
+    }
+    if (IsFloat ? BitsPerSample != 32 : (BitsPerSample != 16 && BitsPerSample != 24 && BitsPerSample != 32))
+    {
+        fprintf(stderr, "Unsupported synthetic sample format: %u bits %s.\n", BitsPerSample, IsFloat ? "float" : "integer");
+        return false;
+    }
+
+    _PacketFrames = PacketFrames;
+    _JitterInHns = static_cast<int64_t>(JitterInMS) * REFTIMES_PER_MILLISEC;
+    SetFormat(SamplesPerSec, Channels, BitsPerSample, IsFloat);
+
+    //
+    //  Wake up twice per packet, like a timer driven engine client.
+    //
+    int64_t packetDuration = static_cast<int64_t>(PacketFrames) * 10000000 / SamplesPerSec;
+    return InitializeClock(packetDuration > 1 ? packetDuration / 2 : 1, RealTime);
+}
+
+//
+//  Switch to SamplesPerSec and Channels (same sample type) once AfterMS of audio has been delivered, with no packets
+//  for GapInMS.  Packets keep their duration.
+//
+bool CSyntheticCaptureSource::ScheduleFormatSwitch(UINT32 AfterMS, DWORD SamplesPerSec, WORD Channels, UINT32 GapInMS)
+{
+    if (AfterMS == 0 || SamplesPerSec == 0 || Channels == 0)
+    {
+        fprintf(stderr, "Invalid format switch parameters.\n");
+        return false;
+    }
+    _SwitchAfterFrames = static_cast<uint64_t>(AfterMS) * _MixFormat.Format.nSamplesPerSec / 1000;
+    _SwitchSamplesPerSec = SamplesPerSec;
+    _SwitchChannels = Channels;
+    _SwitchGapInHns = static_cast<int64_t>(GapInMS) * REFTIMES_PER_MILLISEC;
+    return true;
+}
+
+//
+//  Run the sample clock SkewPpm parts per million fast (negative: slow) against the host clock, and start recording
+//  StartDelayInMS after Start().  With SharedSignal the tones are a function of the host time each frame is recorded
+//  at rather than of the frame count, like the same sound reaching several devices: sources with different clocks
+//  then record the same signal at the same instant, and lining their frames up by capture time makes them match.
+//
+bool CSyntheticCaptureSource::SetClock(int SkewPpm, UINT32 StartDelayInMS, bool SharedSignal)
+{
+    if (SkewPpm <= -100000 || SkewPpm >= 100000)
+    {
+        fprintf(stderr, "Invalid synthetic clock skew: %d ppm.\n", SkewPpm);
+        return false;
+    }
+    _SkewPpm = SkewPpm;
+    _StartDelayInHns = static_cast<int64_t>(StartDelayInMS) * REFTIMES_PER_MILLISEC;
+    _SharedSignal = SharedSignal;
+    _HnsPerFrame = 10000000.0 / (_MixFormat.Format.nSamplesPerSec * (1.0 + _SkewPpm / 1000000.0));
+    return true;
+}
+
+void CSyntheticCaptureSource::SetFormat(DWORD SamplesPerSec, WORD Channels, WORD BitsPerSample, bool IsFloat)
+{
+    InitializeWaveFormat(&_MixFormat, IsFloat, Channels, SamplesPerSec, BitsPerSample, 0);
+    _HnsPerFrame = 10000000.0 / (SamplesPerSec * (1.0 + _SkewPpm / 1000000.0));
+
+    _Packet.assign(static_cast<size_t>(_PacketFrames) * FrameSize(), 0);
+    _Phase.assign(Channels, 0.0);
+    _PhaseIncrement.resize(Channels);
+    for (WORD channel = 0; channel < Channels; channel++)
+    {
+        _PhaseIncrement[channel] = SYNTHETIC_TWO_PI * SYNTHETIC_TONE_HZ * (channel + 1) / SamplesPerSec;
+    }
+}
+
+void CSyntheticCaptureSource::OnStart()
+{
+    StartStream(_StartDelayInHns);
+}
+
+void CSyntheticCaptureSource::StartStream(int64_t DelayInHns)
+{
+    _StartTime = Clock()->Now() + DelayInHns;
+    _PacketIndex = 0;
+    _NextPacketDue = PacketDueTime(0);
+    _Switching = false;
+}
+
+//
+//  The old stream is gone: wait out the gap, then start over on the new format as a fresh stream would.  The tones
+//  keep their phase so the output is continuous apart from the gap.
+//
+bool CSyntheticCaptureSource::OnStreamSwitch()
+{
+    const WAVEFORMATEX* format = &_MixFormat.Format;
+    UINT32 packetFrames = static_cast<UINT32>(static_cast<uint64_t>(_PacketFrames) * _SwitchSamplesPerSec / format->nSamplesPerSec);
+    _PacketFrames = packetFrames > 0 ? packetFrames : 1;
+
+    std::vector<double> phase = _Phase;
+    SetFormat(_SwitchSamplesPerSec, _SwitchChannels, format->wBitsPerSample, IsFloatFormat(format));
+    for (size_t channel = 0; channel < _Phase.size() && channel < phase.size(); channel++)
+    {
+        _Phase[channel] = phase[channel];
+    }
+
+    Clock()->SleepUntil(Clock()->Now() + _SwitchGapInHns);
+    StartStream(0);
+    return true;
+}
+
+//
+//  Host time, in 100 ns units, that Frames frames take at the skewed rate.
+//
+int64_t CSyntheticCaptureSource::FramesToHns(uint64_t Frames)
+{
+    if (_SkewPpm == 0)
+    {
+        return static_cast<int64_t>(Frames * 10000000 / _MixFormat.Format.nSamplesPerSec);
+    }
+    return static_cast<int64_t>(Frames * _HnsPerFrame);
+}
+
+//
+//  Packet PacketIndex has been "recorded" once PacketIndex + 1 packet durations have elapsed.  The jitter only ever
+//  delays a packet, and never past its successor, so packets stay in order.
+//
+int64_t CSyntheticCaptureSource::PacketDueTime(uint64_t PacketIndex)
+{
+    int64_t due = _StartTime + FramesToHns((PacketIndex + 1) * _PacketFrames);
+    if (_JitterInHns > 0)
+    {
+        _RandomState ^= _RandomState << 13;
+        _RandomState ^= _RandomState >> 17;
+        _RandomState ^= _RandomState << 5;
+        due += static_cast<int64_t>(_RandomState % static_cast<uint32_t>(_JitterInHns + 1));
+    }
+    if (PacketIndex != 0 && due < _NextPacketDue)
+    {
+        due = _NextPacketDue;
+    }
+    return due;
+}
+
+bool CSyntheticCaptureSource::GetNextPacketSize(uint32_t* Frames)
+{
+    *Frames = !_Switching && Clock()->Now() >= _NextPacketDue ? _PacketFrames : 0;
+    return true;
+}
+
+bool CSyntheticCaptureSource::GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition)
+{
+    GeneratePacket();
+
+    *Data = &_Packet[0];
+    *Frames = _PacketFrames;
+    *Flags = 0;
+    if (DevicePosition != NULL)
+    {
+        *DevicePosition = _PacketIndex * _PacketFrames;
+    }
+    //
+    //  Like an engine, report when the first frame was recorded; the packet is delivered a packet duration plus
+    //  the jitter later.
+    //
+    if (QPCPosition != NULL)
+    {
+        *QPCPosition = static_cast<uint64_t>(_StartTime + FramesToHns(_PacketIndex * _PacketFrames));
+    }
+    return true;
+}
+
+bool CSyntheticCaptureSource::ReleaseBuffer(uint32_t /*Frames*/)
+{
+    _PacketIndex++;
+    _NextPacketDue = PacketDueTime(_PacketIndex);
+
+    if (_SwitchAfterFrames != 0 && _PacketIndex * _PacketFrames >= _SwitchAfterFrames)
+    {
+        _SwitchAfterFrames = 0;
+        _Switching = true;
+        RequestStreamSwitch();
+    }
+    return true;
+}
+
+void CSyntheticCaptureSource::GeneratePacket()
+{
+    const WORD channels = _MixFormat.Format.nChannels;
+    const WORD bytesPerSample = _MixFormat.Format.wBitsPerSample / 8;
+    const bool isFloat = IsFloatFormat(&_MixFormat.Format);
+    uint8_t* target = &_Packet[0];
+
+    for (UINT32 frame = 0; frame < _PacketFrames; frame++)
+    {
+        double time = _SharedSignal ? (_StartTime + (_PacketIndex * _PacketFrames + frame) * _HnsPerFrame) / 10000000.0 : 0.0;
+        for (WORD channel = 0; channel < channels; channel++)
+        {
+            double sample;
+            if (_SharedSignal)
+            {
+                sample = SYNTHETIC_SHARED_AMPLITUDE * (sin(SYNTHETIC_TWO_PI * SYNTHETIC_TONE_HZ * (channel + 1) * time) +
+                    sin(SYNTHETIC_TWO_PI * SYNTHETIC_SHARED_HZ * time));
+            }
+            else
+            {
+                sample = SYNTHETIC_TONE_AMPLITUDE * sin(_Phase[channel]);
+                _Phase[channel] += _PhaseIncrement[channel];
+                if (_Phase[channel] >= SYNTHETIC_TWO_PI)
+                {
+                    _Phase[channel] -= SYNTHETIC_TWO_PI;
+                }
+            }
+
+            if (isFloat)
+            {
+                float value = static_cast<float>(sample);
+                memcpy(target, &value, sizeof(value));
+            }
+            else
+            {
+                //
+                //  Little endian, most significant bytes of a 32 bit value.
+                //
+                int32_t value = static_cast<int32_t>(sample * 2147483647.0);
+                memcpy(target, reinterpret_cast<uint8_t*>(&value) + (4 - bytesPerSample), bytesPerSample);
+            }
+            target += bytesPerSample;
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include "ClockedCaptureSource.h"
+
+//
+//  Synthetic capture source.
+//
+//  Generates a sine tone per channel (440 Hz times the channel number) in fixed size packets.  Packet k becomes
+//  available once k + 1 packet durations have elapsed plus a random delay of up to JitterInMS, which reproduces the
+//  bursty delivery of a real engine under load.  All buffers are allocated in Initialize().
+//
+//  ScheduleFormatSwitch() makes the source behave like an endpoint that goes away and comes back on another format:
+//  after a while it stops delivering, waits out the gap, and restarts its packets in the new format.
+//
+//  SetClock() makes it behave like a separate device with its own crystal: its sample clock runs fast or slow
+//  against the host clock, and it starts recording a while after Start().
+//
+class CSyntheticCaptureSource : public CClockedCaptureSource
+{
+public:
+    CSyntheticCaptureSource();
+
+    bool Initialize(DWORD SamplesPerSec, WORD Channels, WORD BitsPerSample, bool IsFloat,
+        UINT32 PacketFrames, UINT32 JitterInMS, bool RealTime);
+    bool ScheduleFormatSwitch(UINT32 AfterMS, DWORD SamplesPerSec, WORD Channels, UINT32 GapInMS);
+    bool SetClock(int SkewPpm, UINT32 StartDelayInMS, bool SharedSignal);
+
+protected:
+    ~CSyntheticCaptureSource();
+
+    void OnStart();
+    bool OnStreamSwitch();
+    bool GetNextPacketSize(uint32_t* Frames);
+    bool GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition);
+    bool ReleaseBuffer(uint32_t Frames);
+
+private:
+    void StartStream(int64_t DelayInHns);
+    int64_t FramesToHns(uint64_t Frames);
+    int64_t PacketDueTime(uint64_t PacketIndex);
+    void GeneratePacket();
+    void SetFormat(DWORD SamplesPerSec, WORD Channels, WORD BitsPerSample, bool IsFloat);
+
+    UINT32                  _PacketFrames;
+    int64_t                 _JitterInHns;
+    std::vector<uint8_t>    _Packet;
+    std::vector<double>     _Phase;
+    std::vector<double>     _PhaseIncrement;
+
+    int64_t                 _StartTime;
+    uint64_t                _PacketIndex;
+    int64_t                 _NextPacketDue;
+    uint32_t                _RandomState;
+
+    int                     _SkewPpm;
+    int64_t                 _StartDelayInHns;
+    bool                    _SharedSignal;
+    double                  _HnsPerFrame;           // Host time per frame at the skewed rate.
+
+    uint64_t                _SwitchAfterFrames;     // 0 if no switch is scheduled.
+    DWORD                   _SwitchSamplesPerSec;
+    WORD                    _SwitchChannels;
+    int64_t                 _SwitchGapInHns;
+    bool                    _Switching;
+};
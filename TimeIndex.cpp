@@ -0,0 +1,261 @@
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include "TimeIndex.h"
+#include "CaptureDrain.h"
+#include "WavFile.h"
+
+static int64_t SystemClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+CTimeIndexWriter::CTimeIndexWriter() :
+    _File(NULL),
+    _PacketLog(NULL),
+    _NextFrame(0),
+    _Entries(0),
+    _LastWallTimeNs(INT64_MIN),
+    _HaveRecord(false)
+{
+    memset(&_Header, 0, sizeof(_Header));
+    memset(&_LastRecord, 0, sizeof(_LastRecord));
+}
+
+CTimeIndexWriter::~CTimeIndexWriter()
+{
+    Close();
+}
+
+bool CTimeIndexWriter::Open(const std::string& FileName, const WAVEFORMATEX* Format, uint64_t DataOffset, uint32_t IntervalFrames,
+    CCapturePacketLog* PacketLog)
+{
+    if (Format->nSamplesPerSec == 0 || Format->nBlockAlign == 0 || IntervalFrames == 0 || PacketLog == NULL)
+    {
+        fprintf(stderr, "Invalid time index parameters.\n");
+        return false;
+    }
+    _File = fopen(FileName.c_str(), "wb");
+    if (_File == NULL)
+    {
+        fprintf(stderr, "Unable to create time index %s\n", FileName.c_str());
+        return false;
+    }
+
+    _Header.Magic = TIME_INDEX_MAGIC;
+    _Header.Version = TIME_INDEX_VERSION;
+    _Header.HeaderSize = sizeof(TimeIndexHeader);
+    _Header.EntrySize = sizeof(TimeIndexEntry);
+    _Header.SampleRate = Format->nSamplesPerSec;
+    _Header.FrameSize = Format->nBlockAlign;
+    _Header.IntervalFrames = IntervalFrames;
+    _Header.DataOffset = DataOffset;
+    _PacketLog = PacketLog;
+    _NextFrame = 0;
+    _Entries = 0;
+    _LastWallTimeNs = INT64_MIN;
+    _HaveRecord = false;
+    if (fwrite(&_Header, sizeof(_Header), 1, _File) != 1 || fflush(_File) != 0)
+    {
+        fprintf(stderr, "Unable to write time index %s\n", FileName.c_str());
+        Close();
+        return false;
+    }
+    return true;
+}
+
+bool CTimeIndexWriter::Update(uint64_t FramesWritten)
+{
+    if (_File == NULL)
+    {
+        return false;
+    }
+
+    bool added = false;
+    for (; _NextFrame < FramesWritten; _NextFrame += _Header.IntervalFrames)
+    {
+        TimeIndexEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        CapturePacketRecord record;
+        if (_PacketLog->Lookup(_NextFrame, &record))
+        {
+            _LastRecord = record;
+            _HaveRecord = true;
+            entry.Flags = record.Flags;
+            if (_NextFrame != record.Frame)
+            {
+                entry.Flags &= ~CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY;
+            }
+        }
+        else
+        {
+            entry.Flags = CAPTURE_PACKET_FLAG_TIMESTAMP_ERROR;
+            if (!_HaveRecord)
+            {
+                _LastRecord.Frame = _NextFrame;
+                _LastRecord.WallTimeNs = SystemClockNs();
+                _HaveRecord = true;
+            }
+        }
+        entry.Frame = _NextFrame;
+        entry.ByteOffset = _Header.DataOffset + _NextFrame * _Header.FrameSize;
+        entry.WallTimeNs = _LastRecord.WallTimeNs +
+            static_cast<int64_t>((_NextFrame - _LastRecord.Frame) * 1000000000 / _Header.SampleRate);
+
+        //
+        //  The wall clock can be stepped back under us; holding the time keeps the index searchable.
+        //
+        if (entry.WallTimeNs < _LastWallTimeNs)
+        {
+            entry.WallTimeNs = _LastWallTimeNs;
+        }
+        _LastWallTimeNs = entry.WallTimeNs;
+
+        if (fwrite(&entry, sizeof(entry), 1, _File) != 1)
+        {
+            fprintf(stderr, "Unable to write the time index.\n");
+            return false;
+        }
+        _Entries++;
+        added = true;
+    }
+
+    //
+    //  Let go of the records before the last frame written, so the log doesn't fill up between entries.  The next
+    //  entry's frame is past it, so nothing it needs is lost.
+    //
+    if (FramesWritten != 0)
+    {
+        CapturePacketRecord record;
+        _PacketLog->Lookup(FramesWritten - 1, &record);
+    }
+    return !added || fflush(_File) == 0;
+}
+
+bool CTimeIndexWriter::Close()
+{
+    if (_File == NULL)
+    {
+        return true;
+    }
+    bool succeeded = fclose(_File) == 0;
+    _File = NULL;
+    return succeeded;
+}
+
+CTimeIndexReader::CTimeIndexReader() :
+    _File(NULL),
+    _Entries(0),
+    _EntryReads(0)
+{
+    memset(&_Header, 0, sizeof(_Header));
+}
+
+CTimeIndexReader::~CTimeIndexReader()
+{
+    Close();
+}
+
+bool CTimeIndexReader::Open(const std::string& FileName)
+{
+    Close();
+    _File = fopen(FileName.c_str(), "rb");
+    if (_File == NULL)
+    {
+        fprintf(stderr, "Unable to open time index %s\n", FileName.c_str());
+        return false;
+    }
+    if (fread(&_Header, sizeof(_Header), 1, _File) != 1 || _Header.Magic != TIME_INDEX_MAGIC ||
+        _Header.HeaderSize < sizeof(TimeIndexHeader) || _Header.EntrySize < sizeof(TimeIndexEntry) ||
+        _Header.SampleRate == 0 || _Header.FrameSize == 0)
+    {
+        fprintf(stderr, "%s is not a time index.\n", FileName.c_str());
+        Close();
+        return false;
+    }
+
+    //
+    //  A partial last entry is from a writer that is still going or was cut short.
+    //
+    uint64_t size = FileSize64(_File);
+    _Entries = size > _Header.HeaderSize ? (size - _Header.HeaderSize) / _Header.EntrySize : 0;
+    _EntryReads = 0;
+    return true;
+}
+
+void CTimeIndexReader::Close()
+{
+    if (_File != NULL)
+    {
+        fclose(_File);
+        _File = NULL;
+    }
+    _Entries = 0;
+}
+
+bool CTimeIndexReader::ReadEntry(uint64_t Index, TimeIndexEntry* Entry)
+{
+    if (_File == NULL || Index >= _Entries ||
+        !SeekFile64(_File, _Header.HeaderSize + Index * _Header.EntrySize) || fread(Entry, sizeof(*Entry), 1, _File) != 1)
+    {
+        return false;
+    }
+    _EntryReads++;
+    return true;
+}
+
+bool CTimeIndexReader::FindTime(int64_t WallTimeNs, TimeIndexPosition* Position)
+{
+    TimeIndexEntry entry;
+    if (_Entries == 0 || !ReadEntry(0, &entry))
+    {
+        return false;
+    }
+
+    //
+    //  Invariant: entry low is at or before the time, everything past high is after it.
+    //
+    uint64_t low = 0;
+    uint64_t high = _Entries - 1;
+    if (entry.WallTimeNs <= WallTimeNs)
+    {
+        while (low < high)
+        {
+            uint64_t middle = low + (high - low + 1) / 2;
+            TimeIndexEntry probe;
+            if (!ReadEntry(middle, &probe))
+            {
+                return false;
+            }
+            if (probe.WallTimeNs <= WallTimeNs)
+            {
+                low = middle;
+                entry = probe;
+            }
+            else
+            {
+                high = middle - 1;
+            }
+        }
+    }
+
+    uint64_t frame = entry.Frame;
+    if (WallTimeNs > entry.WallTimeNs)
+    {
+        uint64_t elapsedNs = static_cast<uint64_t>(WallTimeNs - entry.WallTimeNs);
+        TimeIndexEntry next;
+        if (low + 1 < _Entries && ReadEntry(low + 1, &next) && next.WallTimeNs > entry.WallTimeNs)
+        {
+            uint64_t spanNs = static_cast<uint64_t>(next.WallTimeNs - entry.WallTimeNs);
+            frame += static_cast<uint64_t>(static_cast<double>(next.Frame - entry.Frame) * elapsedNs / spanNs);
+        }
+        else
+        {
+            frame += static_cast<uint64_t>(static_cast<double>(elapsedNs) * _Header.SampleRate / 1000000000.0);
+        }
+    }
+    Position->Frame = frame;
+    Position->ByteOffset = _Header.DataOffset + frame * _Header.FrameSize;
+    Position->Entry = low;
+    return true;
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include "AudioFormat.h"
+#include "CapturePacketLog.h"
+
+//
+//  Sidecar time index for raw audio files (PCM and WAV).
+//
+//  A header followed by fixed size entries, one every IntervalFrames frames of the recording, each giving the
+//  byte offset of a frame in the audio file, the frame's position in the recording and its capture time in wall
+//  clock (system clock since the Unix epoch) nanoseconds.  Entry times never go backwards, so the index can be
+//  searched by time as well as by position, straight from the file, in O(log n) reads.  Entries are appended as the
+//  recording goes, so an index is readable while it is still being written, and one cut short by a crash just ends
+//  at its last complete entry.  All fields are little endian.
+//
+#define TIME_INDEX_MAGIC        0x58494341      // "ACIX"
+#define TIME_INDEX_VERSION      1
+
+#pragma pack(push, 1)
+
+struct TimeIndexHeader
+{
+    uint32_t    Magic;
+    uint16_t    Version;
+    uint16_t    HeaderSize;
+    uint16_t    EntrySize;
+    uint16_t    Reserved;
+    uint32_t    SampleRate;
+    uint32_t    FrameSize;
+    uint32_t    IntervalFrames;
+    uint64_t    DataOffset;         // Where the audio starts in the file the index belongs to.
+};
+
+struct TimeIndexEntry
+{
+    uint64_t    ByteOffset;         // DataOffset + Frame * FrameSize.
+    uint64_t    Frame;
+    int64_t     WallTimeNs;
+    uint32_t    Flags;              // CAPTURE_PACKET_FLAG_xxx of the packet the frame came from.
+    uint32_t    Reserved;
+};
+
+#pragma pack(pop)
+
+//
+//  Writes the index on the thread that hands frames to the writer, from the capture times in a packet log it is
+//  the only consumer of.  Frames the log has no record for (it overflowed) get a time extrapolated from the last
+//  record and CAPTURE_PACKET_FLAG_TIMESTAMP_ERROR.
+//
+class CTimeIndexWriter
+{
+public:
+    CTimeIndexWriter();
+    ~CTimeIndexWriter();
+
+    bool Open(const std::string& FileName, const WAVEFORMATEX* Format, uint64_t DataOffset, uint32_t IntervalFrames,
+        CCapturePacketLog* PacketLog);
+
+    //
+    //  Add the entries for the frames up to FramesWritten, the total handed to the writer so far.
+    //
+    bool Update(uint64_t FramesWritten);
+    bool Close();
+
+    uint64_t Entries() const { return _Entries; }
+
+private:
+    FILE*                   _File;
+    TimeIndexHeader         _Header;
+    CCapturePacketLog*      _PacketLog;
+    uint64_t                _NextFrame;
+    uint64_t                _Entries;
+    int64_t                 _LastWallTimeNs;
+    CapturePacketRecord     _LastRecord;
+    bool                    _HaveRecord;
+};
+
+//
+//  Where a capture time falls in the audio file.
+//
+struct TimeIndexPosition
+{
+    uint64_t    Frame;
+    uint64_t    ByteOffset;
+    uint64_t    Entry;              // The entry at or before the time.
+};
+
+class CTimeIndexReader
+{
+public:
+    CTimeIndexReader();
+    ~CTimeIndexReader();
+
+    bool Open(const std::string& FileName);
+    void Close();
+
+    const TimeIndexHeader& Header() const { return _Header; }
+    uint64_t Entries() const { return _Entries; }
+    bool ReadEntry(uint64_t Index, TimeIndexEntry* Entry);
+
+    //
+    //  Binary search for the last entry at or before WallTimeNs, then interpolate between it and the next one, so
+    //  drift between the device and the wall clock over an interval is accounted for.  Times before the first entry
+    //  map to it; times after the last are extrapolated at the sample rate.
+    //
+    bool FindTime(int64_t WallTimeNs, TimeIndexPosition* Position);
+
+    //
+    //  Entries read since Open(), for checking the cost of lookups.
+    //
+    uint64_t EntryReads() const { return _EntryReads; }
+
+private:
+    FILE*               _File;
+    TimeIndexHeader     _Header;
+    uint64_t            _Entries;
+    uint64_t            _EntryReads;
+};
@@ -17,15 +17,18 @@
 //  A simple WASAPI Capture client.
 //
 
-CWASAPICapture::CWASAPICapture(IMMDevice* Endpoint, bool EnableStreamSwitch, ERole EndpointRole) :
+CWASAPICapture::CWASAPICapture(IMMDevice* Endpoint, bool EnableStreamSwitch, ERole EndpointRole, bool Loopback) :
     _RefCount(1),
     _Endpoint(Endpoint),
     _AudioClient(NULL),
     _CaptureClient(NULL),
     _CaptureThread(NULL),
     _ShutdownEvent(NULL),
+    _AudioSamplesReadyEvent(NULL),
+    _CaptureMode(CaptureModeEventDriven),
+    _Loopback(Loopback),
     _MixFormat(NULL),
-    _CurrentCaptureIndex(0),
+    _RingBuffer(NULL),
     _EnableStreamSwitch(EnableStreamSwitch),
     _EndpointRole(EndpointRole),
     _StreamSwitchEvent(NULL),
@@ -46,15 +49,21 @@ CWASAPICapture::~CWASAPICapture(void)
 
 
 //
-//  Initialize WASAPI in event driven mode, associate the audio client with our samples ready event handle, retrieve 
-//  a capture client for the transport, create the capture thread and start the audio engine.
+//  Initialize WASAPI in event driven or timer driven mode, associate the audio client with our samples ready event 
+//  handle, retrieve a capture client for the transport, create the capture thread and start the audio engine.
 //
 bool CWASAPICapture::InitializeAudioEngine()
 {
+    DWORD streamFlags = _Loopback ? AUDCLNT_STREAMFLAGS_LOOPBACK : 0;
+    if (_CaptureMode == CaptureModeEventDriven)
+    {
+        streamFlags |= AUDCLNT_STREAMFLAGS_EVENTCALLBACK;
+    }
+
     HRESULT hr = _AudioClient->Initialize(
         AUDCLNT_SHAREMODE_SHARED, 
-        AUDCLNT_STREAMFLAGS_LOOPBACK, 
-        0, 
+        streamFlags, 
+        static_cast<REFERENCE_TIME>(_EngineLatencyInMS) * REFTIMES_PER_MILLISEC, 
         0, 
         _MixFormat, 
         NULL
@@ -66,6 +75,16 @@ bool CWASAPICapture::InitializeAudioEngine()
         return false;
     }
 
+    if (_CaptureMode == CaptureModeEventDriven)
+    {
+        hr = _AudioClient->SetEventHandle(_AudioSamplesReadyEvent);
+        if (FAILED(hr))
+        {
+            printf("Unable to set ready event: %x.\n", hr);
+            return false;
+        }
+    }
+
     //
     //  Retrieve the buffer size for the audio client.
     //
@@ -107,8 +126,10 @@ bool CWASAPICapture::LoadFormat()
 //
 //  Initialize the capturer.
 //
-bool CWASAPICapture::Initialize(UINT32 EngineLatency)
+bool CWASAPICapture::Initialize(UINT32 EngineLatency, CaptureMode Mode)
 {
+    _CaptureMode = Mode;
+
     //
     //  Create our shutdown event - we want auto reset events that start in the not-signaled state.
     //
@@ -118,6 +139,19 @@ bool CWASAPICapture::Initialize(UINT32 EngineLatency)
         printf("Unable to create shutdown event: %d.\n", GetLastError());
         return false;
     }
+
+    //
+    //  In event driven mode the engine signals this event whenever a packet is ready - auto reset as well.
+    //
+    if (_CaptureMode == CaptureModeEventDriven)
+    {
+        _AudioSamplesReadyEvent = CreateEventEx(NULL, NULL, 0, EVENT_MODIFY_STATE | SYNCHRONIZE);
+        if (_AudioSamplesReadyEvent == NULL)
+        {
+            printf("Unable to create samples ready event: %d.\n", GetLastError());
+            return false;
+        }
+    }
     //
     //  Create our stream switch event- we want auto reset events that start in the not-signaled state.
     //  Note that we create this event even if we're not going to stream switch - that's because the event is used
@@ -202,6 +236,12 @@ void CWASAPICapture::Shutdown()
         _StreamSwitchEvent = NULL;
     }
 
+    if (_AudioSamplesReadyEvent)
+    {
+        CloseHandle(_AudioSamplesReadyEvent);
+        _AudioSamplesReadyEvent = NULL;
+    }
+
     SafeRelease(&_Endpoint);
     SafeRelease(&_AudioClient);
     SafeRelease(&_CaptureClient);
@@ -222,12 +262,19 @@ void CWASAPICapture::Shutdown()
 //
 //  Start capturing...
 //
-bool CWASAPICapture::Start(BYTE* CaptureBuffer, size_t CaptureBufferSize)
+bool CWASAPICapture::Start(CCaptureRingBuffer* RingBuffer, const CaptureProcessing* Processing)
 {
     HRESULT hr;
 
-    _CaptureBuffer = CaptureBuffer;
-    _CaptureBufferSize = CaptureBufferSize;
+    //
+    //  The capture thread wakes every half latency, whether on the timer or on the engine's events.
+    //
+    if (!_Drain.Attach(RingBuffer, Processing, _MixFormat, &_DeviceClock,
+        static_cast<int64_t>(max(_EngineLatencyInMS / 2, 1)) * REFTIMES_PER_MILLISEC))
+    {
+        return false;
+    }
+    _RingBuffer = RingBuffer;
 
     //
     //  Now create the thread which is going to drive the capture.
@@ -293,10 +340,45 @@ DWORD CWASAPICapture::WASAPICaptureThread(LPVOID Context)
     return capturer->DoCaptureThread();
 }
 
+//
+//  The capture thread's scheduler.  In event driven mode we block until the engine signals the samples ready event.
+//  In timer driven mode SamplesReadyEvent is NULL and we wake up whenever the wait times out.
+//
+CWASAPICaptureScheduler::CWASAPICaptureScheduler(HANDLE ShutdownEvent, HANDLE StreamSwitchEvent, HANDLE SamplesReadyEvent, DWORD TimeoutInMS) :
+    _WaitCount(2),
+    _TimeoutInMS(TimeoutInMS)
+{
+    _WaitArray[0] = ShutdownEvent;
+    _WaitArray[1] = StreamSwitchEvent;
+    _WaitArray[2] = SamplesReadyEvent;
+    if (SamplesReadyEvent != NULL)
+    {
+        _WaitCount = 3;
+        _TimeoutInMS = INFINITE;
+    }
+}
+
+CaptureWakeReason CWASAPICaptureScheduler::WaitForWork()
+{
+    DWORD waitResult = WaitForMultipleObjects(_WaitCount, _WaitArray, FALSE, _TimeoutInMS);
+    switch (waitResult)
+    {
+    case WAIT_OBJECT_0 + 0:     // _ShutdownEvent
+        return CaptureWakeShutdown;
+    case WAIT_OBJECT_0 + 1:     // _StreamSwitchEvent
+        return CaptureWakeStreamSwitch;
+    case WAIT_OBJECT_0 + 2:     // _AudioSamplesReadyEvent
+    case WAIT_TIMEOUT:          // Timeout
+        return CaptureWakeSamplesReady;
+    default:
+        printf("Unexpected wait result in capture thread: %d (%d)\n", waitResult, GetLastError());
+        return CaptureWakeShutdown;
+    }
+}
+
 DWORD CWASAPICapture::DoCaptureThread()
 {
     bool stillPlaying = true;
-    HANDLE waitArray[2] = { _ShutdownEvent, _StreamSwitchEvent };
     HANDLE mmcssHandle = NULL;
     DWORD mmcssTaskIndex = 0;
 
@@ -316,24 +398,26 @@ DWORD CWASAPICapture::DoCaptureThread()
             printf("Unable to enable MMCSS on capture thread: %d\n", GetLastError());
         }
     }
+    //
+    //  In Timer Driven mode, we want to wait for half the desired latency in milliseconds.
+    //
+    //  That way we'll wake up half way through the processing period to pull the 
+    //  next set of samples from the engine.  _EngineLatencyInMS is in milliseconds; it is only scaled to
+    //  REFERENCE_TIME units when it is handed to IAudioClient::Initialize.
+    //
+    DWORD timerPeriodInMS = max(_EngineLatencyInMS / 2, 1);
+    CWASAPICaptureScheduler scheduler(_ShutdownEvent, _StreamSwitchEvent,
+        _CaptureMode == CaptureModeEventDriven ? _AudioSamplesReadyEvent : NULL, timerPeriodInMS);
+
     while (stillPlaying)
     {
-        HRESULT hr;
-        //
-        //  In Timer Driven mode, we want to wait for half the desired latency in milliseconds.
-        //
-        //  That way we'll wake up half way through the processing period to pull the 
-        //  next set of samples from the engine.
-        //
-        // edit: the _EngineLatencyInMS / 2 / 10000 is super important! I don't know why it's divided by 10000 though! (and not 1000?) :/
-        DWORD waitResult = WaitForMultipleObjects(2, waitArray, FALSE, _EngineLatencyInMS / 2 / 10000);
-        switch (waitResult)
+        switch (scheduler.WaitForWork())
         {
-        case WAIT_OBJECT_0 + 0:     // _ShutdownEvent
+        case CaptureWakeShutdown:
             printf("got a shutdown event\n");
             stillPlaying = false;       // We're done, exit the loop.
             break;
-        case WAIT_OBJECT_0 + 1:     // _StreamSwitchEvent
+        case CaptureWakeStreamSwitch:
             //
             //  We've received a stream switch request.
             //
@@ -346,54 +430,14 @@ DWORD CWASAPICapture::DoCaptureThread()
                 stillPlaying = false;
             }
             break;
-        case WAIT_TIMEOUT:          // Timeout
-            //
-            //  We need to retrieve the next buffer of samples from the audio capturer.
-            //
-            BYTE* pData;
-            UINT32 framesAvailable;
-            DWORD  flags;
-
-            //
-            //  Find out how much capture data is available.  We need to make sure we don't run over the length
-            //  of our capture buffer.  We'll discard any samples that don't fit in the buffer.
-            //
-            hr = _CaptureClient->GetBuffer(&pData, &framesAvailable, &flags, NULL, NULL);
-            if (SUCCEEDED(hr))
+        case CaptureWakeSamplesReady:
             {
-                UINT32 framesToCopy = min(framesAvailable, static_cast<UINT32>((_CaptureBufferSize - _CurrentCaptureIndex) / _FrameSize));
-                if (framesToCopy != 0)
-                {
-                    //
-                    //  The flags on capture tell us information about the data.
-                    //
-                    //  We only really care about the silent flag since we want to put frames of silence into the buffer
-                    //  when we receive silence.  We rely on the fact that a logical bit 0 is silence for both float and int formats.
-                    //
-                    if (flags & AUDCLNT_BUFFERFLAGS_SILENT)
-                    {
-                        //
-                        //  Fill 0s from the capture buffer to the output buffer.
-                        //
-                        ZeroMemory(&_CaptureBuffer[_CurrentCaptureIndex], framesToCopy * _FrameSize);
-                    }
-                    else
-                    {
-                        //
-                        //  Copy data from the audio engine buffer to the output buffer.
-                        //
-                        CopyMemory(&_CaptureBuffer[_CurrentCaptureIndex], pData, framesToCopy * _FrameSize);
-                    }
-                    //
-                    //  Bump the capture buffer pointer.
-                    //
-                    _CurrentCaptureIndex += framesToCopy * _FrameSize;
-                }
-                hr = _CaptureClient->ReleaseBuffer(framesAvailable);
-                if (FAILED(hr))
-                {
-                    printf("Unable to release capture buffer: %x!\n", hr);
-                }
+                //
+                //  Drain every packet the engine has queued.  With irregular wakeups there can be several, and leaving
+                //  them behind only adds latency and makes an overrun more likely.
+                //
+                CWASAPIPacketClient packetClient(_CaptureClient);
+                _Drain.Drain(&packetClient);
             }
             break;
         }
@@ -408,6 +452,50 @@ DWORD CWASAPICapture::DoCaptureThread()
 }
 
 
+//
+//  Packet client adapter.  Failures are logged here so the portable drain doesn't need to know about HRESULTs.
+//
+bool CWASAPIPacketClient::GetNextPacketSize(uint32_t* Frames)
+{
+    UINT32 packetFrames = 0;
+    HRESULT hr = _CaptureClient->GetNextPacketSize(&packetFrames);
+    if (FAILED(hr))
+    {
+        printf("Unable to get the next packet size: %x!\n", hr);
+        return false;
+    }
+    *Frames = packetFrames;
+    return true;
+}
+
+bool CWASAPIPacketClient::GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition)
+{
+    BYTE* pData;
+    UINT32 framesAvailable;
+    DWORD flags;
+    HRESULT hr = _CaptureClient->GetBuffer(&pData, &framesAvailable, &flags, DevicePosition, QPCPosition);
+    if (FAILED(hr))
+    {
+        printf("Unable to get capture buffer: %x!\n", hr);
+        return false;
+    }
+    *Data = pData;
+    *Frames = framesAvailable;
+    *Flags = flags;
+    return true;
+}
+
+bool CWASAPIPacketClient::ReleaseBuffer(uint32_t Frames)
+{
+    HRESULT hr = _CaptureClient->ReleaseBuffer(Frames);
+    if (FAILED(hr))
+    {
+        printf("Unable to release capture buffer: %x!\n", hr);
+        return false;
+    }
+    return true;
+}
+
 //
 //  Initialize the stream switch logic.
 //
@@ -495,6 +583,8 @@ bool CWASAPICapture::HandleStreamSwitchEvent()
 {
     HRESULT hr;
     DWORD waitResult;
+    CSteadyCaptureClock switchClock;
+    int64_t switchStart = switchClock.Now();
 
     assert(_InStreamSwitch);
     //
@@ -530,10 +620,7 @@ bool CWASAPICapture::HandleStreamSwitchEvent()
     //  new default device, then attempt to switch to the default device.  In the case of a 
     //  format change (i.e. the default device does not change), we artificially generate  a
     //  new default device notification so the code will not needlessly wait 500ms before 
-    //  re-opening on the new format.  (However, note below in step 6 that in this SDK 
-    //  sample, we are unlikely to actually successfully absorb a format change, but a 
-    //  real audio application implementing stream switching would re-format their 
-    //  pipeline to deliver the new format).  
+    //  re-opening on the new format.
     //
     waitResult = WaitForSingleObject(_StreamSwitchCompleteEvent, 500);
     if (waitResult == WAIT_TIMEOUT)
@@ -546,7 +633,7 @@ bool CWASAPICapture::HandleStreamSwitchEvent()
     //  Step 4.  If we can't get the new endpoint, we need to abort the stream switch.  If there IS a new device,
     //          we should be able to retrieve it.
     //
-    hr = _DeviceEnumerator->GetDefaultAudioEndpoint(eCapture, _EndpointRole, &_Endpoint);
+    hr = _DeviceEnumerator->GetDefaultAudioEndpoint(_Loopback ? eRender : eCapture, _EndpointRole, &_Endpoint);
     if (FAILED(hr))
     {
         printf("Unable to retrieve new default device during stream switch: %x\n", hr);
@@ -562,7 +649,8 @@ bool CWASAPICapture::HandleStreamSwitchEvent()
         goto ErrorExit;
     }
     //
-    //  Step 6 - Retrieve the new mix format.
+    //  Step 6 - Retrieve the new mix format.  It may well differ from the old one (a headset running at another rate,
+    //  say); we open the new endpoint on it and the drain adapts it back to the format we started with in step 9.
     //
     WAVEFORMATEX* wfxNew;
     hr = _AudioClient->GetMixFormat(&wfxNew);
@@ -571,18 +659,14 @@ bool CWASAPICapture::HandleStreamSwitchEvent()
         printf("Unable to retrieve mix format for new audio client: %x.\n", hr);
         goto ErrorExit;
     }
-
-    //
-    //  Note that this is an intentionally naive comparison.  A more sophisticated comparison would
-    //  compare the sample rate, channel count and format and apply the appropriate conversions into the capture pipeline.
-    //
-    if (memcmp(_MixFormat, wfxNew, sizeof(WAVEFORMATEX) + wfxNew->cbSize) != 0)
+    if (wfxNew->nSamplesPerSec != _MixFormat->nSamplesPerSec || wfxNew->nChannels != _MixFormat->nChannels ||
+        wfxNew->wBitsPerSample != _MixFormat->wBitsPerSample)
     {
-        printf("New mix format doesn't match old mix format.  Aborting.\n");
-        CoTaskMemFree(wfxNew);
-        goto ErrorExit;
+        printf("Mix format changed to %u Hz, %u channels, %u bits.\n", wfxNew->nSamplesPerSec, wfxNew->nChannels, wfxNew->wBitsPerSample);
     }
-    CoTaskMemFree(wfxNew);
+    CoTaskMemFree(_MixFormat);
+    _MixFormat = wfxNew;
+    _FrameSize = (_MixFormat->wBitsPerSample / 8) * _MixFormat->nChannels;
 
     //
     //  Step 7:  Re-initialize the audio client.
@@ -622,6 +706,15 @@ bool CWASAPICapture::HandleStreamSwitchEvent()
         goto ErrorExit;
     }
 
+    //
+    //  Step 9: Fill the time we weren't capturing with silence and adapt the new format.
+    //
+    if (!_Drain.SwitchFormat(_MixFormat, switchClock.Now() - switchStart))
+    {
+        printf("Unable to adapt the new mix format.\n");
+        goto ErrorExit;
+    }
+
     _InStreamSwitch = false;
     return true;
 
@@ -666,12 +759,12 @@ HRESULT CWASAPICapture::OnSessionDisconnected(AudioSessionDisconnectReason Disco
     return S_OK;
 }
 //
-//  Called when the default capture device changed.  We just want to set an event which lets the stream switch logic know that it's ok to 
+//  Called when the default device changed - the render device when looping back, else the capture device.  We just want to set an event which lets the stream switch logic know that it's ok to 
 //  continue with the stream switch.
 //
 HRESULT CWASAPICapture::OnDefaultDeviceChanged(EDataFlow Flow, ERole Role, LPCWSTR /*NewDefaultDeviceId*/)
 {
-    if (Flow == eCapture && Role == _EndpointRole)
+    if (Flow == (_Loopback ? eRender : eCapture) && Role == _EndpointRole)
     {
         //
         //  The default capture device for our configuredf role was changed.  
@@ -9,25 +9,70 @@
 #include <mmdeviceapi.h>
 #include <audioclient.h>
 #include <audiopolicy.h>
+#include "CaptureRingBuffer.h"
+#include "CaptureScheduler.h"
+#include "CaptureDrain.h"
+#include "CaptureSource.h"
+
+//
+//  How the capture thread is woken up to pull samples from the engine.
+//
+enum CaptureMode
+{
+    CaptureModeEventDriven,     // The engine signals a samples ready event (AUDCLNT_STREAMFLAGS_EVENTCALLBACK).
+    CaptureModeTimerDriven,     // The thread polls every half engine latency.
+};
+
+//
+//  Scheduler for the WASAPI capture thread, built on the capturer's Win32 events.
+//
+class CWASAPICaptureScheduler : public ICaptureScheduler
+{
+public:
+    CWASAPICaptureScheduler(HANDLE ShutdownEvent, HANDLE StreamSwitchEvent, HANDLE SamplesReadyEvent, DWORD TimeoutInMS);
+    CaptureWakeReason WaitForWork();
+
+private:
+    HANDLE  _WaitArray[3];
+    DWORD   _WaitCount;
+    DWORD   _TimeoutInMS;
+};
+
+//
+//  Forwards the portable packet interface to an IAudioCaptureClient.
+//
+class CWASAPIPacketClient : public ICapturePacketClient
+{
+public:
+    CWASAPIPacketClient(IAudioCaptureClient* CaptureClient) : _CaptureClient(CaptureClient) {}
+    bool GetNextPacketSize(uint32_t* Frames);
+    bool GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition);
+    bool ReleaseBuffer(uint32_t Frames);
+
+private:
+    IAudioCaptureClient* _CaptureClient;
+};
 
 //
 //  WASAPI Capture class.
-class CWASAPICapture : public IAudioSessionEvents, IMMNotificationClient
+class CWASAPICapture : public IAudioSessionEvents, IMMNotificationClient, public ICaptureSource
 {
 public:
-    //  Public interface to CWASAPICapture.
-    CWASAPICapture(IMMDevice* Endpoint, bool EnableStreamSwitch, ERole EndpointRole);
-    bool Initialize(UINT32 EngineLatency);
+    //  Public interface to CWASAPICapture.  Loopback records what a render endpoint plays; otherwise the endpoint is a
+    //  capture endpoint such as a microphone, recorded directly.
+    CWASAPICapture(IMMDevice* Endpoint, bool EnableStreamSwitch, ERole EndpointRole, bool Loopback = true);
+    bool Initialize(UINT32 EngineLatency, CaptureMode Mode = CaptureModeEventDriven);
     void Shutdown();
-    bool Start(BYTE* CaptureBuffer, size_t BufferSize);
+    bool Start(CCaptureRingBuffer* RingBuffer, const CaptureProcessing* Processing);
     void Stop();
-    void ResetCaptureIndex() { _CurrentCaptureIndex = 0; }
     WORD ChannelCount() { return _MixFormat->nChannels; }
     UINT32 SamplesPerSecond() { return _MixFormat->nSamplesPerSec; }
     UINT32 BytesPerSample() { return _MixFormat->wBitsPerSample / 8; }
     size_t FrameSize() { return _FrameSize; }
     WAVEFORMATEX* MixFormat() { return _MixFormat; }
-    size_t BytesCaptured() { return _CurrentCaptureIndex; }
+    void GetDrainStats(CaptureDrainStats* Stats) { _Drain.GetStats(Stats); }
+    bool GetLevels(LevelMeterReading* Reading) { return _Drain.GetLevels(Reading); }
+    bool IsFinished() { return false; }
     STDMETHOD_(ULONG, AddRef)();
     STDMETHOD_(ULONG, Release)();
 
@@ -43,16 +88,24 @@ private:
 
     HANDLE              _CaptureThread;
     HANDLE              _ShutdownEvent;
+    HANDLE              _AudioSamplesReadyEvent;
+    CaptureMode         _CaptureMode;
+    bool                _Loopback;
     WAVEFORMATEX* _MixFormat;
     size_t              _FrameSize;
     UINT32              _BufferSize;
 
     //
-    //  Capture buffer management.
+    //  Capture buffer management.  The capture thread is the single producer of the ring.
+    //
+    CCaptureRingBuffer* _RingBuffer;
+    CCaptureDrain       _Drain;
+
+    //
+    //  QPC positions from the engine are QueryPerformanceCounter time in 100 ns units, which is what steady_clock
+    //  counts on Windows.
     //
-    BYTE* _CaptureBuffer;
-    size_t _CaptureBufferSize;
-    size_t _CurrentCaptureIndex;
+    CSteadyCaptureClock _DeviceClock;
 
     static DWORD __stdcall WASAPICaptureThread(LPVOID Context);
     DWORD DoCaptureThread();
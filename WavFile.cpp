@@ -0,0 +1,253 @@
+#include <string.h>
+#include "WavFile.h"
+
+static uint32_t ReadLE32(const uint8_t* Data)
+{
+    return Data[0] | (Data[1] << 8) | (Data[2] << 16) | (static_cast<uint32_t>(Data[3]) << 24);
+}
+
+static uint64_t ReadLE64(const uint8_t* Data)
+{
+    return ReadLE32(Data) | (static_cast<uint64_t>(ReadLE32(Data + 4)) << 32);
+}
+
+static void WriteLE32(uint8_t* Data, uint32_t Value)
+{
+    Data[0] = static_cast<uint8_t>(Value);
+    Data[1] = static_cast<uint8_t>(Value >> 8);
+    Data[2] = static_cast<uint8_t>(Value >> 16);
+    Data[3] = static_cast<uint8_t>(Value >> 24);
+}
+
+static void WriteLE64(uint8_t* Data, uint64_t Value)
+{
+    WriteLE32(Data, static_cast<uint32_t>(Value));
+    WriteLE32(Data + 4, static_cast<uint32_t>(Value >> 32));
+}
+
+bool SeekFile64(FILE* File, uint64_t Offset)
+{
+#ifdef _WIN32
+    return _fseeki64(File, static_cast<__int64>(Offset), SEEK_SET) == 0;
+#else
+    return fseeko(File, static_cast<off_t>(Offset), SEEK_SET) == 0;
+#endif
+}
+
+uint64_t FileSize64(FILE* File)
+{
+#ifdef _WIN32
+    __int64 current = _ftelli64(File);
+    _fseeki64(File, 0, SEEK_END);
+    __int64 size = _ftelli64(File);
+    _fseeki64(File, current, SEEK_SET);
+#else
+    off_t current = ftello(File);
+    fseeko(File, 0, SEEK_END);
+    off_t size = ftello(File);
+    fseeko(File, current, SEEK_SET);
+#endif
+    return size < 0 ? 0 : static_cast<uint64_t>(size);
+}
+
+//
+//  Parse the RIFF/RF64 header up to the start of the data chunk.  On success the file is positioned at the first
+//  sample.
+//
+bool ReadWavHeader(FILE* File, WavFileInfo* Info)
+{
+    uint8_t header[12];
+    memset(Info, 0, sizeof(*Info));
+
+    if (!SeekFile64(File, 0) || fread(header, 1, sizeof(header), File) != sizeof(header))
+    {
+        return false;
+    }
+    if ((memcmp(header, "RIFF", 4) != 0 && memcmp(header, "RF64", 4) != 0) || memcmp(header + 8, "WAVE", 4) != 0)
+    {
+        return false;
+    }
+    Info->IsRF64 = memcmp(header, "RF64", 4) == 0;
+
+    bool haveFormat = false;
+    uint64_t ds64DataSize = UINT64_MAX;
+    uint64_t position = sizeof(header);
+
+    for (;;)
+    {
+        uint8_t chunkHeader[8];
+        if (fread(chunkHeader, 1, sizeof(chunkHeader), File) != sizeof(chunkHeader))
+        {
+            return false;
+        }
+        position += sizeof(chunkHeader);
+        uint32_t chunkSize = ReadLE32(chunkHeader + 4);
+
+        if (memcmp(chunkHeader, "data", 4) == 0)
+        {
+            if (!haveFormat)
+            {
+                return false;
+            }
+            Info->DataOffset = position;
+            if (Info->IsRF64 && chunkSize == 0xFFFFFFFF)
+            {
+                Info->DataSize = ds64DataSize;
+            }
+            else if (chunkSize == 0 || chunkSize == 0xFFFFFFFF)
+            {
+                Info->DataSize = UINT64_MAX;
+            }
+            else
+            {
+                Info->DataSize = chunkSize;
+            }
+            return true;
+        }
+
+        uint8_t chunk[sizeof(WAVEFORMATEXTENSIBLE)];
+        size_t bytesToRead = chunkSize < sizeof(chunk) ? chunkSize : sizeof(chunk);
+        if (memcmp(chunkHeader, "fmt ", 4) == 0 || memcmp(chunkHeader, "ds64", 4) == 0)
+        {
+            memset(chunk, 0, sizeof(chunk));
+            if (fread(chunk, 1, bytesToRead, File) != bytesToRead)
+            {
+                return false;
+            }
+            if (memcmp(chunkHeader, "fmt ", 4) == 0)
+            {
+                //
+                //  A plain PCM fmt chunk stops before cbSize.
+                //
+                memcpy(&Info->Format, chunk, sizeof(chunk));
+                if (bytesToRead < sizeof(WAVEFORMATEX))
+                {
+                    Info->Format.Format.cbSize = 0;
+                }
+                haveFormat = Info->Format.Format.nBlockAlign != 0;
+            }
+            else if (bytesToRead >= 24)
+            {
+                ds64DataSize = ReadLE64(chunk + 8);
+                Info->Ds64Offset = position - sizeof(chunkHeader);
+            }
+        }
+        else if (memcmp(chunkHeader, "JUNK", 4) == 0 && chunkSize >= 28 && !haveFormat)
+        {
+            Info->Ds64Offset = position - sizeof(chunkHeader);
+        }
+
+        position += chunkSize + (chunkSize & 1);
+        if (!SeekFile64(File, position))
+        {
+            return false;
+        }
+    }
+}
+
+//
+//  Layout: RIFF/RF64 header, JUNK or ds64 (28 bytes), fmt, data.  The data chunk size says 0 until the first update,
+//  which readers take as "unknown".
+//
+size_t BuildWavHeader(const WAVEFORMATEX* Format, uint64_t DataSize, uint8_t* Header)
+{
+    uint32_t formatSize = sizeof(WAVEFORMATEX) + Format->cbSize;
+    if (formatSize > sizeof(WAVEFORMATEXTENSIBLE))
+    {
+        formatSize = sizeof(WAVEFORMATEXTENSIBLE);
+    }
+    uint32_t formatPadding = formatSize & 1;
+    size_t headerSize = 12 + 8 + 28 + 8 + formatSize + formatPadding + 8;
+    uint64_t riffSize = headerSize - 8 + DataSize + (DataSize & 1);
+    bool isRF64 = riffSize > 0xFFFFFFFF;
+
+    memset(Header, 0, headerSize);
+    memcpy(Header, isRF64 ? "RF64" : "RIFF", 4);
+    WriteLE32(Header + 4, isRF64 ? 0xFFFFFFFF : static_cast<uint32_t>(riffSize));
+    memcpy(Header + 8, "WAVE", 4);
+
+    uint8_t* chunk = Header + 12;
+    memcpy(chunk, isRF64 ? "ds64" : "JUNK", 4);
+    WriteLE32(chunk + 4, 28);
+    if (isRF64)
+    {
+        WriteLE64(chunk + 8, riffSize);
+        WriteLE64(chunk + 16, DataSize);
+        WriteLE64(chunk + 24, Format->nBlockAlign != 0 ? DataSize / Format->nBlockAlign : 0);
+    }
+
+    chunk += 8 + 28;
+    memcpy(chunk, "fmt ", 4);
+    WriteLE32(chunk + 4, formatSize);
+    memcpy(chunk + 8, Format, formatSize);
+    chunk[8 + 16] = static_cast<uint8_t>(formatSize - sizeof(WAVEFORMATEX));
+    chunk[8 + 17] = 0;
+
+    chunk += 8 + formatSize + formatPadding;
+    memcpy(chunk, "data", 4);
+    WriteLE32(chunk + 4, isRF64 ? 0xFFFFFFFF : static_cast<uint32_t>(DataSize));
+    return headerSize;
+}
+
+bool RepairWavFile(const std::string& FileName)
+{
+    FILE* file = fopen(FileName.c_str(), "r+b");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", FileName.c_str());
+        return false;
+    }
+
+    WavFileInfo info;
+    if (!ReadWavHeader(file, &info))
+    {
+        fprintf(stderr, "%s is not a WAV file.\n", FileName.c_str());
+        fclose(file);
+        return false;
+    }
+
+    //
+    //  Everything after the data chunk header is audio; a partly written last frame is dropped.
+    //
+    uint64_t fileSize = FileSize64(file);
+    uint64_t dataSize = fileSize > info.DataOffset ? fileSize - info.DataOffset : 0;
+    dataSize -= dataSize % info.Format.Format.nBlockAlign;
+
+    uint8_t header[WAV_HEADER_MAX_SIZE];
+    size_t headerSize = BuildWavHeader(&info.Format.Format, dataSize, header);
+    bool succeeded;
+    if (headerSize == info.DataOffset && info.Ds64Offset == 12)
+    {
+        //
+        //  One of ours - rebuild the whole header, switching to RF64 if needed.
+        //
+        succeeded = SeekFile64(file, 0) && fwrite(header, 1, headerSize, file) == headerSize;
+    }
+    else if (dataSize + info.DataOffset - 8 <= 0xFFFFFFFF && !info.IsRF64)
+    {
+        //
+        //  Some other layout: patch the two sizes in place.
+        //
+        uint8_t size[4];
+        WriteLE32(size, static_cast<uint32_t>(dataSize + info.DataOffset - 8 + (dataSize & 1)));
+        succeeded = SeekFile64(file, 4) && fwrite(size, 1, sizeof(size), file) == sizeof(size);
+        WriteLE32(size, static_cast<uint32_t>(dataSize));
+        succeeded = succeeded && SeekFile64(file, info.DataOffset - 4) && fwrite(size, 1, sizeof(size), file) == sizeof(size);
+    }
+    else
+    {
+        fprintf(stderr, "%s has no room for an RF64 header.\n", FileName.c_str());
+        succeeded = false;
+    }
+
+    if (fclose(file) != 0)
+    {
+        succeeded = false;
+    }
+    if (succeeded)
+    {
+        fprintf(stderr, "Repaired %s: %llu bytes of audio data%s\n", FileName.c_str(),
+            static_cast<unsigned long long>(dataSize), dataSize + headerSize - 8 > 0xFFFFFFFF ? " (RF64)" : "");
+    }
+    return succeeded;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include "AudioFormat.h"
+
+//
+//  WAV / RF64 file helpers.
+//
+
+//
+//  Describes the audio payload of a WAV file.  DataSize is UINT64_MAX when the header doesn't say (a stream that was
+//  never finalized); the payload then runs to the end of the file.
+//
+struct WavFileInfo
+{
+    WAVEFORMATEXTENSIBLE    Format;
+    uint64_t                DataOffset;
+    uint64_t                DataSize;
+    uint64_t                Ds64Offset;     // ds64 chunk, or the JUNK chunk reserved for it; 0 if there's neither.
+    bool                    IsRF64;
+};
+
+bool ReadWavHeader(FILE* File, WavFileInfo* Info);
+
+//
+//  Headers we write always reserve room for a ds64 chunk (as a JUNK chunk, per EBU Tech 3306), so a file can turn
+//  into RF64 once it passes 4 GiB without moving the audio data.  The header length depends only on the format.
+//
+#define WAV_HEADER_MAX_SIZE (12 + 8 + 28 + 8 + sizeof(WAVEFORMATEXTENSIBLE) + 8)
+
+size_t BuildWavHeader(const WAVEFORMATEX* Format, uint64_t DataSize, uint8_t* Header);
+
+//
+//  Rewrite the sizes in the header of a WAV file that was never finalized (e.g. the recorder crashed) so they cover
+//  every complete frame in the file.
+//
+bool RepairWavFile(const std::string& FileName);
+
+//
+//  64 bit file positioning for stdio streams.
+//
+bool SeekFile64(FILE* File, uint64_t Offset);
+uint64_t FileSize64(FILE* File);
@@ -1,28 +1,77 @@
 #include "stdafx.h"
 #include <stdio.h>
+#include <math.h>
 #include <iostream>
 #include <string>
 #include <ctime>
+#include <csignal>
+#include <chrono>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#ifdef _WIN32
 #include <atlstr.h>
 #include <mmdeviceapi.h>
 #include <audioclient.h>
 #include <audiopolicy.h>
-#include <csignal>
 #include "WASAPICapture.h"
+// Defines the endpoint name's property key here rather than leaving it to a library
+#include <initguid.h>
+#include <functiondiscoverykeys_devpkey.h>
+#endif
+#ifdef AUDIO_CAPTURE_HAVE_PULSE
+#include "PulseAudioCapture.h"
+#endif
+#ifdef AUDIO_CAPTURE_HAVE_OPUS
+#include "OpusFileSink.h"
+#endif
+#include "SyntheticCaptureSource.h"
+#include "ReplayCaptureSource.h"
+#include "SampleConvert.h"
+#include "Resampler.h"
+#include "ChannelRemix.h"
+#include "OutputSink.h"
+#include "FlacFileSink.h"
+#include "SharedRingSink.h"
+#include "StreamSink.h"
+#include "SocketServerSink.h"
+#include "TimeIndex.h"
+#include "SilenceFile.h"
+#include "SegmentedSink.h"
+#include "AsyncWriter.h"
+#include "CaptureMetrics.h"
+#include "MultiCaptureSource.h"
+#include "ChannelSplitSink.h"
+#include "LevelMeter.h"
 #include "audio_capture_cli.h"
 
+#ifdef _WIN32
 // Declare this variable because it's used in WASAPICapture.cpp
 bool DisableMMCSS = false;
+#endif
 
 // Global flag for handling Ctrl+C signal
 volatile bool g_running = true;
 
+// Set by SIGUSR1 to start a new segment of a segmented recording
+volatile bool g_rotateSegment = false;
+
 // Signal handler for Ctrl+C
 void signalHandler(int signal) {
     if (signal == SIGINT) {
         fprintf(stderr, "\nCtrl+C pressed. Stopping recording...\n");
         g_running = false;
     }
+#ifdef SIGUSR1
+    if (signal == SIGUSR1) {
+        g_rotateSegment = true;
+    }
+#endif
 }
 
 #define SAFE_RELEASE(punk) if ((punk) != NULL) { (punk)->Release(); (punk) = NULL; }
@@ -31,82 +80,250 @@ void signalHandler(int signal) {
 void PrintAudioParameters(const WAVEFORMATEX* WaveFormat)
 {
     // Output single line JSON to stdout with prefix for easier parsing
-    printf("Audio parameters: {\"formatTag\":%u,\"channels\":%u,\"samplesPerSec\":%u,\"avgBytesPerSec\":%u,\"blockAlign\":%u,\"bitsPerSample\":%u,\"extraSize\":%u}\n", 
+    DWORD channelMask = 0;
+    if (WaveFormat->wFormatTag == WAVE_FORMAT_EXTENSIBLE && WaveFormat->cbSize >= WAVEFORMATEXTENSIBLE_EXTRA_SIZE)
+    {
+        channelMask = reinterpret_cast<const WAVEFORMATEXTENSIBLE*>(WaveFormat)->dwChannelMask;
+    }
+    printf("Audio parameters: {\"formatTag\":%u,\"channels\":%u,\"samplesPerSec\":%u,\"avgBytesPerSec\":%u,\"blockAlign\":%u,\"bitsPerSample\":%u,\"extraSize\":%u,\"channelMask\":%u}\n", 
         WaveFormat->wFormatTag,
         WaveFormat->nChannels,
         WaveFormat->nSamplesPerSec, 
         WaveFormat->nAvgBytesPerSec,
         WaveFormat->nBlockAlign,
         WaveFormat->wBitsPerSample,
-        WaveFormat->cbSize);
+        WaveFormat->cbSize,
+        static_cast<unsigned>(channelMask));
     fflush(stdout); // Ensure JSON data is immediately sent to stdout
 }
 
-// Helper function to save PCM data
-bool WritePcmFile(HANDLE FileHandle, const BYTE* Buffer, const size_t BufferSize)
+// Convert a linear level to dBFS for printing, with digital silence at -200
+static double LevelDb(float Level)
 {
-    fprintf(stderr, "Writing PCM data. Buffer size: %zu bytes\n", BufferSize);
+    return Level > 0 ? 20.0 * log10(Level) : -200.0;
+}
 
-    // Write raw PCM data directly
-    DWORD bytesWritten;
-    if (!WriteFile(FileHandle, Buffer, static_cast<DWORD>(BufferSize), &bytesWritten, NULL))
+// Print a level meter reading to stdout in single line format, next to the audio parameters.  The line goes out in
+// one write, since it comes from the level printing thread while the main loop reports progress.
+void PrintAudioLevels(const LevelMeterReading* Reading, DWORD SamplesPerSec)
+{
+    std::string line;
+    char text[128];
+    snprintf(text, sizeof(text), "Audio levels: {\"sequence\":%llu,\"frame\":%llu,\"seconds\":%.3f,\"frames\":%u",
+        static_cast<unsigned long long>(Reading->Sequence),
+        static_cast<unsigned long long>(Reading->FirstFrame),
+        static_cast<double>(Reading->FirstFrame) / SamplesPerSec,
+        Reading->Frames);
+    line += text;
+    const char* names[] = { "peakDb", "rmsDb", "truePeakDb" };
+    const std::vector<float>* levels[] = { &Reading->Peak, &Reading->Rms, &Reading->TruePeak };
+    for (int i = 0; i < 3; i++)
     {
-        fprintf(stderr, "Unable to write PCM data: %d\n", GetLastError());
-        return false;
+        if (levels[i]->empty())
+        {
+            continue;
+        }
+        line += std::string(",\"") + names[i] + "\":[";
+        for (size_t channel = 0; channel < levels[i]->size(); channel++)
+        {
+            snprintf(text, sizeof(text), "%s%.2f", channel != 0 ? "," : "", LevelDb((*levels[i])[channel]));
+            line += text;
+        }
+        line += "]";
+    }
+    line += "}\n";
+    fwrite(line.data(), 1, line.size(), stdout);
+    fflush(stdout);
+}
+
+// What the level printing thread waits on between looks at the meter
+struct LevelPrinterControl
+{
+    std::mutex              Lock;
+    std::condition_variable StopRequested;
+    bool                    Stopping;
+};
+
+// Function to print every reading the level meter publishes, on a thread of its own that looks every PeriodMs
+// whatever the main loop's interval is, and once more when asked to stop.  The meter keeps the last
+// LEVEL_METER_HISTORY readings, so those published between two looks are all printed, in order.
+void PrintLevelsUntilStopped(const CLevelMeter* Meter, DWORD SamplesPerSec, int PeriodMs, LevelPrinterControl* Control)
+{
+    LevelMeterReading reading;
+    uint64_t printed = 0;
+    uint64_t lost = 0;
+    std::unique_lock<std::mutex> lock(Control->Lock);
+    std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+    for (;;)
+    {
+        next += std::chrono::milliseconds(PeriodMs);
+        bool stopping = Control->StopRequested.wait_until(lock, next, [Control] { return Control->Stopping; });
+        lock.unlock();
+        uint64_t latest = Meter->LatestSequence();
+        for (uint64_t sequence = printed + 1; sequence <= latest; sequence++)
+        {
+            if (Meter->GetReading(sequence, &reading))
+            {
+                PrintAudioLevels(&reading, SamplesPerSec);
+            }
+            else
+            {
+                lost++;
+            }
+        }
+        printed = latest;
+        lock.lock();
+        if (stopping)
+        {
+            break;
+        }
+    }
+    if (lost != 0)
+    {
+        fprintf(stderr, "%llu level readings were overwritten before they could be printed.\n", static_cast<unsigned long long>(lost));
     }
+}
+
+// Helper function to save PCM data
+bool WritePcmFile(COutputFile* File, const BYTE* Buffer, const size_t BufferSize)
+{
+    fprintf(stderr, "Writing PCM data. Buffer size: %zu bytes\n", BufferSize);
 
-    if (bytesWritten != BufferSize)
+    // Write raw PCM data directly
+    if (!File->Write(Buffer, BufferSize))
     {
-        fprintf(stderr, "Failed to write entire PCM data\n");
+        fprintf(stderr, "Unable to write PCM data: %d\n", COutputFile::LastError());
         return false;
     }
     
     return true;
 }
 
-// Function to save captured audio data to a PCM file
+// Function to save captured audio data to a WAV file
 void SaveAudioData(BYTE* CaptureBuffer, size_t BufferSize, const WAVEFORMATEX* WaveFormat, std::string fileName)
 {
     // No longer print audio parameters here since we do it at startup
     
-    fprintf(stderr, "Saving to filename: %s.pcm\n", fileName.c_str());
+    fprintf(stderr, "Saving to filename: %s.wav\n", fileName.c_str());
     
-    HANDLE pcmFile = CreateFileA(
-        (fileName + ".pcm").c_str(),
-        GENERIC_WRITE,
-        0,
-        NULL,
-        CREATE_ALWAYS,
-        FILE_ATTRIBUTE_NORMAL,
-        NULL
-    );
-
-    if (pcmFile == INVALID_HANDLE_VALUE)
+    CWavFileSink wavFile;
+    if (!wavFile.Open(fileName + ".wav", WaveFormat))
     {
-        fprintf(stderr, "Unable to open output PCM file: %d\n", GetLastError());
         return;
     }
 
-    if (WritePcmFile(pcmFile, CaptureBuffer, BufferSize))
+    if (wavFile.Write(CaptureBuffer, BufferSize) && wavFile.Close())
     {
-        fprintf(stderr, "Successfully wrote PCM data to %s.pcm\n", fileName.c_str());
+        fprintf(stderr, "Successfully wrote audio data to %s.wav\n", fileName.c_str());
     }
     else
     {
-        fprintf(stderr, "Failed to write PCM file\n");
+        fprintf(stderr, "Failed to write WAV file\n");
     }
-    
-    CloseHandle(pcmFile);
 }
 
 // Function to append captured audio data to an existing PCM file
-bool AppendAudioData(HANDLE FileHandle, BYTE* CaptureBuffer, size_t BufferSize)
+bool AppendAudioData(COutputFile* File, BYTE* CaptureBuffer, size_t BufferSize)
+{
+    return WritePcmFile(File, CaptureBuffer, BufferSize);
+}
+
+// Function to hand all frames published in the ring to the writer thread
+bool DrainRingToWriter(CAsyncWriter* Writer, CCaptureRingBuffer* RingBuffer, size_t* FramesWritten)
+{
+    *FramesWritten = 0;
+    if (Writer->Failed())
+    {
+        return false;
+    }
+
+    // Take everything the capture thread has published so far, as far as the writer has room for whole frames.
+    // Whatever doesn't fit stays in the ring for the next tick.
+    size_t framesToRead = Writer->WritableBytes() / RingBuffer->FrameSize();
+    CaptureRingRegion regions[2];
+    size_t framesAvailable = RingBuffer->BeginRead(framesToRead, regions);
+    if (framesAvailable != 0)
+    {
+        // The ring wraps at most once, so this is at most two copies straight out of the ring
+        for (int i = 0; i < 2; i++)
+        {
+            if (regions[i].Frames != 0)
+            {
+                Writer->Write(regions[i].Data, regions[i].Frames * RingBuffer->FrameSize());
+            }
+        }
+
+        // The bytes are in the writer's blocks now, so the capture thread can reuse the frames
+        RingBuffer->CommitRead(framesAvailable);
+        *FramesWritten = framesAvailable;
+    }
+
+    // End of tick: lets an idle writer start on the partial block
+    Writer->Submit();
+    return true;
+}
+
+// Function to print the capture thread's fault counters
+void PrintCaptureFaults(const CaptureDrainStats* Stats)
+{
+    fprintf(stderr, "Capture faults: %llu glitches (%llu frames lost by the device), %llu frames discarded in %llu overruns, "
+        "%llu silent packets, %llu late wakeups, %llu frames filled with silence\n",
+        static_cast<unsigned long long>(Stats->Glitches),
+        static_cast<unsigned long long>(Stats->GlitchFrames),
+        static_cast<unsigned long long>(Stats->DiscardedFrames),
+        static_cast<unsigned long long>(Stats->Overruns),
+        static_cast<unsigned long long>(Stats->SilentPackets),
+        static_cast<unsigned long long>(Stats->LateWakeups),
+        static_cast<unsigned long long>(Stats->FilledFrames));
+}
+
+// Function to stop and release the capture source and leave COM on the way out of main; returns ExitCode
+int ShutdownCaptureSource(ICaptureSource** Source, int ExitCode)
+{
+    (*Source)->Shutdown();
+    SafeRelease(Source);
+#ifdef _WIN32
+    CoUninitialize();
+#endif
+    return ExitCode;
+}
+
+#ifdef _WIN32
+// Function to print the active endpoints of one direction with their index, ID and name, for picking one by Endpoint
+void PrintAudioEndpoints(IMMDeviceEnumerator* pEnumerator, EDataFlow Flow)
 {
-    return WritePcmFile(FileHandle, CaptureBuffer, BufferSize);
+    IMMDeviceCollection* pCollection = NULL;
+    UINT count = 0;
+    if (FAILED(pEnumerator->EnumAudioEndpoints(Flow, DEVICE_STATE_ACTIVE, &pCollection)) || FAILED(pCollection->GetCount(&count)))
+    {
+        SafeRelease(&pCollection);
+        return;
+    }
+    fprintf(stderr, "Active %s endpoints:\n", Flow == eCapture ? "capture" : "render");
+    for (UINT i = 0; i < count; i++)
+    {
+        IMMDevice* pDevice = NULL;
+        IPropertyStore* pProperties = NULL;
+        LPWSTR id = NULL;
+        PROPVARIANT name;
+        PropVariantInit(&name);
+        if (SUCCEEDED(pCollection->Item(i, &pDevice)) && SUCCEEDED(pDevice->GetId(&id)) &&
+            SUCCEEDED(pDevice->OpenPropertyStore(STGM_READ, &pProperties)) &&
+            SUCCEEDED(pProperties->GetValue(PKEY_Device_FriendlyName, &name)) && name.vt == VT_LPWSTR)
+        {
+            fprintf(stderr, "  %u: %ls  %ls\n", i, id, name.pwszVal);
+        }
+        PropVariantClear(&name);
+        CoTaskMemFree(id);
+        SafeRelease(&pProperties);
+        SafeRelease(&pDevice);
+    }
+    SafeRelease(&pCollection);
 }
 
-// Function to set up audio capture device
-void SetupAudioCapture(IMMDeviceEnumerator*& pEnumerator, IMMDevice*& pDevice)
+// Function to set up audio capture device: the render endpoint to loop back or the capture endpoint, the default one
+// unless Endpoint names another by its index among the active endpoints or by its endpoint ID
+void SetupAudioCapture(IMMDeviceEnumerator*& pEnumerator, IMMDevice*& pDevice, EDataFlow Flow, const std::string& Endpoint)
 {
     HRESULT hr = CoInitializeEx(NULL, COINIT_APARTMENTTHREADED);
     if (FAILED(hr))
@@ -129,27 +346,56 @@ void SetupAudioCapture(IMMDeviceEnumerator*& pEnumerator, IMMDevice*& pDevice)
         return;
     }
 
-    hr = pEnumerator->GetDefaultAudioEndpoint(
-        eRender,
-        eConsole,
-        &pDevice
-    );
+    if (Endpoint.empty())
+    {
+        hr = pEnumerator->GetDefaultAudioEndpoint(
+            Flow,
+            eConsole,
+            &pDevice
+        );
+    }
+    else if (Endpoint.find_first_not_of("0123456789") == std::string::npos)
+    {
+        IMMDeviceCollection* pCollection = NULL;
+        hr = pEnumerator->EnumAudioEndpoints(Flow, DEVICE_STATE_ACTIVE, &pCollection);
+        if (SUCCEEDED(hr))
+        {
+            hr = pCollection->Item(static_cast<UINT>(atoi(Endpoint.c_str())), &pDevice);
+        }
+        SafeRelease(&pCollection);
+    }
+    else
+    {
+        // Endpoint IDs are plain ASCII, such as {0.0.1.00000000}.{GUID}
+        std::wstring id(Endpoint.begin(), Endpoint.end());
+        hr = pEnumerator->GetDevice(id.c_str(), &pDevice);
+    }
 
-    if (FAILED(hr))
+    if (FAILED(hr) || pDevice == NULL)
     {
-        fprintf(stderr, "Failed to get default audio endpoint: %x\n", hr);
+        fprintf(stderr, "Failed to get audio endpoint %s: %x\n", Endpoint.empty() ? "(default)" : Endpoint.c_str(), hr);
+        if (!Endpoint.empty())
+        {
+            PrintAudioEndpoints(pEnumerator, Flow);
+        }
+        SafeRelease(&pDevice);
         return;
     }
     
     fprintf(stderr, "Audio device setup successful\n");
 }
+#endif
 
 // Generate a timestamp string for filename
 std::string GetTimestampString()
 {
     time_t now = time(0);
     struct tm timeinfo;
+#ifdef _WIN32
     localtime_s(&timeinfo, &now);
+#else
+    localtime_r(&now, &timeinfo);
+#endif
     
     char buffer[80];
     strftime(buffer, 80, "%Y%m%d_%H%M%S", &timeinfo);
@@ -201,182 +447,1456 @@ std::string GetCommandLineArgString(int argc, char* argv[], const std::string& a
     return defaultValue;
 }
 
-int main(int argc, char* argv[])
+// Parse a sample format name (f32, s16, s24, s32)
+bool ParseSampleFormat(const std::string& name, bool* isFloat, WORD* bitsPerSample)
 {
-    // Register signal handler for Ctrl+C
-    signal(SIGINT, signalHandler);
-    
-    // Parse command line arguments
-    int bufferIntervalMs = GetCommandLineArgInt(argc, argv, "--interval", 100);
-    if (bufferIntervalMs <= 0) {
-        fprintf(stderr, "Invalid interval value. Using default: 100ms\n");
-        bufferIntervalMs = 100;
+    if (name == "f32") { *isFloat = true; *bitsPerSample = 32; return true; }
+    if (name == "s16") { *isFloat = false; *bitsPerSample = 16; return true; }
+    if (name == "s24") { *isFloat = false; *bitsPerSample = 24; return true; }
+    if (name == "s32") { *isFloat = false; *bitsPerSample = 32; return true; }
+    return false;
+}
+
+// Build the remix matrix from --remix, --remix-matrix or --channels; returns false if none was given or it's invalid
+bool BuildRemixMatrix(int argc, char* argv[], const WAVEFORMATEX* InputFormat, std::vector<float>* Matrix, WORD* OutputChannels,
+    DWORD* OutputChannelMask, bool* Requested)
+{
+    std::string preset = GetCommandLineArgString(argc, argv, "--remix", "");
+    std::string custom = GetCommandLineArgString(argc, argv, "--remix-matrix", "");
+    std::string selection = GetCommandLineArgString(argc, argv, "--channels", "");
+    *Requested = !preset.empty() || !custom.empty() || !selection.empty();
+    if (!preset.empty())
+    {
+        return BuildDownmixMatrix(preset, InputFormat, Matrix, OutputChannels, OutputChannelMask);
     }
-    
-    // Get output file path from command line or use default
-    std::string outputFilePath = GetCommandLineArgString(argc, argv, "--output", "cache.pcm");
-    
-    // Print welcome message
-    fprintf(stderr, "Simple Audio Capture Tool (Based on WASAPI)\n");
-    fprintf(stderr, "------------------------------------------\n");
-    fprintf(stderr, "Recording will continue until you press Ctrl+C to stop\n");
-    fprintf(stderr, "Buffer interval: %d ms\n", bufferIntervalMs);
-    fprintf(stderr, "Output file: %s\n\n", outputFilePath.c_str());
-    
-    // Setup COM and audio device
-    IMMDeviceEnumerator* pEnumerator = NULL;
-    IMMDevice* pDevice = NULL;
-    
-    SetupAudioCapture(pEnumerator, pDevice);
-    if (!pDevice)
+    if (!selection.empty())
     {
-        fprintf(stderr, "Failed to set up audio device.\n");
-        return 1;
+        // Comma separated channel indices, e.g. "0,1"
+        std::vector<uint32_t> channels;
+        size_t start = 0;
+        while (start <= selection.size())
+        {
+            size_t end = selection.find(',', start);
+            if (end == std::string::npos)
+            {
+                end = selection.size();
+            }
+            std::string item = selection.substr(start, end - start);
+            if (item.empty() || item.find_first_not_of("0123456789") != std::string::npos)
+            {
+                fprintf(stderr, "Invalid channel list: %s\n", selection.c_str());
+                return false;
+            }
+            channels.push_back(static_cast<uint32_t>(std::stoul(item)));
+            start = end + 1;
+        }
+        return BuildChannelSelectionMatrix(channels, InputFormat, Matrix, OutputChannels, OutputChannelMask);
     }
-    
-    // Create output file
-    HANDLE pcmFile = CreateFileA(
-        outputFilePath.c_str(),
-        GENERIC_WRITE,
-        0,
-        NULL,
-        CREATE_ALWAYS,
-        FILE_ATTRIBUTE_NORMAL,
-        NULL
-    );
-    
-    if (pcmFile == INVALID_HANDLE_VALUE)
+    if (!custom.empty())
     {
-        fprintf(stderr, "Unable to create output PCM file: %d\n", GetLastError());
-        SafeRelease(&pDevice);
-        SafeRelease(&pEnumerator);
-        CoUninitialize();
-        return 1;
+        // One row of gains per output channel, rows separated by ';' and gains by ','
+        Matrix->clear();
+        size_t rows = 0;
+        size_t start = 0;
+        while (start <= custom.size())
+        {
+            size_t end = custom.find(';', start);
+            if (end == std::string::npos)
+            {
+                end = custom.size();
+            }
+            std::string row = custom.substr(start, end - start);
+            size_t columns = 0;
+            size_t position = 0;
+            while (position <= row.size())
+            {
+                size_t next = row.find(',', position);
+                if (next == std::string::npos)
+                {
+                    next = row.size();
+                }
+                char* parsed;
+                std::string item = row.substr(position, next - position);
+                float gain = strtof(item.c_str(), &parsed);
+                if (item.empty() || *parsed != '\0')
+                {
+                    fprintf(stderr, "Invalid remix matrix: %s\n", custom.c_str());
+                    return false;
+                }
+                Matrix->push_back(gain);
+                columns++;
+                position = next + 1;
+            }
+            if (columns != InputFormat->nChannels)
+            {
+                fprintf(stderr, "Remix matrix row %zu has %zu gains; the source has %u channels.\n", rows, columns, InputFormat->nChannels);
+                return false;
+            }
+            rows++;
+            start = end + 1;
+        }
+        *OutputChannels = static_cast<WORD>(rows);
+        *OutputChannelMask = 0;
+        return true;
     }
-    
-    fprintf(stderr, "Will save to: %s\n", outputFilePath.c_str());
-    
-    // Create and initialize the capturer
-    CWASAPICapture* capturer = new CWASAPICapture(pDevice, true, eConsole);
-    if (!capturer)
+    return false;
+}
+
+// Function to create and initialize one capture source; Option is what follows the name in a --sources entry, and
+// Shared makes a synthetic source play the signal every input of a multi source hears
+ICaptureSource* CreateSingleCaptureSource(int argc, char* argv[], const std::string& sourceName, const std::string& Option, bool Shared)
+{
+    fprintf(stderr, "Capture source: %s%s%s\n", sourceName.c_str(), Option.empty() ? "" : ":", Option.c_str());
+
+#ifdef _WIN32
+    if (sourceName == "wasapi")
     {
-        fprintf(stderr, "Failed to create audio capturer.\n");
-        CloseHandle(pcmFile);
+        // Loopback of the default render endpoint unless the option asks for a microphone; either may be followed by
+        // the index or ID of another endpoint than the default, so several microphones can be recorded at once
+        std::string kind = Option.substr(0, Option.find(':'));
+        std::string endpoint = kind.size() < Option.size() ? Option.substr(kind.size() + 1) : "";
+        if (!kind.empty() && kind != "loopback" && kind != "mic")
+        {
+            fprintf(stderr, "Unknown WASAPI endpoint %s, use loopback[:<index|id>] or mic[:<index|id>].\n", Option.c_str());
+            return NULL;
+        }
+        bool loopback = kind != "mic";
+
+        // Event driven capture is the default; timer driven polling is kept as a fallback
+        CaptureMode captureMode = HasCommandLineArg(argc, argv, "--timer-driven") ? CaptureModeTimerDriven : CaptureModeEventDriven;
+        fprintf(stderr, "Capture mode: %s\n", captureMode == CaptureModeEventDriven ? "event driven" : "timer driven");
+
+        // Setup COM and audio device
+        IMMDeviceEnumerator* pEnumerator = NULL;
+        IMMDevice* pDevice = NULL;
+        
+        SetupAudioCapture(pEnumerator, pDevice, loopback ? eRender : eCapture, endpoint);
+        if (!pDevice)
+        {
+            fprintf(stderr, "Failed to set up audio device.\n");
+            SafeRelease(&pEnumerator);
+            return NULL;
+        }
+        
+        // The capturer holds its own reference to the endpoint
+        CWASAPICapture* capturer = new CWASAPICapture(pDevice, true, eConsole, loopback);
         SafeRelease(&pDevice);
         SafeRelease(&pEnumerator);
-        CoUninitialize();
-        return 1;
+        
+        int targetLatency = 10; // in milliseconds
+        if (!capturer->Initialize(targetLatency, captureMode))
+        {
+            fprintf(stderr, "Failed to initialize audio capturer.\n");
+            capturer->Shutdown();
+            capturer->Release();
+            return NULL;
+        }
+        return capturer;
     }
-    
-    int targetLatency = 10; // in milliseconds
-    if (!capturer->Initialize(targetLatency))
+#endif
+
+#ifdef AUDIO_CAPTURE_HAVE_PULSE
+    if (sourceName == "pulse")
     {
-        fprintf(stderr, "Failed to initialize audio capturer.\n");
-        CloseHandle(pcmFile);
-        capturer->Release();
-        capturer = NULL;
-        SafeRelease(&pDevice);
-        SafeRelease(&pEnumerator);
-        CoUninitialize();
-        return 1;
+        // Record the monitor of the default sink unless the option or --device names another source
+        std::string deviceName = !Option.empty() ? Option : GetCommandLineArgString(argc, argv, "--device", "");
+        
+        CPulseAudioCapture* capturer = new CPulseAudioCapture();
+        int targetLatency = 10; // in milliseconds
+        if (!capturer->Initialize(deviceName, targetLatency))
+        {
+            fprintf(stderr, "Failed to initialize audio capturer.\n");
+            capturer->Shutdown();
+            capturer->Release();
+            return NULL;
+        }
+        return capturer;
     }
+#endif
 
-    // Print audio parameters in JSON format immediately after initialization to stdout
-    // Note we don't add any labels or explanations, just the pure JSON
-    PrintAudioParameters(capturer->MixFormat());
-    
-    // Define buffer size to accumulate data for the interval duration
-    // We'll make the buffer large to ensure it won't overflow
-    const double safetyFactor = 2.0; // 2x safety factor
-    const double bufferDurationInSeconds = (bufferIntervalMs / 1000.0) * safetyFactor;
-    size_t bufferSize = static_cast<size_t>(capturer->SamplesPerSecond() * bufferDurationInSeconds * capturer->FrameSize());
-    BYTE* captureBuffer = new BYTE[bufferSize];
-    
-    if (!captureBuffer)
+    // Portable sources: synthetic tone generator or file replay
+    bool realTime = GetCommandLineArgString(argc, argv, "--speed", "realtime") != "max";
+    int sampleRate = GetCommandLineArgInt(argc, argv, "--source-rate", 48000);
+    int channels = GetCommandLineArgInt(argc, argv, "--source-channels", 2);
+    int packetMs = GetCommandLineArgInt(argc, argv, "--packet-ms", 10);
+    int jitterMs = GetCommandLineArgInt(argc, argv, "--jitter-ms", 0);
+    bool isFloat;
+    WORD bitsPerSample;
+    if (sampleRate <= 0 || channels <= 0 || channels > 64 || packetMs <= 0 || jitterMs < 0 ||
+        !ParseSampleFormat(GetCommandLineArgString(argc, argv, "--source-format", "f32"), &isFloat, &bitsPerSample))
     {
-        fprintf(stderr, "Failed to allocate capture buffer.\n");
-        CloseHandle(pcmFile);
-        capturer->Shutdown();
-        capturer->Release();
-        capturer = NULL;
-        SafeRelease(&pDevice);
-        SafeRelease(&pEnumerator);
-        CoUninitialize();
-        return 1;
+        fprintf(stderr, "Invalid source parameters.\n");
+        return NULL;
     }
-    
-    // Start capturing - we'll only call Start once
-    if (!capturer->Start(captureBuffer, bufferSize))
+    UINT32 packetFrames = static_cast<UINT32>(static_cast<int64_t>(sampleRate) * packetMs / 1000);
+    fprintf(stderr, "Source pacing: %s\n", realTime ? "real time" : "max speed");
+
+    if (sourceName == "synthetic")
     {
-        fprintf(stderr, "Failed to start audio capture.\n");
-        delete[] captureBuffer;
-        CloseHandle(pcmFile);
-        capturer->Shutdown();
-        capturer->Release();
-        capturer = NULL;
-        SafeRelease(&pDevice);
-        SafeRelease(&pEnumerator);
-        CoUninitialize();
-        return 1;
+        CSyntheticCaptureSource* source = new CSyntheticCaptureSource();
+        if (!source->Initialize(sampleRate, static_cast<WORD>(channels), bitsPerSample, isFloat, packetFrames, jitterMs, realTime))
+        {
+            fprintf(stderr, "Failed to initialize synthetic source.\n");
+            source->Release();
+            return NULL;
+        }
+
+        // In a multi source, the option is the clock skew in ppm and the start delay in ms, e.g. synthetic:800:400
+        if (Shared)
+        {
+            char* end = NULL;
+            long skewPpm = Option.empty() ? 0 : strtol(Option.c_str(), &end, 10);
+            long delayMs = 0;
+            if (end != NULL && *end == ':')
+            {
+                const char* delay = end + 1;
+                delayMs = strtol(delay, &end, 10);
+                if (end == delay)
+                {
+                    end = NULL;
+                }
+            }
+            if ((end != NULL && *end != '\0') || (!Option.empty() && end == Option.c_str()) || delayMs < 0 ||
+                !source->SetClock(static_cast<int>(skewPpm), static_cast<UINT32>(delayMs), true))
+            {
+                fprintf(stderr, "Invalid synthetic source clock %s, use <skew ppm>[:<start delay ms>].\n", Option.c_str());
+                source->Release();
+                return NULL;
+            }
+        }
+
+        // Optionally reopen on another format mid-stream, like a WASAPI stream switch to a different endpoint
+        int switchAfterMs = GetCommandLineArgInt(argc, argv, "--switch-after-ms", 0);
+        if (switchAfterMs > 0)
+        {
+            int switchRate = GetCommandLineArgInt(argc, argv, "--switch-rate", sampleRate);
+            int switchChannels = GetCommandLineArgInt(argc, argv, "--switch-channels", channels);
+            int switchGapMs = GetCommandLineArgInt(argc, argv, "--switch-gap-ms", 50);
+            if (!source->ScheduleFormatSwitch(switchAfterMs, switchRate, static_cast<WORD>(switchChannels), switchGapMs))
+            {
+                source->Release();
+                return NULL;
+            }
+            fprintf(stderr, "Format switch after %d ms: %d Hz, %d channels, %d ms gap\n", switchAfterMs, switchRate, switchChannels, switchGapMs);
+        }
+        return source;
     }
-    
-    fprintf(stderr, "Recording... Press Ctrl+C to stop\n");
-    fprintf(stderr, "Buffer size: %zu bytes (%.3f seconds of audio)\n", bufferSize, bufferDurationInSeconds);
-    
-    int totalSeconds = 0;
-    int captureCount = 0;
-    
-    // Main recording loop
-    while (g_running)
+
+    if (sourceName == "replay")
     {
-        // Wait for the specified interval
-        Sleep(bufferIntervalMs);
-        captureCount++;
-        
-        // Check how much data has been captured
-        size_t bytesAvailable = capturer->BytesCaptured();
-        
-        // If we have data, write it to the file and reset capture position
-        if (bytesAvailable > 0)
+        std::string replayFile = !Option.empty() ? Option : GetCommandLineArgString(argc, argv, "--replay", "");
+        if (replayFile.empty())
+        {
+            fprintf(stderr, "--source replay needs --replay <file>, or replay:<file> in --sources\n");
+            return NULL;
+        }
+
+        // Headerless .pcm files are replayed in the --source-* format
+        WAVEFORMATEXTENSIBLE rawFormat;
+        InitializeWaveFormat(&rawFormat, isFloat, static_cast<WORD>(channels), sampleRate, bitsPerSample, 0);
+
+        CReplayCaptureSource* source = new CReplayCaptureSource();
+        if (!source->Initialize(replayFile, &rawFormat.Format, packetFrames, realTime))
+        {
+            fprintf(stderr, "Failed to initialize replay source.\n");
+            source->Release();
+            return NULL;
+        }
+        return source;
+    }
+
+    fprintf(stderr, "Unknown capture source: %s\n", sourceName.c_str());
+    return NULL;
+}
+
+// Function to create and initialize the capture source selected on the command line: --source, or a multi source over
+// the comma separated --sources list, the first of which is the reference clock
+ICaptureSource* CreateCaptureSource(int argc, char* argv[])
+{
+    std::string sourceList = GetCommandLineArgString(argc, argv, "--sources", "");
+    if (sourceList.empty())
+    {
+#if defined(_WIN32)
+        std::string sourceName = GetCommandLineArgString(argc, argv, "--source", "wasapi");
+#elif defined(AUDIO_CAPTURE_HAVE_PULSE)
+        std::string sourceName = GetCommandLineArgString(argc, argv, "--source", "pulse");
+#else
+        std::string sourceName = GetCommandLineArgString(argc, argv, "--source", "synthetic");
+#endif
+        return CreateSingleCaptureSource(argc, argv, sourceName, "", false);
+    }
+
+    // Inputs are aligned by capture time, which only means something when every input runs in real time
+    if (GetCommandLineArgString(argc, argv, "--speed", "realtime") == "max")
+    {
+        fprintf(stderr, "--sources records in real time; it can't be combined with --speed max.\n");
+        return NULL;
+    }
+
+    std::vector<ICaptureSource*> sources;
+    std::vector<std::string> specs;
+    size_t start = 0;
+    while (start <= sourceList.size())
+    {
+        size_t end = sourceList.find(',', start);
+        if (end == std::string::npos)
+        {
+            end = sourceList.size();
+        }
+        std::string spec = sourceList.substr(start, end - start);
+        size_t colon = spec.find(':');
+        ICaptureSource* source = spec.empty() ? NULL : CreateSingleCaptureSource(argc, argv, spec.substr(0, colon),
+            colon == std::string::npos ? "" : spec.substr(colon + 1), true);
+        if (source == NULL)
         {
-            // Write captured data to file
-            if (!WritePcmFile(pcmFile, captureBuffer, bytesAvailable))
+            fprintf(stderr, "Invalid --sources entry: %s\n", spec.c_str());
+            for (size_t i = 0; i < sources.size(); i++)
             {
-                fprintf(stderr, "\nFailed to write audio data.\n");
-                break;
+                sources[i]->Shutdown();
+                SafeRelease(&sources[i]);
             }
-            
-            // Flush file to make sure data is written to disk for downstream consumers
-            FlushFileBuffers(pcmFile);
-            
-            // Reset buffer for next capture without stopping the capturer
-            capturer->ResetCaptureIndex();
+            return NULL;
         }
-        
-        // Update display every second
-        int updatesPerSecond = 1000 / bufferIntervalMs;
-        if (captureCount % updatesPerSecond == 0) {
-            totalSeconds++;
-            fprintf(stderr, "\rRecording: %d seconds", totalSeconds);
+        sources.push_back(source);
+        specs.push_back(spec);
+        start = end + 1;
+    }
+
+    // Output packets of 10 ms of the reference, which is also how often the inputs are steered
+    std::string kernelName = GetCommandLineArgString(argc, argv, "--convert-kernel", "avx2");
+    SampleConvertKernel maxKernel = kernelName == "scalar" ? SampleKernelScalar : kernelName == "sse2" ? SampleKernelSse2 : SampleKernelAvx2;
+    CMultiCaptureSource* multi = new CMultiCaptureSource();
+    bool initialized = multi->Initialize(&sources[0], sources.size(), sources[0]->MixFormat()->nSamplesPerSec / 100, maxKernel);
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        if (!initialized)
+        {
+            sources[i]->Shutdown();
         }
+        SafeRelease(&sources[i]);
     }
-    
-    // Now that we're done, stop the capturer
-    capturer->Stop();
-    
-    fprintf(stderr, "\nRecording complete. Total duration: %d seconds\n", totalSeconds);
-    fprintf(stderr, "Audio data saved to %s\n", outputFilePath.c_str());
-    
-    // Clean up
-    delete[] captureBuffer;
-    CloseHandle(pcmFile);
-    capturer->Shutdown();
-    capturer->Release();
-    capturer = NULL;
-    SafeRelease(&pDevice);
-    SafeRelease(&pEnumerator);
-    CoUninitialize();
-    
-    fprintf(stderr, "Program complete.\n");
-    return 0;
-} 
\ No newline at end of file
+    if (!initialized)
+    {
+        fprintf(stderr, "Failed to initialize multi source.\n");
+        multi->Release();
+        return NULL;
+    }
+
+    UINT32 firstChannel = 0;
+    for (size_t i = 0; i < multi->SourceCount(); i++)
+    {
+        fprintf(stderr, "Multi source input %zu: %s, %u Hz, channels %u-%u%s\n", i, specs[i].c_str(), multi->Source(i)->MixFormat()->nSamplesPerSec,
+            firstChannel, firstChannel + multi->SourceChannels(i) - 1, i == 0 ? " (reference clock)" : "");
+        firstChannel += multi->SourceChannels(i);
+    }
+    return multi;
+}
+
+// Function to create one pcm or wav file per input of a multi source, named <name>_<input>.<ext>, each with that
+// input's channels in the recording's format
+IOutputSink* CreateSplitOutputSink(int argc, char* argv[], const std::string& fileName, const WAVEFORMATEX* WaveFormat, CMultiCaptureSource* Source)
+{
+    bool isWav = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".wav") == 0;
+    std::string outputFormat = GetCommandLineArgString(argc, argv, "--format", isWav ? "wav" : "pcm");
+    if ((outputFormat != "pcm" && outputFormat != "wav") || fileName == "-" || HasCommandLineArg(argc, argv, "--fifo") ||
+        HasCommandLineArg(argc, argv, "--serve") || HasCommandLineArg(argc, argv, "--direct-io") || HasCommandLineArg(argc, argv, "--index") ||
+        HasCommandLineArg(argc, argv, "--segment-seconds") || HasCommandLineArg(argc, argv, "--segment-mb") ||
+        HasCommandLineArg(argc, argv, "--segment-on-signal"))
+    {
+        fprintf(stderr, "--multi-output split writes pcm or wav files, without segments, pipes, --serve, --direct-io or --index.\n");
+        return NULL;
+    }
+    fprintf(stderr, "Output format: %s, one file per input\n", outputFormat.c_str());
+
+    std::vector<IOutputSink*> sinks;
+    std::vector<WORD> channels;
+    bool opened = true;
+    for (size_t i = 0; i < Source->SourceCount() && opened; i++)
+    {
+        std::string splitName = CChannelSplitSink::SplitFileName(fileName, static_cast<uint32_t>(i));
+        if (outputFormat == "wav")
+        {
+            WAVEFORMATEXTENSIBLE format;
+            InitializeWaveFormat(&format, IsFloatFormat(WaveFormat), Source->SourceChannels(i), WaveFormat->nSamplesPerSec,
+                WaveFormat->wBitsPerSample, 0);
+            CWavFileSink* sink = new CWavFileSink();
+            sinks.push_back(sink);
+            opened = sink->Open(splitName, &format.Format);
+        }
+        else
+        {
+            CPcmFileSink* sink = new CPcmFileSink();
+            sinks.push_back(sink);
+            opened = sink->Open(splitName);
+        }
+        channels.push_back(Source->SourceChannels(i));
+        fprintf(stderr, "Input %zu: %s\n", i, splitName.c_str());
+    }
+
+    CChannelSplitSink* sink = new CChannelSplitSink();
+    if (!opened)
+    {
+        for (size_t i = 0; i < sinks.size(); i++)
+        {
+            delete sinks[i];
+        }
+        delete sink;
+        return NULL;
+    }
+    if (!sink->Open(&sinks[0], &channels[0], sinks.size(), static_cast<WORD>(WaveFormat->wBitsPerSample / 8)))
+    {
+        delete sink;
+        return NULL;
+    }
+    return sink;
+}
+
+// Function to create the output sink selected on the command line
+IOutputSink* CreateOutputSink(int argc, char* argv[], const std::string& fileName, const WAVEFORMATEX* WaveFormat, CCapturePacketLog* PacketLog)
+{
+    // WAV, FLAC, Opus or silence collapsed when asked for, or when the output file is named .wav / .flac / .opus / .acs; pipes default to the framed stream
+    bool isPipe = fileName == "-" || HasCommandLineArg(argc, argv, "--fifo");
+    bool isServer = HasCommandLineArg(argc, argv, "--serve");
+    bool isWav = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".wav") == 0;
+    bool isFlac = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".flac") == 0;
+    bool isOpus = fileName.size() >= 5 && fileName.compare(fileName.size() - 5, 5, ".opus") == 0;
+    bool isSilence = fileName.size() >= 4 && fileName.compare(fileName.size() - 4, 4, ".acs") == 0;
+    std::string outputFormat = GetCommandLineArgString(argc, argv, "--format", isPipe || isServer ? "stream" : isWav ? "wav" : isFlac ? "flac" :
+        isOpus ? "opus" : isSilence ? "silence" : "pcm");
+    if (outputFormat != "wav" && outputFormat != "flac" && outputFormat != "opus" && outputFormat != "pcm" && outputFormat != "shm" &&
+        outputFormat != "stream" && outputFormat != "silence")
+    {
+        fprintf(stderr, "Unknown output format: %s\n", outputFormat.c_str());
+        return NULL;
+    }
+    fprintf(stderr, "Output format: %s\n", outputFormat.c_str());
+
+    // Rolling segments cut the recording into files by duration, size or on SIGUSR1 (--segment-on-signal)
+    int segmentSeconds = GetCommandLineArgInt(argc, argv, "--segment-seconds", 0);
+    int segmentMb = GetCommandLineArgInt(argc, argv, "--segment-mb", 0);
+    bool segmentOnSignal = HasCommandLineArg(argc, argv, "--segment-on-signal");
+    if (segmentSeconds != 0 || segmentMb != 0 || segmentOnSignal)
+    {
+        if ((outputFormat != "pcm" && outputFormat != "wav") || isPipe || isServer || HasCommandLineArg(argc, argv, "--direct-io"))
+        {
+            fprintf(stderr, "Segmented output needs pcm or wav files, without --direct-io.\n");
+            return NULL;
+        }
+#ifndef SIGUSR1
+        if (segmentOnSignal)
+        {
+            fprintf(stderr, "--segment-on-signal needs SIGUSR1, which this platform doesn't have.\n");
+            return NULL;
+        }
+#endif
+        SegmentOptions options;
+        options.FileFormat = outputFormat == "wav" ? SegmentFileWav : SegmentFilePcm;
+        options.MaxFrames = static_cast<uint64_t>(segmentSeconds > 0 ? segmentSeconds : 0) * WaveFormat->nSamplesPerSec;
+        options.MaxBytes = static_cast<uint64_t>(segmentMb > 0 ? segmentMb : 0) * 1024 * 1024;
+
+        // Each file reserves room for a whole segment up front, up to 256 MB; signal only segments get 64 MB
+        uint64_t segmentBytes = options.MaxFrames != 0 ? options.MaxFrames * WaveFormat->nBlockAlign : UINT64_MAX;
+        segmentBytes = std::min(segmentBytes, options.MaxBytes != 0 ? options.MaxBytes : UINT64_MAX);
+        int defaultPreallocateMb = segmentBytes == UINT64_MAX ? 64 : static_cast<int>(std::min<uint64_t>(segmentBytes / (1024 * 1024) + 1, 256));
+        int preallocateMb = GetCommandLineArgInt(argc, argv, "--preallocate-mb", defaultPreallocateMb);
+        if (segmentSeconds < 0 || segmentMb < 0 || preallocateMb < 0)
+        {
+            fprintf(stderr, "Invalid segment parameters.\n");
+            return NULL;
+        }
+        options.PreallocateBytes = static_cast<uint64_t>(preallocateMb) * 1024 * 1024;
+        fprintf(stderr, "Segments: %s, every %d s / %d MB%s, %d MB preallocated, manifest %s\n",
+            CSegmentedSink::SegmentFileName(fileName, 0).c_str(), segmentSeconds, segmentMb, segmentOnSignal ? " and on SIGUSR1" : "",
+            preallocateMb, CSegmentedSink::ManifestFileName(fileName).c_str());
+
+        CSegmentedSink* sink = new CSegmentedSink();
+        if (!sink->Open(fileName, WaveFormat, options, PacketLog))
+        {
+            delete sink;
+            return NULL;
+        }
+#ifdef SIGUSR1
+        if (segmentOnSignal)
+        {
+            signal(SIGUSR1, signalHandler);
+        }
+#endif
+        return sink;
+    }
+
+    std::string serveAddress = GetCommandLineArgString(argc, argv, "--serve", "");
+    if (!serveAddress.empty())
+    {
+        if (outputFormat != "stream" || isPipe)
+        {
+            fprintf(stderr, "--serve sends the framed stream and takes no --output - or --fifo.\n");
+            return NULL;
+        }
+
+        // Fans the framed stream out to every subscriber; a slow one is cut off or skipped ahead, never waited for
+        std::string slowClient = GetCommandLineArgString(argc, argv, "--slow-client", "disconnect");
+        int streamBlockMs = GetCommandLineArgInt(argc, argv, "--stream-block-ms", 10);
+        int maxLagMs = GetCommandLineArgInt(argc, argv, "--max-lag-ms", 2000);
+        int maxClients = GetCommandLineArgInt(argc, argv, "--max-clients", 256);
+        if ((slowClient != "disconnect" && slowClient != "skip") || streamBlockMs <= 0 || maxLagMs <= 0 || maxClients <= 0)
+        {
+            fprintf(stderr, "Invalid socket server parameters.\n");
+            return NULL;
+        }
+        fprintf(stderr, "Socket server: %d ms blocks, up to %d clients, slow client: %s after %d ms\n", streamBlockMs, maxClients,
+            slowClient.c_str(), maxLagMs);
+
+        SocketServerOptions options;
+        options.MaxLagMs = static_cast<uint32_t>(maxLagMs);
+        options.Policy = slowClient == "skip" ? SlowClientSkip : SlowClientDisconnect;
+        options.MaxClients = static_cast<uint32_t>(maxClients);
+        uint32_t blockFrames = static_cast<uint32_t>(static_cast<uint64_t>(WaveFormat->nSamplesPerSec) * streamBlockMs / 1000);
+        CSocketServerSink* sink = new CSocketServerSink();
+        if (!sink->Open(serveAddress, WaveFormat, blockFrames != 0 ? blockFrames : 1, PacketLog, options))
+        {
+            delete sink;
+            return NULL;
+        }
+        return sink;
+    }
+
+    if (isPipe || outputFormat == "stream")
+    {
+        if (!isPipe || (outputFormat != "stream" && outputFormat != "pcm"))
+        {
+            fprintf(stderr, "Pipes take --format stream or pcm, and --format stream needs --output -, --fifo or --serve.\n");
+            return NULL;
+        }
+        if (HasCommandLineArg(argc, argv, "--direct-io"))
+        {
+            fprintf(stderr, "--direct-io only supports pcm output to a file.\n");
+            return NULL;
+        }
+
+        // Writes never block the writer thread on a full pipe unless --slow-reader block says to wait
+        std::string slowReader = GetCommandLineArgString(argc, argv, "--slow-reader", "block");
+        int streamBlockMs = GetCommandLineArgInt(argc, argv, "--stream-block-ms", 10);
+        if ((slowReader != "block" && slowReader != "drop") || streamBlockMs <= 0)
+        {
+            fprintf(stderr, "Invalid stream parameters.\n");
+            return NULL;
+        }
+        fprintf(stderr, "Stream: %s, %d ms blocks, slow reader: %s\n", fileName == "-" ? "stdout" : fileName.c_str(), streamBlockMs,
+            slowReader.c_str());
+
+        uint32_t blockFrames = static_cast<uint32_t>(static_cast<uint64_t>(WaveFormat->nSamplesPerSec) * streamBlockMs / 1000);
+        CStreamSink* sink = new CStreamSink();
+        if (!sink->Open(fileName, WaveFormat, outputFormat == "stream", slowReader == "drop" ? StreamSlowReaderDrop : StreamSlowReaderBlock,
+            blockFrames != 0 ? blockFrames : 1, outputFormat == "stream" ? PacketLog : NULL))
+        {
+            delete sink;
+            return NULL;
+        }
+        return sink;
+    }
+
+    if (outputFormat == "shm")
+    {
+        if (HasCommandLineArg(argc, argv, "--direct-io"))
+        {
+            fprintf(stderr, "--direct-io only supports pcm output.\n");
+            return NULL;
+        }
+
+        // Published into a named shared memory ring for readers on this host instead of a file
+        std::string shmName = GetCommandLineArgString(argc, argv, "--shm-name", "audio_capture");
+        int shmMs = GetCommandLineArgInt(argc, argv, "--shm-ms", 5000);
+        int shmBlockMs = GetCommandLineArgInt(argc, argv, "--shm-block-ms", 10);
+        if (shmName.empty() || shmMs <= 0 || shmBlockMs <= 0 || shmBlockMs > shmMs)
+        {
+            fprintf(stderr, "Invalid shared memory ring parameters.\n");
+            return NULL;
+        }
+        fprintf(stderr, "Shared memory ring: %s, %d ms, %d ms blocks\n", shmName.c_str(), shmMs, shmBlockMs);
+
+        size_t bytesPerMs = static_cast<size_t>(WaveFormat->nAvgBytesPerSec) / 1000;
+        CSharedRingSink* sink = new CSharedRingSink();
+        if (!sink->Open(shmName, WaveFormat, bytesPerMs * shmMs, bytesPerMs * shmBlockMs))
+        {
+            delete sink;
+            return NULL;
+        }
+        return sink;
+    }
+
+    if (outputFormat == "opus")
+    {
+#ifdef AUDIO_CAPTURE_HAVE_OPUS
+        if (HasCommandLineArg(argc, argv, "--direct-io"))
+        {
+            fprintf(stderr, "--direct-io only supports pcm output.\n");
+            return NULL;
+        }
+
+        // Encoded on the writer thread straight from the captured bytes
+        int opusBitrateKbps = GetCommandLineArgInt(argc, argv, "--opus-bitrate", 32);
+        int opusFrameMs = GetCommandLineArgInt(argc, argv, "--opus-frame-ms", 20);
+        if (opusBitrateKbps <= 0 || opusBitrateKbps > 1024 || opusFrameMs <= 0)
+        {
+            fprintf(stderr, "Invalid Opus parameters.\n");
+            return NULL;
+        }
+        fprintf(stderr, "Opus encoder: %d kbps, %d ms frames\n", opusBitrateKbps, opusFrameMs);
+
+        COpusFileSink* sink = new COpusFileSink();
+        if (!sink->Open(fileName, WaveFormat, static_cast<uint32_t>(opusBitrateKbps) * 1000, static_cast<uint32_t>(opusFrameMs)))
+        {
+            delete sink;
+            return NULL;
+        }
+        return sink;
+#else
+        fprintf(stderr, "This build has no Opus support (libopus was not found).\n");
+        return NULL;
+#endif
+    }
+
+    if (outputFormat == "flac")
+    {
+        if (HasCommandLineArg(argc, argv, "--direct-io"))
+        {
+            fprintf(stderr, "--direct-io only supports pcm output.\n");
+            return NULL;
+        }
+
+        // Encode on a worker pool, one frame per block; by default a worker per core, up to 4
+        unsigned int cores = std::thread::hardware_concurrency();
+        int defaultThreads = cores == 0 ? 1 : cores > 4 ? 4 : static_cast<int>(cores);
+        int flacThreads = GetCommandLineArgInt(argc, argv, "--flac-threads", defaultThreads);
+        int flacBlock = GetCommandLineArgInt(argc, argv, "--flac-block", 4096);
+        if (flacThreads <= 0 || flacThreads > 64 || flacBlock < 16 || flacBlock > 65535)
+        {
+            fprintf(stderr, "Invalid FLAC parameters.\n");
+            return NULL;
+        }
+        fprintf(stderr, "FLAC encoder: %d threads, %d frame blocks\n", flacThreads, flacBlock);
+
+        CFlacFileSink* sink = new CFlacFileSink();
+        if (!sink->Open(fileName, WaveFormat, static_cast<uint32_t>(flacBlock), static_cast<uint32_t>(flacThreads)))
+        {
+            delete sink;
+            return NULL;
+        }
+        return sink;
+    }
+
+    if (outputFormat == "silence")
+    {
+        if (HasCommandLineArg(argc, argv, "--direct-io"))
+        {
+            fprintf(stderr, "--direct-io only supports pcm output.\n");
+            return NULL;
+        }
+
+        // Silent stretches are stored as a length instead of zeros; by default only digital silence, so nothing is lost
+        std::string threshold = GetCommandLineArgString(argc, argv, "--silence-threshold", "");
+        char* end = NULL;
+        double thresholdDb = threshold.empty() ? 0.0 : strtod(threshold.c_str(), &end);
+        int minSilenceMs = GetCommandLineArgInt(argc, argv, "--silence-min-ms", 200);
+        if ((!threshold.empty() && (*end != '\0' || !(thresholdDb < 0))) || minSilenceMs <= 0)
+        {
+            fprintf(stderr, "Invalid silence parameters: --silence-threshold takes a level below 0 dBFS.\n");
+            return NULL;
+        }
+        double thresholdLinear = threshold.empty() ? 0.0 : pow(10.0, thresholdDb / 20.0);
+        if (threshold.empty())
+        {
+            fprintf(stderr, "Silence collapsing: digital silence only, at least %d ms\n", minSilenceMs);
+        }
+        else
+        {
+            fprintf(stderr, "Silence collapsing: below %.1f dBFS, at least %d ms (lossy)\n", thresholdDb, minSilenceMs);
+        }
+
+        std::string kernelName = GetCommandLineArgString(argc, argv, "--convert-kernel", "avx2");
+        SampleConvertKernel maxKernel = kernelName == "scalar" ? SampleKernelScalar : kernelName == "sse2" ? SampleKernelSse2 : SampleKernelAvx2;
+        CSilenceFileSink* sink = new CSilenceFileSink();
+        if (!sink->Open(fileName, WaveFormat, thresholdLinear, static_cast<uint32_t>(minSilenceMs), PacketLog, maxKernel))
+        {
+            delete sink;
+            return NULL;
+        }
+        fprintf(stderr, "Silence detector kernel: %s\n", SampleConvertKernelName(sink->DetectorKernel()));
+        return sink;
+    }
+
+    if (outputFormat == "wav")
+    {
+        if (HasCommandLineArg(argc, argv, "--direct-io"))
+        {
+            fprintf(stderr, "--direct-io only supports pcm output.\n");
+            return NULL;
+        }
+
+        CWavFileSink* sink = new CWavFileSink();
+        if (!sink->Open(fileName, WaveFormat))
+        {
+            delete sink;
+            return NULL;
+        }
+        return sink;
+    }
+
+    if (HasCommandLineArg(argc, argv, "--direct-io"))
+    {
+        // Stage whole writer blocks and preallocate in large extents to keep long recordings contiguous
+        int writeBlockKb = GetCommandLineArgInt(argc, argv, "--write-block-kb", 1024);
+        int preallocateMb = GetCommandLineArgInt(argc, argv, "--preallocate-mb", 64);
+        if (writeBlockKb <= 0 || preallocateMb <= 0)
+        {
+            fprintf(stderr, "Invalid output parameters.\n");
+            return NULL;
+        }
+        fprintf(stderr, "Output mode: direct I/O, %d MB extents\n", preallocateMb);
+
+        CDirectPcmFileSink* sink = new CDirectPcmFileSink();
+        if (!sink->Open(fileName, static_cast<size_t>(writeBlockKb) * 1024, static_cast<uint64_t>(preallocateMb) * 1024 * 1024))
+        {
+            delete sink;
+            return NULL;
+        }
+        return sink;
+    }
+
+    CPcmFileSink* sink = new CPcmFileSink();
+    if (!sink->Open(fileName))
+    {
+        delete sink;
+        return NULL;
+    }
+    return sink;
+}
+
+// Function to print where a capture time (seconds since the Unix epoch) falls in a recording, from its time index
+bool FindIndexTime(const std::string& indexFileName, const std::string& time)
+{
+    char* end = NULL;
+    double seconds = strtod(time.c_str(), &end);
+    if (time.empty() || *end != '\0')
+    {
+        fprintf(stderr, "--index-find needs --at <seconds since the Unix epoch>.\n");
+        return false;
+    }
+
+    CTimeIndexReader index;
+    TimeIndexPosition position;
+    if (!index.Open(indexFileName) || !index.FindTime(static_cast<int64_t>(seconds * 1e9), &position))
+    {
+        fprintf(stderr, "No position for that time in %s\n", indexFileName.c_str());
+        return false;
+    }
+    printf("{\"frame\":%llu,\"byteOffset\":%llu,\"entry\":%llu,\"entries\":%llu,\"entriesRead\":%llu}\n",
+        static_cast<unsigned long long>(position.Frame),
+        static_cast<unsigned long long>(position.ByteOffset),
+        static_cast<unsigned long long>(position.Entry),
+        static_cast<unsigned long long>(index.Entries()),
+        static_cast<unsigned long long>(index.EntryReads()));
+    return true;
+}
+
+// Function to print the stretches of a silence collapsed recording that have sound in them, as JSON
+bool PrintSilenceRegions(const std::string& fileName)
+{
+    CSilenceFileReader reader;
+    if (!reader.Open(fileName))
+    {
+        return false;
+    }
+    std::vector<SilenceFileRegion> regions;
+    reader.GetSoundRegions(&regions);
+
+    uint32_t sampleRate = reader.Format()->nSamplesPerSec;
+    printf("{\"sampleRate\":%u,\"frames\":%llu,\"silentFrames\":%llu,\"records\":%llu,\"regions\":[", sampleRate,
+        static_cast<unsigned long long>(reader.Frames()),
+        static_cast<unsigned long long>(reader.SilentFrames()),
+        static_cast<unsigned long long>(reader.Records()));
+    for (size_t i = 0; i < regions.size(); i++)
+    {
+        printf("%s{\"frame\":%llu,\"frames\":%llu,\"startSeconds\":%.3f,\"seconds\":%.3f,\"wallTimeNs\":%lld}", i != 0 ? "," : "",
+            static_cast<unsigned long long>(regions[i].Frame),
+            static_cast<unsigned long long>(regions[i].Frames),
+            static_cast<double>(regions[i].Frame) / sampleRate,
+            static_cast<double>(regions[i].Frames) / sampleRate,
+            static_cast<long long>(regions[i].WallTimeNs));
+    }
+    printf("]}\n");
+    return true;
+}
+
+// Function to expand a silence collapsed recording back into a PCM or WAV file
+bool ExpandSilenceFile(const std::string& fileName, const std::string& outputFileName)
+{
+    CSilenceFileReader reader;
+    if (!reader.Open(fileName))
+    {
+        return false;
+    }
+
+    std::unique_ptr<IOutputSink> sink;
+    if (outputFileName.size() >= 4 && outputFileName.compare(outputFileName.size() - 4, 4, ".wav") == 0)
+    {
+        CWavFileSink* wavSink = new CWavFileSink();
+        sink.reset(wavSink);
+        if (!wavSink->Open(outputFileName, reader.Format()))
+        {
+            return false;
+        }
+    }
+    else
+    {
+        CPcmFileSink* pcmSink = new CPcmFileSink();
+        sink.reset(pcmSink);
+        if (!pcmSink->Open(outputFileName))
+        {
+            return false;
+        }
+    }
+
+    size_t frameSize = reader.Format()->nBlockAlign;
+    size_t blockFrames = std::max<size_t>(reader.Format()->nSamplesPerSec, 1);
+    std::vector<uint8_t> block(blockFrames * frameSize);
+    for (uint64_t frame = 0; frame < reader.Frames();)
+    {
+        size_t frames = reader.Read(frame, &block[0], blockFrames);
+        if (frames == 0 || !sink->Write(&block[0], frames * frameSize))
+        {
+            fprintf(stderr, "Failed to expand %s\n", fileName.c_str());
+            sink->Close();
+            return false;
+        }
+        frame += frames;
+    }
+    if (!sink->Close())
+    {
+        return false;
+    }
+    fprintf(stderr, "Expanded %llu frames (%llu silent) from %llu records into %s\n",
+        static_cast<unsigned long long>(reader.Frames()),
+        static_cast<unsigned long long>(reader.SilentFrames()),
+        static_cast<unsigned long long>(reader.Records()),
+        outputFileName.c_str());
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    // Register signal handler for Ctrl+C
+    signal(SIGINT, signalHandler);
+    
+    // Fix up the header of a WAV file left behind by an interrupted recording, then exit
+    std::string repairFilePath = GetCommandLineArgString(argc, argv, "--repair-wav", "");
+    if (!repairFilePath.empty())
+    {
+        return RepairWavFile(repairFilePath) ? 0 : 1;
+    }
+
+    // Look up a capture time in a recording's time index, then exit
+    std::string indexFindPath = GetCommandLineArgString(argc, argv, "--index-find", "");
+    if (!indexFindPath.empty())
+    {
+        return FindIndexTime(indexFindPath, GetCommandLineArgString(argc, argv, "--at", "")) ? 0 : 1;
+    }
+
+    // List the sound in a silence collapsed recording, or expand it back into a PCM or WAV file, then exit
+    std::string silenceRegionsPath = GetCommandLineArgString(argc, argv, "--silence-regions", "");
+    if (!silenceRegionsPath.empty())
+    {
+        return PrintSilenceRegions(silenceRegionsPath) ? 0 : 1;
+    }
+    std::string silenceExpandPath = GetCommandLineArgString(argc, argv, "--silence-expand", "");
+    if (!silenceExpandPath.empty())
+    {
+        std::string expandOutputPath = GetCommandLineArgString(argc, argv, "--output", "");
+        if (expandOutputPath.empty())
+        {
+            fprintf(stderr, "--silence-expand needs --output <file.pcm|file.wav>.\n");
+            return 1;
+        }
+        return ExpandSilenceFile(silenceExpandPath, expandOutputPath) ? 0 : 1;
+    }
+    
+    // Parse command line arguments
+    int bufferIntervalMs = GetCommandLineArgInt(argc, argv, "--interval", 100);
+    if (bufferIntervalMs <= 0) {
+        fprintf(stderr, "Invalid interval value. Using default: 100ms\n");
+        bufferIntervalMs = 100;
+    }
+    
+    // Get output file path from command line or use default
+    std::string outputFilePath = GetCommandLineArgString(argc, argv, "--output", "cache.pcm");
+
+    // Shared memory output has no file; readers attach to the ring by name instead
+    std::string outputName = outputFilePath;
+    if (GetCommandLineArgString(argc, argv, "--format", "") == "shm") {
+        outputName = "shared memory ring " + GetCommandLineArgString(argc, argv, "--shm-name", "audio_capture");
+    }
+    else if (HasCommandLineArg(argc, argv, "--serve")) {
+        outputName = "socket server " + GetCommandLineArgString(argc, argv, "--serve", "");
+    }
+    else if (outputFilePath == "-") {
+        outputName = "stdout";
+    }
+    else if (HasCommandLineArg(argc, argv, "--fifo")) {
+        outputName = "named pipe " + outputFilePath;
+    }
+
+    // With the audio on stdout, everything else we print - the parameters JSON included - goes to stderr
+    if (outputFilePath == "-" && !COutputPipe::ReserveStdout()) {
+        fprintf(stderr, "Failed to take over stdout for streaming.\n");
+        return 1;
+    }
+    
+    // Optional recording length; 0 records until Ctrl+C
+    int durationSeconds = GetCommandLineArgInt(argc, argv, "--duration", 0);
+    
+    // Portable sources can run faster than real time, in which case we don't pace the writer loop either
+    bool realTime = GetCommandLineArgString(argc, argv, "--speed", "realtime") != "max";
+    
+    // Durability policy of the writer thread; both 0 leaves flushing to the OS until the file is closed
+    int fsyncMs = GetCommandLineArgInt(argc, argv, "--fsync-ms", 1000);
+    int fsyncKb = GetCommandLineArgInt(argc, argv, "--fsync-kb", 0);
+    int writeBlockKb = GetCommandLineArgInt(argc, argv, "--write-block-kb", 1024);
+    int writeBlocks = GetCommandLineArgInt(argc, argv, "--write-blocks", 8);
+    if (fsyncMs < 0 || fsyncKb < 0 || writeBlockKb <= 0 || writeBlocks < 2) {
+        fprintf(stderr, "Invalid writer parameters.\n");
+        return 1;
+    }
+    
+    // Print welcome message
+    fprintf(stderr, "Simple Audio Capture Tool (Based on WASAPI)\n");
+    fprintf(stderr, "------------------------------------------\n");
+    fprintf(stderr, "Recording will continue until you press Ctrl+C to stop\n");
+    fprintf(stderr, "Buffer interval: %d ms\n", bufferIntervalMs);
+    fprintf(stderr, "Output file: %s\n\n", outputName.c_str());
+    
+    // Create and initialize the capture source
+    ICaptureSource* source = CreateCaptureSource(argc, argv);
+    if (!source)
+    {
+        fprintf(stderr, "Failed to create audio capturer.\n");
+#ifdef _WIN32
+        CoUninitialize();
+#endif
+        return 1;
+    }
+
+    std::string kernelName = GetCommandLineArgString(argc, argv, "--convert-kernel", "avx2");
+    SampleConvertKernel maxKernel = kernelName == "scalar" ? SampleKernelScalar : kernelName == "sse2" ? SampleKernelSse2 : SampleKernelAvx2;
+    CaptureProcessing processing = {};
+
+    // Lost audio is left out and marked by default; filling it with silence keeps the file on the capture timeline
+    std::string gapPolicyName = GetCommandLineArgString(argc, argv, "--gaps", "mark");
+    if (gapPolicyName != "mark" && gapPolicyName != "fill")
+    {
+        fprintf(stderr, "Unknown gap policy %s, use mark or fill.\n", gapPolicyName.c_str());
+        return ShutdownCaptureSource(&source, 1);
+    }
+    processing.GapPolicy = gapPolicyName == "fill" ? CaptureGapFill : CaptureGapMark;
+
+    // Histograms are only recorded when metrics are exported
+    std::string metricsFile = GetCommandLineArgString(argc, argv, "--metrics", "");
+    std::string metricsPromFile = GetCommandLineArgString(argc, argv, "--metrics-prom", "");
+    int metricsMs = GetCommandLineArgInt(argc, argv, "--metrics-ms", 10000);
+    std::unique_ptr<CCaptureMetrics> metrics;
+    if (!metricsFile.empty() || !metricsPromFile.empty())
+    {
+        if (metricsMs <= 0)
+        {
+            fprintf(stderr, "--metrics-ms must be positive.\n");
+            return ShutdownCaptureSource(&source, 1);
+        }
+        metrics.reset(new CCaptureMetrics());
+        processing.Histograms = metrics->DrainHistograms();
+    }
+
+    // Keep our own copy of the starting format; the source's changes if a stream switch reopens it on another format
+    WAVEFORMATEXTENSIBLE sourceFormat;
+    memset(&sourceFormat, 0, sizeof(sourceFormat));
+    memcpy(&sourceFormat, source->MixFormat(), std::min(sizeof(sourceFormat), sizeof(WAVEFORMATEX) + source->MixFormat()->cbSize));
+    const WAVEFORMATEX* captureFormat = &sourceFormat.Format;
+
+    // Optionally drop or mix down channels first, so nothing downstream handles channels we won't keep
+    CChannelRemixer remixer;
+    std::vector<float> remixMatrix;
+    WORD remixChannels = 0;
+    DWORD remixChannelMask = 0;
+    bool remixRequested;
+    if (!BuildRemixMatrix(argc, argv, captureFormat, &remixMatrix, &remixChannels, &remixChannelMask, &remixRequested) && remixRequested)
+    {
+        return ShutdownCaptureSource(&source, 1);
+    }
+    if (remixRequested)
+    {
+        if (!remixer.Initialize(captureFormat, &remixMatrix[0], remixChannels, remixChannelMask, 1024, maxKernel))
+        {
+            return ShutdownCaptureSource(&source, 1);
+        }
+        fprintf(stderr, "Channel remix: %u -> %u channels (mask 0x%x), %s%s\n", captureFormat->nChannels, remixChannels,
+            static_cast<unsigned>(remixChannelMask), remixer.IsSelection() ? "channel selection" : SampleConvertKernelName(remixer.Kernel()),
+            remixer.IsSelection() ? "" : " kernel");
+        processing.Remixer = &remixer;
+        captureFormat = remixer.OutputFormat();
+    }
+
+    // Optionally resample to a fixed rate on the capture thread
+    CResampler resampler;
+    int resampleRate = GetCommandLineArgInt(argc, argv, "--resample", 0);
+    if (resampleRate > 0)
+    {
+        std::string qualityName = GetCommandLineArgString(argc, argv, "--resample-quality", "medium");
+        ResamplerQuality quality = qualityName == "low" ? ResamplerQualityLow : qualityName == "high" ? ResamplerQualityHigh : ResamplerQualityMedium;
+        if ((qualityName != "low" && qualityName != "medium" && qualityName != "high") ||
+            !resampler.Initialize(captureFormat, static_cast<uint32_t>(resampleRate), quality, 1024, maxKernel))
+        {
+            fprintf(stderr, "Can't resample to %d Hz with quality %s.\n", resampleRate, qualityName.c_str());
+            return ShutdownCaptureSource(&source, 1);
+        }
+        fprintf(stderr, "Resampling: %u Hz -> %d Hz, %s quality, %u phases x %u taps, %s kernel\n", captureFormat->nSamplesPerSec,
+            resampleRate, qualityName.c_str(), resampler.Phases(), resampler.TapsPerPhase(), SampleConvertKernelName(resampler.Kernel()));
+        processing.Resampler = &resampler;
+        captureFormat = resampler.OutputFormat();
+    }
+
+    // Optionally meter the levels on the capture thread, on the float samples the converter is about to take.  The
+    // readings are printed by a thread of their own, every --levels-ms.
+    CLevelMeter meter;
+    bool levels = HasCommandLineArg(argc, argv, "--levels") || HasCommandLineArg(argc, argv, "--true-peak");
+    int levelsMs = GetCommandLineArgInt(argc, argv, "--levels-ms", bufferIntervalMs);
+    if (levels)
+    {
+        if (levelsMs <= 0)
+        {
+            fprintf(stderr, "--levels-ms must be positive.\n");
+            return ShutdownCaptureSource(&source, 1);
+        }
+        uint32_t levelFrames = static_cast<uint32_t>(static_cast<uint64_t>(captureFormat->nSamplesPerSec) * levelsMs / 1000);
+        if (!meter.Initialize(captureFormat, levelFrames != 0 ? levelFrames : 1, HasCommandLineArg(argc, argv, "--true-peak"), maxKernel))
+        {
+            return ShutdownCaptureSource(&source, 1);
+        }
+        fprintf(stderr, "Level meter: every %d ms, %s kernel%s\n", levelsMs, SampleConvertKernelName(meter.Kernel()),
+            meter.HasTruePeak() ? ", 4x oversampled true peak" : "");
+        processing.Meter = &meter;
+    }
+
+    // Optionally convert the samples on the capture thread, on their way into the ring
+    CSampleConverter converter;
+    std::string sampleFormatName = GetCommandLineArgString(argc, argv, "--sample-format", "");
+    if (!sampleFormatName.empty())
+    {
+        bool outputFloat;
+        WORD outputBits;
+        if (!ParseSampleFormat(sampleFormatName, &outputFloat, &outputBits) ||
+            !converter.Initialize(captureFormat, outputFloat, outputBits, HasCommandLineArg(argc, argv, "--dither"), maxKernel))
+        {
+            fprintf(stderr, "Invalid sample format: %s\n", sampleFormatName.c_str());
+            return ShutdownCaptureSource(&source, 1);
+        }
+        fprintf(stderr, "Sample format: %s%s, %s kernel\n", sampleFormatName.c_str(),
+            HasCommandLineArg(argc, argv, "--dither") ? " with TPDF dither" : "", SampleConvertKernelName(converter.Kernel()));
+        processing.Converter = &converter;
+        captureFormat = converter.OutputFormat();
+    }
+    
+    // Print audio parameters in JSON format immediately after initialization to stdout
+    // Note we don't add any labels or explanations, just the pure JSON
+    PrintAudioParameters(captureFormat);
+    
+    // A multi source's inputs go side by side into one recording, or each into a file of its own
+    CMultiCaptureSource* multiSource = dynamic_cast<CMultiCaptureSource*>(source);
+    std::string multiOutput = GetCommandLineArgString(argc, argv, "--multi-output", "interleave");
+    if ((multiOutput != "interleave" && multiOutput != "split") || (multiOutput == "split" && (multiSource == NULL || remixRequested)))
+    {
+        fprintf(stderr, "--multi-output takes interleave or split; split needs --sources and no channel remix.\n");
+        return ShutdownCaptureSource(&source, 1);
+    }
+
+    // Create output file; a WAV header needs the capture format
+    CCapturePacketLog packetLog;
+    packetLog.Initialize(16384);
+    std::unique_ptr<IOutputSink> outputSink(multiOutput == "split" ?
+        CreateSplitOutputSink(argc, argv, outputFilePath, captureFormat, multiSource) :
+        CreateOutputSink(argc, argv, outputFilePath, captureFormat, &packetLog));
+
+    // The framed stream labels its blocks with the packet flags and capture times the drain logs
+    CStreamSink* streamSink = dynamic_cast<CStreamSink*>(outputSink.get());
+    if (streamSink != NULL)
+    {
+        processing.PacketLog = &packetLog;
+    }
+
+    // So do segmented recordings, for the start time of each segment, and the silence collapsed file, which also takes packets the device flagged as silent without looking at them
+    CSilenceFileSink* silenceSink = dynamic_cast<CSilenceFileSink*>(outputSink.get());
+    CSegmentedSink* segmentedSink = dynamic_cast<CSegmentedSink*>(outputSink.get());
+    if (silenceSink != NULL || segmentedSink != NULL)
+    {
+        processing.PacketLog = &packetLog;
+    }
+
+    // Raw files can get a sidecar index of byte offsets and capture times, built from the same packet log
+    CTimeIndexWriter timeIndex;
+    bool indexed = HasCommandLineArg(argc, argv, "--index");
+    if (indexed && outputSink)
+    {
+        int indexMs = GetCommandLineArgInt(argc, argv, "--index-ms", 1000);
+        bool isWavSink = dynamic_cast<CWavFileSink*>(outputSink.get()) != NULL;
+        bool isRawSink = isWavSink || dynamic_cast<CPcmFileSink*>(outputSink.get()) != NULL ||
+            dynamic_cast<CDirectPcmFileSink*>(outputSink.get()) != NULL;
+        uint8_t wavHeader[WAV_HEADER_MAX_SIZE];
+        uint64_t dataOffset = isWavSink ? BuildWavHeader(captureFormat, 0, wavHeader) : 0;
+        uint32_t indexFrames = static_cast<uint32_t>(static_cast<uint64_t>(captureFormat->nSamplesPerSec) * indexMs / 1000);
+        if (!isRawSink || indexMs <= 0)
+        {
+            fprintf(stderr, "--index needs pcm or wav output and a positive --index-ms.\n");
+            outputSink.reset();
+        }
+        else if (!timeIndex.Open(outputFilePath + ".idx", captureFormat, dataOffset, indexFrames != 0 ? indexFrames : 1, &packetLog))
+        {
+            outputSink.reset();
+        }
+        else
+        {
+            fprintf(stderr, "Time index: %s.idx, every %d ms\n", outputFilePath.c_str(), indexMs);
+            processing.PacketLog = &packetLog;
+        }
+    }
+    
+    // All file I/O happens on the writer thread, so a slow disk can't stall the loop below
+    DurabilityPolicy durability;
+    durability.FlushIntervalMs = static_cast<uint32_t>(fsyncMs);
+    durability.FlushBytes = static_cast<uint64_t>(fsyncKb) * 1024;
+    CAsyncWriter writer;
+    if (!outputSink ||
+        !writer.Initialize(outputSink.get(), static_cast<size_t>(writeBlockKb) * 1024, static_cast<size_t>(writeBlocks), durability,
+            metrics ? metrics->WriterHistograms() : NULL))
+    {
+        return ShutdownCaptureSource(&source, 1);
+    }
+    
+    fprintf(stderr, "Will save to: %s\n", outputName.c_str());
+    
+    // Define ring size to accumulate data for the interval duration
+    // We'll make the ring large to ensure it won't overflow
+    const double safetyFactor = 2.0; // 2x safety factor
+    const double bufferDurationInSeconds = (bufferIntervalMs / 1000.0) * safetyFactor;
+    size_t bufferFrames = static_cast<size_t>(captureFormat->nSamplesPerSec * bufferDurationInSeconds);
+    if (multiSource != NULL)
+    {
+        // Plus the backlog a multi source catches up on after waiting for a late input
+        bufferFrames += static_cast<size_t>(static_cast<uint64_t>(multiSource->MaxWaitFrames()) * captureFormat->nSamplesPerSec /
+            multiSource->MixFormat()->nSamplesPerSec);
+    }
+    CCaptureRingBuffer ringBuffer;
+    
+    if (!ringBuffer.Initialize(bufferFrames, captureFormat->nBlockAlign))
+    {
+        fprintf(stderr, "Failed to allocate capture buffer.\n");
+        return ShutdownCaptureSource(&source, 1);
+    }
+    
+    // Start capturing - we'll only call Start once
+    if (!source->Start(&ringBuffer, &processing))
+    {
+        fprintf(stderr, "Failed to start audio capture.\n");
+        return ShutdownCaptureSource(&source, 1);
+    }
+    
+    // The exporter has its own thread and only reads the pipeline's atomics, so it can't hold up capture.  The drain
+    // and the writer keep recording into the histograms even if it couldn't start.
+    if (metrics)
+    {
+        if (!metrics->Start(metricsFile, metricsPromFile, static_cast<uint32_t>(metricsMs), source, &writer))
+        {
+            fprintf(stderr, "Metrics are not exported.\n");
+        }
+        else
+        {
+            fprintf(stderr, "Metrics: every %d ms%s%s%s%s\n", metricsMs, metricsFile.empty() ? "" : ", JSON lines to ",
+                metricsFile.c_str(), metricsPromFile.empty() ? "" : ", Prometheus text file ", metricsPromFile.c_str());
+        }
+    }
+
+    // A source running ahead of real time publishes readings faster than --levels-ms, so they are picked up every
+    // millisecond instead
+    LevelPrinterControl levelPrinter;
+    levelPrinter.Stopping = false;
+    std::thread levelThread;
+    if (levels)
+    {
+        levelThread = std::thread(PrintLevelsUntilStopped, &meter, captureFormat->nSamplesPerSec, realTime ? levelsMs : 1,
+            &levelPrinter);
+    }
+
+    fprintf(stderr, "Recording... Press Ctrl+C to stop\n");
+    fprintf(stderr, "Buffer size: %zu bytes (%.3f seconds of audio)\n", bufferFrames * captureFormat->nBlockAlign,
+        static_cast<double>(bufferFrames) / captureFormat->nSamplesPerSec);
+    
+    int totalSeconds = 0;
+    size_t framesWritten = 0;
+    uint64_t totalFramesWritten = 0;
+    CaptureDrainStats faultStats;
+    memset(&faultStats, 0, sizeof(faultStats));
+    
+    // Main recording loop
+    while (g_running)
+    {
+        // Wait for the specified interval.  A source running ahead of real time is only waited on briefly when it
+        // hasn't published anything yet, since writing no longer slows this loop down.
+        if (realTime)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(bufferIntervalMs));
+        }
+        else if (framesWritten == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        
+        // Queue everything the capture thread has published so far
+        if (!DrainRingToWriter(&writer, &ringBuffer, &framesWritten))
+        {
+            fprintf(stderr, "\nFailed to write audio data.\n");
+            break;
+        }
+        
+        totalFramesWritten += framesWritten;
+        if (indexed && !timeIndex.Update(totalFramesWritten))
+        {
+            break;
+        }
+
+        // The segment ends after what was just queued
+        if (g_rotateSegment && segmentedSink != NULL)
+        {
+            g_rotateSegment = false;
+            segmentedSink->RequestRotation();
+        }
+        
+        // A finite source (file replay) has delivered everything
+        if (source->IsFinished() && ringBuffer.ReadableFrames() == 0)
+        {
+            break;
+        }
+        
+        // Update display every second of captured audio
+        if (totalFramesWritten >= static_cast<uint64_t>(totalSeconds + 1) * captureFormat->nSamplesPerSec) {
+            totalSeconds++;
+            fprintf(stderr, "\rRecording: %d seconds", totalSeconds);
+
+            // Report new faults as they happen, on their own line
+            CaptureDrainStats drainStats;
+            source->GetDrainStats(&drainStats);
+            if (drainStats.Glitches != faultStats.Glitches || drainStats.DiscardedFrames != faultStats.DiscardedFrames ||
+                drainStats.SilentPackets != faultStats.SilentPackets || drainStats.LateWakeups != faultStats.LateWakeups)
+            {
+                fprintf(stderr, "\n");
+                PrintCaptureFaults(&drainStats);
+                faultStats = drainStats;
+            }
+            if (durationSeconds > 0 && totalSeconds >= durationSeconds) {
+                break;
+            }
+        }
+    }
+    
+    // Now that we're done, stop the capturer and pick up whatever it captured after the last tick
+    source->Stop();
+    while (DrainRingToWriter(&writer, &ringBuffer, &framesWritten))
+    {
+        totalFramesWritten += framesWritten;
+        if (ringBuffer.ReadableFrames() == 0)
+        {
+            break;
+        }
+
+        // The writer's blocks are all queued; let it catch up and queue the rest
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (levelThread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(levelPrinter.Lock);
+            levelPrinter.Stopping = true;
+        }
+        levelPrinter.StopRequested.notify_one();
+        levelThread.join();
+    }
+    if (indexed)
+    {
+        timeIndex.Update(totalFramesWritten);
+        timeIndex.Close();
+        fprintf(stderr, "Time index: %llu entries\n", static_cast<unsigned long long>(timeIndex.Entries()));
+    }
+    if (!writer.Close())
+    {
+        fprintf(stderr, "Failed to write audio data.\n");
+    }
+    if (metrics)
+    {
+        metrics->Stop();
+    }
+    
+    fprintf(stderr, "\nRecording complete. Total duration: %d seconds\n", totalSeconds);
+    fprintf(stderr, "Audio data saved to %s\n", outputName.c_str());
+    
+    CaptureDrainStats drainStats;
+    source->GetDrainStats(&drainStats);
+    fprintf(stderr, "Capture wakeups: %llu, packets drained: %llu (max %u per wakeup), frames moved: %llu\n",
+        static_cast<unsigned long long>(drainStats.Wakeups),
+        static_cast<unsigned long long>(drainStats.PacketsDrained),
+        drainStats.MaxWakeupPackets,
+        static_cast<unsigned long long>(drainStats.FramesMoved));
+    if (drainStats.StreamSwitches != 0)
+    {
+        fprintf(stderr, "Stream switches: %llu, silence inserted: %llu frames, last switch %.1f ms, longest %.1f ms\n",
+            static_cast<unsigned long long>(drainStats.StreamSwitches),
+            static_cast<unsigned long long>(drainStats.SwitchSilenceFrames),
+            drainStats.LastSwitchInHns / 10000.0,
+            drainStats.MaxSwitchInHns / 10000.0);
+    }
+    PrintCaptureFaults(&drainStats);
+
+    if (multiSource != NULL)
+    {
+        // The reference has no drift or offset of its own; silence is what an input had nothing for
+        for (size_t i = 0; i < multiSource->SourceCount(); i++)
+        {
+            MultiCaptureStreamStats streamStats;
+            multiSource->GetStreamStats(i, &streamStats);
+            fprintf(stderr, "Input %zu: drift %+.1f ppm, offset %+.1f us (max %.1f us), %llu resyncs, %llu frames of silence\n", i,
+                streamStats.DriftPpm, streamStats.OffsetUs, streamStats.MaxOffsetUs,
+                static_cast<unsigned long long>(streamStats.Resyncs),
+                static_cast<unsigned long long>(streamStats.SilenceFrames));
+        }
+    }
+    
+    AsyncWriterStats writerStats;
+    writer.GetStats(&writerStats);
+    fprintf(stderr, "Writer: %llu bytes in %llu writes (avg %llu us, max %llu us), %llu flushes (max %llu us), max queue depth %u\n",
+        static_cast<unsigned long long>(writerStats.BytesWritten),
+        static_cast<unsigned long long>(writerStats.Writes),
+        static_cast<unsigned long long>(writerStats.Writes != 0 ? writerStats.TotalWriteLatencyUs / writerStats.Writes : 0),
+        static_cast<unsigned long long>(writerStats.MaxWriteLatencyUs),
+        static_cast<unsigned long long>(writerStats.Flushes),
+        static_cast<unsigned long long>(writerStats.MaxFlushLatencyUs),
+        writerStats.MaxQueueDepth);
+    
+    CFlacFileSink* flacSink = dynamic_cast<CFlacFileSink*>(outputSink.get());
+    if (flacSink != NULL)
+    {
+        // Encode time is summed over the workers, so this is the throughput of a single core
+        FlacEncoderStats flacStats;
+        flacSink->GetStats(&flacStats);
+        double encodeSeconds = flacStats.EncodeTimeUs / 1000000.0;
+        double audioSeconds = static_cast<double>(flacStats.SamplesEncoded) / captureFormat->nSamplesPerSec;
+        fprintf(stderr, "FLAC: %llu frames, %llu -> %llu bytes (ratio %.3f), %.1f MB/s and %.1fx real time per core\n",
+            static_cast<unsigned long long>(flacStats.FramesEncoded),
+            static_cast<unsigned long long>(flacStats.InputBytes),
+            static_cast<unsigned long long>(flacStats.OutputBytes),
+            flacStats.InputBytes != 0 ? static_cast<double>(flacStats.OutputBytes) / flacStats.InputBytes : 0.0,
+            encodeSeconds > 0 ? flacStats.InputBytes / encodeSeconds / 1000000.0 : 0.0,
+            encodeSeconds > 0 ? audioSeconds / encodeSeconds : 0.0);
+    }
+    
+    if (streamSink != NULL)
+    {
+        StreamSinkStats streamStats;
+        streamSink->GetStats(&streamStats);
+        fprintf(stderr, "Stream: %llu blocks, %llu bytes sent, %llu blocks (%llu frames) dropped, waited for the reader %.1f ms (max %.1f ms)\n",
+            static_cast<unsigned long long>(streamStats.BlocksSent),
+            static_cast<unsigned long long>(streamStats.BytesSent),
+            static_cast<unsigned long long>(streamStats.BlocksDropped),
+            static_cast<unsigned long long>(streamStats.FramesDropped),
+            streamStats.BlockedUs / 1000.0,
+            streamStats.MaxBlockedUs / 1000.0);
+        CSocketServerSink* serverSink = dynamic_cast<CSocketServerSink*>(streamSink);
+        if (serverSink != NULL)
+        {
+            SocketServerStats serverStats;
+            serverSink->GetServerStats(&serverStats);
+            fprintf(stderr, "Socket server: %llu clients accepted (max %u at once), %llu rejected, %llu dropped for lagging, %llu skips (%llu bytes), %llu bytes in %llu sends\n",
+                static_cast<unsigned long long>(serverStats.ClientsAccepted),
+                serverStats.MaxClientsConnected,
+                static_cast<unsigned long long>(serverStats.ClientsRejected),
+                static_cast<unsigned long long>(serverStats.ClientsDropped),
+                static_cast<unsigned long long>(serverStats.Skips),
+                static_cast<unsigned long long>(serverStats.SkippedBytes),
+                static_cast<unsigned long long>(serverStats.BytesSent),
+                static_cast<unsigned long long>(serverStats.SendCalls));
+        }
+        if (packetLog.DroppedRecords() != 0)
+        {
+            fprintf(stderr, "Packet log overflowed: %llu records dropped\n", static_cast<unsigned long long>(packetLog.DroppedRecords()));
+        }
+    }
+
+    if (segmentedSink != NULL)
+    {
+        SegmentedSinkStats segmentStats;
+        segmentedSink->GetStats(&segmentStats);
+        fprintf(stderr, "Segments: %llu, %llu rotations waited for the next file, rotation %.1f us on average (max %llu us)\n",
+            static_cast<unsigned long long>(segmentStats.Segments),
+            static_cast<unsigned long long>(segmentStats.Stalls),
+            segmentStats.Segments > 1 ? static_cast<double>(segmentStats.TotalRotationUs) / (segmentStats.Segments - 1) : 0.0,
+            static_cast<unsigned long long>(segmentStats.MaxRotationUs));
+        if (packetLog.DroppedRecords() != 0)
+        {
+            fprintf(stderr, "Packet log overflowed: %llu records dropped\n", static_cast<unsigned long long>(packetLog.DroppedRecords()));
+        }
+    }
+
+    if (silenceSink != NULL)
+    {
+        // Raw size is what pcm output would have written; detection runs on the writer thread
+        SilenceFileStats silenceStats;
+        silenceSink->GetStats(&silenceStats);
+        uint64_t totalFrames = silenceStats.AudioFrames + silenceStats.SilentFrames;
+        uint64_t rawBytes = totalFrames * captureFormat->nBlockAlign;
+        double audioSeconds = static_cast<double>(totalFrames) / captureFormat->nSamplesPerSec;
+        fprintf(stderr, "Silence: %llu of %llu frames collapsed (%.1f%%) into %llu records, %llu audio records, %llu -> %llu bytes (ratio %.3f), detection %.1f us per audio second\n",
+            static_cast<unsigned long long>(silenceStats.SilentFrames),
+            static_cast<unsigned long long>(totalFrames),
+            totalFrames != 0 ? silenceStats.SilentFrames * 100.0 / totalFrames : 0.0,
+            static_cast<unsigned long long>(silenceStats.SilenceRecords),
+            static_cast<unsigned long long>(silenceStats.AudioRecords),
+            static_cast<unsigned long long>(rawBytes),
+            static_cast<unsigned long long>(silenceStats.BytesWritten),
+            rawBytes != 0 ? static_cast<double>(silenceStats.BytesWritten) / rawBytes : 0.0,
+            audioSeconds > 0 ? silenceStats.DetectUs / audioSeconds : 0.0);
+        if (packetLog.DroppedRecords() != 0)
+        {
+            fprintf(stderr, "Packet log overflowed: %llu records dropped\n", static_cast<unsigned long long>(packetLog.DroppedRecords()));
+        }
+    }
+
+#ifdef AUDIO_CAPTURE_HAVE_OPUS
+    COpusFileSink* opusSink = dynamic_cast<COpusFileSink*>(outputSink.get());
+    if (opusSink != NULL)
+    {
+        // The encoder runs on the sink's encoder thread alone, so its real-time factor is also its share of one core
+        OpusEncoderStats opusStats;
+        opusSink->GetStats(&opusStats);
+        double encodeSeconds = opusStats.EncodeTimeUs / 1000000.0;
+        double audioSeconds = opusStats.EncoderRate != 0 ? static_cast<double>(opusStats.SamplesEncoded) / opusStats.EncoderRate : 0.0;
+        fprintf(stderr, "Opus: %llu packets, %llu -> %llu bytes (%.1f kbps), real-time factor %.4f (%.1f%% of one core), "
+            "writer waited %.1f ms for the encoder\n",
+            static_cast<unsigned long long>(opusStats.PacketsEncoded),
+            static_cast<unsigned long long>(opusStats.InputBytes),
+            static_cast<unsigned long long>(opusStats.OutputBytes),
+            audioSeconds > 0 ? opusStats.OutputBytes * 8 / audioSeconds / 1000.0 : 0.0,
+            audioSeconds > 0 ? encodeSeconds / audioSeconds : 0.0,
+            audioSeconds > 0 ? encodeSeconds / audioSeconds * 100.0 : 0.0,
+            opusStats.WriterWaitUs / 1000.0);
+    }
+#endif
+    
+    // Clean up
+    ShutdownCaptureSource(&source, 0);
+    
+    fprintf(stderr, "Program complete.\n");
+    return 0;
+}
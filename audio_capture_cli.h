@@ -1,25 +1,45 @@
 #pragma once
 
 #include <string>
+#include "CaptureSource.h"
+#include "CaptureRingBuffer.h"
+#include "OutputFile.h"
+#include "AsyncWriter.h"
+#include "OutputSink.h"
+
+#ifdef _WIN32
 #include <mmdeviceapi.h>
 #include <audioclient.h>
 #include <audiopolicy.h>
 #include "WASAPICapture.h"
+#endif
 
 // Helper function to write PCM data to a file
-bool WritePcmFile(HANDLE FileHandle, const BYTE* Buffer, const size_t BufferSize);
+bool WritePcmFile(COutputFile* File, const BYTE* Buffer, const size_t BufferSize);
 
-// Function to save PCM audio data to a file
+// Function to save PCM audio data to a WAV file
 void SaveAudioData(BYTE* CaptureBuffer, size_t BufferSize, const WAVEFORMATEX* WaveFormat, std::string fileName);
 
 // Function to append PCM audio data to an existing file
-bool AppendAudioData(HANDLE FileHandle, BYTE* CaptureBuffer, size_t BufferSize);
+bool AppendAudioData(COutputFile* File, BYTE* CaptureBuffer, size_t BufferSize);
+
+// Function to hand all frames published in the capture ring to the writer thread
+bool DrainRingToWriter(CAsyncWriter* Writer, CCaptureRingBuffer* RingBuffer, size_t* FramesWritten);
+
+#ifdef _WIN32
+// Function to set up and initialize the audio capture device: the default endpoint of Flow, or the one Endpoint names
+// by index or ID
+void SetupAudioCapture(IMMDeviceEnumerator*& pEnumerator, IMMDevice*& pDevice, EDataFlow Flow, const std::string& Endpoint);
+#endif
+
+// Function to create the output sink selected on the command line
+IOutputSink* CreateOutputSink(int argc, char* argv[], const std::string& fileName, const WAVEFORMATEX* WaveFormat);
 
-// Function to set up and initialize the audio capture device
-void SetupAudioCapture(IMMDeviceEnumerator*& pEnumerator, IMMDevice*& pDevice);
+// Function to create and initialize the capture source selected on the command line
+ICaptureSource* CreateCaptureSource(int argc, char* argv[]);
 
 // Generate a timestamp string for unique filenames
 std::string GetTimestampString();
 
 // Print audio format parameters in JSON format
-void PrintAudioParameters(const WAVEFORMATEX* WaveFormat); 
\ No newline at end of file
+void PrintAudioParameters(const WAVEFORMATEX* WaveFormat);
@@ -0,0 +1,60 @@
+#!/usr/bin/env python3
+#
+#  Compare two result files of audio_capture_bench and flag regressions.
+#
+#  A result regresses when it moved the wrong way by more than --threshold percent: down for throughputs, up for
+#  latencies.  Results only in one of the files are listed but don't fail the comparison.  Exits with 1 if anything
+#  regressed, so it can gate a CI job:
+#
+#      audio_capture_bench --json baseline.json      (on the base commit)
+#      audio_capture_bench --json current.json
+#      bench_compare.py baseline.json current.json --threshold 5
+#
+import argparse
+import json
+import sys
+
+
+def load_results(file_name):
+    with open(file_name) as file:
+        document = json.load(file)
+    return {result["name"]: result for result in document["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare audio_capture_bench results and flag regressions.")
+    parser.add_argument("baseline", help="results of the earlier run")
+    parser.add_argument("current", help="results of the run to check")
+    parser.add_argument("--threshold", type=float, default=5.0, help="regression threshold in percent (default 5)")
+    arguments = parser.parse_args()
+
+    baseline = load_results(arguments.baseline)
+    current = load_results(arguments.current)
+
+    regressions = 0
+    print("%-28s %14s %14s %9s  %s" % ("benchmark", "baseline", "current", "change", "unit"))
+    for name, result in current.items():
+        if name not in baseline:
+            print("%-28s %14s %14.6g %9s  %s  (new)" % (name, "-", result["value"], "-", result["unit"]))
+            continue
+        before = baseline[name]["value"]
+        after = result["value"]
+        change = (after - before) * 100.0 / before if before != 0 else 0.0
+        worse = -change if result["higherIsBetter"] else change
+        regressed = worse > arguments.threshold
+        regressions += regressed
+        print("%-28s %14.6g %14.6g %+8.1f%%  %s%s" % (name, before, after, change, result["unit"],
+                                                   "  REGRESSION" if regressed else ""))
+    for name in baseline:
+        if name not in current:
+            print("%-28s %14.6g %14s %9s  %s  (missing)" % (name, baseline[name]["value"], "-", "-", baseline[name]["unit"]))
+
+    if regressions:
+        print("%d regression(s) above %g%%." % (regressions, arguments.threshold))
+        return 1
+    print("No regressions above %g%%." % arguments.threshold)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
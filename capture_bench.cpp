@@ -0,0 +1,502 @@
+//
+//  Capture hot path benchmarks on Linux, with machine readable results.
+//
+//  - drain_copy / drain_silent: the capture thread's packet loop, CCaptureDrain moving 10 ms packets of stereo
+//    float from a mock capture client into the ring, copying them or zero filling silent ones.
+//  - ring_handoff: the ring between the capture thread and the main loop, a producer and a consumer thread copying
+//    packets through it flat out; ring_handoff_latency_p50/p99 is how long a committed packet takes to be seen by a
+//    consumer polling for it, measured only with two cores or more.
+//  - file_write / file_write_flush: the PCM file sink writing 1 MB blocks, the writer's block size, with no flush
+//    until the end and with a flush after every block.
+//  - file_write_direct / file_write_direct_flush: the same through the direct I/O sink, staging whole blocks and
+//    preallocating 64 MB extents as --direct-io does.  Its blocks are a little short of 1 MB, so every flush writes
+//    and trims an unaligned tail.
+//  - end_to_end_2ch/8ch/32ch: the synthetic source, unpaced, through the ring and the asynchronous writer into a PCM
+//    file, as the CLI records.
+//  - capture_cpu_per_second: process CPU time per second of audio captured from the synthetic source paced in real
+//    time, its capture thread waking on the clock scheduler and generating the tone, the main loop emptying the ring
+//    every 10 ms.  A capture thread that spins instead of sleeping costs about 1000 ms per second; the run fails
+//    above --max-cpu-ms.
+//
+//  Every benchmark runs --repeat times and reports the median.  The results go out as one JSON document, to stdout
+//  or --json <file>, for bench_compare.py to compare against an earlier run; progress goes to stderr.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "AudioFormat.h"
+#include "CaptureDrain.h"
+#include "SyntheticCaptureSource.h"
+#include "OutputSink.h"
+#include "AsyncWriter.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double ProcessCpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static const uint32_t SampleRate = 48000;
+static const uint32_t PacketFrames = 480;
+
+struct BenchResult
+{
+    std::string     Name;
+    double          Value;
+    const char*     Unit;
+    bool            HigherIsBetter;
+};
+
+//
+//  Runs a benchmark Repeat times and keeps the median.  Run returns the measured value, or a negative number if the
+//  run failed.
+//
+template <typename RunFunction>
+static bool Measure(std::vector<BenchResult>* Results, const std::string& Filter, const std::string& Name, const char* Unit,
+    bool HigherIsBetter, uint32_t Repeat, RunFunction Run)
+{
+    if (!Filter.empty() && Name.find(Filter) == std::string::npos)
+    {
+        return true;
+    }
+    std::vector<double> values;
+    for (uint32_t i = 0; i < Repeat; i++)
+    {
+        double value = Run();
+        if (value < 0)
+        {
+            fprintf(stderr, "%s failed.\n", Name.c_str());
+            return false;
+        }
+        values.push_back(value);
+    }
+    std::sort(values.begin(), values.end());
+    BenchResult result = { Name, values[values.size() / 2], Unit, HigherIsBetter };
+    fprintf(stderr, "%-28s %14.6g %s (%.6g .. %.6g)\n", Name.c_str(), result.Value, Unit, values.front(), values.back());
+    Results->push_back(result);
+    return true;
+}
+
+//
+//  Hands the drain the same packet over and over, PacketsPerWakeup per Drain() call, at consecutive device positions.
+//
+class CBenchPacketClient : public ICapturePacketClient
+{
+public:
+    CBenchPacketClient(size_t FrameSize, uint32_t Flags) : _Data(PacketFrames * FrameSize), _Flags(Flags), _Position(0), _Pending(0)
+    {
+        for (size_t i = 0; i < _Data.size(); i++)
+        {
+            _Data[i] = static_cast<uint8_t>(i * 7 + 1);
+        }
+    }
+
+    void QueuePackets(uint32_t Packets) { _Pending = Packets; }
+
+    bool GetNextPacketSize(uint32_t* Frames)
+    {
+        *Frames = _Pending != 0 ? PacketFrames : 0;
+        return true;
+    }
+
+    bool GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition)
+    {
+        *Data = &_Data[0];
+        *Frames = PacketFrames;
+        *Flags = _Flags;
+        *DevicePosition = _Position;
+        *QPCPosition = 0;
+        return true;
+    }
+
+    bool ReleaseBuffer(uint32_t Frames)
+    {
+        _Position += Frames;
+        _Pending--;
+        return true;
+    }
+
+private:
+    std::vector<uint8_t>    _Data;
+    uint32_t                _Flags;
+    uint64_t                _Position;
+    uint32_t                _Pending;
+};
+
+//
+//  Frames per second through CCaptureDrain, emptying the ring after every wakeup of four packets.
+//
+static double RunDrain(uint32_t Flags, uint64_t Packets)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, 2, SampleRate, 32, 0);
+    CCaptureRingBuffer ring;
+    CCaptureDrain drain;
+    CaptureProcessing processing = {};
+    if (!ring.Initialize(SampleRate, format.Format.nBlockAlign) || !drain.Attach(&ring, &processing, &format.Format))
+    {
+        return -1;
+    }
+    CBenchPacketClient client(format.Format.nBlockAlign, Flags);
+    const uint32_t packetsPerWakeup = 4;
+    int64_t start = SteadyClockNs();
+    for (uint64_t packet = 0; packet < Packets; packet += packetsPerWakeup)
+    {
+        client.QueuePackets(packetsPerWakeup);
+        if (!drain.Drain(&client))
+        {
+            return -1;
+        }
+        CaptureRingRegion regions[2];
+        ring.CommitRead(ring.BeginRead(ring.FrameCapacity(), regions));
+    }
+    double seconds = (SteadyClockNs() - start) / 1e9;
+
+    CaptureDrainStats stats;
+    drain.GetStats(&stats);
+    return stats.DiscardedFrames == 0 ? stats.FramesMoved / seconds : -1;
+}
+
+//
+//  Frames per second copied through the ring by a producer and a consumer thread, each yielding when it can't move
+//  a whole packet.
+//
+static double RunRingThroughput(uint64_t Frames)
+{
+    const size_t frameSize = 8;
+    CCaptureRingBuffer ring;
+    if (!ring.Initialize(SampleRate / 10, frameSize))
+    {
+        return -1;
+    }
+    std::vector<uint8_t> source(PacketFrames * frameSize, 1);
+    std::thread consumer([&ring, Frames, frameSize]
+    {
+        std::vector<uint8_t> destination(PacketFrames * frameSize);
+        uint64_t frames = 0;
+        while (frames < Frames)
+        {
+            size_t read = ring.Read(&destination[0], PacketFrames);
+            if (read == 0)
+            {
+                std::this_thread::yield();
+            }
+            frames += read;
+        }
+    });
+
+    int64_t start = SteadyClockNs();
+    uint64_t written = 0;
+    while (written < Frames)
+    {
+        size_t frames = ring.WritableFrames() >= PacketFrames ? ring.Write(&source[0], PacketFrames) : 0;
+        if (frames == 0)
+        {
+            std::this_thread::yield();
+        }
+        written += frames;
+    }
+    consumer.join();
+    return written / ((SteadyClockNs() - start) / 1e9);
+}
+
+//
+//  Nanoseconds from CommitWrite() of a packet stamped with the time to a polling consumer reading the stamp, one
+//  packet in flight at a time, so it needs a core for each side.  Fills Latencies with one value per packet.
+//
+static bool RunRingLatency(uint32_t Packets, std::vector<int64_t>* Latencies)
+{
+    CCaptureRingBuffer ring;
+    if (!ring.Initialize(SampleRate / 10, 8))
+    {
+        return false;
+    }
+    Latencies->assign(Packets, 0);
+    std::thread consumer([&ring, Packets, Latencies]
+    {
+        for (uint32_t i = 0; i < Packets; i++)
+        {
+            CaptureRingRegion regions[2];
+            while (ring.BeginRead(PacketFrames, regions) < PacketFrames)
+            {
+            }
+            int64_t stamp;
+            memcpy(&stamp, regions[0].Data, sizeof(stamp));
+            (*Latencies)[i] = SteadyClockNs() - stamp;
+            ring.CommitRead(PacketFrames);
+        }
+    });
+
+    std::vector<uint8_t> packet(PacketFrames * 8, 0);
+    for (uint32_t i = 0; i < Packets; i++)
+    {
+        while (ring.WritableFrames() != ring.FrameCapacity())
+        {
+        }
+        CaptureRingRegion regions[2];
+        ring.BeginWrite(PacketFrames, regions);
+        memcpy(regions[0].Data, &packet[0], PacketFrames * 8);
+        int64_t stamp = SteadyClockNs();
+        memcpy(regions[0].Data, &stamp, sizeof(stamp));
+        ring.CommitWrite(PacketFrames);
+    }
+    consumer.join();
+    return true;
+}
+
+static double LatencyPercentile(uint32_t Packets, double Percentile)
+{
+    std::vector<int64_t> latencies;
+    if (!RunRingLatency(Packets, &latencies))
+    {
+        return -1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    return static_cast<double>(latencies[static_cast<size_t>(Percentile / 100 * (latencies.size() - 1))]);
+}
+
+//
+//  MB per second written through CPcmFileSink, or CDirectPcmFileSink, in 1 MB blocks, flushing after every block or
+//  only at the end.
+//
+static double RunFileWrite(const std::string& FileName, uint32_t Megabytes, bool Direct, bool FlushEveryBlock)
+{
+    std::vector<uint8_t> block(Direct ? 1024 * 1024 - 24 : 1024 * 1024, 3);
+    CPcmFileSink pcmSink;
+    CDirectPcmFileSink directSink;
+    IOutputSink* sink = Direct ? static_cast<IOutputSink*>(&directSink) : static_cast<IOutputSink*>(&pcmSink);
+    if (Direct ? !directSink.Open(FileName, 1024 * 1024, 64 * 1024 * 1024) : !pcmSink.Open(FileName))
+    {
+        return -1;
+    }
+    int64_t start = SteadyClockNs();
+    bool succeeded = true;
+    for (uint32_t i = 0; i < Megabytes && succeeded; i++)
+    {
+        succeeded = sink->Write(&block[0], block.size()) && (!FlushEveryBlock || sink->Flush());
+    }
+    succeeded = sink->Flush() && sink->Close() && succeeded;
+    double seconds = (SteadyClockNs() - start) / 1e9;
+    unlink(FileName.c_str());
+    return succeeded ? Megabytes / seconds : -1;
+}
+
+//
+//  Frames per second from the unpaced synthetic source to a PCM file, through the ring and the asynchronous writer
+//  with the CLI's default blocks and flush interval, the main loop polling every millisecond like a short --interval.
+//
+static double RunEndToEnd(const std::string& FileName, uint16_t Channels, uint32_t Seconds)
+{
+    CSyntheticCaptureSource* source = new CSyntheticCaptureSource();
+    if (!source->Initialize(SampleRate, Channels, 32, true, PacketFrames, 0, false))
+    {
+        source->Release();
+        return -1;
+    }
+    CCaptureRingBuffer ring;
+    ring.Initialize(SampleRate, source->FrameSize());
+    CPcmFileSink sink;
+    DurabilityPolicy durability = { 1000, 0 };
+    CAsyncWriter writer;
+    if (!sink.Open(FileName) || !writer.Initialize(&sink, 1024 * 1024, 8, durability))
+    {
+        source->Release();
+        return -1;
+    }
+
+    CaptureProcessing processing = {};
+    int64_t start = SteadyClockNs();
+    if (!source->Start(&ring, &processing))
+    {
+        source->Release();
+        return -1;
+    }
+    const uint64_t totalFrames = static_cast<uint64_t>(Seconds) * SampleRate;
+    uint64_t frames = 0;
+    while (frames < totalFrames && !writer.Failed())
+    {
+        size_t framesToRead = std::min<uint64_t>(writer.WritableBytes() / ring.FrameSize(), totalFrames - frames);
+        CaptureRingRegion regions[2];
+        size_t available = ring.BeginRead(framesToRead, regions);
+        for (int i = 0; i < 2; i++)
+        {
+            if (regions[i].Frames != 0)
+            {
+                writer.Write(regions[i].Data, regions[i].Frames * ring.FrameSize());
+            }
+        }
+        ring.CommitRead(available);
+        writer.Submit();
+        frames += available;
+        if (available == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    source->Stop();
+    bool succeeded = writer.Close() && frames == totalFrames;
+    double seconds = (SteadyClockNs() - start) / 1e9;
+    source->Shutdown();
+    source->Release();
+    unlink(FileName.c_str());
+    return succeeded ? frames / seconds : -1;
+}
+
+//
+//  Milliseconds of process CPU time per second captured from the real time synthetic source, or -1 if the capture
+//  failed or cost more than MaxCpuMs.
+//
+static double RunCaptureCpu(uint32_t Seconds, double MaxCpuMs)
+{
+    CSyntheticCaptureSource* source = new CSyntheticCaptureSource();
+    if (!source->Initialize(SampleRate, 2, 32, true, PacketFrames, 0, true))
+    {
+        source->Release();
+        return -1;
+    }
+    CCaptureRingBuffer ring;
+    ring.Initialize(SampleRate, source->FrameSize());
+    CaptureProcessing processing = {};
+    double cpuStart = ProcessCpuSeconds();
+    if (!source->Start(&ring, &processing))
+    {
+        source->Release();
+        return -1;
+    }
+    const uint64_t totalFrames = static_cast<uint64_t>(Seconds) * SampleRate;
+    uint64_t frames = 0;
+    while (frames < totalFrames)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        CaptureRingRegion regions[2];
+        size_t available = ring.BeginRead(ring.FrameCapacity(), regions);
+        ring.CommitRead(available);
+        frames += available;
+    }
+    source->Stop();
+    double cpuMs = (ProcessCpuSeconds() - cpuStart) * 1000 / (frames / static_cast<double>(SampleRate));
+
+    CaptureDrainStats stats;
+    source->GetDrainStats(&stats);
+    source->Shutdown();
+    source->Release();
+    if (stats.DiscardedFrames != 0 || cpuMs > MaxCpuMs)
+    {
+        fprintf(stderr, "Capture took %.2f ms of CPU per second (limit %.2f), discarding %llu frames.\n", cpuMs, MaxCpuMs,
+            static_cast<unsigned long long>(stats.DiscardedFrames));
+        return -1;
+    }
+    return cpuMs;
+}
+
+static bool WriteResults(const std::string& JsonFile, const std::vector<BenchResult>& Results, uint32_t Repeat)
+{
+    FILE* file = JsonFile.empty() ? stdout : fopen(JsonFile.c_str(), "w");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", JsonFile.c_str());
+        return false;
+    }
+    fprintf(file, "{\n  \"benchmark\": \"audio_capture_bench\",\n  \"time\": %lld,\n  \"repeat\": %u,\n  \"results\": [\n",
+        static_cast<long long>(std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count()),
+        Repeat);
+    for (size_t i = 0; i < Results.size(); i++)
+    {
+        fprintf(file, "    {\"name\": \"%s\", \"value\": %.6g, \"unit\": \"%s\", \"higherIsBetter\": %s}%s\n", Results[i].Name.c_str(),
+            Results[i].Value, Results[i].Unit, Results[i].HigherIsBetter ? "true" : "false", i + 1 < Results.size() ? "," : "");
+    }
+    fprintf(file, "  ]\n}\n");
+    bool succeeded = !ferror(file);
+    if (file != stdout)
+    {
+        succeeded = fclose(file) == 0 && succeeded;
+    }
+    return succeeded;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string jsonFile = GetArg(argc, argv, "--json", "");
+    std::string filter = GetArg(argc, argv, "--filter", "");
+    std::string directory = GetArg(argc, argv, "--dir", "/tmp");
+    uint32_t repeat = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--repeat", "5")));
+    uint32_t packets = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--packets", "400000")));
+    uint32_t fileMb = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--file-mb", "256")));
+    uint32_t seconds = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--seconds", "30")));
+    uint32_t cpuSeconds = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--cpu-seconds", "3")));
+    double maxCpuMs = atof(GetArg(argc, argv, "--max-cpu-ms", "20"));
+    if (repeat == 0 || packets == 0 || fileMb == 0 || seconds == 0 || cpuSeconds == 0 || maxCpuMs <= 0)
+    {
+        fprintf(stderr, "Usage: %s [--json <file>] [--filter <name>] [--dir <directory>] [--repeat N] [--packets N] [--file-mb N] "
+            "[--seconds N] [--cpu-seconds N] [--max-cpu-ms ms]\n", argv[0]);
+        return 1;
+    }
+
+    std::string fileName = directory + "/audio_capture_bench_" + std::to_string(getpid()) + ".pcm";
+    std::vector<BenchResult> results;
+    bool succeeded =
+        Measure(&results, filter, "drain_copy", "frames/s", true, repeat, [&] { return RunDrain(0, packets); }) &&
+        Measure(&results, filter, "drain_silent", "frames/s", true, repeat,
+            [&] { return RunDrain(CAPTURE_PACKET_FLAG_SILENT, packets); }) &&
+        Measure(&results, filter, "ring_handoff", "frames/s", true, repeat,
+            [&] { return RunRingThroughput(static_cast<uint64_t>(packets) * PacketFrames); }) &&
+        Measure(&results, filter, "file_write", "MB/s", true, repeat, [&] { return RunFileWrite(fileName, fileMb, false, false); }) &&
+        Measure(&results, filter, "file_write_flush", "MB/s", true, repeat,
+            [&] { return RunFileWrite(fileName, fileMb, false, true); }) &&
+        Measure(&results, filter, "file_write_direct", "MB/s", true, repeat,
+            [&] { return RunFileWrite(fileName, fileMb, true, false); }) &&
+        Measure(&results, filter, "file_write_direct_flush", "MB/s", true, repeat,
+            [&] { return RunFileWrite(fileName, fileMb, true, true); });
+
+    //
+    //  With a single core the consumer only sees a packet once the producer's time slice is up.
+    //
+    if (succeeded && std::thread::hardware_concurrency() >= 2)
+    {
+        succeeded =
+            Measure(&results, filter, "ring_handoff_latency_p50", "ns", false, repeat,
+                [&] { return LatencyPercentile(packets / 10, 50); }) &&
+            Measure(&results, filter, "ring_handoff_latency_p99", "ns", false, repeat,
+                [&] { return LatencyPercentile(packets / 10, 99); });
+    }
+
+    const uint16_t channels[] = { 2, 8, 32 };
+    for (int i = 0; i < 3 && succeeded; i++)
+    {
+        succeeded = Measure(&results, filter, "end_to_end_" + std::to_string(channels[i]) + "ch", "frames/s", true, repeat,
+            [&] { return RunEndToEnd(fileName, channels[i], seconds); });
+    }
+    succeeded = succeeded && Measure(&results, filter, "capture_cpu_per_second", "ms/s", false, repeat,
+        [&] { return RunCaptureCpu(cpuSeconds, maxCpuMs); });
+
+    if (!succeeded || !WriteResults(jsonFile, results, repeat))
+    {
+        return 1;
+    }
+    return 0;
+}
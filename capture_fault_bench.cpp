@@ -0,0 +1,346 @@
+//
+//  Capture fault accounting test on Linux.
+//
+//  A mock capture client feeds the drain 10 ms packets of mono 32 bit PCM on a synthetic device clock, with every
+//  frame holding its device position plus one, and injects faults at random: device gaps (a position jump, a
+//  discontinuity flag, or both), silent packets, late wakeups that find several packets queued, and consumer stalls
+//  that overflow a small ring.  The run is repeated under both gap policies, and the drain's counters must match
+//  what was injected exactly:
+//
+//  - mark: every frame read is where the packet log says it is, counting each record's GapFrames, and the
+//    GapFrames add up to the frames the device skipped plus the frames the drain discarded.
+//  - fill: every frame read sits at its device position, so the output is exactly as long as the device timeline;
+//    the silent packets are zeros, and the silence filled in accounts for every frame skipped or discarded.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <random>
+#include <vector>
+#include "CaptureDrain.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static const uint32_t SampleRate = 48000;
+static const uint32_t PacketFrames = 480;
+static const int64_t PeriodInHns = 100000;
+
+//
+//  Delivers the packets queued on it, like an engine does between wakeups.
+//
+class CMockPacketClient : public ICapturePacketClient
+{
+public:
+    struct Packet
+    {
+        uint64_t    Position;
+        uint32_t    Flags;
+        int64_t     QPCPosition;
+    };
+
+    void Queue(const Packet& NewPacket) { _Packets.push_back(NewPacket); }
+
+    bool GetNextPacketSize(uint32_t* Frames)
+    {
+        *Frames = _Packets.empty() ? 0 : PacketFrames;
+        return true;
+    }
+
+    bool GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition)
+    {
+        //
+        //  Silent packets get the pattern too, so the drain has to zero them rather than copy them.
+        //
+        const Packet& packet = _Packets.front();
+        _Data.resize(PacketFrames);
+        for (uint32_t i = 0; i < PacketFrames; i++)
+        {
+            _Data[i] = static_cast<uint32_t>(packet.Position + i + 1);
+        }
+        *Data = reinterpret_cast<uint8_t*>(&_Data[0]);
+        *Frames = PacketFrames;
+        *Flags = packet.Flags;
+        *DevicePosition = packet.Position;
+        *QPCPosition = static_cast<uint64_t>(packet.QPCPosition);
+        return true;
+    }
+
+    bool ReleaseBuffer(uint32_t /*Frames*/)
+    {
+        _Packets.pop_front();
+        return true;
+    }
+
+private:
+    std::deque<Packet>      _Packets;
+    std::vector<uint32_t>   _Data;
+};
+
+struct InjectedFaults
+{
+    uint64_t    Glitches;
+    uint64_t    GlitchFrames;
+    uint64_t    SilentPackets;
+    uint64_t    LateWakeups;
+    uint64_t    Stalls;
+    uint64_t    FramesDelivered;
+};
+
+//
+//  Reads the ring and checks every frame.  Under CaptureGapMark the expected word follows the device position
+//  through the packet log; under CaptureGapFill it is the ring position itself, and frames of the silent packets,
+//  whose device positions are in SilentPositions, must be zeros.
+//
+class CFaultChecker
+{
+public:
+    CFaultChecker(CaptureGapPolicy Policy, CCaptureRingBuffer* Ring, CCapturePacketLog* PacketLog, const std::vector<uint64_t>* SilentPositions) :
+        _Policy(Policy), _Ring(Ring), _PacketLog(PacketLog), _SilentPositions(SilentPositions), _NextSilent(0), _Frame(0), _Expected(0),
+        _GapFrames(0), _Zeros(0), _Errors(0)
+    {
+        memset(&_Record, 0, sizeof(_Record));
+    }
+
+    void Read()
+    {
+        CaptureRingRegion regions[2];
+        size_t frames = _Ring->BeginRead(_Ring->FrameCapacity(), regions);
+        for (int region = 0; region < 2; region++)
+        {
+            const uint32_t* words = reinterpret_cast<const uint32_t*>(regions[region].Data);
+            for (size_t i = 0; i < regions[region].Frames; i++)
+            {
+                Check(words[i]);
+            }
+        }
+        _Ring->CommitRead(frames);
+    }
+
+    uint64_t FramesRead() const { return _Frame; }
+    uint64_t GapFrames() const { return _GapFrames; }
+    uint64_t Zeros() const { return _Zeros; }
+    uint64_t Errors() const { return _Errors; }
+
+private:
+    void Check(uint32_t Word)
+    {
+        _Zeros += Word == 0;
+        if (_Policy == CaptureGapFill)
+        {
+            while (_NextSilent < _SilentPositions->size() && (*_SilentPositions)[_NextSilent] + PacketFrames <= _Frame)
+            {
+                _NextSilent++;
+            }
+            bool silent = _NextSilent < _SilentPositions->size() && (*_SilentPositions)[_NextSilent] <= _Frame;
+            if (Word != 0 && (silent || Word != static_cast<uint32_t>(_Frame + 1)))
+            {
+                Error(Word, silent ? 0 : static_cast<uint32_t>(_Frame + 1));
+            }
+            _Frame++;
+            return;
+        }
+
+        if (_Frame >= _Record.Frame + _Record.Frames)
+        {
+            if (!_PacketLog->Lookup(_Frame, &_Record) || _Record.Frame != _Frame)
+            {
+                printf("No packet record starts at frame %llu\n", static_cast<unsigned long long>(_Frame));
+                _Errors++;
+                _Record.Frame = _Frame;
+                _Record.Frames = 1;
+                _Record.Flags = 0;
+                _Record.GapFrames = 0;
+            }
+            if ((_Record.Flags & CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY) != 0)
+            {
+                _Expected += _Record.GapFrames;
+                _GapFrames += _Record.GapFrames;
+            }
+        }
+        uint32_t expected = (_Record.Flags & CAPTURE_PACKET_FLAG_SILENT) != 0 ? 0 : static_cast<uint32_t>(_Expected + 1);
+        if (Word != expected)
+        {
+            Error(Word, expected);
+        }
+        _Expected++;
+        _Frame++;
+    }
+
+    void Error(uint32_t Word, uint32_t Expected)
+    {
+        if (_Errors++ < 5)
+        {
+            printf("Frame %llu: got %u, expected %u\n", static_cast<unsigned long long>(_Frame), Word, Expected);
+        }
+    }
+
+    CaptureGapPolicy        _Policy;
+    CCaptureRingBuffer*     _Ring;
+    CCapturePacketLog*      _PacketLog;
+    const std::vector<uint64_t>* _SilentPositions;
+    size_t                  _NextSilent;
+    CapturePacketRecord     _Record;
+    uint64_t                _Frame;
+    uint64_t                _Expected;
+    uint64_t                _GapFrames;
+    uint64_t                _Zeros;
+    uint64_t                _Errors;
+};
+
+static bool RunFaults(CaptureGapPolicy Policy, uint32_t Wakeups, uint32_t Seed)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, false, 1, SampleRate, 32, 0);
+    CCaptureRingBuffer ring;
+    CCapturePacketLog packetLog;
+    ring.Initialize(4096, format.Format.nBlockAlign);
+    packetLog.Initialize(4096);
+
+    CSyntheticCaptureClock clock;
+    clock.Advance(10000000);
+    CCaptureDrain drain;
+    CaptureProcessing processing = {};
+    processing.PacketLog = &packetLog;
+    processing.GapPolicy = Policy;
+    if (!drain.Attach(&ring, &processing, &format.Format, &clock, PeriodInHns))
+    {
+        return false;
+    }
+
+    CMockPacketClient client;
+    std::vector<uint64_t> silentPositions;
+    CFaultChecker checker(Policy, &ring, &packetLog, &silentPositions);
+    InjectedFaults injected;
+    memset(&injected, 0, sizeof(injected));
+    std::mt19937 random(Seed);
+    uint64_t position = 0;
+    uint32_t stallWakeups = 0;
+    uint64_t silentFrames = 0;
+
+    //
+    //  The last 100 wakeups are clean, so the ring drains and whatever is still owed is logged or filled.
+    //
+    for (uint32_t wakeup = 0; wakeup < Wakeups + 100; wakeup++)
+    {
+        bool faults = wakeup < Wakeups;
+        uint32_t packets = 1;
+        if (faults && random() % 50 == 0)
+        {
+            packets = 3;
+            injected.LateWakeups++;
+        }
+        clock.Advance(packets * PeriodInHns);
+
+        for (uint32_t i = 0; i < packets; i++)
+        {
+            CMockPacketClient::Packet packet;
+            packet.Flags = 0;
+            uint32_t fault = faults ? random() % 100 : 100;
+            if (fault < 3)
+            {
+                //
+                //  A device gap: the position jumps, and the packet is flagged unless fault is 2.
+                //
+                uint64_t skipped = 1 + random() % 2000;
+                position += skipped;
+                injected.GlitchFrames += skipped;
+                packet.Flags = fault == 2 ? 0 : CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY;
+                injected.Glitches++;
+            }
+            else if (fault == 3)
+            {
+                //
+                //  A glitch the device can't say the length of.
+                //
+                packet.Flags = CAPTURE_PACKET_FLAG_DATA_DISCONTINUITY;
+                injected.Glitches++;
+            }
+            else if (fault < 7)
+            {
+                packet.Flags = CAPTURE_PACKET_FLAG_SILENT;
+                injected.SilentPackets++;
+                silentFrames += PacketFrames;
+                silentPositions.push_back(position);
+            }
+            packet.Position = position;
+            packet.QPCPosition = clock.Now() - (packets - i) * PeriodInHns;
+            client.Queue(packet);
+            position += PacketFrames;
+            injected.FramesDelivered += PacketFrames;
+        }
+        drain.Drain(&client);
+
+        if (faults && stallWakeups == 0 && random() % 200 == 0)
+        {
+            stallWakeups = 5 + random() % 20;
+            injected.Stalls++;
+        }
+        if (stallWakeups != 0)
+        {
+            stallWakeups--;
+        }
+        else
+        {
+            checker.Read();
+        }
+    }
+
+    CaptureDrainStats stats;
+    drain.GetStats(&stats);
+    bool mark = Policy == CaptureGapMark;
+    printf("%s: %llu frames delivered, %llu read, %llu check errors\n", mark ? "Mark" : "Fill",
+        static_cast<unsigned long long>(injected.FramesDelivered), static_cast<unsigned long long>(checker.FramesRead()),
+        static_cast<unsigned long long>(checker.Errors()));
+    printf("  glitches %llu/%llu, glitch frames %llu/%llu, silent packets %llu/%llu, late wakeups %llu/%llu (counted/injected)\n",
+        static_cast<unsigned long long>(stats.Glitches), static_cast<unsigned long long>(injected.Glitches),
+        static_cast<unsigned long long>(stats.GlitchFrames), static_cast<unsigned long long>(injected.GlitchFrames),
+        static_cast<unsigned long long>(stats.SilentPackets), static_cast<unsigned long long>(injected.SilentPackets),
+        static_cast<unsigned long long>(stats.LateWakeups), static_cast<unsigned long long>(injected.LateWakeups));
+    printf("  %llu stalls: %llu frames discarded in %llu overruns, %llu filled with silence, %llu gap frames logged\n",
+        static_cast<unsigned long long>(injected.Stalls), static_cast<unsigned long long>(stats.DiscardedFrames),
+        static_cast<unsigned long long>(stats.Overruns), static_cast<unsigned long long>(stats.FilledFrames),
+        static_cast<unsigned long long>(checker.GapFrames()));
+
+    bool passed = checker.Errors() == 0 && stats.Glitches == injected.Glitches && stats.GlitchFrames == injected.GlitchFrames &&
+        stats.SilentPackets == injected.SilentPackets && stats.LateWakeups == injected.LateWakeups &&
+        (injected.Stalls == 0 || stats.Overruns != 0) && stats.FramesMoved == checker.FramesRead();
+    if (mark)
+    {
+        passed = passed && stats.FilledFrames == 0 && stats.DiscardedFrames == injected.FramesDelivered - checker.FramesRead() &&
+            checker.GapFrames() == stats.DiscardedFrames + stats.GlitchFrames;
+    }
+    else
+    {
+        passed = passed && checker.FramesRead() == injected.FramesDelivered + injected.GlitchFrames &&
+            stats.FilledFrames == stats.DiscardedFrames + stats.GlitchFrames &&
+            checker.Zeros() >= stats.FilledFrames && checker.Zeros() <= silentFrames + stats.FilledFrames;
+    }
+    printf("  %s\n", passed ? "Counts match." : "COUNT MISMATCH.");
+    return passed;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t wakeups = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--wakeups", "20000")));
+    uint32_t seed = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--seed", "1")));
+    if (wakeups == 0)
+    {
+        fprintf(stderr, "Usage: %s [--wakeups N] [--seed N]\n", argv[0]);
+        return 1;
+    }
+
+    bool passed = RunFaults(CaptureGapMark, wakeups, seed);
+    passed = RunFaults(CaptureGapFill, wakeups, seed) && passed;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,327 @@
+//
+//  Burst drain test on Linux.
+//
+//  A mock capture client hands CCaptureDrain bursts of 1 to --max-burst packets of random sizes per wakeup, some of
+//  them flagged silent, and a consumer between wakeups reads a random part of what is in a small ring of an odd
+//  number of frames, so bursts start anywhere and many of them, and many single packets, cross the wrap point.  The
+//  test checks that
+//
+//  - the drain takes every queued packet in the wakeup and publishes them with a single commit: while it is still
+//    fetching packets nothing new is readable, and afterwards everything is, in one piece;
+//  - the per wakeup stats count the burst's packets and frames;
+//  - a burst reservation is split only at the wrap point: the consumer sees the first region end where the buffer
+//    does, and every frame, on either side, holds what the client delivered, or zeros for a silent packet.
+//
+//  Both the plain copy and the converter (float to 16 bit) paths are run.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <random>
+#include <vector>
+#include "AudioFormat.h"
+#include "CaptureDrain.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static const uint32_t SampleRate = 48000;
+static const WORD Channels = 2;
+static const size_t RingFrames = 4093;
+static const uint32_t MaxPacketFrames = 600;
+
+//
+//  Frame Frame's sample on Channel, as a 16 bit value; the client delivers it as a float scaled by 1 / 32768, so
+//  converting to 16 bits gives it back exactly.
+//
+static int16_t ExpectedSample(uint64_t Frame, uint32_t Channel)
+{
+    uint64_t value = Channel == 0 ? Frame : ~Frame;
+    return static_cast<int16_t>(value & 0x7FFF);
+}
+
+//
+//  Delivers the packets queued on it and checks that nothing reaches the consumer while it is being drained.
+//
+class CBurstPacketClient : public ICapturePacketClient
+{
+public:
+    struct Packet
+    {
+        uint32_t    Frames;
+        uint32_t    Flags;
+    };
+
+    CBurstPacketClient(CCaptureRingBuffer* Ring) :
+        _Ring(Ring), _Data(MaxPacketFrames * Channels), _Position(0), _ReadableAtWakeup(0), _EarlyCommits(0)
+    {
+    }
+
+    void Queue(const Packet& NewPacket) { _Packets.push_back(NewPacket); }
+    void BeginWakeup() { _ReadableAtWakeup = _Ring->ReadableFrames(); }
+    bool Empty() const { return _Packets.empty(); }
+    uint64_t EarlyCommits() const { return _EarlyCommits; }
+
+    bool GetNextPacketSize(uint32_t* Frames)
+    {
+        CheckNothingCommitted();
+        *Frames = _Packets.empty() ? 0 : _Packets.front().Frames;
+        return true;
+    }
+
+    bool GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition)
+    {
+        CheckNothingCommitted();
+        const Packet& packet = _Packets.front();
+        for (uint32_t i = 0; i < packet.Frames; i++)
+        {
+            for (uint32_t channel = 0; channel < Channels; channel++)
+            {
+                _Data[i * Channels + channel] = ExpectedSample(_Position + i, channel) / 32768.0f;
+            }
+        }
+        *Data = reinterpret_cast<uint8_t*>(&_Data[0]);
+        *Frames = packet.Frames;
+        *Flags = packet.Flags;
+        *DevicePosition = _Position;
+        *QPCPosition = 0;
+        return true;
+    }
+
+    bool ReleaseBuffer(uint32_t Frames)
+    {
+        _Position += Frames;
+        _Packets.pop_front();
+        return true;
+    }
+
+private:
+    void CheckNothingCommitted()
+    {
+        if (_Ring->ReadableFrames() != _ReadableAtWakeup)
+        {
+            _EarlyCommits++;
+        }
+    }
+
+    CCaptureRingBuffer*         _Ring;
+    std::deque<Packet>          _Packets;
+    std::vector<float>          _Data;
+    uint64_t                    _Position;
+    size_t                      _ReadableAtWakeup;
+    uint64_t                    _EarlyCommits;
+};
+
+struct BurstResult
+{
+    uint64_t    Packets;
+    uint64_t    Frames;
+    uint64_t    WrappedBursts;
+    uint64_t    WrappedPackets;
+    uint64_t    EarlyCommits;
+    uint64_t    BadCommits;
+    uint64_t    BadStats;
+    uint64_t    BadSplits;
+    uint64_t    WrongFrames;
+};
+
+//
+//  Checks one frame the consumer read at ring frame Frame, expected silent or not.
+//
+static bool CheckFrame(const uint8_t* Data, uint64_t Frame, bool Silent, bool Convert)
+{
+    for (uint32_t channel = 0; channel < Channels; channel++)
+    {
+        int16_t expected = Silent ? 0 : ExpectedSample(Frame, channel);
+        if (Convert)
+        {
+            int16_t sample;
+            memcpy(&sample, Data + channel * sizeof(int16_t), sizeof(sample));
+            if (sample != expected)
+            {
+                return false;
+            }
+        }
+        else
+        {
+            //
+            //  Bit for bit: a silent frame must be +0.0f, and a copied one exactly what was delivered.
+            //
+            float expectedSample = Silent ? 0.0f : expected / 32768.0f;
+            if (memcmp(Data + channel * sizeof(float), &expectedSample, sizeof(float)) != 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static bool RunBursts(uint32_t Wakeups, uint32_t MaxBurst, uint32_t Seed, bool Convert, BurstResult* Result)
+{
+    memset(Result, 0, sizeof(*Result));
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, Channels, SampleRate, 32, 0);
+    CSampleConverter converter;
+    if (Convert && !converter.Initialize(&format.Format, false, 16, false))
+    {
+        return false;
+    }
+    CaptureProcessing processing = {};
+    processing.Converter = Convert ? &converter : NULL;
+    CCaptureRingBuffer ring;
+    CCaptureDrain drain;
+    if (!ring.Initialize(RingFrames, Convert ? converter.OutputFrameSize() : format.Format.nBlockAlign) ||
+        !drain.Attach(&ring, &processing, &format.Format))
+    {
+        return false;
+    }
+    const size_t frameSize = ring.FrameSize();
+
+    //
+    //  Silent stretches of the ring timeline, as half open ranges of ring frames, oldest first.
+    //
+    std::deque<std::pair<uint64_t, uint64_t> > silentRanges;
+    std::mt19937 random(Seed);
+    CBurstPacketClient client(&ring);
+    uint64_t written = 0;
+    uint64_t read = 0;
+    for (uint32_t wakeup = 0; wakeup < Wakeups; wakeup++)
+    {
+        //
+        //  Queue a burst that fits in what the consumer left free, so nothing is discarded.
+        //
+        uint32_t packets = 1 + random() % MaxBurst;
+        uint64_t burstFrames = 0;
+        uint64_t burstStart = written;
+        bool wrappedPacket = false;
+        for (uint32_t i = 0; i < packets; i++)
+        {
+            CBurstPacketClient::Packet packet;
+            packet.Frames = 1 + random() % MaxPacketFrames;
+            packet.Flags = random() % 8 == 0 ? CAPTURE_PACKET_FLAG_SILENT : 0;
+            if (burstFrames + packet.Frames > ring.WritableFrames())
+            {
+                packets = i;
+                break;
+            }
+            uint64_t first = burstStart + burstFrames;
+            if (first / RingFrames != (first + packet.Frames - 1) / RingFrames)
+            {
+                wrappedPacket = true;
+            }
+            if (packet.Flags & CAPTURE_PACKET_FLAG_SILENT)
+            {
+                silentRanges.push_back(std::make_pair(first, first + packet.Frames));
+            }
+            burstFrames += packet.Frames;
+            client.Queue(packet);
+        }
+
+        size_t readableBefore = ring.ReadableFrames();
+        client.BeginWakeup();
+        if (!drain.Drain(&client))
+        {
+            return false;
+        }
+        if (!client.Empty() || ring.ReadableFrames() != readableBefore + burstFrames)
+        {
+            Result->BadCommits++;
+        }
+        CaptureDrainStats stats;
+        drain.GetStats(&stats);
+        if (stats.Wakeups != wakeup + 1u || stats.LastWakeupPackets != packets || stats.LastWakeupFrames != burstFrames ||
+            stats.DiscardedFrames != 0)
+        {
+            Result->BadStats++;
+        }
+        if (packets != 0 && burstStart / RingFrames != (burstStart + burstFrames - 1) / RingFrames)
+        {
+            Result->WrappedBursts++;
+        }
+        Result->WrappedPackets += wrappedPacket ? 1 : 0;
+        Result->Packets += packets;
+        written += burstFrames;
+
+        //
+        //  Read a random part of what is there, sometimes all of it.
+        //
+        size_t available = ring.ReadableFrames();
+        size_t frames = random() % 4 == 0 ? available : random() % (available + 1);
+        CaptureRingRegion regions[2];
+        size_t reserved = ring.BeginRead(frames, regions);
+        if (regions[0].Frames + regions[1].Frames != reserved ||
+            (regions[1].Frames != 0 && regions[0].Data + regions[0].Frames * frameSize != regions[1].Data + RingFrames * frameSize))
+        {
+            Result->BadSplits++;
+        }
+        for (size_t i = 0; i < reserved; i++)
+        {
+            const uint8_t* data = i < regions[0].Frames ? regions[0].Data + i * frameSize :
+                regions[1].Data + (i - regions[0].Frames) * frameSize;
+            uint64_t frame = read + i;
+            while (!silentRanges.empty() && silentRanges.front().second <= frame)
+            {
+                silentRanges.pop_front();
+            }
+            bool silent = !silentRanges.empty() && silentRanges.front().first <= frame;
+            if (!CheckFrame(data, frame, silent, Convert))
+            {
+                if (Result->WrongFrames++ < 10)
+                {
+                    fprintf(stderr, "Frame %llu is wrong.\n", static_cast<unsigned long long>(frame));
+                }
+            }
+        }
+        ring.CommitRead(reserved);
+        read += reserved;
+    }
+    Result->Frames = written;
+    Result->EarlyCommits = client.EarlyCommits();
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t wakeups = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--wakeups", "200000")));
+    uint32_t maxBurst = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--max-burst", "8")));
+    uint32_t seed = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--seed", "1")));
+    if (wakeups == 0 || maxBurst == 0)
+    {
+        fprintf(stderr, "Usage: %s [--wakeups N] [--max-burst packets] [--seed N]\n", argv[0]);
+        return 1;
+    }
+
+    bool passed = true;
+    for (int convert = 0; convert < 2; convert++)
+    {
+        BurstResult result;
+        if (!RunBursts(wakeups, maxBurst, seed, convert != 0, &result))
+        {
+            fprintf(stderr, "Unable to set up the drain.\n");
+            return 1;
+        }
+        bool ok = result.EarlyCommits == 0 && result.BadCommits == 0 && result.BadStats == 0 && result.BadSplits == 0 &&
+            result.WrongFrames == 0 && result.WrappedBursts != 0 && result.WrappedPackets != 0;
+        printf("%-8s %u wakeups, %llu packets, %llu frames; %llu bursts and %llu packets crossed the wrap\n",
+            convert ? "convert" : "copy", wakeups, static_cast<unsigned long long>(result.Packets),
+            static_cast<unsigned long long>(result.Frames), static_cast<unsigned long long>(result.WrappedBursts),
+            static_cast<unsigned long long>(result.WrappedPackets));
+        printf("         %llu early commits, %llu partial commits, %llu wrong stats, %llu bad splits, %llu wrong frames: %s\n",
+            static_cast<unsigned long long>(result.EarlyCommits), static_cast<unsigned long long>(result.BadCommits),
+            static_cast<unsigned long long>(result.BadStats), static_cast<unsigned long long>(result.BadSplits),
+            static_cast<unsigned long long>(result.WrongFrames), ok ? "ok" : "FAILED");
+        passed = passed && ok;
+    }
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,867 @@
+//
+//  FLAC encoder benchmark and round trip check on Linux.
+//
+//  Encodes a recording through CFlacFileSink in 10 ms writes, as the writer thread hands it the replayed capture:
+//  the WAV or RF64 file given with --input, or by default --seconds (default 60) of a synthetic stereo float capture
+//  at 48 kHz - notes with harmonics over a faint noise floor, a stretch of digital silence and a burst of clipped noise.
+//  It runs once with each worker count from 1 up to --threads (default one per core, at most 8), printing the
+//  encoding throughput per worker (input MB per second a worker spends encoding), the throughput of the whole pool in
+//  MB/s and times real time, and the compression ratio against the input and against PCM at the depth FLAC stores.
+//
+//  Every file is decoded again by the small FLAC decoder below, written from the format specification (RFC 9639)
+//  rather than from the encoder, which checks each frame's sync code, header, frame number, CRC-8 and CRC-16,
+//  STREAMINFO's sample count and frame sizes and every seek point, and compares every sample with the input as the
+//  sink converts it (float to 24 bit, 32 bit integer to its top 24 bits).  Any difference fails the run.  If the flac
+//  command line tool is installed, `flac -t` has to accept each file as well.  Shorter synthetic recordings in the
+//  other formats the sink takes - 16 bit stereo at 44.1 kHz, 24 bit 5.1, 32 bit mono - go through the same round
+//  trip, with a block size that doesn't divide their length.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "AudioFormat.h"
+#include "FlacFileSink.h"
+#include "WavFile.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const double Pi = 3.14159265358979323846;
+
+//
+//  A recording: its format and its data as captured.
+//
+struct Recording
+{
+    WAVEFORMATEXTENSIBLE    Format;
+    std::vector<uint8_t>    Data;
+};
+
+static uint32_t NextRandom(uint32_t* State)
+{
+    *State = *State * 1664525u + 1013904223u;
+    return *State;
+}
+
+//
+//  The synthetic capture, in [-1, 1] except the burst: a note with three harmonics every half second, panned a little
+//  differently on every channel, over white noise at -80 dBFS; the fourth second of every ten is digital silence and
+//  a fifth of a second at 7.5 s is full scale noise, up to 1.25, with a NaN and infinities in it.
+//
+static double SyntheticSample(uint64_t Frame, uint32_t Channel, uint32_t Rate, uint32_t* Noise)
+{
+    double t = static_cast<double>(Frame) / Rate;
+    double second = fmod(t, 10.0);
+    double noise = static_cast<double>(NextRandom(Noise) >> 8) / 8388608.0 - 1.0;
+    if (second >= 3.0 && second < 4.0)
+    {
+        return 0.0;
+    }
+    if (second >= 7.5 && second < 7.7)
+    {
+        uint64_t index = Frame % 4801;
+        return index == 17 ? NAN : index == 1000 ? INFINITY : index == 2000 ? -INFINITY : 1.25 * noise;
+    }
+    static const double notes[] = { 220.0, 246.94, 261.63, 293.66, 329.63, 349.23, 392.0, 440.0 };
+    uint64_t note = static_cast<uint64_t>(t * 2.0);
+    double frequency = notes[(note * 5 + Channel / 2) % 8];
+    double age = t - note * 0.5;
+    double envelope = 0.3 * exp(-4.0 * age) * (1.0 - 0.1 * Channel);
+    double value = 0.0;
+    for (int harmonic = 1; harmonic <= 3; harmonic++)
+    {
+        value += envelope / harmonic * sin(2.0 * Pi * frequency * harmonic * t + 0.3 * Channel);
+    }
+    return value + 1e-4 * noise;
+}
+
+static void PutLE(uint8_t* Data, uint32_t Value, int Bytes)
+{
+    for (int i = 0; i < Bytes; i++)
+    {
+        Data[i] = static_cast<uint8_t>(Value >> (8 * i));
+    }
+}
+
+static int32_t Quantize(double Value, double Scale, double Max)
+{
+    if (!(Value == Value))
+    {
+        return 0;
+    }
+    double scaled = nearbyint(Value * Scale);
+    return static_cast<int32_t>(scaled > Max ? Max : scaled < -Max - 1 ? -Max - 1 : scaled);
+}
+
+static void MakeRecording(bool IsFloat, WORD Bits, WORD Channels, uint32_t Rate, DWORD ChannelMask, double Seconds, Recording* Output)
+{
+    InitializeWaveFormat(&Output->Format, IsFloat, Channels, Rate, Bits, ChannelMask);
+    uint64_t frames = static_cast<uint64_t>(Seconds * Rate);
+    uint32_t bytes = Bits / 8;
+    Output->Data.assign(static_cast<size_t>(frames) * Channels * bytes, 0);
+    uint32_t noise = 12345;
+    for (uint64_t frame = 0; frame < frames; frame++)
+    {
+        for (WORD channel = 0; channel < Channels; channel++)
+        {
+            double value = SyntheticSample(frame, channel, Rate, &noise);
+            uint8_t* sample = &Output->Data[(static_cast<size_t>(frame) * Channels + channel) * bytes];
+            if (IsFloat)
+            {
+                float single = static_cast<float>(value);
+                memcpy(sample, &single, sizeof(single));
+            }
+            else
+            {
+                double max = ldexp(1.0, Bits - 1) - 1;
+                PutLE(sample, static_cast<uint32_t>(Quantize(value, max + 1, max)), bytes);
+            }
+        }
+    }
+}
+
+static bool LoadRecording(const std::string& FileName, Recording* Output)
+{
+    FILE* file = fopen(FileName.c_str(), "rb");
+    WavFileInfo info;
+    if (file == NULL || !ReadWavHeader(file, &info) || !SeekFile64(file, info.DataOffset))
+    {
+        fprintf(stderr, "Unable to read %s as a WAV or RF64 file.\n", FileName.c_str());
+        if (file != NULL)
+        {
+            fclose(file);
+        }
+        return false;
+    }
+    Output->Format = info.Format;
+    Output->Data.resize(static_cast<size_t>(info.DataSize));
+    size_t read = Output->Data.empty() ? 0 : fread(&Output->Data[0], 1, Output->Data.size(), file);
+    fclose(file);
+    Output->Data.resize(read - read % info.Format.Format.nBlockAlign);
+    return true;
+}
+
+//
+//  What the sink stores for each input sample: float and 24 bit as 24 bit, 16 bit as is, 32 bit integer shifted down
+//  to its top 24 bits.
+//
+static void ExpectedSamples(const Recording& Input, std::vector<int32_t>* Samples, uint32_t* Bits)
+{
+    const WAVEFORMATEX* format = &Input.Format.Format;
+    bool isFloat = IsFloatFormat(format);
+    uint32_t bytes = format->wBitsPerSample / 8;
+    size_t count = Input.Data.size() / bytes;
+    *Bits = format->wBitsPerSample == 16 ? 16 : 24;
+    Samples->resize(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        const uint8_t* sample = &Input.Data[i * bytes];
+        if (isFloat)
+        {
+            float value;
+            memcpy(&value, sample, sizeof(value));
+            (*Samples)[i] = Quantize(value, 8388608.0, 8388607.0);
+        }
+        else
+        {
+            uint32_t raw = 0;
+            for (uint32_t b = 0; b < bytes; b++)
+            {
+                raw |= static_cast<uint32_t>(sample[b]) << (8 * b);
+            }
+            int32_t value = static_cast<int32_t>(raw << (32 - 8 * bytes)) >> (32 - 8 * bytes);
+            (*Samples)[i] = bytes == 4 ? value >> 8 : value;
+        }
+    }
+}
+
+//
+//  MSB first bit reader.  Reading past the end gives zeros and sets a flag, checked once per frame.
+//
+class CBitReader
+{
+public:
+    CBitReader(const uint8_t* Data, size_t Size) : _Data(Data), _Size(Size), _Bit(0), _Overrun(false) {}
+
+    uint64_t Read(uint32_t Bits)
+    {
+        uint64_t value = 0;
+        for (uint32_t i = 0; i < Bits; i++)
+        {
+            size_t byte = _Bit >> 3;
+            uint32_t bit = 0;
+            if (byte < _Size)
+            {
+                bit = (_Data[byte] >> (7 - (_Bit & 7))) & 1;
+            }
+            else
+            {
+                _Overrun = true;
+            }
+            value = (value << 1) | bit;
+            _Bit++;
+        }
+        return value;
+    }
+
+    int64_t ReadSigned(uint32_t Bits)
+    {
+        if (Bits == 0)
+        {
+            return 0;
+        }
+        uint64_t value = Read(Bits);
+        return static_cast<int64_t>(value << (64 - Bits)) >> (64 - Bits);
+    }
+
+    uint32_t ReadUnary()
+    {
+        uint32_t zeros = 0;
+        while (Read(1) == 0 && !_Overrun)
+        {
+            zeros++;
+        }
+        return zeros;
+    }
+
+    void Align() { _Bit = (_Bit + 7) & ~static_cast<size_t>(7); }
+    size_t BytePosition() const { return _Bit >> 3; }
+    bool Overrun() const { return _Overrun; }
+
+private:
+    const uint8_t*  _Data;
+    size_t          _Size;
+    size_t          _Bit;
+    bool            _Overrun;
+};
+
+static uint32_t Crc(const uint8_t* Data, size_t Size, uint32_t Polynomial, uint32_t Bits)
+{
+    uint32_t crc = 0;
+    uint32_t top = 1u << (Bits - 1);
+    uint32_t mask = (1u << Bits) - 1;
+    for (size_t i = 0; i < Size; i++)
+    {
+        crc ^= static_cast<uint32_t>(Data[i]) << (Bits - 8);
+        for (int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & top) ? ((crc << 1) ^ Polynomial) & mask : (crc << 1) & mask;
+        }
+    }
+    return crc;
+}
+
+struct DecodedStream
+{
+    uint32_t                    MinBlockSize;
+    uint32_t                    MaxBlockSize;
+    uint32_t                    MinFrameSize;
+    uint32_t                    MaxFrameSize;
+    uint32_t                    SampleRate;
+    uint32_t                    Channels;
+    uint32_t                    BitsPerSample;
+    uint64_t                    TotalSamples;
+    std::vector<FlacSeekPoint>  SeekPoints;
+    std::vector<uint64_t>       FrameOffsets;      // From the first frame, per frame.
+    std::vector<uint32_t>       FrameSizes;
+    std::vector<int32_t>        Samples;            // Interleaved.
+};
+
+static bool DecodeResidual(CBitReader* Reader, uint32_t BlockSize, uint32_t Order, int64_t* Residual)
+{
+    uint32_t method = static_cast<uint32_t>(Reader->Read(2));
+    if (method > 1)
+    {
+        return false;
+    }
+    uint32_t parameterBits = method == 0 ? 4 : 5;
+    uint32_t escape = (1u << parameterBits) - 1;
+    uint32_t partitionOrder = static_cast<uint32_t>(Reader->Read(4));
+    uint32_t partitionSize = BlockSize >> partitionOrder;
+    if ((partitionSize << partitionOrder) != BlockSize || partitionSize < Order)
+    {
+        return false;
+    }
+    size_t n = 0;
+    for (uint32_t partition = 0; partition < (1u << partitionOrder); partition++)
+    {
+        uint32_t count = partition == 0 ? partitionSize - Order : partitionSize;
+        uint32_t parameter = static_cast<uint32_t>(Reader->Read(parameterBits));
+        if (parameter == escape)
+        {
+            uint32_t bits = static_cast<uint32_t>(Reader->Read(5));
+            for (uint32_t i = 0; i < count; i++)
+            {
+                Residual[n++] = Reader->ReadSigned(bits);
+            }
+            continue;
+        }
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint64_t value = (static_cast<uint64_t>(Reader->ReadUnary()) << parameter) | Reader->Read(parameter);
+            Residual[n++] = static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+        }
+    }
+    return !Reader->Overrun();
+}
+
+static bool DecodeSubframe(CBitReader* Reader, uint32_t BlockSize, uint32_t Bits, int64_t* Signal)
+{
+    if (Reader->Read(1) != 0)
+    {
+        return false;
+    }
+    uint32_t type = static_cast<uint32_t>(Reader->Read(6));
+    uint32_t wasted = Reader->Read(1) != 0 ? Reader->ReadUnary() + 1 : 0;
+    if (wasted >= Bits)
+    {
+        return false;
+    }
+    Bits -= wasted;
+
+    if (type == 0)
+    {
+        int64_t value = Reader->ReadSigned(Bits);
+        for (uint32_t i = 0; i < BlockSize; i++)
+        {
+            Signal[i] = value;
+        }
+    }
+    else if (type == 1)
+    {
+        for (uint32_t i = 0; i < BlockSize; i++)
+        {
+            Signal[i] = Reader->ReadSigned(Bits);
+        }
+    }
+    else if ((type >= 8 && type <= 12) || type >= 32)
+    {
+        bool lpc = type >= 32;
+        uint32_t order = lpc ? type - 31 : type - 8;
+        if (order > BlockSize)
+        {
+            return false;
+        }
+        for (uint32_t i = 0; i < order; i++)
+        {
+            Signal[i] = Reader->ReadSigned(Bits);
+        }
+        int64_t coefficients[32];
+        uint32_t shift = 0;
+        if (lpc)
+        {
+            uint32_t precision = static_cast<uint32_t>(Reader->Read(4)) + 1;
+            int64_t signedShift = Reader->ReadSigned(5);
+            if (precision == 16 || signedShift < 0)
+            {
+                return false;
+            }
+            shift = static_cast<uint32_t>(signedShift);
+            for (uint32_t j = 0; j < order; j++)
+            {
+                coefficients[j] = Reader->ReadSigned(precision);
+            }
+        }
+        if (!DecodeResidual(Reader, BlockSize, order, Signal + order))
+        {
+            return false;
+        }
+        for (uint32_t i = order; i < BlockSize; i++)
+        {
+            int64_t prediction = 0;
+            if (lpc)
+            {
+                for (uint32_t j = 0; j < order; j++)
+                {
+                    prediction += coefficients[j] * Signal[i - 1 - j];
+                }
+                prediction >>= shift;
+            }
+            else if (order == 1)
+            {
+                prediction = Signal[i - 1];
+            }
+            else if (order == 2)
+            {
+                prediction = 2 * Signal[i - 1] - Signal[i - 2];
+            }
+            else if (order == 3)
+            {
+                prediction = 3 * Signal[i - 1] - 3 * Signal[i - 2] + Signal[i - 3];
+            }
+            else if (order == 4)
+            {
+                prediction = 4 * Signal[i - 1] - 6 * Signal[i - 2] + 4 * Signal[i - 3] - Signal[i - 4];
+            }
+            Signal[i] += prediction;
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < BlockSize; i++)
+    {
+        Signal[i] = static_cast<int64_t>(static_cast<uint64_t>(Signal[i]) << wasted);
+    }
+    return !Reader->Overrun();
+}
+
+//
+//  One frame at Data, which must be frame number Number.  Its samples are appended to Stream's.
+//
+static bool DecodeFrame(const uint8_t* Data, size_t Size, uint64_t Number, DecodedStream* Stream, size_t* FrameSize, std::string* Error)
+{
+    static const uint32_t sampleRates[] = { 0, 88200, 176400, 192000, 8000, 16000, 22050, 24000, 32000, 44100, 48000, 96000 };
+    static const uint32_t sampleBits[] = { 0, 8, 12, 0, 16, 20, 24, 32 };
+    CBitReader reader(Data, Size);
+    if (reader.Read(15) != 0x7FFC || reader.Read(1) != 0)
+    {
+        *Error = "no fixed block size frame sync";
+        return false;
+    }
+    uint32_t blockSizeCode = static_cast<uint32_t>(reader.Read(4));
+    uint32_t sampleRateCode = static_cast<uint32_t>(reader.Read(4));
+    uint32_t channelAssignment = static_cast<uint32_t>(reader.Read(4));
+    uint32_t sampleBitsCode = static_cast<uint32_t>(reader.Read(3));
+    if (reader.Read(1) != 0 || blockSizeCode == 0 || sampleRateCode == 15 || channelAssignment > 10 || sampleBitsCode == 3)
+    {
+        *Error = "reserved header field";
+        return false;
+    }
+
+    //
+    //  The frame number, UTF-8 style.
+    //
+    uint64_t number = reader.Read(8);
+    uint32_t extraBytes = 0;
+    if (number >= 0x80)
+    {
+        uint32_t ones = 0;
+        while (ones < 8 && (number & (0x80u >> ones)) != 0)
+        {
+            ones++;
+        }
+        if (ones < 2 || ones > 7)
+        {
+            *Error = "bad frame number coding";
+            return false;
+        }
+        number &= 0x7Fu >> ones;
+        extraBytes = ones - 1;
+    }
+    for (uint32_t i = 0; i < extraBytes; i++)
+    {
+        uint64_t byte = reader.Read(8);
+        if ((byte & 0xC0) != 0x80)
+        {
+            *Error = "bad frame number coding";
+            return false;
+        }
+        number = (number << 6) | (byte & 0x3F);
+    }
+
+    uint32_t blockSize = blockSizeCode == 1 ? 192 : blockSizeCode <= 5 ? 576u << (blockSizeCode - 2) :
+        blockSizeCode == 6 ? static_cast<uint32_t>(reader.Read(8)) + 1 : blockSizeCode == 7 ? static_cast<uint32_t>(reader.Read(16)) + 1 :
+        256u << (blockSizeCode - 8);
+    uint32_t sampleRate = sampleRateCode == 0 ? Stream->SampleRate : sampleRateCode <= 11 ? sampleRates[sampleRateCode] :
+        sampleRateCode == 12 ? static_cast<uint32_t>(reader.Read(8)) * 1000 : sampleRateCode == 13 ? static_cast<uint32_t>(reader.Read(16)) :
+        static_cast<uint32_t>(reader.Read(16)) * 10;
+    uint32_t bits = sampleBitsCode == 0 ? Stream->BitsPerSample : sampleBits[sampleBitsCode];
+    uint32_t channels = channelAssignment < 8 ? channelAssignment + 1 : 2;
+    size_t headerSize = reader.BytePosition();
+    if (reader.Read(8) != Crc(Data, headerSize, 0x07, 8))
+    {
+        *Error = "header CRC-8 mismatch";
+        return false;
+    }
+    if (number != Number || sampleRate != Stream->SampleRate || bits != Stream->BitsPerSample || channels != Stream->Channels ||
+        blockSize > Stream->MaxBlockSize)
+    {
+        *Error = "header doesn't match the stream";
+        return false;
+    }
+
+    std::vector<int64_t> signals(static_cast<size_t>(blockSize) * channels);
+    for (uint32_t channel = 0; channel < channels; channel++)
+    {
+        bool side = (channelAssignment == 8 && channel == 1) || (channelAssignment == 9 && channel == 0) ||
+            (channelAssignment == 10 && channel == 1);
+        if (!DecodeSubframe(&reader, blockSize, bits + (side ? 1 : 0), &signals[static_cast<size_t>(channel) * blockSize]))
+        {
+            *Error = "bad subframe";
+            return false;
+        }
+    }
+    reader.Align();
+    size_t end = reader.BytePosition();
+    if (reader.Read(16) != Crc(Data, end, 0x8005, 16) || reader.Overrun())
+    {
+        *Error = "frame CRC-16 mismatch";
+        return false;
+    }
+
+    int64_t* first = &signals[0];
+    int64_t* second = channels == 2 ? &signals[blockSize] : NULL;
+    for (uint32_t i = 0; i < blockSize; i++)
+    {
+        if (channelAssignment == 8)
+        {
+            second[i] = first[i] - second[i];
+        }
+        else if (channelAssignment == 9)
+        {
+            first[i] += second[i];
+        }
+        else if (channelAssignment == 10)
+        {
+            int64_t mid = (first[i] * 2) | (second[i] & 1);
+            int64_t sideValue = second[i];
+            first[i] = (mid + sideValue) >> 1;
+            second[i] = (mid - sideValue) >> 1;
+        }
+    }
+    int64_t limit = static_cast<int64_t>(1) << (bits - 1);
+    for (uint32_t i = 0; i < blockSize; i++)
+    {
+        for (uint32_t channel = 0; channel < channels; channel++)
+        {
+            int64_t value = signals[static_cast<size_t>(channel) * blockSize + i];
+            if (value < -limit || value >= limit)
+            {
+                *Error = "sample out of range";
+                return false;
+            }
+            Stream->Samples.push_back(static_cast<int32_t>(value));
+        }
+    }
+    *FrameSize = end + 2;
+    return true;
+}
+
+static bool DecodeFile(const std::string& FileName, DecodedStream* Stream)
+{
+    FILE* file = fopen(FileName.c_str(), "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", FileName.c_str());
+        return false;
+    }
+    std::vector<uint8_t> data(static_cast<size_t>(FileSize64(file)));
+    bool read = data.size() > 4 && fread(&data[0], 1, data.size(), file) == data.size();
+    fclose(file);
+    if (!read || memcmp(&data[0], "fLaC", 4) != 0)
+    {
+        fprintf(stderr, "%s is not a FLAC file.\n", FileName.c_str());
+        return false;
+    }
+
+    size_t position = 4;
+    bool last = false;
+    bool haveStreamInfo = false;
+    while (!last)
+    {
+        if (position + 4 > data.size())
+        {
+            fprintf(stderr, "Truncated metadata.\n");
+            return false;
+        }
+        last = (data[position] & 0x80) != 0;
+        uint32_t type = data[position] & 0x7F;
+        size_t length = static_cast<size_t>(data[position + 1]) << 16 | data[position + 2] << 8 | data[position + 3];
+        position += 4;
+        if (position + length > data.size())
+        {
+            fprintf(stderr, "Truncated metadata.\n");
+            return false;
+        }
+        CBitReader reader(&data[position], length);
+        if (type == 0 && length == 34)
+        {
+            Stream->MinBlockSize = static_cast<uint32_t>(reader.Read(16));
+            Stream->MaxBlockSize = static_cast<uint32_t>(reader.Read(16));
+            Stream->MinFrameSize = static_cast<uint32_t>(reader.Read(24));
+            Stream->MaxFrameSize = static_cast<uint32_t>(reader.Read(24));
+            Stream->SampleRate = static_cast<uint32_t>(reader.Read(20));
+            Stream->Channels = static_cast<uint32_t>(reader.Read(3)) + 1;
+            Stream->BitsPerSample = static_cast<uint32_t>(reader.Read(5)) + 1;
+            Stream->TotalSamples = reader.Read(36);
+            haveStreamInfo = position == 8;
+        }
+        else if (type == 3)
+        {
+            for (size_t i = 0; i + 18 <= length; i += 18)
+            {
+                FlacSeekPoint point;
+                point.SampleNumber = reader.Read(64);
+                point.Offset = reader.Read(64);
+                point.Frames = static_cast<uint32_t>(reader.Read(16));
+                if (point.SampleNumber != ~0ull)
+                {
+                    Stream->SeekPoints.push_back(point);
+                }
+            }
+        }
+        position += length;
+    }
+    if (!haveStreamInfo)
+    {
+        fprintf(stderr, "STREAMINFO is not the first metadata block.\n");
+        return false;
+    }
+
+    size_t framesStart = position;
+    for (uint64_t number = 0; position < data.size(); number++)
+    {
+        size_t frameSize;
+        std::string error;
+        if (!DecodeFrame(&data[position], data.size() - position, number, Stream, &frameSize, &error))
+        {
+            fprintf(stderr, "Frame %llu at byte %zu: %s.\n", static_cast<unsigned long long>(number), position, error.c_str());
+            return false;
+        }
+        Stream->FrameOffsets.push_back(position - framesStart);
+        Stream->FrameSizes.push_back(static_cast<uint32_t>(frameSize));
+        position += frameSize;
+    }
+    return true;
+}
+
+//
+//  The decoded stream against the input: format, samples, and what STREAMINFO and the seek table say about the frames.
+//
+static bool CheckStream(const DecodedStream& Stream, const Recording& Input, uint32_t BlockSize)
+{
+    std::vector<int32_t> expected;
+    uint32_t bits;
+    ExpectedSamples(Input, &expected, &bits);
+    const WAVEFORMATEX* format = &Input.Format.Format;
+    uint64_t frames = expected.size() / format->nChannels;
+    if (Stream.SampleRate != format->nSamplesPerSec || Stream.Channels != format->nChannels || Stream.BitsPerSample != bits ||
+        Stream.MinBlockSize != BlockSize || Stream.MaxBlockSize != BlockSize || Stream.TotalSamples != frames)
+    {
+        fprintf(stderr, "STREAMINFO: %u Hz, %u channels, %u bits, %llu samples, blocks of %u-%u.\n", Stream.SampleRate,
+            Stream.Channels, Stream.BitsPerSample, static_cast<unsigned long long>(Stream.TotalSamples), Stream.MinBlockSize,
+            Stream.MaxBlockSize);
+        return false;
+    }
+    if (Stream.Samples.size() != expected.size())
+    {
+        fprintf(stderr, "Decoded %zu samples, expected %zu.\n", Stream.Samples.size(), expected.size());
+        return false;
+    }
+    size_t wrong = 0;
+    for (size_t i = 0; i < expected.size(); i++)
+    {
+        if (Stream.Samples[i] != expected[i] && wrong++ == 0)
+        {
+            fprintf(stderr, "Sample %zu decoded as %d, expected %d.\n", i, Stream.Samples[i], expected[i]);
+        }
+    }
+    if (wrong != 0)
+    {
+        fprintf(stderr, "%zu of %zu samples differ.\n", wrong, expected.size());
+        return false;
+    }
+
+    uint32_t minFrameSize = 0;
+    uint32_t maxFrameSize = 0;
+    for (size_t i = 0; i < Stream.FrameSizes.size(); i++)
+    {
+        minFrameSize = i == 0 || Stream.FrameSizes[i] < minFrameSize ? Stream.FrameSizes[i] : minFrameSize;
+        maxFrameSize = Stream.FrameSizes[i] > maxFrameSize ? Stream.FrameSizes[i] : maxFrameSize;
+    }
+    if (Stream.MinFrameSize != minFrameSize || Stream.MaxFrameSize != maxFrameSize)
+    {
+        fprintf(stderr, "STREAMINFO frame sizes %u-%u, the frames are %u-%u.\n", Stream.MinFrameSize, Stream.MaxFrameSize,
+            minFrameSize, maxFrameSize);
+        return false;
+    }
+    for (size_t i = 0; i < Stream.SeekPoints.size(); i++)
+    {
+        const FlacSeekPoint& point = Stream.SeekPoints[i];
+        uint64_t frame = point.SampleNumber / BlockSize;
+        if (point.SampleNumber % BlockSize != 0 || frame >= Stream.FrameOffsets.size() || Stream.FrameOffsets[frame] != point.Offset ||
+            point.Frames != (frame + 1 < Stream.FrameOffsets.size() ? BlockSize : frames - frame * BlockSize) ||
+            (i != 0 && point.SampleNumber <= Stream.SeekPoints[i - 1].SampleNumber))
+        {
+            fprintf(stderr, "Seek point %zu (sample %llu, offset %llu) doesn't point at its frame.\n", i,
+                static_cast<unsigned long long>(point.SampleNumber), static_cast<unsigned long long>(point.Offset));
+            return false;
+        }
+    }
+    return !Stream.SeekPoints.empty() && Stream.SeekPoints[0].SampleNumber == 0;
+}
+
+static bool HaveFlacTool()
+{
+    return system("command -v flac >/dev/null 2>&1") == 0;
+}
+
+struct EncodeResult
+{
+    FlacEncoderStats    Stats;
+    double              WallSeconds;
+    uint64_t            FileBytes;
+};
+
+//
+//  Encodes Input in 10 ms writes, then decodes and checks the file.
+//
+static bool EncodeAndCheck(const Recording& Input, const std::string& FileName, uint32_t BlockSize, uint32_t Threads, bool FlacTool,
+    EncodeResult* Result)
+{
+    const WAVEFORMATEX* format = &Input.Format.Format;
+    size_t chunk = static_cast<size_t>(format->nSamplesPerSec / 100) * format->nBlockAlign;
+    CFlacFileSink sink;
+    int64_t start = SteadyClockNs();
+    if (!sink.Open(FileName, format, BlockSize, Threads))
+    {
+        return false;
+    }
+    for (size_t offset = 0; offset < Input.Data.size(); offset += chunk)
+    {
+        size_t size = Input.Data.size() - offset < chunk ? Input.Data.size() - offset : chunk;
+        if (!sink.Write(&Input.Data[offset], size))
+        {
+            sink.Close();
+            return false;
+        }
+    }
+    if (!sink.Close())
+    {
+        return false;
+    }
+    Result->WallSeconds = (SteadyClockNs() - start) / 1e9;
+    sink.GetStats(&Result->Stats);
+
+    DecodedStream stream = {};
+    bool passed = DecodeFile(FileName, &stream) && CheckStream(stream, Input, BlockSize);
+    FILE* file = fopen(FileName.c_str(), "rb");
+    Result->FileBytes = file != NULL ? FileSize64(file) : 0;
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+    if (passed && FlacTool)
+    {
+        std::string command = "flac -t -s '" + FileName + "'";
+        passed = system(command.c_str()) == 0;
+        if (!passed)
+        {
+            fprintf(stderr, "flac -t rejected %s.\n", FileName.c_str());
+        }
+    }
+    return passed;
+}
+
+int main(int argc, char* argv[])
+{
+    std::string input = GetArg(argc, argv, "--input", "");
+    double seconds = atof(GetArg(argc, argv, "--seconds", "60"));
+    unsigned int cores = std::thread::hardware_concurrency();
+    int maxThreads = atoi(GetArg(argc, argv, "--threads", std::to_string(cores == 0 ? 1 : cores < 8 ? cores : 8).c_str()));
+    int blockSize = atoi(GetArg(argc, argv, "--block", "4096"));
+    std::string directory = GetArg(argc, argv, "--dir", "/tmp");
+    if (seconds <= 0 || maxThreads <= 0 || maxThreads > 64 || blockSize < 16 || blockSize > 65535)
+    {
+        fprintf(stderr, "Usage: %s [--input <wav>] [--seconds N] [--threads N] [--block frames] [--dir <dir>]\n", argv[0]);
+        return 1;
+    }
+    std::string fileName = directory + "/audio_capture_flac_bench_" + std::to_string(getpid()) + ".flac";
+    bool flacTool = HaveFlacTool();
+    printf("Round trip checked by the built in decoder%s\n", flacTool ? " and flac -t" : "; flac is not installed");
+
+    Recording recording;
+    if (!input.empty())
+    {
+        if (!LoadRecording(input, &recording))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        MakeRecording(true, 32, 2, 48000, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT, seconds, &recording);
+    }
+    const WAVEFORMATEX* format = &recording.Format.Format;
+    double audioSeconds = static_cast<double>(recording.Data.size()) / format->nAvgBytesPerSec;
+    uint32_t storedBits = format->wBitsPerSample == 16 ? 16 : 24;
+    printf("%s: %u Hz, %u channels, %u bit%s, %.1f seconds, blocks of %d frames\n", input.empty() ? "Synthetic capture" : input.c_str(),
+        format->nSamplesPerSec, format->nChannels, format->wBitsPerSample, IsFloatFormat(format) ? " float" : "", audioSeconds, blockSize);
+
+    bool passed = true;
+    for (int threads = 1; threads <= maxThreads; threads = threads < maxThreads && threads * 2 > maxThreads ? maxThreads : threads * 2)
+    {
+        EncodeResult result;
+        bool ok = EncodeAndCheck(recording, fileName, static_cast<uint32_t>(blockSize), static_cast<uint32_t>(threads), flacTool, &result);
+        unlink(fileName.c_str());
+        double inputMb = recording.Data.size() / 1e6;
+        double pcmBytes = static_cast<double>(recording.Data.size()) / format->wBitsPerSample * storedBits;
+        printf("%d worker%s: %.1f MB/s per worker, %.1f MB/s in all (%.0fx real time), %.3f of the input, %.3f of %u bit PCM: %s\n",
+            threads, threads == 1 ? "" : "s", result.Stats.EncodeTimeUs != 0 ? recording.Data.size() / static_cast<double>(result.Stats.EncodeTimeUs) : 0.0,
+            inputMb / result.WallSeconds, audioSeconds / result.WallSeconds, static_cast<double>(result.FileBytes) / recording.Data.size(),
+            result.FileBytes / pcmBytes, storedBits, ok ? "ok" : "FAILED");
+        passed = passed && ok;
+        if (threads == maxThreads)
+        {
+            break;
+        }
+    }
+
+    //
+    //  The other formats, in blocks that leave a short last frame.
+    //
+    struct FormatCase
+    {
+        const char* Name;
+        bool        IsFloat;
+        WORD        Bits;
+        WORD        Channels;
+        uint32_t    Rate;
+        DWORD       ChannelMask;
+    };
+    static const FormatCase formatCases[] =
+    {
+        { "16 bit stereo 44.1 kHz", false, 16, 2, 44100, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT },
+        { "24 bit 5.1 48 kHz", false, 24, 6, 48000, 0x3F },
+        { "32 bit mono 96 kHz", false, 32, 1, 96000, SPEAKER_FRONT_CENTER },
+        { "float 7.1 48 kHz", true, 32, 8, 48000, 0x63F },
+    };
+    for (size_t i = 0; i < sizeof(formatCases) / sizeof(formatCases[0]); i++)
+    {
+        const FormatCase& test = formatCases[i];
+        Recording shortRecording;
+        MakeRecording(test.IsFloat, test.Bits, test.Channels, test.Rate, test.ChannelMask, 10.0, &shortRecording);
+        EncodeResult result;
+        bool ok = EncodeAndCheck(shortRecording, fileName, 1000, 3, flacTool, &result);
+        unlink(fileName.c_str());
+        printf("%s: %llu frames in %llu FLAC frames, %.3f of the input: %s\n", test.Name,
+            static_cast<unsigned long long>(result.Stats.SamplesEncoded), static_cast<unsigned long long>(result.Stats.FramesEncoded),
+            static_cast<double>(result.FileBytes) / shortRecording.Data.size(), ok ? "ok" : "FAILED");
+        passed = passed && ok;
+    }
+    printf("%s\n", passed ? "ok" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,292 @@
+//
+//  Stream switch test on Linux.
+//
+//  A mock capture client feeds CCaptureDrain a 1 kHz sine over a DC offset, so no frame of it is ever zero, into a
+//  48 kHz stereo ring, and switches its format mid-stream the way a device change does: to 44.1 kHz 5.1, to 96 kHz
+//  mono and back to 48 kHz stereo, with a different gap before each.  The test checks that
+//
+//  - each gap is a run of exactly as many silent ring frames as it lasted at 48 kHz, right where the switch
+//    happened, with the signal on either side of it;
+//  - after each switch the ring still holds the same 48 kHz stereo: once the adapter's resampler has settled, both
+//    channels fit a 1 kHz sine at 48 kHz closely, and the frames add up to what each format delivered at 48 kHz;
+//  - the drain's stats count the switches and their silence, and nothing was discarded.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+#include "AudioFormat.h"
+#include "CaptureDrain.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static const double Pi = 3.14159265358979323846;
+static const uint32_t RingRate = 48000;
+static const WORD RingChannels = 2;
+static const double ToneFrequency = 1000.0;
+
+//
+//  Each stretch of the stream: its format, and the gap before it in 100 ns units.  The first has no gap.
+//
+struct StreamSegment
+{
+    uint32_t    Rate;
+    WORD        Channels;
+    DWORD       ChannelMask;
+    int64_t     GapInHns;
+};
+
+static const StreamSegment StreamSegments[] =
+{
+    { 48000, 2, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT, 0 },
+    { 44100, 6, 0x3F, 200000 },
+    { 96000, 1, SPEAKER_FRONT_CENTER, 125000 },
+    { 48000, 2, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT, 50000 },
+};
+
+//
+//  Delivers 10 ms packets of the sine over DC on the front left and right (or the only channel), zeros on the
+//  others.  The sine's phase follows the time delivered, in whatever format.
+//
+class CSwitchPacketClient : public ICapturePacketClient
+{
+public:
+    CSwitchPacketClient() : _Rate(0), _Channels(0), _Position(0), _Time(0.0), _Pending(0) {}
+
+    void SetFormat(uint32_t Rate, WORD Channels)
+    {
+        _Rate = Rate;
+        _Channels = Channels;
+        _Position = 0;
+        _Data.assign(Rate / 100 * Channels, 0.0f);
+    }
+
+    void Queue() { _Pending = _Rate / 100; }
+
+    bool GetNextPacketSize(uint32_t* Frames)
+    {
+        *Frames = _Pending;
+        return true;
+    }
+
+    bool GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition)
+    {
+        for (uint32_t i = 0; i < _Pending; i++)
+        {
+            float sample = static_cast<float>(0.5 + 0.25 * sin(2.0 * Pi * ToneFrequency * (_Time + static_cast<double>(i) / _Rate)));
+            for (WORD channel = 0; channel < _Channels; channel++)
+            {
+                _Data[i * _Channels + channel] = channel < 2 ? sample : 0.0f;
+            }
+        }
+        *Data = reinterpret_cast<uint8_t*>(&_Data[0]);
+        *Frames = _Pending;
+        *Flags = 0;
+        *DevicePosition = _Position;
+        *QPCPosition = 0;
+        return true;
+    }
+
+    bool ReleaseBuffer(uint32_t Frames)
+    {
+        _Position += Frames;
+        _Time += static_cast<double>(Frames) / _Rate;
+        _Pending = 0;
+        return true;
+    }
+
+private:
+    uint32_t            _Rate;
+    WORD                _Channels;
+    uint64_t            _Position;
+    double              _Time;
+    uint32_t            _Pending;
+    std::vector<float>  _Data;
+};
+
+//
+//  Least squares fit of a sin + b cos + c at ToneFrequency to Count frames of Channel from Start, at the ring's
+//  rate.  Returns the RMS of what is left relative to the sine's RMS.
+//
+static double FitResidual(const std::vector<float>& Frames, size_t Start, size_t Count, WORD Channel)
+{
+    double normal[3][4] = {};
+    for (size_t n = Start; n < Start + Count; n++)
+    {
+        double phase = 2.0 * Pi * ToneFrequency * static_cast<double>(n) / RingRate;
+        double basis[3] = { sin(phase), cos(phase), 1.0 };
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 3; column++)
+            {
+                normal[row][column] += basis[row] * basis[column];
+            }
+            normal[row][3] += basis[row] * Frames[n * RingChannels + Channel];
+        }
+    }
+    for (int pivot = 0; pivot < 3; pivot++)
+    {
+        for (int row = pivot + 1; row < 3; row++)
+        {
+            double factor = normal[row][pivot] / normal[pivot][pivot];
+            for (int column = pivot; column < 4; column++)
+            {
+                normal[row][column] -= factor * normal[pivot][column];
+            }
+        }
+    }
+    double solution[3];
+    for (int row = 2; row >= 0; row--)
+    {
+        double sum = normal[row][3];
+        for (int column = row + 1; column < 3; column++)
+        {
+            sum -= normal[row][column] * solution[column];
+        }
+        solution[row] = sum / normal[row][row];
+    }
+
+    double energy = 0.0;
+    for (size_t n = Start; n < Start + Count; n++)
+    {
+        double phase = 2.0 * Pi * ToneFrequency * static_cast<double>(n) / RingRate;
+        double error = Frames[n * RingChannels + Channel] - (solution[0] * sin(phase) + solution[1] * cos(phase) + solution[2]);
+        energy += error * error;
+    }
+    double amplitude = sqrt(solution[0] * solution[0] + solution[1] * solution[1]);
+    return amplitude > 0.0 ? sqrt(energy / Count) / (amplitude / sqrt(2.0)) : 1.0;
+}
+
+static bool IsSilentFrame(const std::vector<float>& Frames, size_t Frame)
+{
+    for (WORD channel = 0; channel < RingChannels; channel++)
+    {
+        if (Frames[Frame * RingChannels + channel] != 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+//
+//  Reads everything in the ring onto the end of Frames.
+//
+static void ReadAll(CCaptureRingBuffer* Ring, std::vector<float>* Frames)
+{
+    size_t frames = Ring->ReadableFrames();
+    size_t first = Frames->size();
+    Frames->resize(first + frames * RingChannels);
+    Ring->Read(reinterpret_cast<uint8_t*>(&(*Frames)[first]), frames);
+}
+
+int main(int argc, char* argv[])
+{
+    double seconds = atof(GetArg(argc, argv, "--seconds", "1"));
+    if (seconds < 0.5)
+    {
+        fprintf(stderr, "Usage: %s [--seconds per format, at least 0.5]\n", argv[0]);
+        return 1;
+    }
+
+    WAVEFORMATEXTENSIBLE ringFormat;
+    InitializeWaveFormat(&ringFormat, true, RingChannels, RingRate, 32, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT);
+    CaptureProcessing processing = {};
+    CCaptureRingBuffer ring;
+    CCaptureDrain drain;
+    if (!ring.Initialize(RingRate, ringFormat.Format.nBlockAlign) || !drain.Attach(&ring, &processing, &ringFormat.Format))
+    {
+        fprintf(stderr, "Unable to set up the drain.\n");
+        return 1;
+    }
+
+    const size_t segmentCount = sizeof(StreamSegments) / sizeof(StreamSegments[0]);
+    const uint32_t packets = static_cast<uint32_t>(seconds * 100);
+    CSwitchPacketClient client;
+    std::vector<float> frames;
+    uint64_t expectedSilence = 0;
+    bool passed = true;
+    for (size_t s = 0; s < segmentCount; s++)
+    {
+        const StreamSegment& segment = StreamSegments[s];
+        WAVEFORMATEXTENSIBLE format;
+        InitializeWaveFormat(&format, true, segment.Channels, segment.Rate, 32, segment.ChannelMask);
+        client.SetFormat(segment.Rate, segment.Channels);
+
+        size_t gapStart = frames.size() / RingChannels;
+        size_t gapFrames = static_cast<size_t>(segment.GapInHns * RingRate / 10000000);
+        if (s != 0)
+        {
+            if (!drain.SwitchFormat(&format.Format, segment.GapInHns))
+            {
+                fprintf(stderr, "The switch to %u Hz %u channels failed.\n", segment.Rate, segment.Channels);
+                return 1;
+            }
+            expectedSilence += gapFrames;
+        }
+        for (uint32_t packet = 0; packet < packets; packet++)
+        {
+            client.Queue();
+            if (!drain.Drain(&client))
+            {
+                fprintf(stderr, "The drain failed.\n");
+                return 1;
+            }
+            ReadAll(&ring, &frames);
+        }
+        size_t segmentEnd = frames.size() / RingChannels;
+
+        //
+        //  The gap: exactly gapFrames of silence, between frames that aren't.
+        //
+        size_t silentRun = 0;
+        while (gapStart + silentRun < segmentEnd && IsSilentFrame(frames, gapStart + silentRun))
+        {
+            silentRun++;
+        }
+        bool gapOk = silentRun == gapFrames && (gapStart == 0 || !IsSilentFrame(frames, gapStart - 1));
+
+        //
+        //  The rest: what the format delivered, at 48 kHz give or take the resampler's delay, and a clean 1 kHz sine
+        //  at 48 kHz on both channels over the last half of it.
+        //
+        double expectedFrames = static_cast<double>(packets) * (segment.Rate / 100) * RingRate / segment.Rate;
+        double frameError = static_cast<double>(segmentEnd - gapStart - gapFrames) - expectedFrames;
+        size_t fitCount = (segmentEnd - gapStart) / 2;
+        double residual = 0.0;
+        for (WORD channel = 0; channel < RingChannels; channel++)
+        {
+            double channelResidual = FitResidual(frames, segmentEnd - fitCount, fitCount, channel);
+            residual = channelResidual > residual ? channelResidual : residual;
+        }
+        bool ok = gapOk && fabs(frameError) <= 64.0 && residual < 1e-3;
+        printf("%5u Hz %uch: gap of %zu silent frames (expected %zu), %+.0f frames against %.0f, 1 kHz at 48 kHz "
+            "residual %.1f dB: %s\n", segment.Rate, segment.Channels, silentRun, gapFrames, frameError, expectedFrames,
+            20.0 * log10(residual + 1e-12), ok ? "ok" : "FAILED");
+        passed = passed && ok;
+    }
+
+    CaptureDrainStats stats;
+    drain.GetStats(&stats);
+    bool statsOk = stats.StreamSwitches == segmentCount - 1 && stats.SwitchSilenceFrames == expectedSilence &&
+        stats.DiscardedFrames == 0 && stats.Glitches == 0 && stats.FramesMoved == frames.size() / RingChannels &&
+        ring.FrameSize() == ringFormat.Format.nBlockAlign;
+    printf("%llu switches, %llu silent frames (expected %llu), %llu discarded, %llu glitches: %s\n",
+        static_cast<unsigned long long>(stats.StreamSwitches), static_cast<unsigned long long>(stats.SwitchSilenceFrames),
+        static_cast<unsigned long long>(expectedSilence), static_cast<unsigned long long>(stats.DiscardedFrames),
+        static_cast<unsigned long long>(stats.Glitches), statsOk ? "ok" : "FAILED");
+    passed = passed && statsOk;
+    printf("%s\n", passed ? "ok" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,310 @@
+//
+//  Throughput benchmark of the framed stream through a pipe on Linux.
+//
+//  By default a forked writer streams --mb of audio through CStreamSink into a FIFO as fast as it can, in 1 MB
+//  writes like the writer thread's, and this process reads and checks it: every block header, the sequence and
+//  frame continuity, and the payload pattern.  --policy drop with --reader-delay-us shows a slow reader; the gaps the
+//  reader sees must add up to exactly what the writer counted as dropped.
+//
+//  --read parses a stream on stdin instead, e.g. audio_capture_cli --output - | audio_capture_stream_bench --read
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "CaptureDrain.h"
+#include "StreamSink.h"
+
+struct ReaderResult
+{
+    uint64_t Blocks;
+    uint64_t PayloadBytes;
+    uint64_t Frames;
+    uint64_t GapFrames;         // Frames skipped between blocks.
+    uint64_t SequenceGaps;      // Blocks skipped between blocks.
+    uint64_t DiscontinuityBlocks;
+    uint64_t SilentBlocks;
+    uint64_t CorruptBlocks;     // Payload doesn't match the writer's pattern.
+    bool     EndOfStream;
+    bool     Valid;
+};
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static bool ReadExactly(int Fd, void* Buffer, size_t Size)
+{
+    uint8_t* data = static_cast<uint8_t*>(Buffer);
+    while (Size > 0)
+    {
+        ssize_t bytesRead = read(Fd, data, Size);
+        if (bytesRead <= 0)
+        {
+            return false;
+        }
+        data += bytesRead;
+        Size -= static_cast<size_t>(bytesRead);
+    }
+    return true;
+}
+
+//
+//  Parse a framed stream.  With CheckPattern, every 32 bit word of the payload must be its frame position.
+//
+static ReaderResult ReadStream(int Fd, bool CheckPattern, uint32_t DelayUs, FramedStreamHeader* Header)
+{
+    ReaderResult result;
+    memset(&result, 0, sizeof(result));
+    if (!ReadExactly(Fd, Header, sizeof(*Header)) || Header->Magic != FRAMED_STREAM_MAGIC ||
+        Header->HeaderSize != sizeof(FramedStreamHeader) || Header->BlockHeaderSize != sizeof(FramedStreamBlockHeader) ||
+        Header->Format.Format.nBlockAlign == 0)
+    {
+        fprintf(stderr, "Bad stream header.\n");
+        return result;
+    }
+
+    const size_t frameSize = Header->Format.Format.nBlockAlign;
+    std::vector<uint8_t> payload;
+    uint64_t nextSequence = 0;
+    uint64_t nextFrame = 0;
+    for (;;)
+    {
+        FramedStreamBlockHeader block;
+        if (!ReadExactly(Fd, &block, sizeof(block)) || block.Magic != FRAMED_STREAM_BLOCK_MAGIC ||
+            block.PayloadSize % frameSize != 0 || block.Sequence < nextSequence || block.Frame < nextFrame)
+        {
+            fprintf(stderr, "Bad block header after %llu blocks.\n", static_cast<unsigned long long>(result.Blocks));
+            return result;
+        }
+        result.SequenceGaps += block.Sequence - nextSequence;
+        result.GapFrames += block.Frame - nextFrame;
+        if (block.Flags & FRAMED_STREAM_FLAG_END_OF_STREAM)
+        {
+            result.EndOfStream = true;
+            result.Valid = true;
+            return result;
+        }
+
+        payload.resize(block.PayloadSize);
+        if (!ReadExactly(Fd, payload.data(), payload.size()))
+        {
+            fprintf(stderr, "Stream ended inside a block.\n");
+            return result;
+        }
+        uint64_t frames = block.PayloadSize / frameSize;
+        if (CheckPattern)
+        {
+            for (uint64_t i = 0; i < frames; i++)
+            {
+                uint32_t word;
+                memcpy(&word, &payload[i * frameSize], sizeof(word));
+                if (word != static_cast<uint32_t>(block.Frame + i))
+                {
+                    result.CorruptBlocks++;
+                    break;
+                }
+            }
+        }
+        result.Blocks++;
+        result.PayloadBytes += block.PayloadSize;
+        result.Frames += frames;
+        result.DiscontinuityBlocks += (block.Flags & FRAMED_STREAM_FLAG_DISCONTINUITY) != 0;
+        result.SilentBlocks += (block.Flags & FRAMED_STREAM_FLAG_SILENT) != 0;
+        nextSequence = block.Sequence + 1;
+        nextFrame = block.Frame + frames;
+        if (DelayUs != 0)
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(DelayUs));
+        }
+    }
+}
+
+static void PrintResult(const ReaderResult& Result, double Seconds)
+{
+    printf("Read %llu blocks, %.1f MB of audio in %.3f s (%.1f MB/s)\n", static_cast<unsigned long long>(Result.Blocks),
+        Result.PayloadBytes / 1048576.0, Seconds, Result.PayloadBytes / 1048576.0 / Seconds);
+    printf("Gaps: %llu frames in %llu skipped blocks, %llu discontinuity blocks, %llu silent blocks, %llu corrupt blocks%s\n",
+        static_cast<unsigned long long>(Result.GapFrames), static_cast<unsigned long long>(Result.SequenceGaps),
+        static_cast<unsigned long long>(Result.DiscontinuityBlocks), static_cast<unsigned long long>(Result.SilentBlocks),
+        static_cast<unsigned long long>(Result.CorruptBlocks), Result.EndOfStream ? "" : ", no end of stream");
+}
+
+//
+//  Child: stream MB megabytes of 48 kHz stereo float whose first sample of each frame is its position, and report
+//  the sink's stats through StatsPipe.
+//
+static int RunWriter(const std::string& Fifo, uint32_t MB, StreamSlowReaderPolicy Policy, uint32_t BlockFrames, int StatsPipe)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, 2, 48000, 32, 0);
+    const size_t frameSize = format.Format.nBlockAlign;
+
+    //
+    //  Feed the sink a packet log like the drain's: 10 ms packets, every 50th one silent.
+    //
+    CCapturePacketLog packetLog;
+    packetLog.Initialize(4096);
+    CStreamSink sink;
+    if (!sink.Open(Fifo, &format.Format, true, Policy, BlockFrames, &packetLog))
+    {
+        return 1;
+    }
+
+    const size_t chunkFrames = 1024 * 1024 / frameSize;
+    std::vector<uint8_t> chunk(chunkFrames * frameSize, 0);
+    uint64_t totalFrames = static_cast<uint64_t>(MB) * 1024 * 1024 / frameSize;
+    uint64_t packetIndex = 0;
+    int64_t timeNs = 0;
+    for (uint64_t frame = 0; frame < totalFrames; frame += chunkFrames)
+    {
+        size_t frames = static_cast<size_t>(std::min<uint64_t>(chunkFrames, totalFrames - frame));
+        for (size_t i = 0; i < frames; i++)
+        {
+            uint32_t word = static_cast<uint32_t>(frame + i);
+            memcpy(&chunk[i * frameSize], &word, sizeof(word));
+        }
+        for (uint64_t packet = frame; packet < frame + frames; packet += 480)
+        {
+            uint64_t packetFrames = std::min<uint64_t>(480, frame + frames - packet);
+            CapturePacketRecord record = { packet, packetFrames, packetIndex++ % 50 == 49 ? CAPTURE_PACKET_FLAG_SILENT : 0u, 0, timeNs, timeNs,
+                packet };
+            packetLog.Append(record);
+            timeNs += 10000000;
+        }
+        packetLog.Publish();
+        if (!sink.Write(&chunk[0], frames * frameSize))
+        {
+            return 1;
+        }
+    }
+    bool closed = sink.Close();
+
+    StreamSinkStats stats;
+    sink.GetStats(&stats);
+    if (write(StatsPipe, &stats, sizeof(stats)) != sizeof(stats))
+    {
+        return 1;
+    }
+    return closed ? 0 : 1;
+}
+
+int main(int argc, char* argv[])
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--read") == 0)
+        {
+            FramedStreamHeader header;
+            auto start = std::chrono::steady_clock::now();
+            ReaderResult result = ReadStream(STDIN_FILENO, false, 0, &header);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (result.Valid || result.Blocks != 0)
+            {
+                printf("Format: %u Hz, %u channels, %u bits\n", header.Format.Format.nSamplesPerSec,
+                    header.Format.Format.nChannels, header.Format.Format.wBitsPerSample);
+                PrintResult(result, seconds);
+            }
+            return result.Valid ? 0 : 1;
+        }
+    }
+
+    uint32_t mb = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--mb", "2048")));
+    std::string policyName = GetArg(argc, argv, "--policy", "block");
+    uint32_t blockFrames = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--block-frames", "480")));
+    uint32_t delayUs = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--reader-delay-us", "0")));
+    if (mb == 0 || blockFrames == 0 || (policyName != "block" && policyName != "drop"))
+    {
+        fprintf(stderr, "Usage: %s [--mb N] [--policy block|drop] [--block-frames N] [--reader-delay-us N]\n"
+            "       %s --read < stream\n", argv[0], argv[0]);
+        return 1;
+    }
+
+    std::string fifo = "/tmp/audio_capture_stream_bench_" + std::to_string(getpid());
+    int statsPipe[2];
+    if (pipe(statsPipe) != 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+    pid_t writer = fork();
+    if (writer < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+    if (writer == 0)
+    {
+        close(statsPipe[0]);
+        _exit(RunWriter(fifo, mb, policyName == "drop" ? StreamSlowReaderDrop : StreamSlowReaderBlock, blockFrames, statsPipe[1]));
+    }
+    close(statsPipe[1]);
+
+    //
+    //  The writer creates the FIFO and then waits in open() for us.
+    //
+    int fd = -1;
+    for (int attempt = 0; attempt < 5000 && fd < 0; attempt++)
+    {
+        struct stat status;
+        if (stat(fifo.c_str(), &status) == 0 && S_ISFIFO(status.st_mode))
+        {
+            fd = open(fifo.c_str(), O_RDONLY);
+        }
+        else
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    if (fd < 0)
+    {
+        fprintf(stderr, "Writer never created %s\n", fifo.c_str());
+        kill(writer, SIGKILL);
+        waitpid(writer, NULL, 0);
+        return 1;
+    }
+
+    FramedStreamHeader header;
+    auto start = std::chrono::steady_clock::now();
+    ReaderResult result = ReadStream(fd, true, delayUs, &header);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    close(fd);
+    unlink(fifo.c_str());
+
+    StreamSinkStats stats;
+    bool haveStats = ReadExactly(statsPipe[0], &stats, sizeof(stats));
+    int status = 0;
+    waitpid(writer, &status, 0);
+    if (!haveStats || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "Writer failed.\n");
+        return 1;
+    }
+
+    PrintResult(result, seconds);
+    printf("Writer: %llu blocks sent, %llu dropped (%llu frames), blocked %.1f ms in total, %.1f ms at most\n",
+        static_cast<unsigned long long>(stats.BlocksSent), static_cast<unsigned long long>(stats.BlocksDropped),
+        static_cast<unsigned long long>(stats.FramesDropped), stats.BlockedUs / 1000.0, stats.MaxBlockedUs / 1000.0);
+
+    bool consistent = result.Valid && result.CorruptBlocks == 0 && result.GapFrames == stats.FramesDropped &&
+        result.SequenceGaps == stats.BlocksDropped && result.Blocks == stats.BlocksSent;
+    printf("%s\n", consistent ? "Reader and writer agree." : "MISMATCH between reader and writer.");
+    return consistent ? 0 : 1;
+}
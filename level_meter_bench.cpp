@@ -0,0 +1,572 @@
+//
+//  Level meter benchmark and check on Linux.
+//
+//  Checks the meter against signals whose levels are known: sines of a different amplitude on every channel, for
+//  channel counts that do and don't divide the vector width, with every kernel agreeing with the scalar one; a
+//  quarter sample rate sine whose samples all miss its crests by 3 dB, for the true peak; silence; readings, the
+//  latest and older ones from the history, picked up by another thread while the capture thread publishes them as
+//  fast as it can, which must never be torn; and the meter running inside CCaptureDrain.
+//
+//  Then it times a 10 ms packet of --channels channel float (default 2): CCaptureDrain copying it into the ring,
+//  which is the capture thread's cost per packet without metering; a plain memcpy; the meter alone, with every kernel,
+//  with and without copying the packet as it goes, and with the true peak; and the drain again with the fastest meter
+//  in it, which then copies the packet into the ring in the pass that meters it.  The budget is for a packet staying
+//  in the cache, the meter's worst case: what its peak and RMS add to the drain must be at most --max-percent
+//  (default 200) percent of a memcpy of the packet.  Metering takes three vector operations for every register the
+//  copy only moves, so it cannot come in under about one memcpy; a meter taking its own pass over the packet again
+//  would need over twice that.  Packets taken in turn from --pool-mb (default 64) MB, more than the caches hold, and
+//  the true peak, which is opt-in, are only printed.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AudioFormat.h"
+#include "CaptureDrain.h"
+#include "LevelMeter.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const uint32_t SampleRate = 48000;
+static const uint32_t PacketFrames = 480;
+static const double Pi = 3.14159265358979323846;
+
+static const SampleConvertKernel Kernels[] = { SampleKernelScalar, SampleKernelSse2, SampleKernelAvx2 };
+
+static double Db(double Level)
+{
+    return Level > 0 ? 20.0 * log10(Level) : -200.0;
+}
+
+//
+//  Frames of a sine on every channel, channel c at Amplitude / (c + 1), each channel a little out of phase.
+//
+static std::vector<float> MakeSine(WORD Channels, size_t Frames, double Frequency, double Amplitude, double Phase)
+{
+    std::vector<float> samples(Frames * Channels);
+    for (size_t frame = 0; frame < Frames; frame++)
+    {
+        for (WORD channel = 0; channel < Channels; channel++)
+        {
+            samples[frame * Channels + channel] = static_cast<float>(Amplitude / (channel + 1) *
+                sin(2 * Pi * Frequency * frame / SampleRate + Phase + channel * 0.1));
+        }
+    }
+    return samples;
+}
+
+static bool Near(double Value, double Expected, double Tolerance)
+{
+    return fabs(Value - Expected) <= Tolerance;
+}
+
+//
+//  A 997 Hz sine with a peak of -6 dBFS on the first channel, fed in uneven pieces; every interval's reading must
+//  match the sine's peak and RMS, and the scalar kernel's reading.  The meter copies the samples as the drain has it
+//  do, and the copy must come out the same as them.
+//
+static bool CheckLevels(WORD Channels, SampleConvertKernel Kernel)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, Channels, SampleRate, 32, 0);
+    const uint32_t interval = SampleRate / 10;
+    CLevelMeter meter;
+    CLevelMeter reference;
+    if (!meter.Initialize(&format.Format, interval, false, Kernel) || !reference.Initialize(&format.Format, interval, false, SampleKernelScalar))
+    {
+        return false;
+    }
+    if (meter.Kernel() != Kernel)
+    {
+        return true;
+    }
+
+    std::vector<float> samples = MakeSine(Channels, SampleRate, 997, 0.5, 0);
+    std::vector<float> copy(samples.size(), -1.0f);
+    const size_t pieces[] = { 457, 1, 3000, 64, 1201 };
+    bool passed = true;
+    uint64_t sequence = 0;
+    size_t frame = 0;
+    for (size_t i = 0; frame < SampleRate; i++)
+    {
+        size_t frames = std::min(pieces[i % (sizeof(pieces) / sizeof(pieces[0]))], SampleRate - frame);
+        meter.Process(&samples[frame * Channels], frames, &copy[frame * Channels]);
+        reference.Process(&samples[frame * Channels], frames);
+        frame += frames;
+
+        LevelMeterReading reading;
+        LevelMeterReading expected;
+        if (!meter.GetReading(&reading) || reading.Sequence == sequence)
+        {
+            continue;
+        }
+        if (reading.Sequence != sequence + 1 || reading.FirstFrame != sequence * interval || reading.Frames != interval ||
+            !reference.GetReading(&expected) || expected.Sequence != reading.Sequence || !reading.TruePeak.empty())
+        {
+            printf("  %u channels, %s: reading %llu out of order\n", Channels, SampleConvertKernelName(Kernel),
+                static_cast<unsigned long long>(reading.Sequence));
+            return false;
+        }
+        sequence = reading.Sequence;
+        for (WORD channel = 0; channel < Channels; channel++)
+        {
+            double amplitude = 0.5 / (channel + 1);
+            if (!Near(reading.Peak[channel], amplitude, amplitude * 0.005) ||
+                !Near(reading.Rms[channel], amplitude / sqrt(2.0), amplitude * 0.005) ||
+                reading.Peak[channel] != expected.Peak[channel] ||
+                !Near(reading.Rms[channel], expected.Rms[channel], expected.Rms[channel] * 1e-5))
+            {
+                printf("  %u channels, %s: reading %llu channel %u peak %.6f rms %.6f, expected %.6f %.6f, scalar %.6f %.6f\n",
+                    Channels, SampleConvertKernelName(Kernel), static_cast<unsigned long long>(sequence), channel,
+                    reading.Peak[channel], reading.Rms[channel], amplitude, amplitude / sqrt(2.0), expected.Peak[channel], expected.Rms[channel]);
+                passed = false;
+            }
+        }
+    }
+    if (sequence != SampleRate / interval)
+    {
+        printf("  %u channels, %s: %llu readings instead of %u\n", Channels, SampleConvertKernelName(Kernel),
+            static_cast<unsigned long long>(sequence), SampleRate / interval);
+        passed = false;
+    }
+    if (memcmp(&copy[0], &samples[0], samples.size() * sizeof(float)) != 0)
+    {
+        printf("  %u channels, %s: the meter's copy differs\n", Channels, SampleConvertKernelName(Kernel));
+        passed = false;
+    }
+    return passed;
+}
+
+//
+//  A sine at a quarter of the sample rate, 45 degrees off its crests, is sampled at 0.707 of its peak every time.
+//  The sample peak must say -3 dBFS and the true peak 0 dBFS.  Then silence must bring both down to nothing.
+//
+static bool CheckTruePeak(SampleConvertKernel Kernel, double* TruePeakDb)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, 2, SampleRate, 32, 0);
+    CLevelMeter meter;
+    if (!meter.Initialize(&format.Format, SampleRate / 10, true, Kernel))
+    {
+        return false;
+    }
+    std::vector<float> samples = MakeSine(2, SampleRate / 2, SampleRate / 4, 1.0, Pi / 4);
+    for (size_t channel = 1; channel < samples.size(); channel += 2)
+    {
+        samples[channel] = samples[channel - 1] * 0.5f;
+    }
+    meter.Process(&samples[0], samples.size() / 2);
+
+    LevelMeterReading reading;
+    if (!meter.GetReading(&reading) || reading.TruePeak.size() != 2)
+    {
+        printf("  True peak, %s: no reading\n", SampleConvertKernelName(Kernel));
+        return false;
+    }
+    bool passed = true;
+    for (size_t channel = 0; channel < 2; channel++)
+    {
+        double levelDb = Db(channel == 0 ? 1.0 : 0.5);
+        if (!Near(Db(reading.Peak[channel]), levelDb - 3.01, 0.05) || !Near(Db(reading.TruePeak[channel]), levelDb, 0.5))
+        {
+            printf("  True peak, %s: channel %zu peak %.2f dB true peak %.2f dB, expected %.2f dB and %.2f dB\n",
+                SampleConvertKernelName(Kernel), channel, Db(reading.Peak[channel]), Db(reading.TruePeak[channel]), levelDb - 3.01, levelDb);
+            passed = false;
+        }
+    }
+    *TruePeakDb = Db(reading.TruePeak[0]);
+
+    //
+    //  Two intervals of silence: the first still has the tail of the oversampler's filter, the second none.
+    //
+    meter.Process(NULL, SampleRate / 5);
+    if (!meter.GetReading(&reading) || reading.Peak[0] != 0 || reading.Rms[0] != 0 || reading.TruePeak[0] != 0 ||
+        reading.Peak[1] != 0 || reading.Rms[1] != 0 || reading.TruePeak[1] != 0)
+    {
+        printf("  Silence, %s: not silent\n", SampleConvertKernelName(Kernel));
+        passed = false;
+    }
+    return passed;
+}
+
+//
+//  The capture thread publishes a reading every 64 frames of a constant that changes every interval, and the main
+//  thread reads as fast as it can, the latest reading and one from half the history back.  A torn reading would mix
+//  the channels of two intervals, or not match its sequence.  Once the capture thread is done, exactly the last
+//  LEVEL_METER_HISTORY readings must still be there.
+//
+static bool CheckConcurrentReads(uint64_t* Readings)
+{
+    const WORD channels = 8;
+    const uint32_t interval = 64;
+    const uint32_t intervals = 200000;
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, channels, SampleRate, 32, 0);
+    CLevelMeter meter;
+    if (!meter.Initialize(&format.Format, interval, false))
+    {
+        return false;
+    }
+
+    std::atomic<bool> done(false);
+    std::thread capture([&meter, &done]
+    {
+        std::vector<float> samples(interval * channels);
+        for (uint32_t i = 0; i < intervals; i++)
+        {
+            std::fill(samples.begin(), samples.end(), static_cast<float>(i % 1000 + 1) / 1024);
+            meter.Process(&samples[0], interval);
+        }
+        done.store(true);
+    });
+
+    auto isWhole = [interval, channels](const LevelMeterReading& Reading)
+    {
+        float expected = static_cast<float>((Reading.Sequence - 1) % 1000 + 1) / 1024;
+        bool whole = Reading.FirstFrame == (Reading.Sequence - 1) * interval && Reading.Frames == interval;
+        for (WORD channel = 0; channel < channels && whole; channel++)
+        {
+            whole = Reading.Peak[channel] == expected && Near(Reading.Rms[channel], expected, expected * 1e-5);
+        }
+        if (!whole)
+        {
+            printf("  Concurrent reads: torn reading %llu\n", static_cast<unsigned long long>(Reading.Sequence));
+        }
+        return whole;
+    };
+
+    bool passed = true;
+    uint64_t readings = 0;
+    uint64_t last = 0;
+    LevelMeterReading reading;
+    LevelMeterReading older;
+    while (!done.load() && passed)
+    {
+        if (!meter.GetReading(&reading))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+        passed = reading.Sequence >= last && isWhole(reading);
+        uint64_t olderSequence = reading.Sequence - LEVEL_METER_HISTORY / 2;
+        if (reading.Sequence > LEVEL_METER_HISTORY / 2 && meter.GetReading(olderSequence, &older))
+        {
+            passed = passed && older.Sequence == olderSequence && isWhole(older);
+            readings++;
+        }
+        last = reading.Sequence;
+        readings++;
+    }
+    capture.join();
+    *Readings = readings;
+
+    passed = passed && meter.LatestSequence() == intervals && meter.GetReading(&reading) && reading.Sequence == intervals;
+    for (uint64_t sequence = intervals - LEVEL_METER_HISTORY + 1; sequence <= intervals && passed; sequence++)
+    {
+        passed = meter.GetReading(sequence, &reading) && reading.Sequence == sequence && isWhole(reading);
+    }
+    return passed && !meter.GetReading(intervals - LEVEL_METER_HISTORY, &reading) && !meter.GetReading(intervals + 1, &reading);
+}
+
+//
+//  Hands the drain packets of PacketFrames float frames, taking them in turn from Packets, which holds one or many.
+//
+class CBenchPacketClient : public ICapturePacketClient
+{
+public:
+    CBenchPacketClient(const std::vector<float>& Packets, WORD Channels) :
+        _Packets(Packets), _PacketSize(PacketFrames * Channels), _PacketCount(Packets.size() / _PacketSize), _Next(0),
+        _Position(0), _Pending(0)
+    {
+    }
+
+    void QueuePackets(uint32_t Packets) { _Pending = Packets; }
+
+    bool GetNextPacketSize(uint32_t* Frames)
+    {
+        *Frames = _Pending != 0 ? PacketFrames : 0;
+        return true;
+    }
+
+    bool GetBuffer(uint8_t** Data, uint32_t* Frames, uint32_t* Flags, uint64_t* DevicePosition, uint64_t* QPCPosition)
+    {
+        *Data = reinterpret_cast<uint8_t*>(const_cast<float*>(&_Packets[_Next * _PacketSize]));
+        *Frames = PacketFrames;
+        *Flags = 0;
+        *DevicePosition = _Position;
+        *QPCPosition = 0;
+        return true;
+    }
+
+    bool ReleaseBuffer(uint32_t Frames)
+    {
+        _Position += Frames;
+        _Pending--;
+        _Next = _Next + 1 < _PacketCount ? _Next + 1 : 0;
+        return true;
+    }
+
+private:
+    const std::vector<float>&   _Packets;
+    size_t                      _PacketSize;
+    size_t                      _PacketCount;
+    size_t                      _Next;
+    uint64_t                    _Position;
+    uint32_t                    _Pending;
+};
+
+//
+//  Nanoseconds per packet through CCaptureDrain, with Meter if it isn't NULL, emptying the ring every four packets.
+//  The drain must then hand out the meter's latest reading.
+//
+static double RunDrain(const std::vector<float>& Packet, WORD Channels, CLevelMeter* Meter, uint64_t Packets)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, Channels, SampleRate, 32, 0);
+    CCaptureRingBuffer ring;
+    CCaptureDrain drain;
+    CaptureProcessing processing = {};
+    processing.Meter = Meter;
+    if (!ring.Initialize(SampleRate, format.Format.nBlockAlign) || !drain.Attach(&ring, &processing, &format.Format))
+    {
+        return -1;
+    }
+    CBenchPacketClient client(Packet, Channels);
+    const uint32_t packetsPerWakeup = 4;
+    int64_t start = SteadyClockNs();
+    for (uint64_t packet = 0; packet < Packets; packet += packetsPerWakeup)
+    {
+        client.QueuePackets(packetsPerWakeup);
+        if (!drain.Drain(&client))
+        {
+            return -1;
+        }
+        CaptureRingRegion regions[2];
+        ring.CommitRead(ring.BeginRead(ring.FrameCapacity(), regions));
+    }
+    int64_t elapsed = SteadyClockNs() - start;
+
+    CaptureDrainStats stats;
+    drain.GetStats(&stats);
+    if (stats.DiscardedFrames != 0 || stats.FramesMoved != Packets * PacketFrames)
+    {
+        return -1;
+    }
+    if (Meter != NULL)
+    {
+        LevelMeterReading fromDrain;
+        LevelMeterReading fromMeter;
+        if (!drain.GetLevels(&fromDrain) || !Meter->GetReading(&fromMeter) || fromDrain.Sequence != fromMeter.Sequence ||
+            fromDrain.Sequence != Packets * PacketFrames / Meter->IntervalFrames())
+        {
+            return -1;
+        }
+    }
+    return static_cast<double>(elapsed) / Packets;
+}
+
+//
+//  The quickest of Repeat runs of Run, in nanoseconds per packet.
+//
+template <typename RunFunction>
+static double Quickest(uint32_t Repeat, RunFunction Run)
+{
+    double quickest = 1e18;
+    for (uint32_t i = 0; i < Repeat; i++)
+    {
+        double value = Run();
+        if (value < 0)
+        {
+            return -1;
+        }
+        quickest = std::min(quickest, value);
+    }
+    return quickest;
+}
+
+static double RunMemcpy(const std::vector<float>& Packet, uint64_t Packets)
+{
+    std::vector<float> destination(Packet.size());
+    int64_t start = SteadyClockNs();
+    for (uint64_t packet = 0; packet < Packets; packet++)
+    {
+        memcpy(&destination[0], &Packet[0], Packet.size() * sizeof(float));
+        __asm__ __volatile__("" : : "r"(&destination[0]) : "memory");
+    }
+    return static_cast<double>(SteadyClockNs() - start) / Packets;
+}
+
+static double RunMeter(CLevelMeter* Meter, const std::vector<float>& Packet, WORD Channels, uint64_t Packets, bool Copy)
+{
+    std::vector<float> destination(Packet.size());
+    int64_t start = SteadyClockNs();
+    for (uint64_t packet = 0; packet < Packets; packet++)
+    {
+        Meter->Process(&Packet[0], Packet.size() / Channels, Copy ? &destination[0] : NULL);
+        __asm__ __volatile__("" : : "r"(&destination[0]) : "memory");
+    }
+    return static_cast<double>(SteadyClockNs() - start) / Packets;
+}
+
+//
+//  Nanoseconds per packet through the drain taking Packets, without a meter and with the fastest one, with or
+//  without the true peak.  Runs with and without it take turns, so the machine speeding up or slowing down lands on
+//  both, and the quickest of each kind counts, since anything else running only ever slows a run down.  This also
+//  checks that the drain hands out the meter's readings.
+//
+static bool CompareDrains(const std::vector<float>& Packets, WORD Channels, uint64_t PacketCount, uint32_t Repeat, bool TruePeak,
+    double* PlainNs, double* MeteredNs, SampleConvertKernel* Kernel)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, Channels, SampleRate, 32, 0);
+    *PlainNs = 1e18;
+    *MeteredNs = 1e18;
+    for (uint32_t i = 0; i < Repeat; i++)
+    {
+        CLevelMeter meter;
+        if (!meter.Initialize(&format.Format, SampleRate / 10, TruePeak))
+        {
+            return false;
+        }
+        *Kernel = meter.Kernel();
+        double plainNs = RunDrain(Packets, Channels, NULL, PacketCount);
+        double meteredNs = RunDrain(Packets, Channels, &meter, PacketCount);
+        if (plainNs < 0 || meteredNs < 0)
+        {
+            return false;
+        }
+        *PlainNs = std::min(*PlainNs, plainNs);
+        *MeteredNs = std::min(*MeteredNs, meteredNs);
+    }
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    int channelsArg = atoi(GetArg(argc, argv, "--channels", "2"));
+    double maxPercent = atof(GetArg(argc, argv, "--max-percent", "200"));
+    int poolMb = atoi(GetArg(argc, argv, "--pool-mb", "64"));
+    int packetsArg = atoi(GetArg(argc, argv, "--packets", "1000000"));
+    uint32_t repeat = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--repeat", "5")));
+    if (channelsArg <= 0 || channelsArg > 64 || maxPercent <= 0 || poolMb <= 0 || packetsArg <= 0 || repeat == 0)
+    {
+        fprintf(stderr, "Usage: %s [--channels N] [--max-percent X] [--pool-mb N] [--packets N] [--repeat N]\n", argv[0]);
+        return 1;
+    }
+    WORD channels = static_cast<WORD>(channelsArg);
+    uint64_t packets = static_cast<uint64_t>(packetsArg) / 4 * 4;
+    size_t poolPackets = (static_cast<size_t>(poolMb) << 20) / (PacketFrames * channels * sizeof(float)) + 1;
+
+    bool passed = true;
+    static const WORD checkChannels[] = { 1, 2, 3, 6, 7, 8, 12 };
+    for (size_t i = 0; i < sizeof(Kernels) / sizeof(Kernels[0]); i++)
+    {
+        bool levels = true;
+        for (size_t j = 0; j < sizeof(checkChannels) / sizeof(checkChannels[0]); j++)
+        {
+            levels = CheckLevels(checkChannels[j], Kernels[i]) && levels;
+        }
+        double truePeakDb = 0;
+        bool truePeak = CheckTruePeak(Kernels[i], &truePeakDb);
+        printf("Levels, %s kernel: %s; true peak of a -3 dBFS sampled 0 dBFS sine %.2f dBFS: %s\n", SampleConvertKernelName(Kernels[i]),
+            levels ? "ok" : "FAILED", truePeakDb, truePeak ? "ok" : "FAILED");
+        passed = passed && levels && truePeak;
+    }
+    uint64_t readings = 0;
+    bool concurrent = CheckConcurrentReads(&readings);
+    printf("Concurrent reads: %llu readings, %s\n", static_cast<unsigned long long>(readings), concurrent ? "none torn" : "FAILED");
+    passed = passed && concurrent;
+
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, channels, SampleRate, 32, 0);
+    std::vector<float> packet = MakeSine(channels, PacketFrames, 997, 0.5, 0);
+    double drainNs = Quickest(repeat, [&] { return RunDrain(packet, channels, NULL, packets); });
+    double copyNs = Quickest(repeat, [&] { return RunMemcpy(packet, packets); });
+    if (drainNs < 0)
+    {
+        printf("Drain FAILED.\n");
+        return 1;
+    }
+    printf("Per %u frame packet of %u channels, quickest of %u runs: drain %.1f ns, memcpy %.1f ns\n", PacketFrames, channels,
+        repeat, drainNs, copyNs);
+
+    for (size_t i = 0; i < sizeof(Kernels) / sizeof(Kernels[0]); i++)
+    {
+        for (int truePeak = 0; truePeak < 2; truePeak++)
+        {
+            CLevelMeter meter;
+            if (!meter.Initialize(&format.Format, SampleRate / 10, truePeak != 0, Kernels[i]))
+            {
+                return 1;
+            }
+            if (meter.Kernel() != Kernels[i])
+            {
+                if (truePeak == 0)
+                {
+                    printf("Meter %s: not available\n", SampleConvertKernelName(Kernels[i]));
+                }
+                break;
+            }
+            uint64_t meterPackets = truePeak != 0 ? packets / 200 : packets;
+            double meterNs = Quickest(repeat, [&] { return RunMeter(&meter, packet, channels, meterPackets, false); });
+            double copyingNs = Quickest(repeat, [&] { return RunMeter(&meter, packet, channels, meterPackets, true); });
+            printf("Meter %s%s: %.1f ns per packet, %.0fx real time; copying the packet as well, %.1f ns, %.1f ns more than memcpy\n",
+                SampleConvertKernelName(Kernels[i]), truePeak != 0 ? " with true peak" : "", meterNs, 1e7 / meterNs, copyingNs,
+                copyingNs - copyNs);
+        }
+    }
+
+    //
+    //  The fastest kernel inside the drain, which has it copy the packet into the ring in the pass that meters it.
+    //  The budget is against a plain memcpy of the packet, for the packet that stays in the cache, the worst case:
+    //  there the copy costs least and the meter's arithmetic shows most.  For packets taken in turn from more memory
+    //  than the caches hold, the way a device buffer comes in, and with the true peak, which is opt-in, what the meter
+    //  adds is only printed.
+    //
+    std::vector<float> pool = MakeSine(channels, poolPackets * PacketFrames, 997, 0.5, 0);
+    double cachedPlainNs;
+    double cachedNs;
+    double poolPlainNs;
+    double poolNs;
+    double truePeakPlainNs;
+    double truePeakNs;
+    SampleConvertKernel meteredKernel;
+    if (!CompareDrains(packet, channels, packets, repeat, false, &cachedPlainNs, &cachedNs, &meteredKernel) ||
+        !CompareDrains(pool, channels, packets, repeat, false, &poolPlainNs, &poolNs, &meteredKernel) ||
+        !CompareDrains(packet, channels, packets / 20, repeat, true, &truePeakPlainNs, &truePeakNs, &meteredKernel))
+    {
+        printf("Drain with meter FAILED.\n");
+        return 1;
+    }
+    double addedPercent = std::max(cachedNs - cachedPlainNs, 0.0) * 100 / copyNs;
+    bool fast = addedPercent <= maxPercent;
+    printf("Drain with %s meter, %zu MB of packets: %.1f ns per packet, peak and RMS add %.1f ns\n", SampleConvertKernelName(meteredKernel),
+        pool.size() * sizeof(float) >> 20, poolNs, poolNs - poolPlainNs);
+    printf("Drain with %s meter and true peak (opt-in, not in the budget), cached packet: %.1f ns per packet, the meter adds %.1f ns\n",
+        SampleConvertKernelName(meteredKernel), truePeakNs, truePeakNs - truePeakPlainNs);
+    printf("Drain with %s meter, cached packet: %.1f ns per packet, peak and RMS add %.1f ns, %.1f%% of a memcpy of the packet, "
+        "limit %.0f%%: %s\n", SampleConvertKernelName(meteredKernel), cachedNs, cachedNs - cachedPlainNs, addedPercent, maxPercent,
+        fast ? "ok" : "FAILED");
+    return passed && fast ? 0 : 1;
+}
@@ -0,0 +1,352 @@
+//
+//  Metrics overhead benchmark on Linux.
+//
+//  Records --seconds from the synthetic source in real time through the ring and the asynchronous writer into a
+//  temporary file, the way the CLI does, alternately without metrics and with every histogram recording and the
+//  exporter writing both its JSON lines and its Prometheus file every --metrics-ms, by default as often as the CLI
+//  does.  Every percentage is of the same denominator, printed first: the whole process's CPU time per second of
+//  audio without metrics, from getrusage(), the quietest of the runs.
+//
+//  The metrics' own cost is measured directly: every export must run on the exporter's own thread, never on the
+//  capture thread or the thread reading the ring, and the bench times each one by the exporter thread's CPU clock;
+//  to that it adds what the histograms cost the threads they record on, the values they recorded times the cost of a
+//  Record() and the clock read before it, each measured on its own.  That must come to less than --max-percent
+//  (default 1).  The process CPU time with metrics is compared with the time without them as well, but runs of the
+//  same kind differ by a few percent on their own, so that comparison only fails if it's over the limit by more than
+//  the spread between the runs without metrics.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <time.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#include "SyntheticCaptureSource.h"
+#include "OutputSink.h"
+#include "CaptureMetrics.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static double ProcessCpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static int64_t ThreadCpuNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+//
+//  The synthetic source, noting which thread it captures and drains on.
+//
+class CThreadLoggingSource : public CSyntheticCaptureSource
+{
+public:
+    std::thread::id CaptureThread() const { return _CaptureThread; }
+
+protected:
+    void OnStart()
+    {
+        _CaptureThread = std::this_thread::get_id();
+        CSyntheticCaptureSource::OnStart();
+    }
+
+private:
+    std::thread::id _CaptureThread;
+};
+
+//
+//  The pipeline's metrics, noting the threads the exports run on and the exporter thread's CPU time at each, read
+//  once everything has stopped.
+//
+class CTimedCaptureMetrics : public CCaptureMetrics
+{
+public:
+    CTimedCaptureMetrics() : _FirstCpuNs(0), _LastCpuNs(0), _Collects(0) {}
+
+    const std::set<std::thread::id>& ExportThreads() const { return _ExportThreads; }
+
+    //
+    //  The exporter thread's CPU time per export, from the first to the last: collecting, snapshotting the
+    //  histograms and writing both files.
+    //
+    double ExportCpuNs() const { return _Collects > 1 ? static_cast<double>(_LastCpuNs - _FirstCpuNs) / (_Collects - 1) : 0.0; }
+
+    void CollectMetrics(std::vector<MetricValue>* Values)
+    {
+        _LastCpuNs = ThreadCpuNs();
+        _FirstCpuNs = _Collects++ == 0 ? _LastCpuNs : _FirstCpuNs;
+        _ExportThreads.insert(std::this_thread::get_id());
+        CCaptureMetrics::CollectMetrics(Values);
+    }
+
+private:
+    std::set<std::thread::id>   _ExportThreads;
+    int64_t                     _FirstCpuNs;
+    int64_t                     _LastCpuNs;
+    uint64_t                    _Collects;
+};
+
+struct RunResult
+{
+    double      CpuSeconds;
+    double      WallSeconds;
+    uint64_t    Frames;
+    uint64_t    Exports;
+    uint64_t    ExportTimeNs;
+    uint64_t    Records;
+    double      ExportCpuNs;
+    bool        ExportsOnOwnThread;
+};
+
+static bool RunPipeline(const std::string& AudioFile, const std::string& MetricsFile, uint32_t Seconds, uint32_t JitterMs,
+    uint32_t MetricsMs, bool Metrics, RunResult* Result)
+{
+    CThreadLoggingSource* source = new CThreadLoggingSource();
+    if (!source->Initialize(48000, 2, 32, true, 480, JitterMs, true))
+    {
+        source->Release();
+        return false;
+    }
+    const WAVEFORMATEX* format = source->MixFormat();
+    CCaptureRingBuffer ring;
+    ring.Initialize(48000, format->nBlockAlign);
+
+    std::unique_ptr<CTimedCaptureMetrics> metrics;
+    if (Metrics)
+    {
+        metrics.reset(new CTimedCaptureMetrics());
+    }
+    CPcmFileSink sink;
+    DurabilityPolicy durability = { 1000, 0 };
+    CAsyncWriter writer;
+    if (!sink.Open(AudioFile) ||
+        !writer.Initialize(&sink, 1024 * 1024, 8, durability, metrics ? metrics->WriterHistograms() : NULL))
+    {
+        source->Release();
+        return false;
+    }
+
+    CaptureProcessing processing = {};
+    processing.Histograms = metrics ? metrics->DrainHistograms() : NULL;
+    double cpuStart = ProcessCpuSeconds();
+    auto wallStart = std::chrono::steady_clock::now();
+    if (!source->Start(&ring, &processing))
+    {
+        source->Release();
+        return false;
+    }
+    if (metrics && !metrics->Start(MetricsFile + ".jsonl", MetricsFile + ".prom", MetricsMs, source, &writer))
+    {
+        source->Stop();
+        source->Shutdown();
+        source->Release();
+        return false;
+    }
+
+    uint64_t frames = 0;
+    bool succeeded = true;
+    while (frames < static_cast<uint64_t>(Seconds) * 48000 && succeeded)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        size_t framesToRead = writer.WritableBytes() / ring.FrameSize();
+        CaptureRingRegion regions[2];
+        size_t available = ring.BeginRead(framesToRead, regions);
+        for (int i = 0; i < 2; i++)
+        {
+            if (regions[i].Frames != 0)
+            {
+                writer.Write(regions[i].Data, regions[i].Frames * ring.FrameSize());
+            }
+        }
+        ring.CommitRead(available);
+        writer.Submit();
+        frames += available;
+        succeeded = !writer.Failed();
+    }
+    source->Stop();
+    succeeded = writer.Close() && succeeded;
+    if (metrics)
+    {
+        metrics->Stop();
+    }
+    Result->WallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - wallStart).count();
+    Result->CpuSeconds = ProcessCpuSeconds() - cpuStart;
+    Result->Frames = frames;
+    Result->Exports = metrics ? metrics->Exporter().Exports() : 0;
+    Result->ExportTimeNs = metrics ? metrics->Exporter().ExportTimeNs() : 0;
+    Result->ExportCpuNs = metrics ? metrics->ExportCpuNs() : 0.0;
+    Result->Records = 0;
+    if (metrics)
+    {
+        const CLatencyHistogram* histograms[] =
+        {
+            &metrics->DrainHistograms()->RingLatencyNs, &metrics->DrainHistograms()->WakeupJitterNs,
+            &metrics->WriterHistograms()->WriteLatencyNs, &metrics->WriterHistograms()->FlushLatencyNs,
+            &metrics->WriterHistograms()->QueueDepth,
+        };
+        for (size_t i = 0; i < sizeof(histograms) / sizeof(histograms[0]); i++)
+        {
+            CHistogramSnapshot snapshot;
+            histograms[i]->Snapshot(&snapshot);
+            Result->Records += snapshot.Count();
+        }
+    }
+
+    //
+    //  One exporter thread, which is neither the capture thread nor this one, reading the ring.
+    //
+    Result->ExportsOnOwnThread = !metrics || (metrics->ExportThreads().size() == 1 &&
+        metrics->ExportThreads().count(source->CaptureThread()) == 0 &&
+        metrics->ExportThreads().count(std::this_thread::get_id()) == 0);
+
+    source->Shutdown();
+    source->Release();
+    return succeeded;
+}
+
+//
+//  The cost of one Record() on its own, with values spread over the latency range the pipeline sees.
+//
+static double MeasureRecordNs(uint32_t Records)
+{
+    std::unique_ptr<CLatencyHistogram> histogram(new CLatencyHistogram());
+    std::mt19937_64 random(1);
+    std::vector<uint64_t> values(4096);
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        values[i] = 1000 + random() % 50000000;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < Records; i++)
+    {
+        histogram->Record(values[i & (values.size() - 1)]);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    CHistogramSnapshot snapshot;
+    histogram->Snapshot(&snapshot);
+    return snapshot.Count() == Records ? seconds * 1e9 / Records : -1;
+}
+
+//
+//  The cost of the steady clock read the pipeline takes for each latency it records.
+//
+static double MeasureClockNs(uint32_t Reads)
+{
+    int64_t sum = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < Reads; i++)
+    {
+        sum += std::chrono::steady_clock::now().time_since_epoch().count() & 1;
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return sum >= 0 ? seconds * 1e9 / Reads : -1;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t seconds = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--seconds", "20")));
+    uint32_t jitterMs = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--jitter-ms", "2")));
+    uint32_t metricsMs = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--metrics-ms", "10000")));
+    uint32_t rounds = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--rounds", "3")));
+    double maxPercent = atof(GetArg(argc, argv, "--max-percent", "1"));
+    if (seconds == 0 || metricsMs == 0 || rounds == 0 || maxPercent <= 0)
+    {
+        fprintf(stderr, "Usage: %s [--seconds N] [--jitter-ms N] [--metrics-ms N] [--rounds N] [--max-percent N]\n", argv[0]);
+        return 1;
+    }
+
+    std::string prefix = "/tmp/audio_capture_metrics_bench_" + std::to_string(getpid());
+    std::string audioFile = prefix + ".pcm";
+    double recordNs = MeasureRecordNs(50000000);
+    double clockNs = MeasureClockNs(10000000);
+    printf("Histogram Record(): %.2f ns, steady clock read: %.2f ns\n", recordNs, clockNs);
+
+    //
+    //  Alternate the runs so drift in the machine's load lands on both sides, and compare the quietest run of each
+    //  kind, since the rest of the machine only ever adds to a run's CPU time.
+    //
+    double cpuRate[2] = { 1e9, 1e9 };
+    double noisiestBaseline = 0;
+    double recordsPerSecond = 0;
+    uint64_t exports = 0;
+    uint64_t exportTimeNs = 0;
+    double exportCpuNs = 0;
+    bool exportsOnOwnThread = true;
+    bool succeeded = recordNs > 0 && clockNs > 0;
+    for (uint32_t round = 0; round < rounds && succeeded; round++)
+    {
+        for (int withMetrics = 0; withMetrics < 2 && succeeded; withMetrics++)
+        {
+            RunResult result;
+            succeeded = RunPipeline(audioFile, prefix, seconds, jitterMs, metricsMs, withMetrics != 0, &result);
+            if (succeeded)
+            {
+                printf("Round %u %s: %llu frames, %.3f s CPU over %.3f s (%.3f%% of a core)\n", round + 1,
+                    withMetrics ? "with metrics   " : "without metrics", static_cast<unsigned long long>(result.Frames),
+                    result.CpuSeconds, result.WallSeconds, result.CpuSeconds * 100 / result.WallSeconds);
+                double rate = result.CpuSeconds / result.WallSeconds;
+                cpuRate[withMetrics] = rate < cpuRate[withMetrics] ? rate : cpuRate[withMetrics];
+                noisiestBaseline = !withMetrics && rate > noisiestBaseline ? rate : noisiestBaseline;
+                recordsPerSecond += result.Records / result.WallSeconds / rounds;
+                exports += result.Exports;
+                exportTimeNs += result.ExportTimeNs;
+                exportCpuNs += withMetrics ? result.ExportCpuNs / rounds : 0.0;
+                exportsOnOwnThread = exportsOnOwnThread && result.ExportsOnOwnThread;
+            }
+        }
+    }
+    unlink(audioFile.c_str());
+    unlink((prefix + ".jsonl").c_str());
+    unlink((prefix + ".prom").c_str());
+    if (!succeeded)
+    {
+        printf("Pipeline failed.\n");
+        return 1;
+    }
+
+    //
+    //  The exporter thread's CPU time and the histograms' share of the recording threads', per second of audio, and
+    //  the CPU time per second of audio with metrics against the same without them.
+    //
+    double baseline = cpuRate[0];
+    double exportPercent = exportCpuNs / (metricsMs * 1e6) * 100 / baseline;
+    double recordPercent = recordsPerSecond * (recordNs + clockNs) / 1e9 * 100 / baseline;
+    double overheadPercent = (cpuRate[1] - baseline) * 100 / baseline;
+    double noisePercent = (noisiestBaseline - baseline) * 100 / baseline;
+    printf("Denominator: %.3f ms of process CPU time per second of audio without metrics, the quietest of %u runs\n",
+        baseline * 1000, rounds);
+    printf("Exports: %llu every %u ms, %.1f us of exporter thread CPU each (%.1f us wall time by the exporter), "
+        "%.3f%%; all on the exporter's own thread: %s\n",
+        static_cast<unsigned long long>(exports), metricsMs, exportCpuNs / 1000.0,
+        exports != 0 ? exportTimeNs / 1000.0 / exports : 0.0, exportPercent, exportsOnOwnThread ? "yes" : "NO");
+    printf("Histograms: %.0f values recorded per second, %.3f%%\n", recordsPerSecond, recordPercent);
+    printf("Metrics cost: %.3f%%, limit %.1f%%\n", exportPercent + recordPercent, maxPercent);
+    printf("Process CPU time with metrics: %+.2f%% (%.3f%% of a core), runs without metrics spread over %.2f%%, limit %.1f%% beyond that\n",
+        overheadPercent, (cpuRate[1] - baseline) * 100, noisePercent, maxPercent);
+    bool passed = exportPercent + recordPercent < maxPercent && overheadPercent < maxPercent + noisePercent && exportsOnOwnThread;
+    printf("%s\n", passed ? "Overhead within budget." : exportsOnOwnThread ? "OVERHEAD TOO HIGH." : "EXPORT ON THE WRONG THREAD.");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,251 @@
+//
+//  Multi source alignment test on Linux.
+//
+//  Records --seconds in real time from three synthetic sources that behave like separate devices hearing the same
+//  sound: the reference, 48 kHz stereo float on an exact clock; a 48 kHz mono source whose clock runs 800 ppm
+//  fast and that starts 400 ms late, longer than the multi source waits, so it begins as silence; and a 44.1 kHz
+//  stereo source 500 ppm slow with 3 ms of delivery jitter that starts 35 ms late.  The multi source's output
+//  is read straight from its ring.
+//
+//  Once the control loop has settled (--settle-seconds), every 250 ms window of each input's first channel is compared
+//  with the reference's first channel, which carries the same signal: the offset between them, to a fraction of a
+//  frame, from a regression of the difference on the reference's slope, and the level of the difference.  The run
+//  passes if every window is within 20 us and 40 dB, and each input's drift estimate is within 25 ppm of its skew.
+//  For scale, it also prints how far each input would have drifted by the end without compensation.  Finally the
+//  drift resampler's throughput is measured for each kernel.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "SyntheticCaptureSource.h"
+#include "MultiCaptureSource.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+struct InputSetup
+{
+    DWORD   SamplesPerSec;
+    WORD    Channels;
+    WORD    BitsPerSample;
+    bool    IsFloat;
+    int     SkewPpm;
+    UINT32  StartDelayMs;
+    UINT32  JitterMs;
+};
+
+static const InputSetup Inputs[] =
+{
+    { 48000, 2, 32, true, 0, 0, 0 },
+    { 48000, 1, 32, true, 800, 400, 0 },
+    { 44100, 2, 32, true, -500, 35, 3 },
+};
+static const size_t InputCount = sizeof(Inputs) / sizeof(Inputs[0]);
+
+static double NowSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+//  Offset of Input against Reference in frames, positive when Input lags, and the level of their difference in dB,
+//  over Frames frames Stride floats apart.
+//
+static void CompareWindow(const float* Reference, const float* Input, size_t Stride, size_t Frames, double* Offset, double* LevelDb)
+{
+    double slopeSquares = 0.0;
+    double projection = 0.0;
+    double signal = 0.0;
+    double difference = 0.0;
+    for (size_t frame = 1; frame + 1 < Frames; frame++)
+    {
+        double reference = Reference[frame * Stride];
+        double slope = (Reference[(frame + 1) * Stride] - Reference[(frame - 1) * Stride]) / 2.0;
+        double delta = reference - Input[frame * Stride];
+        slopeSquares += slope * slope;
+        projection += delta * slope;
+        signal += reference * reference;
+        difference += delta * delta;
+    }
+    *Offset = slopeSquares > 0.0 ? projection / slopeSquares : 0.0;
+    *LevelDb = signal > 0.0 && difference > 0.0 ? 10.0 * log10(difference / signal) : -200.0;
+}
+
+static bool RunAlignment(double Seconds, double SettleSeconds)
+{
+    ICaptureSource* sources[InputCount];
+    for (size_t i = 0; i < InputCount; i++)
+    {
+        const InputSetup& setup = Inputs[i];
+        CSyntheticCaptureSource* source = new CSyntheticCaptureSource();
+        if (!source->Initialize(setup.SamplesPerSec, setup.Channels, setup.BitsPerSample, setup.IsFloat, setup.SamplesPerSec / 100,
+                setup.JitterMs, true) ||
+            !source->SetClock(setup.SkewPpm, setup.StartDelayMs, true))
+        {
+            source->Release();
+            return false;
+        }
+        sources[i] = source;
+    }
+
+    CMultiCaptureSource* multi = new CMultiCaptureSource();
+    bool initialized = multi->Initialize(sources, InputCount, Inputs[0].SamplesPerSec / 100);
+    for (size_t i = 0; i < InputCount; i++)
+    {
+        sources[i]->Release();
+    }
+    if (!initialized)
+    {
+        multi->Release();
+        return false;
+    }
+
+    const WAVEFORMATEX* format = multi->MixFormat();
+    const size_t channels = format->nChannels;
+    CCaptureRingBuffer ring;
+    ring.Initialize(format->nSamplesPerSec, format->nBlockAlign);
+    CaptureProcessing processing = {};
+    if (!multi->Start(&ring, &processing))
+    {
+        multi->Release();
+        return false;
+    }
+
+    std::vector<float> output;
+    output.reserve(static_cast<size_t>((Seconds + 1) * format->nSamplesPerSec) * channels);
+    const size_t totalFrames = static_cast<size_t>(Seconds * format->nSamplesPerSec);
+    double start = NowSeconds();
+    while (output.size() < totalFrames * channels)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        CaptureRingRegion regions[2];
+        size_t frames = ring.BeginRead(ring.FrameCapacity(), regions);
+        for (int region = 0; region < 2; region++)
+        {
+            const float* data = reinterpret_cast<const float*>(regions[region].Data);
+            output.insert(output.end(), data, data + regions[region].Frames * channels);
+        }
+        ring.CommitRead(frames);
+        if (NowSeconds() - start > Seconds + 5)
+        {
+            fprintf(stderr, "The multi source stopped delivering.\n");
+            break;
+        }
+    }
+    multi->Stop();
+
+    size_t frames = output.size() / channels;
+    printf("Recorded %.2f s, %u channels at %u Hz\n", static_cast<double>(frames) / format->nSamplesPerSec, static_cast<unsigned>(channels),
+        format->nSamplesPerSec);
+    bool passed = frames >= totalFrames;
+
+    const size_t window = format->nSamplesPerSec / 4;
+    const size_t settleFrames = static_cast<size_t>(SettleSeconds * format->nSamplesPerSec);
+    for (size_t i = 1; i < InputCount; i++)
+    {
+        MultiCaptureStreamStats stats;
+        multi->GetStreamStats(i, &stats);
+        size_t firstChannel = 0;
+        for (size_t j = 0; j < i; j++)
+        {
+            firstChannel += Inputs[j].Channels;
+        }
+
+        double maxOffsetUs = 0.0;
+        double maxLevelDb = -200.0;
+        size_t windows = 0;
+        for (size_t first = settleFrames; first + window <= frames; first += window)
+        {
+            double offset;
+            double levelDb;
+            CompareWindow(&output[first * channels], &output[first * channels + firstChannel], channels, window, &offset, &levelDb);
+            maxOffsetUs = std::max(maxOffsetUs, fabs(offset) * 1000000.0 / format->nSamplesPerSec);
+            maxLevelDb = std::max(maxLevelDb, levelDb);
+            windows++;
+        }
+
+        double expectedPpm = (1.0 + Inputs[i].SkewPpm / 1000000.0) / (1.0 + Inputs[0].SkewPpm / 1000000.0) * 1000000.0 - 1000000.0;
+        double uncompensatedMs = fabs(expectedPpm) * frames / format->nSamplesPerSec / 1000.0;
+        bool inputPassed = windows != 0 && maxOffsetUs <= 20.0 && maxLevelDb <= -40.0 && fabs(stats.DriftPpm - expectedPpm) <= 25.0;
+        printf("Input %zu: %u Hz, %+d ppm, starts %u ms late: drift estimate %+.1f ppm (true %+.1f), %llu frames of silence, "
+            "%llu resyncs; %zu windows after %.1f s: offset within %.2f us, difference at most %.1f dB "
+            "(uncompensated it would have drifted %.2f ms) %s\n",
+            i, Inputs[i].SamplesPerSec, Inputs[i].SkewPpm, Inputs[i].StartDelayMs, stats.DriftPpm, expectedPpm,
+            static_cast<unsigned long long>(stats.SilenceFrames), static_cast<unsigned long long>(stats.Resyncs), windows,
+            SettleSeconds, maxOffsetUs, maxLevelDb, uncompensatedMs, inputPassed ? "ok" : "FAILED");
+        passed = passed && inputPassed;
+    }
+
+    CaptureDrainStats drainStats;
+    multi->GetDrainStats(&drainStats);
+    printf("Multi source: %llu wakeups, %llu packets, %llu frames, %llu overruns\n",
+        static_cast<unsigned long long>(drainStats.Wakeups), static_cast<unsigned long long>(drainStats.PacketsDrained),
+        static_cast<unsigned long long>(drainStats.FramesMoved), static_cast<unsigned long long>(drainStats.Overruns));
+    multi->Shutdown();
+    multi->Release();
+    return passed;
+}
+
+//
+//  Stereo at 48 kHz, stepping 1.000123 input frames per output frame, in 10 ms pieces.
+//
+static void BenchmarkResampler(SampleConvertKernel Kernel)
+{
+    const size_t frames = 48000 * 20;
+    const size_t piece = 480;
+    std::vector<float> input(piece * 2);
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        input[i] = static_cast<float>(sin(i * 0.01));
+    }
+    std::vector<float> output(piece * 2 * 2);
+
+    CDriftResampler resampler;
+    if (!resampler.Initialize(2, 1.0, 48000, Kernel) || resampler.Kernel() != Kernel)
+    {
+        return;
+    }
+    const double step = 1.000123;
+    size_t produced = 0;
+    double start = NowSeconds();
+    for (size_t pushed = 0; pushed < frames; pushed += piece)
+    {
+        resampler.Push(&input[0], piece);
+        produced += resampler.Pull(&output[0], 2, resampler.Available(step), step);
+    }
+    double seconds = NowSeconds() - start;
+    printf("Drift resampler, %s kernel: %.1f M output frames/s (%.0fx real time for stereo 48 kHz)\n", SampleConvertKernelName(Kernel),
+        produced / seconds / 1000000.0, produced / seconds / 48000.0);
+}
+
+int main(int argc, char* argv[])
+{
+    double seconds = atof(GetArg(argc, argv, "--seconds", "8"));
+    double settleSeconds = atof(GetArg(argc, argv, "--settle-seconds", "3"));
+    if (seconds <= settleSeconds)
+    {
+        fprintf(stderr, "--seconds must be longer than --settle-seconds.\n");
+        return 1;
+    }
+
+    bool passed = RunAlignment(seconds, settleSeconds);
+    BenchmarkResampler(SampleKernelScalar);
+    BenchmarkResampler(SampleKernelSse2);
+    BenchmarkResampler(SampleKernelAvx2);
+    printf(passed ? "All inputs aligned.\n" : "Alignment FAILED.\n");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,460 @@
+//
+//  Opus output test and benchmark on Linux.
+//
+//  - order: for every standard layout of 1 to 8 channels, tags each WAVE order channel with its speaker and checks
+//    that BuildVorbisChannelOrder() puts it at its Vorbis position (RFC 7845 section 5.1.1.2), side and back
+//    surrounds standing in for each other.
+//
+//  With libopus:
+//
+//  - placement: COpusFileSink encodes 5.1 and 7.1 with a different tone on every channel; the file is parsed and
+//    decoded with the mapping from its OpusHead, and every decoded channel must carry the tone of the speaker at its
+//    Vorbis position.  The granule positions must never go back or pass the end of the stream, which the last page
+//    marks at the pre-skip plus the input's length, and the decoded length must match it.
+//  - speed: --seconds of synthetic audio through the sink, stereo and 5.1 at 48 kHz and stereo at 44.1 kHz, which
+//    goes through the resampler; prints the real-time factor, process CPU time per second of audio, and the CPU time
+//    the writing thread itself spent in Write(), which is what the other sinks on the writer thread wait for while
+//    the sink's encoder thread does the encoding.  Fails above --max-rtf or above --max-writer-ms (default 5) ms of
+//    writing thread CPU per second of audio.
+//
+#include <stdio.h>
+#include <string.h>
+#include "AudioFormat.h"
+#include "ChannelRemix.h"
+
+#ifdef AUDIO_CAPTURE_HAVE_OPUS
+#include <math.h>
+#include <stdlib.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+#include <opus_multistream.h>
+#include "OpusFileSink.h"
+#endif
+
+#define FL  SPEAKER_FRONT_LEFT
+#define FR  SPEAKER_FRONT_RIGHT
+#define FC  SPEAKER_FRONT_CENTER
+#define LFE SPEAKER_LOW_FREQUENCY
+#define BL  SPEAKER_BACK_LEFT
+#define BR  SPEAKER_BACK_RIGHT
+#define BC  SPEAKER_BACK_CENTER
+#define SL  SPEAKER_SIDE_LEFT
+#define SR  SPEAKER_SIDE_RIGHT
+
+//
+//  A layout and the speakers Vorbis order wants at each position.
+//
+struct OrderCase
+{
+    const char* Name;
+    WORD        Channels;
+    DWORD       Mask;
+    DWORD       Vorbis[8];
+};
+
+static const OrderCase OrderCases[] =
+{
+    { "mono", 1, FC, { FC } },
+    { "stereo", 2, FL | FR, { FL, FR } },
+    { "3.0", 3, FL | FR | FC, { FL, FC, FR } },
+    { "quad", 4, FL | FR | BL | BR, { FL, FR, BL, BR } },
+    { "quad side", 4, FL | FR | SL | SR, { FL, FR, SL, SR } },
+    { "5.0", 5, FL | FR | FC | BL | BR, { FL, FC, FR, BL, BR } },
+    { "5.1", 6, FL | FR | FC | LFE | BL | BR, { FL, FC, FR, BL, BR, LFE } },
+    { "5.1 side", 6, FL | FR | FC | LFE | SL | SR, { FL, FC, FR, SL, SR, LFE } },
+    { "6.1", 7, FL | FR | FC | LFE | BC | SL | SR, { FL, FC, FR, SL, SR, BC, LFE } },
+    { "6.1 back", 7, FL | FR | FC | LFE | BL | BR | BC, { FL, FC, FR, BL, BR, BC, LFE } },
+    { "7.1", 8, FL | FR | FC | LFE | BL | BR | SL | SR, { FL, FC, FR, SL, SR, BL, BR, LFE } },
+};
+
+//
+//  The speaker of each channel of a layout, in WAVE order: the n-th set bit of the mask is channel n.
+//
+static void WaveSpeakers(DWORD Mask, WORD Channels, DWORD* Speakers)
+{
+    WORD channel = 0;
+    for (DWORD speaker = 1; speaker != 0 && channel < Channels; speaker <<= 1)
+    {
+        if (Mask & speaker)
+        {
+            Speakers[channel++] = speaker;
+        }
+    }
+}
+
+static bool RunOrder()
+{
+    bool passed = true;
+    for (size_t i = 0; i < sizeof(OrderCases) / sizeof(OrderCases[0]); i++)
+    {
+        const OrderCase& test = OrderCases[i];
+        WAVEFORMATEXTENSIBLE format;
+        InitializeWaveFormat(&format, true, test.Channels, 48000, 32, test.Mask);
+
+        //
+        //  A frame whose every channel holds its speaker, reordered the way the sink reads it.
+        //
+        DWORD frame[8] = {};
+        WaveSpeakers(test.Mask, test.Channels, frame);
+        uint32_t order[8];
+        BuildVorbisChannelOrder(&format.Format, order);
+        bool ok = true;
+        for (WORD position = 0; position < test.Channels; position++)
+        {
+            ok = ok && order[position] < test.Channels && frame[order[position]] == test.Vorbis[position];
+        }
+        printf("order %-10s", test.Name);
+        for (WORD position = 0; position < test.Channels; position++)
+        {
+            printf(" %u", order[position]);
+        }
+        printf(": %s\n", ok ? "ok" : "FAILED");
+        passed = passed && ok;
+    }
+    return passed;
+}
+
+#ifdef AUDIO_CAPTURE_HAVE_OPUS
+
+static const double Pi = 3.14159265358979323846;
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static double ProcessCpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static double ThreadCpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+//
+//  Frames frames of float audio, a tone of Frequencies[channel] on every channel.
+//
+static std::vector<float> MakeTones(const WAVEFORMATEX* Format, const std::vector<double>& Frequencies, uint64_t Frames)
+{
+    std::vector<float> audio(static_cast<size_t>(Frames) * Format->nChannels);
+    for (uint64_t frame = 0; frame < Frames; frame++)
+    {
+        double t = static_cast<double>(frame) / Format->nSamplesPerSec;
+        for (WORD channel = 0; channel < Format->nChannels; channel++)
+        {
+            audio[frame * Format->nChannels + channel] = static_cast<float>(0.25 * sin(2.0 * Pi * Frequencies[channel] * t));
+        }
+    }
+    return audio;
+}
+
+//
+//  Writes the audio through the sink in 10 ms blocks, the way the writer thread hands on capture packets.
+//
+static bool WriteAudio(COpusFileSink* Sink, const WAVEFORMATEX* Format, const std::vector<float>& Audio)
+{
+    const size_t block = static_cast<size_t>(Format->nSamplesPerSec / 100) * Format->nBlockAlign;
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(Audio.empty() ? NULL : &Audio[0]);
+    size_t size = Audio.size() * sizeof(float);
+    for (size_t offset = 0; offset < size; offset += block)
+    {
+        if (!Sink->Write(data + offset, size - offset < block ? size - offset : block))
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+struct OggOpusFile
+{
+    std::vector<uint8_t>                Head;
+    std::vector<std::vector<uint8_t> >  Packets;
+    uint64_t                            LastGranule;
+    bool                                GranulesInOrder;
+    bool                                EndFlagged;
+};
+
+//
+//  Splits an Ogg stream into its packets and checks the pages' granule positions.
+//
+static bool ReadOggOpus(const std::string& FileName, OggOpusFile* File)
+{
+    FILE* file = fopen(FileName.c_str(), "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", FileName.c_str());
+        return false;
+    }
+    std::vector<uint8_t> data;
+    uint8_t buffer[65536];
+    size_t bytes;
+    while ((bytes = fread(buffer, 1, sizeof(buffer), file)) != 0)
+    {
+        data.insert(data.end(), buffer, buffer + bytes);
+    }
+    fclose(file);
+
+    File->Packets.clear();
+    File->LastGranule = 0;
+    File->GranulesInOrder = true;
+    File->EndFlagged = false;
+    std::vector<uint64_t> granules;
+    std::vector<uint8_t> packet;
+    size_t position = 0;
+    while (position + 27 <= data.size())
+    {
+        if (memcmp(&data[position], "OggS", 4) != 0)
+        {
+            fprintf(stderr, "Broken Ogg page at %zu.\n", position);
+            return false;
+        }
+        uint64_t granule = 0;
+        for (int i = 7; i >= 0; i--)
+        {
+            granule = granule << 8 | data[position + 6 + i];
+        }
+        size_t segments = data[position + 26];
+        size_t body = position + 27 + segments;
+        for (size_t i = 0; i < segments && body <= data.size(); i++)
+        {
+            size_t size = data[position + 27 + i];
+            if (body + size > data.size())
+            {
+                break;
+            }
+            packet.insert(packet.end(), &data[body], &data[body] + size);
+            body += size;
+            if (size < 255)
+            {
+                File->Packets.push_back(packet);
+                packet.clear();
+            }
+        }
+        if (File->Packets.size() > 2)
+        {
+            granules.push_back(granule);
+        }
+        File->EndFlagged = (data[position + 5] & 0x04) != 0;
+        File->LastGranule = granule;
+        position = body;
+    }
+    for (size_t i = 1; i < granules.size(); i++)
+    {
+        File->GranulesInOrder = File->GranulesInOrder && granules[i - 1] <= granules[i] && granules[i - 1] <= File->LastGranule;
+    }
+    if (File->Packets.size() < 2 || File->Packets[0].size() < 19 || memcmp(&File->Packets[0][0], "OpusHead", 8) != 0)
+    {
+        fprintf(stderr, "%s isn't an Ogg Opus file.\n", FileName.c_str());
+        return false;
+    }
+    File->Head = File->Packets[0];
+    File->Packets.erase(File->Packets.begin(), File->Packets.begin() + 2);
+    return true;
+}
+
+//
+//  Power of one frequency in a channel of interleaved audio (Goertzel).
+//
+static double TonePower(const std::vector<float>& Audio, size_t Channels, size_t Channel, size_t Start, size_t Frames, double Frequency)
+{
+    double coefficient = 2.0 * cos(2.0 * Pi * Frequency / 48000.0);
+    double previous = 0.0;
+    double beforePrevious = 0.0;
+    for (size_t frame = Start; frame < Start + Frames; frame++)
+    {
+        double current = Audio[frame * Channels + Channel] + coefficient * previous - beforePrevious;
+        beforePrevious = previous;
+        previous = current;
+    }
+    return previous * previous + beforePrevious * beforePrevious - coefficient * previous * beforePrevious;
+}
+
+//
+//  Encodes a tone per speaker and checks the decoder hands each one back at the speaker's Vorbis position.
+//
+static bool RunPlacement(const std::string& FileName, const OrderCase& Test, uint32_t SampleRate)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, Test.Channels, SampleRate, 32, Test.Mask);
+    DWORD speakers[8] = {};
+    WaveSpeakers(Test.Mask, Test.Channels, speakers);
+    std::vector<double> frequencies(Test.Channels);
+    for (WORD channel = 0; channel < Test.Channels; channel++)
+    {
+        frequencies[channel] = speakers[channel] == LFE ? 80.0 : 400.0 + 300.0 * channel;
+    }
+
+    const uint64_t frames = SampleRate * 2 + 123;
+    COpusFileSink sink;
+    if (!sink.Open(FileName, &format.Format, 0, 20) || !WriteAudio(&sink, &format.Format, MakeTones(&format.Format, frequencies, frames)) ||
+        !sink.Close())
+    {
+        return false;
+    }
+    OggOpusFile file;
+    if (!ReadOggOpus(FileName, &file))
+    {
+        return false;
+    }
+
+    const std::vector<uint8_t>& head = file.Head;
+    uint32_t preSkip = head[10] | (head[11] << 8);
+    int streams = head[18] == 0 ? 1 : head[19];
+    int coupled = head[18] == 0 ? (Test.Channels == 2 ? 1 : 0) : head[20];
+    uint8_t mapping[8] = { 0, 1 };
+    if (head[18] != 0)
+    {
+        memcpy(mapping, &head[21], Test.Channels);
+    }
+    int error;
+    OpusMSDecoder* decoder = opus_multistream_decoder_create(48000, Test.Channels, streams, coupled, mapping, &error);
+    if (decoder == NULL)
+    {
+        fprintf(stderr, "Unable to create Opus decoder: %s\n", opus_strerror(error));
+        return false;
+    }
+    std::vector<float> audio;
+    std::vector<float> pcm(5760 * Test.Channels);
+    for (size_t i = 0; i < file.Packets.size(); i++)
+    {
+        int decoded = opus_multistream_decode_float(decoder, &file.Packets[i][0], static_cast<opus_int32>(file.Packets[i].size()),
+            &pcm[0], 5760, 0);
+        if (decoded < 0)
+        {
+            fprintf(stderr, "Opus decoding failed: %s\n", opus_strerror(decoded));
+            opus_multistream_decoder_destroy(decoder);
+            return false;
+        }
+        audio.insert(audio.end(), pcm.begin(), pcm.begin() + static_cast<size_t>(decoded) * Test.Channels);
+    }
+    opus_multistream_decoder_destroy(decoder);
+
+    uint64_t expectedEnd = preSkip + (frames * 48000 + SampleRate / 2) / SampleRate;
+    size_t decodedFrames = audio.size() / Test.Channels;
+    bool ok = file.EndFlagged && file.GranulesInOrder && file.LastGranule == expectedEnd && decodedFrames >= expectedEnd;
+
+    //
+    //  Which input channel's tone is loudest on each decoded channel, over a second in the middle.
+    //
+    printf("placement %-6s %u Hz: pre-skip %u, end %llu of %llu, decoded channels carry input", Test.Name, SampleRate, preSkip,
+        static_cast<unsigned long long>(file.LastGranule), static_cast<unsigned long long>(expectedEnd));
+    for (WORD position = 0; position < Test.Channels && decodedFrames >= preSkip + 72000; position++)
+    {
+        WORD loudest = 0;
+        double loudestPower = -1.0;
+        for (WORD channel = 0; channel < Test.Channels; channel++)
+        {
+            double power = TonePower(audio, Test.Channels, position, preSkip + 24000, 48000, frequencies[channel]);
+            if (power > loudestPower)
+            {
+                loudest = channel;
+                loudestPower = power;
+            }
+        }
+        printf(" %u", loudest);
+        ok = ok && speakers[loudest] == Test.Vorbis[position];
+    }
+    printf(": %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+static bool RunSpeed(const std::string& FileName, const char* Name, WORD Channels, DWORD Mask, uint32_t SampleRate,
+    double Seconds, double MaxRtf, double MaxWriterMs)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, Channels, SampleRate, 32, Mask);
+    std::vector<double> frequencies(Channels);
+    for (WORD channel = 0; channel < Channels; channel++)
+    {
+        frequencies[channel] = 220.0 * (channel + 1) + 0.37;
+    }
+
+    std::vector<float> audio = MakeTones(&format.Format, frequencies, static_cast<uint64_t>(Seconds * SampleRate));
+
+    COpusFileSink sink;
+    double cpuStart = ProcessCpuSeconds();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double writerCpu = 0;
+    bool succeeded = sink.Open(FileName, &format.Format, 0, 20);
+    if (succeeded)
+    {
+        double writerStart = ThreadCpuSeconds();
+        succeeded = WriteAudio(&sink, &format.Format, audio);
+        writerCpu = ThreadCpuSeconds() - writerStart;
+        succeeded = sink.Close() && succeeded;
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpu = ProcessCpuSeconds() - cpuStart;
+    if (!succeeded)
+    {
+        return false;
+    }
+
+    OpusEncoderStats stats;
+    sink.GetStats(&stats);
+    double rtf = elapsed / Seconds;
+    double writerMs = writerCpu / Seconds * 1000.0;
+    bool ok = rtf <= MaxRtf && writerMs <= MaxWriterMs;
+    printf("speed %-9s %u Hz: %.1f s in %.2f s, real-time factor %.4f (%.0fx), %.1f ms CPU per second, encoder alone %.4f, "
+        "%.0f kbit/s; writing thread %.2f ms CPU per second, %.2f s waiting for the encoder: %s\n", Name, SampleRate, Seconds,
+        elapsed, rtf, 1.0 / rtf, cpu / Seconds * 1000.0, stats.EncodeTimeUs / 1e6 / Seconds, stats.OutputBytes * 8 / Seconds / 1000.0,
+        writerMs, stats.WriterWaitUs / 1e6, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+#endif
+
+int main(int argc, char* argv[])
+{
+    bool passed = RunOrder();
+
+#ifdef AUDIO_CAPTURE_HAVE_OPUS
+    double seconds = atof(GetArg(argc, argv, "--seconds", "20"));
+    double maxRtf = atof(GetArg(argc, argv, "--max-rtf", "0.1"));
+    double maxWriterMs = atof(GetArg(argc, argv, "--max-writer-ms", "5"));
+    std::string directory = GetArg(argc, argv, "--dir", "/tmp");
+    std::string fileName = directory + "/audio_capture_opus_bench_" + std::to_string(getpid()) + ".opus";
+    if (seconds <= 0 || maxRtf <= 0 || maxWriterMs <= 0)
+    {
+        fprintf(stderr, "Usage: %s [--seconds N] [--max-rtf factor] [--max-writer-ms N] [--dir directory]\n", argv[0]);
+        return 1;
+    }
+
+    for (size_t i = 0; i < sizeof(OrderCases) / sizeof(OrderCases[0]); i++)
+    {
+        if (strcmp(OrderCases[i].Name, "5.1") == 0 || strcmp(OrderCases[i].Name, "7.1") == 0)
+        {
+            passed = RunPlacement(fileName, OrderCases[i], 48000) && passed;
+            passed = RunPlacement(fileName, OrderCases[i], 44100) && passed;
+        }
+    }
+    passed = RunSpeed(fileName, "stereo", 2, FL | FR, 48000, seconds, maxRtf, maxWriterMs) && passed;
+    passed = RunSpeed(fileName, "5.1", 6, FL | FR | FC | LFE | BL | BR, 48000, seconds, maxRtf, maxWriterMs) && passed;
+    passed = RunSpeed(fileName, "stereo", 2, FL | FR, 44100, seconds, maxRtf, maxWriterMs) && passed;
+    unlink(fileName.c_str());
+#else
+    (void)argc;
+    (void)argv;
+    printf("Built without libopus: only the channel order is checked.\n");
+#endif
+
+    printf("%s\n", passed ? "ok" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#!/bin/sh
+#
+#  Smoke test of the PulseAudio / PipeWire capture backend against a real server, on a machine without a sound card.
+#
+#  Loads a 5.1 null sink in PulseAudio's own channel order (FL FR RL RR FC LFE), plays a tone into it with pacat,
+#  records its monitor with audio_capture_cli for a few seconds and checks the recording: it must be about as long
+#  as asked, come out in WAVEFORMATEXTENSIBLE order (FL FR FC LFE BL BR), and hold the tone on the front left
+#  channel only.  It records twice: the monitor by name, then with the null sink made the default and no --device,
+#  which is the default monitor (@DEFAULT_MONITOR@) the CLI records out of the box; the old default sink is put back
+#  afterwards.  Needs pactl, pacat, python3, a running PulseAudio or PipeWire server and a CLI built with libpulse;
+#  without them it exits with 77, the usual code for a skipped test.
+#
+#  Usage: ./pulse_smoke_test.sh [path/to/audio_capture_cli] [seconds]
+#
+set -e
+
+CLI=${1:-./audio_capture_cli}
+SECONDS_TO_RECORD=${2:-3}
+SINK=audio_capture_smoke
+WORK=$(mktemp -d)
+MODULE=
+PLAYER=
+DEFAULT_SINK=
+
+cleanup()
+{
+    [ -n "$PLAYER" ] && kill "$PLAYER" 2>/dev/null || true
+    [ -n "$DEFAULT_SINK" ] && pactl set-default-sink "$DEFAULT_SINK" || true
+    [ -n "$MODULE" ] && pactl unload-module "$MODULE" || true
+    rm -rf "$WORK"
+}
+trap cleanup EXIT
+
+skip()
+{
+    echo "skipped: $1"
+    exit 77
+}
+
+for tool in pactl pacat python3; do
+    command -v $tool > /dev/null || skip "$tool not found"
+done
+pactl info > /dev/null 2>&1 || skip "no PulseAudio or PipeWire server"
+[ -x "$CLI" ] || skip "$CLI not found"
+
+MODULE=$(pactl load-module module-null-sink sink_name=$SINK rate=48000 channels=6 \
+    channel_map=front-left,front-right,rear-left,rear-right,front-center,lfe)
+
+#
+#  A 1 kHz tone at half scale on the first channel of the sink, front left, and silence on the others.
+#
+python3 - "$WORK/tone.raw" <<'EOF'
+import math, struct, sys
+with open(sys.argv[1], "wb") as f:
+    for i in range(48000 * 30):
+        f.write(struct.pack("<6h", int(16384 * math.sin(2 * math.pi * 1000 * i / 48000)), 0, 0, 0, 0, 0))
+EOF
+pacat --playback --device=$SINK --raw --format=s16le --rate=48000 --channels=6 \
+    --channel-map=front-left,front-right,rear-left,rear-right,front-center,lfe "$WORK/tone.raw" &
+PLAYER=$!
+sleep 1
+
+cat > "$WORK/check.py" <<'EOF'
+import math, struct, sys
+data = open(sys.argv[1], "rb").read()
+seconds = float(sys.argv[2])
+position = 12
+fmt = None
+samples = None
+while position + 8 <= len(data):
+    chunk, size = struct.unpack("<4sI", data[position:position + 8])
+    body = data[position + 8:position + 8 + size]
+    if chunk == b"fmt ":
+        tag, channels, rate = struct.unpack("<HHI", body[:8])
+        bits = struct.unpack("<H", body[14:16])[0]
+        mask = struct.unpack("<I", body[20:24])[0] if tag == 0xFFFE else 0
+        fmt = (channels, rate, bits, mask)
+    elif chunk == b"data":
+        samples = struct.unpack("<%df" % (len(body) // 4), body)
+    position += 8 + size + (size & 1)
+
+channels, rate, bits, mask = fmt
+frames = len(samples) // channels
+rms = [math.sqrt(sum(samples[i] ** 2 for i in range(c, len(samples), channels)) / frames) for c in range(channels)]
+print("%d channels at %d Hz, mask 0x%x, %.2f s, RMS per channel: %s" %
+    (channels, rate, mask, frames / rate, " ".join("%.4f" % value for value in rms)))
+ok = (channels == 6 and bits == 32 and mask == 0x3F and abs(frames / rate - seconds) < 0.25 * seconds and
+    0.3 < rms[0] < 0.4 and max(rms[1:]) < 0.001)
+print("ok" if ok else "FAILED")
+sys.exit(0 if ok else 1)
+EOF
+
+#
+#  Records the null sink's monitor, by name or with no --device at all, and checks the recording.
+#
+record()
+{
+    "$CLI" --source pulse "$@" --duration "$SECONDS_TO_RECORD" --output "$WORK/capture.wav" > "$WORK/cli.out" 2>&1 || {
+        cat "$WORK/cli.out"
+        grep -q "Unknown capture source" "$WORK/cli.out" && skip "$CLI was built without libpulse"
+        echo FAILED
+        exit 1
+    }
+    grep "PulseAudio source" "$WORK/cli.out" || true
+    python3 "$WORK/check.py" "$WORK/capture.wav" "$SECONDS_TO_RECORD"
+}
+
+echo "Monitor by name:"
+record --device $SINK.monitor
+
+DEFAULT_SINK=$(pactl get-default-sink 2>/dev/null || pactl info | sed -n 's/^Default Sink: //p')
+pactl set-default-sink $SINK
+echo "Default monitor:"
+record
@@ -0,0 +1,330 @@
+//
+//  Resampler quality and speed benchmark on Linux.
+//
+//  For each rate pair and quality preset, CResampler converts sines fed to it in 10 ms blocks, as the capture path
+//  does, and every output is fitted with a sine of the input's frequency by least squares once the filter has
+//  settled:
+//
+//  - THD+N: what a 1 kHz sine at -1 dBFS leaves besides the fitted sine, relative to it.  Distortion, images and
+//    aliases, and float rounding all count.  It must be below the preset's limit.
+//  - passband ripple: the spread of the gain over 24 frequencies from 20 Hz to 80 % of the lower Nyquist frequency,
+//    which must stay within the preset's limit; the gain at 90 % is printed to show where the band ends.
+//  - alias rejection, when decimating far enough to have room for it: a sine at 1.5 times the output's Nyquist
+//    frequency must come out at its alias no louder than the preset's limit.
+//
+//  Then each kernel the CPU has resamples stereo in 10 ms blocks for a while, to print its speed.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+#include "AudioFormat.h"
+#include "Resampler.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const double Pi = 3.14159265358979323846;
+
+struct RatePair
+{
+    uint32_t    Input;
+    uint32_t    Output;
+};
+
+static const RatePair RatePairs[] =
+{
+    { 44100, 48000 },
+    { 48000, 44100 },
+    { 16000, 48000 },
+    { 48000, 16000 },
+    { 96000, 48000 },
+};
+
+//
+//  Per preset: the THD+N, ripple and alias level it must meet, in dB, with a few dB to spare over what the design
+//  gives.
+//
+struct QualityCase
+{
+    const char*         Name;
+    ResamplerQuality    Quality;
+    double              MaxThdN;
+    double              MaxRipple;
+    double              MaxAlias;
+};
+
+static const QualityCase QualityCases[] =
+{
+    { "low", ResamplerQualityLow, -70.0, 0.05, -55.0 },
+    { "medium", ResamplerQualityMedium, -100.0, 0.002, -85.0 },
+    { "high", ResamplerQualityHigh, -125.0, 0.001, -110.0 },
+};
+
+//
+//  Resamples Seconds of a mono sine of Frequency Hz at Amplitude in 10 ms blocks.
+//
+static bool ResampleSine(const RatePair& Rates, ResamplerQuality Quality, double Frequency, double Amplitude, double Seconds,
+    std::vector<float>* Output, double* Delay)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, 1, Rates.Input, 32, 0);
+    const size_t block = Rates.Input / 100;
+    CResampler resampler;
+    if (!resampler.Initialize(&format.Format, Rates.Output, Quality, block))
+    {
+        return false;
+    }
+    *Delay = resampler.Delay();
+
+    const size_t frames = static_cast<size_t>(Seconds * Rates.Input);
+    std::vector<float> input(block);
+    Output->clear();
+    for (size_t frame = 0; frame < frames; frame += block)
+    {
+        for (size_t i = 0; i < block; i++)
+        {
+            input[i] = static_cast<float>(Amplitude * sin(2.0 * Pi * Frequency * static_cast<double>(frame + i) / Rates.Input));
+        }
+        size_t outputFrames;
+        const float* output = resampler.Process(&input[0], block, &outputFrames);
+        Output->insert(Output->end(), output, output + outputFrames);
+    }
+    return true;
+}
+
+//
+//  Least squares fit of a sin + b cos + c at Frequency to Count samples from Start, at Rate.  Returns the sine's
+//  amplitude, and the RMS of what is left in Residual.
+//
+static double FitSine(const std::vector<float>& Samples, size_t Start, size_t Count, double Frequency, uint32_t Rate,
+    double* Residual)
+{
+    double normal[3][4] = {};
+    for (size_t n = Start; n < Start + Count; n++)
+    {
+        double phase = 2.0 * Pi * Frequency * static_cast<double>(n) / Rate;
+        double basis[3] = { sin(phase), cos(phase), 1.0 };
+        for (int row = 0; row < 3; row++)
+        {
+            for (int column = 0; column < 3; column++)
+            {
+                normal[row][column] += basis[row] * basis[column];
+            }
+            normal[row][3] += basis[row] * Samples[n];
+        }
+    }
+
+    //
+    //  Gaussian elimination; the system is well conditioned for any window of many cycles.
+    //
+    for (int pivot = 0; pivot < 3; pivot++)
+    {
+        for (int row = pivot + 1; row < 3; row++)
+        {
+            double factor = normal[row][pivot] / normal[pivot][pivot];
+            for (int column = pivot; column < 4; column++)
+            {
+                normal[row][column] -= factor * normal[pivot][column];
+            }
+        }
+    }
+    double solution[3];
+    for (int row = 2; row >= 0; row--)
+    {
+        double sum = normal[row][3];
+        for (int column = row + 1; column < 3; column++)
+        {
+            sum -= normal[row][column] * solution[column];
+        }
+        solution[row] = sum / normal[row][row];
+    }
+
+    double energy = 0.0;
+    for (size_t n = Start; n < Start + Count; n++)
+    {
+        double phase = 2.0 * Pi * Frequency * static_cast<double>(n) / Rate;
+        double error = Samples[n] - (solution[0] * sin(phase) + solution[1] * cos(phase) + solution[2]);
+        energy += error * error;
+    }
+    *Residual = sqrt(energy / Count);
+    return sqrt(solution[0] * solution[0] + solution[1] * solution[1]);
+}
+
+//
+//  The fit's window: past the filter's delay and ramp, half a second long.  The output is fitted at
+//  OutputFrequency, which is Frequency unless it is looking for an alias.
+//
+static bool MeasureSine(const RatePair& Rates, ResamplerQuality Quality, double Frequency, double Amplitude, double* Gain,
+    double* Residual, double OutputFrequency = 0.0)
+{
+    std::vector<float> output;
+    double delay;
+    if (!ResampleSine(Rates, Quality, Frequency, Amplitude, 0.75, &output, &delay))
+    {
+        return false;
+    }
+    size_t start = static_cast<size_t>(2.0 * delay) + Rates.Output / 10;
+    size_t count = Rates.Output / 2;
+    if (start + count > output.size())
+    {
+        fprintf(stderr, "The resampler put out only %zu frames.\n", output.size());
+        return false;
+    }
+    *Gain = FitSine(output, start, count, OutputFrequency != 0.0 ? OutputFrequency : Frequency, Rates.Output, Residual) / Amplitude;
+    *Residual /= Amplitude / sqrt(2.0);
+    return true;
+}
+
+static bool RunQuality(const RatePair& Rates, const QualityCase& Test)
+{
+    double gain;
+    double residual;
+    if (!MeasureSine(Rates, Test.Quality, 1000.0, pow(10.0, -1.0 / 20.0), &gain, &residual))
+    {
+        return false;
+    }
+    double thdN = 20.0 * log10(residual / gain);
+
+    //
+    //  Gain from 20 Hz to 80 % of the lower Nyquist frequency, log spaced.
+    //
+    const double nyquist = 0.5 * (Rates.Input < Rates.Output ? Rates.Input : Rates.Output);
+    const int points = 24;
+    double minimum = 1e9;
+    double maximum = -1e9;
+    for (int point = 0; point < points; point++)
+    {
+        double frequency = 20.0 * pow(0.8 * nyquist / 20.0, static_cast<double>(point) / (points - 1));
+        double pointGain;
+        if (!MeasureSine(Rates, Test.Quality, frequency, 0.5, &pointGain, &residual))
+        {
+            return false;
+        }
+        double db = 20.0 * log10(pointGain);
+        minimum = db < minimum ? db : minimum;
+        maximum = db > maximum ? db : maximum;
+    }
+    double edgeGain;
+    if (!MeasureSine(Rates, Test.Quality, 0.9 * nyquist, 0.5, &edgeGain, &residual))
+    {
+        return false;
+    }
+
+    double ripple = maximum - minimum;
+    bool ok = thdN <= Test.MaxThdN && ripple <= Test.MaxRipple;
+    printf("%5u -> %5u %-6s: THD+N %.1f dB (limit %.0f), ripple %.4f dB to %.0f Hz (limit %.3f), %.2f dB at %.0f Hz",
+        Rates.Input, Rates.Output, Test.Name, thdN, Test.MaxThdN, ripple, 0.8 * nyquist, Test.MaxRipple,
+        20.0 * log10(edgeGain), 0.9 * nyquist);
+
+    //
+    //  A sine at 1.5 times the output's Nyquist frequency folds back to half of it.
+    //
+    double aliasFrequency = 0.75 * Rates.Output;
+    if (aliasFrequency < 0.45 * Rates.Input)
+    {
+        double aliasGain;
+        if (!MeasureSine(Rates, Test.Quality, aliasFrequency, 0.5, &aliasGain, &residual, Rates.Output - aliasFrequency))
+        {
+            return false;
+        }
+        double alias = 20.0 * log10(aliasGain);
+        ok = ok && alias <= Test.MaxAlias;
+        printf(", alias of %.0f Hz %.1f dB (limit %.0f)", aliasFrequency, alias, Test.MaxAlias);
+    }
+    printf(": %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+//
+//  Stereo in 10 ms blocks through each kernel, for about 200 ms.
+//
+static void RunSpeed(const RatePair& Rates, const QualityCase& Test)
+{
+    static const SampleConvertKernel kernels[] = { SampleKernelScalar, SampleKernelSse2, SampleKernelAvx2 };
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, 2, Rates.Input, 32, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT);
+    const size_t block = Rates.Input / 100;
+    std::vector<float> input(block * 2);
+    for (size_t i = 0; i < input.size(); i++)
+    {
+        input[i] = static_cast<float>(0.5 * sin(0.01 * static_cast<double>(i)));
+    }
+
+    printf("%5u -> %5u %-6s:", Rates.Input, Rates.Output, Test.Name);
+    uint32_t taps = 0;
+    for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+        CResampler resampler;
+        if (!resampler.Initialize(&format.Format, Rates.Output, Test.Quality, block, kernels[k]))
+        {
+            return;
+        }
+        if (resampler.Kernel() != kernels[k])
+        {
+            printf(" %s not available;", SampleConvertKernelName(kernels[k]));
+            continue;
+        }
+        taps = resampler.TapsPerPhase();
+        uint64_t blocks = 0;
+        uint64_t outputFrames = 0;
+        int64_t start = SteadyClockNs();
+        int64_t elapsed = 0;
+        while (elapsed < 200000000)
+        {
+            for (int i = 0; i < 100; i++)
+            {
+                size_t frames;
+                resampler.Process(&input[0], block, &frames);
+                outputFrames += frames;
+            }
+            blocks += 100;
+            elapsed = SteadyClockNs() - start;
+        }
+        printf(" %s %.0fx real time, %.1f M frames/s out;", SampleConvertKernelName(kernels[k]),
+            static_cast<double>(blocks) * 10000000.0 / elapsed, outputFrames * 1000.0 / elapsed);
+    }
+    printf(" %u taps per phase\n", taps);
+}
+
+int main(int argc, char* argv[])
+{
+    bool speed = atoi(GetArg(argc, argv, "--speed", "1")) != 0;
+
+    bool passed = true;
+    for (size_t r = 0; r < sizeof(RatePairs) / sizeof(RatePairs[0]); r++)
+    {
+        for (size_t q = 0; q < sizeof(QualityCases) / sizeof(QualityCases[0]); q++)
+        {
+            passed = RunQuality(RatePairs[r], QualityCases[q]) && passed;
+        }
+    }
+    if (speed)
+    {
+        for (size_t r = 0; r < sizeof(RatePairs) / sizeof(RatePairs[0]); r++)
+        {
+            for (size_t q = 0; q < sizeof(QualityCases) / sizeof(QualityCases[0]); q++)
+            {
+                RunSpeed(RatePairs[r], QualityCases[q]);
+            }
+        }
+    }
+    printf("%s\n", passed ? "ok" : "FAILED");
+    return passed ? 0 : 1;
+}
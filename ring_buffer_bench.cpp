@@ -0,0 +1,274 @@
+//
+//  Stress test of the capture ring on Linux: a producer thread standing in for the capture thread and a consumer
+//  standing in for the writer loop move frames through a small CCaptureRingBuffer as fast as they can for --seconds.
+//
+//  Every frame is --channels 32 bit words, each holding the frame's number mixed with its channel, so a frame that
+//  was lost, repeated, reordered or read half written shows up as a mismatch.  Both sides pick at random between
+//  their copying calls and the Begin/Commit calls, in random sizes, sometimes committing less than they reserved;
+//  the producer writes some stretches with WriteSilence(), which must read back as zeros.  The capacity defaults to
+//  an odd number of frames so the wrap point moves around, and every reservation split in two must be split exactly
+//  there.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include "CaptureRingBuffer.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+//
+//  Frames 1024 to 1279 of every 4096 are written as silence.
+//
+static bool IsSilentFrame(uint64_t Frame)
+{
+    return Frame % 4096 >= 1024 && Frame % 4096 < 1280;
+}
+
+static uint32_t FrameWord(uint64_t Frame, size_t Channel)
+{
+    return static_cast<uint32_t>(Frame * 2654435761u) ^ static_cast<uint32_t>(Channel * 0x9E3779B9u) ^ 1u;
+}
+
+class CRingStress
+{
+public:
+    CRingStress(CCaptureRingBuffer* Ring, size_t Channels, size_t MaxChunk) :
+        _Ring(Ring), _Channels(Channels), _MaxChunk(MaxChunk), _Stop(false), _Done(false), _Written(0), _ProducerWaits(0),
+        _Read(0), _Errors(0), _SplitErrors(0), _Splits(0)
+    {
+    }
+
+    void Producer(uint32_t Seed)
+    {
+        std::mt19937 random(Seed);
+        std::vector<uint32_t> chunk(_MaxChunk * _Channels);
+        uint64_t frame = 0;
+        while (!_Stop.load(std::memory_order_relaxed))
+        {
+            size_t frames = 1 + random() % _MaxChunk;
+            size_t written = 0;
+            if (IsSilentFrame(frame))
+            {
+                written = _Ring->WriteSilence(std::min<size_t>(frames, 1280 - frame % 4096));
+            }
+            else
+            {
+                frames = std::min<size_t>(frames, SilenceStart(frame) - frame);
+                if (random() % 2 == 0)
+                {
+                    for (size_t i = 0; i < frames; i++)
+                    {
+                        Fill(&chunk[i * _Channels], frame + i);
+                    }
+                    written = _Ring->Write(reinterpret_cast<const uint8_t*>(&chunk[0]), frames);
+                }
+                else
+                {
+                    CaptureRingRegion regions[2];
+                    size_t reserved = _Ring->BeginWrite(frames, regions);
+                    CheckSplit(regions, reserved);
+                    written = random() % 4 == 0 ? reserved / 2 : reserved;
+                    for (size_t i = 0; i < written; i++)
+                    {
+                        Fill(FrameAt(regions, i), frame + i);
+                    }
+                    _Ring->CommitWrite(written);
+                }
+            }
+            if (written == 0)
+            {
+                _ProducerWaits++;
+                std::this_thread::yield();
+            }
+            frame += written;
+            _Written.store(frame, std::memory_order_relaxed);
+        }
+        _Done.store(true, std::memory_order_release);
+    }
+
+    void Consumer(uint32_t Seed)
+    {
+        std::mt19937 random(Seed);
+        std::vector<uint32_t> chunk(_MaxChunk * _Channels);
+        uint64_t frame = 0;
+        for (;;)
+        {
+            size_t frames = 1 + random() % _MaxChunk;
+            size_t read = 0;
+            if (random() % 2 == 0)
+            {
+                read = _Ring->Read(reinterpret_cast<uint8_t*>(&chunk[0]), frames);
+                for (size_t i = 0; i < read; i++)
+                {
+                    Verify(&chunk[i * _Channels], frame + i);
+                }
+            }
+            else
+            {
+                CaptureRingRegion regions[2];
+                size_t reserved = _Ring->BeginRead(frames, regions);
+                CheckSplit(regions, reserved);
+                read = random() % 4 == 0 ? reserved / 2 : reserved;
+                for (size_t i = 0; i < read; i++)
+                {
+                    Verify(FrameAt(regions, i), frame + i);
+                }
+                _Ring->CommitRead(read);
+            }
+            frame += read;
+            if (read == 0)
+            {
+                //
+                //  Only give up once the producer is done and everything it wrote is read.
+                //
+                if (_Done.load(std::memory_order_acquire) && frame == _Written.load(std::memory_order_relaxed))
+                {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+        _Read = frame;
+    }
+
+    void Stop() { _Stop.store(true, std::memory_order_release); }
+
+    uint64_t Written() const { return _Written.load(); }
+    uint64_t ProducerWaits() const { return _ProducerWaits; }
+    uint64_t Read() const { return _Read; }
+    uint64_t Errors() const { return _Errors; }
+    uint64_t SplitErrors() const { return _SplitErrors.load(); }
+    uint64_t Splits() const { return _Splits.load(); }
+
+private:
+    static uint64_t SilenceStart(uint64_t Frame)
+    {
+        uint64_t start = Frame - Frame % 4096 + 1024;
+        return start > Frame ? start : start + 4096;
+    }
+
+    void Fill(uint32_t* Words, uint64_t Frame)
+    {
+        for (size_t channel = 0; channel < _Channels; channel++)
+        {
+            Words[channel] = FrameWord(Frame, channel);
+        }
+    }
+
+    void Verify(const uint32_t* Words, uint64_t Frame)
+    {
+        bool silent = IsSilentFrame(Frame);
+        for (size_t channel = 0; channel < _Channels; channel++)
+        {
+            if (Words[channel] != (silent ? 0 : FrameWord(Frame, channel)))
+            {
+                if (_Errors++ < 10)
+                {
+                    fprintf(stderr, "Frame %llu channel %zu: read %08x, expected %08x\n", static_cast<unsigned long long>(Frame),
+                        channel, Words[channel], silent ? 0 : FrameWord(Frame, channel));
+                }
+                return;
+            }
+        }
+    }
+
+    uint32_t* FrameAt(const CaptureRingRegion Regions[2], size_t Index)
+    {
+        const CaptureRingRegion& region = Index < Regions[0].Frames ? Regions[0] : Regions[1];
+        size_t frame = Index < Regions[0].Frames ? Index : Index - Regions[0].Frames;
+        return reinterpret_cast<uint32_t*>(region.Data + frame * _Ring->FrameSize());
+    }
+
+    //
+    //  A second region starts the buffer, and the first must then end where the buffer does.
+    //
+    void CheckSplit(const CaptureRingRegion Regions[2], size_t Frames)
+    {
+        if (Regions[0].Frames + Regions[1].Frames != Frames)
+        {
+            _SplitErrors++;
+        }
+        if (Regions[1].Frames != 0)
+        {
+            _Splits++;
+            if (Regions[0].Data + Regions[0].Frames * _Ring->FrameSize() != Regions[1].Data + _Ring->FrameCapacity() * _Ring->FrameSize())
+            {
+                _SplitErrors++;
+            }
+        }
+    }
+
+    CCaptureRingBuffer*     _Ring;
+    size_t                  _Channels;
+    size_t                  _MaxChunk;
+    std::atomic<bool>       _Stop;
+    std::atomic<bool>       _Done;
+    std::atomic<uint64_t>   _Written;
+    uint64_t                _ProducerWaits;
+    uint64_t                _Read;
+    uint64_t                _Errors;
+    std::atomic<uint64_t>   _SplitErrors;
+    std::atomic<uint64_t>   _Splits;
+};
+
+int main(int argc, char* argv[])
+{
+    double seconds = atof(GetArg(argc, argv, "--seconds", "5"));
+    int capacity = atoi(GetArg(argc, argv, "--capacity", "1021"));
+    int channels = atoi(GetArg(argc, argv, "--channels", "3"));
+    int maxChunk = atoi(GetArg(argc, argv, "--max-chunk", "700"));
+    uint32_t seed = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--seed", "1")));
+    if (seconds <= 0 || capacity <= 0 || channels <= 0 || maxChunk <= 0)
+    {
+        fprintf(stderr, "Usage: %s [--seconds N] [--capacity frames] [--channels N] [--max-chunk frames] [--seed N]\n", argv[0]);
+        return 1;
+    }
+
+    CCaptureRingBuffer ring;
+    if (!ring.Initialize(static_cast<size_t>(capacity), static_cast<size_t>(channels) * sizeof(uint32_t)))
+    {
+        fprintf(stderr, "Unable to allocate the ring.\n");
+        return 1;
+    }
+    CRingStress stress(&ring, static_cast<size_t>(channels), static_cast<size_t>(maxChunk));
+    int64_t start = SteadyClockNs();
+    std::thread consumer(&CRingStress::Consumer, &stress, seed + 1);
+    std::thread producer(&CRingStress::Producer, &stress, seed);
+    std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<int64_t>(seconds * 1000)));
+    stress.Stop();
+    producer.join();
+    consumer.join();
+    double elapsed = (SteadyClockNs() - start) / 1e9;
+
+    bool passed = stress.Errors() == 0 && stress.SplitErrors() == 0 && stress.Read() == stress.Written() && stress.Written() != 0;
+    printf("Ring of %d frames of %d words: %llu frames in %.1f s (%.1f M frames/s), %llu wraps, %llu split reservations, "
+        "producer found it full %llu times\n",
+        capacity, channels, static_cast<unsigned long long>(stress.Written()), elapsed, stress.Written() / elapsed / 1e6,
+        static_cast<unsigned long long>(stress.Written() / static_cast<uint64_t>(capacity)),
+        static_cast<unsigned long long>(stress.Splits()), static_cast<unsigned long long>(stress.ProducerWaits()));
+    printf("Read back %llu frames: %llu wrong, %llu bad splits: %s\n", static_cast<unsigned long long>(stress.Read()),
+        static_cast<unsigned long long>(stress.Errors()), static_cast<unsigned long long>(stress.SplitErrors()),
+        passed ? "ok" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,243 @@
+//
+//  Sample conversion kernel test and benchmark on Linux.
+//
+//  For every output format (16, 24 and 32 bit, with and without dither) and 1, 2 and 6 channels, each kernel the
+//  CPU has converts --seconds of float audio salted with the awkward values: full scale and beyond, ties between
+//  two integers, values next to the 32 bit clip point, -0, denormals, infinities and NaN.  It converts in pieces of
+//  random sizes, so every call starts in a different dither lane and splits into a scalar head, the kernel and a
+//  scalar tail differently, once into a separate buffer and once in place, and both must match the scalar kernel
+//  converting the whole stream at once byte for byte.  Then it times the kernel on 10 ms chunks of stereo, the
+//  capture path's packet size.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <limits>
+#include <random>
+#include <vector>
+#include "AudioFormat.h"
+#include "SampleConvert.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static const uint32_t SampleRate = 48000;
+
+//
+//  Mostly noise a little past full scale; one sample in sixteen is an edge case and one a tie at the output size.
+//
+static std::vector<float> MakeInput(size_t Samples, WORD OutputBits, uint32_t Seed)
+{
+    const float scale = OutputBits == 16 ? 32768.0f : OutputBits == 24 ? 8388608.0f : 2147483648.0f;
+    const float edges[] =
+    {
+        0.0f, -0.0f, 1.0f, -1.0f, 1.5f, -1.5f, 32767.0f / 32768.0f, 0.99999994f, -0.99999994f,
+        std::numeric_limits<float>::denorm_min(), -std::numeric_limits<float>::denorm_min(),
+        std::numeric_limits<float>::min(), std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(),
+        std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(),
+        2147483520.0f / 2147483648.0f, 2147483648.0f / 2147483648.0f,
+    };
+    std::mt19937 random(Seed);
+    std::uniform_real_distribution<float> noise(-1.2f, 1.2f);
+    std::vector<float> input(Samples);
+    for (size_t i = 0; i < Samples; i++)
+    {
+        uint32_t kind = random() % 16;
+        if (kind == 0)
+        {
+            input[i] = edges[random() % (sizeof(edges) / sizeof(edges[0]))];
+        }
+        else if (kind == 1)
+        {
+            //
+            //  Exactly halfway between two output values, which must round to even.
+            //
+            int32_t step = static_cast<int32_t>(random() % 65536) - 32768;
+            input[i] = (static_cast<float>(step) + 0.5f) / scale;
+        }
+        else
+        {
+            input[i] = noise(random);
+        }
+    }
+    return input;
+}
+
+struct ConvertCase
+{
+    const char* Name;
+    WORD        Bits;
+    bool        Dither;
+};
+
+static const ConvertCase ConvertCases[] =
+{
+    { "s16", 16, false },
+    { "s16 dither", 16, true },
+    { "s24", 24, false },
+    { "s24 dither", 24, true },
+    { "s32", 32, false },
+    { "s32 dither", 32, true },
+};
+
+//
+//  Converts the stream in random pieces, into Output or, when InPlace, over a copy of the input.
+//
+static void ConvertInPieces(CSampleConverter* Converter, const std::vector<float>& Input, WORD Channels, bool InPlace,
+    uint32_t Seed, std::vector<uint8_t>* Output)
+{
+    const size_t frames = Input.size() / Channels;
+    const size_t inputFrameSize = Converter->InputFrameSize();
+    const size_t outputFrameSize = Converter->OutputFrameSize();
+    Output->assign(frames * outputFrameSize, 0);
+    std::vector<uint8_t> piece(1024 * inputFrameSize);
+    std::mt19937 random(Seed);
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(&Input[0]);
+    for (size_t frame = 0; frame < frames;)
+    {
+        size_t count = 1 + random() % 1024;
+        if (count > frames - frame)
+        {
+            count = frames - frame;
+        }
+        if (InPlace)
+        {
+            memcpy(&piece[0], input + frame * inputFrameSize, count * inputFrameSize);
+            Converter->Convert(&piece[0], &piece[0], count);
+            memcpy(&(*Output)[frame * outputFrameSize], &piece[0], count * outputFrameSize);
+        }
+        else
+        {
+            Converter->Convert(input + frame * inputFrameSize, &(*Output)[frame * outputFrameSize], count);
+        }
+        frame += count;
+    }
+}
+
+static size_t CountWrongSamples(const std::vector<uint8_t>& Output, const std::vector<uint8_t>& Expected, size_t SampleSize)
+{
+    size_t wrong = 0;
+    for (size_t i = 0; i < Output.size(); i += SampleSize)
+    {
+        wrong += memcmp(&Output[i], &Expected[i], SampleSize) != 0 ? 1 : 0;
+    }
+    return wrong;
+}
+
+//
+//  How fast the converter gets through 10 ms chunks of stereo.
+//
+static double TimeConverter(CSampleConverter* Converter, const std::vector<float>& Input)
+{
+    const size_t chunkFrames = SampleRate / 100;
+    std::vector<uint8_t> output(chunkFrames * Converter->OutputFrameSize());
+    const uint8_t* input = reinterpret_cast<const uint8_t*>(&Input[0]);
+    uint64_t chunks = 0;
+    int64_t start = SteadyClockNs();
+    int64_t elapsed = 0;
+    while (elapsed < 200000000)
+    {
+        for (int i = 0; i < 1000; i++)
+        {
+            Converter->Convert(input, &output[0], chunkFrames);
+        }
+        chunks += 1000;
+        elapsed = SteadyClockNs() - start;
+    }
+    return static_cast<double>(elapsed) / chunks;
+}
+
+int main(int argc, char* argv[])
+{
+    double seconds = atof(GetArg(argc, argv, "--seconds", "2"));
+    uint32_t seed = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--seed", "1")));
+    if (seconds <= 0)
+    {
+        fprintf(stderr, "Usage: %s [--seconds N] [--seed N]\n", argv[0]);
+        return 1;
+    }
+
+    static const SampleConvertKernel kernels[] = { SampleKernelScalar, SampleKernelSse2, SampleKernelAvx2 };
+    static const WORD channelCounts[] = { 1, 2, 6 };
+    const size_t frames = static_cast<size_t>(seconds * SampleRate);
+    bool passed = true;
+    for (size_t c = 0; c < sizeof(ConvertCases) / sizeof(ConvertCases[0]); c++)
+    {
+        const ConvertCase& test = ConvertCases[c];
+        for (size_t n = 0; n < sizeof(channelCounts) / sizeof(channelCounts[0]); n++)
+        {
+            const WORD channels = channelCounts[n];
+            WAVEFORMATEXTENSIBLE format;
+            InitializeWaveFormat(&format, true, channels, SampleRate, 32, 0);
+            std::vector<float> input = MakeInput(frames * channels, test.Bits, seed + static_cast<uint32_t>(c * 16 + n));
+
+            CSampleConverter reference;
+            if (!reference.Initialize(&format.Format, false, test.Bits, test.Dither, SampleKernelScalar))
+            {
+                return 1;
+            }
+            std::vector<uint8_t> expected(frames * reference.OutputFrameSize());
+            reference.Convert(reinterpret_cast<const uint8_t*>(&input[0]), &expected[0], frames);
+
+            for (size_t k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+            {
+                CSampleConverter converter;
+                if (!converter.Initialize(&format.Format, false, test.Bits, test.Dither, kernels[k]))
+                {
+                    return 1;
+                }
+                if (converter.Kernel() != kernels[k])
+                {
+                    printf("%-10s %uch %-6s: not available\n", test.Name, channels, SampleConvertKernelName(kernels[k]));
+                    continue;
+                }
+
+                std::vector<uint8_t> output;
+                ConvertInPieces(&converter, input, channels, false, seed + 1, &output);
+                size_t wrong = CountWrongSamples(output, expected, test.Bits / 8);
+                CSampleConverter inPlace;
+                inPlace.Initialize(&format.Format, false, test.Bits, test.Dither, kernels[k]);
+                ConvertInPieces(&inPlace, input, channels, true, seed + 2, &output);
+                size_t wrongInPlace = CountWrongSamples(output, expected, test.Bits / 8);
+                bool ok = wrong == 0 && wrongInPlace == 0;
+
+                if (channels == 2)
+                {
+                    CSampleConverter timed;
+                    timed.Initialize(&format.Format, false, test.Bits, test.Dither, kernels[k]);
+                    double chunkNs = TimeConverter(&timed, input);
+                    double samples = SampleRate / 100 * 2;
+                    printf("%-10s %uch %-6s: %zu and %zu of %zu samples differ from scalar; %.2f GB/s, %.0f M samples/s, "
+                        "%.1f ns per 10 ms chunk: %s\n", test.Name, channels, SampleConvertKernelName(kernels[k]), wrong,
+                        wrongInPlace, expected.size() / (test.Bits / 8), samples * sizeof(float) / chunkNs,
+                        samples * 1000.0 / chunkNs, chunkNs, ok ? "ok" : "FAILED");
+                }
+                else
+                {
+                    printf("%-10s %uch %-6s: %zu and %zu of %zu samples differ from scalar: %s\n", test.Name, channels,
+                        SampleConvertKernelName(kernels[k]), wrong, wrongInPlace, expected.size() / (test.Bits / 8),
+                        ok ? "ok" : "FAILED");
+                }
+                passed = passed && ok;
+            }
+        }
+    }
+    printf("%s\n", passed ? "ok" : "FAILED");
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,315 @@
+//
+//  Segmented output seam test on Linux.
+//
+//  Records --seconds of the synthetic source, unpaced, through the ring and the asynchronous writer: once into a
+//  plain PCM file as the reference, then into segments cut by duration, by size and on random rotation requests
+//  from another thread, the way SIGUSR1 reaches the CLI.  The format is 3 channel 16 bit, so the writer's blocks
+//  split frames and every cut has to find a frame boundary inside a write.  A last run records --realtime-seconds
+//  in real time, in 250 ms segments.
+//
+//  Each run checks the manifest - consecutive segments, each starting at the frame after the previous one ended, with
+//  as many frames as its file holds and the limit respected - then concatenates the segments and compares them with
+//  the reference byte for byte, so a lost or duplicated frame at any seam fails.  An unpaced source's clock runs
+//  ahead of the wall clock, so capture times are checked only in the real time run: every segment must start
+//  within a millisecond of where the sample clock puts it.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include "SyntheticCaptureSource.h"
+#include "AsyncWriter.h"
+#include "OutputSink.h"
+#include "SegmentedSink.h"
+#include "WavFile.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static const uint32_t SampleRate = 48000;
+static const uint16_t Channels = 3;
+static const uint32_t FrameSize = Channels * 2;
+
+//
+//  The synthetic source, in real time or unpaced, into Sink until Frames frames were written.  Rotate, if set, runs on its own
+//  thread meanwhile and stops when told.
+//
+template <typename RotateFunction>
+static bool Record(IOutputSink* Sink, CCapturePacketLog* PacketLog, uint64_t Frames, bool RealTime, RotateFunction Rotate)
+{
+    CSyntheticCaptureSource* source = new CSyntheticCaptureSource();
+    if (!source->Initialize(SampleRate, Channels, 16, false, 480, 0, RealTime))
+    {
+        source->Release();
+        return false;
+    }
+    CCaptureRingBuffer ring;
+    ring.Initialize(SampleRate, source->FrameSize());
+    DurabilityPolicy durability = { 1000, 0 };
+    CAsyncWriter writer;
+    if (!writer.Initialize(Sink, 1024 * 1024, 8, durability))
+    {
+        source->Release();
+        return false;
+    }
+
+    CaptureProcessing processing = {};
+    processing.PacketLog = PacketLog;
+    if (!source->Start(&ring, &processing))
+    {
+        source->Release();
+        return false;
+    }
+    std::atomic<bool> stop(false);
+    std::thread rotator([&]() { Rotate(&stop); });
+    uint64_t frames = 0;
+    while (frames < Frames && !writer.Failed())
+    {
+        size_t framesToRead = static_cast<size_t>(std::min<uint64_t>(writer.WritableBytes() / ring.FrameSize(), Frames - frames));
+        CaptureRingRegion regions[2];
+        size_t available = ring.BeginRead(framesToRead, regions);
+        for (int i = 0; i < 2; i++)
+        {
+            if (regions[i].Frames != 0)
+            {
+                writer.Write(regions[i].Data, regions[i].Frames * ring.FrameSize());
+            }
+        }
+        ring.CommitRead(available);
+        writer.Submit();
+        frames += available;
+        if (available == 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    source->Stop();
+    stop.store(true);
+    rotator.join();
+    bool succeeded = writer.Close() && frames == Frames;
+    source->Shutdown();
+    source->Release();
+    return succeeded;
+}
+
+static bool ReadFile(const std::string& FileName, bool IsWav, std::vector<uint8_t>* Data)
+{
+    FILE* file = fopen(FileName.c_str(), "rb");
+    if (file == NULL)
+    {
+        printf("Missing %s\n", FileName.c_str());
+        return false;
+    }
+    uint64_t offset = 0;
+    uint64_t size = FileSize64(file);
+    WavFileInfo info;
+    if (IsWav)
+    {
+        if (!ReadWavHeader(file, &info))
+        {
+            printf("%s is not a WAV file\n", FileName.c_str());
+            fclose(file);
+            return false;
+        }
+        offset = info.DataOffset;
+        size = std::min(info.DataSize, size - offset);
+    }
+    Data->resize(static_cast<size_t>(size));
+    bool succeeded = SeekFile64(file, offset) && (size == 0 || fread(&(*Data)[0], 1, Data->size(), file) == Data->size());
+    fclose(file);
+    return succeeded;
+}
+
+//
+//  Checks the manifest and the segments against the reference, and deletes them.
+//
+static bool CheckSegments(const std::string& FileName, const SegmentOptions& Options, const std::vector<uint8_t>& Reference,
+    uint64_t Frames, bool RealTime, const char* Name, const SegmentedSinkStats& Stats)
+{
+    std::string manifestFileName = CSegmentedSink::ManifestFileName(FileName);
+    FILE* manifest = fopen(manifestFileName.c_str(), "r");
+    if (manifest == NULL)
+    {
+        printf("%s: no manifest\n", Name);
+        return false;
+    }
+    std::string directory = FileName.substr(0, FileName.find_last_of('/') + 1);
+    bool isWav = Options.FileFormat == SegmentFileWav;
+    uint64_t maxBytes = Options.MaxFrames != 0 ? Options.MaxFrames * FrameSize : UINT64_MAX;
+    maxBytes = std::min(maxBytes, Options.MaxBytes != 0 ? Options.MaxBytes / FrameSize * FrameSize : UINT64_MAX);
+
+    char line[1024];
+    unsigned int sampleRate = 0;
+    unsigned int frameSize = 0;
+    bool passed = fgets(line, sizeof(line), manifest) != NULL &&
+        sscanf(line, "{\"sampleRate\":%u,\"channels\":%*u,\"bitsPerSample\":%*u,\"float\":%*[a-z],\"frameSize\":%u", &sampleRate, &frameSize) == 2 &&
+        sampleRate == SampleRate && frameSize == FrameSize;
+    if (!passed)
+    {
+        printf("%s: bad manifest header\n", Name);
+    }
+
+    uint32_t segments = 0;
+    uint64_t nextFrame = 0;
+    int64_t firstWallTimeNs = 0;
+    int64_t maxTimeErrorNs = 0;
+    uint64_t shortSegments = 0;
+    std::vector<uint8_t> data;
+    while (passed && fgets(line, sizeof(line), manifest) != NULL)
+    {
+        unsigned int index;
+        char file[256];
+        unsigned long long startFrame, frames, dataBytes;
+        long long wallTimeNs;
+        char reason[32];
+        if (sscanf(line, "{\"segment\":%u,\"file\":\"%255[^\"]\",\"startFrame\":%llu,\"frames\":%llu,\"dataBytes\":%llu,\"startWallTimeNs\":%lld,\"reason\":\"%31[^\"]\"}",
+                &index, file, &startFrame, &frames, &dataBytes, &wallTimeNs, reason) != 7)
+        {
+            printf("%s: bad manifest line %s", Name, line);
+            passed = false;
+            break;
+        }
+        std::string segmentFile = directory + file;
+        firstWallTimeNs = segments == 0 ? wallTimeNs : firstWallTimeNs;
+        int64_t timeErrorNs = llabs(wallTimeNs - firstWallTimeNs - static_cast<int64_t>(startFrame * 1000000000 / SampleRate));
+        maxTimeErrorNs = std::max(maxTimeErrorNs, timeErrorNs);
+        if (index != segments || startFrame != nextFrame || frames == 0 || dataBytes != frames * FrameSize || dataBytes > maxBytes ||
+            wallTimeNs == 0 || (RealTime && timeErrorNs > 1000000) || !ReadFile(segmentFile, isWav, &data) || data.size() != dataBytes)
+        {
+            printf("%s: segment %u is inconsistent: %s", Name, segments, line);
+            passed = false;
+            break;
+        }
+        if (startFrame * FrameSize + data.size() > Reference.size() || memcmp(&data[0], &Reference[startFrame * FrameSize], data.size()) != 0)
+        {
+            printf("%s: segment %u doesn't match the source\n", Name, segments);
+            passed = false;
+            break;
+        }
+        shortSegments += strcmp(reason, "signal") == 0 || strcmp(reason, "end") == 0 ? 1 : 0;
+        nextFrame += frames;
+        segments++;
+    }
+    fclose(manifest);
+    unlink(manifestFileName.c_str());
+    for (uint32_t i = 0; i <= Stats.Segments; i++)
+    {
+        unlink(CSegmentedSink::SegmentFileName(FileName, i).c_str());
+    }
+    if (passed && nextFrame != Frames)
+    {
+        printf("%s: the segments hold %llu frames, the source %llu\n", Name, static_cast<unsigned long long>(nextFrame),
+            static_cast<unsigned long long>(Frames));
+        passed = false;
+    }
+    printf("%s: %u segments (%llu cut by a request or the end), %llu waited for the next file, rotation %.1f us on average, max %llu us",
+        Name, segments, static_cast<unsigned long long>(shortSegments), static_cast<unsigned long long>(Stats.Stalls),
+        Stats.Segments > 1 ? static_cast<double>(Stats.TotalRotationUs) / (Stats.Segments - 1) : 0.0,
+        static_cast<unsigned long long>(Stats.MaxRotationUs));
+    if (RealTime)
+    {
+        printf(", start times within %.1f us of the sample clock", maxTimeErrorNs / 1000.0);
+    }
+    printf(": %s\n", passed ? "seams gapless" : "FAILED");
+    return passed;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t seconds = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--seconds", "30")));
+    uint32_t realTimeSeconds = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--realtime-seconds", "3")));
+    uint32_t seed = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--seed", "1")));
+    if (seconds == 0 || realTimeSeconds > seconds)
+    {
+        fprintf(stderr, "Usage: %s [--seconds N] [--realtime-seconds N] [--seed N]\n", argv[0]);
+        return 1;
+    }
+    uint64_t frames = static_cast<uint64_t>(seconds) * SampleRate;
+    std::string prefix = "/tmp/audio_capture_segment_bench_" + std::to_string(getpid());
+
+    std::string referenceFile = prefix + "_reference.pcm";
+    CPcmFileSink reference;
+    std::vector<uint8_t> referenceData;
+    if (!reference.Open(referenceFile) || !Record(&reference, NULL, frames, false, [](std::atomic<bool>*) {}) ||
+        !ReadFile(referenceFile, false, &referenceData))
+    {
+        fprintf(stderr, "Reference recording failed.\n");
+        unlink(referenceFile.c_str());
+        return 1;
+    }
+    unlink(referenceFile.c_str());
+
+    struct Scenario
+    {
+        const char*         Name;
+        SegmentFileFormat   FileFormat;
+        uint64_t            MaxFrames;
+        uint64_t            MaxBytes;
+        bool                Requests;
+        bool                RealTime;
+    };
+    static const Scenario scenarios[] =
+    {
+        { "duration", SegmentFilePcm, SampleRate * 37 / 100, 0, false, false },
+        { "size", SegmentFileWav, 0, 100001, false, false },
+        { "requests", SegmentFilePcm, 0, 0, true, false },
+        { "requests+duration", SegmentFileWav, SampleRate, 0, true, false },
+        { "realtime", SegmentFileWav, SampleRate / 4, 0, false, true },
+    };
+
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, false, Channels, SampleRate, 16, 0);
+    bool passed = true;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++)
+    {
+        const Scenario& scenario = scenarios[i];
+        uint64_t scenarioFrames = scenario.RealTime ? static_cast<uint64_t>(realTimeSeconds) * SampleRate : frames;
+        if (scenarioFrames == 0)
+        {
+            continue;
+        }
+        std::string fileName = prefix + (scenario.FileFormat == SegmentFileWav ? ".wav" : ".pcm");
+        SegmentOptions options = { scenario.FileFormat, scenario.MaxFrames, scenario.MaxBytes, 4 * 1024 * 1024 };
+        CCapturePacketLog packetLog;
+        CSegmentedSink sink;
+        if (!packetLog.Initialize(16384) || !sink.Open(fileName, &format.Format, options, &packetLog))
+        {
+            passed = false;
+            continue;
+        }
+
+        //
+        //  Requests every 1 to 20 ms, faster than the writer's blocks arrive, so some land on the same frame.
+        //
+        std::mt19937 random(seed + static_cast<uint32_t>(i));
+        bool recorded = Record(&sink, &packetLog, scenarioFrames, scenario.RealTime, [&](std::atomic<bool>* Stop)
+        {
+            while (scenario.Requests && !Stop->load())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1 + random() % 20));
+                sink.RequestRotation();
+            }
+        });
+        SegmentedSinkStats stats;
+        sink.GetStats(&stats);
+        passed = recorded && CheckSegments(fileName, options, referenceData, scenarioFrames, scenario.RealTime, scenario.Name, stats) && passed;
+    }
+    printf("%s\n", passed ? "All seams gapless." : "SEAM MISMATCH.");
+    return passed ? 0 : 1;
+}
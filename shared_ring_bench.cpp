@@ -0,0 +1,277 @@
+//
+//  Two process benchmark of the shared memory ring: a forked writer publishes audio through CSharedRingSink the way
+//  the CLI's writer thread does, and this process reads it back with CSharedRingReader.
+//
+//  latency     The writer publishes one block every --block-ms.  The reader polls and, for every block, measures
+//              the time from the writer's block timestamp to the reader seeing it.
+//  throughput  The writer publishes --burst-mb as fast as it can; the reader copies it out and counts what it lost
+//              to being lapped.  Every block is filled with its number, so torn reads would show up as corrupt bytes.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "SharedRingReader.h"
+#include "SharedRingSink.h"
+
+struct BenchOptions
+{
+    std::string Mode;
+    uint32_t    Rate;
+    uint32_t    Channels;
+    uint32_t    BlockMs;
+    uint32_t    Blocks;
+    uint32_t    RingMs;
+    uint32_t    PollUs;         // 0 spins with yield().
+    uint32_t    BurstMB;
+};
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static int64_t NowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void Poll(const BenchOptions& Options)
+{
+    if (Options.PollUs == 0)
+    {
+        std::this_thread::yield();
+    }
+    else
+    {
+        std::this_thread::sleep_for(std::chrono::microseconds(Options.PollUs));
+    }
+}
+
+//
+//  Child: create the ring, wait for the reader to attach, then publish.
+//
+static int RunWriter(const BenchOptions& Options, const std::string& Name, size_t BlockBytes, int ReadyPipe)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, static_cast<WORD>(Options.Channels), Options.Rate, 32, 0);
+    size_t ringBytes = static_cast<size_t>(Options.RingMs) * Options.Rate / 1000 * format.Format.nBlockAlign;
+
+    CSharedRingSink sink;
+    if (!sink.Open(Name, &format.Format, ringBytes, BlockBytes))
+    {
+        return 1;
+    }
+    char ready;
+    if (read(ReadyPipe, &ready, 1) != 1)
+    {
+        return 1;
+    }
+
+    std::vector<uint8_t> block(BlockBytes);
+    if (Options.Mode == "latency")
+    {
+        auto next = std::chrono::steady_clock::now();
+        for (uint32_t i = 0; i < Options.Blocks; i++)
+        {
+            memset(&block[0], static_cast<int>(i), BlockBytes);
+            sink.Write(&block[0], BlockBytes);
+            next += std::chrono::milliseconds(Options.BlockMs);
+            std::this_thread::sleep_until(next);
+        }
+    }
+    else
+    {
+        uint64_t total = static_cast<uint64_t>(Options.BurstMB) << 20;
+        for (uint64_t written = 0; written < total; written += BlockBytes)
+        {
+            memset(&block[0], static_cast<int>(written / BlockBytes), BlockBytes);
+            sink.Write(&block[0], BlockBytes);
+        }
+    }
+    sink.Close();
+    return 0;
+}
+
+static double Percentile(std::vector<int64_t>& Values, double Fraction)
+{
+    size_t index = std::min(Values.size() - 1, static_cast<size_t>(Fraction * Values.size()));
+    std::nth_element(Values.begin(), Values.begin() + index, Values.end());
+    return Values[index] / 1000.0;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions options;
+    options.Mode = GetArg(argc, argv, "--mode", "latency");
+    options.Rate = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--rate", "48000")));
+    options.Channels = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--channels", "2")));
+    options.BlockMs = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--block-ms", "10")));
+    options.Blocks = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--blocks", "1000")));
+    options.RingMs = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--ring-ms", "5000")));
+    options.PollUs = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--poll-us", "0")));
+    options.BurstMB = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--burst-mb", "4096")));
+    if ((options.Mode != "latency" && options.Mode != "throughput") || options.Rate == 0 || options.Channels == 0 ||
+        options.BlockMs == 0 || options.Blocks == 0 || options.RingMs == 0 || options.BurstMB == 0)
+    {
+        fprintf(stderr, "Usage: %s [--mode latency|throughput] [--rate Hz] [--channels N] [--block-ms N] [--blocks N]\n"
+            "       [--ring-ms N] [--poll-us N] [--burst-mb N]\n", argv[0]);
+        return 1;
+    }
+
+    size_t frameSize = options.Channels * sizeof(float);
+    size_t blockBytes = static_cast<size_t>(options.BlockMs) * options.Rate / 1000 * frameSize;
+    std::string name = "audio_capture_bench_" + std::to_string(getpid());
+
+    int readyPipe[2];
+    if (pipe(readyPipe) != 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+    pid_t writer = fork();
+    if (writer < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+    if (writer == 0)
+    {
+        close(readyPipe[1]);
+        _exit(RunWriter(options, name, blockBytes, readyPipe[0]));
+    }
+    close(readyPipe[0]);
+
+    CSharedRingReader reader;
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!reader.Open(name))
+    {
+        if (std::chrono::steady_clock::now() > deadline)
+        {
+            fprintf(stderr, "Writer never created %s\n", name.c_str());
+            kill(writer, SIGKILL);
+            waitpid(writer, NULL, 0);
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (write(readyPipe[1], "x", 1) != 1)
+    {
+        perror("write");
+        return 1;
+    }
+
+    std::vector<int64_t> latencies;
+    latencies.reserve(options.Blocks);
+    std::vector<uint8_t> buffer(1 << 20);
+    uint64_t bytesRead = 0;
+    uint64_t missingTimestamps = 0;
+    uint64_t corruptBytes = 0;
+    int64_t start = 0;
+    for (;;)
+    {
+        //
+        //  Check for the end first, so data published just before the writer closed is still read.
+        //
+        bool closed = reader.IsWriterClosed();
+        if (options.Mode == "latency")
+        {
+            SharedRingSpan span;
+            if (reader.Peek(&span, SIZE_MAX) != 0)
+            {
+                int64_t now = NowNs();
+                uint64_t block = (span.Position + blockBytes - 1) / blockBytes;
+                for (; block * blockBytes < span.Position + span.Bytes; block++)
+                {
+                    int64_t timestamp;
+                    if (reader.BlockTimestamp(block * blockBytes, &timestamp))
+                    {
+                        latencies.push_back(now - timestamp);
+                    }
+                    else
+                    {
+                        missingTimestamps++;
+                    }
+                }
+                if (reader.Consume(span))
+                {
+                    bytesRead += span.Bytes;
+                }
+                continue;
+            }
+        }
+        else
+        {
+            size_t bytes = reader.Read(&buffer[0], buffer.size());
+            if (bytes != 0)
+            {
+                uint64_t position = reader.Position() - bytes;
+                for (size_t i = 0; i < bytes; i++)
+                {
+                    corruptBytes += buffer[i] != static_cast<uint8_t>((position + i) / blockBytes);
+                }
+                if (start == 0)
+                {
+                    start = NowNs();
+                }
+                bytesRead += bytes;
+                continue;
+            }
+        }
+        if (closed)
+        {
+            break;
+        }
+        Poll(options);
+    }
+    int64_t elapsed = NowNs() - start;
+    close(readyPipe[1]);
+
+    int status = 0;
+    waitpid(writer, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "Writer failed.\n");
+        return 1;
+    }
+
+    printf("Ring: %llu bytes, %zu byte blocks\n", static_cast<unsigned long long>(reader.Capacity()), blockBytes);
+    if (options.Mode == "latency")
+    {
+        if (latencies.empty())
+        {
+            fprintf(stderr, "No blocks were read.\n");
+            return 1;
+        }
+        printf("Blocks: %zu timed, %llu without timestamp, %llu bytes lost\n", latencies.size(),
+            static_cast<unsigned long long>(missingTimestamps), static_cast<unsigned long long>(reader.LostBytes()));
+        printf("Latency (us): p50 %.1f  p99 %.1f  p99.9 %.1f  max %.1f\n", Percentile(latencies, 0.5),
+            Percentile(latencies, 0.99), Percentile(latencies, 0.999), Percentile(latencies, 1.0));
+    }
+    else
+    {
+        double seconds = elapsed / 1e9;
+        printf("Read %.1f MB in %.3f s (%.2f GB/s), lost %llu bytes to laps, %llu corrupt bytes\n",
+            bytesRead / 1048576.0, seconds, bytesRead / seconds / 1e9, static_cast<unsigned long long>(reader.LostBytes()),
+            static_cast<unsigned long long>(corruptBytes));
+        if (corruptBytes != 0)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
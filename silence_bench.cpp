@@ -0,0 +1,461 @@
+//
+//  Silence collapsed storage benchmark on Linux.
+//
+//  Records a stream into a silence collapsed file and a plain PCM file side by side, the way the writer thread would:
+//  100 ms blocks with a flush every --flush-ms, and a packet log carrying the packets' flags.  The stream is either
+//  a real capture replayed with --replay <file.wav|file.pcm>, or --minutes of a made up idle desktop: stereo float
+//  that is mostly silence, half of it flagged silent by the device, with a short sound every few seconds, and with
+//  --noise-db a noise floor under everything instead of digital silence.
+//
+//  It reports the disk saved, the CPU the sink costs per second of audio next to the PCM sink, and how fast each
+//  detector kernel scans silence.  The file is then expanded and compared with the stream frame by frame: with no
+//  --threshold-db it must be identical; with one, frames may only differ where they were quiet, and come back as
+//  zeros.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "AudioFormat.h"
+#include "CaptureDrain.h"
+#include "OutputSink.h"
+#include "SilenceFile.h"
+#include "WavFile.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static int64_t SteadyClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t ThreadCpuNs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+//
+//  The stream under test, which can be started over to compare against the expanded file.
+//
+class CBenchStream
+{
+public:
+    virtual ~CBenchStream() {}
+    virtual const WAVEFORMATEX* Format() const = 0;
+    virtual bool Rewind() = 0;
+
+    //
+    //  Up to Frames frames of the next packet and its CAPTURE_PACKET_FLAG_xxx; 0 at the end.
+    //
+    virtual size_t Next(uint8_t* Data, size_t Frames, uint32_t* Flags) = 0;
+};
+
+//
+//  Idle desktop: silences of 2 to 40 s, each flagged silent by the device or not with even odds, between sounds of
+//  0.1 to 1.5 s, a tone at -20 dBFS.  The same seed always makes the same stream.
+//
+class CIdleDesktopStream : public CBenchStream
+{
+public:
+    CIdleDesktopStream(uint32_t Minutes, double NoiseDb, uint32_t Seed) :
+        _TotalFrames(static_cast<uint64_t>(Minutes) * 60 * 48000),
+        _Noise(NoiseDb < 0 ? static_cast<float>(pow(10.0, NoiseDb / 20.0)) : 0.0f),
+        _Seed(Seed)
+    {
+        InitializeWaveFormat(&_Format, true, 2, 48000, 32, 0);
+        Rewind();
+    }
+
+    const WAVEFORMATEX* Format() const { return &_Format.Format; }
+
+    bool Rewind()
+    {
+        _Random.seed(_Seed);
+        _Frame = 0;
+        _SegmentFrames = 0;
+        _Sound = true;
+        return true;
+    }
+
+    size_t Next(uint8_t* Data, size_t Frames, uint32_t* Flags)
+    {
+        if (_SegmentFrames == 0)
+        {
+            _Sound = !_Sound;
+            std::uniform_real_distribution<double> length(_Sound ? 0.1 : 2.0, _Sound ? 1.5 : 40.0);
+            _SegmentFrames = static_cast<uint64_t>(length(_Random) * 48000);
+            _Flagged = !_Sound && _Noise == 0 && (_Random() & 1) != 0;
+            _Step = static_cast<float>(2 * 3.14159265358979 * std::uniform_real_distribution<double>(300, 2000)(_Random) / 48000);
+            _Phase = 0;
+        }
+        size_t frames = static_cast<size_t>(std::min<uint64_t>(std::min<uint64_t>(Frames, _SegmentFrames), _TotalFrames - _Frame));
+        float* samples = reinterpret_cast<float*>(Data);
+        std::uniform_real_distribution<float> noise(-_Noise, _Noise);
+        for (size_t i = 0; i < frames; i++)
+        {
+            float value = _Sound ? 0.1f * sinf(_Phase) : 0.0f;
+            _Phase += _Step;
+            samples[i * 2] = _Noise != 0 ? value + noise(_Random) : value;
+            samples[i * 2 + 1] = _Noise != 0 ? value + noise(_Random) : value;
+        }
+        *Flags = _Flagged ? CAPTURE_PACKET_FLAG_SILENT : 0;
+        _Frame += frames;
+        _SegmentFrames -= frames;
+        return frames;
+    }
+
+private:
+    WAVEFORMATEXTENSIBLE    _Format;
+    uint64_t                _TotalFrames;
+    float                   _Noise;
+    uint32_t                _Seed;
+    std::mt19937            _Random;
+    uint64_t                _Frame;
+    uint64_t                _SegmentFrames;
+    bool                    _Sound;
+    bool                    _Flagged;
+    float                   _Step;
+    float                   _Phase;
+};
+
+//
+//  A recording read back from a WAV file, or from a headerless PCM file in the given format.
+//
+class CReplayStream : public CBenchStream
+{
+public:
+    CReplayStream() : _File(NULL), _DataOffset(0), _DataFrames(0), _Frame(0) {}
+    ~CReplayStream() { if (_File != NULL) fclose(_File); }
+
+    bool Open(const std::string& FileName, bool IsFloat, WORD BitsPerSample, WORD Channels, DWORD SampleRate)
+    {
+        _File = fopen(FileName.c_str(), "rb");
+        if (_File == NULL)
+        {
+            fprintf(stderr, "Unable to open %s\n", FileName.c_str());
+            return false;
+        }
+        uint64_t size = FileSize64(_File);
+        WavFileInfo info;
+        if (FileName.size() >= 4 && FileName.compare(FileName.size() - 4, 4, ".wav") == 0)
+        {
+            if (!ReadWavHeader(_File, &info))
+            {
+                fprintf(stderr, "%s is not a WAV file.\n", FileName.c_str());
+                return false;
+            }
+            _Format = info.Format;
+            _DataOffset = info.DataOffset;
+            size = std::min(info.DataSize, size - info.DataOffset);
+        }
+        else
+        {
+            InitializeWaveFormat(&_Format, IsFloat, Channels, SampleRate, BitsPerSample, 0);
+        }
+        _DataFrames = size / _Format.Format.nBlockAlign;
+        return Rewind();
+    }
+
+    const WAVEFORMATEX* Format() const { return &_Format.Format; }
+
+    bool Rewind()
+    {
+        _Frame = 0;
+        return SeekFile64(_File, _DataOffset);
+    }
+
+    size_t Next(uint8_t* Data, size_t Frames, uint32_t* Flags)
+    {
+        size_t frames = static_cast<size_t>(std::min<uint64_t>(Frames, _DataFrames - _Frame));
+        frames = fread(Data, _Format.Format.nBlockAlign, frames, _File);
+        _Frame += frames;
+        *Flags = 0;
+        return frames;
+    }
+
+private:
+    FILE*                   _File;
+    WAVEFORMATEXTENSIBLE    _Format;
+    uint64_t                _DataOffset;
+    uint64_t                _DataFrames;
+    uint64_t                _Frame;
+};
+
+//
+//  Writes the stream to both sinks, timing each on this thread's CPU clock.
+//
+static bool RecordStream(CBenchStream* Stream, const std::string& SilenceFile, const std::string& PcmFile, double Threshold,
+    uint32_t MinSilenceMs, uint32_t FlushMs, CSilenceFileSink* SilenceSink, uint64_t* Frames, int64_t* SilenceCpuNs, int64_t* PcmCpuNs)
+{
+    const WAVEFORMATEX* format = Stream->Format();
+    CCapturePacketLog packetLog;
+    CPcmFileSink pcmSink;
+    if (!packetLog.Initialize(1024) || !SilenceSink->Open(SilenceFile, format, Threshold, MinSilenceMs, &packetLog) || !pcmSink.Open(PcmFile))
+    {
+        return false;
+    }
+
+    size_t packetFrames = std::max<size_t>(format->nSamplesPerSec / 100, 1);
+    size_t blockFrames = packetFrames * 10;
+    uint64_t flushFrames = std::max<uint64_t>(static_cast<uint64_t>(format->nSamplesPerSec) * FlushMs / 1000, blockFrames);
+    std::vector<uint8_t> block(blockFrames * format->nBlockAlign);
+    int64_t wallTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    uint64_t frame = 0;
+    uint64_t lastFlush = 0;
+    *SilenceCpuNs = 0;
+    *PcmCpuNs = 0;
+    for (bool done = false; !done;)
+    {
+        size_t frames = 0;
+        while (frames < blockFrames)
+        {
+            uint32_t flags;
+            size_t packet = Stream->Next(&block[frames * format->nBlockAlign], std::min(packetFrames, blockFrames - frames), &flags);
+            if (packet == 0)
+            {
+                done = true;
+                break;
+            }
+            CapturePacketRecord record = { frame + frames, packet, flags, 0, SteadyClockNs(),
+                wallTimeNs + static_cast<int64_t>((frame + frames) * 1000000000 / format->nSamplesPerSec), 0 };
+            packetLog.Append(record);
+            packetLog.Publish();
+            frames += packet;
+        }
+        frame += frames;
+        bool flush = done || frame - lastFlush >= flushFrames;
+        if (flush)
+        {
+            lastFlush = frame;
+        }
+
+        int64_t start = ThreadCpuNs();
+        bool succeeded = SilenceSink->Write(&block[0], frames * format->nBlockAlign) && (!flush || SilenceSink->Flush());
+        int64_t middle = ThreadCpuNs();
+        succeeded = pcmSink.Write(&block[0], frames * format->nBlockAlign) && (!flush || pcmSink.Flush()) && succeeded;
+        *SilenceCpuNs += middle - start;
+        *PcmCpuNs += ThreadCpuNs() - middle;
+        if (!succeeded)
+        {
+            return false;
+        }
+    }
+
+    int64_t start = ThreadCpuNs();
+    bool succeeded = SilenceSink->Close();
+    int64_t middle = ThreadCpuNs();
+    succeeded = pcmSink.Close() && succeeded;
+    *SilenceCpuNs += middle - start;
+    *PcmCpuNs += ThreadCpuNs() - middle;
+    *Frames = frame;
+    return succeeded;
+}
+
+//
+//  Expands the file and compares it with the stream.  Frames that differ must have come back as zeros and be quiet
+//  by the scalar detector; Lossy counts them.
+//
+static bool VerifyStream(CBenchStream* Stream, const std::string& SilenceFile, double Threshold, uint64_t Frames, uint64_t* Lossy)
+{
+    CSilenceFileReader reader;
+    CSilenceDetector detector;
+    if (!reader.Open(SilenceFile) || !detector.Initialize(Stream->Format(), Threshold, SampleKernelScalar) || !Stream->Rewind())
+    {
+        return false;
+    }
+    if (reader.Frames() != Frames)
+    {
+        printf("Expanded %llu frames, recorded %llu\n", static_cast<unsigned long long>(reader.Frames()), static_cast<unsigned long long>(Frames));
+        return false;
+    }
+
+    size_t frameSize = Stream->Format()->nBlockAlign;
+    size_t blockFrames = Stream->Format()->nSamplesPerSec;
+    std::vector<uint8_t> original(blockFrames * frameSize);
+    std::vector<uint8_t> expanded(blockFrames * frameSize);
+    std::vector<uint8_t> zeros(frameSize, 0);
+    *Lossy = 0;
+    for (uint64_t frame = 0; frame < Frames;)
+    {
+        size_t frames = 0;
+        uint32_t flags;
+        for (size_t packet = 1; frames < blockFrames && packet != 0; frames += packet)
+        {
+            packet = Stream->Next(&original[frames * frameSize], blockFrames - frames, &flags);
+        }
+        if (frames == 0 || reader.Read(frame, &expanded[0], frames) != frames)
+        {
+            printf("Expanded file is short at frame %llu\n", static_cast<unsigned long long>(frame));
+            return false;
+        }
+        for (size_t i = 0; i < frames; i++)
+        {
+            const uint8_t* source = &original[i * frameSize];
+            const uint8_t* target = &expanded[i * frameSize];
+            if (memcmp(source, target, frameSize) == 0)
+            {
+                continue;
+            }
+            if (memcmp(target, &zeros[0], frameSize) != 0 || !detector.Quiet(source, 1))
+            {
+                printf("Mismatch at frame %llu\n", static_cast<unsigned long long>(frame + i));
+                return false;
+            }
+            (*Lossy)++;
+        }
+        frame += frames;
+    }
+
+    //
+    //  The sound regions are the audio records, so they must add up to the frames that weren't collapsed.
+    //
+    std::vector<SilenceFileRegion> regions;
+    reader.GetSoundRegions(&regions);
+    uint64_t soundFrames = 0;
+    for (size_t i = 0; i < regions.size(); i++)
+    {
+        soundFrames += regions[i].Frames;
+    }
+    printf("Expanded: %llu records, %llu sound regions (%.1f s of sound), %llu frames changed by the threshold\n",
+        static_cast<unsigned long long>(reader.Records()),
+        static_cast<unsigned long long>(regions.size()),
+        static_cast<double>(soundFrames) / Stream->Format()->nSamplesPerSec,
+        static_cast<unsigned long long>(*Lossy));
+    return soundFrames + reader.SilentFrames() == Frames;
+}
+
+//
+//  How fast the detector scans 10 ms chunks of silence, the worst case since nothing stops it early.
+//
+static void RunKernels(const WAVEFORMATEX* Format, double Threshold)
+{
+    static const SampleConvertKernel kernels[] = { SampleKernelScalar, SampleKernelSse2, SampleKernelAvx2 };
+    size_t chunkFrames = std::max<size_t>(Format->nSamplesPerSec / 100, 1);
+    std::vector<uint8_t> chunk(chunkFrames * Format->nBlockAlign, 0);
+    for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+    {
+        CSilenceDetector detector;
+        if (!detector.Initialize(Format, Threshold, kernels[i]))
+        {
+            return;
+        }
+        if (detector.Kernel() != kernels[i])
+        {
+            printf("Detector %s: not available\n", SampleConvertKernelName(kernels[i]));
+            continue;
+        }
+
+        uint64_t chunks = 0;
+        uint64_t quiet = 0;
+        int64_t start = SteadyClockNs();
+        int64_t elapsed = 0;
+        while (elapsed < 200000000)
+        {
+            for (int j = 0; j < 1000; j++)
+            {
+                quiet += detector.Quiet(&chunk[0], chunkFrames) ? 1 : 0;
+            }
+            chunks += 1000;
+            elapsed = SteadyClockNs() - start;
+        }
+        double bytes = static_cast<double>(chunks) * chunk.size();
+        printf("Detector %s: %.2f GB/s, %.1f ns per 10 ms chunk, %.0fx real time%s\n", SampleConvertKernelName(kernels[i]),
+            bytes / elapsed, static_cast<double>(elapsed) / chunks, static_cast<double>(chunks) * 10000000 / elapsed,
+            quiet == chunks ? "" : " (WRONG RESULT)");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    std::string replay = GetArg(argc, argv, "--replay", "");
+    uint32_t minutes = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--minutes", "10")));
+    std::string thresholdArg = GetArg(argc, argv, "--threshold-db", "");
+    double noiseDb = atof(GetArg(argc, argv, "--noise-db", "0"));
+    uint32_t minSilenceMs = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--min-silence-ms", "200")));
+    uint32_t flushMs = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--flush-ms", "1000")));
+    std::string replayFormat = GetArg(argc, argv, "--replay-format", "f32");
+    int replayRate = atoi(GetArg(argc, argv, "--replay-rate", "48000"));
+    int replayChannels = atoi(GetArg(argc, argv, "--replay-channels", "2"));
+    double thresholdDb = atof(thresholdArg.c_str());
+    bool isFloat = replayFormat == "f32";
+    int bits = isFloat ? 32 : replayFormat == "s16" ? 16 : replayFormat == "s24" ? 24 : replayFormat == "s32" ? 32 : 0;
+    if ((replay.empty() && minutes == 0) || (!thresholdArg.empty() && !(thresholdDb < 0)) || minSilenceMs == 0 || bits == 0 ||
+        replayRate <= 0 || replayChannels <= 0)
+    {
+        fprintf(stderr, "Usage: %s [--replay <file.wav|file.pcm> [--replay-format f32|s16|s24|s32] [--replay-rate N] [--replay-channels N]]\n"
+            "    [--minutes N] [--noise-db X] [--threshold-db X] [--min-silence-ms N] [--flush-ms N]\n", argv[0]);
+        return 1;
+    }
+    double threshold = thresholdArg.empty() ? 0.0 : pow(10.0, thresholdDb / 20.0);
+
+    CIdleDesktopStream idleStream(minutes, noiseDb, 1);
+    CReplayStream replayStream;
+    CBenchStream* stream = &idleStream;
+    if (!replay.empty())
+    {
+        if (!replayStream.Open(replay, isFloat, static_cast<WORD>(bits), static_cast<WORD>(replayChannels), static_cast<DWORD>(replayRate)))
+        {
+            return 1;
+        }
+        stream = &replayStream;
+    }
+    const WAVEFORMATEX* format = stream->Format();
+    printf("Stream: %s, %u Hz, %u channels, %u bit %s; threshold %s, silences of at least %u ms collapsed\n",
+        replay.empty() ? "idle desktop" : replay.c_str(), format->nSamplesPerSec, format->nChannels, format->wBitsPerSample,
+        IsFloatFormat(format) ? "float" : "integer", thresholdArg.empty() ? "digital silence" : (thresholdArg + " dBFS").c_str(), minSilenceMs);
+
+    std::string prefix = "/tmp/audio_capture_silence_bench_" + std::to_string(getpid());
+    std::string silenceFile = prefix + ".acs";
+    std::string pcmFile = prefix + ".pcm";
+    CSilenceFileSink sink;
+    uint64_t frames = 0;
+    int64_t silenceCpuNs = 0;
+    int64_t pcmCpuNs = 0;
+    bool passed = RecordStream(stream, silenceFile, pcmFile, threshold, minSilenceMs, flushMs, &sink, &frames, &silenceCpuNs, &pcmCpuNs);
+    if (passed)
+    {
+        SilenceFileStats stats;
+        sink.GetStats(&stats);
+        double seconds = static_cast<double>(frames) / format->nSamplesPerSec;
+        uint64_t rawBytes = frames * format->nBlockAlign;
+        printf("Storage: %.1f s, %llu -> %llu bytes (ratio %.4f), %.1f%% of frames collapsed into %llu silence records, %llu audio records\n",
+            seconds,
+            static_cast<unsigned long long>(rawBytes),
+            static_cast<unsigned long long>(stats.BytesWritten),
+            rawBytes != 0 ? static_cast<double>(stats.BytesWritten) / rawBytes : 0.0,
+            frames != 0 ? stats.SilentFrames * 100.0 / frames : 0.0,
+            static_cast<unsigned long long>(stats.SilenceRecords),
+            static_cast<unsigned long long>(stats.AudioRecords));
+        printf("CPU per audio second: silence sink %.1f us (detection %.1f us, %s kernel), pcm sink %.1f us\n",
+            silenceCpuNs / 1000.0 / seconds, stats.DetectUs / seconds, SampleConvertKernelName(sink.DetectorKernel()),
+            pcmCpuNs / 1000.0 / seconds);
+
+        uint64_t lossy = 0;
+        passed = VerifyStream(stream, silenceFile, threshold, frames, &lossy) && (!thresholdArg.empty() || lossy == 0);
+        printf("%s\n", !passed ? "ROUND TRIP MISMATCH." : thresholdArg.empty() ? "Round trip exact." : "Round trip exact outside quiet frames.");
+    }
+    unlink(silenceFile.c_str());
+    unlink(pcmFile.c_str());
+
+    RunKernels(format, threshold);
+    return passed ? 0 : 1;
+}
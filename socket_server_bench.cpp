@@ -0,0 +1,490 @@
+//
+//  Load benchmark of the socket server on Linux.
+//
+//  This process serves --seconds of 48 kHz stereo float through CSocketServerSink, paced at --speed times real time
+//  (0 is as fast as it goes), and a forked process subscribes --clients times over a Unix socket (or --tcp PORT)
+//  and checks every stream: header, block headers, sequence and frame continuity, and the payload pattern, all with
+//  one epoll loop and an incremental parser per subscriber.  The first --slow subscribers only read at half the
+//  stream rate, to show the lag policy (--policy disconnect|skip, --max-lag-ms): they get cut off or skipped ahead
+//  while the others must still receive everything.  The server's CPU time comes from getrusage() and covers the
+//  writer and the event loop thread.  At --speed 0 the writer outruns any subscriber, so give it a --max-lag-ms
+//  longer than the stream.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "CaptureDrain.h"
+#include "SocketServerSink.h"
+
+struct SubscriberTotals
+{
+    uint64_t Subscribers;
+    uint64_t Completed;         // Got the end of stream block.
+    uint64_t Disconnected;      // Closed by the server before the end.
+    uint64_t Invalid;           // Bad header, block header or stream position.
+    uint64_t Blocks;
+    uint64_t PayloadBytes;
+    uint64_t GapFrames;
+    uint64_t SequenceGaps;
+    uint64_t CorruptBlocks;
+};
+
+struct Subscriber
+{
+    int                     Fd;
+    bool                    Slow;
+    bool                    HaveHeader;
+    bool                    HaveBlock;
+    bool                    Done;
+    size_t                  FrameSize;
+    std::vector<uint8_t>    Pending;
+    uint64_t                NextSequence;
+    uint64_t                NextFrame;
+    SubscriberTotals        Totals;
+};
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static double CpuSeconds()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000000.0;
+}
+
+static void AddTotals(SubscriberTotals* Sum, const SubscriberTotals& Totals)
+{
+    Sum->Subscribers += Totals.Subscribers;
+    Sum->Completed += Totals.Completed;
+    Sum->Disconnected += Totals.Disconnected;
+    Sum->Invalid += Totals.Invalid;
+    Sum->Blocks += Totals.Blocks;
+    Sum->PayloadBytes += Totals.PayloadBytes;
+    Sum->GapFrames += Totals.GapFrames;
+    Sum->SequenceGaps += Totals.SequenceGaps;
+    Sum->CorruptBlocks += Totals.CorruptBlocks;
+}
+
+//
+//  Parse whatever complete pieces of the stream have arrived.  The first block a subscriber gets may start
+//  anywhere; after that, sequence and frame gaps are counted.
+//
+static void ParseStream(Subscriber* Client)
+{
+    size_t offset = 0;
+    const size_t available = Client->Pending.size();
+    while (!Client->Done)
+    {
+        const uint8_t* data = Client->Pending.data() + offset;
+        size_t size = available - offset;
+        if (!Client->HaveHeader)
+        {
+            if (size < sizeof(FramedStreamHeader))
+            {
+                break;
+            }
+            FramedStreamHeader header;
+            memcpy(&header, data, sizeof(header));
+            if (header.Magic != FRAMED_STREAM_MAGIC || header.HeaderSize != sizeof(FramedStreamHeader) ||
+                header.BlockHeaderSize != sizeof(FramedStreamBlockHeader) || header.Format.Format.nBlockAlign == 0)
+            {
+                Client->Totals.Invalid++;
+                Client->Done = true;
+                break;
+            }
+            Client->FrameSize = header.Format.Format.nBlockAlign;
+            Client->HaveHeader = true;
+            offset += sizeof(header);
+            continue;
+        }
+
+        if (size < sizeof(FramedStreamBlockHeader))
+        {
+            break;
+        }
+        FramedStreamBlockHeader block;
+        memcpy(&block, data, sizeof(block));
+        if (block.Magic != FRAMED_STREAM_BLOCK_MAGIC || block.PayloadSize % Client->FrameSize != 0 ||
+            (Client->HaveBlock && (block.Sequence < Client->NextSequence || block.Frame < Client->NextFrame)))
+        {
+            Client->Totals.Invalid++;
+            Client->Done = true;
+            break;
+        }
+        if (size < sizeof(block) + block.PayloadSize)
+        {
+            break;
+        }
+        if (Client->HaveBlock)
+        {
+            Client->Totals.SequenceGaps += block.Sequence - Client->NextSequence;
+            Client->Totals.GapFrames += block.Frame - Client->NextFrame;
+        }
+        if (block.Flags & FRAMED_STREAM_FLAG_END_OF_STREAM)
+        {
+            Client->Totals.Completed++;
+            Client->Done = true;
+            break;
+        }
+
+        const uint8_t* payload = data + sizeof(block);
+        uint64_t frames = block.PayloadSize / Client->FrameSize;
+        for (uint64_t i = 0; i < frames; i++)
+        {
+            uint32_t word;
+            memcpy(&word, payload + i * Client->FrameSize, sizeof(word));
+            if (word != static_cast<uint32_t>(block.Frame + i))
+            {
+                Client->Totals.CorruptBlocks++;
+                break;
+            }
+        }
+        Client->Totals.Blocks++;
+        Client->Totals.PayloadBytes += block.PayloadSize;
+        Client->HaveBlock = true;
+        Client->NextSequence = block.Sequence + 1;
+        Client->NextFrame = block.Frame + frames;
+        offset += sizeof(block) + block.PayloadSize;
+    }
+    Client->Pending.erase(Client->Pending.begin(), Client->Pending.begin() + offset);
+}
+
+//
+//  Read up to Budget bytes.  Returns false once the server has closed the connection.
+//
+static bool ReadSubscriber(Subscriber* Client, size_t Budget)
+{
+    uint8_t buffer[65536];
+    while (Budget > 0 && !Client->Done)
+    {
+        ssize_t bytesRead = read(Client->Fd, buffer, std::min(sizeof(buffer), Budget));
+        if (bytesRead < 0 && (errno == EAGAIN || errno == EINTR))
+        {
+            return true;
+        }
+        if (bytesRead <= 0)
+        {
+            if (!Client->Done)
+            {
+                Client->Totals.Disconnected++;
+                Client->Done = true;
+            }
+            return false;
+        }
+        Client->Pending.insert(Client->Pending.end(), buffer, buffer + bytesRead);
+        Budget -= static_cast<size_t>(bytesRead);
+        ParseStream(Client);
+    }
+    return true;
+}
+
+static int Connect(const std::string& SocketPath, int TcpPort)
+{
+    for (int attempt = 0; attempt < 5000; attempt++)
+    {
+        int fd;
+        int result;
+        if (TcpPort != 0)
+        {
+            fd = socket(AF_INET, SOCK_STREAM, 0);
+            sockaddr_in address;
+            memset(&address, 0, sizeof(address));
+            address.sin_family = AF_INET;
+            address.sin_port = htons(static_cast<uint16_t>(TcpPort));
+            address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            result = connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        }
+        else
+        {
+            fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            sockaddr_un address;
+            memset(&address, 0, sizeof(address));
+            address.sun_family = AF_UNIX;
+            strncpy(address.sun_path, SocketPath.c_str(), sizeof(address.sun_path) - 1);
+            result = connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address));
+        }
+        if (result == 0)
+        {
+            return fd;
+        }
+        close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return -1;
+}
+
+//
+//  Child: subscribe Clients times and report the fast and the slow subscribers' totals through ResultPipe.
+//
+static int RunSubscribers(const std::string& SocketPath, int TcpPort, uint32_t Clients, uint32_t SlowClients,
+    size_t BytesPerSecond, int ResultPipe)
+{
+    int epoll = epoll_create1(0);
+    std::vector<Subscriber> subscribers(Clients);
+    for (uint32_t i = 0; i < Clients; i++)
+    {
+        Subscriber& client = subscribers[i];
+        client.Fd = Connect(SocketPath, TcpPort);
+        if (client.Fd < 0)
+        {
+            fprintf(stderr, "Subscriber %u failed to connect.\n", i);
+            return 1;
+        }
+        fcntl(client.Fd, F_SETFL, fcntl(client.Fd, F_GETFL) | O_NONBLOCK);
+        client.Slow = i < SlowClients;
+        client.HaveHeader = false;
+        client.HaveBlock = false;
+        client.Done = false;
+        client.FrameSize = 0;
+        client.NextSequence = 0;
+        client.NextFrame = 0;
+        memset(&client.Totals, 0, sizeof(client.Totals));
+        client.Totals.Subscribers = 1;
+
+        //
+        //  Slow subscribers are read on a timer below instead.
+        //
+        if (!client.Slow)
+        {
+            struct epoll_event event;
+            memset(&event, 0, sizeof(event));
+            event.events = EPOLLIN;
+            event.data.ptr = &client;
+            epoll_ctl(epoll, EPOLL_CTL_ADD, client.Fd, &event);
+        }
+    }
+
+    const size_t slowBudget = BytesPerSecond / 2 / 100;
+    uint32_t remaining = Clients;
+    auto nextTick = std::chrono::steady_clock::now();
+    while (remaining > 0)
+    {
+        struct epoll_event events[128];
+        int count = epoll_wait(epoll, events, 128, 10);
+        for (int i = 0; i < count; i++)
+        {
+            Subscriber* client = static_cast<Subscriber*>(events[i].data.ptr);
+            if (!client->Done)
+            {
+                ReadSubscriber(client, SIZE_MAX);
+                if (client->Done)
+                {
+                    epoll_ctl(epoll, EPOLL_CTL_DEL, client->Fd, NULL);
+                    remaining--;
+                }
+            }
+        }
+        if (std::chrono::steady_clock::now() >= nextTick)
+        {
+            nextTick += std::chrono::milliseconds(10);
+            for (uint32_t i = 0; i < SlowClients; i++)
+            {
+                if (!subscribers[i].Done)
+                {
+                    ReadSubscriber(&subscribers[i], slowBudget);
+                    remaining -= subscribers[i].Done;
+                }
+            }
+        }
+    }
+
+    SubscriberTotals totals[2];
+    memset(totals, 0, sizeof(totals));
+    for (uint32_t i = 0; i < Clients; i++)
+    {
+        AddTotals(&totals[subscribers[i].Slow ? 1 : 0], subscribers[i].Totals);
+        close(subscribers[i].Fd);
+    }
+    close(epoll);
+    return write(ResultPipe, totals, sizeof(totals)) == sizeof(totals) ? 0 : 1;
+}
+
+static void PrintTotals(const char* Name, const SubscriberTotals& Totals)
+{
+    printf("%s: %llu subscribers, %llu completed, %llu disconnected, %llu invalid; %llu blocks, %.1f MB, "
+        "%llu gap frames in %llu skipped blocks, %llu corrupt blocks\n", Name,
+        static_cast<unsigned long long>(Totals.Subscribers), static_cast<unsigned long long>(Totals.Completed),
+        static_cast<unsigned long long>(Totals.Disconnected), static_cast<unsigned long long>(Totals.Invalid),
+        static_cast<unsigned long long>(Totals.Blocks), Totals.PayloadBytes / 1048576.0,
+        static_cast<unsigned long long>(Totals.GapFrames), static_cast<unsigned long long>(Totals.SequenceGaps),
+        static_cast<unsigned long long>(Totals.CorruptBlocks));
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t clients = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--clients", "100")));
+    uint32_t slowClients = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--slow", "0")));
+    uint32_t seconds = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--seconds", "10")));
+    double speed = atof(GetArg(argc, argv, "--speed", "1"));
+    int tcpPort = atoi(GetArg(argc, argv, "--tcp", "0"));
+    std::string policyName = GetArg(argc, argv, "--policy", "disconnect");
+    uint32_t maxLagMs = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--max-lag-ms", "2000")));
+    if (clients == 0 || slowClients > clients || seconds == 0 || speed < 0 || maxLagMs == 0 ||
+        (policyName != "disconnect" && policyName != "skip"))
+    {
+        fprintf(stderr, "Usage: %s [--clients N] [--slow N] [--seconds N] [--speed X] [--tcp PORT] [--policy disconnect|skip] "
+            "[--max-lag-ms N]\n", argv[0]);
+        return 1;
+    }
+
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, 2, 48000, 32, 0);
+    const size_t frameSize = format.Format.nBlockAlign;
+    std::string socketPath = "/tmp/audio_capture_server_bench_" + std::to_string(getpid());
+    std::string address = tcpPort != 0 ? "tcp:" + std::to_string(tcpPort) : "unix:" + socketPath;
+
+    //
+    //  Fork before the server starts its thread; the subscribers keep trying to connect until it listens.
+    //
+    int resultPipe[2];
+    if (pipe(resultPipe) != 0)
+    {
+        perror("pipe");
+        return 1;
+    }
+    pid_t child = fork();
+    if (child < 0)
+    {
+        perror("fork");
+        return 1;
+    }
+    if (child == 0)
+    {
+        close(resultPipe[0]);
+        _exit(RunSubscribers(socketPath, tcpPort, clients, slowClients, format.Format.nAvgBytesPerSec, resultPipe[1]));
+    }
+    close(resultPipe[1]);
+    signal(SIGPIPE, SIG_IGN);
+
+    SocketServerOptions options;
+    options.MaxLagMs = maxLagMs;
+    options.Policy = policyName == "skip" ? SlowClientSkip : SlowClientDisconnect;
+    options.MaxClients = clients;
+    CCapturePacketLog packetLog;
+    packetLog.Initialize(4096);
+    CSocketServerSink sink;
+    if (!sink.Open(address, &format.Format, 480, &packetLog, options))
+    {
+        kill(child, SIGKILL);
+        waitpid(child, NULL, 0);
+        return 1;
+    }
+
+    SocketServerStats stats;
+    for (int attempt = 0; attempt < 10000; attempt++)
+    {
+        sink.GetServerStats(&stats);
+        if (stats.ClientsConnected == clients)
+        {
+            break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    if (stats.ClientsConnected != clients)
+    {
+        fprintf(stderr, "Only %u of %u subscribers connected.\n", stats.ClientsConnected, clients);
+    }
+
+    //
+    //  10 ms writes, each one packet in the packet log, like the capture path with a short --interval.
+    //
+    const size_t writeFrames = 480;
+    std::vector<uint8_t> chunk(writeFrames * frameSize, 0);
+    uint64_t totalFrames = static_cast<uint64_t>(seconds) * 48000;
+    double cpuStart = CpuSeconds();
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t frame = 0; frame < totalFrames; frame += writeFrames)
+    {
+        if (speed > 0)
+        {
+            std::this_thread::sleep_until(start + std::chrono::microseconds(static_cast<int64_t>(frame * 1000000 / 48000 / speed)));
+        }
+        for (size_t i = 0; i < writeFrames; i++)
+        {
+            uint32_t word = static_cast<uint32_t>(frame + i);
+            memcpy(&chunk[i * frameSize], &word, sizeof(word));
+        }
+        int64_t timeNs = static_cast<int64_t>(frame * 1000000000 / 48000);
+        CapturePacketRecord record = { frame, writeFrames, 0, 0, timeNs, timeNs, frame };
+        packetLog.Append(record);
+        packetLog.Publish();
+        if (!sink.Write(&chunk[0], chunk.size()))
+        {
+            fprintf(stderr, "Write failed.\n");
+            break;
+        }
+    }
+    sink.Close();
+    double streamSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    double cpuSeconds = CpuSeconds() - cpuStart;
+    sink.GetServerStats(&stats);
+
+    SubscriberTotals totals[2];
+    size_t received = 0;
+    while (received < sizeof(totals))
+    {
+        ssize_t bytesRead = read(resultPipe[0], reinterpret_cast<uint8_t*>(totals) + received, sizeof(totals) - received);
+        if (bytesRead <= 0)
+        {
+            break;
+        }
+        received += static_cast<size_t>(bytesRead);
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    if (received != sizeof(totals) || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        fprintf(stderr, "Subscribers failed.\n");
+        return 1;
+    }
+
+    uint64_t streamBytes = totalFrames * frameSize;
+    printf("Served %u s of audio to %u subscribers in %.3f s: %.1f MB/s out, %llu sends\n", seconds, clients, streamSeconds,
+        stats.BytesSent / 1048576.0 / streamSeconds, static_cast<unsigned long long>(stats.SendCalls));
+    printf("Server CPU: %.3f s (%.2f%% of one core, %.4f%% per subscriber)\n", cpuSeconds, cpuSeconds / streamSeconds * 100,
+        cpuSeconds / streamSeconds * 100 / clients);
+    printf("Server: %llu accepted, %llu rejected, %llu dropped for lagging, %llu skips (%.1f MB)\n",
+        static_cast<unsigned long long>(stats.ClientsAccepted), static_cast<unsigned long long>(stats.ClientsRejected),
+        static_cast<unsigned long long>(stats.ClientsDropped), static_cast<unsigned long long>(stats.Skips),
+        stats.SkippedBytes / 1048576.0);
+    PrintTotals("Subscribers", totals[0]);
+    if (slowClients != 0)
+    {
+        PrintTotals("Slow subscribers", totals[1]);
+    }
+
+    //
+    //  Every subscriber that keeps up gets the whole stream and the end of it.
+    //
+    const SubscriberTotals& fast = totals[0];
+    bool consistent = fast.Invalid == 0 && fast.CorruptBlocks == 0 && fast.GapFrames == 0 && fast.SequenceGaps == 0 &&
+        fast.Completed == fast.Subscribers && fast.PayloadBytes == streamBytes * fast.Subscribers &&
+        totals[1].Invalid == 0 && totals[1].CorruptBlocks == 0;
+    printf("%s\n", consistent ? "All subscribers consistent." : "MISMATCH in the subscribers' streams.");
+    return consistent ? 0 : 1;
+}
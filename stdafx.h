@@ -13,9 +13,14 @@
 
 #pragma once
 
+#ifdef _WIN32
+
 #include "targetver.h"
 #define _CRT_SECURE_CPP_OVERLOAD_SECURE_NAMES 1
 #include <new>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
 #include <windows.h>
 #include <strsafe.h>
 #include <objbase.h>
@@ -27,6 +32,14 @@
 
 extern bool DisableMMCSS;
 
+#else
+
+#include <new>
+
+#endif
+
+#include "AudioFormat.h"
+
 template <class T> void SafeRelease(T** ppT)
 {
     if (*ppT)
@@ -34,4 +47,4 @@ template <class T> void SafeRelease(T** ppT)
         (*ppT)->Release();
         *ppT = NULL;
     }
-}
\ No newline at end of file
+}
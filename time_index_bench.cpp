@@ -0,0 +1,215 @@
+//
+//  Capture timestamp and time index benchmark on Linux.
+//
+//  The first part records --seconds from the synthetic source in real time, with packets delivered up to
+//  --jitter-ms late, and indexes the recording every 100 ms.  The source reports when each packet was recorded, so
+//  the index times must sit on a straight line at the sample rate no matter how late the packets arrived, and
+//  start within a packet of when capture started.
+//
+//  The second part builds a --hours long index from packet records on a clock running --drift-ppm fast, and looks
+//  up random times in it: every lookup must land within a frame of the right position, in O(log n) entry reads.
+//
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include "SyntheticCaptureSource.h"
+#include "TimeIndex.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static int64_t SystemClockNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+static bool RunCaptureTimestamps(const std::string& IndexFile, uint32_t Seconds, uint32_t JitterMs)
+{
+    CSyntheticCaptureSource* source = new CSyntheticCaptureSource();
+    if (!source->Initialize(48000, 2, 32, true, 480, JitterMs, true))
+    {
+        source->Release();
+        return false;
+    }
+    const WAVEFORMATEX* format = source->MixFormat();
+    CCaptureRingBuffer ring;
+    CCapturePacketLog packetLog;
+    CTimeIndexWriter writer;
+    ring.Initialize(48000, format->nBlockAlign);
+    packetLog.Initialize(4096);
+    if (!writer.Open(IndexFile, format, 0, 4800, &packetLog))
+    {
+        source->Release();
+        return false;
+    }
+
+    CaptureProcessing processing = {};
+    processing.PacketLog = &packetLog;
+    int64_t startNs = SystemClockNs();
+    if (!source->Start(&ring, &processing))
+    {
+        source->Release();
+        return false;
+    }
+    uint64_t frames = 0;
+    while (frames < static_cast<uint64_t>(Seconds) * 48000)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        CaptureRingRegion regions[2];
+        size_t available = ring.BeginRead(ring.FrameCapacity(), regions);
+        ring.CommitRead(available);
+        frames += available;
+        writer.Update(frames);
+    }
+    source->Stop();
+    source->Shutdown();
+    source->Release();
+    writer.Close();
+
+    CTimeIndexReader reader;
+    TimeIndexEntry first;
+    if (!reader.Open(IndexFile) || !reader.ReadEntry(0, &first))
+    {
+        return false;
+    }
+    double maxDeviationUs = 0;
+    uint32_t timestampErrors = 0;
+    for (uint64_t i = 0; i < reader.Entries(); i++)
+    {
+        TimeIndexEntry entry;
+        reader.ReadEntry(i, &entry);
+        int64_t expected = first.WallTimeNs + static_cast<int64_t>((entry.Frame - first.Frame) * 1000000000 / 48000);
+        maxDeviationUs = std::max(maxDeviationUs, fabs(static_cast<double>(entry.WallTimeNs - expected)) / 1000.0);
+        timestampErrors += (entry.Flags & CAPTURE_PACKET_FLAG_TIMESTAMP_ERROR) != 0;
+    }
+    double startOffsetMs = (first.WallTimeNs - startNs) / 1000000.0;
+    printf("Capture: %llu entries over %u s with up to %u ms delivery jitter\n", static_cast<unsigned long long>(reader.Entries()),
+        Seconds, JitterMs);
+    printf("Index times vs. the sample clock: max deviation %.1f us; first entry %.2f ms after start; %u without timestamps\n",
+        maxDeviationUs, startOffsetMs, timestampErrors);
+
+    //
+    //  Within 0.5 ms of the line, well under the jitter, and the first frame recorded within a packet of the start.
+    //
+    bool passed = reader.Entries() >= Seconds * 10 - 1 && maxDeviationUs < 500 && timestampErrors == 0 &&
+        fabs(startOffsetMs) < 20;
+    printf("%s\n", passed ? "Timestamps consistent." : "TIMESTAMP MISMATCH.");
+    return passed;
+}
+
+static bool RunLookups(const std::string& IndexFile, uint32_t Hours, double DriftPpm, uint32_t Lookups)
+{
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, 2, 48000, 32, 0);
+    CCapturePacketLog packetLog;
+    CTimeIndexWriter writer;
+    packetLog.Initialize(1024);
+    const uint64_t dataOffset = 80;
+    if (!writer.Open(IndexFile, &format.Format, dataOffset, 4800, &packetLog))
+    {
+        return false;
+    }
+
+    //
+    //  10 ms packets whose wall clock runs DriftPpm fast against the sample clock.
+    //
+    const int64_t startNs = 1700000000000000000LL;
+    const double nsPerFrame = 1000000000.0 / 48000 * (1.0 + DriftPpm / 1000000.0);
+    const uint64_t totalFrames = static_cast<uint64_t>(Hours) * 3600 * 48000;
+    auto buildStart = std::chrono::steady_clock::now();
+    for (uint64_t frame = 0; frame < totalFrames; frame += 480)
+    {
+        int64_t wallNs = startNs + static_cast<int64_t>(frame * nsPerFrame);
+        CapturePacketRecord record = { frame, 480, 0, 0, wallNs, wallNs, frame };
+        packetLog.Append(record);
+        packetLog.Publish();
+        if ((frame / 480) % 100 == 99)
+        {
+            writer.Update(frame + 480);
+        }
+    }
+    writer.Update(totalFrames);
+    writer.Close();
+    double buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - buildStart).count();
+
+    CTimeIndexReader reader;
+    if (!reader.Open(IndexFile))
+    {
+        return false;
+    }
+    std::mt19937_64 random(1);
+    uint64_t maxError = 0;
+    uint64_t maxReads = 0;
+    uint64_t readsBefore = reader.EntryReads();
+    auto lookupStart = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < Lookups; i++)
+    {
+        uint64_t frame = random() % (totalFrames - 48000);
+        int64_t wallNs = startNs + static_cast<int64_t>(frame * nsPerFrame);
+        uint64_t before = reader.EntryReads();
+        TimeIndexPosition position;
+        if (!reader.FindTime(wallNs, &position) || position.ByteOffset != dataOffset + position.Frame * format.Format.nBlockAlign)
+        {
+            printf("Lookup failed at frame %llu\n", static_cast<unsigned long long>(frame));
+            return false;
+        }
+        uint64_t error = position.Frame > frame ? position.Frame - frame : frame - position.Frame;
+        maxError = std::max(maxError, error);
+        maxReads = std::max(maxReads, reader.EntryReads() - before);
+    }
+    double lookupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - lookupStart).count();
+
+    uint64_t logEntries = 0;
+    while ((1ULL << logEntries) < reader.Entries())
+    {
+        logEntries++;
+    }
+    printf("Index: %u h, %llu entries (%.1f MB), built in %.2f s\n", Hours, static_cast<unsigned long long>(reader.Entries()),
+        (sizeof(TimeIndexHeader) + reader.Entries() * sizeof(TimeIndexEntry)) / 1048576.0, buildSeconds);
+    printf("Lookups: %u in %.3f s (%.1f us each), %.1f entry reads on average, %llu at most (log2 n = %llu), max error %llu frames\n",
+        Lookups, lookupSeconds, lookupSeconds * 1000000 / Lookups, static_cast<double>(reader.EntryReads() - readsBefore) / Lookups,
+        static_cast<unsigned long long>(maxReads), static_cast<unsigned long long>(logEntries), static_cast<unsigned long long>(maxError));
+
+    bool passed = maxError <= 1 && maxReads <= logEntries + 2;
+    printf("%s\n", passed ? "Lookups consistent." : "LOOKUP MISMATCH.");
+    return passed;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t seconds = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--seconds", "5")));
+    uint32_t jitterMs = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--jitter-ms", "8")));
+    uint32_t hours = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--hours", "24")));
+    double driftPpm = atof(GetArg(argc, argv, "--drift-ppm", "50"));
+    uint32_t lookups = static_cast<uint32_t>(atoi(GetArg(argc, argv, "--lookups", "100000")));
+    if (hours == 0 || lookups == 0)
+    {
+        fprintf(stderr, "Usage: %s [--seconds N] [--jitter-ms N] [--hours N] [--drift-ppm X] [--lookups N]\n", argv[0]);
+        return 1;
+    }
+
+    std::string indexFile = "/tmp/audio_capture_index_bench_" + std::to_string(getpid()) + ".idx";
+    bool passed = true;
+    if (seconds != 0)
+    {
+        passed = RunCaptureTimestamps(indexFile, seconds, jitterMs);
+    }
+    passed = RunLookups(indexFile, hours, driftPpm, lookups) && passed;
+    unlink(indexFile.c_str());
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+//
+//  WAV to RF64 test on Linux.
+//
+//  - sink: CWavFileSink writes a little over 4 GiB of stereo float, as the writer thread would, flushing right at
+//    the largest data size a plain WAV header can describe, one frame past it, and at Close().  After each flush the
+//    header must be a plain WAV and then RF64 (EBU Tech 3306: RIFF and data sizes 0xFFFFFFFF, the real sizes in the
+//    ds64 chunk that took the JUNK chunk's place), and ReadWavHeader() must agree; the audio at both ends must be
+//    intact.  The data written is punched out of the file as it goes, so the test only needs a few MB of disk.
+//  - repair: a recording that crashed after its last flush at 1 GiB, left as a sparse file with 5 GiB of audio and a
+//    partial frame, must be repaired into an RF64 file covering every complete frame.
+//
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include "AudioFormat.h"
+#include "OutputSink.h"
+#include "WavFile.h"
+
+static const char* GetArg(int argc, char* argv[], const char* Name, const char* Default)
+{
+    for (int i = 1; i < argc - 1; i++)
+    {
+        if (strcmp(argv[i], Name) == 0)
+        {
+            return argv[i + 1];
+        }
+    }
+    return Default;
+}
+
+static uint32_t ReadLE32(const uint8_t* Data)
+{
+    return Data[0] | (Data[1] << 8) | (Data[2] << 16) | (static_cast<uint32_t>(Data[3]) << 24);
+}
+
+static uint64_t ReadLE64(const uint8_t* Data)
+{
+    return ReadLE32(Data) | (static_cast<uint64_t>(ReadLE32(Data + 4)) << 32);
+}
+
+//
+//  The byte at Offset into the audio data.
+//
+static uint8_t PatternByte(uint64_t Offset)
+{
+    return static_cast<uint8_t>(Offset * 131 + (Offset >> 20) + 7);
+}
+
+//
+//  Checks the file's header describes DataSize bytes of audio, as a plain WAV or as RF64, both by its raw fields
+//  and through ReadWavHeader().
+//
+static bool CheckHeader(const std::string& FileName, uint64_t DataSize, bool ExpectRF64, const char* When)
+{
+    FILE* file = fopen(FileName.c_str(), "rb");
+    if (file == NULL)
+    {
+        fprintf(stderr, "Unable to open %s\n", FileName.c_str());
+        return false;
+    }
+    uint8_t header[WAV_HEADER_MAX_SIZE];
+    WavFileInfo info;
+    bool succeeded = fread(header, 1, sizeof(header), file) == sizeof(header) && ReadWavHeader(file, &info);
+    uint64_t fileSize = FileSize64(file);
+    fclose(file);
+    if (!succeeded)
+    {
+        fprintf(stderr, "%s: the header can't be read.\n", When);
+        return false;
+    }
+
+    uint64_t riffSize = info.DataOffset + DataSize + (DataSize & 1) - 8;
+    bool isRF64 = memcmp(header, "RF64", 4) == 0;
+    if (ExpectRF64)
+    {
+        succeeded = isRF64 && ReadLE32(header + 4) == 0xFFFFFFFF && memcmp(header + 12, "ds64", 4) == 0 &&
+            ReadLE64(header + 20) == riffSize && ReadLE64(header + 28) == DataSize &&
+            ReadLE32(header + info.DataOffset - 4) == 0xFFFFFFFF;
+    }
+    else
+    {
+        succeeded = memcmp(header, "RIFF", 4) == 0 && ReadLE32(header + 4) == riffSize && memcmp(header + 12, "JUNK", 4) == 0 &&
+            ReadLE32(header + info.DataOffset - 4) == DataSize;
+    }
+    succeeded = succeeded && info.IsRF64 == ExpectRF64 && info.DataSize == DataSize && info.Ds64Offset == 12 &&
+        fileSize >= info.DataOffset + DataSize;
+    printf("%-26s %s, %llu bytes of audio, header says %llu: %s\n", When, isRF64 ? "RF64" : "WAVE",
+        static_cast<unsigned long long>(DataSize), static_cast<unsigned long long>(info.DataSize), succeeded ? "ok" : "FAILED");
+    return succeeded;
+}
+
+//
+//  Checks Size bytes of audio at Offset into the data still hold the pattern.
+//
+static bool CheckData(const std::string& FileName, uint64_t DataOffset, uint64_t Offset, size_t Size)
+{
+    int fd = open(FileName.c_str(), O_RDONLY);
+    std::vector<uint8_t> data(Size);
+    bool succeeded = fd >= 0 && pread(fd, &data[0], Size, static_cast<off_t>(DataOffset + Offset)) == static_cast<ssize_t>(Size);
+    for (size_t i = 0; i < Size && succeeded; i++)
+    {
+        succeeded = data[i] == PatternByte(Offset + i);
+    }
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    if (!succeeded)
+    {
+        fprintf(stderr, "Audio at %llu is wrong.\n", static_cast<unsigned long long>(Offset));
+    }
+    return succeeded;
+}
+
+class CPatternWriter
+{
+public:
+    CPatternWriter(CWavFileSink* Sink, const std::string& FileName, size_t HeaderSize) :
+        _Sink(Sink), _Fd(open(FileName.c_str(), O_RDWR)), _HeaderSize(HeaderSize), _Block(64 * 1024 * 1024), _Written(0)
+    {
+    }
+
+    ~CPatternWriter()
+    {
+        if (_Fd >= 0)
+        {
+            close(_Fd);
+        }
+    }
+
+    //
+    //  Writes the pattern up to Size bytes of audio in all, giving back the disk space of all but the first and the
+    //  latest 1 MB.
+    //
+    bool WriteUpTo(uint64_t Size)
+    {
+        while (_Written < Size)
+        {
+            size_t bytes = Size - _Written < _Block.size() ? static_cast<size_t>(Size - _Written) : _Block.size();
+            for (size_t i = 0; i < bytes; i++)
+            {
+                _Block[i] = PatternByte(_Written + i);
+            }
+            if (!_Sink->Write(&_Block[0], bytes))
+            {
+                return false;
+            }
+            _Written += bytes;
+
+            const uint64_t keep = 1024 * 1024;
+            if (_Written > 2 * keep && _Fd >= 0)
+            {
+                fallocate(_Fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, static_cast<off_t>(_HeaderSize + keep),
+                    static_cast<off_t>(_Written - 2 * keep));
+            }
+        }
+        return true;
+    }
+
+private:
+    CWavFileSink*           _Sink;
+    int                     _Fd;
+    size_t                  _HeaderSize;
+    std::vector<uint8_t>    _Block;
+    uint64_t                _Written;
+};
+
+static bool RunSink(const std::string& FileName, const WAVEFORMATEX* Format, size_t HeaderSize)
+{
+    CWavFileSink sink;
+    if (!sink.Open(FileName, Format))
+    {
+        return false;
+    }
+
+    //
+    //  The RIFF size, the header past its first 8 bytes plus the data, has to fit in 32 bits.
+    //
+    uint64_t largestPlain = 0xFFFFFFFFull - (HeaderSize - 8);
+    largestPlain -= largestPlain % Format->nBlockAlign;
+    uint64_t finalSize = largestPlain + 1000 * Format->nBlockAlign;
+
+    CPatternWriter writer(&sink, FileName, HeaderSize);
+    bool succeeded =
+        writer.WriteUpTo(largestPlain) && sink.Flush() && CheckHeader(FileName, largestPlain, false, "Largest plain WAV") &&
+        writer.WriteUpTo(largestPlain + Format->nBlockAlign) && sink.Flush() &&
+        CheckHeader(FileName, largestPlain + Format->nBlockAlign, true, "One frame more") &&
+        writer.WriteUpTo(finalSize) && sink.Close() && CheckHeader(FileName, finalSize, true, "Closed") &&
+        CheckData(FileName, HeaderSize, 0, 1024 * 1024) && CheckData(FileName, HeaderSize, finalSize - 1024 * 1024, 1024 * 1024);
+    return succeeded;
+}
+
+static bool RunRepair(const std::string& FileName, const WAVEFORMATEX* Format)
+{
+    //
+    //  The header as the last flush left it, at 1 GiB, then 5 GiB of audio and half a frame.
+    //
+    const uint64_t flushedSize = 1ull << 30;
+    const uint64_t audioSize = 5ull << 30;
+    uint8_t header[WAV_HEADER_MAX_SIZE];
+    size_t headerSize = BuildWavHeader(Format, flushedSize, header);
+    int fd = open(FileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+    {
+        fprintf(stderr, "Unable to create %s\n", FileName.c_str());
+        return false;
+    }
+    std::vector<uint8_t> tail(1024 * 1024);
+    for (size_t i = 0; i < tail.size(); i++)
+    {
+        tail[i] = PatternByte(audioSize - tail.size() + i);
+    }
+    bool succeeded = write(fd, header, headerSize) == static_cast<ssize_t>(headerSize) &&
+        pwrite(fd, &tail[0], tail.size(), static_cast<off_t>(headerSize + audioSize - tail.size())) == static_cast<ssize_t>(tail.size()) &&
+        ftruncate(fd, static_cast<off_t>(headerSize + audioSize + Format->nBlockAlign / 2)) == 0;
+    close(fd);
+
+    return succeeded && CheckHeader(FileName, flushedSize, false, "Crashed at 1 GiB") && RepairWavFile(FileName) &&
+        CheckHeader(FileName, audioSize, true, "Repaired") && CheckData(FileName, headerSize, audioSize - tail.size(), tail.size());
+}
+
+int main(int argc, char* argv[])
+{
+    std::string directory = GetArg(argc, argv, "--dir", "/tmp");
+    std::string fileName = directory + "/audio_capture_wav_bench_" + std::to_string(getpid()) + ".wav";
+
+    WAVEFORMATEXTENSIBLE format;
+    InitializeWaveFormat(&format, true, 2, 48000, 32, SPEAKER_FRONT_LEFT | SPEAKER_FRONT_RIGHT);
+    uint8_t header[WAV_HEADER_MAX_SIZE];
+    size_t headerSize = BuildWavHeader(&format.Format, 0, header);
+
+    bool passed = RunSink(fileName, &format.Format, headerSize);
+    unlink(fileName.c_str());
+    passed = RunRepair(fileName, &format.Format) && passed;
+    unlink(fileName.c_str());
+    printf("%s\n", passed ? "ok" : "FAILED");
+    return passed ? 0 : 1;
+}